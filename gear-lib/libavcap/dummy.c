@@ -155,7 +155,7 @@ static int dummy_dequeue(struct avcap_ctx *avcap, struct video_frame *frame)
         }
         lseek(c->fd, c->seek_offset, SEEK_SET);
     }
-    if (-1 == clock_gettime(CLOCK_REALTIME, &ts)) {
+    if (-1 == clock_gettime(CLOCK_MONOTONIC, &ts)) {
         printf("clock_gettime failed %d:%s\n", errno, strerror(errno));
         return -1;
     }
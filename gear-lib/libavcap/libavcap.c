@@ -92,6 +92,9 @@ void avcap_close(struct avcap_ctx *avcap)
         printf("%s:%d invalid paraments!\n", __func__, __LINE__);
         return;
     }
+    if (avcap->pipeline) {
+        avcap_pipeline_stop(avcap);
+    }
     avcap->ops->_close(avcap);
     free(avcap);
 }
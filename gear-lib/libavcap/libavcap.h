@@ -65,6 +65,22 @@ enum avcap_backend_type {
 struct avcap_ctx;
 typedef int (media_frame_cb)(struct avcap_ctx *c, struct media_frame *frame);
 
+#define AVCAP_MAX_CONSUMERS 8
+
+enum avcap_overflow {
+    AVCAP_OVERFLOW_DROP_OLDEST,     /* lagging consumers skip to the oldest kept frame */
+    AVCAP_OVERFLOW_DROP_NEWEST,     /* capture drops frames the slowest consumer has no room for */
+};
+
+struct avcap_pipeline;
+struct avcap_consumer;
+typedef int (avcap_consumer_cb)(struct avcap_consumer *s, struct media_frame *frame, void *opaque);
+
+struct avcap_stat {
+    uint64_t frames;
+    uint64_t dropped;
+};
+
 struct avcap_config {
     enum avcap_type type;
     enum avcap_backend_type backend;
@@ -80,6 +96,7 @@ struct avcap_ctx {
     const struct avcap_ops *ops;
     media_frame_cb *on_media_frame;
     void *opaque;
+    struct avcap_pipeline *pipeline;
 };
 
 struct avcap_ops {
@@ -118,6 +135,33 @@ GEAR_API int avcap_query_frame(struct avcap_ctx *c, struct media_frame *frame);
 GEAR_API int avcap_start_stream(struct avcap_ctx *avcap, media_frame_cb *cb);
 GEAR_API int avcap_stop_stream(struct avcap_ctx *avcap);
 
+/*
+ * capture pipeline: the backend thread copies every frame once into a
+ * ring of ring_size refcounted frames, timestamped with the monotonic
+ * clock at dequeue (ns since start) and numbered in frame_id. Consumers
+ * share these frames by reference and never stall the capture.
+ */
+GEAR_API int avcap_pipeline_start(struct avcap_ctx *avcap, int ring_size, enum avcap_overflow policy);
+GEAR_API int avcap_pipeline_stop(struct avcap_ctx *avcap);
+GEAR_API void avcap_pipeline_get_stat(struct avcap_ctx *avcap, struct avcap_stat *st);
+
+/*
+ * with cb set the consumer gets its own thread calling cb for each frame,
+ * otherwise frames are pulled with avcap_consumer_read(). Consumers start
+ * at the next captured frame. cb may delete its own consumer, it gets no
+ * more frames once it returns.
+ */
+GEAR_API struct avcap_consumer *avcap_consumer_add(struct avcap_ctx *avcap, avcap_consumer_cb *cb, void *opaque);
+GEAR_API void avcap_consumer_del(struct avcap_consumer *s);
+GEAR_API void avcap_consumer_get_stat(struct avcap_consumer *s, struct avcap_stat *st);
+
+/*
+ * timeout_ms < 0 waits forever, returns -1 on timeout or once the pipeline
+ * stopped and drained. The frame holds a reference until avcap_frame_release
+ */
+GEAR_API int avcap_consumer_read(struct avcap_consumer *s, struct media_frame *frame, int timeout_ms);
+GEAR_API void avcap_frame_release(struct media_frame *frame);
+
 
 #ifdef __cplusplus
 }
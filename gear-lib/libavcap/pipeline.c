@@ -0,0 +1,521 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#include "libavcap.h"
+#include <libthread.h>
+#if !defined (_MSC_VER)
+#include <libatomic.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+/*
+ * Capture pipeline
+ *
+ * The backend thread is the only producer: it copies each frame once into
+ * a pooled media_buffer owned by a ring slot and publishes it by bumping
+ * head. Consumers keep their own cursor and take a reference to the slot
+ * buffer, so any number of them read the same frame without copies or
+ * locks. A slot still referenced when it comes around again gets a fresh
+ * buffer, the capture thread never waits for a consumer.
+ *
+ * slot seq is 2n+2 while it holds frame n and odd while it is rewritten.
+ * A reader pins the slot (readers++) before checking seq and referencing
+ * the buffer, the producer only swaps buffers once the pins are gone.
+ * The mutex/cond pair is only used to park idle consumers.
+ */
+
+#define AVCAP_CONSUMER_POLL_MS  100
+
+#if defined (_MSC_VER)
+#define ring_load(p)        InterlockedCompareExchange64((volatile LONG64 *)(p), 0, 0)
+#define ring_store(p, v)    InterlockedExchange64((volatile LONG64 *)(p), (v))
+#define pin_get(p)          InterlockedCompareExchange((volatile LONG *)(p), 0, 0)
+#define pin_inc(p)          InterlockedIncrement((volatile LONG *)(p))
+#define pin_dec(p)          InterlockedDecrement((volatile LONG *)(p))
+#define cpu_relax()         YieldProcessor()
+#else
+#define ring_load(p)        __atomic_load_n(p, __ATOMIC_SEQ_CST)
+#define ring_store(p, v)    __atomic_store_n(p, v, __ATOMIC_SEQ_CST)
+#define pin_get(p)          __atomic_load_n(p, __ATOMIC_SEQ_CST)
+#define pin_inc(p)          __atomic_add_fetch(p, 1, __ATOMIC_SEQ_CST)
+#define pin_dec(p)          __atomic_sub_fetch(p, 1, __ATOMIC_SEQ_CST)
+#endif
+
+struct ring_slot {
+    volatile uint64_t   seq;
+    volatile int        readers;
+    struct media_frame  frame;      /* MEDIA_MEM_REF */
+};
+
+struct avcap_consumer {
+    struct avcap_pipeline *pipeline;
+    volatile int        used;
+    volatile uint64_t   next;       /* next frame number to read */
+    avcap_consumer_cb  *cb;
+    void               *opaque;
+    struct thread      *thread;
+    volatile int        run;
+    uint64_t            frames;
+    uint64_t            dropped;
+};
+
+struct avcap_pipeline {
+    struct avcap_ctx   *avcap;
+    enum avcap_overflow policy;
+    uint32_t            window;     /* frames a consumer may lag behind */
+    uint32_t            mask;
+    struct ring_slot   *slots;
+    volatile uint64_t   head;       /* frames published */
+    volatile int        running;
+    uint64_t            start_ts;
+    uint64_t            dropped;
+    pthread_mutex_t     lock;
+    pthread_cond_t      cond;
+    volatile int        waiters;
+    struct avcap_consumer consumers[AVCAP_MAX_CONSUMERS];
+};
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void frame_planes(struct media_frame *f, uint8_t ***data, int *num,
+                struct media_buffer ***buf, uint64_t **size)
+{
+    if (f->type == MEDIA_TYPE_VIDEO) {
+        *data = f->video.data;
+        *num  = VIDEO_MAX_PLANES;
+        *buf  = &f->video.buf;
+        *size = &f->video.total_size;
+    } else {
+        *data = f->audio.data;
+        *num  = AUDIO_MAX_CHANNELS;
+        *buf  = &f->audio.buf;
+        *size = &f->audio.total_size;
+    }
+}
+
+/*
+ * one memcpy of the whole frame, planes keep their offsets from data[0]
+ */
+static int slot_fill(struct ring_slot *slot, const struct media_frame *src)
+{
+    struct media_frame *dst = &slot->frame;
+    struct media_buffer *buf, **pbuf;
+    uint8_t **sdata, **ddata;
+    uint64_t *psize, size;
+    const uint8_t *base;
+    int i, num;
+
+    frame_planes((struct media_frame *)src, &sdata, &num, &pbuf, &psize);
+    base = sdata[0];
+    size = *psize;
+    if (!base || !size) {
+        return -1;
+    }
+    for (i = 1; i < num; i++) {
+        if (sdata[i] && (sdata[i] < base || sdata[i] >= base + size)) {
+            printf("%s: planes are not contiguous!\n", __func__);
+            return -1;
+        }
+    }
+    frame_planes(dst, &ddata, &num, &pbuf, &psize);
+    buf = *pbuf;
+    if (!buf || !media_buffer_is_writable(buf) || buf->size < size) {
+        media_buffer_unref(buf);
+        buf = media_buffer_alloc(size);
+        if (!buf) {
+            *pbuf = NULL;
+            return -1;
+        }
+    }
+    memcpy(buf->data, base, size);
+    memcpy(dst, src, sizeof(struct media_frame));
+    frame_planes(dst, &ddata, &num, &pbuf, &psize);
+    for (i = 0; i < num; i++) {
+        ddata[i] = sdata[i] ? buf->data + (sdata[i] - base) : NULL;
+    }
+    *pbuf = buf;
+    if (dst->type == MEDIA_TYPE_VIDEO) {
+        dst->video.mem_type = MEDIA_MEM_REF;
+    } else {
+        dst->audio.mem_type = MEDIA_MEM_REF;
+    }
+    return 0;
+}
+
+static void slot_clear(struct ring_slot *slot)
+{
+    struct media_buffer **pbuf;
+    uint8_t **data;
+    uint64_t *size;
+    int num;
+
+    frame_planes(&slot->frame, &data, &num, &pbuf, &size);
+    media_buffer_unref(*pbuf);
+    *pbuf = NULL;
+}
+
+static uint64_t min_cursor(struct avcap_pipeline *p, uint64_t n)
+{
+    uint64_t next, min = n;
+    int i;
+    for (i = 0; i < AVCAP_MAX_CONSUMERS; i++) {
+        if (pin_get(&p->consumers[i].used)) {
+            next = ring_load(&p->consumers[i].next);
+            min = (next < min) ? next : min;
+        }
+    }
+    return min;
+}
+
+/*
+ * runs on the backend capture thread
+ */
+static int pipeline_ingest(struct avcap_ctx *avcap, struct media_frame *frame)
+{
+    struct avcap_pipeline *p = avcap->pipeline;
+    struct ring_slot *slot;
+    uint64_t n, ts = monotonic_ns();
+
+    if (!p || !pin_get(&p->running) || !frame) {
+        return 0;
+    }
+    n = p->head;
+    if (p->policy == AVCAP_OVERFLOW_DROP_NEWEST && n - min_cursor(p, n) >= p->window) {
+        p->dropped++;
+        return 0;
+    }
+    slot = &p->slots[n & p->mask];
+    ring_store(&slot->seq, 2 * n + 1);
+    while (pin_get(&slot->readers)) {
+        /* a reader is between its seq check and buffer ref */
+        cpu_relax();
+    }
+    if (0 != slot_fill(slot, frame)) {
+        p->dropped++;
+        return -1;
+    }
+    if (frame->type == MEDIA_TYPE_VIDEO) {
+        slot->frame.video.timestamp = ts - p->start_ts;
+        slot->frame.video.frame_id = n;
+    } else {
+        slot->frame.audio.timestamp = ts - p->start_ts;
+        slot->frame.audio.frame_id = n;
+    }
+    ring_store(&slot->seq, 2 * n + 2);
+    ring_store(&p->head, n + 1);
+    if (pin_get(&p->waiters)) {
+        pthread_mutex_lock(&p->lock);
+        pthread_cond_broadcast(&p->cond);
+        pthread_mutex_unlock(&p->lock);
+    }
+    return 0;
+}
+
+static int pipeline_wait(struct avcap_pipeline *p, struct avcap_consumer *s, int timeout_ms)
+{
+    struct timespec ts;
+    uint64_t ns;
+    int ret = 0;
+
+    if (timeout_ms == 0) {
+        return -1;
+    }
+    if (timeout_ms > 0) {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ns = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec + (uint64_t)timeout_ms * 1000000ULL;
+        ts.tv_sec = ns / 1000000000ULL;
+        ts.tv_nsec = ns % 1000000000ULL;
+    }
+    pthread_mutex_lock(&p->lock);
+    pin_inc(&p->waiters);
+    while (ret == 0 && pin_get(&p->running) && pin_get(&s->run) &&
+           ring_load(&p->head) <= s->next) {
+        if (timeout_ms > 0) {
+            ret = pthread_cond_timedwait(&p->cond, &p->lock, &ts);
+        } else {
+            ret = pthread_cond_wait(&p->cond, &p->lock);
+        }
+    }
+    pin_dec(&p->waiters);
+    pthread_mutex_unlock(&p->lock);
+    return (ring_load(&p->head) > s->next) ? 0 : -1;
+}
+
+int avcap_consumer_read(struct avcap_consumer *s, struct media_frame *frame, int timeout_ms)
+{
+    struct avcap_pipeline *p;
+    struct ring_slot *slot;
+    struct media_buffer **pbuf;
+    uint8_t **data;
+    uint64_t *size, head, n;
+    int num, ok;
+
+    if (!s || !frame || !s->pipeline) {
+        printf("%s invalid paramenters!\n", __func__);
+        return -1;
+    }
+    p = s->pipeline;
+    for (;;) {
+        head = ring_load(&p->head);
+        n = s->next;
+        if (n >= head) {
+            if (0 != pipeline_wait(p, s, timeout_ms)) {
+                return -1;
+            }
+            continue;
+        }
+        if (head - n > p->window) {
+            s->dropped += head - p->window - n;
+            n = head - p->window;
+            ring_store(&s->next, n);
+        }
+        slot = &p->slots[n & p->mask];
+        pin_inc(&slot->readers);
+        ok = (ring_load(&slot->seq) == 2 * n + 2);
+        if (ok) {
+            memcpy(frame, &slot->frame, sizeof(struct media_frame));
+            frame_planes(frame, &data, &num, &pbuf, &size);
+            media_buffer_ref(*pbuf);
+        }
+        pin_dec(&slot->readers);
+        if (ok) {
+            break;
+        }
+        /* overwritten under us, head has moved on */
+    }
+    s->frames++;
+    ring_store(&s->next, n + 1);
+    return 0;
+}
+
+void avcap_frame_release(struct media_frame *frame)
+{
+    if (!frame) {
+        return;
+    }
+    if (frame->type == MEDIA_TYPE_VIDEO) {
+        video_frame_deinit(&frame->video);
+    } else {
+        audio_frame_deinit(&frame->audio);
+    }
+}
+
+static void *consumer_thread(struct thread *t, void *arg)
+{
+    struct avcap_consumer *s = arg;
+    struct media_frame frame;
+
+    while (pin_get(&s->run)) {
+        if (0 != avcap_consumer_read(s, &frame, AVCAP_CONSUMER_POLL_MS)) {
+            if (!pin_get(&s->pipeline->running)) {
+                break;
+            }
+            continue;
+        }
+        s->cb(s, &frame, s->opaque);
+        avcap_frame_release(&frame);
+    }
+    return NULL;
+}
+
+static int consumer_is_self(struct avcap_consumer *s)
+{
+    return s->thread && pthread_equal(s->thread->tid, pthread_self());
+}
+
+struct avcap_consumer *avcap_consumer_add(struct avcap_ctx *avcap, avcap_consumer_cb *cb, void *opaque)
+{
+    struct avcap_pipeline *p;
+    struct avcap_consumer *s = NULL;
+    int i;
+
+    if (!avcap || !avcap->pipeline) {
+        printf("%s invalid paramenters!\n", __func__);
+        return NULL;
+    }
+    p = avcap->pipeline;
+    pthread_mutex_lock(&p->lock);
+    for (i = 0; i < AVCAP_MAX_CONSUMERS; i++) {
+        if (!p->consumers[i].used && !consumer_is_self(&p->consumers[i])) {
+            s = &p->consumers[i];
+            if (s->thread) {
+                /* deleted from its own cb, exits right after it returns */
+                thread_join(s->thread);
+                thread_destroy(s->thread);
+            }
+            memset(s, 0, sizeof(struct avcap_consumer));
+            s->pipeline = p;
+            s->cb = cb;
+            s->opaque = opaque;
+            s->run = 1;
+            ring_store(&s->next, ring_load(&p->head));
+            ring_store(&s->used, 1);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&p->lock);
+    if (!s) {
+        printf("%s: max %d consumers!\n", __func__, AVCAP_MAX_CONSUMERS);
+        return NULL;
+    }
+    if (cb) {
+        s->thread = thread_create(consumer_thread, s);
+        if (!s->thread) {
+            printf("%s: thread_create failed!\n", __func__);
+            ring_store(&s->used, 0);
+            return NULL;
+        }
+    }
+    return s;
+}
+
+void avcap_consumer_del(struct avcap_consumer *s)
+{
+    struct avcap_pipeline *p;
+
+    if (!s || !s->pipeline) {
+        return;
+    }
+    p = s->pipeline;
+    ring_store(&s->run, 0);
+    pthread_mutex_lock(&p->lock);
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+    if (consumer_is_self(s)) {
+        /*
+         * called from its own cb, the thread can't join itself. It stops
+         * once cb returns and is joined when the slot is reused or the
+         * pipeline stops.
+         */
+        ring_store(&s->used, 0);
+        return;
+    }
+    if (s->thread) {
+        thread_join(s->thread);
+        thread_destroy(s->thread);
+        s->thread = NULL;
+    }
+    ring_store(&s->used, 0);
+}
+
+void avcap_consumer_get_stat(struct avcap_consumer *s, struct avcap_stat *st)
+{
+    if (!s || !st) {
+        return;
+    }
+    st->frames = s->frames;
+    st->dropped = s->dropped;
+}
+
+void avcap_pipeline_get_stat(struct avcap_ctx *avcap, struct avcap_stat *st)
+{
+    if (!avcap || !avcap->pipeline || !st) {
+        return;
+    }
+    st->frames = ring_load(&avcap->pipeline->head);
+    st->dropped = avcap->pipeline->dropped;
+}
+
+int avcap_pipeline_start(struct avcap_ctx *avcap, int ring_size, enum avcap_overflow policy)
+{
+    struct avcap_pipeline *p;
+    uint32_t size = 2;
+
+    if (!avcap || ring_size < 1 || avcap->pipeline) {
+        printf("%s invalid paramenters!\n", __func__);
+        return -1;
+    }
+    /* one spare slot for the frame being written */
+    while (size < (uint32_t)ring_size + 1) {
+        size <<= 1;
+    }
+    p = calloc(1, sizeof(struct avcap_pipeline));
+    if (!p) {
+        printf("malloc avcap_pipeline failed!\n");
+        return -1;
+    }
+    p->slots = calloc(size, sizeof(struct ring_slot));
+    if (!p->slots) {
+        printf("malloc ring slots failed!\n");
+        free(p);
+        return -1;
+    }
+    p->avcap = avcap;
+    p->policy = policy;
+    p->window = ring_size;
+    p->mask = size - 1;
+    p->start_ts = monotonic_ns();
+    p->running = 1;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->cond, NULL);
+    avcap->pipeline = p;
+    if (0 != avcap_start_stream(avcap, pipeline_ingest)) {
+        printf("%s: avcap_start_stream failed!\n", __func__);
+        avcap->pipeline = NULL;
+        pthread_cond_destroy(&p->cond);
+        pthread_mutex_destroy(&p->lock);
+        free(p->slots);
+        free(p);
+        return -1;
+    }
+    return 0;
+}
+
+int avcap_pipeline_stop(struct avcap_ctx *avcap)
+{
+    struct avcap_pipeline *p;
+    uint32_t i;
+
+    if (!avcap || !avcap->pipeline) {
+        printf("%s invalid paramenters!\n", __func__);
+        return -1;
+    }
+    p = avcap->pipeline;
+    avcap_stop_stream(avcap);
+    ring_store(&p->running, 0);
+    pthread_mutex_lock(&p->lock);
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+    for (i = 0; i < AVCAP_MAX_CONSUMERS; i++) {
+        if (p->consumers[i].used || p->consumers[i].thread) {
+            avcap_consumer_del(&p->consumers[i]);
+        }
+    }
+    for (i = 0; i <= p->mask; i++) {
+        slot_clear(&p->slots[i]);
+    }
+    avcap->pipeline = NULL;
+    avcap->on_media_frame = NULL;
+    pthread_cond_destroy(&p->cond);
+    pthread_mutex_destroy(&p->lock);
+    free(p->slots);
+    free(p);
+    return 0;
+}
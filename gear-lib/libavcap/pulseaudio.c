@@ -463,8 +463,11 @@ static void read_cb(pa_stream *ps, size_t bytes, void *arg)
 
     media.type = MEDIA_TYPE_AUDIO;
 
+    memset(frame, 0, sizeof(struct audio_frame));
     frame->sample_rate = c->sample_rate;
     frame->format = pulse_to_sample_format(c->format);
+    frame->channels = c->channels;
+    frame->mem_type = MEDIA_MEM_SHALLOW;
     frame->data[0] = (uint8_t *)frames;
     frame->total_size = nbytes;
     frame->frames = nbytes / c->bytes_per_frame;
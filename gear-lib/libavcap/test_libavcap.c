@@ -176,6 +176,100 @@ int dummy_test()
     return 0;
 }
 
+static int on_encode(struct avcap_consumer *s, struct media_frame *frm, void *opaque)
+{
+    uint64_t *last = opaque;
+    *last = frm->video.frame_id;
+    return 0;
+}
+
+static int on_snapshot(struct avcap_consumer *s, struct media_frame *frm, void *opaque)
+{
+    usleep(50 * 1000);
+    return 0;
+}
+
+/* deletes its own consumer from the callback after 5 frames */
+static int on_once(struct avcap_consumer *s, struct media_frame *frm, void *opaque)
+{
+    int *cnt = opaque;
+    if (++*cnt == 5) {
+        avcap_consumer_del(s);
+    }
+    return 0;
+}
+
+int pipeline_test()
+{
+#if defined (OS_LINUX)
+    struct avcap_ctx *avcap;
+    struct avcap_consumer *enc, *snap, *motion, *once;
+    struct avcap_stat st;
+    struct media_frame frm;
+    struct video_frame *raw;
+    uint64_t last_id = 0, ts = 0, gap_max = 0;
+    int i, got = 0, once_cnt = 0, ret = 0;
+    struct avcap_config conf = {
+            .type = AVCAP_TYPE_VIDEO,
+            .backend = AVCAP_BACKEND_DUMMY,
+            .video = {
+                PIXEL_FORMAT_YUY2,
+                320,
+                240,
+                .fps = {100, 1},
+            }
+    };
+    printf("======== pipeline_test enter\n");
+    /* dummy source: 100 numbered frames */
+    raw = video_frame_create(PIXEL_FORMAT_YUY2, 320, 240, MEDIA_MEM_DEEP);
+    fp = file_open(OUTPUT_DUMMY, F_CREATE);
+    for (i = 0; i < 100; i++) {
+        memset(raw->data[0], i, raw->total_size);
+        file_write(fp, raw->data[0], raw->total_size);
+    }
+    file_close(fp);
+    video_frame_destroy(raw);
+
+    avcap = avcap_open(OUTPUT_DUMMY, &conf);
+    if (!avcap) {
+        printf("avcap_open dummy failed!\n");
+        return -1;
+    }
+    avcap_pipeline_start(avcap, 4, AVCAP_OVERFLOW_DROP_OLDEST);
+    enc = avcap_consumer_add(avcap, on_encode, &last_id);
+    snap = avcap_consumer_add(avcap, on_snapshot, NULL);
+    motion = avcap_consumer_add(avcap, NULL, NULL);
+    once = avcap_consumer_add(avcap, on_once, &once_cnt);
+    while (0 == avcap_consumer_read(motion, &frm, 1000)) {
+        if (got++ && frm.video.timestamp - ts > gap_max) {
+            gap_max = frm.video.timestamp - ts;
+        }
+        ts = frm.video.timestamp;
+        avcap_frame_release(&frm);
+    }
+    printf("motion: %d frames, max gap %" PRIu64 " ms\n", got, gap_max / 1000000);
+    avcap_consumer_get_stat(enc, &st);
+    printf("encoder: %" PRIu64 " frames, %" PRIu64 " dropped, last id %" PRIu64 "\n",
+           st.frames, st.dropped, last_id);
+    avcap_consumer_get_stat(snap, &st);
+    printf("snapshot: %" PRIu64 " frames, %" PRIu64 " dropped\n", st.frames, st.dropped);
+    avcap_consumer_get_stat(once, &st);
+    printf("once: %d callbacks, %" PRIu64 " frames\n", once_cnt, st.frames);
+    if (once_cnt != 5) {
+        printf("consumer deleted from its callback got %d frames!\n", once_cnt);
+        ret = -1;
+    }
+    avcap_pipeline_get_stat(avcap, &st);
+    printf("captured: %" PRIu64 " frames, %" PRIu64 " dropped\n", st.frames, st.dropped);
+    avcap_pipeline_stop(avcap);
+    avcap_close(avcap);
+    printf("======== pipeline_test leave\n");
+    return ret;
+#else
+    return 0;
+#endif
+}
+
 int uvc_test()
 {
 #if defined (OS_LINUX)
@@ -314,6 +408,7 @@ int main(int argc, char **argv)
 {
     v4l2_test();
     dummy_test();
+    pipeline_test();
     uvc_test();
     dshow_test();
     pulseaudio_test();
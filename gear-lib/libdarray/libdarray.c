@@ -24,20 +24,65 @@
 #include <stdlib.h>
 
 #define DARRAY_INVALID ((size_t)-1)
+#define DARRAY_MIN_CAP 4
 
 void darray_init(struct darray *dst)
 {
     dst->array = NULL;
     dst->num = 0;
     dst->capacity = 0;
+    dst->inline_buf = NULL;
+    dst->inline_cap = 0;
+    dst->alloc = NULL;
+}
+
+void darray_init_inline(struct darray *dst, void *buf, size_t capacity)
+{
+    darray_init(dst);
+    dst->inline_buf = buf;
+    dst->inline_cap = capacity;
+    dst->array = buf;
+    dst->capacity = capacity;
+}
+
+static inline int darray_is_heap(const struct darray *da)
+{
+    return da->array && da->array != da->inline_buf;
+}
+
+int darray_set_allocator(struct darray *dst, const struct darray_allocator *alloc)
+{
+    if (darray_is_heap(dst)) {
+        printf("darray already allocated, can not change allocator\n");
+        return -1;
+    }
+    dst->alloc = alloc;
+    return 0;
+}
+
+static void *darray_mem_realloc(const struct darray *da, void *ptr,
+                size_t old_size, size_t new_size)
+{
+    if (da->alloc)
+        return da->alloc->realloc(da->alloc->opaque, ptr, old_size, new_size);
+    return realloc(ptr, new_size);
+}
+
+static void darray_mem_free(const struct darray *da, void *ptr)
+{
+    if (da->alloc)
+        da->alloc->free(da->alloc->opaque, ptr);
+    else
+        free(ptr);
 }
 
 void darray_free(struct darray *dst)
 {
-    free(dst->array);
-    dst->array = NULL;
+    if (darray_is_heap(dst))
+            darray_mem_free(dst, dst->array);
+    dst->array = dst->inline_buf;
     dst->num = 0;
-    dst->capacity = 0;
+    dst->capacity = dst->inline_cap;
 }
 
 size_t darray_alloc_size(const size_t element_size,
@@ -46,7 +91,7 @@ size_t darray_alloc_size(const size_t element_size,
     return element_size * da->num;
 }
 
-static void *darray_item(const size_t element_size,
+static inline void *darray_item(const size_t element_size,
                 const struct darray *da, size_t idx)
 {
     return (void *)(((uint8_t *)da->array) + element_size * idx);
@@ -61,92 +106,136 @@ void *darray_end(const size_t element_size,
     return darray_item(element_size, da, da->num - 1);
 }
 
-void darray_reserve(const size_t element_size, struct darray *dst,
+/*
+ * heap storage is resized in place when the allocator can,
+ * inline storage is copied out once and never used again until free
+ */
+static int darray_set_capacity(const size_t element_size, struct darray *dst,
                 const size_t capacity)
 {
     void *ptr;
-    if (capacity == 0 || capacity <= dst->num)
-            return;
 
-    ptr = malloc(element_size * capacity);
-    if (dst->num)
-            memcpy(ptr, dst->array, element_size * dst->num);
-    if (dst->array)
-            free(dst->array);
+    if (darray_is_heap(dst)) {
+            ptr = darray_mem_realloc(dst, dst->array,
+                            element_size * dst->capacity,
+                            element_size * capacity);
+    } else {
+            ptr = darray_mem_realloc(dst, NULL, 0, element_size * capacity);
+            if (ptr && dst->num)
+                    memcpy(ptr, dst->array, element_size * dst->num);
+    }
+    if (!ptr) {
+            printf("darray alloc %zu items failed\n", capacity);
+            return -1;
+    }
     dst->array = ptr;
     dst->capacity = capacity;
+    return 0;
 }
 
-static void darray_ensure_capacity(const size_t element_size,
-                struct darray *dst,
+void darray_reserve(const size_t element_size, struct darray *dst,
+                const size_t capacity)
+{
+    if (capacity == 0 || capacity <= dst->capacity)
+            return;
+
+    darray_set_capacity(element_size, dst, capacity);
+}
+
+/*
+ * x2 while small, x1.5 once large: amortised O(1) push_back without
+ * doubling big buffers
+ */
+static int darray_grow(const size_t element_size, struct darray *dst,
                 const size_t new_size)
 {
     size_t new_cap;
-    void *ptr;
-    if (new_size <= dst->capacity)
-            return;
 
-    new_cap = (!dst->capacity) ? new_size : dst->capacity * 2;
+    if (dst->capacity < 1024)
+            new_cap = dst->capacity * 2;
+    else
+            new_cap = dst->capacity + dst->capacity / 2;
+    if (new_cap < DARRAY_MIN_CAP)
+            new_cap = DARRAY_MIN_CAP;
     if (new_size > new_cap)
             new_cap = new_size;
-    ptr = malloc(element_size * new_cap);
-    if (dst->capacity)
-            memcpy(ptr, dst->array, element_size * dst->capacity);
-    if (dst->array)
-            free(dst->array);
-    dst->array = ptr;
-    dst->capacity = new_cap;
+    return darray_set_capacity(element_size, dst, new_cap);
+}
+
+static inline int darray_ensure_capacity(const size_t element_size,
+                struct darray *dst,
+                const size_t new_size)
+{
+    if (LIKELY(new_size <= dst->capacity))
+            return 0;
+
+    return darray_grow(element_size, dst, new_size);
+}
+
+void darray_reserve_more(const size_t element_size, struct darray *dst,
+                const size_t num)
+{
+    darray_ensure_capacity(element_size, dst, dst->num + num);
 }
 
 void darray_resize(const size_t element_size, struct darray *dst,
                 const size_t size)
 {
-    int b_clear;
     size_t old_num;
 
     if (size == dst->num) {
             return;
-    } else if (size == 0) {
-            dst->num = 0;
+    } else if (size < dst->num) {
+            dst->num = size;
             return;
     }
 
-    b_clear = size > dst->num;
-    old_num = dst->num;
+    if (darray_ensure_capacity(element_size, dst, size))
+            return;
 
-    darray_ensure_capacity(element_size, dst, size);
+    old_num = dst->num;
     dst->num = size;
+    memset(darray_item(element_size, dst, old_num), 0,
+                    element_size * (dst->num - old_num));
+}
 
-    if (b_clear)
-            memset(darray_item(element_size, dst, old_num), 0,
-                            element_size * (dst->num - old_num));
+void darray_copy_array(const size_t element_size,
+                struct darray *dst, const void *array,
+                const size_t num)
+{
+    if (darray_ensure_capacity(element_size, dst, num))
+            return;
+    dst->num = num;
+    if (num)
+            memcpy(dst->array, array, element_size * num);
 }
 
-static void darray_copy(const size_t element_size, struct darray *dst,
+void darray_copy(const size_t element_size, struct darray *dst,
                 const struct darray *da)
 {
     if (da->num == 0) {
             darray_free(dst);
     } else {
-            darray_resize(element_size, dst, da->num);
-            memcpy(dst->array, da->array, element_size * da->num);
+            darray_copy_array(element_size, dst, da->array, da->num);
     }
 }
 
-static void darray_copy_array(const size_t element_size,
-                struct darray *dst, const void *array,
-                const size_t num)
-{
-    darray_resize(element_size, dst, num);
-    memcpy(dst->array, array, element_size * dst->num);
-}
-
-void darray_move(struct darray *dst, struct darray *src)
+void darray_move(const size_t element_size, struct darray *dst,
+                struct darray *src)
 {
     darray_free(dst);
-    memcpy(dst, src, sizeof(struct darray));
-    src->array = NULL;
-    src->capacity = 0;
+    if (darray_is_heap(src) && src->alloc == dst->alloc) {
+            dst->array = src->array;
+            dst->num = src->num;
+            dst->capacity = src->capacity;
+    } else {
+            /* inline or foreign storage can not change hands */
+            darray_copy_array(element_size, dst, src->array, src->num);
+            if (darray_is_heap(src))
+                    darray_mem_free(src, src->array);
+    }
+    src->array = src->inline_buf;
+    src->capacity = src->inline_cap;
     src->num = 0;
 }
 
@@ -154,16 +243,40 @@ size_t darray_find(const size_t element_size,
                 const struct darray *da, const void *item,
                 const size_t idx)
 {
+    const uint8_t *p;
+    uint64_t key64, v64;
+    uint32_t key32, v32;
     size_t i;
 
     if (idx > da->num) {
             return DARRAY_INVALID;
     }
 
-    for (i = idx; i < da->num; i++) {
-            void *compare = darray_item(element_size, da, i);
-            if (memcmp(compare, item, element_size) == 0)
-                    return i;
+    /* pointer and int sized items: compare words, not memcmp calls */
+    p = darray_item(element_size, da, idx);
+    switch (element_size) {
+    case sizeof(uint32_t):
+            memcpy(&key32, item, sizeof(key32));
+            for (i = idx; i < da->num; i++, p += element_size) {
+                    memcpy(&v32, p, sizeof(v32));
+                    if (v32 == key32)
+                            return i;
+            }
+            break;
+    case sizeof(uint64_t):
+            memcpy(&key64, item, sizeof(key64));
+            for (i = idx; i < da->num; i++, p += element_size) {
+                    memcpy(&v64, p, sizeof(v64));
+                    if (v64 == key64)
+                            return i;
+            }
+            break;
+    default:
+            for (i = idx; i < da->num; i++, p += element_size) {
+                    if (memcmp(p, item, element_size) == 0)
+                            return i;
+            }
+            break;
     }
 
     return DARRAY_INVALID;
@@ -172,21 +285,32 @@ size_t darray_find(const size_t element_size,
 size_t darray_push_back(const size_t element_size,
                 struct darray *dst, const void *item)
 {
-    darray_ensure_capacity(element_size, dst, ++dst->num);
-    memcpy(darray_end(element_size, dst), item, element_size);
+    if (darray_ensure_capacity(element_size, dst, dst->num + 1))
+            return DARRAY_INVALID;
+    memcpy(darray_item(element_size, dst, dst->num), item, element_size);
 
-    return dst->num - 1;
+    return dst->num++;
 }
 
-static void *darray_push_back_new(const size_t element_size,
-                struct darray *dst)
+void *darray_push_back_uninit(const size_t element_size,
+                struct darray *dst, const size_t num)
 {
-    void *last;
+    void *first;
 
-    darray_ensure_capacity(element_size, dst, ++dst->num);
+    if (darray_ensure_capacity(element_size, dst, dst->num + num))
+            return NULL;
+    first = darray_item(element_size, dst, dst->num);
+    dst->num += num;
+    return first;
+}
+
+void *darray_push_back_new(const size_t element_size,
+                struct darray *dst)
+{
+    void *last = darray_push_back_uninit(element_size, dst, 1);
 
-    last = darray_end(element_size, dst);
-    memset(last, 0, element_size);
+    if (last)
+            memset(last, 0, element_size);
     return last;
 }
 
@@ -195,51 +319,28 @@ size_t darray_push_back_array(const size_t element_size,
                 const void *array, const size_t num)
 {
     size_t old_num;
+    void *p;
+
     if (!dst)
             return 0;
     if (!array || !num)
             return dst->num;
 
     old_num = dst->num;
-    darray_resize(element_size, dst, dst->num + num);
-    memcpy(darray_item(element_size, dst, old_num), array,
-                    element_size * num);
+    p = darray_push_back_uninit(element_size, dst, num);
+    if (p)
+            memcpy(p, array, element_size * num);
 
     return old_num;
 }
 
-static size_t darray_push_back_darray(const size_t element_size,
+size_t darray_push_back_darray(const size_t element_size,
                 struct darray *dst,
                 const struct darray *da)
 {
     return darray_push_back_array(element_size, dst, da->array, da->num);
 }
 
-void darray_insert(const size_t element_size, struct darray *dst,
-                const size_t idx, const void *item)
-{
-    void *new_item;
-    size_t move_count;
-
-    if (idx > dst->num) {
-            return;
-    }
-
-    if (idx == dst->num) {
-            darray_push_back(element_size, dst, item);
-            return;
-    }
-
-    move_count = dst->num - idx;
-    darray_ensure_capacity(element_size, dst, ++dst->num);
-
-    new_item = darray_item(element_size, dst, idx);
-
-    memmove(darray_item(element_size, dst, idx + 1), new_item,
-                    move_count * element_size);
-    memcpy(new_item, item, element_size);
-}
-
 void *darray_insert_new(const size_t element_size,
                 struct darray *dst, const size_t idx)
 {
@@ -252,10 +353,12 @@ void *darray_insert_new(const size_t element_size,
     if (idx == dst->num)
             return darray_push_back_new(element_size, dst);
 
-    item = darray_item(element_size, dst, idx);
-
     move_count = dst->num - idx;
-    darray_ensure_capacity(element_size, dst, ++dst->num);
+    if (darray_ensure_capacity(element_size, dst, dst->num + 1))
+            return NULL;
+    dst->num++;
+
+    item = darray_item(element_size, dst, idx);
     memmove(darray_item(element_size, dst, idx + 1), item,
                     move_count * element_size);
 
@@ -263,7 +366,16 @@ void *darray_insert_new(const size_t element_size,
     return item;
 }
 
-static void darray_insert_array(const size_t element_size,
+void darray_insert(const size_t element_size, struct darray *dst,
+                const size_t idx, const void *item)
+{
+    void *new_item = darray_insert_new(element_size, dst, idx);
+
+    if (new_item)
+            memcpy(new_item, item, element_size);
+}
+
+void darray_insert_array(const size_t element_size,
                 struct darray *dst, const size_t idx,
                 const void *array, const size_t num)
 {
@@ -277,7 +389,8 @@ static void darray_insert_array(const size_t element_size,
             return;
 
     old_num = dst->num;
-    darray_resize(element_size, dst, dst->num + num);
+    if (!darray_push_back_uninit(element_size, dst, num))
+            return;
 
     memmove(darray_item(element_size, dst, idx + num),
                     darray_item(element_size, dst, idx),
@@ -295,9 +408,6 @@ void darray_insert_darray(const size_t element_size,
 void darray_erase(const size_t element_size, struct darray *dst,
                 const size_t idx)
 {
-    if (idx >= dst->num)
-            return;
-
     if (idx >= dst->num || !--dst->num)
             return;
 
@@ -306,6 +416,18 @@ void darray_erase(const size_t element_size, struct darray *dst,
                     element_size * (dst->num - idx));
 }
 
+void darray_erase_swap(const size_t element_size, struct darray *dst,
+                const size_t idx)
+{
+    if (idx >= dst->num)
+            return;
+
+    if (idx != --dst->num)
+            memcpy(darray_item(element_size, dst, idx),
+                            darray_item(element_size, dst, dst->num),
+                            element_size);
+}
+
 void darray_erase_item(const size_t element_size,
                 struct darray *dst, const void *item)
 {
@@ -314,6 +436,14 @@ void darray_erase_item(const size_t element_size,
             darray_erase(element_size, dst, idx);
 }
 
+void darray_erase_item_swap(const size_t element_size,
+                struct darray *dst, const void *item)
+{
+    size_t idx = darray_find(element_size, dst, item, 0);
+    if (idx != DARRAY_INVALID)
+            darray_erase_swap(element_size, dst, idx);
+}
+
 void darray_erase_range(const size_t element_size,
                 struct darray *dst, const size_t start,
                 const size_t end)
@@ -351,8 +481,7 @@ void darray_pop_back(const size_t element_size,
     if (dst->num == 0)
             return;
 
-    if (dst->num)
-            darray_erase(element_size, dst, dst->num - 1);
+    dst->num--;
 }
 
 void darray_join(const size_t element_size, struct darray *dst,
@@ -34,30 +34,74 @@
 extern "C" {
 #endif
 
+/*
+ * storage allocator, NULL means realloc/free.
+ * realloc gets the old size too, so a bump arena can copy without headers
+ */
+struct darray_allocator {
+    void *(*realloc)(void *opaque, void *ptr, size_t old_size, size_t new_size);
+    void (*free)(void *opaque, void *ptr);
+    void *opaque;
+};
+
 struct darray {
     void *array;
     size_t num;
     size_t capacity;
+    void *inline_buf;   /* small buffer storage, owned by the container */
+    size_t inline_cap;
+    const struct darray_allocator *alloc;
 };
 
 GEAR_API void darray_init(struct darray *dst);
+GEAR_API void darray_init_inline(struct darray *dst, void *buf, size_t capacity);
+GEAR_API int darray_set_allocator(struct darray *dst, const struct darray_allocator *alloc);
 GEAR_API void darray_free(struct darray *dst);
 GEAR_API size_t darray_push_back(const size_t size, struct darray *dst, const void *item);
+GEAR_API void *darray_push_back_new(const size_t size, struct darray *dst);
+GEAR_API void *darray_push_back_uninit(const size_t size, struct darray *dst, const size_t num);
 GEAR_API void darray_pop_back(const size_t size, struct darray *dst);
 GEAR_API size_t darray_find(const size_t size, const struct darray *da, const void *item,
                 const size_t idx);
 GEAR_API void *darray_end(const size_t size, const struct darray *da);
 GEAR_API void darray_reserve(const size_t size, struct darray *dst, const size_t capacity);
+GEAR_API void darray_reserve_more(const size_t size, struct darray *dst, const size_t num);
+GEAR_API void darray_copy(const size_t size, struct darray *dst, const struct darray *da);
+GEAR_API void darray_copy_array(const size_t size, struct darray *dst,
+                const void *array, const size_t num);
+GEAR_API void darray_move(const size_t size, struct darray *dst, struct darray *src);
 GEAR_API size_t darray_push_back_array(const size_t size, struct darray *dst,
                 const void *array, const size_t num);
+GEAR_API size_t darray_push_back_darray(const size_t size, struct darray *dst,
+                const struct darray *da);
 GEAR_API void darray_insert(const size_t element_size, struct darray *dst,
                 const size_t idx, const void *item);
+GEAR_API void *darray_insert_new(const size_t element_size, struct darray *dst,
+                const size_t idx);
+GEAR_API void darray_insert_array(const size_t element_size, struct darray *dst,
+                const size_t idx, const void *array, const size_t num);
+GEAR_API void darray_insert_darray(const size_t element_size, struct darray *dst,
+                const size_t idx, const struct darray *da);
 GEAR_API void darray_erase(const size_t element_size, struct darray *dst,
                 const size_t idx);
+GEAR_API void darray_erase_swap(const size_t element_size, struct darray *dst,
+                const size_t idx);
 GEAR_API void darray_erase_item(const size_t element_size,
                 struct darray *dst, const void *item);
+GEAR_API void darray_erase_item_swap(const size_t element_size,
+                struct darray *dst, const void *item);
+GEAR_API void darray_erase_range(const size_t element_size, struct darray *dst,
+                const size_t start, const size_t end);
 GEAR_API void darray_resize(const size_t element_size, struct darray *dst,
                 const size_t size);
+GEAR_API void darray_join(const size_t element_size, struct darray *dst,
+                struct darray *da);
+GEAR_API void darray_split(const size_t element_size, struct darray *dst1,
+                struct darray *dst2, const struct darray *da, const size_t idx);
+GEAR_API void darray_move_item(const size_t element_size, struct darray *dst,
+                const size_t from, const size_t to);
+GEAR_API void darray_swap(const size_t element_size, struct darray *dst,
+                const size_t a, const size_t b);
 
 
 /*
@@ -74,8 +118,24 @@ GEAR_API void darray_resize(const size_t element_size, struct darray *dst,
         };                              \
     }
 
+/*
+ * DARRAY with n items of inline storage, no heap until it outgrows them.
+ * must be set up with da_init_inline(), and never be memcpy'd: use da_move()
+ */
+#define DARRAY_INLINE(type, n)          \
+    struct {                            \
+        DARRAY(type);                   \
+        type inline_items[n];           \
+    }
+
 #define da_init(v) darray_init(&v.da)
 
+#define da_init_inline(v)                                               \
+        darray_init_inline(&v.da, v.inline_items,                       \
+                        sizeof(v.inline_items) / sizeof(v.inline_items[0]))
+
+#define da_set_allocator(v, alloc) darray_set_allocator(&v.da, alloc)
+
 #define da_free(v) darray_free(&v.da)
 
 #define da_alloc_size(v) (sizeof(*v.array) * v.num)
@@ -85,6 +145,9 @@ GEAR_API void darray_resize(const size_t element_size, struct darray *dst,
 #define da_reserve(v, capacity) \
         darray_reserve(sizeof(*v.array), &v.da, capacity)
 
+#define da_reserve_more(v, n) \
+        darray_reserve_more(sizeof(*v.array), &v.da, n)
+
 #define da_resize(v, size) darray_resize(sizeof(*v.array), &v.da, size)
 
 #define da_copy(dst, src) darray_copy(sizeof(*dst.array), &dst.da, &src.da)
@@ -92,7 +155,7 @@ GEAR_API void darray_resize(const size_t element_size, struct darray *dst,
 #define da_copy_array(dst, src_array, n) \
         darray_copy_array(sizeof(*dst.array), &dst.da, src_array, n)
 
-#define da_move(dst, src) darray_move(&dst.da, &src.da)
+#define da_move(dst, src) darray_move(sizeof(*dst.array), &dst.da, &src.da)
 
 #define da_find(v, item, idx) darray_find(sizeof(*v.array), &v.da, item, idx)
 
@@ -100,6 +163,18 @@ GEAR_API void darray_resize(const size_t element_size, struct darray *dst,
 
 #define da_push_back_new(v) darray_push_back_new(sizeof(*v.array), &v.da)
 
+/*
+ * append n uninitialised items with a single capacity check,
+ * returns the first one for the caller to fill
+ */
+#define da_push_back_uninit(v, n) \
+        darray_push_back_uninit(sizeof(*v.array), &v.da, n)
+
+/*
+ * append without capacity check, after da_reserve_more()
+ */
+#define da_push_back_unchecked(v, item) (v.array[v.num++] = (item))
+
 #define da_push_back_array(dst, src_array, n) \
         darray_push_back_array(sizeof(*dst.array), &dst.da, src_array, n)
 
@@ -122,6 +197,15 @@ GEAR_API void darray_resize(const size_t element_size, struct darray *dst,
 #define da_erase_item(dst, item) \
         darray_erase_item(sizeof(*dst.array), &dst.da, item)
 
+/*
+ * O(1) erase for unordered arrays: the last item fills the hole
+ */
+#define da_erase_swap(dst, idx) \
+        darray_erase_swap(sizeof(*dst.array), &dst.da, idx)
+
+#define da_erase_item_swap(dst, item) \
+        darray_erase_item_swap(sizeof(*dst.array), &dst.da, item)
+
 #define da_erase_range(dst, from, to) \
         darray_erase_range(sizeof(*dst.array), &dst.da, from, to)
 
@@ -70,6 +70,12 @@ int serializer_array_get_data(struct serializer *s, uint8_t **output, size_t *si
     return 0;
 }
 
+void serializer_array_reserve(struct serializer *s, size_t size)
+{
+    struct array_data *data = s->data;
+    da_reserve_more(data->bytes, size);
+}
+
 void serializer_array_reset(struct serializer *s)
 {
     struct array_data *data = s->data;
@@ -141,33 +147,57 @@ size_t s_getpos(struct serializer *s)
     return -1;
 }
 
+/*
+ * fixed width writes: bytes are composed on the stack and land with one
+ * capacity check, array serializers skip the write callback entirely
+ */
+static inline void s_write_fixed(struct serializer *s, const uint8_t *b, size_t size)
+{
+    struct array_data *data;
+    uint8_t *p;
+
+    if (s && s->write == array_write) {
+        data = s->data;
+        p = da_push_back_uninit(data->bytes, size);
+        if (p)
+            memcpy(p, b, size);
+        return;
+    }
+    s_write(s, b, size);
+}
+
 void s_w8(struct serializer *s, uint8_t u8)
 {
-    s_write(s, &u8, sizeof(uint8_t));
+    s_write_fixed(s, &u8, sizeof(uint8_t));
 }
 
 void s_wl16(struct serializer *s, uint16_t u16)
 {
-    s_w8(s, (uint8_t)u16);
-    s_w8(s, u16 >> 8);
+    uint8_t b[2] = {(uint8_t)u16, (uint8_t)(u16 >> 8)};
+    s_write_fixed(s, b, sizeof(b));
 }
 
 void s_wl24(struct serializer *s, uint32_t u24)
 {
-    s_w8(s, (uint8_t)u24);
-    s_wl16(s, (uint16_t)(u24 >> 8));
+    uint8_t b[3] = {(uint8_t)u24, (uint8_t)(u24 >> 8), (uint8_t)(u24 >> 16)};
+    s_write_fixed(s, b, sizeof(b));
 }
 
 void s_wl32(struct serializer *s, uint32_t u32)
 {
-    s_wl16(s, (uint16_t)u32);
-    s_wl16(s, (uint16_t)(u32 >> 16));
+    uint8_t b[4] = {(uint8_t)u32, (uint8_t)(u32 >> 8),
+                    (uint8_t)(u32 >> 16), (uint8_t)(u32 >> 24)};
+    s_write_fixed(s, b, sizeof(b));
 }
 
 void s_wl64(struct serializer *s, uint64_t u64)
 {
-    s_wl32(s, (uint32_t)u64);
-    s_wl32(s, (uint32_t)(u64 >> 32));
+    uint8_t b[8];
+    int i;
+    for (i = 0; i < 8; i++) {
+        b[i] = (uint8_t)(u64 >> (8 * i));
+    }
+    s_write_fixed(s, b, sizeof(b));
 }
 
 void s_wlf(struct serializer *s, float f)
@@ -182,26 +212,31 @@ void s_wld(struct serializer *s, double d)
 
 void s_wb16(struct serializer *s, uint16_t u16)
 {
-    s_w8(s, u16 >> 8);
-    s_w8(s, (uint8_t)u16);
+    uint8_t b[2] = {(uint8_t)(u16 >> 8), (uint8_t)u16};
+    s_write_fixed(s, b, sizeof(b));
 }
 
 void s_wb24(struct serializer *s, uint32_t u24)
 {
-    s_wb16(s, (uint16_t)(u24 >> 8));
-    s_w8(s, (uint8_t)u24);
+    uint8_t b[3] = {(uint8_t)(u24 >> 16), (uint8_t)(u24 >> 8), (uint8_t)u24};
+    s_write_fixed(s, b, sizeof(b));
 }
 
 void s_wb32(struct serializer *s, uint32_t u32)
 {
-    s_wb16(s, (uint16_t)(u32 >> 16));
-    s_wb16(s, (uint16_t)u32);
+    uint8_t b[4] = {(uint8_t)(u32 >> 24), (uint8_t)(u32 >> 16),
+                    (uint8_t)(u32 >> 8), (uint8_t)u32};
+    s_write_fixed(s, b, sizeof(b));
 }
 
 void s_wb64(struct serializer *s, uint64_t u64)
 {
-    s_wb32(s, (uint32_t)(u64 >> 32));
-    s_wb32(s, (uint32_t)u64);
+    uint8_t b[8];
+    int i;
+    for (i = 0; i < 8; i++) {
+        b[i] = (uint8_t)(u64 >> (56 - 8 * i));
+    }
+    s_write_fixed(s, b, sizeof(b));
 }
 
 void s_wbf(struct serializer *s, float f)
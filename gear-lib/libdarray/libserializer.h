@@ -40,6 +40,7 @@ GEAR_API int serializer_array_init(struct serializer *s);
 GEAR_API void serializer_array_deinit(struct serializer *s);
 GEAR_API int serializer_array_get_data(struct serializer *s, uint8_t **output, size_t *size);
 GEAR_API void serializer_array_reset(struct serializer *s);
+GEAR_API void serializer_array_reserve(struct serializer *s, size_t size);
 
 GEAR_API int serializer_file_init(struct serializer *s, const char *path);
 GEAR_API void serializer_file_deinit(struct serializer *s);
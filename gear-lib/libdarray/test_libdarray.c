@@ -27,21 +27,124 @@
 static int foo()
 {
     struct serializer *s, ss;
+    uint8_t *data;
+    size_t size, i;
+    static const uint8_t expect[] = {
+        0x01, 'F', 'L', 'V',
+        0x12, 0x34, 0x56, 0x78,
+        0x78, 0x56, 0x34, 0x12,
+        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+        0xab, 0xcd, 0xef,
+    };
     s = &ss;
     serializer_array_init(s);
     s_w8(s, 1);           /* Version */
     s_write(s, "FLV", 3);
+    s_wb32(s, 0x12345678);
+    s_wl32(s, 0x12345678);
+    s_wb64(s, 0x0102030405060708ULL);
+    s_wb24(s, 0xabcdef);
+    serializer_array_get_data(s, &data, &size);
+    if (size != sizeof(expect) || memcmp(data, expect, size)) {
+        printf("serializer output mismatch, size=%zu\n", size);
+        for (i = 0; i < size; i++) {
+            printf("%02x ", data[i]);
+        }
+        printf("\n");
+    } else {
+        printf("serializer output ok, size=%zu\n", size);
+    }
     serializer_array_deinit(s);
 
     return 0;
 }
 
+struct test_arena {
+    uint8_t buf[4096];
+    size_t used;
+    int frees;
+};
+
+static void *arena_realloc(void *opaque, void *ptr, size_t old_size, size_t new_size)
+{
+    struct test_arena *a = opaque;
+    void *p;
+    if (a->used + new_size > sizeof(a->buf)) {
+        return NULL;
+    }
+    p = a->buf + a->used;
+    a->used += (new_size + 15) & ~15;
+    if (ptr) {
+        memcpy(p, ptr, old_size);
+    }
+    return p;
+}
+
+static void arena_free(void *opaque, void *ptr)
+{
+    struct test_arena *a = opaque;
+    a->frees++;
+}
+
+static int foo_inline()
+{
+    DARRAY_INLINE(int, 4) v;
+    DARRAY(int) w;
+    struct test_arena arena;
+    struct darray_allocator alloc = {arena_realloc, arena_free, &arena};
+    int j, sum = 0, *p;
+
+    da_init_inline(v);
+    for (j = 0; j < 4; j++) {
+        da_push_back(v, &j);
+    }
+    printf("inline: num=%zu on_stack=%d\n", v.num, v.array == v.inline_items);
+    j = 4;
+    da_push_back(v, &j);
+    printf("spilled: num=%zu on_stack=%d\n", v.num, v.array == v.inline_items);
+
+    da_erase_swap(v, 0);
+    printf("erase_swap: v[0]=%d num=%zu\n", v.array[0], v.num);
+    j = 2;
+    da_erase_item_swap(v, &j);
+
+    da_reserve_more(v, 100);
+    for (j = 100; j < 200; j++) {
+        da_push_back_unchecked(v, j);
+    }
+    p = da_push_back_uninit(v, 3);
+    p[0] = p[1] = p[2] = 1;
+    for (j = 0; j < (int)v.num; j++) {
+        sum += v.array[j];
+    }
+    printf("bulk append: num=%zu sum=%d\n", v.num, sum);
+
+    da_init(w);
+    da_move(w, v);
+    printf("move: w.num=%zu v.num=%zu v.on_stack=%d\n",
+           w.num, v.num, v.array == v.inline_items);
+    da_free(w);
+    da_free(v);
+
+    memset(&arena, 0, sizeof(arena));
+    da_init(w);
+    da_set_allocator(w, &alloc);
+    for (j = 0; j < 100; j++) {
+        da_push_back(w, &j);
+    }
+    printf("arena: num=%zu arena_used=%zu\n", w.num, arena.used);
+    da_free(w);
+    printf("arena: frees=%d\n", arena.frees);
+    return 0;
+}
+
 
 int main(int argc, char **argv)
 {
     int j;
     DARRAY(int) i;
     foo();
+    foo_inline();
     da_init(i);
     for (j = 0; j < 10; j++) {
         da_push_back(i, &j);
@@ -20,6 +20,7 @@
  * SOFTWARE.
  ******************************************************************************/
 #include <libposix.h>
+#include <libstrex.h>
 #include "libdict.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -45,13 +46,7 @@
  */
 #define DEBUG           0
 
-/*
- * Specify which hash function to use
- * MurmurHash is fast but may not work on all architectures
- * Dobbs is a tad bit slower but not by much and works everywhere
- */
-#define dict_hash   dict_hash_murmur
-/* #define dict_hash   dict_hash_dobbs */
+#define dict_hash(key, len)   strhash32(key, len)
 
 /* Forward definitions */
 static int dict_resize(dict *d);
@@ -69,71 +64,6 @@ static char *xstrdup(char *s)
     return t;
 }
 
-/**
-  This hash function has been taken from an Article in Dr Dobbs Journal.
-  There are probably better ones out there but this one does the job.
- */
-#if 0
-static uint32_t dict_hash_dobbs(char *key, size_t len)
-{
-    int len, i;
-    uint32_t hash;
-    if (!key || !len) {
-        printf("%s: invalid paraments!\n", __func__);
-        return 0;
-    }
-    for (hash = 0, i=0; i < len; i++) {
-        hash += (uint32_t)key[i];
-        hash += (hash<<10);
-        hash ^= (hash>>6);
-    }
-    hash += (hash <<3);
-    hash ^= (hash >>11);
-    hash += (hash <<15);
-    return hash;
-}
-#endif
-
-/* Murmurhash */
-static uint32_t dict_hash_murmur(char *key, size_t len)
-{
-    uint32_t h, k;
-    uint8_t *data;
-    uint32_t seed = 0x0badcafe;//magic number
-    uint32_t m = 0x5bd1e995;//magic number
-    uint32_t r = 24;//magic number
-
-    if (!key || !len) {
-        return 0;
-    }
-
-    h = seed ^ len;
-    data = (uint8_t *)key;
-    while (len >= 4) {
-        k = *(uint32_t *)data;
-
-        k *= m;
-        k ^= k >> r;
-        k *= m;
-
-        h *= m;
-        h ^= k;
-
-        data += 4;
-        len -= 4;
-    }
-    switch (len) {
-        case 3: h ^= data[2] << 16;
-        case 2: h ^= data[1] << 8;
-        case 1: h ^= data[0];
-                h *= m;
-    };
-    h ^= h >> 13;
-    h *= m;
-    h ^= h >> 15;
-    return h;
-}
-
 /** Lookup an element in a dict
     This implementation copied almost verbatim from the Python dictionary
     object, without the Pythonisms.
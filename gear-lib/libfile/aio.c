@@ -0,0 +1,1148 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#define _GNU_SOURCE
+#include "libfile.h"
+#include "libfileaio.h"
+#include <libworkq.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#if defined (__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define AIO_HAVE_URING
+#endif
+
+#define AIO_ALIGN               (4096)
+#define AIO_ALIGN_UP(x)         (((x) + AIO_ALIGN - 1) & ~((uint64_t)AIO_ALIGN - 1))
+#define AIO_ALIGN_DOWN(x)       ((x) & ~((uint64_t)AIO_ALIGN - 1))
+#define AIO_RING_ENTRIES        (256)
+#define AIO_SYNC_TAG            (1UL)
+
+#define AIO_DEFAULT_CHUNK_SIZE  (512 * 1024)
+#define AIO_DEFAULT_NR_CHUNKS   (4)
+
+struct aio_file;
+
+struct aio_chunk {
+    struct aio_file *af;
+    char *buf;
+    size_t len;                 /* valid bytes */
+    size_t io_len;              /* len padded to AIO_ALIGN for O_DIRECT */
+    size_t done;
+    uint64_t off;
+    struct iovec iov;
+    struct aio_chunk *next;
+};
+
+struct aio_file {
+    struct file_desc desc;      /* what file_ops see, keep it first */
+    struct file_aio_conf conf;
+    enum file_aio_engine engine;
+    int direct;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct aio_chunk *chunks;
+    struct aio_chunk *free_list;
+    struct aio_chunk *cur;      /* being filled, writer only */
+    int inflight;
+    int syncing;
+    int error;
+    uint64_t off;               /* writer only */
+    uint64_t size;              /* writer only */
+    uint64_t prealloc_end;      /* writer only */
+    uint64_t dirty_start;
+    uint64_t dirty_end;
+    uint64_t wb_start;          /* pushed to writeback last time */
+    uint64_t wb_end;
+    struct file_aio_stat stat;
+};
+
+/*
+ * engines are shared by all aio files, io_uring has one ring and one
+ * reaper thread, the fallback pushes blocking pwrite to a workq pool
+ */
+#if defined (AIO_HAVE_URING)
+struct aio_ring {
+    int fd;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr;
+    void *cq_ptr;
+    size_t sq_len;
+    size_t cq_len;
+    size_t sqes_len;
+    unsigned entries;
+    unsigned pending;           /* ops in the kernel, never above entries */
+    uint64_t *slots;            /* user_data of the ops in the kernel */
+    unsigned *free_slots;
+    unsigned nr_free;
+    int async;                  /* IOSQE_ASYNC works */
+    int dead;                   /* the reaper hit an error it can't wait out */
+    pthread_t reaper;
+};
+#endif
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int ring_ref;
+    int pool_ref;
+#if defined (AIO_HAVE_URING)
+    struct aio_ring ring;
+#endif
+    struct workq_pool *pool;
+} engine = {
+    PTHREAD_MUTEX_INITIALIZER,
+    PTHREAD_COND_INITIALIZER,
+};
+
+static uint64_t aio_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void aio_complete(struct aio_chunk *c, int err);
+static void aio_sync_done(struct aio_file *af);
+
+#if defined (AIO_HAVE_URING)
+static int ring_enter(struct aio_ring *r, unsigned submit, unsigned wait)
+{
+    return syscall(__NR_io_uring_enter, r->fd, submit, wait,
+                   wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+/*
+ * engine.lock held, the ring has room. The sqe carries a slot number and
+ * the slot the user_data, so a dead ring can still fail what is in flight.
+ * user_data 0 is the reaper quit NOP and takes no slot.
+ */
+static int ring_push(struct aio_ring *r, uint8_t opcode, int fd, void *addr,
+                unsigned len, uint64_t off, unsigned flags, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe;
+    unsigned tail = *r->sq_tail;
+    unsigned idx = tail & *r->sq_mask;
+    unsigned slot = 0;
+    int ret;
+
+    if (r->dead) {
+        errno = EIO;
+        return -1;
+    }
+    if (user_data) {
+        slot = r->free_slots[--r->nr_free];
+        r->slots[slot] = user_data;
+    }
+    sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)addr;
+    sqe->len = len;
+    sqe->off = off;
+    sqe->sync_range_flags = flags;
+    sqe->user_data = user_data ? slot + 1 : 0;
+#if defined (IOSQE_ASYNC)
+    if (opcode == IORING_OP_WRITEV && r->async) {
+        sqe->flags = IOSQE_ASYNC;
+    }
+#endif
+    r->sq_array[idx] = idx;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    r->pending++;
+    do {
+        ret = ring_enter(r, 1, 0);
+    } while (ret < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY));
+    if (ret < 0) {
+        printf("io_uring_enter failed %d:%s\n", errno, strerror(errno));
+        r->pending--;
+        if (user_data) {
+            r->slots[slot] = 0;
+            r->free_slots[r->nr_free++] = slot;
+        }
+        return -1;
+    }
+    return 0;
+}
+
+static void ring_write(struct aio_chunk *c)
+{
+    struct aio_ring *r = &engine.ring;
+    int ret;
+
+    c->iov.iov_base = c->buf + c->done;
+    c->iov.iov_len = c->io_len - c->done;
+    pthread_mutex_lock(&engine.lock);
+    while (r->pending >= r->entries) {
+        pthread_cond_wait(&engine.cond, &engine.lock);
+    }
+    ret = ring_push(r, IORING_OP_WRITEV, c->af->desc.fd, &c->iov, 1,
+                    c->off + c->done, 0, (uint64_t)(uintptr_t)c);
+    pthread_mutex_unlock(&engine.lock);
+    if (ret < 0) {
+        aio_complete(c, EIO);
+    }
+}
+
+/*
+ * called from the reaper, never waits for room: a writeback round that
+ * does not fit is simply retried on a later completion
+ */
+static int ring_sync_range(struct aio_file *af, uint64_t start, uint64_t end,
+                uint64_t prev_start, uint64_t prev_end)
+{
+    struct aio_ring *r = &engine.ring;
+    uint64_t tag = (uint64_t)(uintptr_t)af | AIO_SYNC_TAG;
+    int n = 0;
+
+    pthread_mutex_lock(&engine.lock);
+    if (r->pending + 2 <= r->entries) {
+        if (0 == ring_push(r, IORING_OP_SYNC_FILE_RANGE, af->desc.fd, NULL,
+                           end - start, start, SYNC_FILE_RANGE_WRITE, tag)) {
+            n++;
+        }
+        if (prev_end > prev_start &&
+            0 == ring_push(r, IORING_OP_SYNC_FILE_RANGE, af->desc.fd, NULL,
+                           prev_end - prev_start, prev_start,
+                           SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                           SYNC_FILE_RANGE_WAIT_AFTER, tag)) {
+            n++;
+        }
+    }
+    pthread_mutex_unlock(&engine.lock);
+    return n;
+}
+
+static void ring_done(struct aio_chunk *c, int res)
+{
+    struct aio_ring *r = &engine.ring;
+    int err = 0;
+
+    /* the lock also orders the submitter's writes to c before ours */
+    pthread_mutex_lock(&engine.lock);
+    r->pending--;
+    if (res > 0 && c->done + res < c->io_len) {
+        /* short write, reuse the slot for the rest */
+        c->done += res;
+        c->iov.iov_base = c->buf + c->done;
+        c->iov.iov_len = c->io_len - c->done;
+        if (0 == ring_push(r, IORING_OP_WRITEV, c->af->desc.fd, &c->iov, 1,
+                           c->off + c->done, 0, (uint64_t)(uintptr_t)c)) {
+            pthread_mutex_unlock(&engine.lock);
+            return;
+        }
+        err = EIO;
+    } else if (res < 0) {
+        err = -res;
+    } else if (res == 0) {
+        err = ENOSPC;
+    }
+    pthread_cond_broadcast(&engine.cond);
+    pthread_mutex_unlock(&engine.lock);
+    aio_complete(c, err);
+}
+
+static void ring_dispatch(struct aio_ring *r, uint64_t user_data, int res)
+{
+    if (user_data & AIO_SYNC_TAG) {
+        pthread_mutex_lock(&engine.lock);
+        r->pending--;
+        pthread_cond_broadcast(&engine.cond);
+        pthread_mutex_unlock(&engine.lock);
+        aio_sync_done((struct aio_file *)(uintptr_t)(user_data & ~AIO_SYNC_TAG));
+    } else {
+        ring_done((struct aio_chunk *)(uintptr_t)user_data, res);
+    }
+}
+
+/*
+ * no completion will ever come for what is still in flight: fail it with
+ * err, later pushes fail right away so no writer waits on this ring again
+ */
+static void ring_fail_all(struct aio_ring *r, int err)
+{
+    unsigned i, n = 0;
+
+    /*
+     * nothing takes a slot once dead, so the live ones can be packed in
+     * place. Don't touch engine.lock after the last dispatch: close may
+     * be joining us with it held as soon as that one completes.
+     */
+    pthread_mutex_lock(&engine.lock);
+    r->dead = 1;
+    for (i = 0; i < r->entries; i++) {
+        if (r->slots[i]) {
+            r->slots[n++] = r->slots[i];
+        }
+    }
+    pthread_cond_broadcast(&engine.cond);
+    pthread_mutex_unlock(&engine.lock);
+    for (i = 0; i < n; i++) {
+        ring_dispatch(r, r->slots[i], -err);
+    }
+}
+
+static void *ring_reaper(void *arg)
+{
+    struct aio_ring *r = (struct aio_ring *)arg;
+    struct io_uring_cqe *cqe;
+    uint64_t user_data;
+    unsigned head, slot;
+    int res;
+    int quit = 0;
+
+    while (!quit) {
+        if (ring_enter(r, 0, 1) < 0) {
+            if (errno == EAGAIN) {
+                usleep(1000);
+            } else if (errno != EINTR && errno != EBUSY) {
+                /* EBUSY is a full cq, reaping below makes room */
+                printf("io_uring_enter wait failed %d:%s\n", errno, strerror(errno));
+                ring_fail_all(r, errno);
+                break;
+            }
+        }
+        head = *r->cq_head;
+        while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+            cqe = &r->cqes[head & *r->cq_mask];
+            slot = (unsigned)cqe->user_data;
+            res = cqe->res;
+            head++;
+            __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+            if (!slot) {
+                quit = 1;
+                continue;
+            }
+            pthread_mutex_lock(&engine.lock);
+            user_data = r->slots[slot - 1];
+            r->slots[slot - 1] = 0;
+            r->free_slots[r->nr_free++] = slot - 1;
+            pthread_mutex_unlock(&engine.lock);
+            ring_dispatch(r, user_data, res);
+        }
+    }
+    return NULL;
+}
+
+static void ring_unmap(struct aio_ring *r)
+{
+    if (r->sqes && r->sqes != MAP_FAILED) {
+        munmap(r->sqes, r->sqes_len);
+    }
+    if (r->cq_ptr && r->cq_ptr != MAP_FAILED && r->cq_ptr != r->sq_ptr) {
+        munmap(r->cq_ptr, r->cq_len);
+    }
+    if (r->sq_ptr && r->sq_ptr != MAP_FAILED) {
+        munmap(r->sq_ptr, r->sq_len);
+    }
+    close(r->fd);
+    free(r->slots);
+    free(r->free_slots);
+    memset(r, 0, sizeof(*r));
+}
+
+static int ring_init(struct aio_ring *r, unsigned entries)
+{
+    struct io_uring_params p;
+    char *sq, *cq;
+
+    memset(r, 0, sizeof(*r));
+    memset(&p, 0, sizeof(p));
+    r->fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0) {
+        printf("io_uring_setup failed %d:%s, use thread pool\n", errno, strerror(errno));
+        return -1;
+    }
+    r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_len > r->sq_len) {
+            r->sq_len = r->cq_len;
+        }
+        r->cq_len = r->sq_len;
+    }
+    r->sq_ptr = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_ptr == MAP_FAILED) {
+        goto failed;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_ptr = r->sq_ptr;
+    } else {
+        r->cq_ptr = mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (r->cq_ptr == MAP_FAILED) {
+            goto failed;
+        }
+    }
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        goto failed;
+    }
+    sq = (char *)r->sq_ptr;
+    cq = (char *)r->cq_ptr;
+    r->sq_head = (unsigned *)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(sq + p.sq_off.array);
+    r->cq_head = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    /* cq has twice the entries, pending <= sq entries can't overflow it */
+    r->entries = p.sq_entries;
+    r->slots = calloc(r->entries, sizeof(uint64_t));
+    r->free_slots = calloc(r->entries, sizeof(unsigned));
+    if (!r->slots || !r->free_slots) {
+        goto failed;
+    }
+    for (r->nr_free = 0; r->nr_free < r->entries; r->nr_free++) {
+        r->free_slots[r->nr_free] = r->entries - 1 - r->nr_free;
+    }
+#if defined (IOSQE_ASYNC) && defined (IORING_FEAT_RW_CUR_POS)
+    /*
+     * buffered writes that hit the page cache complete inline in
+     * io_uring_enter, i.e. in the media thread. since 5.6 they can be
+     * punted to the kernel workers instead.
+     */
+    r->async = !!(p.features & IORING_FEAT_RW_CUR_POS);
+#endif
+    if (pthread_create(&r->reaper, NULL, ring_reaper, r)) {
+        goto failed;
+    }
+    return 0;
+
+failed:
+    printf("io_uring mmap failed %d:%s\n", errno, strerror(errno));
+    ring_unmap(r);
+    return -1;
+}
+
+/* engine.lock held, nothing in flight so the reaper won't need it */
+static void ring_deinit(struct aio_ring *r)
+{
+    ring_push(r, IORING_OP_NOP, -1, NULL, 0, 0, 0, 0);
+    pthread_join(r->reaper, NULL);
+    ring_unmap(r);
+}
+#endif
+
+static void pool_write(void *arg)
+{
+    struct aio_chunk *c = (struct aio_chunk *)arg;
+    struct aio_file *af = c->af;
+    ssize_t n;
+    int err = 0;
+
+    while (c->done < c->io_len) {
+        n = pwrite(af->desc.fd, c->buf + c->done, c->io_len - c->done,
+                   c->off + c->done);
+        if (n > 0) {
+            c->done += n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            err = n < 0 ? errno : ENOSPC;
+            break;
+        }
+    }
+    aio_complete(c, err);
+}
+
+static int engine_get(enum file_aio_engine type)
+{
+    int ret = -1;
+
+    pthread_mutex_lock(&engine.lock);
+#if defined (AIO_HAVE_URING)
+    if (type != FILE_AIO_WORKQ) {
+        if (engine.ring_ref || 0 == ring_init(&engine.ring, AIO_RING_ENTRIES)) {
+            engine.ring_ref++;
+            pthread_mutex_unlock(&engine.lock);
+            return FILE_AIO_URING;
+        }
+    }
+#endif
+    if (engine.pool_ref || (engine.pool = workq_pool_create())) {
+        engine.pool_ref++;
+        ret = FILE_AIO_WORKQ;
+    }
+    pthread_mutex_unlock(&engine.lock);
+    return ret;
+}
+
+static void engine_put(enum file_aio_engine type)
+{
+    pthread_mutex_lock(&engine.lock);
+#if defined (AIO_HAVE_URING)
+    if (type == FILE_AIO_URING) {
+        if (--engine.ring_ref == 0) {
+            ring_deinit(&engine.ring);
+        }
+    }
+#endif
+    if (type == FILE_AIO_WORKQ) {
+        if (--engine.pool_ref == 0) {
+            workq_pool_destroy(engine.pool);
+            engine.pool = NULL;
+        }
+    }
+    pthread_mutex_unlock(&engine.lock);
+}
+
+static void aio_writeback(struct aio_file *af, uint64_t start, uint64_t end,
+                uint64_t prev_start, uint64_t prev_end)
+{
+    /*
+     * kick writeback of the new range and wait for the one before, the
+     * page cache never holds much more than two sync_size of dirty data
+     */
+#if defined (AIO_HAVE_URING)
+    if (af->engine == FILE_AIO_URING) {
+        int n = ring_sync_range(af, start, end, prev_start, prev_end);
+        pthread_mutex_lock(&af->lock);
+        af->syncing += n - 1;
+        if (n == 0) {
+            /* no room, try again with the next chunk */
+            af->dirty_start = start;
+            af->wb_start = prev_start;
+            af->wb_end = prev_end;
+        }
+        pthread_cond_broadcast(&af->cond);
+        pthread_mutex_unlock(&af->lock);
+        return;
+    }
+#endif
+    sync_file_range(af->desc.fd, start, end - start, SYNC_FILE_RANGE_WRITE);
+    if (prev_end > prev_start) {
+        sync_file_range(af->desc.fd, prev_start, prev_end - prev_start,
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                        SYNC_FILE_RANGE_WAIT_AFTER);
+    }
+    aio_sync_done(af);
+}
+
+static void aio_sync_done(struct aio_file *af)
+{
+    pthread_mutex_lock(&af->lock);
+    af->syncing--;
+    pthread_cond_broadcast(&af->cond);
+    pthread_mutex_unlock(&af->lock);
+}
+
+static void aio_complete(struct aio_chunk *c, int err)
+{
+    struct aio_file *af = c->af;
+    uint64_t end = c->off + c->len;
+    uint64_t start = 0, prev_start = 0, prev_end = 0;
+    int writeback = 0;
+
+    pthread_mutex_lock(&af->lock);
+    if (err && !af->error) {
+        af->error = err;
+        printf("async write %s at %" PRIu64 " failed %d:%s\n",
+               af->desc.name, c->off, err, strerror(err));
+    }
+    af->stat.completed++;
+    if (!err) {
+        af->stat.bytes += c->len;
+    }
+    if (end > af->dirty_end) {
+        af->dirty_end = end;
+    }
+    if (af->conf.sync_size && !af->direct && !af->syncing &&
+        af->dirty_end >= af->dirty_start + af->conf.sync_size) {
+        start = af->dirty_start;
+        end = af->dirty_end;
+        prev_start = af->wb_start;
+        prev_end = af->wb_end;
+        af->wb_start = start;
+        af->wb_end = end;
+        af->dirty_start = end;
+        af->syncing = 1;
+        writeback = 1;
+    }
+    pthread_mutex_unlock(&af->lock);
+
+    if (af->conf.complete) {
+        af->conf.complete(af->conf.arg, c->off, c->len, err);
+    }
+    if (writeback) {
+        aio_writeback(af, start, end, prev_start, prev_end);
+    }
+
+    /* af may be freed by close as soon as inflight drops to zero */
+    pthread_mutex_lock(&af->lock);
+    c->next = af->free_list;
+    af->free_list = c;
+    af->inflight--;
+    pthread_cond_broadcast(&af->cond);
+    pthread_mutex_unlock(&af->lock);
+}
+
+static void aio_prealloc(struct aio_file *af, uint64_t end)
+{
+    uint64_t step = af->conf.prealloc_size;
+    uint64_t new_end;
+
+    if (!step || end <= af->prealloc_end) {
+        return;
+    }
+    new_end = (end + step - 1) / step * step;
+    if (fallocate(af->desc.fd, FALLOC_FL_KEEP_SIZE, af->prealloc_end,
+                  new_end - af->prealloc_end) < 0) {
+        printf("fallocate %s failed %d:%s, preallocation off\n",
+               af->desc.name, errno, strerror(errno));
+        af->conf.prealloc_size = 0;
+        return;
+    }
+    af->prealloc_end = new_end;
+}
+
+static struct aio_chunk *aio_get_chunk(struct aio_file *af)
+{
+    struct aio_chunk *c;
+    uint64_t start = 0;
+
+    pthread_mutex_lock(&af->lock);
+    if (!af->free_list && !af->error) {
+        start = aio_now_ns();
+        af->stat.stalls++;
+        while (!af->free_list && !af->error) {
+            pthread_cond_wait(&af->cond, &af->lock);
+        }
+        af->stat.stall_ns += aio_now_ns() - start;
+    }
+    c = af->error ? NULL : af->free_list;
+    if (c) {
+        af->free_list = c->next;
+        c->next = NULL;
+    }
+    pthread_mutex_unlock(&af->lock);
+    return c;
+}
+
+static void aio_submit(struct aio_file *af, struct aio_chunk *c)
+{
+    c->io_len = af->direct ? AIO_ALIGN_UP(c->len) : c->len;
+    if (c->io_len > c->len) {
+        memset(c->buf + c->len, 0, c->io_len - c->len);
+    }
+    c->done = 0;
+    aio_prealloc(af, c->off + c->io_len);
+
+    pthread_mutex_lock(&af->lock);
+    af->inflight++;
+    af->stat.submitted++;
+    pthread_mutex_unlock(&af->lock);
+
+#if defined (AIO_HAVE_URING)
+    if (af->engine == FILE_AIO_URING) {
+        ring_write(c);
+        return;
+    }
+#endif
+    if (workq_pool_task_push(engine.pool, pool_write, c) < 0) {
+        pool_write(c);
+    }
+}
+
+static int aio_drain(struct aio_file *af, int64_t ms)
+{
+    struct timespec ts;
+    int ret = 0;
+
+    if (ms >= 0) {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += ms / 1000;
+        ts.tv_nsec += (ms % 1000) * 1000000;
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+    }
+    pthread_mutex_lock(&af->lock);
+    while ((af->inflight || af->syncing) && ret == 0) {
+        if (ms < 0) {
+            pthread_cond_wait(&af->cond, &af->lock);
+        } else {
+            ret = pthread_cond_timedwait(&af->cond, &af->lock, &ts);
+        }
+    }
+    if (af->error) {
+        ret = -1;
+    }
+    pthread_mutex_unlock(&af->lock);
+    return ret ? -1 : 0;
+}
+
+/*
+ * submit the chunk being filled. with O_DIRECT the unaligned tail goes out
+ * padded and is copied into the next chunk to be written again, the two
+ * overlap so the padded write must land first.
+ */
+static void aio_flush_cur(struct aio_file *af, int keep_tail)
+{
+    struct aio_chunk *c = af->cur;
+    struct aio_chunk *next;
+    size_t tail;
+
+    if (!c || !c->len) {
+        return;
+    }
+    af->cur = NULL;
+    tail = af->direct ? c->len - AIO_ALIGN_DOWN(c->len) : 0;
+    aio_submit(af, c);
+    if (!tail) {
+        return;
+    }
+    aio_drain(af, -1);
+    if (!keep_tail) {
+        return;
+    }
+    next = aio_get_chunk(af);
+    if (!next) {
+        return;
+    }
+    next->off = c->off + AIO_ALIGN_DOWN(c->len);
+    /* c is free again and may well be next */
+    memmove(next->buf, c->buf + AIO_ALIGN_DOWN(c->len), tail);
+    next->len = tail;
+    af->cur = next;
+}
+
+static struct file_desc *aio_open_conf(const char *path, file_open_mode_t mode,
+                const struct file_aio_conf *conf)
+{
+    struct aio_file *af;
+    struct stat st;
+    int flags = -1;
+    int i;
+
+    af = (struct aio_file *)calloc(1, sizeof(struct aio_file));
+    if (!af) {
+        printf("malloc failed:%d %s\n", errno, strerror(errno));
+        return NULL;
+    }
+    if (conf) {
+        af->conf = *conf;
+    } else {
+        file_aio_conf_init(&af->conf);
+    }
+    if (af->conf.chunk_size == 0) {
+        af->conf.chunk_size = AIO_DEFAULT_CHUNK_SIZE;
+    }
+    af->conf.chunk_size = AIO_ALIGN_UP(af->conf.chunk_size);
+    if (af->conf.nr_chunks < 2) {
+        af->conf.nr_chunks = 2;
+    }
+    switch (mode) {
+    case F_RDONLY:
+        flags = O_RDONLY;
+        break;
+    case F_WRONLY:
+        flags = O_WRONLY;
+        break;
+    case F_RDWR:
+    case F_APPEND:
+        /* positional writes, O_APPEND would make pwrite ignore the offset */
+        flags = O_RDWR;
+        break;
+    case F_CREATE:
+        flags = O_RDWR|O_TRUNC|O_CREAT;
+        break;
+    case F_WRCLEAR:
+        flags = O_WRONLY|O_TRUNC|O_CREAT;
+        break;
+    default:
+        printf("unsupport file mode!\n");
+        break;
+    }
+    af->desc.fd = -1;
+    if (af->conf.direct) {
+        af->desc.fd = open(path, flags | O_DIRECT, 0666);
+        if (af->desc.fd == -1 && errno == EINVAL) {
+            printf("%s: O_DIRECT not supported, use buffered io\n", path);
+        } else {
+            af->direct = 1;
+        }
+    }
+    if (af->desc.fd == -1) {
+        af->direct = 0;
+        af->desc.fd = open(path, flags, 0666);
+    }
+    if (af->desc.fd == -1) {
+        printf("open %s failed:%d %s\n", path, errno, strerror(errno));
+        free(af);
+        return NULL;
+    }
+    if (fstat(af->desc.fd, &st) == 0) {
+        af->size = st.st_size;
+    }
+    af->off = (mode == F_APPEND) ? af->size : 0;
+    if (af->direct && af->off != AIO_ALIGN_DOWN(af->off)) {
+        printf("%s: append at unaligned end, use buffered io\n", path);
+        fcntl(af->desc.fd, F_SETFL, fcntl(af->desc.fd, F_GETFL) & ~O_DIRECT);
+        af->direct = 0;
+    }
+    af->prealloc_end = af->size;
+    af->dirty_start = af->dirty_end = af->off;
+    pthread_mutex_init(&af->lock, NULL);
+    pthread_cond_init(&af->cond, NULL);
+
+    af->chunks = (struct aio_chunk *)calloc(af->conf.nr_chunks, sizeof(struct aio_chunk));
+    if (!af->chunks) {
+        goto failed;
+    }
+    for (i = 0; i < af->conf.nr_chunks; i++) {
+        if (posix_memalign((void **)&af->chunks[i].buf, AIO_ALIGN, af->conf.chunk_size)) {
+            goto failed;
+        }
+        af->chunks[i].af = af;
+        af->chunks[i].next = af->free_list;
+        af->free_list = &af->chunks[i];
+    }
+    i = engine_get(af->conf.engine);
+    if (i < 0) {
+        printf("no async io engine\n");
+        goto failed;
+    }
+    af->engine = (enum file_aio_engine)i;
+    af->desc.name = strdup(path);
+    return &af->desc;
+
+failed:
+    if (af->chunks) {
+        for (i = 0; i < af->conf.nr_chunks; i++) {
+            free(af->chunks[i].buf);
+        }
+        free(af->chunks);
+    }
+    pthread_mutex_destroy(&af->lock);
+    pthread_cond_destroy(&af->cond);
+    close(af->desc.fd);
+    free(af);
+    return NULL;
+}
+
+static struct file_desc *aio_open(const char *path, file_open_mode_t mode)
+{
+    return aio_open_conf(path, mode, NULL);
+}
+
+static ssize_t aio_write(struct file_desc *fd, const void *buf, size_t len)
+{
+    struct aio_file *af = (struct aio_file *)fd;
+    const char *p = (const char *)buf;
+    size_t left = len;
+    size_t n;
+
+    if (!af || !buf || !len) {
+        printf("%s paraments invalid\n", __func__);
+        return -1;
+    }
+    if (af->error) {
+        return -1;
+    }
+    while (left > 0) {
+        if (!af->cur) {
+            af->cur = aio_get_chunk(af);
+            if (!af->cur) {
+                return -1;
+            }
+            af->cur->off = af->off;
+            af->cur->len = 0;
+        }
+        n = af->conf.chunk_size - af->cur->len;
+        if (n > left) {
+            n = left;
+        }
+        memcpy(af->cur->buf + af->cur->len, p, n);
+        af->cur->len += n;
+        af->off += n;
+        p += n;
+        left -= n;
+        if (af->cur->len == af->conf.chunk_size) {
+            aio_submit(af, af->cur);
+            af->cur = NULL;
+        }
+    }
+    if (af->off > af->size) {
+        af->size = af->off;
+    }
+    return len;
+}
+
+static ssize_t aio_read(struct file_desc *fd, void *buf, size_t len)
+{
+    struct aio_file *af = (struct aio_file *)fd;
+    char *p = (char *)buf;
+    char *bounce = NULL;
+    size_t left, skip, n;
+    uint64_t pos;
+    ssize_t ret;
+
+    if (!af || !buf || !len) {
+        printf("%s paraments invalid!\n", __func__);
+        return -1;
+    }
+    aio_flush_cur(af, 1);
+    aio_drain(af, -1);
+    if (af->off >= af->size) {
+        return 0;
+    }
+    if (len > af->size - af->off) {
+        len = af->size - af->off;
+    }
+    left = len;
+    if (af->direct &&
+        posix_memalign((void **)&bounce, AIO_ALIGN, af->conf.chunk_size)) {
+        return -1;
+    }
+    while (left > 0) {
+        if (!bounce) {
+            ret = pread(af->desc.fd, p, left, af->off);
+            skip = 0;
+        } else {
+            /* O_DIRECT needs aligned buffer, offset and length */
+            pos = AIO_ALIGN_DOWN(af->off);
+            skip = af->off - pos;
+            n = AIO_ALIGN_UP(skip + left);
+            if (n > af->conf.chunk_size) {
+                n = af->conf.chunk_size;
+            }
+            ret = pread(af->desc.fd, bounce, n, pos);
+            if (ret > (ssize_t)skip) {
+                ret -= skip;
+                if ((size_t)ret > left) {
+                    ret = left;
+                }
+                memcpy(p, bounce + skip, ret);
+            } else if (ret > 0) {
+                ret = 0;
+            }
+        }
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            if (ret < 0) {
+                printf("read failed: %d\n", errno);
+            }
+            break;
+        }
+        p += ret;
+        left -= ret;
+        af->off += ret;
+    }
+    free(bounce);
+    return len - left;
+}
+
+static off_t aio_seek(struct file_desc *fd, off_t offset, int whence)
+{
+    struct aio_file *af = (struct aio_file *)fd;
+    int64_t pos;
+
+    if (!af) {
+        return -1;
+    }
+    switch (whence) {
+    case SEEK_SET:
+        pos = offset;
+        break;
+    case SEEK_CUR:
+        pos = af->off + offset;
+        break;
+    case SEEK_END:
+        pos = af->size + offset;
+        break;
+    default:
+        return -1;
+    }
+    if (pos < 0) {
+        return -1;
+    }
+    if ((uint64_t)pos == af->off) {
+        return pos;
+    }
+    if (af->direct && (uint64_t)pos != AIO_ALIGN_DOWN(pos)) {
+        printf("%s: seek to %" PRId64 " not aligned for O_DIRECT\n", af->desc.name, pos);
+        return -1;
+    }
+    /* chunks written out of order must not overlap, settle them first */
+    aio_flush_cur(af, 0);
+    aio_drain(af, -1);
+    af->off = pos;
+    return pos;
+}
+
+static int aio_sync(struct file_desc *fd)
+{
+    struct aio_file *af = (struct aio_file *)fd;
+    int ret;
+
+    if (!af) {
+        return -1;
+    }
+    aio_flush_cur(af, 1);
+    ret = aio_drain(af, -1);
+    if (fsync(af->desc.fd) < 0) {
+        ret = -1;
+    }
+    return ret;
+}
+
+static size_t aio_size(struct file_desc *fd)
+{
+    struct aio_file *af = (struct aio_file *)fd;
+    return af ? af->size : 0;
+}
+
+static void aio_close(struct file_desc *fd)
+{
+    struct aio_file *af = (struct aio_file *)fd;
+    int i;
+
+    if (!af) {
+        return;
+    }
+    aio_flush_cur(af, 0);
+    aio_drain(af, -1);
+    /* drop the O_DIRECT padding and preallocated blocks past the end */
+    if ((af->direct || af->prealloc_end > af->size) &&
+        ftruncate(af->desc.fd, af->size) < 0) {
+        printf("ftruncate %s failed %d:%s\n", af->desc.name, errno, strerror(errno));
+    }
+    engine_put(af->engine);
+    close(af->desc.fd);
+    for (i = 0; i < af->conf.nr_chunks; i++) {
+        free(af->chunks[i].buf);
+    }
+    free(af->chunks);
+    pthread_mutex_destroy(&af->lock);
+    pthread_cond_destroy(&af->cond);
+    free(af->desc.name);
+    free(af);
+}
+
+struct file_ops aio_ops = {
+    aio_open,
+    aio_write,
+    aio_read,
+    aio_seek,
+    aio_sync,
+    aio_size,
+    aio_close,
+};
+
+static struct aio_file *aio_file_of(struct file *file)
+{
+    if (!file || file->ops != &aio_ops || !file->fd) {
+        return NULL;
+    }
+    return (struct aio_file *)file->fd;
+}
+
+void file_aio_conf_init(struct file_aio_conf *conf)
+{
+    memset(conf, 0, sizeof(*conf));
+    conf->engine = FILE_AIO_AUTO;
+    conf->chunk_size = AIO_DEFAULT_CHUNK_SIZE;
+    conf->nr_chunks = AIO_DEFAULT_NR_CHUNKS;
+}
+
+struct file *file_open_aio(const char *path, file_open_mode_t mode,
+                const struct file_aio_conf *conf)
+{
+    struct file *file = (struct file *)calloc(1, sizeof(struct file));
+    if (!file) {
+        printf("malloc failed!\n");
+        return NULL;
+    }
+    file->ops = &aio_ops;
+    file->fd = aio_open_conf(path, mode, conf);
+    if (!file->fd) {
+        free(file);
+        return NULL;
+    }
+    return file;
+}
+
+int file_aio_flush(struct file *file)
+{
+    struct aio_file *af = aio_file_of(file);
+    if (!af) {
+        return -1;
+    }
+    aio_flush_cur(af, 1);
+    return af->error ? -1 : 0;
+}
+
+int file_aio_wait(struct file *file, int64_t ms)
+{
+    struct aio_file *af = aio_file_of(file);
+    if (!af) {
+        return -1;
+    }
+    aio_flush_cur(af, 1);
+    return aio_drain(af, ms);
+}
+
+int file_aio_get_stat(struct file *file, struct file_aio_stat *st)
+{
+    struct aio_file *af = aio_file_of(file);
+    if (!af || !st) {
+        return -1;
+    }
+    pthread_mutex_lock(&af->lock);
+    *st = af->stat;
+    st->inflight = af->inflight;
+    st->error = af->error;
+    st->engine = af->engine;
+    st->direct = af->direct;
+    pthread_mutex_unlock(&af->lock);
+    return 0;
+}
@@ -19,6 +19,7 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
  * SOFTWARE.
  ******************************************************************************/
+#define _GNU_SOURCE
 #include <libposix.h>
 #include "libfilewatcher.h"
 #include <stdio.h>
@@ -26,230 +27,734 @@
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <dirent.h>
+#include <time.h>
 #include <sys/inotify.h>
+#include <sys/fanotify.h>
+#include <sys/vfs.h>
+#include <sys/stat.h>
 
 #define WATCH_MOVED     1
 #define WATCH_MODIFY    1
-#define KEY_LEN         9
+#define FW_EVENT_BUF    (64 * 1024)
 
-int add_path_list(struct fw *fw, int wd, const char *path)
+/*
+ * watch tree: a node per watched directory holding an interned name
+ * component, full paths are rebuilt from the parents only when an event is
+ * reported. nodes are found by wd and by (parent, name) in open addressing
+ * tables. files are not watched, their directory reports them.
+ */
+struct fw_name {
+    uint32_t ref;
+    uint32_t hash;
+    char str[];
+};
+
+struct fw_node {
+    int wd;                     /* -1 once the kernel dropped the watch */
+    struct fw_name *name;       /* component, or the whole path of a root */
+    struct fw_node *parent;
+    struct fw_node *child;
+    struct fw_node *next;
+    struct fw_node *prev;
+};
+
+struct fw_table {
+    void **slot;
+    uint32_t mask;
+    uint32_t count;
+    uint32_t (*hash)(const void *item);
+};
+
+/* modify events held back for the coalesce window, oldest first */
+struct fw_pending {
+    struct fw_pending *next;
+    struct fw_pending *prev;
+    uint64_t deadline;
+    uint32_t hash;
+    char path[];
+};
+
+struct fw_mark {
+    int mount_fd;
+    fsid_t fsid;
+    char *path;
+};
+
+struct fw_tree {
+    struct fw_table wds;
+    struct fw_table childs;
+    struct fw_table names;
+    struct fw_node *roots;
+    struct fw_table pendings;
+    struct fw_pending *pend_head;
+    struct fw_pending *pend_tail;
+    struct fw_mark *marks;
+    int nmark;
+};
+
+static uint32_t fw_hash_str(const char *s)
 {
-    char key[KEY_LEN];
-    memset(key, 0, sizeof(key));
-    snprintf(key, KEY_LEN, "%d", wd);
-    char *val = calloc(PATH_MAX, sizeof(char));
-    strncpy(val, path, PATH_MAX);
-    dict_add(fw->dict_path, key, val);
-    return 0;
+    uint32_t h = 2166136261u;
+    for (; *s; s++) {
+        h = (h ^ (uint8_t)*s) * 16777619u;
+    }
+    return h;
 }
 
-int del_path_list(struct fw *fw, int wd)
+static uint32_t fw_hash_int(uintptr_t v)
 {
-    char key[KEY_LEN];
-    memset(key, 0, sizeof(key));
-    snprintf(key, sizeof(key), "%d", wd);
-    dict_del(fw->dict_path, key);
-    return 0;
+    v ^= v >> 16;
+    v *= 0x45d9f3b;
+    v ^= v >> 16;
+    return (uint32_t)v;
 }
 
-int fw_add_watch(struct fw *fw, const char *path, uint32_t mask)
+static uint32_t hash_wd(const void *item)
 {
-    int fd = fw->fd;
-    int wd = inotify_add_watch(fd, path, mask);
-    if (wd == -1) {
-        printf("inotify_add_watch %s failed(%d): %s\n", path, errno, strerror(errno));
-        if (errno == ENOSPC) {
-            return -2;
+    return fw_hash_int((uint32_t)((const struct fw_node *)item)->wd);
+}
+
+static uint32_t hash_child(const void *item)
+{
+    const struct fw_node *n = (const struct fw_node *)item;
+    return fw_hash_int((uintptr_t)n->parent ^ n->name->hash);
+}
+
+static uint32_t hash_name(const void *item)
+{
+    return ((const struct fw_name *)item)->hash;
+}
+
+static uint32_t hash_pending(const void *item)
+{
+    return ((const struct fw_pending *)item)->hash;
+}
+
+static int table_init(struct fw_table *t, uint32_t (*hash)(const void *item))
+{
+    t->mask = 63;
+    t->count = 0;
+    t->hash = hash;
+    t->slot = (void **)calloc(t->mask + 1, sizeof(void *));
+    return t->slot ? 0 : -1;
+}
+
+static void table_deinit(struct fw_table *t)
+{
+    free(t->slot);
+    t->slot = NULL;
+}
+
+static int table_insert(struct fw_table *t, void *item)
+{
+    void **old = t->slot;
+    uint32_t i, j, size = t->mask + 1;
+
+    if ((t->count + 1) * 4 > size * 3) {
+        t->slot = (void **)calloc(size * 2, sizeof(void *));
+        if (!t->slot) {
+            t->slot = old;
+            return -1;
         }
-        return -1;
+        t->mask = size * 2 - 1;
+        for (i = 0; i < size; i++) {
+            if (!old[i]) {
+                continue;
+            }
+            for (j = t->hash(old[i]) & t->mask; t->slot[j]; j = (j + 1) & t->mask);
+            t->slot[j] = old[i];
+        }
+        free(old);
     }
-    add_path_list(fw, wd, path);
+    for (j = t->hash(item) & t->mask; t->slot[j]; j = (j + 1) & t->mask);
+    t->slot[j] = item;
+    t->count++;
     return 0;
 }
 
-int fw_del_watch(struct fw *fw, const char *path)
+/* backward shift, no tombstones */
+static void table_remove(struct fw_table *t, void *item)
+{
+    uint32_t i, j, k;
+
+    for (i = t->hash(item) & t->mask; t->slot[i]; i = (i + 1) & t->mask) {
+        if (t->slot[i] == item) {
+            break;
+        }
+    }
+    if (!t->slot[i]) {
+        return;
+    }
+    t->slot[i] = NULL;
+    t->count--;
+    for (j = (i + 1) & t->mask; t->slot[j]; j = (j + 1) & t->mask) {
+        k = t->hash(t->slot[j]) & t->mask;
+        if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j))) {
+            t->slot[i] = t->slot[j];
+            t->slot[j] = NULL;
+            i = j;
+        }
+    }
+}
+
+static struct fw_node *find_wd(struct fw_tree *tr, int wd)
 {
-    int fd = fw->fd;
-    int rank = 0;
-    char *key, *val;
-    while (1) {
-        rank = dict_enumerate(fw->dict_path, rank, &key, &val);
-        if (rank < 0) {
+    struct fw_table *t = &tr->wds;
+    struct fw_node *n;
+    uint32_t i;
+    for (i = fw_hash_int((uint32_t)wd) & t->mask; (n = t->slot[i]) != NULL; i = (i + 1) & t->mask) {
+        if (n->wd == wd) {
+            return n;
+        }
+    }
+    return NULL;
+}
+
+static struct fw_name *find_name(struct fw_tree *tr, const char *str, uint32_t h)
+{
+    struct fw_table *t = &tr->names;
+    struct fw_name *nm;
+    uint32_t i;
+    for (i = h & t->mask; (nm = t->slot[i]) != NULL; i = (i + 1) & t->mask) {
+        if (nm->hash == h && !strcmp(nm->str, str)) {
+            return nm;
+        }
+    }
+    return NULL;
+}
+
+static struct fw_node *find_child(struct fw_tree *tr, struct fw_node *parent, const char *str)
+{
+    struct fw_table *t = &tr->childs;
+    struct fw_name *nm = find_name(tr, str, fw_hash_str(str));
+    struct fw_node *n;
+    uint32_t i;
+    if (!nm) {
+        return NULL;
+    }
+    for (i = fw_hash_int((uintptr_t)parent ^ nm->hash) & t->mask;
+         (n = t->slot[i]) != NULL; i = (i + 1) & t->mask) {
+        if (n->parent == parent && n->name == nm) {
+            return n;
+        }
+    }
+    return NULL;
+}
+
+static struct fw_name *name_get(struct fw_tree *tr, const char *str)
+{
+    uint32_t h = fw_hash_str(str);
+    size_t len = strlen(str);
+    struct fw_name *nm = find_name(tr, str, h);
+    if (nm) {
+        nm->ref++;
+        return nm;
+    }
+    nm = (struct fw_name *)malloc(sizeof(struct fw_name) + len + 1);
+    if (!nm) {
+        return NULL;
+    }
+    nm->ref = 1;
+    nm->hash = h;
+    memcpy(nm->str, str, len + 1);
+    if (table_insert(&tr->names, nm) < 0) {
+        free(nm);
+        return NULL;
+    }
+    return nm;
+}
+
+static void name_put(struct fw_tree *tr, struct fw_name *nm)
+{
+    if (--nm->ref == 0) {
+        table_remove(&tr->names, nm);
+        free(nm);
+    }
+}
+
+static int node_path(struct fw_node *n, char *buf, size_t size)
+{
+    int len = 0;
+    if (n->parent) {
+        len = node_path(n->parent, buf, size);
+        if (len < 0 || (size_t)len + 1 >= size) {
             return -1;
         }
-        if (!strncmp(path, val, strlen(path))) {
-            break;
+        buf[len++] = '/';
+    }
+    len += snprintf(buf + len, size - len, "%s", n->name->str);
+    return (size_t)len < size ? len : -1;
+}
+
+/* "a//b/" -> "a/b" */
+static void path_normalize(char *dst, const char *src, size_t size)
+{
+    size_t n = 0;
+    for (; *src && n + 1 < size; src++) {
+        if (*src == '/' && n > 0 && dst[n - 1] == '/') {
+            continue;
         }
+        dst[n++] = *src;
     }
-    int wd = atoi(key);
-    if (-1 == inotify_rm_watch(fd, wd)) {
-        //printf("inotify_rm_watch %d failed(%d):%s\n", wd, errno, strerror(errno));
+    while (n > 1 && dst[n - 1] == '/') {
+        n--;
     }
-    del_path_list(fw, wd);
-    return 0;
+    dst[n] = '\0';
 }
 
-int fw_add_watch_recursive(struct fw *fw, const char *path)
+static struct fw_node *find_path(struct fw_tree *tr, const char *path)
 {
-    int res;
-    int fd = fw->fd;
-    struct dirent *ent = NULL;
-    DIR *pdir = NULL;
-    char full_path[PATH_MAX];
-    uint32_t mask = IN_CREATE | IN_DELETE;
+    char buf[PATH_MAX];
+    struct fw_node *n;
+    char *p, *s;
+    size_t len;
+
+    path_normalize(buf, path, sizeof(buf));
+    for (n = tr->roots; n; n = n->next) {
+        len = strlen(n->name->str);
+        if (strncmp(buf, n->name->str, len)) {
+            continue;
+        }
+        if (buf[len] == '\0') {
+            return n;
+        }
+        if (buf[len] != '/' && !(len == 1 && buf[0] == '/')) {
+            continue;
+        }
+        for (p = buf + len + (buf[len] == '/'); n && *p; p = s) {
+            s = strchr(p, '/');
+            if (s) {
+                *s++ = '\0';
+            } else {
+                s = p + strlen(p);
+            }
+            n = find_child(tr, n, p);
+        }
+        return n;
+    }
+    return NULL;
+}
+
+static void node_link(struct fw_node **head, struct fw_node *n)
+{
+    n->prev = NULL;
+    n->next = *head;
+    if (*head) {
+        (*head)->prev = n;
+    }
+    *head = n;
+}
+
+static void node_unlink(struct fw_node **head, struct fw_node *n)
+{
+    if (n->prev) {
+        n->prev->next = n->next;
+    } else {
+        *head = n->next;
+    }
+    if (n->next) {
+        n->next->prev = n->prev;
+    }
+}
+
+static void node_del(struct fw *fw, struct fw_node *n);
+
+static struct fw_node *node_add(struct fw *fw, struct fw_node *parent,
+                const char *name, int wd)
+{
+    struct fw_tree *tr = fw->tree;
+    struct fw_node *n, *old;
+
+    n = parent ? find_child(tr, parent, name) : NULL;
+    if (n) {
+        if (n->wd == wd) {
+            return n;
+        }
+        /* replaced before we saw the old one go */
+        node_del(fw, n);
+    }
+    n = (struct fw_node *)calloc(1, sizeof(struct fw_node));
+    if (!n) {
+        return NULL;
+    }
+    n->name = name_get(tr, name);
+    if (!n->name) {
+        free(n);
+        return NULL;
+    }
+    n->parent = parent;
+    n->wd = wd;
+    /* the same inode watched twice shares the wd, the newest node gets it */
+    old = find_wd(tr, wd);
+    if (old) {
+        table_remove(&tr->wds, old);
+        old->wd = -1;
+    }
+    table_insert(&tr->wds, n);
+    if (parent) {
+        table_insert(&tr->childs, n);
+        node_link(&parent->child, n);
+    } else {
+        node_link(&tr->roots, n);
+    }
+    return n;
+}
+
+/* drop a node and its whole subtree in one pass */
+static void node_del(struct fw *fw, struct fw_node *n)
+{
+    struct fw_tree *tr = fw->tree;
+    struct fw_node *cur, *up;
+
+    node_unlink(n->parent ? &n->parent->child : &tr->roots, n);
+    n->next = NULL;
+    cur = n;
+    while (cur) {
+        if (cur->child) {
+            cur = cur->child;
+            continue;
+        }
+        /* leaf: release it, go on with the sibling or back up */
+        if (cur->wd != -1) {
+            inotify_rm_watch(fw->fd, cur->wd);
+            table_remove(&tr->wds, cur);
+        }
+        if (cur->parent) {
+            table_remove(&tr->childs, cur);
+        }
+        up = (cur == n) ? NULL : cur->parent;
+        if (up) {
+            up->child = cur->next;
+        }
+        name_put(tr, cur->name);
+        free(cur);
+        cur = up ? (up->child ? up->child : up) : NULL;
+    }
+}
+
+static uint64_t fw_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static struct fw_pending *find_pending(struct fw_tree *tr, const char *path, uint32_t h)
+{
+    struct fw_table *t = &tr->pendings;
+    struct fw_pending *p;
+    uint32_t i;
+    for (i = h & t->mask; (p = t->slot[i]) != NULL; i = (i + 1) & t->mask) {
+        if (p->hash == h && !strcmp(p->path, path)) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static void pending_out(struct fw *fw, struct fw_pending *p)
+{
+    struct fw_tree *tr = fw->tree;
+
+    if (p->prev) {
+        p->prev->next = p->next;
+    } else {
+        tr->pend_head = p->next;
+    }
+    if (p->next) {
+        p->next->prev = p->prev;
+    } else {
+        tr->pend_tail = p->prev;
+    }
+    table_remove(&tr->pendings, p);
+    if (fw->notify_cb) {
+        fw->notify_cb(fw, FW_MODIFY_FILE, p->path);
+    }
+    free(p);
+}
+
+/* report held modify events, all of them if now is 0 */
+static void flush_pending(struct fw *fw, uint64_t now)
+{
+    struct fw_tree *tr = fw->tree;
+
+    while (tr->pend_head && (now == 0 || tr->pend_head->deadline <= now)) {
+        pending_out(fw, tr->pend_head);
+    }
+}
+
+static void fw_notify(struct fw *fw, enum fw_type type, char *path)
+{
+    struct fw_tree *tr = fw->tree;
+    struct fw_pending *p = NULL;
+    uint32_t h = 0;
+    size_t len;
+
+    if (tr->pend_head) {
+        h = fw_hash_str(path);
+        p = find_pending(tr, path, h);
+    }
+    if (type != FW_MODIFY_FILE || fw->coalesce_ms <= 0) {
+        /* a held modify of the same path goes out first */
+        if (p) {
+            pending_out(fw, p);
+        }
+        if (fw->notify_cb) {
+            fw->notify_cb(fw, type, path);
+        }
+        return;
+    }
+    if (p) {
+        return;
+    }
+    len = strlen(path);
+    p = (struct fw_pending *)malloc(sizeof(struct fw_pending) + len + 1);
+    if (!p) {
+        if (fw->notify_cb) {
+            fw->notify_cb(fw, type, path);
+        }
+        return;
+    }
+    p->hash = fw_hash_str(path);
+    p->deadline = fw_now_ms() + fw->coalesce_ms;
+    memcpy(p->path, path, len + 1);
+    if (table_insert(&tr->pendings, p) < 0) {
+        free(p);
+        if (fw->notify_cb) {
+            fw->notify_cb(fw, type, path);
+        }
+        return;
+    }
+    p->next = NULL;
+    p->prev = tr->pend_tail;
+    if (tr->pend_tail) {
+        tr->pend_tail->next = p;
+    } else {
+        tr->pend_head = p;
+    }
+    tr->pend_tail = p;
+}
+
+static uint32_t fw_mask(void)
+{
+    uint32_t mask = IN_CREATE | IN_DELETE | IN_ONLYDIR | IN_EXCL_UNLINK;
 #if WATCH_MOVED
     mask |= IN_MOVE | IN_MOVE_SELF;
 #endif
 #if WATCH_MODIFY
     mask |= IN_MODIFY;
 #endif
-    if (fd == -1 || path == NULL) {
-        printf("invalid paraments\n");
-        return -1;
+    return mask;
+}
+
+/*
+ * watch path (held in buf, len long) as child name of parent and all the
+ * directories below it, the directory is watched before it's read so
+ * nothing created meanwhile is missed.
+ * return -2 to stop when out of watches or fds
+ */
+static int add_tree(struct fw *fw, struct fw_node *parent, const char *name,
+                char *buf, size_t len)
+{
+    struct fw_node *n;
+    struct dirent *ent;
+    struct stat st;
+    DIR *pdir;
+    size_t nlen;
+    int wd, res = 0;
+
+    wd = inotify_add_watch(fw->fd, buf, fw_mask());
+    if (wd == -1) {
+        printf("inotify_add_watch %s failed(%d): %s\n", buf, errno, strerror(errno));
+        return (errno == ENOSPC || errno == ENOMEM) ? -2 : -1;
+    }
+    n = node_add(fw, parent, name, wd);
+    if (!n) {
+        inotify_rm_watch(fw->fd, wd);
+        return -2;
     }
-    pdir = opendir(path);
+    pdir = opendir(buf);
     if (!pdir) {
-        printf("opendir %s failed(%d): %s\n", path, errno, strerror(errno));
-        if (errno == EMFILE) {
-            return -2;//stop recursive
-        } else {
-            return -1;//continue recursive
-        }
+        printf("opendir %s failed(%d): %s\n", buf, errno, strerror(errno));
+        return (errno == EMFILE || errno == ENFILE) ? -2 : -1;
     }
-
-    while (NULL != (ent = readdir(pdir))) {
-        if (ent->d_type == DT_DIR) {
-            if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
+    while (res != -2 && NULL != (ent = readdir(pdir))) {
+        if (ent->d_type == DT_UNKNOWN) {
+            if (fstatat(dirfd(pdir), ent->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0 ||
+                !S_ISDIR(st.st_mode)) {
                 continue;
-            sprintf(full_path, "%s/%s", path, ent->d_name);
-            res = fw_add_watch_recursive(fw, full_path);
-            if (res == -2) {
-                return -2;
-            }
-        } else if (ent->d_type == DT_REG){
-            sprintf(full_path, "%s/%s", path, ent->d_name);
-            res = fw_add_watch(fw, full_path, mask);
-            if (res == -2) {
-                return -2;
             }
+        } else if (ent->d_type != DT_DIR) {
+            continue;
+        }
+        if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, "..")) {
+            continue;
         }
+        nlen = strlen(ent->d_name);
+        if (len + nlen + 2 > PATH_MAX) {
+            continue;
+        }
+        buf[len] = '/';
+        memcpy(buf + len + 1, ent->d_name, nlen + 1);
+        res = add_tree(fw, n, ent->d_name, buf, len + 1 + nlen);
+        buf[len] = '\0';
     }
-    fw_add_watch(fw, path, mask);
     closedir(pdir);
-    return 0;
+    return res == -2 ? -2 : 0;
+}
+
+int fw_add_watch_recursive(struct fw *fw, const char *path)
+{
+    char buf[PATH_MAX];
+
+    if (!fw || fw->fd == -1 || path == NULL) {
+        printf("invalid paraments\n");
+        return -1;
+    }
+    if (find_path(fw->tree, path)) {
+        return 0;
+    }
+    path_normalize(buf, path, sizeof(buf));
+    return add_tree(fw, NULL, buf, buf, strlen(buf));
 }
 
 int fw_del_watch_recursive(struct fw *fw, const char *path)
 {
-    int rank = 0;
-    char *key, *val;
-    while (1) {
-        rank = dict_enumerate(fw->dict_path, rank, &key, &val);
-        if (rank < 0) {
-            break;
-        }
-        if (!strncmp(path, val, strlen(path))) {
-            fw_del_watch(fw, path);
-        }
+    struct fw_node *n;
+
+    if (!fw || !path) {
+        return -1;
+    }
+    n = find_path(fw->tree, path);
+    if (!n) {
+        return -1;
     }
+    node_del(fw, n);
     return 0;
 }
 
-int fw_update_watch(struct fw *fw, struct inotify_event *iev)
+static int fw_update_watch(struct fw *fw, struct inotify_event *iev)
 {
     char full_path[PATH_MAX];
-    uint32_t mask = IN_CREATE | IN_DELETE;
-#if WATCH_MOVED
-    mask |= IN_MOVE | IN_MOVE_SELF;
-#endif
-#if WATCH_MODIFY
-    mask |= IN_MODIFY;
-#endif
-    char key[KEY_LEN];
-    memset(key, 0, sizeof(key));
-    snprintf(key, KEY_LEN, "%d", iev->wd);
-    char *path = (char *)dict_get(fw->dict_path, key, NULL);
-    if (!path) {
-        printf("dict_get NULL key=%s\n", key);
+    struct fw_node *n, *child;
+    int len;
+
+    n = find_wd(fw->tree, iev->wd);
+    if (!n) {
+        /* late events of a subtree we already dropped */
         return -1;
     }
-    memset(full_path, 0, sizeof(full_path));
-    snprintf(full_path, sizeof(full_path), "%s/%s", path, iev->name);
+    len = node_path(n, full_path, sizeof(full_path));
+    if (len < 0 || len + 1 + strlen(iev->name) >= sizeof(full_path)) {
+        return -1;
+    }
+    full_path[len] = '/';
+    strcpy(full_path + len + 1, iev->name);
     if (iev->mask & IN_CREATE) {
         if (iev->mask & IN_ISDIR) {
-            fw_add_watch_recursive(fw, full_path);
-            if (fw->notify_cb)
-                fw->notify_cb(fw, FW_CREATE_DIR, full_path);
+            add_tree(fw, n, iev->name, full_path, strlen(full_path));
+            fw_notify(fw, FW_CREATE_DIR, full_path);
         } else {
-            fw_add_watch(fw, full_path, mask);
-            if (fw->notify_cb)
-                fw->notify_cb(fw, FW_CREATE_FILE, full_path);
+            fw_notify(fw, FW_CREATE_FILE, full_path);
         }
     } else if (iev->mask & IN_DELETE) {
         if (iev->mask & IN_ISDIR) {
-            fw_del_watch_recursive(fw, full_path);
-            if (fw->notify_cb)
-                fw->notify_cb(fw, FW_DELETE_DIR, full_path);
+            child = find_child(fw->tree, n, iev->name);
+            if (child) {
+                node_del(fw, child);
+            }
+            fw_notify(fw, FW_DELETE_DIR, full_path);
         } else {
-            fw_del_watch(fw, full_path);
-            if (fw->notify_cb)
-                fw->notify_cb(fw, FW_DELETE_FILE, full_path);
+            fw_notify(fw, FW_DELETE_FILE, full_path);
         }
-    } else if (iev->mask & IN_MOVED_FROM){
+    } else if (iev->mask & IN_MOVED_FROM) {
         if (iev->mask & IN_ISDIR) {
-            fw_del_watch_recursive(fw, full_path);
-            if (fw->notify_cb)
-                fw->notify_cb(fw, FW_MOVE_FROM_DIR, full_path);
+            child = find_child(fw->tree, n, iev->name);
+            if (child) {
+                node_del(fw, child);
+            }
+            fw_notify(fw, FW_MOVE_FROM_DIR, full_path);
         } else {
-            fw_del_watch(fw, full_path);
-            if (fw->notify_cb)
-                fw->notify_cb(fw, FW_MOVE_FROM_FILE, full_path);
+            fw_notify(fw, FW_MOVE_FROM_FILE, full_path);
         }
-    } else if (iev->mask & IN_MOVED_TO){
+    } else if (iev->mask & IN_MOVED_TO) {
         if (iev->mask & IN_ISDIR) {
-            fw_add_watch_recursive(fw, full_path);
-            if (fw->notify_cb)
-                fw->notify_cb(fw, FW_MOVE_TO_DIR, full_path);
+            add_tree(fw, n, iev->name, full_path, strlen(full_path));
+            fw_notify(fw, FW_MOVE_TO_DIR, full_path);
         } else {
-            fw_add_watch(fw, full_path, mask);
-            if (fw->notify_cb)
-                fw->notify_cb(fw, FW_MOVE_TO_FILE, full_path);
-        }
-    } else if (iev->mask & IN_IGNORED){
-    } else if (iev->mask & IN_MODIFY){
-        if (fw->notify_cb)
-            fw->notify_cb(fw, FW_MODIFY_FILE, full_path);
+            fw_notify(fw, FW_MOVE_TO_FILE, full_path);
+        }
+    } else if (iev->mask & IN_MODIFY) {
+        fw_notify(fw, FW_MODIFY_FILE, full_path);
     } else {
         printf("unknown inotify_event:%d\n", iev->mask);
     }
     return 0;
 }
 
+/* events of a watched directory itself */
+static void fw_update_self(struct fw *fw, struct inotify_event *iev)
+{
+    struct fw_node *n;
+
+    if (iev->mask & IN_Q_OVERFLOW) {
+        printf("inotify event queue overflow, events lost\n");
+        return;
+    }
+    if (iev->mask & IN_IGNORED) {
+        /* kernel dropped the watch, the wd may come back for another dir */
+        n = find_wd(fw->tree, iev->wd);
+        if (n) {
+            table_remove(&fw->tree->wds, n);
+            n->wd = -1;
+        }
+    }
+}
+
 struct fw *fw_init(void (notify_cb)(struct fw *fw, enum fw_type type, char *path))
 {
+    struct fw_tree *tr = NULL;
     struct fw *fw = calloc(1, sizeof(struct fw));
     if (!fw) {
         printf("malloc fw failed\n");
         goto err;
     }
-    int fd = inotify_init();
-    if (fd == -1) {
+    fw->fd = -1;
+    fw->fan_fd = -1;
+    tr = calloc(1, sizeof(struct fw_tree));
+    if (!tr || table_init(&tr->wds, hash_wd) || table_init(&tr->childs, hash_child) ||
+        table_init(&tr->names, hash_name) || table_init(&tr->pendings, hash_pending)) {
+        printf("malloc fw_tree failed\n");
+        goto err;
+    }
+    fw->tree = tr;
+    fw->fd = inotify_init1(IN_CLOEXEC);
+    if (fw->fd == -1) {
         printf("inotify_init failed: %d\n", errno);
         goto err;
     }
-    struct gevent_base *evbase = gevent_base_create();
-    if (!evbase) {
+    fw->evbase = gevent_base_create();
+    if (!fw->evbase) {
         printf("gevent_base_create failed\n");
         goto err;
     }
-    fw->fd = fd;
-    fw->evbase = evbase;
-    fw->dict_path = dict_new();
     fw->notify_cb = notify_cb;
     return fw;
 err:
+    if (tr) {
+        table_deinit(&tr->wds);
+        table_deinit(&tr->childs);
+        table_deinit(&tr->names);
+        table_deinit(&tr->pendings);
+        free(tr);
+    }
     if (fw) {
+        if (fw->fd != -1) {
+            close(fw->fd);
+        }
         free(fw);
     }
     return NULL;
@@ -257,33 +762,89 @@ err:
 
 void fw_deinit(struct fw *fw)
 {
+    struct fw_tree *tr;
+    struct fw_pending *p;
+    int i;
+
     if (!fw) {
         return;
     }
-    int rank = 0;
-    char *key, *val;
-    while (1) {
-        rank = dict_enumerate(fw->dict_path, rank, &key, &val);
-        if (rank < 0) {
-            break;
-        }
-        inotify_rm_watch(fw->fd, atoi(key));
-        free(val);
+    tr = fw->tree;
+    while (tr->roots) {
+        node_del(fw, tr->roots);
     }
-    dict_free(fw->dict_path);
+    while ((p = tr->pend_head) != NULL) {
+        tr->pend_head = p->next;
+        free(p);
+    }
+    for (i = 0; i < tr->nmark; i++) {
+        close(tr->marks[i].mount_fd);
+        free(tr->marks[i].path);
+    }
+    free(tr->marks);
+    table_deinit(&tr->wds);
+    table_deinit(&tr->childs);
+    table_deinit(&tr->names);
+    table_deinit(&tr->pendings);
+    free(tr);
     gevent_base_loop_break(fw->evbase);
+    if (fw->timer) {
+        gevent_del(fw->evbase, &fw->timer);
+        gevent_timer_destroy(fw->timer);
+    }
+    if (fw->ev) {
+        gevent_del(fw->evbase, &fw->ev);
+        gevent_destroy(fw->ev);
+    }
     close(fw->fd);
+    if (fw->fan_ev) {
+        gevent_del(fw->evbase, &fw->fan_ev);
+        gevent_destroy(fw->fan_ev);
+    }
+    if (fw->fan_fd != -1) {
+        close(fw->fan_fd);
+    }
     gevent_base_destroy(fw->evbase);
     free(fw);
 }
 
-void on_read_ops(int fd, void *arg)
+static void on_timer(int fd, void *arg)
+{
+    struct fw *fw = (struct fw *)arg;
+    flush_pending(fw, fw_now_ms());
+}
+
+int fw_set_coalesce(struct fw *fw, int msec)
+{
+    if (!fw) {
+        return -1;
+    }
+    if (fw->timer) {
+        gevent_del(fw->evbase, &fw->timer);
+        gevent_timer_destroy(fw->timer);
+        fw->timer = NULL;
+    }
+    fw->coalesce_ms = msec > 0 ? msec : 0;
+    if (fw->coalesce_ms == 0) {
+        flush_pending(fw, 0);
+        return 0;
+    }
+    /* held events go out between msec and 1.5 * msec */
+    fw->timer = gevent_timer_create(msec > 1 ? msec / 2 : 1, TIMER_PERSIST, on_timer, fw);
+    if (!fw->timer) {
+        printf("gevent_timer_create failed\n");
+        fw->coalesce_ms = 0;
+        return -1;
+    }
+    gevent_add(fw->evbase, &fw->timer);
+    return 0;
+}
+
+static void on_read_ops(int fd, void *arg)
 {
-#define INOTIFYEVENTBUFSIZE (1024)
     int i, len;
     struct inotify_event *iev;
-    size_t iev_size;
-    char ibuf[INOTIFYEVENTBUFSIZE] __attribute__ ((aligned(4))) = {0};
+    char ibuf[FW_EVENT_BUF] __attribute__ ((aligned(__alignof__(struct inotify_event))));
     struct fw *fw = (struct fw *)arg;
 
 again:
@@ -302,20 +863,222 @@ again:
             if (iev->len > 0) {
                 fw_update_watch(fw, iev);
             } else {
+                fw_update_self(fw, iev);
             }
-            iev_size = sizeof(struct inotify_event) + iev->len;
-            i += iev_size;
+            i += sizeof(struct inotify_event) + iev->len;
         }
     }
+    if (fw->tree->pend_head) {
+        flush_pending(fw, fw_now_ms());
+    }
 }
 
+#if defined (FAN_REPORT_DFID_NAME)
+static struct fw_mark *fan_mark_find(struct fw_tree *tr, const void *fsid, const char *path)
+{
+    size_t len;
+    int i;
+    for (i = 0; i < tr->nmark; i++) {
+        if (memcmp(&tr->marks[i].fsid, fsid, sizeof(fsid_t))) {
+            continue;
+        }
+        if (!path) {
+            return &tr->marks[i];
+        }
+        len = strlen(tr->marks[i].path);
+        if (!strncmp(path, tr->marks[i].path, len) &&
+            (path[len] == '/' || path[len] == '\0' || len == 1)) {
+            return &tr->marks[i];
+        }
+    }
+    return NULL;
+}
+
+/* directory handle + name of the event to a path, needs CAP_DAC_READ_SEARCH */
+static int fan_resolve(struct fw *fw, struct fanotify_event_info_fid *fid,
+                char *buf, size_t size)
+{
+    struct file_handle *fh = (struct file_handle *)fid->handle;
+    const char *name = (const char *)fh->f_handle + fh->handle_bytes;
+    struct fw_mark *mark;
+    char proc[32];
+    ssize_t len;
+    int fd;
+
+    mark = fan_mark_find(fw->tree, &fid->fsid, NULL);
+    if (!mark) {
+        return -1;
+    }
+    fd = open_by_handle_at(mark->mount_fd, fh, O_PATH);
+    if (fd == -1) {
+        /* ESTALE: the directory is gone already */
+        return -1;
+    }
+    snprintf(proc, sizeof(proc), "/proc/self/fd/%d", fd);
+    len = readlink(proc, buf, size - 1);
+    close(fd);
+    if (len < 0) {
+        return -1;
+    }
+    buf[len] = '\0';
+    if (strcmp(name, ".") && (size_t)len + 1 + strlen(name) < size) {
+        snprintf(buf + len, size - len, "%s%s", len == 1 ? "" : "/", name);
+    }
+    return fan_mark_find(fw->tree, &fid->fsid, buf) ? 0 : -1;
+}
+
+static void fan_event(struct fw *fw, uint64_t mask, char *path)
+{
+    int dir = !!(mask & FAN_ONDIR);
+    if (mask & FAN_CREATE) {
+        fw_notify(fw, dir ? FW_CREATE_DIR : FW_CREATE_FILE, path);
+    }
+    if (mask & FAN_MOVED_TO) {
+        fw_notify(fw, dir ? FW_MOVE_TO_DIR : FW_MOVE_TO_FILE, path);
+    }
+    if (mask & FAN_MODIFY) {
+        fw_notify(fw, FW_MODIFY_FILE, path);
+    }
+    if (mask & FAN_MOVED_FROM) {
+        fw_notify(fw, dir ? FW_MOVE_FROM_DIR : FW_MOVE_FROM_FILE, path);
+    }
+    if (mask & FAN_DELETE) {
+        fw_notify(fw, dir ? FW_DELETE_DIR : FW_DELETE_FILE, path);
+    }
+}
+
+static void on_fan_read(int fd, void *arg)
+{
+    char buf[FW_EVENT_BUF] __attribute__ ((aligned(__alignof__(struct fanotify_event_metadata))));
+    char path[PATH_MAX];
+    struct fw *fw = (struct fw *)arg;
+    struct fanotify_event_metadata *md;
+    struct fanotify_event_info_header *hdr;
+    ssize_t len;
+    size_t off;
+
+    len = read(fd, buf, sizeof(buf));
+    if (len <= 0) {
+        if (len < 0 && errno != EAGAIN && errno != EINTR) {
+            printf("read fanotify event buffer error: %s\n", strerror(errno));
+        }
+        return;
+    }
+    for (md = (struct fanotify_event_metadata *)buf; FAN_EVENT_OK(md, len);
+         md = FAN_EVENT_NEXT(md, len)) {
+        if (md->vers != FANOTIFY_METADATA_VERSION) {
+            printf("fanotify metadata version mismatch\n");
+            break;
+        }
+        if (md->mask & FAN_Q_OVERFLOW) {
+            printf("fanotify event queue overflow, events lost\n");
+            continue;
+        }
+        for (off = md->metadata_len; off + sizeof(*hdr) <= md->event_len; off += hdr->len) {
+            hdr = (struct fanotify_event_info_header *)((char *)md + off);
+            if (hdr->len == 0) {
+                break;
+            }
+            if (hdr->info_type != FAN_EVENT_INFO_TYPE_DFID_NAME) {
+                continue;
+            }
+            if (fan_resolve(fw, (struct fanotify_event_info_fid *)hdr, path, sizeof(path)) == 0) {
+                fan_event(fw, md->mask, path);
+            }
+            break;
+        }
+    }
+    if (fw->tree->pend_head) {
+        flush_pending(fw, fw_now_ms());
+    }
+}
+
+int fw_add_watch_mount(struct fw *fw, const char *path)
+{
+    struct fw_tree *tr;
+    struct fw_mark *marks;
+    struct statfs sfs;
+    char real[PATH_MAX];
+    int fd;
+
+    if (!fw || !path) {
+        printf("invalid paraments\n");
+        return -1;
+    }
+    tr = fw->tree;
+    if (!realpath(path, real) || statfs(real, &sfs) < 0) {
+        printf("stat %s failed(%d): %s\n", path, errno, strerror(errno));
+        return -1;
+    }
+    if (fw->fan_fd == -1) {
+        fw->fan_fd = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME |
+                                   FAN_CLOEXEC | FAN_NONBLOCK, O_RDONLY | O_LARGEFILE);
+        if (fw->fan_fd == -1) {
+            printf("fanotify_init failed(%d): %s\n", errno, strerror(errno));
+            return -1;
+        }
+        fw->fan_ev = gevent_create(fw->fan_fd, on_fan_read, NULL, NULL, fw);
+        if (!fw->fan_ev || gevent_add(fw->evbase, &fw->fan_ev) < 0) {
+            printf("gevent_add fanotify failed\n");
+            if (fw->fan_ev) {
+                gevent_destroy(fw->fan_ev);
+                fw->fan_ev = NULL;
+            }
+            close(fw->fan_fd);
+            fw->fan_fd = -1;
+            return -1;
+        }
+    }
+    fd = open(real, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
+        printf("open %s failed(%d): %s\n", real, errno, strerror(errno));
+        return -1;
+    }
+    if (fanotify_mark(fw->fan_fd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM,
+                      FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO |
+                      FAN_MODIFY | FAN_ONDIR, AT_FDCWD, real) < 0) {
+        printf("fanotify_mark %s failed(%d): %s\n", real, errno, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    marks = (struct fw_mark *)realloc(tr->marks, (tr->nmark + 1) * sizeof(struct fw_mark));
+    if (!marks) {
+        close(fd);
+        return -1;
+    }
+    tr->marks = marks;
+    marks[tr->nmark].mount_fd = fd;
+    memcpy(&marks[tr->nmark].fsid, &sfs.f_fsid, sizeof(fsid_t));
+    marks[tr->nmark].path = strdup(real);
+    if (!marks[tr->nmark].path) {
+        close(fd);
+        return -1;
+    }
+    tr->nmark++;
+    return 0;
+}
+#else
+int fw_add_watch_mount(struct fw *fw, const char *path)
+{
+    printf("fanotify with directory entry events is not supported\n");
+    return -1;
+}
+#endif
+
 int fw_dispatch(struct fw *fw)
 {
-    int fd = fw->fd;
-    struct gevent *ev;
     struct gevent_base *evbase = fw->evbase;
-    ev = gevent_create(fd, on_read_ops, NULL, NULL, fw);
-    gevent_add(evbase, &ev);
+    if (!fw->ev) {
+        fw->ev = gevent_create(fw->fd, on_read_ops, NULL, NULL, fw);
+        if (!fw->ev || gevent_add(evbase, &fw->ev) < 0) {
+            printf("gevent_add inotify failed\n");
+            if (fw->ev) {
+                gevent_destroy(fw->ev);
+                fw->ev = NULL;
+            }
+            return -1;
+        }
+    }
     gevent_base_loop(evbase);
     return 0;
 }
@@ -21,6 +21,9 @@
  ******************************************************************************/
 #include <libposix.h>
 #include "libfile.h"
+#if defined (ENABLE_FILE_WALK)
+#include "libfilewalk.h"
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
@@ -35,6 +38,7 @@
 #include <sys/param.h>
 #include <sys/mount.h>
 #endif
+#include <sys/mman.h>
 
 
 #include <string.h>
@@ -116,11 +120,19 @@ static struct {
 
 extern const struct file_ops io_ops;
 extern const struct file_ops fio_ops;
+#if defined (ENABLE_FILE_AIO)
+extern const struct file_ops aio_ops;
+#endif
 
 
 static const struct file_ops *file_ops[] = {
     &io_ops,
     &fio_ops,
+#if defined (ENABLE_FILE_AIO)
+    &aio_ops,
+#else
+    NULL,
+#endif
     NULL
 };
 
@@ -157,7 +169,16 @@ struct file *file_open(const char *path, file_open_mode_t mode)
         return NULL;
     }
     file->ops = file_ops[backend];
+    if (!file->ops) {
+        printf("file backend %d is not supported\n", backend);
+        free(file);
+        return NULL;
+    }
     file->fd = file->ops->_open(path, mode);
+    if (!file->fd) {
+        free(file);
+        return NULL;
+    }
     return file;
 }
 
@@ -259,37 +280,325 @@ struct iovec *file_dump(const char *path)
     struct iovec *buf = NULL;
     struct file *f = NULL;
     ssize_t size = 0;
+    ssize_t len;
     if (!path) {
         return NULL;
     }
-    size = file_get_size(path);
-    if (size == 0) {
+    f = file_open(path, F_RDONLY);
+    if (!f) {
+        printf("file open failed!\n");
+        return NULL;
+    }
+    size = file_size(f);
+    if (size <= 0) {
+        file_close(f);
         return NULL;
     }
     buf = (struct iovec *)calloc(1, sizeof(struct iovec));
     if (!buf) {
         printf("malloc failed!\n");
+        file_close(f);
         return NULL;
     }
-    buf->iov_len = size;
-    buf->iov_base = calloc(1, buf->iov_len);
+    /* read overwrites it all, no need to zero */
+    buf->iov_base = malloc(size);
     if (!buf->iov_base) {
         printf("malloc failed!\n");
-        return NULL;
-    }
-
-    f = file_open(path, F_RDONLY);
-    if (!f) {
-        printf("file open failed!\n");
-        free(buf->iov_base);
         free(buf);
+        file_close(f);
         return NULL;
     }
-    file_read(f, buf->iov_base, buf->iov_len);
+    len = file_read(f, buf->iov_base, size);
     file_close(f);
+    if (len <= 0) {
+        iovec_destroy(buf);
+        return NULL;
+    }
+    buf->iov_len = len;
     return buf;
 }
 
+#if defined (OS_LINUX) || defined (OS_APPLE)
+#define FILE_READER_WINDOW  (4 * 1024 * 1024)
+
+static size_t file_page_size(void)
+{
+    static size_t page_size = 0;
+    if (!page_size) {
+        page_size = sysconf(_SC_PAGESIZE);
+    }
+    return page_size;
+}
+
+static void file_madvise(void *addr, size_t len, int flags)
+{
+    if (flags & FILE_MAP_SEQUENTIAL) {
+        madvise(addr, len, MADV_SEQUENTIAL);
+    }
+    if (flags & FILE_MAP_RANDOM) {
+        madvise(addr, len, MADV_RANDOM);
+    }
+#if defined (MADV_HUGEPAGE)
+    if (flags & FILE_MAP_HUGEPAGE) {
+        /* only with CONFIG_READ_ONLY_THP_FOR_FS, a hint anyway */
+        madvise(addr, len, MADV_HUGEPAGE);
+    }
+#endif
+    if (flags & FILE_MAP_WILLNEED) {
+        madvise(addr, len, MADV_WILLNEED);
+    }
+}
+
+struct file_map *file_map(const char *path, uint64_t offset, size_t len, int flags)
+{
+    struct file_map *map;
+    struct stat st;
+    uint64_t map_off;
+    int mflags = MAP_PRIVATE;
+    int fd;
+
+    if (!path) {
+        return NULL;
+    }
+    fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        printf("open %s failed:%d %s\n", path, errno, strerror(errno));
+        return NULL;
+    }
+    if (fstat(fd, &st) < 0 || (uint64_t)st.st_size <= offset) {
+        printf("%s is empty or shorter than %" PRIu64 "\n", path, offset);
+        close(fd);
+        return NULL;
+    }
+    map = (struct file_map *)calloc(1, sizeof(struct file_map));
+    if (!map) {
+        printf("malloc failed!\n");
+        close(fd);
+        return NULL;
+    }
+    if (len == 0 || len > st.st_size - offset) {
+        len = st.st_size - offset;
+    }
+    map_off = offset & ~((uint64_t)file_page_size() - 1);
+    map->map_len = len + (offset - map_off);
+#if defined (MAP_POPULATE)
+    if (flags & FILE_MAP_POPULATE) {
+        mflags |= MAP_POPULATE;
+    }
+#endif
+    map->map_base = mmap(NULL, map->map_len, PROT_READ, mflags, fd, map_off);
+    /* the mapping holds its own reference to the file */
+    close(fd);
+    if (map->map_base == MAP_FAILED) {
+        printf("mmap %s failed:%d %s\n", path, errno, strerror(errno));
+        free(map);
+        return NULL;
+    }
+    map->base = (char *)map->map_base + (offset - map_off);
+    map->len = len;
+    map->offset = offset;
+    map->file_size = st.st_size;
+    file_madvise(map->map_base, map->map_len, flags);
+    return map;
+}
+
+int file_map_advise(struct file_map *map, size_t offset, size_t len, int flags)
+{
+    uintptr_t start, end;
+    if (!map || offset >= map->len) {
+        return -1;
+    }
+    if (len == 0 || len > map->len - offset) {
+        len = map->len - offset;
+    }
+    start = (uintptr_t)map->base + offset;
+    end = start + len;
+    start &= ~((uintptr_t)file_page_size() - 1);
+    file_madvise((void *)start, end - start, flags);
+    return 0;
+}
+
+void file_unmap(struct file_map *map)
+{
+    if (!map) {
+        return;
+    }
+    munmap(map->map_base, map->map_len);
+    free(map);
+}
+
+struct iovec *file_dump_map(const char *path)
+{
+    struct iovec *iov;
+    struct file_map *map = file_map(path, 0, 0, FILE_MAP_SEQUENTIAL | FILE_MAP_WILLNEED);
+    if (!map) {
+        return NULL;
+    }
+    iov = (struct iovec *)calloc(1, sizeof(struct iovec));
+    if (!iov) {
+        printf("malloc failed!\n");
+        file_unmap(map);
+        return NULL;
+    }
+    /* offset 0, so base and len are all munmap needs later */
+    iov->iov_base = map->base;
+    iov->iov_len = map->len;
+    free(map);
+    return iov;
+}
+
+void file_dump_unmap(struct iovec *iov)
+{
+    if (!iov) {
+        return;
+    }
+    munmap(iov->iov_base, iov->iov_len);
+    free(iov);
+}
+
+struct file_reader *file_reader_open(const char *path, size_t window)
+{
+    struct file_reader *r;
+    struct stat st;
+    size_t page = file_page_size();
+
+    if (!path) {
+        return NULL;
+    }
+    r = (struct file_reader *)calloc(1, sizeof(struct file_reader));
+    if (!r) {
+        printf("malloc failed!\n");
+        return NULL;
+    }
+    r->fd = open(path, O_RDONLY);
+    if (r->fd == -1) {
+        printf("open %s failed:%d %s\n", path, errno, strerror(errno));
+        free(r);
+        return NULL;
+    }
+    if (fstat(r->fd, &st) < 0) {
+        printf("fstat %s failed:%d %s\n", path, errno, strerror(errno));
+        close(r->fd);
+        free(r);
+        return NULL;
+    }
+    r->size = st.st_size;
+    if (window == 0) {
+        window = FILE_READER_WINDOW;
+    }
+    r->window = (window + page - 1) & ~(page - 1);
+#if defined (OS_LINUX)
+    posix_fadvise(r->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    return r;
+}
+
+ssize_t file_reader_next(struct file_reader *r, const void **data)
+{
+    uint64_t map_off;
+    size_t skip;
+
+    if (!r || !data) {
+        return -1;
+    }
+    if (r->map) {
+        munmap(r->map, r->map_len);
+        r->map = NULL;
+    }
+    if (r->pos >= r->size) {
+        return 0;
+    }
+    map_off = r->pos & ~((uint64_t)file_page_size() - 1);
+    skip = r->pos - map_off;
+    r->map_len = r->window;
+    if (r->map_len > r->size - map_off) {
+        r->map_len = r->size - map_off;
+    }
+    r->map = mmap(NULL, r->map_len, PROT_READ, MAP_PRIVATE, r->fd, map_off);
+    if (r->map == MAP_FAILED) {
+        printf("mmap failed:%d %s\n", errno, strerror(errno));
+        r->map = NULL;
+        return -1;
+    }
+    madvise(r->map, r->map_len, MADV_SEQUENTIAL);
+#if defined (OS_LINUX)
+    /* the window after this one is read while this one is consumed */
+    if (map_off + r->map_len < r->size) {
+        posix_fadvise(r->fd, map_off + r->map_len, r->window, POSIX_FADV_WILLNEED);
+    }
+#endif
+    *data = (char *)r->map + skip;
+    r->pos = map_off + r->map_len;
+    return r->map_len - skip;
+}
+
+int file_reader_seek(struct file_reader *r, uint64_t pos)
+{
+    if (!r || pos > r->size) {
+        return -1;
+    }
+    r->pos = pos;
+    return 0;
+}
+
+void file_reader_close(struct file_reader *r)
+{
+    if (!r) {
+        return;
+    }
+    if (r->map) {
+        munmap(r->map, r->map_len);
+    }
+    close(r->fd);
+    free(r);
+}
+#else
+struct file_map *file_map(const char *path, uint64_t offset, size_t len, int flags)
+{
+    printf("%s not supported\n", __func__);
+    return NULL;
+}
+
+int file_map_advise(struct file_map *map, size_t offset, size_t len, int flags)
+{
+    return -1;
+}
+
+void file_unmap(struct file_map *map)
+{
+}
+
+struct iovec *file_dump_map(const char *path)
+{
+    return file_dump(path);
+}
+
+void file_dump_unmap(struct iovec *iov)
+{
+    iovec_destroy(iov);
+}
+
+struct file_reader *file_reader_open(const char *path, size_t window)
+{
+    printf("%s not supported\n", __func__);
+    return NULL;
+}
+
+ssize_t file_reader_next(struct file_reader *r, const void **data)
+{
+    return -1;
+}
+
+int file_reader_seek(struct file_reader *r, uint64_t pos)
+{
+    return -1;
+}
+
+void file_reader_close(struct file_reader *r)
+{
+}
+#endif
+
 
 struct file_systat *file_get_systat(const char *path)
 {
@@ -481,6 +790,7 @@ int dfs_dir_size(const char *path, uint64_t *size)
     DIR *pdir = NULL;
     struct dirent *ent = NULL;
     char full_path[PATH_MAX];
+    struct stat st;
     int ret;
     pdir = opendir(path);
     if (!pdir) {
@@ -492,19 +802,29 @@ int dfs_dir_size(const char *path, uint64_t *size)
         }
     }
     while (NULL != (ent = readdir(pdir))) {
-        memset(full_path, 0, sizeof(full_path));
-        snprintf(full_path, sizeof(full_path), "%s/%s", path, ent->d_name);
-        if (ent->d_type == DT_DIR) {
-            if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, "..")) {
+        if (ent->d_type == DT_UNKNOWN || ent->d_type == DT_REG) {
+            /* relative to the open directory, no path lookup again */
+            if (fstatat(dirfd(pdir), ent->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
                 continue;
             }
-            ret = dfs_dir_size(full_path, size);
-            if (ret == -EMFILE) {
-                closedir(pdir);
-                return ret;
+            if (S_ISREG(st.st_mode)) {
+                *size += st.st_size;
+                continue;
+            }
+            if (!S_ISDIR(st.st_mode)) {
+                continue;
             }
-        } else if (ent->d_type == DT_REG) {
-            *size += file_get_size(full_path);
+        } else if (ent->d_type != DT_DIR) {
+            continue;
+        }
+        if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, "..")) {
+            continue;
+        }
+        snprintf(full_path, sizeof(full_path), "%s/%s", path, ent->d_name);
+        ret = dfs_dir_size(full_path, size);
+        if (ret == -EMFILE) {
+            closedir(pdir);
+            return ret;
         }
     }
     closedir(pdir);
@@ -513,8 +833,23 @@ int dfs_dir_size(const char *path, uint64_t *size)
 
 int file_dir_size(const char *path, uint64_t *size)
 {
+#if defined (ENABLE_FILE_WALK)
+    struct file_walk_conf conf;
+    struct file_walk_stat st;
+    file_walk_conf_init(&conf);
+    /* no pool per call, use file_walk with a shared pool for big trees */
+    conf.parallel = 0;
+    conf.flags = FILE_WALK_SIZE;
+    if (file_walk(path, &conf, &st) < 0) {
+        *size = 0;
+        return -1;
+    }
+    *size = st.bytes;
+    return 0;
+#else
     *size = 0;
     return dfs_dir_size(path, size);
+#endif
 }
 
 int file_num_in_dir(const char *path)
@@ -90,9 +90,44 @@ typedef struct file_ops {
     void (*_close)(struct file_desc *fd);
 } file_ops_t;
 
+/*
+ * read-only file mapping, pages come from and stay in the page cache so a
+ * mapped file starts instantly and is shared with every other reader
+ */
+enum file_map_flag {
+    FILE_MAP_SEQUENTIAL = (1 << 0),     /* aggressive readahead, drop behind */
+    FILE_MAP_RANDOM     = (1 << 1),     /* no readahead */
+    FILE_MAP_WILLNEED   = (1 << 2),     /* start reading the range now */
+    FILE_MAP_HUGEPAGE   = (1 << 3),     /* THP if the fs supports it */
+    FILE_MAP_POPULATE   = (1 << 4),     /* fault everything in at map time */
+};
+
+typedef struct file_map {
+    void *base;                 /* at the offset asked for */
+    size_t len;
+    uint64_t offset;
+    uint64_t file_size;
+    void *map_base;             /* page aligned */
+    size_t map_len;
+} file_map_t;
+
+/*
+ * streaming reader for files larger than RAM, maps a window at a time and
+ * reads the next one ahead
+ */
+typedef struct file_reader {
+    int fd;
+    uint64_t size;
+    uint64_t pos;
+    size_t window;
+    void *map;
+    size_t map_len;
+} file_reader_t;
+
 typedef enum file_backend_type {
     FILE_BACKEND_IO,
     FILE_BACKEND_FIO,
+    FILE_BACKEND_AIO,           /* linux, see libfileaio.h */
 } file_backend_type;
 
 GEAR_API void file_backend(file_backend_type type);
@@ -110,6 +145,30 @@ GEAR_API ssize_t file_size(struct file *file);
 GEAR_API ssize_t file_get_size(const char *path);
 GEAR_API int file_get_info(const char *path, struct file_info *info);
 GEAR_API struct iovec *file_dump(const char *path);
+
+/*
+ * same as file_dump but the iovec is a read-only mapping of the file,
+ * release with file_dump_unmap, not iovec_destroy
+ */
+GEAR_API struct iovec *file_dump_map(const char *path);
+GEAR_API void file_dump_unmap(struct iovec *iov);
+
+/*
+ * len 0 maps up to the end of file, flags are enum file_map_flag
+ */
+GEAR_API struct file_map *file_map(const char *path, uint64_t offset, size_t len, int flags);
+GEAR_API int file_map_advise(struct file_map *map, size_t offset, size_t len, int flags);
+GEAR_API void file_unmap(struct file_map *map);
+
+/*
+ * window 0 takes 4MB. file_reader_next returns the length of the next
+ * piece, 0 at end of file and -1 on error. *data stays valid until the
+ * next call.
+ */
+GEAR_API struct file_reader *file_reader_open(const char *path, size_t window);
+GEAR_API ssize_t file_reader_next(struct file_reader *r, const void **data);
+GEAR_API int file_reader_seek(struct file_reader *r, uint64_t pos);
+GEAR_API void file_reader_close(struct file_reader *r);
 GEAR_API int file_sync(struct file *file);
 GEAR_API off_t file_seek(struct file *file, off_t offset, int whence);
 GEAR_API int file_rename(const char* old_file, const char* new_file);
@@ -0,0 +1,97 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#ifndef LIBFILEAIO_H
+#define LIBFILEAIO_H
+
+#include "libfile.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * asynchronous write-behind backend, linux only
+ *
+ * file_write() copies into a chunk and returns, full chunks are submitted
+ * to io_uring (or a libworkq thread pool when io_uring is not available)
+ * and written in the background. file_write() only blocks when all chunks
+ * of the file are in flight. An io error is sticky: later file_write(),
+ * file_sync() and file_aio_wait() return -1.
+ *
+ * one writer per file, like the other backends.
+ */
+
+enum file_aio_engine {
+    FILE_AIO_AUTO,              /* io_uring, thread pool if not available */
+    FILE_AIO_URING,
+    FILE_AIO_WORKQ,
+};
+
+struct file_aio_conf {
+    enum file_aio_engine engine;
+    int direct;                 /* O_DIRECT, buffered if the fs refuses it */
+    size_t chunk_size;          /* small writes are coalesced up to this */
+    int nr_chunks;              /* per file, bounds memory and io in flight */
+    uint64_t prealloc_size;     /* fallocate ahead in steps of this, 0: off */
+    uint64_t sync_size;         /* sync_file_range every this many bytes, 0: off */
+    /* called from the io thread when a chunk is done, keep it short */
+    void (*complete)(void *arg, uint64_t offset, size_t len, int err);
+    void *arg;
+};
+
+struct file_aio_stat {
+    uint64_t submitted;         /* chunks */
+    uint64_t completed;
+    uint64_t bytes;
+    uint64_t stalls;            /* file_write waited for a free chunk */
+    uint64_t stall_ns;
+    int inflight;
+    int error;                  /* first errno seen */
+    enum file_aio_engine engine;
+    int direct;
+};
+
+GEAR_API void file_aio_conf_init(struct file_aio_conf *conf);
+
+/*
+ * conf NULL takes the defaults, same as file_open() with FILE_BACKEND_AIO
+ */
+GEAR_API struct file *file_open_aio(const char *path, file_open_mode_t mode,
+                const struct file_aio_conf *conf);
+
+/*
+ * submit the partly filled chunk without waiting for it,
+ * with O_DIRECT the padded tail block is waited for
+ */
+GEAR_API int file_aio_flush(struct file *file);
+
+/*
+ * flush and wait for everything in flight, ms < 0 waits forever
+ * return 0 if all written, -1 on timeout or io error
+ */
+GEAR_API int file_aio_wait(struct file *file, int64_t ms);
+GEAR_API int file_aio_get_stat(struct file *file, struct file_aio_stat *st);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
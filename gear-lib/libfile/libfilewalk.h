@@ -0,0 +1,114 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#ifndef LIBFILEWALK_H
+#define LIBFILEWALK_H
+
+#include "libfile.h"
+#include <sys/stat.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * parallel directory walker, linux only
+ *
+ * every directory is a libworkq task, entries are read with getdents64 and
+ * stat'ed relative to the directory fd, only when d_type is not enough.
+ */
+
+struct workq_pool;
+
+enum file_walk_action {
+    FILE_WALK_CONTINUE,
+    FILE_WALK_PRUNE,            /* don't descend into this directory */
+    FILE_WALK_STOP,             /* end the whole walk */
+};
+
+enum file_walk_flag {
+    FILE_WALK_STAT      = (1 << 0),     /* full stat of every entry for the callback */
+    FILE_WALK_SIZE      = (1 << 1),     /* size of regular files */
+    FILE_WALK_FOLLOW    = (1 << 2),     /* follow symlinks */
+    FILE_WALK_XDEV      = (1 << 3),     /* stay on the filesystem of the root */
+};
+
+struct file_walk_entry {
+    const char *path;
+    const char *name;
+    int dirfd;                  /* parent directory, for *at() calls */
+    int depth;                  /* entries of the root are 1 */
+    enum file_type type;
+    uint64_t size;              /* with FILE_WALK_SIZE or FILE_WALK_STAT */
+    const struct stat *st;      /* with FILE_WALK_STAT, else NULL */
+};
+
+/* with parallel walks it's called from several threads at once */
+typedef enum file_walk_action (*file_walk_cb)(const struct file_walk_entry *e, void *arg);
+
+struct file_walk_conf {
+    int flags;
+    int max_depth;              /* 0: unlimited */
+    int parallel;               /* 0: walk in the caller thread */
+    struct workq_pool *pool;    /* NULL: a pool per walk */
+    file_walk_cb cb;
+    void *arg;
+};
+
+struct file_walk_stat {
+    uint64_t dirs;
+    uint64_t files;             /* everything that is not a directory */
+    uint64_t bytes;             /* regular files, with FILE_WALK_SIZE */
+    uint64_t stat_calls;
+    uint64_t errors;
+    uint64_t loops;             /* FILE_WALK_FOLLOW links back to a directory above, skipped */
+};
+
+GEAR_API void file_walk_conf_init(struct file_walk_conf *conf);
+
+/*
+ * return 0 when done, 1 when stopped by the callback, -1 if path can't be
+ * opened. st is optional.
+ */
+GEAR_API int file_walk(const char *path, const struct file_walk_conf *conf,
+                struct file_walk_stat *st);
+
+/*
+ * per directory totals cache. a directory is rescanned alone (not its
+ * subtree) once invalidated, feed it the paths of libfilewatcher events:
+ *
+ *    void notify(struct fw *fw, enum fw_type type, char *path)
+ *    {
+ *        file_dir_cache_invalidate(cache, path);
+ *    }
+ */
+struct file_dir_cache;
+
+GEAR_API struct file_dir_cache *file_dir_cache_create(struct workq_pool *pool);
+GEAR_API void file_dir_cache_destroy(struct file_dir_cache *c);
+GEAR_API int file_dir_cache_size(struct file_dir_cache *c, const char *path,
+                uint64_t *size, uint64_t *files);
+GEAR_API void file_dir_cache_invalidate(struct file_dir_cache *c, const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
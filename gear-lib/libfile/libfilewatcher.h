@@ -22,8 +22,6 @@
 #ifndef LIBFILEWATCHER_H
 #define LIBFILEWATCHER_H
 
-#include <dirent.h>
-#include <libdict.h>
 #include <libgevent.h>
 
 #ifdef __cplusplus
@@ -42,10 +40,17 @@ enum fw_type {
     FW_MODIFY_FILE,
 };
 
+struct fw_tree;
+
 typedef struct fw {
     int fd;
+    int fan_fd;
     struct gevent_base *evbase;
-    dict *dict_path;
+    struct fw_tree *tree;       /* watched directories, by wd and by path */
+    int coalesce_ms;
+    struct gevent *timer;
+    struct gevent *ev;          /* inotify fd, added by fw_dispatch */
+    struct gevent *fan_ev;
     void (*notify_cb)(struct fw *fw, enum fw_type type, char *path);
 } fw_t;
 
@@ -54,6 +59,19 @@ GEAR_API struct fw *fw_init(void (notify_cb)(struct fw *fw, enum fw_type type, c
 GEAR_API void fw_deinit(struct fw *fw);
 GEAR_API int fw_add_watch_recursive(struct fw *fw, const char *path);
 GEAR_API int fw_del_watch_recursive(struct fw *fw, const char *path);
+
+/*
+ * FW_MODIFY_FILE of the same path within msec is reported once, at the end
+ * of the window, any other event of that path flushes it first. 0 disables.
+ * call it before fw_dispatch or from notify_cb.
+ */
+GEAR_API int fw_set_coalesce(struct fw *fw, int msec);
+
+/*
+ * fanotify filesystem mark, events under path without a watch per
+ * directory. needs CAP_SYS_ADMIN and linux 5.9+
+ */
+GEAR_API int fw_add_watch_mount(struct fw *fw, const char *path);
 GEAR_API int fw_dispatch(struct fw *fw);
 
 
@@ -22,6 +22,17 @@
 #include "libfile.h"
 #ifdef ENABLE_FILEWATCHER
 #include "libfilewatcher.h"
+#include <pthread.h>
+#include <unistd.h>
+#include <limits.h>
+#endif
+#ifdef ENABLE_FILE_AIO
+#include "libfileaio.h"
+#include <time.h>
+#endif
+#ifdef ENABLE_FILE_WALK
+#include "libfilewalk.h"
+#include <unistd.h>
 #endif
 #include <stdio.h>
 #include <stdlib.h>
@@ -31,6 +42,7 @@
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
 #include <signal.h>
+#include <sys/time.h>
 
 static void foo(void)
 {
@@ -115,6 +127,337 @@ static void foo5(void)
     printf("info->time_access = %" PRIu64 "\n", info.access_sec);
 }
 
+#define MAP_TEST_FILE   "map.bin"
+#define MAP_TEST_SIZE   (64 * 1024 * 1024 + 123)
+
+static uint64_t map_now_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void foo_map(void)
+{
+    struct iovec *dump, *mdump;
+    struct file_map *map;
+    struct file_reader *r;
+    const void *data;
+    uint64_t t0, t1, t2, total = 0;
+    uint32_t sum = 0, sum2 = 0;
+    char *buf;
+    size_t i;
+    ssize_t n;
+
+    buf = malloc(MAP_TEST_SIZE);
+    if (!buf) {
+        return;
+    }
+    for (i = 0; i < MAP_TEST_SIZE; i++) {
+        buf[i] = (char)(i * 31 + (i >> 12));
+    }
+    file_write_path(MAP_TEST_FILE, buf, MAP_TEST_SIZE);
+
+    t0 = map_now_us();
+    dump = file_dump(MAP_TEST_FILE);
+    t1 = map_now_us();
+    mdump = file_dump_map(MAP_TEST_FILE);
+    t2 = map_now_us();
+    if (!dump || !mdump || dump->iov_len != MAP_TEST_SIZE ||
+        mdump->iov_len != MAP_TEST_SIZE ||
+        memcmp(dump->iov_base, mdump->iov_base, MAP_TEST_SIZE)) {
+        printf("file_dump_map mismatch\n");
+    }
+    printf("file_dump %" PRIu64 " us, file_dump_map %" PRIu64 " us\n", t1 - t0, t2 - t1);
+    iovec_destroy(dump);
+    file_dump_unmap(mdump);
+
+    map = file_map(MAP_TEST_FILE, 5000, 100000, FILE_MAP_RANDOM | FILE_MAP_WILLNEED);
+    if (map) {
+        if (map->len != 100000 || memcmp(map->base, buf + 5000, map->len)) {
+            printf("file_map mismatch\n");
+        }
+        file_map_advise(map, 0, 0, FILE_MAP_SEQUENTIAL);
+        file_unmap(map);
+    }
+
+    r = file_reader_open(MAP_TEST_FILE, 1024 * 1024);
+    file_reader_seek(r, 77);
+    while ((n = file_reader_next(r, &data)) > 0) {
+        for (i = 0; i < (size_t)n; i++) {
+            sum += ((const uint8_t *)data)[i];
+        }
+        total += n;
+    }
+    file_reader_close(r);
+    for (i = 77; i < MAP_TEST_SIZE; i++) {
+        sum2 += (uint8_t)buf[i];
+    }
+    printf("file_reader %" PRIu64 " bytes, %s\n", total,
+           (sum == sum2 && total == MAP_TEST_SIZE - 77) ? "ok" : "mismatch");
+    free(buf);
+    file_delete(MAP_TEST_FILE);
+}
+
+#ifdef ENABLE_FILE_AIO
+#define AIO_TEST_FILE   "aio.bin"
+#define AIO_TEST_SIZE   (32 * 1024 * 1024)
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint8_t aio_pattern(uint64_t off)
+{
+    return (uint8_t)(off * 2654435761ULL >> 13);
+}
+
+/*
+ * write AIO_TEST_SIZE in odd sized pieces like a muxer does, then read back
+ */
+static int aio_write_verify(const char *name, struct file *f)
+{
+    static uint8_t buf[64 * 1024];
+    struct file_aio_stat st;
+    uint64_t off = 0, start, us, max_us = 0;
+    size_t len, i;
+    ssize_t n;
+    int ret = 0;
+
+    start = now_ns();
+    while (off < AIO_TEST_SIZE) {
+        len = 188 + (off * 7) % (sizeof(buf) - 188);
+        if (len > AIO_TEST_SIZE - off) {
+            len = AIO_TEST_SIZE - off;
+        }
+        for (i = 0; i < len; i++) {
+            buf[i] = aio_pattern(off + i);
+        }
+        us = now_ns();
+        if (file_write(f, buf, len) != (ssize_t)len) {
+            printf("%s: write failed at %" PRIu64 "\n", name, off);
+            return -1;
+        }
+        us = (now_ns() - us) / 1000;
+        if (us > max_us) {
+            max_us = us;
+        }
+        off += len;
+    }
+    file_sync(f);
+    us = (now_ns() - start) / 1000;
+    memset(&st, 0, sizeof(st));
+    file_aio_get_stat(f, &st);
+    printf("%-16s engine=%d direct=%d %" PRIu64 " MB/s, max write %" PRIu64 " us, "
+           "chunks %" PRIu64 "/%" PRIu64 ", stalls %" PRIu64 " (%" PRIu64 " us)\n",
+           name, st.engine, st.direct, (uint64_t)AIO_TEST_SIZE / (us ? us : 1),
+           max_us, st.completed, st.submitted, st.stalls, st.stall_ns / 1000);
+
+    file_seek(f, 0, SEEK_SET);
+    off = 0;
+    while (off < AIO_TEST_SIZE) {
+        n = file_read(f, buf, sizeof(buf));
+        if (n <= 0) {
+            break;
+        }
+        for (i = 0; i < (size_t)n; i++) {
+            if (buf[i] != aio_pattern(off + i)) {
+                printf("%s: mismatch at %" PRIu64 "\n", name, off + i);
+                return -1;
+            }
+        }
+        off += n;
+    }
+    if (off != AIO_TEST_SIZE || file_size(f) != AIO_TEST_SIZE) {
+        printf("%s: read back %" PRIu64 " size %zd\n", name, off, file_size(f));
+        ret = -1;
+    }
+    return ret;
+}
+
+static void foo_aio(void)
+{
+    static const char *names[] = {"uring", "workq", "uring direct", "workq direct"};
+    struct file_aio_conf conf;
+    struct file *f;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        file_aio_conf_init(&conf);
+        conf.engine = (i % 2) ? FILE_AIO_WORKQ : FILE_AIO_URING;
+        conf.direct = i >= 2;
+        conf.chunk_size = 1024 * 1024;
+        conf.prealloc_size = 8 * 1024 * 1024;
+        conf.sync_size = 4 * 1024 * 1024;
+        f = file_open_aio(AIO_TEST_FILE, F_CREATE, &conf);
+        if (!f) {
+            printf("file_open_aio failed\n");
+            continue;
+        }
+        if (aio_write_verify(names[i], f)) {
+            printf("%s: verify failed\n", names[i]);
+        }
+        file_close(f);
+        if (file_get_size(AIO_TEST_FILE) != AIO_TEST_SIZE) {
+            printf("%s: size after close %zd\n", names[i], file_get_size(AIO_TEST_FILE));
+        }
+    }
+
+    file_backend(FILE_BACKEND_IO);
+    f = file_open(AIO_TEST_FILE, F_CREATE);
+    if (f) {
+        aio_write_verify("sync io", f);
+        file_close(f);
+    }
+    file_delete(AIO_TEST_FILE);
+}
+#endif
+
+#ifdef ENABLE_FILE_WALK
+#define WALK_TEST_DIR   "walk_t"
+
+static void walk_put(const char *path, size_t len)
+{
+    FILE *fp = fopen(path, "w");
+    static const char pad[256];
+    if (!fp) {
+        return;
+    }
+    while (len > 0) {
+        len -= fwrite(pad, 1, len > sizeof(pad) ? sizeof(pad) : len, fp);
+    }
+    fclose(fp);
+}
+
+static enum file_walk_action walk_prune(const struct file_walk_entry *e, void *arg)
+{
+    if (e->type == F_DIR && !strcmp(e->name, "d3")) {
+        return FILE_WALK_PRUNE;
+    }
+    return FILE_WALK_CONTINUE;
+}
+
+static enum file_walk_action walk_stop(const struct file_walk_entry *e, void *arg)
+{
+    int *left = (int *)arg;
+    return __sync_sub_and_fetch(left, 1) > 0 ? FILE_WALK_CONTINUE : FILE_WALK_STOP;
+}
+
+static enum file_walk_action walk_slash(const struct file_walk_entry *e, void *arg)
+{
+    int *bad = (int *)arg;
+    if (!strncmp(e->path, "//", 2)) {
+        __sync_add_and_fetch(bad, 1);
+    }
+    return FILE_WALK_CONTINUE;
+}
+
+static void foo_walk()
+{
+    struct file_walk_conf conf;
+    struct file_walk_stat st;
+    struct file_dir_cache *cache;
+    char path[256];
+    uint64_t expect = 0, size = 0, files = 0;
+    int i, j, k, left = 10, ret;
+
+    mkdir(WALK_TEST_DIR, 0755);
+    for (i = 0; i < 8; i++) {
+        snprintf(path, sizeof(path), WALK_TEST_DIR "/d%d", i);
+        mkdir(path, 0755);
+        for (j = 0; j < 8; j++) {
+            snprintf(path, sizeof(path), WALK_TEST_DIR "/d%d/e%d", i, j);
+            mkdir(path, 0755);
+            for (k = 0; k < 4; k++) {
+                snprintf(path, sizeof(path), WALK_TEST_DIR "/d%d/e%d/f%d", i, j, k);
+                walk_put(path, i * 1000 + j * 10 + k);
+                expect += i * 1000 + j * 10 + k;
+            }
+        }
+    }
+    file_dir_size(WALK_TEST_DIR, &size);
+    printf("file_dir_size %" PRIu64 " expect %" PRIu64 "\n", size, expect);
+
+    file_walk_conf_init(&conf);
+    conf.flags = FILE_WALK_SIZE;
+    file_walk(WALK_TEST_DIR, &conf, &st);
+    printf("file_walk parallel: dirs=%" PRIu64 " files=%" PRIu64 " bytes=%" PRIu64
+           " stat_calls=%" PRIu64 " %s\n", st.dirs, st.files, st.bytes, st.stat_calls,
+           st.bytes == expect ? "ok" : "mismatch");
+    conf.parallel = 0;
+    file_walk(WALK_TEST_DIR, &conf, &st);
+    printf("file_walk inline: bytes=%" PRIu64 " %s\n", st.bytes,
+           st.bytes == expect ? "ok" : "mismatch");
+
+    conf.cb = walk_prune;
+    file_walk(WALK_TEST_DIR, &conf, &st);
+    printf("file_walk prune d3: dirs=%" PRIu64 " files=%" PRIu64 "\n", st.dirs, st.files);
+
+    conf.cb = walk_stop;
+    conf.arg = &left;
+    ret = file_walk(WALK_TEST_DIR, &conf, &st);
+    printf("file_walk stop: ret=%d files=%" PRIu64 "\n", ret, st.files);
+
+    /* links back up are skipped, not walked again */
+    if (symlink(".", WALK_TEST_DIR "/d0/self") || symlink("..", WALK_TEST_DIR "/d1/e1/up")) {
+        printf("symlink failed %d:%s\n", errno, strerror(errno));
+    }
+    conf.cb = NULL;
+    conf.flags = FILE_WALK_SIZE | FILE_WALK_FOLLOW;
+    for (i = 0; i < 2; i++) {
+        conf.parallel = !i;
+        file_walk(WALK_TEST_DIR, &conf, &st);
+        printf("file_walk follow %s: dirs=%" PRIu64 " loops=%" PRIu64 " bytes=%" PRIu64 " %s\n",
+               conf.parallel ? "parallel" : "inline", st.dirs, st.loops, st.bytes,
+               (st.loops == 2 && st.dirs == 74 && st.bytes == expect) ? "ok" : "mismatch");
+    }
+    unlink(WALK_TEST_DIR "/d0/self");
+    unlink(WALK_TEST_DIR "/d1/e1/up");
+    conf.flags = FILE_WALK_SIZE;
+
+    /* entries under the root are "/name", not "//name" */
+    left = 0;
+    conf.cb = walk_slash;
+    conf.arg = &left;
+    conf.max_depth = 1;
+    file_walk("/", &conf, &st);
+    printf("file_walk /: entries=%" PRIu64 " %s\n", st.dirs + st.files,
+           left == 0 ? "ok" : "double slash");
+    conf.max_depth = 0;
+
+    cache = file_dir_cache_create(NULL);
+    file_dir_cache_size(cache, WALK_TEST_DIR, &size, &files);
+    printf("file_dir_cache %" PRIu64 " bytes %" PRIu64 " files %s\n", size, files,
+           size == expect ? "ok" : "mismatch");
+    walk_put(WALK_TEST_DIR "/d5/e5/new", 4096);
+    file_dir_cache_invalidate(cache, WALK_TEST_DIR "/d5/e5/new");
+    file_dir_cache_size(cache, WALK_TEST_DIR "/", &size, &files);
+    printf("file_dir_cache after add %" PRIu64 " bytes %" PRIu64 " files %s\n", size, files,
+           size == expect + 4096 ? "ok" : "mismatch");
+    file_dir_cache_destroy(cache);
+
+    for (i = 0; i < 8; i++) {
+        for (j = 0; j < 8; j++) {
+            for (k = 0; k < 4; k++) {
+                snprintf(path, sizeof(path), WALK_TEST_DIR "/d%d/e%d/f%d", i, j, k);
+                file_delete(path);
+            }
+            snprintf(path, sizeof(path), WALK_TEST_DIR "/d%d/e%d", i, j);
+            if (i == 5 && j == 5) {
+                file_delete(WALK_TEST_DIR "/d5/e5/new");
+            }
+            rmdir(path);
+        }
+        snprintf(path, sizeof(path), WALK_TEST_DIR "/d%d", i);
+        rmdir(path);
+    }
+    rmdir(WALK_TEST_DIR);
+}
+#endif
+
 #ifdef ENABLE_FILEWATCHER
 #define ROOT_DIR		"./"
 static struct fw *_fw = NULL;
@@ -163,10 +506,318 @@ int file_watcher_foo()
         printf("fw_init failed!\n");
         return -1;
     }
+    fw_set_coalesce(_fw, 100);
     fw_add_watch_recursive(_fw, ROOT_DIR);
     fw_dispatch(_fw);
     return 0;
 }
+
+#define FW_MAX_EVENTS   256
+#define FW_COALESCE_MS  500
+
+static struct {
+    pthread_mutex_t lock;
+    int num;
+    enum fw_type type[FW_MAX_EVENTS];
+    char path[FW_MAX_EVENTS][PATH_MAX];
+} fw_log = {PTHREAD_MUTEX_INITIALIZER};
+
+static void fw_record(struct fw *fw, enum fw_type type, char *path)
+{
+    pthread_mutex_lock(&fw_log.lock);
+    if (fw_log.num < FW_MAX_EVENTS) {
+        fw_log.type[fw_log.num] = type;
+        snprintf(fw_log.path[fw_log.num], PATH_MAX, "%s", path);
+        fw_log.num++;
+    }
+    pthread_mutex_unlock(&fw_log.lock);
+}
+
+static void *fw_loop(void *arg)
+{
+    fw_dispatch((struct fw *)arg);
+    return NULL;
+}
+
+/* events of type for dir/name so far, -1 for any type */
+static int fw_count(int type, const char *dir, const char *name)
+{
+    char path[PATH_MAX];
+    int i, n = 0;
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    pthread_mutex_lock(&fw_log.lock);
+    for (i = 0; i < fw_log.num; i++) {
+        if ((type == -1 || (int)fw_log.type[i] == type) && !strcmp(fw_log.path[i], path)) {
+            n++;
+        }
+    }
+    pthread_mutex_unlock(&fw_log.lock);
+    return n;
+}
+
+/* index of the first such event, -1 if none */
+static int fw_index(enum fw_type type, const char *dir, const char *name)
+{
+    char path[PATH_MAX];
+    int i;
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    pthread_mutex_lock(&fw_log.lock);
+    for (i = 0; i < fw_log.num; i++) {
+        if (fw_log.type[i] == type && !strcmp(fw_log.path[i], path)) {
+            break;
+        }
+    }
+    i = i < fw_log.num ? i : -1;
+    pthread_mutex_unlock(&fw_log.lock);
+    return i;
+}
+
+/* wait up to msec for the event, a new directory is watched once its event is seen */
+static int fw_wait(enum fw_type type, const char *dir, const char *name, int msec)
+{
+    for (; msec > 0; msec -= 10) {
+        if (fw_count(type, dir, name)) {
+            return 0;
+        }
+        usleep(10 * 1000);
+    }
+    printf("%s: no event %d for %s/%s\n", __func__, type, dir, name);
+    return -1;
+}
+
+/* an empty new file: only a create event */
+static void fw_touch(const char *dir, const char *name)
+{
+    char path[PATH_MAX];
+    FILE *fp;
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    fp = fopen(path, "w");
+    if (fp) {
+        fclose(fp);
+    }
+}
+
+static void fw_put(const char *dir, const char *name, const char *data)
+{
+    char path[PATH_MAX];
+    FILE *fp;
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    fp = fopen(path, "a");
+    if (fp) {
+        fputs(data, fp);
+        fclose(fp);
+    }
+}
+
+static void fw_mkdir(const char *dir, const char *name)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    mkdir(path, 0755);
+}
+
+static void fw_unlink(const char *dir, const char *name)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    if (unlink(path) < 0) {
+        rmdir(path);
+    }
+}
+
+static void fw_rename(const char *dir, const char *from, const char *to)
+{
+    char src[PATH_MAX], dst[PATH_MAX];
+    snprintf(src, sizeof(src), "%s/%s", dir, from);
+    snprintf(dst, sizeof(dst), "%s/%s", dir, to);
+    rename(src, dst);
+}
+
+#define FW_CHECK(cond)                                                      \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            printf("%s:%d check failed: %s\n", __func__, __LINE__, #cond);  \
+            ret = -1;                                                       \
+            goto out;                                                       \
+        }                                                                   \
+    } while (0)
+
+/* set up watches before, the tree is not locked against the loop thread */
+static int fw_start(struct fw *fw, pthread_t *tid)
+{
+    pthread_mutex_lock(&fw_log.lock);
+    fw_log.num = 0;
+    pthread_mutex_unlock(&fw_log.lock);
+    if (pthread_create(tid, NULL, fw_loop, fw)) {
+        printf("pthread_create failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+static void fw_stop(struct fw *fw, pthread_t tid)
+{
+    gevent_base_loop_break(fw->evbase);
+    pthread_join(tid, NULL);
+    fw_deinit(fw);
+}
+
+/*
+ * inotify tree in a temp dir: events of nested directories created after the
+ * watch, modify coalescing, paths of directories created after a subtree was
+ * deleted or renamed (their wds are reused)
+ */
+static int foo_fw_inotify(const char *d)
+{
+    struct fw *fw;
+    pthread_t tid;
+    int i, ret = 0;
+
+    fw = fw_init(fw_record);
+    if (!fw || fw_set_coalesce(fw, FW_COALESCE_MS) ||
+        fw_add_watch_recursive(fw, d) || fw_start(fw, &tid)) {
+        printf("%s: watch %s failed\n", __func__, d);
+        fw_deinit(fw);
+        return -1;
+    }
+
+    fw_mkdir(d, "a");
+    FW_CHECK(0 == fw_wait(FW_CREATE_DIR, d, "a", 1000));
+    fw_mkdir(d, "a/b");
+    FW_CHECK(0 == fw_wait(FW_CREATE_DIR, d, "a/b", 1000));
+    fw_mkdir(d, "a/b/c");
+    FW_CHECK(0 == fw_wait(FW_CREATE_DIR, d, "a/b/c", 1000));
+    fw_touch(d, "a/b/c/f");
+    FW_CHECK(0 == fw_wait(FW_CREATE_FILE, d, "a/b/c/f", 1000));
+
+    /* modifies read one by one still come out once, after the window */
+    for (i = 0; i < 5; i++) {
+        fw_put(d, "a/b/c/f", "x");
+        usleep(20 * 1000);
+    }
+    FW_CHECK(0 == fw_count(FW_MODIFY_FILE, d, "a/b/c/f"));
+    FW_CHECK(0 == fw_wait(FW_MODIFY_FILE, d, "a/b/c/f", 2 * FW_COALESCE_MS));
+    usleep(2 * FW_COALESCE_MS * 1000);
+    FW_CHECK(1 == fw_count(FW_MODIFY_FILE, d, "a/b/c/f"));
+
+    /* a held modify goes out before the delete of the same path */
+    fw_put(d, "a/b/c/f", "x");
+    usleep(20 * 1000);
+    fw_unlink(d, "a/b/c/f");
+    FW_CHECK(0 == fw_wait(FW_DELETE_FILE, d, "a/b/c/f", 1000));
+    FW_CHECK(2 == fw_count(FW_MODIFY_FILE, d, "a/b/c/f"));
+    FW_CHECK(fw_index(FW_MODIFY_FILE, d, "a/b/c/f") <
+             fw_index(FW_DELETE_FILE, d, "a/b/c/f"));
+
+    /* delete the subtree, new directories may get the freed wds */
+    fw_unlink(d, "a/b/c");
+    FW_CHECK(0 == fw_wait(FW_DELETE_DIR, d, "a/b/c", 1000));
+    fw_unlink(d, "a/b");
+    FW_CHECK(0 == fw_wait(FW_DELETE_DIR, d, "a/b", 1000));
+    fw_mkdir(d, "a/x");
+    FW_CHECK(0 == fw_wait(FW_CREATE_DIR, d, "a/x", 1000));
+    fw_mkdir(d, "a/x/y");
+    FW_CHECK(0 == fw_wait(FW_CREATE_DIR, d, "a/x/y", 1000));
+    fw_touch(d, "a/x/y/g");
+    FW_CHECK(0 == fw_wait(FW_CREATE_FILE, d, "a/x/y/g", 1000));
+
+    /* rename the subtree, events below it use the new name */
+    fw_rename(d, "a", "r");
+    FW_CHECK(0 == fw_wait(FW_MOVE_TO_DIR, d, "r", 1000));
+    FW_CHECK(1 == fw_count(FW_MOVE_FROM_DIR, d, "a"));
+    fw_touch(d, "r/x/y/h");
+    FW_CHECK(0 == fw_wait(FW_CREATE_FILE, d, "r/x/y/h", 1000));
+    fw_unlink(d, "r/x/y/g");
+    FW_CHECK(0 == fw_wait(FW_DELETE_FILE, d, "r/x/y/g", 1000));
+
+    /* a dropped subtree reports nothing */
+    FW_CHECK(0 == fw_del_watch_recursive(fw, d));
+    fw_touch(d, "r/x/y/i");
+    usleep(200 * 1000);
+    FW_CHECK(0 == fw_count(-1, d, "r/x/y/i"));
+
+    /* every event is accounted for, nothing under the old names */
+    FW_CHECK(1 == fw_count(-1, d, "a/x/y/g"));
+    FW_CHECK(0 == fw_count(-1, d, "a/x/y/h"));
+    FW_CHECK(1 == fw_count(-1, d, "r/x/y/h"));
+    FW_CHECK(1 == fw_count(-1, d, "r/x/y/g"));
+    pthread_mutex_lock(&fw_log.lock);
+    i = fw_log.num;
+    pthread_mutex_unlock(&fw_log.lock);
+    FW_CHECK(i == 16);
+out:
+    fw_stop(fw, tid);
+    fw_unlink(d, "r/x/y/h");
+    fw_unlink(d, "r/x/y/i");
+    fw_unlink(d, "r/x/y");
+    fw_unlink(d, "r/x");
+    fw_unlink(d, "r");
+    return ret;
+}
+
+/* fanotify filesystem mark: one mark reports the whole tree */
+static int foo_fw_mount(const char *d)
+{
+    struct fw *fw;
+    pthread_t tid;
+    int ret = 0;
+
+    fw = fw_init(fw_record);
+    if (!fw) {
+        return -1;
+    }
+    if (fw_add_watch_mount(fw, d)) {
+        printf("%s: fanotify not available, skipped\n", __func__);
+        fw_deinit(fw);
+        return 0;
+    }
+    if (fw_start(fw, &tid)) {
+        fw_deinit(fw);
+        return -1;
+    }
+    fw_mkdir(d, "m");
+    FW_CHECK(0 == fw_wait(FW_CREATE_DIR, d, "m", 1000));
+    /* no watch to wait for, files in a new directory are seen right away */
+    fw_mkdir(d, "m/n");
+    fw_touch(d, "m/n/f");
+    FW_CHECK(0 == fw_wait(FW_CREATE_FILE, d, "m/n/f", 1000));
+    FW_CHECK(1 == fw_count(FW_CREATE_DIR, d, "m/n"));
+    fw_put(d, "m/n/f", "x");
+    FW_CHECK(0 == fw_wait(FW_MODIFY_FILE, d, "m/n/f", 1000));
+    fw_rename(d, "m/n/f", "m/n/g");
+    FW_CHECK(0 == fw_wait(FW_MOVE_TO_FILE, d, "m/n/g", 1000));
+    FW_CHECK(1 == fw_count(FW_MOVE_FROM_FILE, d, "m/n/f"));
+    fw_unlink(d, "m/n/g");
+    FW_CHECK(0 == fw_wait(FW_DELETE_FILE, d, "m/n/g", 1000));
+    fw_unlink(d, "m/n");
+    FW_CHECK(0 == fw_wait(FW_DELETE_DIR, d, "m/n", 1000));
+out:
+    fw_stop(fw, tid);
+    fw_unlink(d, "m/n/f");
+    fw_unlink(d, "m/n/g");
+    fw_unlink(d, "m/n");
+    fw_unlink(d, "m");
+    return ret;
+}
+
+static int foo_fw()
+{
+    char tmpl[] = "/tmp/fw_testXXXXXX";
+    char dir[PATH_MAX];
+    int ret;
+
+    if (!mkdtemp(tmpl) || !realpath(tmpl, dir)) {
+        printf("mkdtemp failed(%d): %s\n", errno, strerror(errno));
+        return -1;
+    }
+    ret = foo_fw_inotify(dir);
+    if (ret == 0) {
+        ret = foo_fw_mount(dir);
+    }
+    rmdir(dir);
+    printf("%s: %s\n", __func__, ret ? "failed" : "pass");
+    return ret;
+}
 #endif
 
 static void sigint_handler(int sig)
@@ -197,8 +848,21 @@ int main(int argc, char **argv)
     if (0 != file_create("jjj.c")) {
         printf("file_create failed!\n");
     }
+    foo_map();
+#ifdef ENABLE_FILE_AIO
+    foo_aio();
+#endif
+#ifdef ENABLE_FILE_WALK
+    foo_walk();
+#endif
 #ifdef ENABLE_FILEWATCHER
-    file_watcher_foo();
+    if (foo_fw()) {
+        return -1;
+    }
+    /* test_libfile watch: print events of the current directory */
+    if (argc > 1 && !strcmp(argv[1], "watch")) {
+        file_watcher_foo();
+    }
 #endif
     return 0;
 }
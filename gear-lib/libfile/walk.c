@@ -0,0 +1,846 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#define _GNU_SOURCE
+#include "libfile.h"
+#include "libfilewalk.h"
+#include <libworkq.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/syscall.h>
+
+#define WALK_DENTS_BUF      (32 * 1024)
+
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+struct walk_ctx;
+
+/* what a scanned directory holds itself, used by the dir cache */
+struct walk_dir_result {
+    int err;
+    uint64_t bytes;
+    uint64_t files;
+    char **subdirs;
+    int nsubdir;
+};
+
+typedef void (*walk_dir_hook)(struct walk_ctx *w, const char *path,
+                struct walk_dir_result *res);
+
+struct walk_dir {
+    struct walk_ctx *w;
+    struct walk_dir *next;      /* stack of the serial walk */
+    struct walk_dir *parent;    /* held while a child is queued, FILE_WALK_FOLLOW only */
+    int ref;
+    int depth;
+    dev_t dev;
+    ino_t ino;
+    char path[];
+};
+
+struct walk_ctx {
+    struct file_walk_conf conf;
+    struct workq_pool *pool;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int pending;
+    int stop;                   /* atomic, workq threads read and set it */
+    int root_failed;            /* atomic */
+    dev_t dev;
+    struct walk_dir *stack;
+    struct file_walk_stat stat;
+    walk_dir_hook hook;
+    void *hook_arg;
+};
+
+static enum file_type walk_dtype(unsigned char d_type)
+{
+    switch (d_type) {
+    case DT_DIR:
+        return F_DIR;
+    case DT_LNK:
+        return F_LINK;
+    case DT_SOCK:
+        return F_SOCKET;
+    case DT_BLK:
+    case DT_CHR:
+        return F_DEVICE;
+    default:
+        return F_NORMAL;
+    }
+}
+
+static enum file_type walk_mode(mode_t mode)
+{
+    switch (mode & S_IFMT) {
+    case S_IFDIR:
+        return F_DIR;
+    case S_IFLNK:
+        return F_LINK;
+    case S_IFSOCK:
+        return F_SOCKET;
+    case S_IFBLK:
+    case S_IFCHR:
+        return F_DEVICE;
+    default:
+        return F_NORMAL;
+    }
+}
+
+static void walk_push(struct walk_ctx *w, struct walk_dir *parent, const char *path,
+                size_t len, int depth, dev_t dev, ino_t ino);
+
+static int walk_stopped(struct walk_ctx *w)
+{
+    return __atomic_load_n(&w->stop, __ATOMIC_RELAXED);
+}
+
+static void walk_set_stop(struct walk_ctx *w)
+{
+    __atomic_store_n(&w->stop, 1, __ATOMIC_RELAXED);
+}
+
+/* a followed link back to a directory we are inside of, as fts FTS_DC */
+static int walk_is_loop(struct walk_dir *d, dev_t dev, ino_t ino)
+{
+    for (; d; d = d->parent) {
+        if (d->dev == dev && d->ino == ino) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void walk_dir_put(struct walk_dir *d)
+{
+    struct walk_dir *parent;
+    while (d && __atomic_sub_fetch(&d->ref, 1, __ATOMIC_ACQ_REL) == 0) {
+        parent = d->parent;
+        free(d);
+        d = parent;
+    }
+}
+
+static int walk_add_subdir(struct walk_dir_result *res, const char *name)
+{
+    char **p;
+    if ((res->nsubdir & (res->nsubdir - 1)) == 0) {
+        p = (char **)realloc(res->subdirs, (res->nsubdir ? res->nsubdir * 2 : 4) * sizeof(char *));
+        if (!p) {
+            return -1;
+        }
+        res->subdirs = p;
+    }
+    res->subdirs[res->nsubdir] = strdup(name);
+    if (!res->subdirs[res->nsubdir]) {
+        return -1;
+    }
+    res->nsubdir++;
+    return 0;
+}
+
+/*
+ * stat relative to the directory fd, statx can skip the fields we don't
+ * need which is cheaper on network filesystems
+ */
+static int walk_stat(struct walk_ctx *w, int dirfd, const char *name,
+                struct stat *st, enum file_type *type, uint64_t *size, dev_t *dev,
+                ino_t *ino)
+{
+    int flags = (w->conf.flags & FILE_WALK_FOLLOW) ? 0 : AT_SYMLINK_NOFOLLOW;
+#if defined (STATX_TYPE)
+    struct statx stx;
+    if (!(w->conf.flags & FILE_WALK_STAT)) {
+        if (statx(dirfd, name, flags | AT_STATX_DONT_SYNC,
+                  STATX_TYPE | STATX_SIZE | STATX_INO, &stx) < 0) {
+            return -1;
+        }
+        *type = walk_mode(stx.stx_mode);
+        *size = stx.stx_size;
+        *dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+        *ino = stx.stx_ino;
+        return 0;
+    }
+#endif
+    if (fstatat(dirfd, name, st, flags) < 0) {
+        return -1;
+    }
+    *type = walk_mode(st->st_mode);
+    *size = st->st_size;
+    *dev = st->st_dev;
+    *ino = st->st_ino;
+    return 0;
+}
+
+static void walk_scan(struct walk_ctx *w, struct walk_dir *d)
+{
+    char buf[WALK_DENTS_BUF];
+    char path[PATH_MAX];
+    struct walk_dir_result res;
+    struct file_walk_stat stat;
+    struct file_walk_entry e;
+    struct linux_dirent64 *de;
+    struct stat st;
+    enum file_walk_action act;
+    size_t plen = strlen(d->path);
+    size_t nlen;
+    uint64_t size;
+    dev_t dev;
+    ino_t ino;
+    int follow = w->conf.flags & FILE_WALK_FOLLOW;
+    int need_stat;
+    int fd, n, pos;
+
+    memset(&res, 0, sizeof(res));
+    memset(&stat, 0, sizeof(stat));
+    fd = open(d->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
+        if (d->depth == 0) {
+            printf("can not open path: %s %d:%s\n", d->path, errno, strerror(errno));
+            __atomic_store_n(&w->root_failed, 1, __ATOMIC_RELAXED);
+        }
+        stat.errors++;
+        res.err = errno;
+        goto out;
+    }
+    memcpy(path, d->path, plen);
+    /* "/" is the only root that keeps its trailing slash */
+    if (plen == 0 || path[plen - 1] != '/') {
+        path[plen++] = '/';
+    }
+    while (!walk_stopped(w)) {
+        n = syscall(SYS_getdents64, fd, buf, sizeof(buf));
+        if (n <= 0) {
+            if (n < 0) {
+                stat.errors++;
+                res.err = errno;
+            }
+            break;
+        }
+        for (pos = 0; pos < n && !walk_stopped(w); pos += de->d_reclen) {
+            de = (struct linux_dirent64 *)(buf + pos);
+            if (de->d_name[0] == '.' && (de->d_name[1] == '\0' ||
+                (de->d_name[1] == '.' && de->d_name[2] == '\0'))) {
+                continue;
+            }
+            nlen = strlen(de->d_name);
+            if (plen + nlen >= sizeof(path)) {
+                stat.errors++;
+                continue;
+            }
+            memcpy(path + plen, de->d_name, nlen + 1);
+
+            e.type = walk_dtype(de->d_type);
+            size = 0;
+            dev = w->dev;
+            ino = 0;
+            need_stat = (w->conf.flags & FILE_WALK_STAT) ||
+                        de->d_type == DT_UNKNOWN ||
+                        (de->d_type == DT_REG && (w->conf.flags & FILE_WALK_SIZE)) ||
+                        (de->d_type == DT_LNK && follow) ||
+                        (de->d_type == DT_DIR && (follow || (w->conf.flags & FILE_WALK_XDEV)));
+            if (need_stat) {
+                stat.stat_calls++;
+                if (walk_stat(w, fd, de->d_name, &st, &e.type, &size, &dev, &ino) < 0) {
+                    /* gone meanwhile */
+                    stat.errors++;
+                    continue;
+                }
+            }
+            e.path = path;
+            e.name = path + plen;
+            e.dirfd = fd;
+            e.depth = d->depth + 1;
+            e.size = size;
+            e.st = (w->conf.flags & FILE_WALK_STAT) ? &st : NULL;
+            act = w->conf.cb ? w->conf.cb(&e, w->conf.arg) : FILE_WALK_CONTINUE;
+            if (act == FILE_WALK_STOP) {
+                walk_set_stop(w);
+                break;
+            }
+            if (e.type != F_DIR) {
+                stat.files++;
+                res.files++;
+                if (e.type == F_NORMAL) {
+                    stat.bytes += size;
+                    res.bytes += size;
+                }
+                continue;
+            }
+            stat.dirs++;
+            if (act == FILE_WALK_PRUNE) {
+                continue;
+            }
+            if ((w->conf.flags & FILE_WALK_XDEV) && dev != w->dev) {
+                continue;
+            }
+            if (follow && walk_is_loop(d, dev, ino)) {
+                stat.loops++;
+                continue;
+            }
+            if (w->hook) {
+                walk_add_subdir(&res, e.name);
+            }
+            if (w->conf.max_depth == 0 || e.depth < w->conf.max_depth) {
+                walk_push(w, follow ? d : NULL, path, plen + nlen, e.depth, dev, ino);
+            }
+        }
+    }
+    close(fd);
+
+out:
+    if (w->hook && !walk_stopped(w)) {
+        w->hook(w, d->path, &res);
+    }
+    while (res.nsubdir > 0) {
+        free(res.subdirs[--res.nsubdir]);
+    }
+    free(res.subdirs);
+    pthread_mutex_lock(&w->lock);
+    w->stat.dirs += stat.dirs;
+    w->stat.files += stat.files;
+    w->stat.bytes += stat.bytes;
+    w->stat.stat_calls += stat.stat_calls;
+    w->stat.errors += stat.errors;
+    w->stat.loops += stat.loops;
+    pthread_mutex_unlock(&w->lock);
+}
+
+static void walk_task(void *arg)
+{
+    struct walk_dir *d = (struct walk_dir *)arg;
+    struct walk_ctx *w = d->w;
+
+    if (!walk_stopped(w)) {
+        walk_scan(w, d);
+    }
+    walk_dir_put(d);
+    pthread_mutex_lock(&w->lock);
+    if (--w->pending == 0) {
+        pthread_cond_signal(&w->cond);
+    }
+    pthread_mutex_unlock(&w->lock);
+}
+
+static void walk_push(struct walk_ctx *w, struct walk_dir *parent, const char *path,
+                size_t len, int depth, dev_t dev, ino_t ino)
+{
+    struct walk_dir *d = (struct walk_dir *)malloc(sizeof(struct walk_dir) + len + 1);
+    if (!d) {
+        printf("malloc failed!\n");
+        return;
+    }
+    d->w = w;
+    d->parent = parent;
+    d->ref = 1;
+    d->depth = depth;
+    d->dev = dev;
+    d->ino = ino;
+    if (parent) {
+        __atomic_add_fetch(&parent->ref, 1, __ATOMIC_RELAXED);
+    }
+    memcpy(d->path, path, len);
+    d->path[len] = '\0';
+    if (!w->pool) {
+        d->next = w->stack;
+        w->stack = d;
+        return;
+    }
+    pthread_mutex_lock(&w->lock);
+    w->pending++;
+    pthread_mutex_unlock(&w->lock);
+    if (workq_pool_task_push(w->pool, walk_task, d) < 0) {
+        walk_task(d);
+    }
+}
+
+static int walk_run(const char *path, const struct file_walk_conf *conf,
+                struct file_walk_stat *st, walk_dir_hook hook, void *hook_arg)
+{
+    struct walk_ctx w;
+    struct walk_dir *d;
+    struct stat root;
+    struct workq_pool *own_pool = NULL;
+    size_t len;
+
+    if (!path || !conf) {
+        return -1;
+    }
+    memset(&w, 0, sizeof(w));
+    w.conf = *conf;
+    w.hook = hook;
+    w.hook_arg = hook_arg;
+    memset(&root, 0, sizeof(root));
+    if (w.conf.flags & (FILE_WALK_XDEV | FILE_WALK_FOLLOW)) {
+        if (stat(path, &root) < 0) {
+            printf("stat %s failed %d:%s\n", path, errno, strerror(errno));
+            return -1;
+        }
+        w.dev = root.st_dev;
+    }
+    if (w.conf.parallel) {
+        w.pool = w.conf.pool;
+        if (!w.pool) {
+            w.pool = own_pool = workq_pool_create();
+        }
+    }
+    pthread_mutex_init(&w.lock, NULL);
+    pthread_cond_init(&w.cond, NULL);
+
+    len = strlen(path);
+    while (len > 1 && path[len - 1] == '/') {
+        len--;
+    }
+    walk_push(&w, NULL, path, len, 0, root.st_dev, root.st_ino);
+    if (w.pool) {
+        pthread_mutex_lock(&w.lock);
+        while (w.pending > 0) {
+            pthread_cond_wait(&w.cond, &w.lock);
+        }
+        pthread_mutex_unlock(&w.lock);
+    } else {
+        while ((d = w.stack) != NULL) {
+            w.stack = d->next;
+            if (!walk_stopped(&w)) {
+                walk_scan(&w, d);
+            }
+            walk_dir_put(d);
+        }
+    }
+    if (own_pool) {
+        workq_pool_destroy(own_pool);
+    }
+    pthread_mutex_destroy(&w.lock);
+    pthread_cond_destroy(&w.cond);
+    if (st) {
+        *st = w.stat;
+    }
+    if (__atomic_load_n(&w.root_failed, __ATOMIC_RELAXED)) {
+        return -1;
+    }
+    return walk_stopped(&w) ? 1 : 0;
+}
+
+void file_walk_conf_init(struct file_walk_conf *conf)
+{
+    memset(conf, 0, sizeof(*conf));
+    conf->parallel = 1;
+}
+
+int file_walk(const char *path, const struct file_walk_conf *conf,
+                struct file_walk_stat *st)
+{
+    struct file_walk_conf def;
+    if (!conf) {
+        file_walk_conf_init(&def);
+        conf = &def;
+    }
+    return walk_run(path, conf, st, NULL, NULL);
+}
+
+/*
+ * dir cache: a node per directory with the totals of its own files and the
+ * names of its subdirectories, a subtree total is summed over the nodes
+ */
+struct dir_node {
+    struct dir_node *hnext;
+    uint32_t hash;
+    int valid;
+    int err;
+    uint64_t bytes;
+    uint64_t files;
+    char **subdirs;
+    int nsubdir;
+    char path[];
+};
+
+struct file_dir_cache {
+    pthread_mutex_t lock;
+    struct dir_node **bucket;
+    uint32_t nbucket;
+    uint32_t count;
+    struct workq_pool *pool;
+};
+
+struct dir_target {
+    char *path;
+    int missing;
+};
+
+#define DIR_CACHE_BATCH     (64)
+
+static uint32_t dir_hash(const char *s, size_t len)
+{
+    uint32_t h = 2166136261u;
+    size_t i;
+    for (i = 0; i < len; i++) {
+        h = (h ^ (uint8_t)s[i]) * 16777619u;
+    }
+    return h;
+}
+
+/* "a//b/" -> "a/b", so watcher paths match walker paths */
+static void dir_normalize(char *dst, const char *src, size_t size)
+{
+    size_t n = 0;
+    for (; *src && n + 1 < size; src++) {
+        if (*src == '/' && n > 0 && dst[n - 1] == '/') {
+            continue;
+        }
+        dst[n++] = *src;
+    }
+    while (n > 1 && dst[n - 1] == '/') {
+        n--;
+    }
+    dst[n] = '\0';
+}
+
+/* parent/name, no double slash below "/" */
+static void dir_join(char *dst, size_t size, const char *parent, const char *name)
+{
+    size_t len = strlen(parent);
+    snprintf(dst, size, "%s%s%s", parent,
+             (len > 0 && parent[len - 1] == '/') ? "" : "/", name);
+}
+
+static struct dir_node *dir_find(struct file_dir_cache *c, const char *path, size_t len)
+{
+    uint32_t h = dir_hash(path, len);
+    struct dir_node *n = c->bucket[h & (c->nbucket - 1)];
+    for (; n; n = n->hnext) {
+        if (n->hash == h && !strncmp(n->path, path, len) && n->path[len] == '\0') {
+            return n;
+        }
+    }
+    return NULL;
+}
+
+static void dir_node_free(struct dir_node *n)
+{
+    while (n->nsubdir > 0) {
+        free(n->subdirs[--n->nsubdir]);
+    }
+    free(n->subdirs);
+    free(n);
+}
+
+static void dir_grow(struct file_dir_cache *c)
+{
+    struct dir_node **nb, *n, *next;
+    uint32_t i, size = c->nbucket * 2;
+
+    nb = (struct dir_node **)calloc(size, sizeof(struct dir_node *));
+    if (!nb) {
+        return;
+    }
+    for (i = 0; i < c->nbucket; i++) {
+        for (n = c->bucket[i]; n; n = next) {
+            next = n->hnext;
+            n->hnext = nb[n->hash & (size - 1)];
+            nb[n->hash & (size - 1)] = n;
+        }
+    }
+    free(c->bucket);
+    c->bucket = nb;
+    c->nbucket = size;
+}
+
+static struct dir_node *dir_insert(struct file_dir_cache *c, const char *path)
+{
+    size_t len = strlen(path);
+    struct dir_node *n = dir_find(c, path, len);
+    uint32_t idx;
+
+    if (n) {
+        return n;
+    }
+    n = (struct dir_node *)calloc(1, sizeof(struct dir_node) + len + 1);
+    if (!n) {
+        return NULL;
+    }
+    memcpy(n->path, path, len + 1);
+    n->hash = dir_hash(path, len);
+    if (c->count >= c->nbucket) {
+        dir_grow(c);
+    }
+    idx = n->hash & (c->nbucket - 1);
+    n->hnext = c->bucket[idx];
+    c->bucket[idx] = n;
+    c->count++;
+    return n;
+}
+
+/* drop path and everything cached below it */
+static void dir_remove(struct file_dir_cache *c, const char *path)
+{
+    char child[PATH_MAX];
+    size_t len = strlen(path);
+    uint32_t idx = dir_hash(path, len) & (c->nbucket - 1);
+    struct dir_node **pp, *n;
+    int i;
+
+    for (pp = &c->bucket[idx]; (n = *pp) != NULL; pp = &n->hnext) {
+        if (!strcmp(n->path, path)) {
+            break;
+        }
+    }
+    if (!n) {
+        return;
+    }
+    *pp = n->hnext;
+    c->count--;
+    for (i = 0; i < n->nsubdir; i++) {
+        dir_join(child, sizeof(child), path, n->subdirs[i]);
+        dir_remove(c, child);
+    }
+    dir_node_free(n);
+}
+
+static void dir_hook(struct walk_ctx *w, const char *path, struct walk_dir_result *res)
+{
+    struct file_dir_cache *c = (struct file_dir_cache *)w->hook_arg;
+    char child[PATH_MAX];
+    struct dir_node *n;
+    int i, j;
+
+    pthread_mutex_lock(&c->lock);
+    n = dir_insert(c, path);
+    if (!n) {
+        pthread_mutex_unlock(&c->lock);
+        return;
+    }
+    /* subdirectories gone since the last scan take their subtree along */
+    for (i = 0; i < n->nsubdir; i++) {
+        for (j = 0; j < res->nsubdir; j++) {
+            if (!strcmp(n->subdirs[i], res->subdirs[j])) {
+                break;
+            }
+        }
+        if (j == res->nsubdir) {
+            dir_join(child, sizeof(child), path, n->subdirs[i]);
+            dir_remove(c, child);
+        }
+    }
+    /* and new ones may have left a failed node behind, scan them afresh */
+    for (j = 0; j < res->nsubdir; j++) {
+        for (i = 0; i < n->nsubdir; i++) {
+            if (!strcmp(n->subdirs[i], res->subdirs[j])) {
+                break;
+            }
+        }
+        if (i == n->nsubdir) {
+            dir_join(child, sizeof(child), path, res->subdirs[j]);
+            dir_remove(c, child);
+        }
+    }
+    while (n->nsubdir > 0) {
+        free(n->subdirs[--n->nsubdir]);
+    }
+    free(n->subdirs);
+    /* take over the names */
+    n->subdirs = res->subdirs;
+    n->nsubdir = res->nsubdir;
+    res->subdirs = NULL;
+    res->nsubdir = 0;
+    n->bytes = res->bytes;
+    n->files = res->files;
+    n->err = res->err;
+    n->valid = 1;
+    pthread_mutex_unlock(&c->lock);
+}
+
+static int dir_collect(struct file_dir_cache *c, const char *path,
+                struct dir_target *t, int nt)
+{
+    char child[PATH_MAX];
+    struct dir_node *n = dir_find(c, path, strlen(path));
+    int i;
+
+    if (nt >= DIR_CACHE_BATCH) {
+        return nt;
+    }
+    if (!n || !n->valid) {
+        t[nt].path = strdup(path);
+        t[nt].missing = !n;
+        return t[nt].path ? nt + 1 : nt;
+    }
+    for (i = 0; i < n->nsubdir && nt < DIR_CACHE_BATCH; i++) {
+        dir_join(child, sizeof(child), path, n->subdirs[i]);
+        nt = dir_collect(c, child, t, nt);
+    }
+    return nt;
+}
+
+static void dir_sum(struct file_dir_cache *c, const char *path,
+                uint64_t *size, uint64_t *files)
+{
+    char child[PATH_MAX];
+    struct dir_node *n = dir_find(c, path, strlen(path));
+    int i;
+
+    if (!n) {
+        return;
+    }
+    *size += n->bytes;
+    *files += n->files;
+    for (i = 0; i < n->nsubdir; i++) {
+        dir_join(child, sizeof(child), path, n->subdirs[i]);
+        dir_sum(c, child, size, files);
+    }
+}
+
+struct file_dir_cache *file_dir_cache_create(struct workq_pool *pool)
+{
+    struct file_dir_cache *c = (struct file_dir_cache *)calloc(1, sizeof(struct file_dir_cache));
+    if (!c) {
+        printf("malloc failed!\n");
+        return NULL;
+    }
+    c->nbucket = 256;
+    c->bucket = (struct dir_node **)calloc(c->nbucket, sizeof(struct dir_node *));
+    if (!c->bucket) {
+        printf("malloc failed!\n");
+        free(c);
+        return NULL;
+    }
+    c->pool = pool;
+    pthread_mutex_init(&c->lock, NULL);
+    return c;
+}
+
+void file_dir_cache_destroy(struct file_dir_cache *c)
+{
+    struct dir_node *n, *next;
+    uint32_t i;
+
+    if (!c) {
+        return;
+    }
+    for (i = 0; i < c->nbucket; i++) {
+        for (n = c->bucket[i]; n; n = next) {
+            next = n->hnext;
+            dir_node_free(n);
+        }
+    }
+    free(c->bucket);
+    pthread_mutex_destroy(&c->lock);
+    free(c);
+}
+
+int file_dir_cache_size(struct file_dir_cache *c, const char *path,
+                uint64_t *size, uint64_t *files)
+{
+    struct dir_target t[DIR_CACHE_BATCH];
+    struct file_walk_conf conf;
+    char key[PATH_MAX];
+    uint64_t bytes = 0, nfile = 0;
+    struct dir_node *n;
+    int nt, i, ret = 0;
+
+    if (!c || !path) {
+        return -1;
+    }
+    dir_normalize(key, path, sizeof(key));
+    file_walk_conf_init(&conf);
+    conf.flags = FILE_WALK_SIZE;
+    conf.pool = c->pool;
+    conf.parallel = c->pool != NULL;
+    for (;;) {
+        pthread_mutex_lock(&c->lock);
+        nt = dir_collect(c, key, t, 0);
+        pthread_mutex_unlock(&c->lock);
+        if (nt == 0) {
+            break;
+        }
+        for (i = 0; i < nt; i++) {
+            /* new directories are walked whole, stale ones alone */
+            conf.max_depth = t[i].missing ? 0 : 1;
+            walk_run(t[i].path, &conf, NULL, dir_hook, c);
+            pthread_mutex_lock(&c->lock);
+            n = dir_find(c, t[i].path, strlen(t[i].path));
+            if (!n || !n->valid) {
+                /* could not be scanned, don't come back to it */
+                n = dir_insert(c, t[i].path);
+                if (n) {
+                    n->valid = 1;
+                    n->err = -1;
+                }
+            }
+            pthread_mutex_unlock(&c->lock);
+            free(t[i].path);
+        }
+    }
+    pthread_mutex_lock(&c->lock);
+    n = dir_find(c, key, strlen(key));
+    if (!n || n->err) {
+        ret = -1;
+    }
+    dir_sum(c, key, &bytes, &nfile);
+    pthread_mutex_unlock(&c->lock);
+    if (size) {
+        *size = bytes;
+    }
+    if (files) {
+        *files = nfile;
+    }
+    return ret;
+}
+
+void file_dir_cache_invalidate(struct file_dir_cache *c, const char *path)
+{
+    char key[PATH_MAX];
+    struct dir_node *n;
+    char *slash;
+
+    if (!c || !path) {
+        return;
+    }
+    dir_normalize(key, path, sizeof(key));
+    pthread_mutex_lock(&c->lock);
+    /* the entry itself if it's a directory, and the one it lives in */
+    n = dir_find(c, key, strlen(key));
+    if (n) {
+        n->valid = 0;
+    }
+    slash = strrchr(key, '/');
+    if (slash) {
+        n = dir_find(c, key, slash > key ? (size_t)(slash - key) : 1);
+        if (n) {
+            n->valid = 0;
+        }
+    }
+    pthread_mutex_unlock(&c->lock);
+}
@@ -88,6 +88,13 @@ static struct gevent_backend gevent_backend_list[] = {
 #define GEVENT_BACKEND GEVENT_POLL
 #endif
 
+static struct mem_cache *gevent_cache;
+
+static struct gevent *gevent_alloc(void)
+{
+    return mem_cache_zalloc(mem_cache_get(&gevent_cache, "gevent", sizeof(struct gevent)));
+}
+
 static void event_in(int fd, void *arg)
 {
     uint64_t notify;
@@ -147,9 +154,9 @@ void gevent_base_destroy(struct gevent_base *eb)
     close(eb->inner_fd);
     eb->ops->deinit(eb->ctx);
     while (eb->ev_array.num > 0) {
-        struct gevent **e = eb->ev_array.array + eb->ev_array.num-1;
-        da_erase_item(eb->ev_array, e);
-        free(*e);
+        struct gevent *e = eb->ev_array.array[eb->ev_array.num-1];
+        da_pop_back(eb->ev_array);
+        mem_cache_free(gevent_cache, e);
     }
     da_free(eb->ev_array);
     free(eb);
@@ -219,7 +226,7 @@ struct gevent *gevent_create(int fd,
         void *args)
 {
     int flags = 0;
-    struct gevent *e = (struct gevent *)calloc(1, sizeof(struct gevent));
+    struct gevent *e = gevent_alloc();
     if (!e) {
         printf("malloc gevent failed!\n");
         return NULL;
@@ -254,7 +261,7 @@ void gevent_timer_destroy(struct gevent *e)
     if (e->evfd)
         close(e->evfd);
     if (e)
-        free(e);
+        mem_cache_free(gevent_cache, e);
 }
 
 struct gevent *gevent_timer_create(time_t msec,
@@ -268,7 +275,7 @@ struct gevent *gevent_timer_create(time_t msec,
     time_t sec = msec/1000;
     long nsec = (msec-sec*1000)*1000000;
 
-    struct gevent *e = (struct gevent *)calloc(1, sizeof(struct gevent));
+    struct gevent *e = gevent_alloc();
     if (!e) {
         printf("malloc gevent failed!\n");
         goto failed;
@@ -306,7 +313,7 @@ struct gevent *gevent_timer_create(time_t msec,
     return e;
 
 failed:
-    if (e) free(e);
+    if (e) mem_cache_free(gevent_cache, e);
 #endif
     return NULL;
 }
@@ -315,7 +322,7 @@ void gevent_destroy(struct gevent *e)
 {
     if (!e)
         return;
-    free(e);
+    mem_cache_free(gevent_cache, e);
 }
 
 int gevent_add(struct gevent_base *eb, struct gevent **e)
@@ -336,7 +343,7 @@ int gevent_del(struct gevent_base *eb, struct gevent **e)
         return -1;
     }
     ret = eb->ops->del(eb, *e);
-    da_erase_item(eb->ev_array, e);
+    da_erase_item_swap(eb->ev_array, e);
     return ret;
 }
 
@@ -346,7 +353,7 @@ int gevent_mod(struct gevent_base *eb, struct gevent **e)
         printf("%s:%d paraments is NULL\n", __func__, __LINE__);
         return -1;
     }
-    da_erase_item(eb->ev_array, e);
+    da_erase_item_swap(eb->ev_array, e);
     da_push_back(eb->ev_array, e);
     return eb->ops->mod(eb, *e);
 }
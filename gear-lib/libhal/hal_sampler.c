@@ -0,0 +1,869 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#include "libhal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_link.h>
+#include <net/if.h>
+
+#define SAMPLER_MAX_TASK        1024
+
+struct linux_dirent64 {
+    uint64_t       d_ino;
+    int64_t        d_off;
+    unsigned short d_reclen;
+    unsigned char  d_type;
+    char           d_name[];
+};
+
+/* an open /proc file, read again from offset 0 with pread */
+struct proc_file {
+    int fd;
+    char *buf;
+    size_t cap;
+    size_t len;
+};
+
+struct cpu_ticks {
+    uint64_t user;
+    uint64_t system;
+    uint64_t idle;
+    uint64_t iowait;
+    uint64_t total;
+};
+
+struct task_slot {
+    int tid;
+    int fd;
+    int seen;
+    uint64_t ticks;
+};
+
+struct hal_sampler {
+    struct hal_sampler_conf conf;
+    pthread_mutex_t lock;       /* writers only */
+    struct proc_file stat;
+    struct proc_file meminfo;
+    struct proc_file psi[3];
+    int nl_fd;
+    uint32_t nl_seq;
+    char *nl_buf;
+    int task_dir;
+    struct task_slot *tasks;
+    int task_cnt;
+    long clk_tck;
+    uint64_t last_ms;
+    struct cpu_ticks prev_cpu;
+    struct cpu_ticks prev_cores[HAL_SAMPLE_MAX_CPU];
+    struct hal_netif_stat prev_netif[HAL_SAMPLE_MAX_NETIF];
+    int prev_netif_cnt;
+    struct hal_sample work;
+    /* published snapshot, odd seq while it is being written */
+    uint32_t snap_seq;
+    struct hal_sample snap;
+    pthread_t tid;
+    pthread_cond_t cond;
+    int running;
+};
+
+static uint64_t sampler_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void proc_open(struct proc_file *f, const char *path, size_t cap)
+{
+    f->fd = open(path, O_RDONLY | O_CLOEXEC);
+    f->buf = NULL;
+    f->cap = cap;
+    f->len = 0;
+    if (f->fd != -1) {
+        f->buf = malloc(cap);
+        if (!f->buf) {
+            close(f->fd);
+            f->fd = -1;
+        }
+    }
+}
+
+static void proc_close(struct proc_file *f)
+{
+    if (f->fd != -1) {
+        close(f->fd);
+    }
+    free(f->buf);
+    f->fd = -1;
+    f->buf = NULL;
+}
+
+/* whole file into f->buf, grown until it fits */
+static int proc_read(struct proc_file *f)
+{
+    ssize_t n;
+    char *buf;
+
+    if (f->fd == -1) {
+        return -1;
+    }
+    for (;;) {
+        n = pread(f->fd, f->buf, f->cap, 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if ((size_t)n < f->cap) {
+            break;
+        }
+        buf = realloc(f->buf, f->cap * 2);
+        if (!buf) {
+            return -1;
+        }
+        f->buf = buf;
+        f->cap *= 2;
+    }
+    f->len = n;
+    return 0;
+}
+
+/******************************************************************************
+ * parsing, no stdio
+ ******************************************************************************/
+
+static const char *skip_space(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    return p;
+}
+
+static const char *next_line(const char *p, const char *end)
+{
+    p = memchr(p, '\n', end - p);
+    return p ? p + 1 : end;
+}
+
+static uint64_t parse_u64(const char **pp, const char *end)
+{
+    const char *p = skip_space(*pp, end);
+    uint64_t v = 0;
+
+    while (p < end && *p >= '0' && *p <= '9') {
+        v = v * 10 + (*p - '0');
+        p++;
+    }
+    *pp = p;
+    return v;
+}
+
+/* "12.34" as 1234 */
+static uint32_t parse_fixed2(const char **pp, const char *end)
+{
+    const char *p;
+    uint32_t v = (uint32_t)parse_u64(pp, end) * 100;
+    int i;
+
+    p = *pp;
+    if (p < end && *p == '.') {
+        p++;
+        for (i = 0; i < 2; i++) {
+            v += (p < end && *p >= '0' && *p <= '9') ? (*p++ - '0') * (i ? 1 : 10) : 0;
+        }
+        while (p < end && *p >= '0' && *p <= '9') {
+            p++;
+        }
+    }
+    *pp = p;
+    return v;
+}
+
+static int has_prefix(const char *p, const char *end, const char *prefix, size_t len)
+{
+    return (size_t)(end - p) >= len && !memcmp(p, prefix, len);
+}
+
+/******************************************************************************
+ * cpu and memory
+ ******************************************************************************/
+
+static void cpu_parse(const char *p, const char *end, struct cpu_ticks *t)
+{
+    uint64_t v[8];
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        v[i] = parse_u64(&p, end);
+    }
+    /* user nice system idle iowait irq softirq steal */
+    t->user = v[0] + v[1];
+    t->system = v[2] + v[5] + v[6];
+    t->idle = v[3];
+    t->iowait = v[4];
+    t->total = t->user + t->system + t->idle + t->iowait + v[7];
+}
+
+static void cpu_usage(const struct cpu_ticks *now, const struct cpu_ticks *prev,
+                struct hal_cpu_usage *u)
+{
+    uint64_t total = now->total - prev->total;
+    uint64_t idle = (now->idle - prev->idle) + (now->iowait - prev->iowait);
+
+    if (prev->total == 0 || now->total <= prev->total) {
+        memset(u, 0, sizeof(*u));
+        return;
+    }
+    u->busy = idle >= total ? 0 : (total - idle) * 1000 / total;
+    u->user = (now->user - prev->user) * 1000 / total;
+    u->system = (now->system - prev->system) * 1000 / total;
+    u->iowait = (now->iowait - prev->iowait) * 1000 / total;
+}
+
+static int sample_cpu(struct hal_sampler *s, struct hal_sample *out)
+{
+    const char *p, *end;
+    struct cpu_ticks t;
+    uint64_t n;
+
+    if (proc_read(&s->stat) < 0) {
+        return -1;
+    }
+    p = s->stat.buf;
+    end = p + s->stat.len;
+    out->cpu_cnt = 0;
+    for (; p < end && has_prefix(p, end, "cpu", 3); p = next_line(p, end)) {
+        p += 3;
+        if (*p == ' ') {
+            cpu_parse(p, end, &t);
+            cpu_usage(&t, &s->prev_cpu, &out->cpu);
+            s->prev_cpu = t;
+            continue;
+        }
+        n = parse_u64(&p, end);
+        if (n >= HAL_SAMPLE_MAX_CPU) {
+            continue;
+        }
+        cpu_parse(p, end, &t);
+        cpu_usage(&t, &s->prev_cores[n], &out->cores[n]);
+        s->prev_cores[n] = t;
+        if ((int)n >= out->cpu_cnt) {
+            out->cpu_cnt = n + 1;
+        }
+    }
+    return 0;
+}
+
+static int sample_memory(struct hal_sampler *s, struct hal_sample *out)
+{
+    static const struct {
+        const char *key;
+        size_t len;
+        size_t off;
+    } keys[] = {
+        {"MemTotal:",     9, offsetof(struct hal_sample, mem_total)},
+        {"MemFree:",      8, offsetof(struct hal_sample, mem_free)},
+        {"MemAvailable:", 13, offsetof(struct hal_sample, mem_available)},
+        {"Cached:",       7, offsetof(struct hal_sample, mem_cached)},
+    };
+    const char *p, *end;
+    size_t i, found = 0;
+
+    if (proc_read(&s->meminfo) < 0) {
+        return -1;
+    }
+    p = s->meminfo.buf;
+    end = p + s->meminfo.len;
+    for (; p < end && found < sizeof(keys) / sizeof(keys[0]); p = next_line(p, end)) {
+        for (i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+            if (has_prefix(p, end, keys[i].key, keys[i].len)) {
+                p += keys[i].len;
+                *(uint64_t *)((char *)out + keys[i].off) = parse_u64(&p, end) * 1024;
+                found++;
+                break;
+            }
+        }
+    }
+    return 0;
+}
+
+/* "some avg10=0.00 avg60=0.00 avg300=0.00 total=0" and a "full" line */
+static void psi_parse(struct proc_file *f, struct hal_psi *psi)
+{
+    const char *p = f->buf, *end = f->buf + f->len;
+    uint32_t *avg10, *avg60;
+    uint64_t *total;
+
+    memset(psi, 0, sizeof(*psi));
+    for (; p < end; p = next_line(p, end)) {
+        if (has_prefix(p, end, "some", 4)) {
+            avg10 = &psi->some_avg10;
+            avg60 = &psi->some_avg60;
+            total = &psi->some_total_us;
+        } else if (has_prefix(p, end, "full", 4)) {
+            avg10 = &psi->full_avg10;
+            avg60 = &psi->full_avg60;
+            total = &psi->full_total_us;
+        } else {
+            continue;
+        }
+        p += 4;
+        p = skip_space(p, end);
+        if (!has_prefix(p, end, "avg10=", 6)) {
+            continue;
+        }
+        p += 6;
+        *avg10 = parse_fixed2(&p, end);
+        p = skip_space(p, end);
+        if (has_prefix(p, end, "avg60=", 6)) {
+            p += 6;
+            *avg60 = parse_fixed2(&p, end);
+        }
+        p = skip_space(p, end);
+        if (has_prefix(p, end, "avg300=", 7)) {
+            p += 7;
+            parse_fixed2(&p, end);
+        }
+        p = skip_space(p, end);
+        if (has_prefix(p, end, "total=", 6)) {
+            p += 6;
+            *total = parse_u64(&p, end);
+        }
+    }
+}
+
+static void sample_psi(struct hal_sampler *s, struct hal_sample *out)
+{
+    struct hal_psi *psi[3] = {&out->psi_cpu, &out->psi_memory, &out->psi_io};
+    int i;
+
+    out->has_psi = false;
+    for (i = 0; i < 3; i++) {
+        if (proc_read(&s->psi[i]) == 0) {
+            psi_parse(&s->psi[i], psi[i]);
+            out->has_psi = true;
+        }
+    }
+}
+
+/******************************************************************************
+ * network interfaces, RTM_GETLINK dump
+ ******************************************************************************/
+
+#define NL_BUF_SIZE     (32 * 1024)
+
+static uint64_t rate(uint64_t now, uint64_t prev, uint32_t ms)
+{
+    return (ms == 0 || now < prev) ? 0 : (now - prev) * 1000 / ms;
+}
+
+static void netif_add(struct hal_sampler *s, struct hal_sample *out,
+                struct ifinfomsg *ifi, int len)
+{
+    struct hal_netif_stat *n, *prev = NULL;
+    struct rtnl_link_stats64 st64;
+    struct rtnl_link_stats *st;
+    struct rtattr *rta;
+    int i, has_stats = 0;
+
+    if (out->netif_cnt >= HAL_SAMPLE_MAX_NETIF) {
+        return;
+    }
+    n = &out->netif[out->netif_cnt];
+    memset(n, 0, sizeof(*n));
+    n->index = ifi->ifi_index;
+    n->is_running = (ifi->ifi_flags & IFF_UP) && (ifi->ifi_flags & IFF_RUNNING);
+    for (rta = IFLA_RTA(ifi); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        switch (rta->rta_type) {
+        case IFLA_IFNAME:
+            snprintf(n->name, sizeof(n->name), "%s", (char *)RTA_DATA(rta));
+            break;
+        case IFLA_STATS64:
+            /* attribute data is only 4-byte aligned */
+            memcpy(&st64, RTA_DATA(rta), sizeof(st64));
+            n->rx_bytes = st64.rx_bytes;
+            n->tx_bytes = st64.tx_bytes;
+            n->rx_packets = st64.rx_packets;
+            n->tx_packets = st64.tx_packets;
+            n->rx_errors = st64.rx_errors;
+            n->tx_errors = st64.tx_errors;
+            has_stats = 2;
+            break;
+        case IFLA_STATS:
+            if (has_stats < 2) {
+                st = (struct rtnl_link_stats *)RTA_DATA(rta);
+                n->rx_bytes = st->rx_bytes;
+                n->tx_bytes = st->tx_bytes;
+                n->rx_packets = st->rx_packets;
+                n->tx_packets = st->tx_packets;
+                n->rx_errors = st->rx_errors;
+                n->tx_errors = st->tx_errors;
+                has_stats = 1;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    for (i = 0; i < s->prev_netif_cnt; i++) {
+        if (s->prev_netif[i].index == n->index) {
+            prev = &s->prev_netif[i];
+            break;
+        }
+    }
+    if (prev && out->interval_ms) {
+        n->rx_bps = rate(n->rx_bytes, prev->rx_bytes, out->interval_ms);
+        n->tx_bps = rate(n->tx_bytes, prev->tx_bytes, out->interval_ms);
+        n->rx_pps = rate(n->rx_packets, prev->rx_packets, out->interval_ms);
+        n->tx_pps = rate(n->tx_packets, prev->tx_packets, out->interval_ms);
+    }
+    out->netif_cnt++;
+}
+
+static int sample_netif(struct hal_sampler *s, struct hal_sample *out)
+{
+    struct {
+        struct nlmsghdr nh;
+        struct ifinfomsg ifi;
+    } req;
+    struct nlmsghdr *nh;
+    ssize_t n;
+    int done = 0;
+
+    out->netif_cnt = 0;
+    if (s->nl_fd == -1) {
+        return -1;
+    }
+    memset(&req, 0, sizeof(req));
+    req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+    req.nh.nlmsg_type = RTM_GETLINK;
+    req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.nh.nlmsg_seq = ++s->nl_seq;
+    req.ifi.ifi_family = AF_UNSPEC;
+    if (send(s->nl_fd, &req, req.nh.nlmsg_len, 0) < 0) {
+        return -1;
+    }
+    while (!done) {
+        n = recv(s->nl_fd, s->nl_buf, NL_BUF_SIZE, 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        for (nh = (struct nlmsghdr *)s->nl_buf; NLMSG_OK(nh, n); nh = NLMSG_NEXT(nh, n)) {
+            if (nh->nlmsg_seq != s->nl_seq) {
+                continue;
+            }
+            if (nh->nlmsg_type == NLMSG_DONE || nh->nlmsg_type == NLMSG_ERROR) {
+                done = 1;
+                break;
+            }
+            if (nh->nlmsg_type == RTM_NEWLINK) {
+                netif_add(s, out, NLMSG_DATA(nh), IFLA_PAYLOAD(nh));
+            }
+        }
+    }
+    memcpy(s->prev_netif, out->netif, out->netif_cnt * sizeof(struct hal_netif_stat));
+    s->prev_netif_cnt = out->netif_cnt;
+    return 0;
+}
+
+/******************************************************************************
+ * threads, one stat fd kept open per task
+ ******************************************************************************/
+
+static struct task_slot *task_get(struct hal_sampler *s, int tid)
+{
+    struct task_slot *t;
+    char path[32];
+    int i;
+
+    for (i = 0; i < s->task_cnt; i++) {
+        if (s->tasks[i].tid == tid) {
+            return &s->tasks[i];
+        }
+    }
+    if (s->task_cnt >= SAMPLER_MAX_TASK) {
+        return NULL;
+    }
+    if (s->task_cnt % 64 == 0) {
+        t = realloc(s->tasks, (s->task_cnt + 64) * sizeof(struct task_slot));
+        if (!t) {
+            return NULL;
+        }
+        s->tasks = t;
+    }
+    snprintf(path, sizeof(path), "%d/stat", tid);
+    t = &s->tasks[s->task_cnt];
+    t->fd = openat(s->task_dir, path, O_RDONLY | O_CLOEXEC);
+    if (t->fd == -1) {
+        return NULL;
+    }
+    t->tid = tid;
+    t->ticks = 0;
+    s->task_cnt++;
+    return t;
+}
+
+/* "tid (comm) S ppid ... utime stime", comm may hold spaces and ')' */
+static int task_parse(struct hal_sampler *s, struct task_slot *t, struct hal_thread_stat *ts,
+                uint32_t interval_ms)
+{
+    char buf[512];
+    const char *p, *end, *name;
+    uint64_t utime, stime, ticks;
+    ssize_t n;
+    int i;
+
+    n = pread(t->fd, buf, sizeof(buf), 0);
+    if (n <= 0) {
+        return -1;
+    }
+    end = buf + n;
+    name = memchr(buf, '(', n);
+    for (p = end - 1; p > buf && *p != ')'; p--)
+        ;
+    if (!name || p <= name) {
+        return -1;
+    }
+    i = p - name - 1 < (int)sizeof(ts->name) - 1 ? p - name - 1 : (int)sizeof(ts->name) - 1;
+    memcpy(ts->name, name + 1, i);
+    ts->name[i] = '\0';
+    p = skip_space(p + 1, end);
+    ts->state = p < end ? *p++ : '?';
+    /* ppid .. cmajflt, then utime stime */
+    for (i = 0; i < 10; i++) {
+        parse_u64(&p, end);
+        p = skip_space(p, end);
+        if (p < end && *p == '-') {
+            p++;
+        }
+    }
+    utime = parse_u64(&p, end);
+    stime = parse_u64(&p, end);
+    ticks = utime + stime;
+    ts->tid = t->tid;
+    ts->utime_ms = utime * 1000 / s->clk_tck;
+    ts->stime_ms = stime * 1000 / s->clk_tck;
+    ts->cpu = (t->ticks && interval_ms && ticks >= t->ticks) ?
+              (ticks - t->ticks) * 1000 * 1000 / s->clk_tck / interval_ms : 0;
+    t->ticks = ticks;
+    return 0;
+}
+
+static int thread_cmp(const void *a, const void *b)
+{
+    const struct hal_thread_stat *x = a, *y = b;
+    if (x->cpu != y->cpu) {
+        return x->cpu > y->cpu ? -1 : 1;
+    }
+    return x->tid - y->tid;
+}
+
+static int sample_threads(struct hal_sampler *s, struct hal_sample *out)
+{
+    struct hal_thread_stat *all, ts;
+    struct linux_dirent64 *de;
+    struct task_slot *t;
+    char buf[4096];
+    long n, pos;
+    int i, cnt = 0, tid;
+
+    out->thread_cnt = 0;
+    out->thread_total = 0;
+    if (s->task_dir == -1 || lseek(s->task_dir, 0, SEEK_SET) == -1) {
+        return -1;
+    }
+    for (i = 0; i < s->task_cnt; i++) {
+        s->tasks[i].seen = 0;
+    }
+    all = malloc(SAMPLER_MAX_TASK * sizeof(struct hal_thread_stat));
+    if (!all) {
+        return -1;
+    }
+    while ((n = syscall(SYS_getdents64, s->task_dir, buf, sizeof(buf))) > 0) {
+        for (pos = 0; pos < n; pos += de->d_reclen) {
+            de = (struct linux_dirent64 *)(buf + pos);
+            if (de->d_name[0] < '0' || de->d_name[0] > '9') {
+                continue;
+            }
+            tid = atoi(de->d_name);
+            t = task_get(s, tid);
+            if (!t) {
+                continue;
+            }
+            t->seen = 1;
+            if (task_parse(s, t, &ts, out->interval_ms) == 0) {
+                all[cnt++] = ts;
+            }
+        }
+    }
+    /* exited threads */
+    for (i = 0; i < s->task_cnt;) {
+        if (!s->tasks[i].seen) {
+            close(s->tasks[i].fd);
+            s->tasks[i] = s->tasks[--s->task_cnt];
+        } else {
+            i++;
+        }
+    }
+    qsort(all, cnt, sizeof(struct hal_thread_stat), thread_cmp);
+    out->thread_total = cnt;
+    out->thread_cnt = cnt < HAL_SAMPLE_MAX_THREAD ? cnt : HAL_SAMPLE_MAX_THREAD;
+    memcpy(out->thread, all, out->thread_cnt * sizeof(struct hal_thread_stat));
+    free(all);
+    return 0;
+}
+
+/******************************************************************************
+ * snapshot
+ ******************************************************************************/
+
+static void snapshot_publish(struct hal_sampler *s)
+{
+    uint32_t seq = __atomic_load_n(&s->snap_seq, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&s->snap_seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(&s->snap, &s->work, sizeof(struct hal_sample));
+    __atomic_store_n(&s->snap_seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+int hal_sampler_get(struct hal_sampler *s, struct hal_sample *out)
+{
+    uint32_t seq0, seq1;
+
+    if (!s || !out) {
+        return -1;
+    }
+    /* seqlock read, retried only if an update was published meanwhile */
+    do {
+        seq0 = __atomic_load_n(&s->snap_seq, __ATOMIC_ACQUIRE);
+        if (seq0 & 1) {
+            sched_yield();
+            continue;
+        }
+        memcpy(out, &s->snap, sizeof(struct hal_sample));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        seq1 = __atomic_load_n(&s->snap_seq, __ATOMIC_RELAXED);
+    } while ((seq0 & 1) || seq0 != seq1);
+    return out->seq ? 0 : -1;
+}
+
+int hal_sampler_update(struct hal_sampler *s)
+{
+    struct hal_sample *out;
+    uint64_t now;
+    int ret;
+
+    if (!s) {
+        return -1;
+    }
+    pthread_mutex_lock(&s->lock);
+    out = &s->work;
+    now = sampler_now_ms();
+    out->interval_ms = s->last_ms ? (uint32_t)(now - s->last_ms) : 0;
+    out->time_ms = now;
+    s->last_ms = now;
+    ret = sample_cpu(s, out);
+    if (ret == 0) {
+        ret = sample_memory(s, out);
+    }
+    sample_psi(s, out);
+    if (s->conf.netif) {
+        sample_netif(s, out);
+    }
+    if (s->conf.threads) {
+        sample_threads(s, out);
+    }
+    if (ret == 0) {
+        out->seq++;
+        snapshot_publish(s);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return ret;
+}
+
+static void *sampler_thread(void *arg)
+{
+    struct hal_sampler *s = (struct hal_sampler *)arg;
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    pthread_mutex_lock(&s->lock);
+    while (s->running) {
+        pthread_mutex_unlock(&s->lock);
+        hal_sampler_update(s);
+        pthread_mutex_lock(&s->lock);
+        /* fixed period, not drifting with the update time */
+        ts.tv_sec += s->conf.interval_ms / 1000;
+        ts.tv_nsec += (s->conf.interval_ms % 1000) * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        while (s->running && pthread_cond_timedwait(&s->cond, &s->lock, &ts) != ETIMEDOUT)
+            ;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+struct hal_sampler *hal_sampler_create(const struct hal_sampler_conf *conf)
+{
+    static const char *psi_path[3] = {
+        "/proc/pressure/cpu", "/proc/pressure/memory", "/proc/pressure/io"
+    };
+    struct hal_sampler_conf def = hal_sampler_conf_initializer;
+    struct sockaddr_nl addr;
+    pthread_condattr_t attr;
+    struct hal_sampler *s;
+    char path[64];
+    int i;
+
+    s = calloc(1, sizeof(struct hal_sampler));
+    if (!s) {
+        printf("malloc hal_sampler failed!\n");
+        return NULL;
+    }
+    s->conf = conf ? *conf : def;
+    s->clk_tck = sysconf(_SC_CLK_TCK);
+    if (s->clk_tck <= 0) {
+        s->clk_tck = 100;
+    }
+    s->nl_fd = -1;
+    s->task_dir = -1;
+    proc_open(&s->stat, "/proc/stat", 16 * 1024);
+    proc_open(&s->meminfo, "/proc/meminfo", 8 * 1024);
+    for (i = 0; i < 3; i++) {
+        proc_open(&s->psi[i], psi_path[i], 256);
+    }
+    if (s->stat.fd == -1 || s->meminfo.fd == -1) {
+        printf("open /proc failed: %s\n", strerror(errno));
+        goto failed;
+    }
+    if (s->conf.netif) {
+        s->nl_buf = malloc(NL_BUF_SIZE);
+        s->nl_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+        memset(&addr, 0, sizeof(addr));
+        addr.nl_family = AF_NETLINK;
+        if (!s->nl_buf || s->nl_fd == -1 ||
+            bind(s->nl_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+            printf("netlink socket failed: %s\n", strerror(errno));
+            goto failed;
+        }
+    }
+    if (s->conf.threads) {
+        if (s->conf.pid > 0) {
+            snprintf(path, sizeof(path), "/proc/%d/task", s->conf.pid);
+        } else {
+            snprintf(path, sizeof(path), "/proc/self/task");
+        }
+        s->task_dir = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (s->task_dir == -1) {
+            printf("open %s failed: %s\n", path, strerror(errno));
+            goto failed;
+        }
+    }
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&s->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    if (s->conf.interval_ms > 0) {
+        s->running = 1;
+        if (pthread_create(&s->tid, NULL, sampler_thread, s)) {
+            printf("pthread_create failed!\n");
+            s->running = 0;
+            pthread_cond_destroy(&s->cond);
+            pthread_mutex_destroy(&s->lock);
+            goto failed;
+        }
+    }
+    return s;
+
+failed:
+    if (s->nl_fd != -1) {
+        close(s->nl_fd);
+    }
+    if (s->task_dir != -1) {
+        close(s->task_dir);
+    }
+    free(s->nl_buf);
+    proc_close(&s->stat);
+    proc_close(&s->meminfo);
+    for (i = 0; i < 3; i++) {
+        proc_close(&s->psi[i]);
+    }
+    free(s);
+    return NULL;
+}
+
+void hal_sampler_destroy(struct hal_sampler *s)
+{
+    int i;
+
+    if (!s) {
+        return;
+    }
+    if (s->running) {
+        pthread_mutex_lock(&s->lock);
+        s->running = 0;
+        pthread_cond_signal(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+        pthread_join(s->tid, NULL);
+    }
+    for (i = 0; i < s->task_cnt; i++) {
+        close(s->tasks[i].fd);
+    }
+    free(s->tasks);
+    if (s->nl_fd != -1) {
+        close(s->nl_fd);
+    }
+    if (s->task_dir != -1) {
+        close(s->task_dir);
+    }
+    free(s->nl_buf);
+    proc_close(&s->stat);
+    proc_close(&s->meminfo);
+    for (i = 0; i < 3; i++) {
+        proc_close(&s->psi[i]);
+    }
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+}
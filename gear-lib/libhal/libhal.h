@@ -107,6 +107,104 @@ int system_noblock(char **argv);
 ssize_t system_with_result(const char *cmd, void *buf, size_t count);
 ssize_t system_noblock_with_result(char **argv, void *buf, size_t count);
 
+/******************************************************************************
+ * sampler
+ ******************************************************************************/
+
+/*
+ * periodic system metrics for watchdogs. the sampler keeps its /proc fds and
+ * netlink socket open and re-reads them each update, the result is published
+ * as a snapshot that hal_sampler_get copies without taking a lock.
+ * linux only.
+ */
+#define HAL_SAMPLE_MAX_CPU      256
+#define HAL_SAMPLE_MAX_NETIF    16
+#define HAL_SAMPLE_MAX_THREAD   64
+
+/* per-mille of the cpu time since the previous sample */
+struct hal_cpu_usage {
+    uint16_t busy;
+    uint16_t user;
+    uint16_t system;
+    uint16_t iowait;
+};
+
+/* /proc/pressure, avg in hundredths of a percent */
+struct hal_psi {
+    uint32_t some_avg10;
+    uint32_t some_avg60;
+    uint32_t full_avg10;
+    uint32_t full_avg60;
+    uint64_t some_total_us;
+    uint64_t full_total_us;
+};
+
+struct hal_netif_stat {
+    char name[16];
+    int index;
+    bool is_running;
+    uint64_t rx_bytes;
+    uint64_t tx_bytes;
+    uint64_t rx_packets;
+    uint64_t tx_packets;
+    uint64_t rx_errors;
+    uint64_t tx_errors;
+    /* per second since the previous sample */
+    uint64_t rx_bps;
+    uint64_t tx_bps;
+    uint64_t rx_pps;
+    uint64_t tx_pps;
+};
+
+struct hal_thread_stat {
+    int tid;
+    char name[16];
+    char state;
+    uint16_t cpu;               /* per-mille of one core */
+    uint64_t utime_ms;
+    uint64_t stime_ms;
+};
+
+struct hal_sample {
+    uint64_t seq;               /* 0 until the first update */
+    uint64_t time_ms;           /* monotonic */
+    uint32_t interval_ms;       /* since the previous sample */
+    int cpu_cnt;                /* highest online cpu + 1 */
+    struct hal_cpu_usage cpu;   /* all cpus */
+    struct hal_cpu_usage cores[HAL_SAMPLE_MAX_CPU];
+    uint64_t mem_total;
+    uint64_t mem_free;
+    uint64_t mem_available;
+    uint64_t mem_cached;
+    bool has_psi;
+    struct hal_psi psi_cpu;
+    struct hal_psi psi_memory;
+    struct hal_psi psi_io;
+    int netif_cnt;
+    struct hal_netif_stat netif[HAL_SAMPLE_MAX_NETIF];
+    int thread_cnt;             /* busiest threads first */
+    int thread_total;
+    struct hal_thread_stat thread[HAL_SAMPLE_MAX_THREAD];
+};
+
+struct hal_sampler_conf {
+    int interval_ms;            /* sampling thread period, 0 caller updates */
+    int pid;                    /* threads of this process, 0 self */
+    bool netif;
+    bool threads;
+};
+
+#define hal_sampler_conf_initializer { 1000, 0, true, true }
+
+struct hal_sampler;
+
+struct hal_sampler *hal_sampler_create(const struct hal_sampler_conf *conf);
+void hal_sampler_destroy(struct hal_sampler *s);
+/* take a sample now, return 0 or -1 */
+int hal_sampler_update(struct hal_sampler *s);
+/* copy the latest sample, -1 if there is none yet */
+int hal_sampler_get(struct hal_sampler *s, struct hal_sample *out);
+
 int hal_open(const char *pathname, int flags);
 ssize_t hal_read(int fd, void *buf, size_t count);
 ssize_t hal_write(int fd, const void *buf, size_t count);
@@ -24,6 +24,9 @@
 #include <stdlib.h>
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
 
 void foo2()
 {
@@ -32,6 +35,125 @@ void foo2()
     system_with_result(cmd, buf, sizeof(buf));
     printf("buf = %s\n", buf);
 }
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+#define CHECK(c) do { if (!(c)) { printf("check '%s' failed\n", #c); goto fail; } } while (0)
+
+/* per-mille as a percent with one decimal */
+#define PM(v) (v) / 10, (v) % 10
+
+static int check_usage(const struct hal_cpu_usage *u)
+{
+    return u->busy <= 1000 && u->user <= 1000 && u->system <= 1000 &&
+           u->iowait <= 1000 ? 0 : -1;
+}
+
+int foo_sampler()
+{
+    struct hal_sampler_conf conf = hal_sampler_conf_initializer;
+    struct hal_sampler *s;
+    struct hal_sample *hs;
+    static struct network_ports ports;
+    struct cpu_info ci;
+    struct memory_info mi;
+    uint64_t start, seq;
+    int i, n = 200, ret = -1;
+
+    hs = calloc(1, sizeof(struct hal_sample));
+    conf.interval_ms = 0;
+    s = hal_sampler_create(&conf);
+    if (!s || !hs) {
+        printf("hal_sampler_create failed!\n");
+        hal_sampler_destroy(s);
+        free(hs);
+        return -1;
+    }
+    CHECK(hal_sampler_get(s, hs) == -1);
+    CHECK(hal_sampler_update(s) == 0);
+    CHECK(hal_sampler_get(s, hs) == 0);
+    seq = hs->seq;
+    usleep(200 * 1000);
+    CHECK(hal_sampler_update(s) == 0);
+    CHECK(hal_sampler_get(s, hs) == 0);
+    CHECK(hs->seq == seq + 1);
+    printf("sample %" PRIu64 " interval %ums, %d cpus, busy %u.%u%%\n", hs->seq,
+           hs->interval_ms, hs->cpu_cnt, PM(hs->cpu.busy));
+    CHECK(hs->cpu_cnt > 0 && hs->cpu_cnt <= HAL_SAMPLE_MAX_CPU);
+    CHECK(check_usage(&hs->cpu) == 0);
+    for (i = 0; i < hs->cpu_cnt; i++) {
+        CHECK(check_usage(&hs->cores[i]) == 0);
+    }
+    for (i = 0; i < hs->cpu_cnt && i < 4; i++) {
+        printf("  cpu%d busy %u.%u%% user %u.%u%% sys %u.%u%% iowait %u.%u%%\n", i,
+               PM(hs->cores[i].busy), PM(hs->cores[i].user),
+               PM(hs->cores[i].system), PM(hs->cores[i].iowait));
+    }
+    CHECK(hs->mem_total > 0 && hs->mem_available <= hs->mem_total);
+    printf("memory total %" PRIu64 "MB available %" PRIu64 "MB\n",
+           hs->mem_total >> 20, hs->mem_available >> 20);
+    if (hs->has_psi) {
+        printf("psi memory some avg10 %u.%02u full avg10 %u.%02u\n",
+               hs->psi_memory.some_avg10 / 100, hs->psi_memory.some_avg10 % 100,
+               hs->psi_memory.full_avg10 / 100, hs->psi_memory.full_avg10 % 100);
+    }
+    for (i = 0; i < hs->netif_cnt; i++) {
+        printf("  %-8s %s rx %" PRIu64 " B/s tx %" PRIu64 " B/s, rx %" PRIu64 " tx %" PRIu64 "\n",
+               hs->netif[i].name, hs->netif[i].is_running ? "up  " : "down",
+               hs->netif[i].rx_bps, hs->netif[i].tx_bps,
+               hs->netif[i].rx_bytes, hs->netif[i].tx_bytes);
+    }
+    for (i = 0; i < hs->thread_cnt; i++) {
+        printf("  thread %d %s %c cpu %u.%u%%\n", hs->thread[i].tid, hs->thread[i].name,
+               hs->thread[i].state, PM(hs->thread[i].cpu));
+    }
+
+    /* the per-call fopen path against the kept-open sampler */
+    start = now_us();
+    for (i = 0; i < n; i++) {
+        cpu_get_info(&ci);
+        memory_get_info(&mi);
+        network_get_port_occupied(&ports);
+    }
+    printf("cpu_get_info/memory_get_info/network_get_port_occupied: %" PRIu64 " us per call\n",
+           (now_us() - start) / n);
+    start = now_us();
+    for (i = 0; i < n; i++) {
+        CHECK(hal_sampler_update(s) == 0);
+    }
+    CHECK(hal_sampler_get(s, hs) == 0);
+    CHECK(hs->seq == seq + 1 + n);
+    printf("hal_sampler_update: %" PRIu64 " us per call\n", (now_us() - start) / n);
+    start = now_us();
+    for (i = 0; i < n * 100; i++) {
+        hal_sampler_get(s, hs);
+    }
+    printf("hal_sampler_get: %" PRIu64 " ns per call\n", (now_us() - start) * 1000 / (n * 100));
+    hal_sampler_destroy(s);
+
+    /* sampling thread, readers only copy the snapshot */
+    conf.interval_ms = 50;
+    s = hal_sampler_create(&conf);
+    CHECK(s);
+    usleep(200 * 1000);
+    CHECK(hal_sampler_get(s, hs) == 0);
+    seq = hs->seq;
+    printf("sampler thread: %" PRIu64 " samples\n", seq);
+    usleep(200 * 1000);
+    CHECK(hal_sampler_get(s, hs) == 0);
+    CHECK(hs->seq > seq);
+    CHECK(check_usage(&hs->cpu) == 0 && hs->mem_total > 0);
+    ret = 0;
+fail:
+    hal_sampler_destroy(s);
+    free(hs);
+    return ret;
+}
+
 int main(int argc, char **argv)
 {
     struct network_ports ports;
@@ -39,8 +161,11 @@ int main(int argc, char **argv)
     struct cpu_info ci;
     struct memory_info mi;
     struct os_info oi;
-    int i;
+    int i, ret = 0;
     foo2();
+    if (foo_sampler() != 0) {
+        ret = -1;
+    }
     network_get_info("lo", &ni);
     cpu_get_info(&ci);
     printf("%s\n", ni.ipaddr);
@@ -61,5 +186,5 @@ int main(int argc, char **argv)
     for (i = 0; i < ports.udp_cnt; i++) {
         printf("udp_ports = %d\n", ports.udp[i]);
     }
-    return 0;
+    return ret;
 }
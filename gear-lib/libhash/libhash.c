@@ -21,6 +21,7 @@
  ******************************************************************************/
 #include "libhash.h"
 #include <libposix.h>
+#include <libstrex.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -45,92 +46,11 @@ struct hash_item {
     void *val;
 };
 
-enum hash_fn_id {
-    HASH_DOBBS,
-    HASH_MURMUR,
-    HASH_CITY,
-    HASH_SPOOKY
-};
-
-typedef struct hash_fn_item {
-    int id;
-    uint32_t (*func)(const char *key, size_t len);
-} hash_fn_item;
-
-static uint32_t hash_dobbs(const char *key, size_t len)
-{
-//https://en.wikipedia.org/wiki/Jenkins_hash_function
-    uint32_t hash = 0;
-    size_t i = 0;
-    for (i = 0; i < len; ++i) {
-        hash += key[i];
-        hash += (hash << 10);
-        hash ^= (hash >> 6);
-    }
-    hash += (hash << 3);
-    hash ^= (hash >> 11);
-    hash += (hash << 15);
-    return hash;
-}
-
-static uint32_t hash_murmur(const char *key, size_t len)
-{
-//https://en.wikipedia.org/wiki/MurmurHash from variety of dict
-//https://github.com/ndevilla/dict
-#define MURMUR_MAGIC_1  0x5bd1e995
-#define MURMUR_MAGIC_2  0x0badcafe
-    uint32_t h, k;
-    unsigned char * data;
-    h = MURMUR_MAGIC_2 ^ len;
-    data = (uint8_t *)key;
-    while(len >= 4) {
-        k = *(uint32_t *)data;
-        k *= MURMUR_MAGIC_1;
-        k ^= k >> 24;
-        k *= MURMUR_MAGIC_1;
-        h *= MURMUR_MAGIC_1;
-        h ^= k;
-        data += 4;
-        len -= 4;
-    }
-    switch (len) {
-    case 3: h ^= data[2] << 16;
-    case 2: h ^= data[1] << 8;
-    case 1: h ^= data[0];
-            h *= MURMUR_MAGIC_1;
-    }
-    h ^= h >> 13;
-    h *= MURMUR_MAGIC_1;
-    h ^= h >> 15;
-    return h;
-}
-
-static uint32_t hash_city(const char *key, size_t len)
-{
-//https://github.com/google/cityhash
-//TODO
-    printf("unsupport yet\n");
-    return 0;
-}
-
-static uint32_t hash_spooky(const char *key, size_t len)
-{
-//http://burtleburtle.net/bob/hash/spooky.html
-//TODO
-    printf("unsupport yet\n");
-    return 0;
-}
-
-static hash_fn_item hash_fn_table[] = {
-    {HASH_DOBBS, &hash_dobbs},
-    {HASH_MURMUR, &hash_murmur},
-    {HASH_CITY, &hash_city},
-    {HASH_SPOOKY, &hash_spooky},
-};
+static struct mem_cache *hash_item_cache;
 
 uint32_t hash_gen32(const char *key, size_t len)
 {
-    return hash_fn_table[HASH_MURMUR].func(key, len);
+    return strhash32(key, len);
 }
 
 static struct hash_item *hash_lookup(struct hash *h, const char *key, uint32_t *hash)
@@ -198,7 +118,7 @@ void hash_destroy(struct hash *h)
             if (h->destory) {
                 h->destory(hi->val);
             }
-            free(hi);
+            mem_cache_free(hash_item_cache, hi);
         }
     }
     free(list);
@@ -237,7 +157,7 @@ int hash_set(struct hash *h, const char *key, void *val)
         return 0;
     }
 
-    hi = (struct hash_item *)calloc(1, sizeof(*hi));
+    hi = mem_cache_zalloc(mem_cache_get(&hash_item_cache, "hash_item", sizeof(*hi)));
     if (!hi) {
         printf("calloc hash_item failed!\n");
         return -1;
@@ -266,7 +186,7 @@ int hash_del(struct hash *h, const char *key)
     if (hi) {
         hlist_del((struct hlist_node *)hi);
         free(hi->key);
-        free(hi);
+        mem_cache_free(hash_item_cache, hi);
         return 0;
     }
 
@@ -288,7 +208,7 @@ void *hash_get_and_del(struct hash *h, const char *key)
         void *val = memdup(hi->val, sizeof(void *));
         hlist_del((struct hlist_node *)hi);
         free(hi->key);
-        free(hi);
+        mem_cache_free(hash_item_cache, hi);
         return val;
     }
     return NULL;
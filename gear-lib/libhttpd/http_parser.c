@@ -0,0 +1,227 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#include "http_parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+static const struct {
+    const char *str;
+    enum http_method method;
+} method_list[] = {
+    {"GET",     HTTP_GET},
+    {"HEAD",    HTTP_HEAD},
+    {"POST",    HTTP_POST},
+    {"PUT",     HTTP_PUT},
+    {"DELETE",  HTTP_DELETE},
+    {"OPTIONS", HTTP_OPTIONS},
+};
+
+void http_parser_reset(struct http_parser *p)
+{
+    memset(p, 0, sizeof(*p));
+}
+
+/* Content-Length / Transfer-Encoding before the request is split */
+static int scan_body_len(const char *buf, size_t len, size_t *body_len)
+{
+    const char *p = buf, *end = buf + len, *eol;
+    char *num_end;
+    unsigned long long v;
+
+    *body_len = 0;
+    while (p < end) {
+        eol = memchr(p, '\n', end - p);
+        if (!eol) {
+            break;
+        }
+        if (eol - p > 15 && !strncasecmp(p, "Content-Length:", 15)) {
+            v = strtoull(p + 15, &num_end, 10);
+            if (num_end == p + 15 || v > HTTP_MAX_BODY_LEN) {
+                return 413;
+            }
+            *body_len = v;
+        } else if (eol - p > 18 && !strncasecmp(p, "Transfer-Encoding:", 18)) {
+            return 501;
+        }
+        p = eol + 1;
+    }
+    return 0;
+}
+
+static char *skip_space(char *p)
+{
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+    return p;
+}
+
+static void trim_right(char *s)
+{
+    size_t n = strlen(s);
+    while (n > 0 && (s[n - 1] == ' ' || s[n - 1] == '\t' || s[n - 1] == '\r')) {
+        s[--n] = '\0';
+    }
+}
+
+/* request line and headers, split in place */
+static int split_request(char *buf, size_t hdr_len, struct http_request *req)
+{
+    char *p = buf, *end = buf + hdr_len, *eol, *sp, *colon;
+    const char *conn;
+    size_t i;
+
+    memset(req, 0, sizeof(*req));
+    eol = memchr(p, '\n', end - p);
+    if (!eol) {
+        return 400;
+    }
+    *eol = '\0';
+    trim_right(p);
+    sp = strchr(p, ' ');
+    if (!sp) {
+        return 400;
+    }
+    *sp = '\0';
+    req->method_str = p;
+    req->method = HTTP_UNKNOWN;
+    for (i = 0; i < sizeof(method_list) / sizeof(method_list[0]); i++) {
+        if (!strcmp(p, method_list[i].str)) {
+            req->method = method_list[i].method;
+            break;
+        }
+    }
+    p = skip_space(sp + 1);
+    sp = strchr(p, ' ');
+    if (!sp || *p != '/') {
+        return 400;
+    }
+    *sp = '\0';
+    req->path = p;
+    sp = skip_space(sp + 1);
+    if (!strcmp(sp, "HTTP/1.1")) {
+        req->version = 11;
+    } else if (!strcmp(sp, "HTTP/1.0")) {
+        req->version = 10;
+    } else {
+        return 505;
+    }
+    p = strchr(p, '?');
+    if (p) {
+        *p = '\0';
+        req->query = p + 1;
+    }
+
+    for (p = eol + 1; p < end; p = eol + 1) {
+        eol = memchr(p, '\n', end - p);
+        if (!eol) {
+            break;
+        }
+        *eol = '\0';
+        trim_right(p);
+        if (*p == '\0') {
+            break;
+        }
+        colon = strchr(p, ':');
+        if (!colon || colon == p) {
+            return 400;
+        }
+        if (req->nheader == HTTP_MAX_HEADERS) {
+            return 431;
+        }
+        *colon = '\0';
+        req->headers[req->nheader].name = p;
+        req->headers[req->nheader].value = skip_space(colon + 1);
+        req->nheader++;
+    }
+
+    conn = http_header_get(req, "Connection");
+    if (req->version == 11) {
+        req->keep_alive = !(conn && !strcasecmp(conn, "close"));
+    } else {
+        req->keep_alive = conn && !strcasecmp(conn, "keep-alive");
+    }
+    return 0;
+}
+
+int http_parse_request(struct http_parser *p, char *buf, size_t len,
+                struct http_request *req, int *status)
+{
+    size_t i, total;
+    int ret;
+
+    if (p->hdr_len == 0) {
+        /* empty lines between pipelined requests are skipped */
+        while (p->scan == 0 && p->skip < len &&
+               (buf[p->skip] == '\r' || buf[p->skip] == '\n')) {
+            p->skip++;
+        }
+    }
+    buf += p->skip;
+    len -= p->skip;
+    if (p->hdr_len == 0) {
+        /* an empty line ends the headers, LF alone is a line end too (RFC 9112 2.2) */
+        for (i = p->scan > 2 ? p->scan - 2 : 0; i + 1 < len; i++) {
+            if (buf[i] != '\n') {
+                continue;
+            }
+            if (buf[i + 1] == '\n') {
+                p->hdr_len = i + 2;
+                break;
+            }
+            if (buf[i + 1] == '\r' && i + 2 < len && buf[i + 2] == '\n') {
+                p->hdr_len = i + 3;
+                break;
+            }
+        }
+        if (p->hdr_len == 0) {
+            p->scan = len;
+            if (len > HTTP_MAX_HEADER_LEN) {
+                *status = 431;
+                return -1;
+            }
+            return 0;
+        }
+        ret = scan_body_len(buf, p->hdr_len, &p->body_len);
+        if (ret) {
+            *status = ret;
+            return -1;
+        }
+    }
+    total = p->hdr_len + p->body_len;
+    if (len < total) {
+        return 0;
+    }
+    ret = split_request(buf, p->hdr_len, req);
+    if (ret) {
+        *status = ret;
+        return -1;
+    }
+    req->body = p->body_len ? buf + p->hdr_len : NULL;
+    req->body_len = p->body_len;
+    total += p->skip;
+    http_parser_reset(p);
+    return (int)total;
+}
@@ -0,0 +1,57 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#ifndef HTTP_PARSER_H
+#define HTTP_PARSER_H
+
+#include "libhttpd.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HTTP_MAX_HEADER_LEN     (16 * 1024)
+#define HTTP_MAX_BODY_LEN       (1024 * 1024)
+
+/*
+ * incremental request parser: the header end is searched only in bytes
+ * not seen before, the request is split in place once it's complete.
+ */
+struct http_parser {
+    size_t skip;                /* blank lines before the request */
+    size_t scan;                /* bytes already searched for the header end */
+    size_t hdr_len;             /* 0 until the header end is found */
+    size_t body_len;
+};
+
+void http_parser_reset(struct http_parser *p);
+
+/*
+ * return the length of the complete request parsed into req, 0 when more
+ * data is needed, -1 on error with the http status to reply in *status
+ */
+int http_parse_request(struct http_parser *p, char *buf, size_t len,
+                struct http_request *req, int *status);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,875 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#define _GNU_SOURCE
+#include "libhttpd.h"
+#include "httpd_conn.h"
+#include <libatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#define MJPEG_BOUNDARY      "gearframe"
+#define MJPEG_PENDING_MAX   (8)     /* frames waiting for the loop */
+#define HLS_PART_HINT_SEGS  (3)     /* segments listed with their parts */
+
+struct stream_item {
+    struct stream_item *next;
+    struct http_buf *buf;
+};
+
+struct http_stream {
+    struct http_stream *next;
+    struct httpd *httpd;
+    char *path;
+    char *content_type;
+    enum http_stream_type type;
+    size_t max_queue;
+    /* loop thread */
+    struct http_conn **clients;
+    int nclient;
+    int cap;
+    struct http_buf *last;          /* sent first to MJPEG late joiners */
+    /* producers, under httpd lock */
+    struct stream_item *pend_head;
+    struct stream_item *pend_tail;
+    int npend;
+};
+
+struct hls_part {
+    struct http_buf *buf;
+    int duration_ms;
+    int independent;
+};
+
+struct hls_seg {
+    int64_t msn;
+    struct hls_part *parts;
+    int nparts;
+    int cap;
+    int duration_ms;
+    struct http_buf *whole;         /* all parts, once the segment is closed */
+};
+
+struct hls_item {
+    struct hls_item *next;
+    struct http_buf *buf;
+    int duration_ms;
+    int independent;
+    int segment_end;
+};
+
+enum hls_wait_type {
+    HLS_WAIT_PLAYLIST = 0,
+    HLS_WAIT_PART,
+    HLS_WAIT_SEGMENT,
+};
+
+struct hls_wait {
+    struct http_conn *conn;
+    enum hls_wait_type type;
+    int64_t msn;
+    int part;
+};
+
+struct http_hls {
+    struct http_hls *next;
+    struct httpd *httpd;
+    char *prefix;
+    int target_ms;
+    int part_ms;
+    /* loop thread: ring of window closed segments plus the open one */
+    struct hls_seg *segs;
+    int nseg;
+    int64_t first_msn;
+    int64_t cur_msn;
+    struct http_buf *init;
+    struct http_buf *playlist;      /* rendered on demand, shared by all */
+    struct hls_wait *waits;
+    int nwait;
+    int wait_cap;
+    /* producers, under httpd lock */
+    struct http_buf *pend_init;
+    struct hls_item *pend_head;
+    struct hls_item *pend_tail;
+};
+
+/******************************************************************************
+ * MJPEG and chunked streams
+ ******************************************************************************/
+
+static void stream_client_del(struct http_conn *c)
+{
+    struct http_stream *s = (struct http_stream *)c->owner;
+    int i;
+
+    for (i = 0; i < s->nclient; i++) {
+        if (s->clients[i] == c) {
+            s->clients[i] = s->clients[--s->nclient];
+            c->httpd->stat.stream_clients--;
+            break;
+        }
+    }
+    c->owner = NULL;
+}
+
+static int stream_handler(struct http_conn *c, const struct http_request *req, void *arg)
+{
+    struct http_stream *s = (struct http_stream *)arg;
+    struct http_conn **clients;
+    struct http_buf *b;
+    char ctype[128];
+
+    if (req->method != HTTP_GET) {
+        return http_reply(c, 405, "text/plain", "method not allowed\n", 19);
+    }
+    if (s->type == HTTP_STREAM_CHUNKED && req->version != 11) {
+        return http_reply(c, 505, "text/plain", "chunked stream needs HTTP/1.1\n", 30);
+    }
+    if (s->nclient == s->cap) {
+        clients = (struct http_conn **)realloc(s->clients,
+                        (s->cap ? s->cap * 2 : 16) * sizeof(struct http_conn *));
+        if (!clients) {
+            return -1;
+        }
+        s->clients = clients;
+        s->cap = s->cap ? s->cap * 2 : 16;
+    }
+    if (s->type == HTTP_STREAM_MJPEG) {
+        snprintf(ctype, sizeof(ctype), "multipart/x-mixed-replace; boundary=%s", MJPEG_BOUNDARY);
+        b = http_header_build(c, 200, ctype, -1,
+                        "Cache-Control: no-cache\r\n", 0, 0);
+    } else {
+        b = http_header_build(c, 200, s->content_type, -1,
+                        "Cache-Control: no-cache\r\nTransfer-Encoding: chunked\r\n", 1, 0);
+    }
+    if (!b || http_conn_queue(c, b) < 0) {
+        return -1;
+    }
+    c->streaming = 1;
+    c->owner = s;
+    c->on_close = stream_client_del;
+    s->clients[s->nclient++] = c;
+    c->httpd->stat.stream_clients++;
+    if (s->last) {
+        http_conn_queue(c, http_buf_ref(s->last));
+    }
+    return 0;
+}
+
+struct http_stream *httpd_stream_create(struct httpd *h, const char *path,
+                enum http_stream_type type, const char *content_type, size_t max_queue)
+{
+    struct http_stream *s;
+
+    if (!h || !path) {
+        printf("invalid paraments!\n");
+        return NULL;
+    }
+    s = (struct http_stream *)calloc(1, sizeof(struct http_stream));
+    if (!s) {
+        printf("malloc http_stream failed!\n");
+        return NULL;
+    }
+    s->httpd = h;
+    s->type = type;
+    s->max_queue = max_queue ? max_queue : 1024 * 1024;
+    s->path = strdup(path);
+    s->content_type = strdup(content_type ? content_type : "application/octet-stream");
+    if (!s->path || !s->content_type || httpd_route(h, path, stream_handler, s) < 0) {
+        free(s->path);
+        free(s->content_type);
+        free(s);
+        return NULL;
+    }
+    s->next = h->streams;
+    h->streams = s;
+    return s;
+}
+
+/* framed copy of the data, the only copy made whatever the client count */
+static struct http_buf *stream_frame(struct http_stream *s, const void *data, size_t len)
+{
+    struct http_buf *b;
+    char head[128];
+    int n;
+
+    if (s->type == HTTP_STREAM_MJPEG) {
+        n = snprintf(head, sizeof(head),
+                     "--%s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n\r\n",
+                     MJPEG_BOUNDARY, s->content_type, len);
+    } else {
+        n = snprintf(head, sizeof(head), "%zx\r\n", len);
+    }
+    b = http_buf_alloc(n + len + 2);
+    if (!b) {
+        return NULL;
+    }
+    memcpy(b->data, head, n);
+    memcpy(b->data + n, data, len);
+    memcpy(b->data + n + len, "\r\n", 2);
+    return b;
+}
+
+int http_stream_push(struct http_stream *s, const void *data, size_t len)
+{
+    struct stream_item *it, *old = NULL;
+    struct httpd *h;
+
+    if (!s || !data || !len) {
+        return -1;
+    }
+    h = s->httpd;
+    it = (struct stream_item *)calloc(1, sizeof(struct stream_item));
+    if (!it) {
+        return -1;
+    }
+    it->buf = stream_frame(s, data, len);
+    if (!it->buf) {
+        free(it);
+        return -1;
+    }
+    pthread_mutex_lock(&h->lock);
+    if (s->pend_tail) {
+        s->pend_tail->next = it;
+    } else {
+        s->pend_head = it;
+    }
+    s->pend_tail = it;
+    s->npend++;
+    if (s->type == HTTP_STREAM_MJPEG && s->npend > MJPEG_PENDING_MAX) {
+        /* the loop is behind, nobody would see the oldest frame anyway */
+        old = s->pend_head;
+        s->pend_head = old->next;
+        s->npend--;
+        h->stat.frames_dropped++;
+    }
+    pthread_mutex_unlock(&h->lock);
+    if (old) {
+        http_buf_unref(old->buf);
+        free(old);
+    }
+    httpd_wake(h);
+    return 0;
+}
+
+int http_stream_clients(struct http_stream *s)
+{
+    return s ? atomic_load_ex(&s->nclient, ATOMIC_RELAXED) : -1;
+}
+
+static void stream_fanout(struct http_stream *s, struct http_buf *b)
+{
+    struct http_conn *c;
+    int i;
+
+    /* backwards, a client closed here is replaced by one already served */
+    for (i = s->nclient - 1; i >= 0; i--) {
+        c = s->clients[i];
+        if (c->out_bytes + b->len > s->max_queue) {
+            if (s->type == HTTP_STREAM_MJPEG) {
+                /* whole frames are skipped, the multipart stream stays valid */
+                s->httpd->stat.frames_dropped++;
+                continue;
+            }
+            http_conn_close(c);
+            continue;
+        }
+        http_conn_queue(c, http_buf_ref(b));
+        http_conn_flush(c);
+    }
+    if (s->type == HTTP_STREAM_MJPEG) {
+        http_buf_unref(s->last);
+        s->last = http_buf_ref(b);
+    }
+}
+
+static void stream_wake(struct http_stream *s)
+{
+    struct httpd *h = s->httpd;
+    struct stream_item *it, *next;
+
+    pthread_mutex_lock(&h->lock);
+    it = s->pend_head;
+    s->pend_head = s->pend_tail = NULL;
+    s->npend = 0;
+    pthread_mutex_unlock(&h->lock);
+    for (; it; it = next) {
+        next = it->next;
+        stream_fanout(s, it->buf);
+        http_buf_unref(it->buf);
+        free(it);
+    }
+}
+
+static void stream_free(struct http_stream *s)
+{
+    struct stream_item *it, *next;
+
+    for (it = s->pend_head; it; it = next) {
+        next = it->next;
+        http_buf_unref(it->buf);
+        free(it);
+    }
+    http_buf_unref(s->last);
+    free(s->clients);
+    free(s->path);
+    free(s->content_type);
+    free(s);
+}
+
+/******************************************************************************
+ * LL-HLS
+ ******************************************************************************/
+
+static struct hls_seg *hls_seg(struct http_hls *hls, int64_t msn)
+{
+    if (msn < hls->first_msn || msn > hls->cur_msn) {
+        return NULL;
+    }
+    return &hls->segs[msn % hls->nseg];
+}
+
+static void hls_seg_clear(struct hls_seg *seg)
+{
+    int i;
+    for (i = 0; i < seg->nparts; i++) {
+        http_buf_unref(seg->parts[i].buf);
+    }
+    http_buf_unref(seg->whole);
+    seg->whole = NULL;
+    seg->nparts = 0;
+    seg->duration_ms = 0;
+}
+
+/* concatenation of the parts, served for seg<msn>.m4s */
+static struct http_buf *hls_seg_join(struct hls_seg *seg)
+{
+    struct http_buf *b;
+    size_t len = 0, off = 0;
+    int i;
+
+    for (i = 0; i < seg->nparts; i++) {
+        len += seg->parts[i].buf->len;
+    }
+    b = http_buf_alloc(len);
+    if (!b) {
+        return NULL;
+    }
+    for (i = 0; i < seg->nparts; i++) {
+        memcpy(b->data + off, seg->parts[i].buf->data, seg->parts[i].buf->len);
+        off += seg->parts[i].buf->len;
+    }
+    return b;
+}
+
+static int hls_add_part(struct http_hls *hls, struct hls_item *it)
+{
+    struct hls_seg *seg = hls_seg(hls, hls->cur_msn);
+    struct hls_part *parts;
+
+    if (seg->nparts == seg->cap) {
+        parts = (struct hls_part *)realloc(seg->parts,
+                        (seg->cap ? seg->cap * 2 : 8) * sizeof(struct hls_part));
+        if (!parts) {
+            return -1;
+        }
+        seg->parts = parts;
+        seg->cap = seg->cap ? seg->cap * 2 : 8;
+    }
+    seg->parts[seg->nparts].buf = it->buf;
+    seg->parts[seg->nparts].duration_ms = it->duration_ms;
+    seg->parts[seg->nparts].independent = it->independent;
+    seg->nparts++;
+    seg->duration_ms += it->duration_ms;
+    it->buf = NULL;
+    if (!it->segment_end) {
+        return 0;
+    }
+    seg->whole = hls_seg_join(seg);
+    hls->cur_msn++;
+    if (hls->cur_msn - hls->first_msn >= hls->nseg) {
+        hls->first_msn++;
+    }
+    seg = &hls->segs[hls->cur_msn % hls->nseg];
+    hls_seg_clear(seg);
+    seg->msn = hls->cur_msn;
+    return 0;
+}
+
+static struct http_buf *hls_playlist(struct http_hls *hls)
+{
+    struct hls_seg *seg;
+    struct http_buf *b;
+    size_t cap, n;
+    int64_t msn;
+    int i, nparts = 0;
+
+    if (hls->playlist) {
+        return hls->playlist;
+    }
+    for (msn = hls->first_msn; msn <= hls->cur_msn; msn++) {
+        nparts += hls_seg(hls, msn)->nparts + 1;
+    }
+    cap = 512 + nparts * 96;
+    b = http_buf_alloc(cap);
+    if (!b) {
+        return NULL;
+    }
+    n = snprintf((char *)b->data, cap,
+                 "#EXTM3U\n"
+                 "#EXT-X-VERSION:9\n"
+                 "#EXT-X-TARGETDURATION:%d\n"
+                 "#EXT-X-PART-INF:PART-TARGET=%.3f\n"
+                 "#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES,PART-HOLD-BACK=%.3f\n"
+                 "#EXT-X-MEDIA-SEQUENCE:%" PRId64 "\n"
+                 "#EXT-X-MAP:URI=\"init.mp4\"\n",
+                 (hls->target_ms + 999) / 1000, hls->part_ms / 1000.0,
+                 hls->part_ms * 3 / 1000.0, hls->first_msn);
+    for (msn = hls->first_msn; msn <= hls->cur_msn; msn++) {
+        seg = hls_seg(hls, msn);
+        if (hls->cur_msn - msn < HLS_PART_HINT_SEGS) {
+            for (i = 0; i < seg->nparts; i++) {
+                n += snprintf((char *)b->data + n, cap - n,
+                              "#EXT-X-PART:DURATION=%.3f,URI=\"seg%" PRId64 ".%d.m4s\"%s\n",
+                              seg->parts[i].duration_ms / 1000.0, msn, i,
+                              seg->parts[i].independent ? ",INDEPENDENT=YES" : "");
+            }
+        }
+        if (msn < hls->cur_msn) {
+            n += snprintf((char *)b->data + n, cap - n, "#EXTINF:%.3f,\nseg%" PRId64 ".m4s\n",
+                          seg->duration_ms / 1000.0, msn);
+        }
+    }
+    n += snprintf((char *)b->data + n, cap - n,
+                  "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"seg%" PRId64 ".%d.m4s\"\n",
+                  hls->cur_msn, hls_seg(hls, hls->cur_msn)->nparts);
+    b->len = n;
+    hls->playlist = b;
+    return b;
+}
+
+/* 1 the wait can be answered, 0 not yet, -1 never */
+static int hls_ready(struct http_hls *hls, struct hls_wait *w)
+{
+    struct hls_seg *cur = hls_seg(hls, hls->cur_msn);
+
+    if (w->msn < hls->first_msn && w->type != HLS_WAIT_PLAYLIST) {
+        return -1;
+    }
+    switch (w->type) {
+    case HLS_WAIT_PLAYLIST:
+        if (hls->cur_msn == 0 && cur->nparts == 0) {
+            return 0;
+        }
+        if (w->msn < 0) {
+            return 1;
+        }
+        if (w->part < 0) {
+            return w->msn < hls->cur_msn;
+        }
+        return w->msn < hls->cur_msn || (w->msn == hls->cur_msn && w->part < cur->nparts);
+    case HLS_WAIT_PART:
+        if (w->msn < hls->cur_msn) {
+            return w->part < hls_seg(hls, w->msn)->nparts ? 1 : -1;
+        }
+        if (w->msn == hls->cur_msn) {
+            return w->part < cur->nparts ? 1 : (w->part == cur->nparts ? 0 : -1);
+        }
+        return -1;
+    case HLS_WAIT_SEGMENT:
+        return w->msn < hls->cur_msn ? 1 : (w->msn == hls->cur_msn ? 0 : -1);
+    }
+    return -1;
+}
+
+static void hls_answer(struct http_hls *hls, struct hls_wait *w, int ready)
+{
+    struct http_conn *c = w->conn;
+    struct http_buf *b;
+    struct hls_seg *seg;
+
+    if (ready < 0) {
+        http_reply(c, 404, "text/plain", "not found\n", 10);
+        return;
+    }
+    switch (w->type) {
+    case HLS_WAIT_PLAYLIST:
+        b = hls_playlist(hls);
+        if (!b) {
+            http_reply(c, 500, "text/plain", "internal error\n", 15);
+            return;
+        }
+        http_reply_buf(c, 200, "application/vnd.apple.mpegurl", b);
+        break;
+    case HLS_WAIT_PART:
+        seg = hls_seg(hls, w->msn);
+        http_reply_buf(c, 200, "video/mp4", seg->parts[w->part].buf);
+        break;
+    case HLS_WAIT_SEGMENT:
+        seg = hls_seg(hls, w->msn);
+        if (!seg->whole) {
+            http_reply(c, 500, "text/plain", "internal error\n", 15);
+            return;
+        }
+        http_reply_buf(c, 200, "video/mp4", seg->whole);
+        break;
+    }
+}
+
+static void hls_wait_del(struct http_conn *c)
+{
+    struct http_hls *hls = (struct http_hls *)c->owner;
+    int i;
+
+    for (i = 0; i < hls->nwait; i++) {
+        if (hls->waits[i].conn == c) {
+            hls->waits[i] = hls->waits[--hls->nwait];
+            break;
+        }
+    }
+    c->owner = NULL;
+}
+
+static int hls_park(struct http_hls *hls, struct http_conn *c, struct hls_wait *w)
+{
+    struct hls_wait *waits;
+
+    if (hls->nwait == hls->wait_cap) {
+        waits = (struct hls_wait *)realloc(hls->waits,
+                        (hls->wait_cap ? hls->wait_cap * 2 : 16) * sizeof(struct hls_wait));
+        if (!waits) {
+            return -1;
+        }
+        hls->waits = waits;
+        hls->wait_cap = hls->wait_cap ? hls->wait_cap * 2 : 16;
+    }
+    hls->waits[hls->nwait++] = *w;
+    c->parked = 1;
+    c->park_time = httpd_now_ms();
+    c->owner = hls;
+    c->on_close = hls_wait_del;
+    return 0;
+}
+
+/*
+ * answer the waits that are ready, or with 503 once timed out. they are
+ * taken off the list first: answering resumes the pipeline of the
+ * connection, which may park it again.
+ */
+static void hls_wake_waits(struct http_hls *hls, uint64_t now)
+{
+    struct {
+        struct hls_wait w;
+        int ready;
+    } *done;
+    struct http_conn *c;
+    uint64_t timeout = (uint64_t)hls->target_ms * 3;
+    int i, n = 0, ready;
+
+    if (hls->nwait == 0) {
+        return;
+    }
+    done = malloc(hls->nwait * sizeof(*done));
+    if (!done) {
+        return;
+    }
+    for (i = hls->nwait - 1; i >= 0; i--) {
+        ready = hls_ready(hls, &hls->waits[i]);
+        if (ready == 0 && (!now || now - hls->waits[i].conn->park_time < timeout)) {
+            continue;
+        }
+        done[n].w = hls->waits[i];
+        done[n].ready = ready;
+        n++;
+        hls->waits[i] = hls->waits[--hls->nwait];
+    }
+    for (i = 0; i < n; i++) {
+        c = done[i].w.conn;
+        c->parked = 0;
+        c->owner = NULL;
+        c->on_close = NULL;
+        if (done[i].ready == 0) {
+            http_reply(c, 503, "text/plain", "timeout\n", 8);
+        } else {
+            hls_answer(hls, &done[i].w, done[i].ready);
+        }
+        http_conn_process(c);
+    }
+    free(done);
+}
+
+static int query_int(const char *query, const char *key, int64_t *val)
+{
+    size_t len = strlen(key);
+    const char *p = query;
+    char *end;
+
+    while (p && *p) {
+        if (!strncmp(p, key, len) && p[len] == '=') {
+            *val = strtoll(p + len + 1, &end, 10);
+            return (end == p + len + 1 || *val < 0) ? -1 : 1;
+        }
+        p = strchr(p, '&');
+        if (p) {
+            p++;
+        }
+    }
+    return 0;
+}
+
+static int hls_handler(struct http_conn *c, const struct http_request *req, void *arg)
+{
+    struct http_hls *hls = (struct http_hls *)arg;
+    const char *name = req->path + strlen(hls->prefix);
+    struct hls_wait w;
+    long long msn;
+    int64_t qpart;
+    int part, n = 0, ret_msn, ret_part, ready;
+
+    if (req->method != HTTP_GET && req->method != HTTP_HEAD) {
+        return http_reply(c, 405, "text/plain", "method not allowed\n", 19);
+    }
+    while (*name == '/') {
+        name++;
+    }
+    memset(&w, 0, sizeof(w));
+    w.conn = c;
+    w.msn = -1;
+    w.part = -1;
+    if (!strcmp(name, "init.mp4")) {
+        if (!hls->init) {
+            return http_reply(c, 404, "text/plain", "not found\n", 10);
+        }
+        return http_reply_buf(c, 200, "video/mp4", hls->init);
+    } else if (strlen(name) > 5 && !strcmp(name + strlen(name) - 5, ".m3u8")) {
+        w.type = HLS_WAIT_PLAYLIST;
+        ret_msn = query_int(req->query, "_HLS_msn", &w.msn);
+        ret_part = query_int(req->query, "_HLS_part", &qpart);
+        if (ret_msn < 0 || ret_part < 0 || (ret_part && !ret_msn) ||
+            (ret_msn && w.msn > hls->cur_msn + 1)) {
+            return http_reply(c, 400, "text/plain", "bad request\n", 12);
+        }
+        if (!ret_msn) {
+            w.msn = -1;
+        }
+        w.part = ret_part ? (int)qpart : -1;
+    } else if (sscanf(name, "seg%lld.%d.m4s%n", &msn, &part, &n) == 2 &&
+               name[n] == '\0' && msn >= 0 && part >= 0) {
+        w.type = HLS_WAIT_PART;
+        w.msn = msn;
+        w.part = part;
+    } else if (sscanf(name, "seg%lld.m4s%n", &msn, &n) == 1 && name[n] == '\0' && msn >= 0) {
+        w.type = HLS_WAIT_SEGMENT;
+        w.msn = msn;
+    } else {
+        return http_reply(c, 404, "text/plain", "not found\n", 10);
+    }
+    ready = hls_ready(hls, &w);
+    if (ready != 0) {
+        hls_answer(hls, &w, ready);
+        return 0;
+    }
+    /* blocking reload or preload hint, answered by the push */
+    return hls_park(hls, c, &w);
+}
+
+struct http_hls *httpd_hls_create(struct httpd *h, const char *prefix,
+                int target_ms, int part_ms, int window)
+{
+    struct http_hls *hls;
+
+    if (!h || !prefix || target_ms <= 0 || part_ms <= 0 || window <= 0) {
+        printf("invalid paraments!\n");
+        return NULL;
+    }
+    hls = (struct http_hls *)calloc(1, sizeof(struct http_hls));
+    if (!hls) {
+        printf("malloc http_hls failed!\n");
+        return NULL;
+    }
+    hls->httpd = h;
+    hls->target_ms = target_ms;
+    hls->part_ms = part_ms;
+    hls->nseg = window + 1;
+    hls->segs = (struct hls_seg *)calloc(hls->nseg, sizeof(struct hls_seg));
+    hls->prefix = strdup(prefix);
+    if (!hls->segs || !hls->prefix || httpd_route(h, prefix, hls_handler, hls) < 0) {
+        free(hls->segs);
+        free(hls->prefix);
+        free(hls);
+        return NULL;
+    }
+    hls->next = h->hls;
+    h->hls = hls;
+    return hls;
+}
+
+int http_hls_set_init(struct http_hls *hls, const void *data, size_t len)
+{
+    struct http_buf *b, *old;
+
+    if (!hls || !data || !len) {
+        return -1;
+    }
+    b = http_buf_create(data, len);
+    if (!b) {
+        return -1;
+    }
+    pthread_mutex_lock(&hls->httpd->lock);
+    old = hls->pend_init;
+    hls->pend_init = b;
+    pthread_mutex_unlock(&hls->httpd->lock);
+    http_buf_unref(old);
+    httpd_wake(hls->httpd);
+    return 0;
+}
+
+int http_hls_push_part(struct http_hls *hls, const void *data, size_t len,
+                int duration_ms, int independent, int segment_end)
+{
+    struct hls_item *it;
+
+    if (!hls || !data || !len) {
+        return -1;
+    }
+    it = (struct hls_item *)calloc(1, sizeof(struct hls_item));
+    if (!it) {
+        return -1;
+    }
+    it->buf = http_buf_create(data, len);
+    if (!it->buf) {
+        free(it);
+        return -1;
+    }
+    it->duration_ms = duration_ms;
+    it->independent = independent;
+    it->segment_end = segment_end;
+    pthread_mutex_lock(&hls->httpd->lock);
+    if (hls->pend_tail) {
+        hls->pend_tail->next = it;
+    } else {
+        hls->pend_head = it;
+    }
+    hls->pend_tail = it;
+    pthread_mutex_unlock(&hls->httpd->lock);
+    httpd_wake(hls->httpd);
+    return 0;
+}
+
+static void hls_wake(struct http_hls *hls)
+{
+    struct hls_item *it, *next;
+    struct http_buf *init;
+
+    pthread_mutex_lock(&hls->httpd->lock);
+    init = hls->pend_init;
+    hls->pend_init = NULL;
+    it = hls->pend_head;
+    hls->pend_head = hls->pend_tail = NULL;
+    pthread_mutex_unlock(&hls->httpd->lock);
+    if (init) {
+        http_buf_unref(hls->init);
+        hls->init = init;
+    }
+    if (!it) {
+        return;
+    }
+    for (; it; it = next) {
+        next = it->next;
+        if (hls_add_part(hls, it) < 0) {
+            printf("hls_add_part failed!\n");
+        }
+        http_buf_unref(it->buf);
+        free(it);
+    }
+    http_buf_unref(hls->playlist);
+    hls->playlist = NULL;
+    hls_wake_waits(hls, 0);
+}
+
+static void hls_free(struct http_hls *hls)
+{
+    struct hls_item *it, *next;
+    int i;
+
+    for (it = hls->pend_head; it; it = next) {
+        next = it->next;
+        http_buf_unref(it->buf);
+        free(it);
+    }
+    for (i = 0; i < hls->nseg; i++) {
+        hls_seg_clear(&hls->segs[i]);
+        free(hls->segs[i].parts);
+    }
+    http_buf_unref(hls->pend_init);
+    http_buf_unref(hls->init);
+    http_buf_unref(hls->playlist);
+    free(hls->segs);
+    free(hls->waits);
+    free(hls->prefix);
+    free(hls);
+}
+
+/******************************************************************************
+ * loop thread hooks
+ ******************************************************************************/
+
+void http_stream_wake(struct httpd *h)
+{
+    struct http_stream *s;
+    struct http_hls *hls;
+
+    for (s = h->streams; s; s = s->next) {
+        stream_wake(s);
+    }
+    for (hls = h->hls; hls; hls = hls->next) {
+        hls_wake(hls);
+    }
+}
+
+void http_stream_tick(struct httpd *h, uint64_t now)
+{
+    struct http_hls *hls;
+
+    /* pushes made before httpd_dispatch had nobody to wake */
+    http_stream_wake(h);
+    for (hls = h->hls; hls; hls = hls->next) {
+        hls_wake_waits(hls, now);
+    }
+}
+
+/* all connections are closed already */
+void http_stream_free_all(struct httpd *h)
+{
+    struct http_stream *s;
+    struct http_hls *hls;
+
+    while ((s = h->streams) != NULL) {
+        h->streams = s->next;
+        stream_free(s);
+    }
+    while ((hls = h->hls) != NULL) {
+        h->hls = hls->next;
+        hls_free(hls);
+    }
+}
@@ -0,0 +1,136 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#ifndef HTTPD_CONN_H
+#define HTTPD_CONN_H
+
+#include "libhttpd.h"
+#include "http_parser.h"
+#include <libgevent.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* internal to libhttpd, shared by the server and the live streams */
+
+#define HTTP_RECV_BUF       (4 * 1024)
+#define HTTP_OUT_HIGH       (256 * 1024)    /* stop reading requests above */
+#define HTTP_OUT_IOV        (16)
+
+enum http_out_type {
+    HTTP_OUT_BUF = 0,
+    HTTP_OUT_FILE,
+};
+
+struct http_out {
+    struct http_out *next;
+    enum http_out_type type;
+    struct http_buf *buf;
+    int fd;
+    uint64_t off;
+    uint64_t len;
+};
+
+struct http_conn {
+    struct http_conn *next;
+    struct http_conn *prev;
+    struct httpd *httpd;
+    int fd;
+    struct gevent *ev;
+    char *in;
+    size_t in_len;
+    size_t in_cap;
+    struct http_parser parser;
+    struct http_out *out_head;
+    struct http_out *out_tail;
+    size_t out_bytes;           /* memory queued, files not counted */
+    int pipe[2];                /* splice fallback of sendfile */
+    size_t pipe_bytes;
+    uint64_t last_active;
+    uint64_t zombie_tick;
+    int closed;
+    int close_after;            /* close once the queue is written */
+    int read_eof;
+    int read_blocked;           /* stopped reading on a full queue */
+    int busy;                   /* in http_conn_process */
+    int parked;                 /* response deferred, e.g. hls blocking reload */
+    int streaming;
+    int req_version;
+    int req_keep_alive;
+    int req_head;
+    uint64_t park_time;
+    /* the stream or hls the connection waits on */
+    void *owner;
+    void (*on_close)(struct http_conn *c);
+};
+
+struct http_route {
+    char *prefix;
+    size_t len;
+    http_handler cb;
+    void *arg;
+    char *root;                 /* httpd_serve_dir */
+};
+
+struct httpd {
+    int listen_fd;
+    char host[64];
+    uint16_t port;
+    struct gevent_base *evbase;
+    struct gevent *ev_listen;
+    struct gevent *ev_wake;
+    struct gevent *ev_timer;
+    int wake_fd;
+    struct http_route *routes;
+    int nroute;
+    struct http_conn *conns;
+    struct http_conn *zombies;
+    uint64_t tick;
+    int idle_timeout;
+    char date[40];              /* Date header, updated every tick */
+    pthread_mutex_t lock;       /* producers of streams and hls */
+    struct http_stream *streams;
+    struct http_hls *hls;
+    struct httpd_stat stat;
+};
+
+uint64_t httpd_now_ms(void);
+void httpd_wake(struct httpd *h);
+void http_conn_close(struct http_conn *c);
+int http_conn_queue(struct http_conn *c, struct http_buf *b);
+int http_conn_flush(struct http_conn *c);
+void http_conn_process(struct http_conn *c);
+struct http_buf *http_buf_alloc(size_t len);
+struct http_buf *http_header_build(struct http_conn *c, int status,
+                const char *content_type, int64_t content_len, const char *extra,
+                int keep_alive, size_t reserve);
+
+/* http_stream.c */
+void http_stream_wake(struct httpd *h);
+void http_stream_tick(struct httpd *h, uint64_t now);
+void http_stream_free_all(struct httpd *h);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
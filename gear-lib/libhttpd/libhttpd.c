@@ -0,0 +1,1103 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#define _GNU_SOURCE
+#include "libhttpd.h"
+#include "httpd_conn.h"
+#include <libsock.h>
+#include <libatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define HTTP_SENDFILE_MAX   (1024 * 1024)
+#define HTTP_SPLICE_MAX     (64 * 1024)
+
+static const struct {
+    int code;
+    const char *text;
+} status_list[] = {
+    {200, "OK"},
+    {206, "Partial Content"},
+    {304, "Not Modified"},
+    {400, "Bad Request"},
+    {403, "Forbidden"},
+    {404, "Not Found"},
+    {405, "Method Not Allowed"},
+    {413, "Payload Too Large"},
+    {416, "Range Not Satisfiable"},
+    {431, "Request Header Fields Too Large"},
+    {500, "Internal Server Error"},
+    {501, "Not Implemented"},
+    {503, "Service Unavailable"},
+    {505, "HTTP Version Not Supported"},
+};
+
+static const struct {
+    const char *ext;
+    const char *type;
+} mime_list[] = {
+    {"html", "text/html"},
+    {"htm",  "text/html"},
+    {"txt",  "text/plain"},
+    {"json", "application/json"},
+    {"js",   "application/javascript"},
+    {"css",  "text/css"},
+    {"jpg",  "image/jpeg"},
+    {"jpeg", "image/jpeg"},
+    {"png",  "image/png"},
+    {"mp4",  "video/mp4"},
+    {"m4s",  "video/iso.segment"},
+    {"ts",   "video/mp2t"},
+    {"flv",  "video/x-flv"},
+    {"mkv",  "video/x-matroska"},
+    {"h264", "video/h264"},
+    {"264",  "video/h264"},
+    {"aac",  "audio/aac"},
+    {"m3u8", "application/vnd.apple.mpegurl"},
+};
+
+static void conn_recv(struct http_conn *c);
+
+uint64_t httpd_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static const char *status_text(int code)
+{
+    size_t i;
+    for (i = 0; i < sizeof(status_list) / sizeof(status_list[0]); i++) {
+        if (status_list[i].code == code) {
+            return status_list[i].text;
+        }
+    }
+    return "Unknown";
+}
+
+static const char *mime_type(const char *path)
+{
+    const char *ext = strrchr(path, '.');
+    size_t i;
+    if (ext && !strchr(ext, '/')) {
+        for (i = 0; i < sizeof(mime_list) / sizeof(mime_list[0]); i++) {
+            if (!strcasecmp(ext + 1, mime_list[i].ext)) {
+                return mime_list[i].type;
+            }
+        }
+    }
+    return "application/octet-stream";
+}
+
+static void http_date(char *buf, size_t size, time_t t)
+{
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    strftime(buf, size, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+struct http_buf *http_buf_alloc(size_t len)
+{
+    struct http_buf *b = (struct http_buf *)malloc(sizeof(struct http_buf) + len);
+    if (!b) {
+        printf("malloc http_buf failed!\n");
+        return NULL;
+    }
+    b->ref = 1;
+    b->len = len;
+    b->data = (uint8_t *)(b + 1);
+    return b;
+}
+
+struct http_buf *http_buf_create(const void *data, size_t len)
+{
+    struct http_buf *b = http_buf_alloc(len);
+    if (b && data) {
+        memcpy(b->data, data, len);
+    }
+    return b;
+}
+
+struct http_buf *http_buf_ref(struct http_buf *b)
+{
+    if (b) {
+        atomic_fetch_add_ex(&b->ref, 1, ATOMIC_RELAXED);
+    }
+    return b;
+}
+
+void http_buf_unref(struct http_buf *b)
+{
+    if (b && atomic_fetch_sub_ex(&b->ref, 1, ATOMIC_ACQ_REL) == 1) {
+        free(b);
+    }
+}
+
+const char *http_header_get(const struct http_request *req, const char *name)
+{
+    int i;
+    for (i = 0; i < req->nheader; i++) {
+        if (!strcasecmp(req->headers[i].name, name)) {
+            return req->headers[i].value;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * status line and headers, reserve bytes are left after them so a small
+ * body goes out in the same buffer
+ */
+struct http_buf *http_header_build(struct http_conn *c, int status,
+                const char *content_type, int64_t content_len, const char *extra,
+                int keep_alive, size_t reserve)
+{
+    struct http_buf *b;
+    size_t cap = 192 + (content_type ? strlen(content_type) : 0) + (extra ? strlen(extra) : 0);
+    int n;
+
+    b = http_buf_alloc(cap + reserve);
+    if (!b) {
+        return NULL;
+    }
+    n = snprintf((char *)b->data, cap, "HTTP/1.1 %d %s\r\nServer: gear-lib\r\nDate: %s\r\n",
+                 status, status_text(status), c->httpd->date);
+    if (content_type) {
+        n += snprintf((char *)b->data + n, cap - n, "Content-Type: %s\r\n", content_type);
+    }
+    if (content_len >= 0) {
+        n += snprintf((char *)b->data + n, cap - n, "Content-Length: %lld\r\n", (long long)content_len);
+    }
+    if (!keep_alive) {
+        n += snprintf((char *)b->data + n, cap - n, "Connection: close\r\n");
+    } else if (c->req_version == 10) {
+        n += snprintf((char *)b->data + n, cap - n, "Connection: keep-alive\r\n");
+    }
+    n += snprintf((char *)b->data + n, cap - n, "%s\r\n", extra ? extra : "");
+    b->len = n;
+    return b;
+}
+
+static struct http_out *out_add(struct http_conn *c, enum http_out_type type)
+{
+    struct http_out *o = (struct http_out *)calloc(1, sizeof(struct http_out));
+    if (!o) {
+        printf("malloc http_out failed!\n");
+        return NULL;
+    }
+    o->type = type;
+    o->fd = -1;
+    if (c->out_tail) {
+        c->out_tail->next = o;
+    } else {
+        c->out_head = o;
+    }
+    c->out_tail = o;
+    return o;
+}
+
+static void out_pop(struct http_conn *c)
+{
+    struct http_out *o = c->out_head;
+    c->out_head = o->next;
+    if (!c->out_head) {
+        c->out_tail = NULL;
+    }
+    if (o->type == HTTP_OUT_BUF) {
+        c->out_bytes -= o->len;
+        http_buf_unref(o->buf);
+    } else if (o->fd != -1) {
+        close(o->fd);
+    }
+    free(o);
+}
+
+/* takes over the reference of b */
+int http_conn_queue(struct http_conn *c, struct http_buf *b)
+{
+    struct http_out *o;
+    if (c->closed) {
+        http_buf_unref(b);
+        return -1;
+    }
+    o = out_add(c, HTTP_OUT_BUF);
+    if (!o) {
+        http_buf_unref(b);
+        return -1;
+    }
+    o->buf = b;
+    o->len = b->len;
+    c->out_bytes += b->len;
+    return 0;
+}
+
+static int conn_queue_file(struct http_conn *c, int fd, uint64_t off, uint64_t len)
+{
+    struct http_out *o = out_add(c, HTTP_OUT_FILE);
+    if (!o) {
+        close(fd);
+        return -1;
+    }
+    o->fd = fd;
+    o->off = off;
+    o->len = len;
+    return 0;
+}
+
+/* consecutive memory items with one sendmsg, MSG_MORE if a file follows */
+static int out_mem(struct http_conn *c)
+{
+    struct iovec iov[HTTP_OUT_IOV];
+    struct msghdr msg;
+    struct http_out *o;
+    ssize_t n;
+    int cnt = 0, flags = MSG_NOSIGNAL;
+
+    for (o = c->out_head; o && o->type == HTTP_OUT_BUF && cnt < HTTP_OUT_IOV; o = o->next) {
+        iov[cnt].iov_base = o->buf->data + o->off;
+        iov[cnt].iov_len = o->len;
+        cnt++;
+    }
+    if (o && o->type == HTTP_OUT_FILE) {
+        flags |= MSG_MORE;
+    }
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = cnt;
+    do {
+        n = sendmsg(c->fd, &msg, flags);
+    } while (n == -1 && errno == EINTR);
+    if (n == -1) {
+        return errno == EAGAIN ? 0 : -1;
+    }
+    c->httpd->stat.bytes_out += n;
+    while (n > 0) {
+        o = c->out_head;
+        if ((size_t)n < o->len) {
+            o->off += n;
+            o->len -= n;
+            c->out_bytes -= n;
+            return 0;
+        }
+        n -= o->len;
+        out_pop(c);
+    }
+    return 1;
+}
+
+/*
+ * sendfile, or splice through a pipe where sendfile can't be used
+ * return 1 done, 0 socket full, -1 error
+ */
+static int out_file(struct http_conn *c, struct http_out *o)
+{
+    ssize_t n;
+    off_t off;
+    loff_t loff;
+
+    while (o->len > 0 || c->pipe_bytes > 0) {
+        if (c->pipe[0] == -1) {
+            off = o->off;
+            n = sendfile(c->fd, o->fd, &off, o->len > HTTP_SENDFILE_MAX ? HTTP_SENDFILE_MAX : o->len);
+            if (n > 0) {
+                o->off += n;
+                o->len -= n;
+                c->httpd->stat.bytes_out += n;
+                continue;
+            }
+            if (n == 0) {
+                /* file got shorter */
+                return -1;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN) {
+                return 0;
+            }
+            if ((errno != EINVAL && errno != ENOSYS) ||
+                pipe2(c->pipe, O_NONBLOCK | O_CLOEXEC) == -1) {
+                return -1;
+            }
+            continue;
+        }
+        if (c->pipe_bytes == 0) {
+            loff = o->off;
+            n = splice(o->fd, &loff, c->pipe[1], NULL,
+                       o->len > HTTP_SPLICE_MAX ? HTTP_SPLICE_MAX : o->len,
+                       SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n <= 0) {
+                if (n == -1 && errno == EINTR) {
+                    continue;
+                }
+                return -1;
+            }
+            o->off += n;
+            o->len -= n;
+            c->pipe_bytes = n;
+        }
+        n = splice(c->pipe[0], NULL, c->fd, NULL, c->pipe_bytes,
+                   SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            c->pipe_bytes -= n;
+            c->httpd->stat.bytes_out += n;
+            continue;
+        }
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        return (n == -1 && errno == EAGAIN) ? 0 : -1;
+    }
+    return 1;
+}
+
+/* return -1 if the connection got closed */
+int http_conn_flush(struct http_conn *c)
+{
+    int ret;
+
+    while (!c->closed && c->out_head) {
+        if (c->out_head->type == HTTP_OUT_FILE) {
+            ret = out_file(c, c->out_head);
+            if (ret == 1) {
+                out_pop(c);
+            }
+        } else {
+            ret = out_mem(c);
+        }
+        if (ret == 0) {
+            return 0;
+        }
+        if (ret == -1) {
+            http_conn_close(c);
+            return -1;
+        }
+    }
+    if (c->closed) {
+        return -1;
+    }
+    if (c->close_after && !c->parked && !c->streaming) {
+        http_conn_close(c);
+        return -1;
+    }
+    return 0;
+}
+
+int http_reply(struct http_conn *c, int status, const char *content_type,
+                const void *body, size_t len)
+{
+    struct http_buf *b;
+    size_t reserve = c->req_head ? 0 : len;
+
+    b = http_header_build(c, status, content_type, len, NULL, c->req_keep_alive, reserve);
+    if (!b) {
+        return -1;
+    }
+    if (reserve) {
+        memcpy(b->data + b->len, body, len);
+        b->len += len;
+    }
+    if (!c->req_keep_alive) {
+        c->close_after = 1;
+    }
+    return http_conn_queue(c, b);
+}
+
+int http_reply_buf(struct http_conn *c, int status, const char *content_type,
+                struct http_buf *body)
+{
+    struct http_buf *b;
+
+    b = http_header_build(c, status, content_type, body->len, NULL, c->req_keep_alive, 0);
+    if (!b) {
+        return -1;
+    }
+    if (!c->req_keep_alive) {
+        c->close_after = 1;
+    }
+    if (http_conn_queue(c, b) < 0) {
+        return -1;
+    }
+    if (c->req_head) {
+        return 0;
+    }
+    return http_conn_queue(c, http_buf_ref(body));
+}
+
+/* single "bytes=a-b" range, return 0 ok, 1 no range, -1 unsatisfiable */
+static int parse_range(const char *range, uint64_t size, uint64_t *off, uint64_t *len)
+{
+    unsigned long long a, b;
+    char *end;
+
+    if (!range || strncmp(range, "bytes=", 6) || strchr(range, ',')) {
+        return 1;
+    }
+    range += 6;
+    if (*range == '-') {
+        b = strtoull(range + 1, &end, 10);
+        if (end == range + 1 || b == 0 || size == 0) {
+            return -1;
+        }
+        if (b > size) {
+            b = size;
+        }
+        *off = size - b;
+        *len = b;
+        return 0;
+    }
+    a = strtoull(range, &end, 10);
+    if (end == range || *end != '-' || a >= size) {
+        return -1;
+    }
+    range = end + 1;
+    if (*range == '\0') {
+        b = size - 1;
+    } else {
+        b = strtoull(range, &end, 10);
+        if (end == range || b < a) {
+            return -1;
+        }
+        if (b >= size) {
+            b = size - 1;
+        }
+    }
+    *off = a;
+    *len = b - a + 1;
+    return 0;
+}
+
+int http_reply_file(struct http_conn *c, const struct http_request *req,
+                const char *path, const char *content_type)
+{
+    char extra[192], mtime[40];
+    const char *ims;
+    struct http_buf *b;
+    struct stat st;
+    uint64_t off = 0, len;
+    int fd, status = 200, ret;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return http_reply(c, errno == EACCES ? 403 : 404, "text/plain", "not found\n", 10);
+    }
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return http_reply(c, 403, "text/plain", "forbidden\n", 10);
+    }
+    http_date(mtime, sizeof(mtime), st.st_mtime);
+    ims = http_header_get(req, "If-Modified-Since");
+    if (ims && !strcmp(ims, mtime)) {
+        close(fd);
+        b = http_header_build(c, 304, NULL, -1, NULL, c->req_keep_alive, 0);
+        if (!c->req_keep_alive) {
+            c->close_after = 1;
+        }
+        return b ? http_conn_queue(c, b) : -1;
+    }
+    len = st.st_size;
+    ret = parse_range(http_header_get(req, "Range"), st.st_size, &off, &len);
+    if (ret == -1) {
+        close(fd);
+        snprintf(extra, sizeof(extra), "Content-Range: bytes */%llu\r\n",
+                 (unsigned long long)st.st_size);
+        b = http_header_build(c, 416, NULL, 0, extra, c->req_keep_alive, 0);
+        if (!c->req_keep_alive) {
+            c->close_after = 1;
+        }
+        return b ? http_conn_queue(c, b) : -1;
+    }
+    if (ret == 0) {
+        status = 206;
+        snprintf(extra, sizeof(extra),
+                 "Accept-Ranges: bytes\r\nLast-Modified: %s\r\nContent-Range: bytes %llu-%llu/%llu\r\n",
+                 mtime, (unsigned long long)off, (unsigned long long)(off + len - 1),
+                 (unsigned long long)st.st_size);
+    } else {
+        snprintf(extra, sizeof(extra), "Accept-Ranges: bytes\r\nLast-Modified: %s\r\n", mtime);
+    }
+    if (!content_type) {
+        content_type = mime_type(path);
+    }
+    b = http_header_build(c, status, content_type, len, extra, c->req_keep_alive, 0);
+    if (!b) {
+        close(fd);
+        return -1;
+    }
+    if (!c->req_keep_alive) {
+        c->close_after = 1;
+    }
+    if (http_conn_queue(c, b) < 0 || c->req_head || len == 0) {
+        close(fd);
+        return 0;
+    }
+    posix_fadvise(fd, off, len, POSIX_FADV_SEQUENTIAL);
+    return conn_queue_file(c, fd, off, len);
+}
+
+static int hex_val(char ch)
+{
+    if (ch >= '0' && ch <= '9') return ch - '0';
+    if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+    return -1;
+}
+
+/* root + decoded path, no ".." escaping the root */
+static int dir_path(char *dst, size_t size, const char *root, const char *path)
+{
+    size_t n = snprintf(dst, size, "%s/", root);
+    const char *seg = path;
+    int hi, lo;
+
+    for (; *path && n + 1 < size; path++) {
+        if (*path == '%' && (hi = hex_val(path[1])) >= 0 && (lo = hex_val(path[2])) >= 0) {
+            dst[n] = (char)(hi << 4 | lo);
+            path += 2;
+        } else {
+            dst[n] = *path;
+        }
+        if (dst[n] == '\0') {
+            return -1;
+        }
+        if (dst[n] == '/' && n > 0 && dst[n - 1] == '/') {
+            continue;
+        }
+        n++;
+    }
+    if (*path) {
+        return -1;
+    }
+    dst[n] = '\0';
+    for (seg = strstr(dst, ".."); seg; seg = strstr(seg + 2, "..")) {
+        if ((seg == dst || seg[-1] == '/') && (seg[2] == '/' || seg[2] == '\0')) {
+            return -1;
+        }
+    }
+    if (n > 0 && dst[n - 1] == '/' && n + 10 < size) {
+        strcpy(dst + n, "index.html");
+    }
+    return 0;
+}
+
+static void serve_dir(struct http_conn *c, const struct http_request *req,
+                struct http_route *r)
+{
+    char path[PATH_MAX];
+
+    if (req->method != HTTP_GET && req->method != HTTP_HEAD) {
+        http_reply(c, 405, "text/plain", "method not allowed\n", 19);
+        return;
+    }
+    if (dir_path(path, sizeof(path), r->root, req->path + r->len) < 0) {
+        http_reply(c, 403, "text/plain", "forbidden\n", 10);
+        return;
+    }
+    http_reply_file(c, req, path, NULL);
+}
+
+static struct http_route *route_find(struct httpd *h, const char *path)
+{
+    struct http_route *best = NULL;
+    int i;
+    for (i = 0; i < h->nroute; i++) {
+        if (!strncmp(path, h->routes[i].prefix, h->routes[i].len) &&
+            (!best || h->routes[i].len > best->len)) {
+            best = &h->routes[i];
+        }
+    }
+    return best;
+}
+
+static void conn_dispatch(struct http_conn *c, const struct http_request *req)
+{
+    struct http_route *r = route_find(c->httpd, req->path);
+    struct http_out *tail = c->out_tail;
+
+    c->httpd->stat.requests++;
+    c->req_version = req->version;
+    c->req_keep_alive = req->keep_alive;
+    c->req_head = req->method == HTTP_HEAD;
+    if (!r) {
+        http_reply(c, 404, "text/plain", "not found\n", 10);
+    } else if (r->root) {
+        serve_dir(c, req, r);
+    } else if (r->cb(c, req, r->arg) < 0 && c->out_tail == tail && !c->parked) {
+        http_reply(c, 500, "text/plain", "internal error\n", 15);
+    }
+}
+
+/* handle the complete requests buffered, in order */
+static void conn_handle(struct http_conn *c)
+{
+    struct http_request req;
+    size_t used = 0;
+    int n, status;
+
+    while (!c->closed && !c->parked && !c->streaming && !c->close_after &&
+           c->out_bytes < HTTP_OUT_HIGH && used < c->in_len) {
+        n = http_parse_request(&c->parser, c->in + used, c->in_len - used, &req, &status);
+        if (n == 0) {
+            break;
+        }
+        if (n < 0) {
+            c->req_keep_alive = 0;
+            c->req_head = 0;
+            http_reply(c, status, "text/plain", "bad request\n", 12);
+            used = c->in_len;
+            break;
+        }
+        conn_dispatch(c, &req);
+        used += n;
+    }
+    if (c->streaming) {
+        /* nothing more is read from a stream client */
+        used = c->in_len;
+    }
+    if (used > 0) {
+        memmove(c->in, c->in + used, c->in_len - used);
+        c->in_len -= used;
+    }
+    if (c->in_len == 0 && c->in_cap > HTTP_RECV_BUF * 4) {
+        free(c->in);
+        c->in = NULL;
+        c->in_cap = 0;
+    }
+}
+
+void http_conn_process(struct http_conn *c)
+{
+    if (c->busy) {
+        return;
+    }
+    c->busy = 1;
+    for (;;) {
+        conn_handle(c);
+        if (http_conn_flush(c) < 0) {
+            break;
+        }
+        if (c->read_eof && !c->parked && !c->streaming && !c->out_head) {
+            http_conn_close(c);
+            break;
+        }
+        if (c->read_blocked && !c->parked && c->out_bytes < HTTP_OUT_HIGH / 2) {
+            c->read_blocked = 0;
+            conn_recv(c);
+            continue;
+        }
+        break;
+    }
+    c->busy = 0;
+}
+
+/* read until EAGAIN, or stop when nothing more can be taken now */
+static void conn_recv(struct http_conn *c)
+{
+    ssize_t n;
+    size_t cap;
+    char *p;
+
+    while (!c->closed && !c->read_eof) {
+        if (c->in_len == c->in_cap) {
+            if (c->in_cap >= HTTP_MAX_HEADER_LEN + HTTP_MAX_BODY_LEN ||
+                (c->in_cap >= HTTP_RECV_BUF * 4 &&
+                 (c->parked || c->out_bytes >= HTTP_OUT_HIGH))) {
+                c->read_blocked = 1;
+                return;
+            }
+            cap = c->in_cap ? c->in_cap * 2 : HTTP_RECV_BUF;
+            p = (char *)realloc(c->in, cap);
+            if (!p) {
+                http_conn_close(c);
+                return;
+            }
+            c->in = p;
+            c->in_cap = cap;
+        }
+        n = recv(c->fd, c->in + c->in_len, c->in_cap - c->in_len, 0);
+        if (n > 0) {
+            c->in_len += n;
+            continue;
+        }
+        if (n == 0) {
+            c->read_eof = 1;
+            if (c->parked || c->streaming) {
+                http_conn_close(c);
+            }
+            return;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EAGAIN) {
+            http_conn_close(c);
+        }
+        return;
+    }
+}
+
+static void on_conn_in(int fd, void *arg)
+{
+    struct http_conn *c = (struct http_conn *)arg;
+    if (c->closed) {
+        return;
+    }
+    c->last_active = c->httpd->tick;
+    conn_recv(c);
+    if (!c->closed) {
+        http_conn_process(c);
+    }
+}
+
+static void on_conn_out(int fd, void *arg)
+{
+    struct http_conn *c = (struct http_conn *)arg;
+    if (c->closed) {
+        return;
+    }
+    c->last_active = c->httpd->tick;
+    http_conn_process(c);
+}
+
+/*
+ * the gevent may still be referenced by the epoll batch being dispatched,
+ * so the connection is only freed on a later tick
+ */
+void http_conn_close(struct http_conn *c)
+{
+    struct httpd *h = c->httpd;
+
+    if (c->closed) {
+        return;
+    }
+    c->closed = 1;
+    if (c->on_close) {
+        c->on_close(c);
+        c->on_close = NULL;
+    }
+    gevent_del(h->evbase, &c->ev);
+    sock_close(c->fd);
+    while (c->out_head) {
+        out_pop(c);
+    }
+    if (c->pipe[0] != -1) {
+        close(c->pipe[0]);
+        close(c->pipe[1]);
+    }
+    free(c->in);
+    c->in = NULL;
+    if (c->prev) {
+        c->prev->next = c->next;
+    } else {
+        h->conns = c->next;
+    }
+    if (c->next) {
+        c->next->prev = c->prev;
+    }
+    c->zombie_tick = h->tick;
+    c->next = h->zombies;
+    h->zombies = c;
+    h->stat.conns--;
+}
+
+static void conn_free(struct http_conn *c)
+{
+    gevent_destroy(c->ev);
+    free(c);
+}
+
+static void conn_create(struct httpd *h, int fd)
+{
+    struct http_conn *c;
+    int on = 1;
+
+    c = (struct http_conn *)calloc(1, sizeof(struct http_conn));
+    if (!c) {
+        printf("malloc http_conn failed!\n");
+        sock_close(fd);
+        return;
+    }
+    c->httpd = h;
+    c->fd = fd;
+    c->pipe[0] = c->pipe[1] = -1;
+    c->last_active = h->tick;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    c->ev = gevent_create(fd, on_conn_in, on_conn_out, NULL, c);
+    if (!c->ev || gevent_add(h->evbase, &c->ev) == -1) {
+        printf("gevent_add failed!\n");
+        gevent_destroy(c->ev);
+        sock_close(fd);
+        free(c);
+        return;
+    }
+    c->next = h->conns;
+    if (h->conns) {
+        h->conns->prev = c;
+    }
+    h->conns = c;
+    h->stat.conns++;
+    h->stat.accepted++;
+    /* data may be there already, the edge won't come again */
+    on_conn_in(fd, c);
+}
+
+static void on_listen(int fd, void *arg)
+{
+    struct httpd *h = (struct httpd *)arg;
+    int afd;
+
+    for (;;) {
+        afd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (afd == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN) {
+                printf("accept failed: %s\n", strerror(errno));
+            }
+            break;
+        }
+        conn_create(h, afd);
+    }
+}
+
+static void on_wake(int fd, void *arg)
+{
+    struct httpd *h = (struct httpd *)arg;
+    uint64_t cnt;
+
+    if (read(fd, &cnt, sizeof(cnt)) != sizeof(cnt) && errno != EAGAIN) {
+        printf("read wake fd failed: %s\n", strerror(errno));
+    }
+    http_stream_wake(h);
+}
+
+void httpd_wake(struct httpd *h)
+{
+    uint64_t one = 1;
+    if (h->wake_fd == -1) {
+        /* not dispatched yet, picked up by the first wake */
+        return;
+    }
+    if (write(h->wake_fd, &one, sizeof(one)) != sizeof(one) && errno != EAGAIN) {
+        printf("write wake fd failed: %s\n", strerror(errno));
+    }
+}
+
+static void on_tick(int fd, void *arg)
+{
+    struct httpd *h = (struct httpd *)arg;
+    struct http_conn *c, *next, **pp;
+
+    /* zombies of an earlier tick are out of any epoll batch */
+    for (pp = &h->zombies; (c = *pp) != NULL;) {
+        if (c->zombie_tick < h->tick) {
+            *pp = c->next;
+            conn_free(c);
+        } else {
+            pp = &c->next;
+        }
+    }
+    h->tick++;
+    http_date(h->date, sizeof(h->date), time(NULL));
+    for (c = h->conns; c; c = next) {
+        next = c->next;
+        if (!c->streaming && !c->parked && h->idle_timeout > 0 &&
+            h->tick - c->last_active > (uint64_t)h->idle_timeout) {
+            http_conn_close(c);
+        }
+    }
+    http_stream_tick(h, httpd_now_ms());
+}
+
+struct httpd *httpd_create(const char *host, uint16_t port)
+{
+    struct httpd *h = (struct httpd *)calloc(1, sizeof(struct httpd));
+    if (!h) {
+        printf("malloc httpd failed!\n");
+        return NULL;
+    }
+    if (host) {
+        snprintf(h->host, sizeof(h->host), "%s", host);
+    }
+    h->port = port;
+    h->listen_fd = -1;
+    h->wake_fd = -1;
+    h->idle_timeout = 30;
+    pthread_mutex_init(&h->lock, NULL);
+    http_date(h->date, sizeof(h->date), time(NULL));
+    return h;
+}
+
+static int route_add(struct httpd *h, const char *prefix, http_handler cb,
+                void *arg, const char *root)
+{
+    struct http_route *r;
+
+    r = (struct http_route *)realloc(h->routes, (h->nroute + 1) * sizeof(struct http_route));
+    if (!r) {
+        return -1;
+    }
+    h->routes = r;
+    r = &h->routes[h->nroute];
+    memset(r, 0, sizeof(*r));
+    r->prefix = strdup(prefix);
+    r->root = root ? strdup(root) : NULL;
+    if (!r->prefix || (root && !r->root)) {
+        free(r->prefix);
+        free(r->root);
+        return -1;
+    }
+    r->len = strlen(prefix);
+    r->cb = cb;
+    r->arg = arg;
+    h->nroute++;
+    return 0;
+}
+
+int httpd_route(struct httpd *h, const char *prefix, http_handler cb, void *arg)
+{
+    if (!h || !prefix || !cb) {
+        printf("invalid paraments!\n");
+        return -1;
+    }
+    return route_add(h, prefix, cb, arg, NULL);
+}
+
+int httpd_serve_dir(struct httpd *h, const char *prefix, const char *root)
+{
+    if (!h || !prefix || !root) {
+        printf("invalid paraments!\n");
+        return -1;
+    }
+    return route_add(h, prefix, NULL, NULL, root);
+}
+
+void httpd_set_idle_timeout(struct httpd *h, int sec)
+{
+    if (h) {
+        h->idle_timeout = sec;
+    }
+}
+
+int httpd_dispatch(struct httpd *h)
+{
+    if (!h) {
+        return -1;
+    }
+    /* a peer closing during sendfile must not kill the process */
+    signal(SIGPIPE, SIG_IGN);
+    h->listen_fd = sock_tcp_bind_listen(h->host, h->port);
+    if (h->listen_fd == -1) {
+        printf("sock_tcp_bind_listen %s:%d failed!\n", h->host, h->port);
+        return -1;
+    }
+    sock_set_noblk(h->listen_fd, 1);
+    h->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (h->wake_fd == -1) {
+        printf("eventfd failed: %s\n", strerror(errno));
+        return -1;
+    }
+    h->evbase = gevent_base_create();
+    if (!h->evbase) {
+        return -1;
+    }
+    h->ev_listen = gevent_create(h->listen_fd, on_listen, NULL, NULL, h);
+    h->ev_wake = gevent_create(h->wake_fd, on_wake, NULL, NULL, h);
+    h->ev_timer = gevent_timer_create(1000, TIMER_PERSIST, on_tick, h);
+    if (!h->ev_listen || !h->ev_wake || !h->ev_timer ||
+        gevent_add(h->evbase, &h->ev_listen) == -1 ||
+        gevent_add(h->evbase, &h->ev_wake) == -1 ||
+        gevent_add(h->evbase, &h->ev_timer) == -1) {
+        printf("gevent_add failed!\n");
+        return -1;
+    }
+    gevent_base_loop_start(h->evbase);
+    if (!h->evbase->thread) {
+        printf("gevent_base_loop_start failed!\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* counters are owned by the loop thread, a snapshot may be slightly stale */
+void httpd_get_stat(struct httpd *h, struct httpd_stat *st)
+{
+    memcpy(st, &h->stat, sizeof(*st));
+}
+
+void httpd_destroy(struct httpd *h)
+{
+    struct http_conn *c;
+    int i;
+
+    if (!h) {
+        return;
+    }
+    if (h->evbase && h->evbase->thread) {
+        gevent_base_loop_stop(h->evbase);
+    }
+    while (h->conns) {
+        http_conn_close(h->conns);
+    }
+    while ((c = h->zombies) != NULL) {
+        h->zombies = c->next;
+        conn_free(c);
+    }
+    http_stream_free_all(h);
+    if (h->evbase) {
+        if (h->ev_timer) {
+            gevent_del(h->evbase, &h->ev_timer);
+            gevent_timer_destroy(h->ev_timer);
+        }
+        gevent_base_destroy(h->evbase);
+    }
+    if (h->wake_fd != -1) {
+        close(h->wake_fd);
+    }
+    if (h->listen_fd != -1) {
+        sock_close(h->listen_fd);
+    }
+    for (i = 0; i < h->nroute; i++) {
+        free(h->routes[i].prefix);
+        free(h->routes[i].root);
+    }
+    free(h->routes);
+    pthread_mutex_destroy(&h->lock);
+    free(h);
+}
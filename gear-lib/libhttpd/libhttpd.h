@@ -1 +1,163 @@
-#include "mongoose.h"
\ No newline at end of file
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#ifndef LIBHTTPD_H
+#define LIBHTTPD_H
+
+#include <libposix.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define LIBHTTPD_VERSION "0.2.0"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * HTTP/1.1 server on libgevent, one event loop thread:
+ * keep-alive and pipelined requests, files by sendfile with Range, and live
+ * MJPEG / chunked / LL-HLS streams fanned out from shared buffers.
+ */
+
+enum http_method {
+    HTTP_GET = 0,
+    HTTP_HEAD,
+    HTTP_POST,
+    HTTP_PUT,
+    HTTP_DELETE,
+    HTTP_OPTIONS,
+    HTTP_UNKNOWN,
+};
+
+#define HTTP_MAX_HEADERS    (32)
+
+struct http_header {
+    const char *name;
+    const char *value;
+};
+
+/* valid only during the handler call, points into the connection buffer */
+struct http_request {
+    enum http_method method;
+    const char *method_str;
+    const char *path;
+    const char *query;          /* after '?', NULL if none */
+    int version;                /* 10 or 11 */
+    int keep_alive;
+    struct http_header headers[HTTP_MAX_HEADERS];
+    int nheader;
+    const char *body;
+    size_t body_len;
+};
+
+/*
+ * refcounted buffer, one copy of a frame or segment queued to any number of
+ * connections
+ */
+struct http_buf {
+    int ref;
+    size_t len;
+    uint8_t *data;
+};
+
+GEAR_API struct http_buf *http_buf_create(const void *data, size_t len);
+GEAR_API struct http_buf *http_buf_ref(struct http_buf *b);
+GEAR_API void http_buf_unref(struct http_buf *b);
+
+struct httpd;
+struct http_conn;
+
+/* return -1 to reply 500, else a response must be queued with http_reply* */
+typedef int (*http_handler)(struct http_conn *c, const struct http_request *req, void *arg);
+
+GEAR_API struct httpd *httpd_create(const char *host, uint16_t port);
+GEAR_API void httpd_destroy(struct httpd *h);
+
+/*
+ * routes, streams and hls are set up before httpd_dispatch, the longest
+ * matching prefix wins
+ */
+GEAR_API int httpd_route(struct httpd *h, const char *prefix, http_handler cb, void *arg);
+GEAR_API int httpd_serve_dir(struct httpd *h, const char *prefix, const char *root);
+GEAR_API void httpd_set_idle_timeout(struct httpd *h, int sec);
+
+/* start the event loop thread */
+GEAR_API int httpd_dispatch(struct httpd *h);
+
+GEAR_API const char *http_header_get(const struct http_request *req, const char *name);
+
+GEAR_API int http_reply(struct http_conn *c, int status, const char *content_type,
+                const void *body, size_t len);
+/* a regular file, with Range, HEAD and Last-Modified */
+GEAR_API int http_reply_file(struct http_conn *c, const struct http_request *req,
+                const char *path, const char *content_type);
+GEAR_API int http_reply_buf(struct http_conn *c, int status, const char *content_type,
+                struct http_buf *b);
+
+struct httpd_stat {
+    uint64_t conns;             /* open connections */
+    uint64_t accepted;
+    uint64_t requests;
+    uint64_t bytes_out;
+    uint64_t stream_clients;
+    uint64_t frames_dropped;    /* frames skipped for slow stream clients */
+};
+
+GEAR_API void httpd_get_stat(struct httpd *h, struct httpd_stat *st);
+
+/*
+ * live streams. push may be called from any thread, the data is copied
+ * once, framed and queued to all clients. a client that falls behind by
+ * more than max_queue bytes skips whole frames (MJPEG) or is closed
+ * (chunked, as skipping would corrupt the stream).
+ */
+enum http_stream_type {
+    HTTP_STREAM_MJPEG = 0,      /* multipart/x-mixed-replace of image/jpeg */
+    HTTP_STREAM_CHUNKED,        /* Transfer-Encoding: chunked, e.g. video/mp2t */
+};
+
+struct http_stream;
+
+GEAR_API struct http_stream *httpd_stream_create(struct httpd *h, const char *path,
+                enum http_stream_type type, const char *content_type, size_t max_queue);
+GEAR_API int http_stream_push(struct http_stream *s, const void *data, size_t len);
+GEAR_API int http_stream_clients(struct http_stream *s);
+
+/*
+ * low latency HLS of fMP4 parts under prefix:
+ *   index.m3u8 (blocking reload with _HLS_msn/_HLS_part), init.mp4,
+ *   seg<msn>.m4s and seg<msn>.<part>.m4s
+ * part and segment requests for the preload hint are held until pushed.
+ */
+struct http_hls;
+
+GEAR_API struct http_hls *httpd_hls_create(struct httpd *h, const char *prefix,
+                int target_ms, int part_ms, int window);
+GEAR_API int http_hls_set_init(struct http_hls *hls, const void *data, size_t len);
+/* segment_end closes the current segment after this part */
+GEAR_API int http_hls_push_part(struct http_hls *hls, const void *data, size_t len,
+                int duration_ms, int independent, int segment_end);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -1,8 +1,481 @@
-#include <stdio.h>
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#define _GNU_SOURCE
 #include "libhttpd.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define TEST_PORT   18088
+
+static volatile int producer_run;
 
-int main(void)
+static uint64_t now_ms(void)
 {
-    printf("hello world!\n");
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int on_hello(struct http_conn *c, const struct http_request *req, void *arg)
+{
+    return http_reply(c, 200, "text/plain", "hello world!\n", 13);
+}
+
+static int on_echo(struct http_conn *c, const struct http_request *req, void *arg)
+{
+    return http_reply(c, 200, "application/octet-stream", req->body, req->body_len);
+}
+
+static int connect_to(const char *host, uint16_t port)
+{
+    struct sockaddr_in addr;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, host, &addr.sin_addr);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* send req as is, it must ask for Connection: close. return the status */
+static int http_raw(uint16_t port, const char *req, char *body, size_t size, size_t *body_len)
+{
+    struct timeval tv = {5, 0};
+    char *resp, *p;
+    size_t len = 0, cap = 64 * 1024;
+    ssize_t n;
+    int fd, status = -1;
+
+    fd = connect_to("127.0.0.1", port);
+    if (fd == -1) {
+        return -1;
+    }
+    /* a request the server never sees the end of fails instead of hanging */
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (write(fd, req, strlen(req)) != (ssize_t)strlen(req)) {
+        close(fd);
+        return -1;
+    }
+    resp = malloc(cap);
+    while ((n = read(fd, resp + len, cap - len - 1)) > 0) {
+        len += n;
+        if (len + 1 == cap) {
+            cap *= 2;
+            resp = realloc(resp, cap);
+        }
+    }
+    resp[len] = '\0';
+    close(fd);
+    sscanf(resp, "HTTP/1.1 %d", &status);
+    p = strstr(resp, "\r\n\r\n");
+    if (p && body) {
+        p += 4;
+        *body_len = len - (p - resp);
+        if (*body_len >= size) {
+            *body_len = size - 1;
+        }
+        memcpy(body, p, *body_len);
+        body[*body_len] = '\0';
+    }
+    free(resp);
+    return status;
+}
+
+/* one request with Connection: close, return the status */
+static int http_get(uint16_t port, const char *path, const char *extra,
+                char *body, size_t size, size_t *body_len)
+{
+    char req[512];
+
+    snprintf(req, sizeof(req), "GET %s HTTP/1.1\r\nHost: localhost\r\n%sConnection: close\r\n\r\n",
+             path, extra ? extra : "");
+    return http_raw(port, req, body, size, body_len);
+}
+
+#define CHECK(cond) do { if (!(cond)) { \
+        printf("%s:%d: check '%s' failed\n", __func__, __LINE__, #cond); \
+        return -1; } } while (0)
+
+/* served from ".", run in the source dir */
+static int foo_file(void)
+{
+    char body[1024], expect[16];
+    size_t len;
+    int status;
+    FILE *fp;
+
+    fp = fopen("test_libhttpd.c", "rb");
+    CHECK(fp);
+    CHECK(fseek(fp, 3, SEEK_SET) == 0 && fread(expect, 1, 10, fp) == 10);
+    fclose(fp);
+
+    status = http_get(TEST_PORT, "/hello", NULL, body, sizeof(body), &len);
+    printf("GET /hello: %d %s", status, body);
+    CHECK(status == 200 && len == 13 && !strcmp(body, "hello world!\n"));
+    status = http_raw(TEST_PORT, "GET /hello HTTP/1.1\nHost: localhost\nConnection: close\n\n",
+                      body, sizeof(body), &len);
+    printf("GET /hello with bare LF line ends: %d\n", status);
+    CHECK(status == 200 && len == 13);
+    status = http_get(TEST_PORT, "/files/test_libhttpd.c", "Range: bytes=3-12\r\n",
+                      body, sizeof(body), &len);
+    printf("GET /files/test_libhttpd.c Range 3-12: %d len=%zu \"%s\"\n", status, len, body);
+    CHECK(status == 206 && len == 10 && !memcmp(body, expect, 10));
+    status = http_get(TEST_PORT, "/files/test_libhttpd.c", "Range: bytes=99999999-\r\n",
+                      body, sizeof(body), &len);
+    printf("GET Range out of file: %d\n", status);
+    CHECK(status == 416);
+    status = http_get(TEST_PORT, "/files/../../etc/passwd", NULL, body, sizeof(body), &len);
+    printf("GET /files/../../etc/passwd: %d\n", status);
+    CHECK(status == 403);
     return 0;
-}
\ No newline at end of file
+}
+
+struct bench_conn {
+    int fd;
+    char *buf;
+    size_t len;
+    int inflight;
+};
+
+/* responses fully in buf, by Content-Length */
+static int bench_parse(struct bench_conn *bc)
+{
+    char *end, *cl;
+    size_t hdr, body;
+    int cnt = 0;
+
+    while (bc->len > 0) {
+        bc->buf[bc->len] = '\0';
+        end = strstr(bc->buf, "\r\n\r\n");
+        if (!end) {
+            break;
+        }
+        hdr = end + 4 - bc->buf;
+        cl = strcasestr(bc->buf, "Content-Length:");
+        body = (cl && cl < end) ? strtoul(cl + 15, NULL, 10) : 0;
+        if (bc->len < hdr + body) {
+            break;
+        }
+        memmove(bc->buf, bc->buf + hdr + body, bc->len - hdr - body);
+        bc->len -= hdr + body;
+        bc->inflight--;
+        cnt++;
+    }
+    return cnt;
+}
+
+/*
+ * keep-alive load: each connection sends pipeline requests at once and
+ * the next batch when all are answered
+ */
+static void foo_bench(const char *host, uint16_t port, const char *path,
+                int nconn, int secs, int pipeline)
+{
+    struct bench_conn *bcs = calloc(nconn, sizeof(struct bench_conn));
+    struct pollfd *pfds = calloc(nconn, sizeof(struct pollfd));
+    char req[256], *batch;
+    size_t req_len;
+    uint64_t start, end, done = 0, errors = 0;
+    ssize_t n;
+    int i, j;
+
+    req_len = snprintf(req, sizeof(req), "GET %s HTTP/1.1\r\nHost: %s\r\n\r\n", path, host);
+    batch = malloc(req_len * pipeline);
+    for (j = 0; j < pipeline; j++) {
+        memcpy(batch + j * req_len, req, req_len);
+    }
+    for (i = 0; i < nconn; i++) {
+        bcs[i].fd = connect_to(host, port);
+        bcs[i].buf = malloc(256 * 1024);
+        pfds[i].fd = bcs[i].fd;
+        pfds[i].events = POLLIN;
+        if (bcs[i].fd == -1) {
+            errors++;
+            continue;
+        }
+        if (write(bcs[i].fd, batch, req_len * pipeline) > 0) {
+            bcs[i].inflight = pipeline;
+        }
+    }
+    start = now_ms();
+    end = start + secs * 1000;
+    while (now_ms() < end) {
+        if (poll(pfds, nconn, 100) <= 0) {
+            continue;
+        }
+        for (i = 0; i < nconn; i++) {
+            if (!(pfds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+            n = read(bcs[i].fd, bcs[i].buf + bcs[i].len, 256 * 1024 - 1 - bcs[i].len);
+            if (n <= 0) {
+                errors++;
+                close(bcs[i].fd);
+                pfds[i].fd = -1;
+                continue;
+            }
+            bcs[i].len += n;
+            done += bench_parse(&bcs[i]);
+            if (bcs[i].inflight == 0 &&
+                write(bcs[i].fd, batch, req_len * pipeline) > 0) {
+                bcs[i].inflight = pipeline;
+            }
+        }
+    }
+    end = now_ms();
+    printf("bench %s: %d conns, pipeline %d, %llu requests in %llu ms, %.0f req/s, %llu errors\n",
+           path, nconn, pipeline, (unsigned long long)done,
+           (unsigned long long)(end - start), done * 1000.0 / (end - start),
+           (unsigned long long)errors);
+    for (i = 0; i < nconn; i++) {
+        if (pfds[i].fd != -1) {
+            close(bcs[i].fd);
+        }
+        free(bcs[i].buf);
+    }
+    free(batch);
+    free(pfds);
+    free(bcs);
+}
+
+struct producer {
+    struct http_stream *s;
+    int fps;
+    size_t frame_size;
+};
+
+static void *producer_thread(void *arg)
+{
+    struct producer *p = (struct producer *)arg;
+    char *frame = malloc(p->frame_size);
+    memset(frame, 0xab, p->frame_size);
+    while (producer_run) {
+        http_stream_push(p->s, frame, p->frame_size);
+        usleep(1000000 / p->fps);
+    }
+    free(frame);
+    return NULL;
+}
+
+/* many clients of one MJPEG stream, frames shared by reference */
+static void foo_stream_bench(const char *host, uint16_t port, const char *path,
+                int nclient, int secs)
+{
+    struct pollfd *pfds = calloc(nclient, sizeof(struct pollfd));
+    char req[256], buf[64 * 1024];
+    uint64_t start, end, bytes = 0;
+    int i, alive = 0;
+    ssize_t n;
+
+    snprintf(req, sizeof(req), "GET %s HTTP/1.1\r\nHost: %s\r\n\r\n", path, host);
+    for (i = 0; i < nclient; i++) {
+        pfds[i].fd = connect_to(host, port);
+        pfds[i].events = POLLIN;
+        if (pfds[i].fd != -1 && write(pfds[i].fd, req, strlen(req)) > 0) {
+            alive++;
+        }
+    }
+    start = now_ms();
+    end = start + secs * 1000;
+    while (now_ms() < end) {
+        if (poll(pfds, nclient, 100) <= 0) {
+            continue;
+        }
+        for (i = 0; i < nclient; i++) {
+            if (!(pfds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+            n = read(pfds[i].fd, buf, sizeof(buf));
+            if (n <= 0) {
+                close(pfds[i].fd);
+                pfds[i].fd = -1;
+                alive--;
+                continue;
+            }
+            bytes += n;
+        }
+    }
+    end = now_ms();
+    printf("stream %s: %d/%d clients alive, %.1f MB/s received\n", path, alive, nclient,
+           bytes / 1024.0 / 1024.0 * 1000.0 / (end - start));
+    for (i = 0; i < nclient; i++) {
+        if (pfds[i].fd != -1) {
+            close(pfds[i].fd);
+        }
+    }
+    free(pfds);
+}
+
+struct hls_producer {
+    struct http_hls *hls;
+    int part_ms;
+    int parts_per_seg;
+};
+
+static void *hls_thread(void *arg)
+{
+    struct hls_producer *p = (struct hls_producer *)arg;
+    char part[4096];
+    int i = 0;
+
+    memset(part, 0x5a, sizeof(part));
+    http_hls_set_init(p->hls, "ftypinit", 8);
+    while (producer_run) {
+        usleep(p->part_ms * 1000);
+        http_hls_push_part(p->hls, part, sizeof(part), p->part_ms,
+                           i % p->parts_per_seg == 0, i % p->parts_per_seg == p->parts_per_seg - 1);
+        i++;
+    }
+    return NULL;
+}
+
+static void foo_hls(void)
+{
+    char body[8192];
+    size_t len;
+    uint64_t t;
+    int status;
+
+    t = now_ms();
+    status = http_get(TEST_PORT, "/hls/index.m3u8?_HLS_msn=1&_HLS_part=1", NULL,
+                      body, sizeof(body), &len);
+    printf("blocking reload msn 1 part 1: %d after %llu ms\n%s", status,
+           (unsigned long long)(now_ms() - t), body);
+    t = now_ms();
+    status = http_get(TEST_PORT, "/hls/seg1.2.m4s", NULL, body, sizeof(body), &len);
+    printf("preload hint seg1.2.m4s: %d len=%zu after %llu ms\n", status, len,
+           (unsigned long long)(now_ms() - t));
+    status = http_get(TEST_PORT, "/hls/seg0.m4s", NULL, body, sizeof(body), &len);
+    printf("seg0.m4s: %d len=%zu\n", status, len);
+    status = http_get(TEST_PORT, "/hls/init.mp4", NULL, body, sizeof(body), &len);
+    printf("init.mp4: %d len=%zu\n", status, len);
+}
+
+static struct httpd *test_server(uint16_t port, struct http_stream **mjpeg,
+                struct http_hls **hls)
+{
+    struct httpd *h = httpd_create(NULL, port);
+    if (!h) {
+        return NULL;
+    }
+    httpd_route(h, "/hello", on_hello, NULL);
+    httpd_route(h, "/echo", on_echo, NULL);
+    httpd_serve_dir(h, "/files/", ".");
+    *mjpeg = httpd_stream_create(h, "/mjpeg", HTTP_STREAM_MJPEG, "image/jpeg", 512 * 1024);
+    *hls = httpd_hls_create(h, "/hls/", 1000, 200, 6);
+    if (httpd_dispatch(h) < 0) {
+        httpd_destroy(h);
+        return NULL;
+    }
+    return h;
+}
+
+static void usage(void)
+{
+    printf("./test_libhttpd                 self test and load test in process\n"
+           "./test_libhttpd -s [port]       serve /hello /files/ /mjpeg /hls/\n"
+           "./test_libhttpd -b host port path conns secs pipeline\n"
+           "./test_libhttpd -m host port path clients secs\n");
+}
+
+int main(int argc, char **argv)
+{
+    struct producer mp = {NULL, 30, 64 * 1024};
+    struct hls_producer hp = {NULL, 200, 5};
+    struct http_stream *mjpeg;
+    struct http_hls *hls;
+    struct httpd_stat st;
+    struct httpd *h;
+    pthread_t tid[2];
+    uint16_t port = TEST_PORT;
+    int ret = 0;
+
+    signal(SIGPIPE, SIG_IGN);
+    if (argc > 1 && !strcmp(argv[1], "-b") && argc == 8) {
+        foo_bench(argv[2], atoi(argv[3]), argv[4], atoi(argv[5]), atoi(argv[6]), atoi(argv[7]));
+        return 0;
+    }
+    if (argc > 1 && !strcmp(argv[1], "-m") && argc == 7) {
+        foo_stream_bench(argv[2], atoi(argv[3]), argv[4], atoi(argv[5]), atoi(argv[6]));
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "-s")) {
+        usage();
+        return 0;
+    }
+    if (argc > 2) {
+        port = atoi(argv[2]);
+    }
+    h = test_server(port, &mjpeg, &hls);
+    if (!h) {
+        return -1;
+    }
+    mp.s = mjpeg;
+    hp.hls = hls;
+    producer_run = 1;
+    pthread_create(&tid[0], NULL, producer_thread, &mp);
+    pthread_create(&tid[1], NULL, hls_thread, &hp);
+    if (argc > 1) {
+        while (1) {
+            sleep(1);
+        }
+    }
+
+    if (foo_file() < 0) {
+        ret = -1;
+    }
+    foo_hls();
+    foo_bench("127.0.0.1", port, "/hello", 64, 3, 1);
+    foo_bench("127.0.0.1", port, "/hello", 64, 3, 16);
+    foo_stream_bench("127.0.0.1", port, "/mjpeg", 200, 3);
+
+    producer_run = 0;
+    pthread_join(tid[0], NULL);
+    pthread_join(tid[1], NULL);
+    httpd_get_stat(h, &st);
+    printf("accepted %llu, requests %llu, out %llu MB, stream clients %llu, frames dropped %llu\n",
+           (unsigned long long)st.accepted, (unsigned long long)st.requests,
+           (unsigned long long)st.bytes_out / 1024 / 1024,
+           (unsigned long long)st.stream_clients, (unsigned long long)st.frames_dropped);
+    httpd_destroy(h);
+    return ret;
+}
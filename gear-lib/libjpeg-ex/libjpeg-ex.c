@@ -13,7 +13,10 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
 #include <jpeglib.h>
+#include <jerror.h>
 #include <liblog.h>
 #include "libjpeg-ex.h"
 
@@ -161,7 +164,7 @@ static void term_destination(j_compress_ptr cinfo)
 static void dest_buffer(j_compress_ptr cinfo, unsigned char *buffer, int size, int *written)
 {
     struct jpeg_args * dest;
-    if (cinfo->dest == NULL) {
+    if (cinfo->dest == NULL || cinfo->dest->init_destination != init_destination) {
         cinfo->dest = (struct jpeg_destination_mgr *)(*cinfo->mem->alloc_small)((j_common_ptr) cinfo, JPOOL_PERMANENT, sizeof(struct jpeg_args));
     }
 
@@ -343,6 +346,15 @@ void je_jpeg_free(struct je_jpeg *jpeg)
     free(jpeg);
 }
 
+static void je_error_exit(j_common_ptr cinfo)
+{
+    struct je_codec *codec = (struct je_codec *)((char *)cinfo -
+                    (cinfo->is_decompressor ? offsetof(struct je_codec, decoder)
+                                            : offsetof(struct je_codec, encoder)));
+    (*cinfo->err->output_message)(cinfo);
+    longjmp(codec->jmp, 1);
+}
+
 struct je_codec *je_codec_create()
 {
     struct je_codec *codec = CALLOC(1, struct je_codec);
@@ -352,6 +364,7 @@ struct je_codec *je_codec_create()
     }
     //init encoder
     codec->encoder.err = jpeg_std_error(&codec->errmgr);
+    codec->errmgr.error_exit = je_error_exit;
     jpeg_create_compress(&codec->encoder);
     jpeg_set_quality(&codec->encoder, DEFAULT_JPEG_QUALITY, 1);
 
@@ -370,6 +383,8 @@ void je_codec_destroy(struct je_codec *codec)
     }
     jpeg_destroy_compress(&codec->encoder);
     jpeg_destroy_decompress(&codec->decoder);
+    free(codec->band);
+    free(codec->scratch);
     free(codec);
 }
 
@@ -446,6 +461,10 @@ int je_encode_yuv_to_jpeg(struct je_codec *codec, struct je_yuv *yuv, struct je_
     planes[1] = cb;
     planes[2] = cr;
 
+    if (setjmp(codec->jmp)) {
+        jpeg_abort_compress(encoder);
+        return -1;
+    }
     dest_buffer(encoder, output, yuv->width * yuv->height, &written);
 
     encoder->image_width = yuv->width;	/* image width and height, in pixels */
@@ -486,3 +505,483 @@ int je_encode_yuv_to_jpeg(struct je_codec *codec, struct je_yuv *yuv, struct je_
     jpeg->data.iov_len = written;
     return 0;
 }
+
+#define JE_MAX_STRIPES      (64)
+#define JE_MAX_RESTART      (65535)
+
+static struct je_codec *je_codec_of(j_compress_ptr cinfo)
+{
+    return (struct je_codec *)((char *)cinfo - offsetof(struct je_codec, encoder));
+}
+
+static void je_init_destination(j_compress_ptr cinfo)
+{
+}
+
+static boolean je_empty_output_buffer(j_compress_ptr cinfo)
+{
+    struct je_codec *codec = je_codec_of(cinfo);
+    struct je_dest *dest = &codec->dest;
+    uint8_t *buf;
+
+    if (!dest->grow) {
+        ERREXIT(cinfo, JERR_BUFFER_SIZE);
+    }
+    buf = realloc(dest->buf, dest->size * 2);
+    if (!buf) {
+        ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 0);
+    }
+    codec->scratch = buf;
+    codec->scratch_size = dest->size * 2;
+    dest->pub.next_output_byte = buf + dest->size;
+    dest->pub.free_in_buffer = dest->size;
+    dest->buf = buf;
+    dest->size *= 2;
+    return TRUE;
+}
+
+static void je_term_destination(j_compress_ptr cinfo)
+{
+}
+
+static JSAMPROW pad_row(uint8_t *dst, const uint8_t *src, uint32_t width, uint32_t padded)
+{
+    memcpy(dst, src, width);
+    memset(dst + width, src[width - 1], padded - width);
+    return dst;
+}
+
+static void split_uv_row(uint8_t *u, uint8_t *v, const uint8_t *src,
+                         uint32_t width, uint32_t padded)
+{
+    uint32_t i;
+    for (i = 0; i < width; i++) {
+        u[i] = src[2 * i];
+        v[i] = src[2 * i + 1];
+    }
+    memset(u + width, u[width - 1], padded - width);
+    memset(v + width, v[width - 1], padded - width);
+}
+
+static void split_yuy2_row(uint8_t *y, uint8_t *u, uint8_t *v, const uint8_t *src,
+                           uint32_t width, uint32_t ypadded, uint32_t cpadded)
+{
+    uint32_t i, cw = (width + 1) / 2;
+    for (i = 0; i < width / 2; i++) {
+        y[2 * i]     = src[4 * i];
+        u[i]         = src[4 * i + 1];
+        y[2 * i + 1] = src[4 * i + 2];
+        v[i]         = src[4 * i + 3];
+    }
+    if (width & 1) {
+        y[width - 1] = src[4 * i];
+        u[i]         = src[4 * i + 1];
+        v[i]         = src[4 * i + 3];
+    }
+    memset(y + width, y[width - 1], ypadded - width);
+    memset(u + cw, u[cw - 1], cpadded - cw);
+    memset(v + cw, v[cw - 1], cpadded - cw);
+}
+
+static const uint8_t *plane_row(const struct video_frame *frame, int plane,
+                                uint32_t rows, uint32_t row)
+{
+    if (row >= rows) {
+        row = rows - 1;
+    }
+    return frame->data[plane] + (size_t)frame->linesize[plane] * row;
+}
+
+/*
+ * encode frame rows [y0, y0 + rows) as a standalone image, y0 must sit on
+ * an MCU row. Planes are fed to libjpeg in place with raw_data_in, only
+ * NV12 chroma, YUY2 and rows too short for whole DCT blocks go through
+ * the one MCU row band buffer
+ */
+static int encode_rows(struct je_codec *codec, const struct video_frame *frame,
+                       uint32_t y0, uint32_t rows, int quality, unsigned int restart,
+                       uint8_t *out, size_t size, int grow)
+{
+    struct jpeg_compress_struct *cinfo = &codec->encoder;
+    JSAMPROW y[16];
+    JSAMPROW cb[16];
+    JSAMPROW cr[16];
+    JSAMPARRAY planes[3] = {y, cb, cr};
+    uint32_t w = frame->width;
+    uint32_t h = frame->height;
+    uint32_t cw = (w + 1) / 2;
+    uint32_t ch = (h + 1) / 2;
+    uint32_t yw = ALIGN2(w, 16);
+    uint32_t cwp = ALIGN2(cw, 8);
+    uint32_t mcu_h = (frame->format == PIXEL_FORMAT_YUY2) ? 8 : 16;
+    uint32_t i, j, r;
+    uint8_t *yband, *cbband, *crband;
+    int direct_y, direct_c;
+    size_t band_size = 16 * (size_t)(yw + 2 * cwp);
+
+    if (codec->band_size < band_size) {
+        uint8_t *band = realloc(codec->band, band_size);
+        if (!band) {
+            loge("malloc band buffer failed!\n");
+            return -1;
+        }
+        codec->band = band;
+        codec->band_size = band_size;
+    }
+    yband = codec->band;
+    cbband = yband + 16 * yw;
+    crband = cbband + 16 * cwp;
+    direct_y = (frame->format != PIXEL_FORMAT_YUY2 &&
+                frame->linesize[0] >= ALIGN2(w, 8));
+    direct_c = (frame->format == PIXEL_FORMAT_I420 &&
+                frame->linesize[1] >= ALIGN2(cw, 8) &&
+                frame->linesize[2] >= ALIGN2(cw, 8));
+
+    if (setjmp(codec->jmp)) {
+        jpeg_abort_compress(cinfo);
+        return -1;
+    }
+    codec->dest.pub.init_destination = je_init_destination;
+    codec->dest.pub.empty_output_buffer = je_empty_output_buffer;
+    codec->dest.pub.term_destination = je_term_destination;
+    codec->dest.pub.next_output_byte = out;
+    codec->dest.pub.free_in_buffer = size;
+    codec->dest.buf = out;
+    codec->dest.size = size;
+    codec->dest.grow = grow;
+    cinfo->dest = &codec->dest.pub;
+
+    cinfo->image_width = w;
+    cinfo->image_height = rows;
+    cinfo->input_components = COLOR_COMPONENTS;
+    cinfo->in_color_space = JCS_YCbCr;
+    jpeg_set_defaults(cinfo);
+    jpeg_set_quality(cinfo, quality, TRUE);
+    cinfo->raw_data_in = TRUE;
+    cinfo->dct_method = JDCT_IFAST;
+    cinfo->restart_interval = restart;
+    cinfo->comp_info[0].h_samp_factor = 2;
+    cinfo->comp_info[0].v_samp_factor = mcu_h / 8;
+    cinfo->comp_info[1].h_samp_factor = 1;
+    cinfo->comp_info[1].v_samp_factor = 1;
+    cinfo->comp_info[2].h_samp_factor = 1;
+    cinfo->comp_info[2].v_samp_factor = 1;
+    jpeg_start_compress(cinfo, TRUE);
+
+    for (j = y0; j < y0 + rows; j += mcu_h) {
+        switch (frame->format) {
+        case PIXEL_FORMAT_I420:
+        case PIXEL_FORMAT_NV12:
+            for (i = 0; i < 16; i++) {
+                if (direct_y) {
+                    y[i] = (JSAMPROW)plane_row(frame, 0, h, j + i);
+                } else {
+                    y[i] = pad_row(yband + i * yw, plane_row(frame, 0, h, j + i), w, yw);
+                }
+            }
+            for (i = 0; i < 8; i++) {
+                r = j / 2 + i;
+                if (direct_c) {
+                    cb[i] = (JSAMPROW)plane_row(frame, 1, ch, r);
+                    cr[i] = (JSAMPROW)plane_row(frame, 2, ch, r);
+                } else if (frame->format == PIXEL_FORMAT_I420) {
+                    cb[i] = pad_row(cbband + i * cwp, plane_row(frame, 1, ch, r), cw, cwp);
+                    cr[i] = pad_row(crband + i * cwp, plane_row(frame, 2, ch, r), cw, cwp);
+                } else {
+                    cb[i] = cbband + i * cwp;
+                    cr[i] = crband + i * cwp;
+                    split_uv_row(cb[i], cr[i], plane_row(frame, 1, ch, r), cw, cwp);
+                }
+            }
+            break;
+        case PIXEL_FORMAT_YUY2:
+            for (i = 0; i < 8; i++) {
+                y[i] = yband + i * yw;
+                cb[i] = cbband + i * cwp;
+                cr[i] = crband + i * cwp;
+                split_yuy2_row(y[i], cb[i], cr[i], plane_row(frame, 0, h, j + i),
+                               w, yw, cwp);
+            }
+            break;
+        default:
+            break;
+        }
+        jpeg_write_raw_data(cinfo, planes, mcu_h);
+    }
+    jpeg_finish_compress(cinfo);
+    return (int)(codec->dest.size - codec->dest.pub.free_in_buffer);
+}
+
+static int frame_check(const struct video_frame *frame, int quality)
+{
+    if (!frame || frame->width == 0 || frame->height == 0 ||
+        quality < 1 || quality > 100) {
+        return -1;
+    }
+    switch (frame->format) {
+    case PIXEL_FORMAT_I420:
+    case PIXEL_FORMAT_NV12:
+    case PIXEL_FORMAT_YUY2:
+        return 0;
+    default:
+        loge("unsupported pixel format %s!\n", pixel_format_to_string(frame->format));
+        return -1;
+    }
+}
+
+size_t je_encode_bound(uint32_t width, uint32_t height)
+{
+    /* 4:2:2 worst case as libjpeg-turbo tjBufSize, plus RSTn of each stripe */
+    return (size_t)ALIGN2(width, 16) * ALIGN2(height, 16) * 2 + 2048 + 4 * JE_MAX_STRIPES;
+}
+
+int je_encode_frame(struct je_codec *codec, const struct video_frame *frame,
+                    int quality, uint8_t *out, size_t size)
+{
+    if (!codec || !out || frame_check(frame, quality)) {
+        loge("invalid paraments!\n");
+        return -1;
+    }
+    return encode_rows(codec, frame, 0, frame->height, quality, 0, out, size, 0);
+}
+
+struct je_job {
+    const struct video_frame *frame;
+    int quality;
+    unsigned int restart;
+    int pending;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+struct je_stripe {
+    struct je_job *job;
+    struct je_codec *codec;
+    uint32_t y;
+    uint32_t rows;
+    int len;
+};
+
+static void stripe_task(void *arg)
+{
+    struct je_stripe *s = (struct je_stripe *)arg;
+    struct je_job *job = s->job;
+    struct je_codec *codec = s->codec;
+    /* q60 4:2:0 is well under a byte per pixel, the scratch grows if not */
+    size_t size = (size_t)job->frame->width * s->rows / 2 + 4096;
+
+    if (codec->scratch_size < size) {
+        uint8_t *buf = realloc(codec->scratch, size);
+        if (buf) {
+            codec->scratch = buf;
+            codec->scratch_size = size;
+        }
+    }
+    if (codec->scratch) {
+        s->len = encode_rows(codec, job->frame, s->y, s->rows, job->quality,
+                             job->restart, codec->scratch, codec->scratch_size, 1);
+    } else {
+        s->len = -1;
+    }
+    pthread_mutex_lock(&job->lock);
+    if (--job->pending == 0) {
+        pthread_cond_signal(&job->cond);
+    }
+    pthread_mutex_unlock(&job->lock);
+}
+
+/* offset of the SOFn segment and the first entropy coded byte */
+static int parse_header(const uint8_t *p, size_t len, size_t *sof, size_t *data)
+{
+    size_t i = 2;
+    while (i + 4 <= len && p[i] == 0xFF) {
+        uint8_t m = p[i + 1];
+        size_t seg = (p[i + 2] << 8) | p[i + 3];
+        if (m >= 0xC0 && m <= 0xC2) {
+            *sof = i;
+        }
+        i += 2 + seg;
+        if (m == 0xDA) {
+            *data = i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+struct je_encoder *je_encoder_create(int stripes)
+{
+    struct je_encoder *enc = CALLOC(1, struct je_encoder);
+    if (!enc) {
+        loge("malloc jpeg encoder failed!\n");
+        return NULL;
+    }
+    pthread_mutex_init(&enc->lock, NULL);
+    if (stripes != 1) {
+        enc->workq = workq_pool_create();
+        if (!enc->workq) {
+            loge("workq_pool_create failed, encode in caller thread!\n");
+        } else if (stripes <= 0) {
+            stripes = enc->workq->cpus;
+        }
+    }
+    if (stripes < 1 || !enc->workq) {
+        stripes = 1;
+    }
+    enc->stripes = stripes > JE_MAX_STRIPES ? JE_MAX_STRIPES : stripes;
+    return enc;
+}
+
+void je_encoder_destroy(struct je_encoder *enc)
+{
+    struct je_codec *codec;
+    if (!enc) {
+        return;
+    }
+    if (enc->workq) {
+        workq_pool_destroy(enc->workq);
+    }
+    while (enc->free_list) {
+        codec = enc->free_list;
+        enc->free_list = codec->next;
+        je_codec_destroy(codec);
+    }
+    pthread_mutex_destroy(&enc->lock);
+    free(enc);
+}
+
+struct je_codec *je_encoder_get_codec(struct je_encoder *enc)
+{
+    struct je_codec *codec;
+    pthread_mutex_lock(&enc->lock);
+    codec = enc->free_list;
+    if (codec) {
+        enc->free_list = codec->next;
+    }
+    pthread_mutex_unlock(&enc->lock);
+    if (!codec) {
+        codec = je_codec_create();
+    }
+    return codec;
+}
+
+void je_encoder_put_codec(struct je_encoder *enc, struct je_codec *codec)
+{
+    if (!codec) {
+        return;
+    }
+    pthread_mutex_lock(&enc->lock);
+    codec->next = enc->free_list;
+    enc->free_list = codec;
+    pthread_mutex_unlock(&enc->lock);
+}
+
+int je_encoder_encode(struct je_encoder *enc, const struct video_frame *frame,
+                      int quality, uint8_t *out, size_t size)
+{
+    struct je_stripe stripe[JE_MAX_STRIPES];
+    struct je_job job;
+    struct je_codec *codec;
+    uint32_t mcu_h, mcu_rows, mcu_cols, rows = 0;
+    size_t sof, data, pos;
+    int i, n, len = -1;
+
+    if (!enc || !out || frame_check(frame, quality)) {
+        loge("invalid paraments!\n");
+        return -1;
+    }
+    mcu_h = (frame->format == PIXEL_FORMAT_YUY2) ? 8 : 16;
+    mcu_rows = (frame->height + mcu_h - 1) / mcu_h;
+    mcu_cols = (frame->width + 15) / 16;
+    n = enc->stripes;
+    if ((uint64_t)frame->width * frame->height < JE_STRIPE_MIN_PIXELS ||
+        mcu_cols > JE_MAX_RESTART) {
+        n = 1;
+    }
+    if (n > 1) {
+        /* one restart interval per stripe, DRI holds 16 bits */
+        rows = (mcu_rows + n - 1) / n;
+        if (rows * mcu_cols > JE_MAX_RESTART) {
+            rows = JE_MAX_RESTART / mcu_cols;
+        }
+        n = (mcu_rows + rows - 1) / rows;
+    }
+    if (n <= 1 || n > JE_MAX_STRIPES) {
+        codec = je_encoder_get_codec(enc);
+        if (!codec) {
+            return -1;
+        }
+        len = encode_rows(codec, frame, 0, frame->height, quality, 0, out, size, 0);
+        je_encoder_put_codec(enc, codec);
+        return len;
+    }
+
+    job.frame = frame;
+    job.quality = quality;
+    job.restart = rows * mcu_cols;
+    job.pending = n - 1;
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_cond_init(&job.cond, NULL);
+    for (i = 0; i < n; i++) {
+        stripe[i].job = &job;
+        stripe[i].codec = je_encoder_get_codec(enc);
+        stripe[i].y = i * rows * mcu_h;
+        stripe[i].rows = (i == n - 1) ? frame->height - stripe[i].y : rows * mcu_h;
+        stripe[i].len = -1;
+    }
+    for (i = 1; i < n; i++) {
+        if (!stripe[i].codec || workq_pool_task_push(enc->workq, stripe_task, &stripe[i])) {
+            if (stripe[i].codec) {
+                stripe_task(&stripe[i]);
+            } else {
+                pthread_mutex_lock(&job.lock);
+                job.pending--;
+                pthread_mutex_unlock(&job.lock);
+            }
+        }
+    }
+    /* first stripe goes straight to the caller buffer and carries the header */
+    if (stripe[0].codec) {
+        stripe[0].len = encode_rows(stripe[0].codec, frame, 0, stripe[0].rows,
+                                    quality, job.restart, out, size, 0);
+    }
+    pthread_mutex_lock(&job.lock);
+    while (job.pending > 0) {
+        pthread_cond_wait(&job.cond, &job.lock);
+    }
+    pthread_mutex_unlock(&job.lock);
+
+    if (stripe[0].len < 4 || parse_header(out, stripe[0].len, &sof, &data)) {
+        goto end;
+    }
+    out[sof + 5] = frame->height >> 8;
+    out[sof + 6] = frame->height & 0xFF;
+    pos = stripe[0].len - 2;    /* drop EOI */
+    for (i = 1; i < n; i++) {
+        const uint8_t *p = stripe[i].codec ? stripe[i].codec->scratch : NULL;
+        size_t seg;
+        if (stripe[i].len < 4 || parse_header(p, stripe[i].len, &sof, &data)) {
+            goto end;
+        }
+        seg = stripe[i].len - 2 - data;
+        if (pos + 2 + seg + 2 > size) {
+            loge("jpeg output buffer too small!\n");
+            goto end;
+        }
+        out[pos++] = 0xFF;
+        out[pos++] = 0xD0 + ((i - 1) & 7);
+        memcpy(out + pos, p + data, seg);
+        pos += seg;
+    }
+    out[pos++] = 0xFF;
+    out[pos++] = 0xD9;
+    len = (int)pos;
+
+end:
+    for (i = 0; i < n; i++) {
+        je_encoder_put_codec(enc, stripe[i].codec);
+    }
+    pthread_mutex_destroy(&job.lock);
+    pthread_cond_destroy(&job.cond);
+    return len;
+}
@@ -12,7 +12,11 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <stdint.h>
+#include <setjmp.h>
+#include <pthread.h>
 #include <jpeglib.h>
+#include <libmedia-io.h>
+#include <libworkq.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -61,10 +65,44 @@ struct je_yuv {
     int pitch;
 };
 
+/*
+ * destination writing straight into a memory buffer, grows only when the
+ * buffer is the codec's own stripe scratch
+ */
+struct je_dest {
+    struct jpeg_destination_mgr   pub;
+    uint8_t                      *buf;
+    size_t                        size;
+    int                           grow;
+};
+
 struct je_codec {
     struct jpeg_compress_struct   encoder;
     struct jpeg_decompress_struct decoder;
     struct jpeg_error_mgr         errmgr;
+    jmp_buf                       jmp;
+    struct je_dest                dest;
+    uint8_t                      *band;     /* deinterleaved MCU rows */
+    size_t                        band_size;
+    uint8_t                      *scratch;  /* stripe output */
+    size_t                        scratch_size;
+    struct je_codec              *next;     /* je_encoder pool link */
+};
+
+/*
+ * je_encoder: pool of reusable codecs plus libworkq threads, frames larger
+ * than JE_STRIPE_MIN_PIXELS are cut into horizontal stripes of whole MCU
+ * rows, every stripe is one restart interval and is encoded in parallel,
+ * the entropy segments are then joined with RSTn markers under one header
+ */
+#define JE_DEFAULT_QUALITY      60
+#define JE_STRIPE_MIN_PIXELS    (1920 * 1080)
+
+struct je_encoder {
+    struct je_codec              *free_list;
+    pthread_mutex_t               lock;
+    struct workq_pool            *workq;
+    int                           stripes;
 };
 
 
@@ -88,6 +126,25 @@ int je_get_yuv_from_mem();
 int je_encode_yuv_to_jpeg(struct je_codec *codec, struct je_yuv *in, struct je_jpeg *out);
 int je_decode_jpeg_to_yuv(struct je_codec *codec, struct je_jpeg *in, struct je_yuv *out);
 
+/*
+ * encode I420/NV12/YUY2 frame from its strided planes into out,
+ * return bytes written, -1 on error or when out is too small
+ */
+size_t je_encode_bound(uint32_t width, uint32_t height);
+int je_encode_frame(struct je_codec *codec, const struct video_frame *frame,
+                    int quality, uint8_t *out, size_t size);
+
+/*
+ * stripes is the max parallel stripes per frame, 0 means one per cpu,
+ * 1 disables libworkq, je_encoder_encode is safe to call from many threads
+ */
+struct je_encoder *je_encoder_create(int stripes);
+void je_encoder_destroy(struct je_encoder *enc);
+struct je_codec *je_encoder_get_codec(struct je_encoder *enc);
+void je_encoder_put_codec(struct je_encoder *enc, struct je_codec *codec);
+int je_encoder_encode(struct je_encoder *enc, const struct video_frame *frame,
+                      int quality, uint8_t *out, size_t size);
+
 
 
 #ifdef __cplusplus
@@ -10,6 +10,8 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <string.h>
+#include <time.h>
 #include "libjpeg-ex.h"
 #define WIDTH 	1920
 #define HEIGH	1080
@@ -172,8 +174,83 @@ void foo2()
 
 }
 
+static uint64_t now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void fill_frame(struct video_frame *frame)
+{
+    uint32_t x, y, p;
+    for (p = 0; p < frame->planes; p++) {
+        uint32_t w = frame->linesize[p];
+        uint32_t h = frame->height;
+        if (p > 0 && frame->format != PIXEL_FORMAT_YUY2) {
+            h = (h + 1) / 2;
+        }
+        for (y = 0; y < h; y++) {
+            for (x = 0; x < w; x++) {
+                frame->data[p][y * w + x] = (x * (p + 1) + y * 3 + (x ^ y) / 8) & 0xFF;
+            }
+        }
+    }
+}
+
+static void foo_snapshot(enum pixel_format fmt, uint32_t width, uint32_t height, int loop)
+{
+    struct video_frame *frame;
+    struct je_codec *codec;
+    struct je_encoder *enc;
+    size_t size = je_encode_bound(width, height);
+    uint8_t *out = malloc(size);
+    uint64_t start;
+    int i, len1 = 0, len2 = 0;
+    char name[64];
+    struct je_jpeg jpeg;
+
+    frame = video_frame_create(fmt, width, height, MEDIA_MEM_DEEP);
+    if (!frame || !out) {
+        printf("video_frame_create failed!\n");
+        return;
+    }
+    fill_frame(frame);
+
+    codec = je_codec_create();
+    start = now_us();
+    for (i = 0; i < loop; i++) {
+        len1 = je_encode_frame(codec, frame, JE_DEFAULT_QUALITY, out, size);
+    }
+    printf("%s %ux%u single: %d bytes, %.1f fps\n", pixel_format_to_string(fmt),
+           width, height, len1, loop * 1000000.0 / (now_us() - start));
+    je_codec_destroy(codec);
+
+    enc = je_encoder_create(4);
+    start = now_us();
+    for (i = 0; i < loop; i++) {
+        len2 = je_encoder_encode(enc, frame, JE_DEFAULT_QUALITY, out, size);
+    }
+    printf("%s %ux%u striped: %d bytes, %.1f fps\n", pixel_format_to_string(fmt),
+           width, height, len2, loop * 1000000.0 / (now_us() - start));
+    je_encoder_destroy(enc);
+
+    if (len2 > 0) {
+        snprintf(name, sizeof(name), "%ux%u_%s.jpeg", width, height,
+                 pixel_format_to_string(fmt));
+        jpeg.data.iov_base = out;
+        jpeg.data.iov_len = len2;
+        save_jpeg_file(name, &jpeg);
+    }
+    video_frame_destroy(frame);
+    free(out);
+}
+
 int main(int argc, char **argv)
 {
     foo2();
+    foo_snapshot(PIXEL_FORMAT_I420, 1920, 1080, 30);
+    foo_snapshot(PIXEL_FORMAT_NV12, 3840, 2160, 10);
+    foo_snapshot(PIXEL_FORMAT_YUY2, 4000, 3000, 10);
     return 0;
 }
@@ -22,6 +22,7 @@
 #include <libposix.h>
 #include "liblog.h"
 #include "color.h"
+#include <libtime.h>
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -237,20 +238,19 @@ static void log_get_time(char *str, int len, int flag_name)
     struct tm now_tm;
     int now_ms;
     time_t now_sec;
+
+    if (flag_name == 0) {
+        /* per line: reuse the thread's cached string, no localtime/strftime */
+        snprintf(str, len, "[%s]", time_cached_str(1));
+        return;
+    }
     gettimeofday(&tv, NULL);
     now_sec = tv.tv_sec;
     now_ms = tv.tv_usec/1000;
     localtime_r(&now_sec, &now_tm);
-
-    if (flag_name == 0) {
-        strftime(date_fmt, 20, "%Y-%m-%d %H:%M:%S", &now_tm);
-        snprintf(date_ms, sizeof(date_ms), "%03d", now_ms);
-        snprintf(str, len, "[%s.%s]", date_fmt, date_ms);
-    } else {
-        strftime(date_fmt, 20, "%Y_%m_%d_%H_%M_%S", &now_tm);
-        snprintf(date_ms, sizeof(date_ms), "%03d", now_ms);
-        snprintf(str, len, "%s_%s.log", date_fmt, date_ms);
-    }
+    strftime(date_fmt, 20, "%Y_%m_%d_%H_%M_%S", &now_tm);
+    snprintf(date_ms, sizeof(date_ms), "%03d", now_ms);
+    snprintf(str, len, "%s_%s.log", date_fmt, date_ms);
 }
 
 static const char *get_dir(const char *path)
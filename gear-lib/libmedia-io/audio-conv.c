@@ -0,0 +1,1365 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#include "libmedia-io.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#define ACONV_SIMD_X86
+#include <immintrin.h>
+#elif (defined (__ARM_NEON) || defined (__ARM_NEON__)) && !defined (__ARM_BIG_ENDIAN)
+#define ACONV_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined (_WIN32) || defined (ACONV_SIMD_X86) || defined (ACONV_SIMD_NEON) || \
+    (defined (__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define ACONV_HOST_LE
+#endif
+
+#define ACONV_BLOCK         256     /* frames per conversion step */
+#define ACONV_MAX_PHASES    4096
+#define ACONV_BASE_TAPS     32
+#define ACONV_CUTOFF        0.97
+
+#define S16_SCALE           (1.0f / 32768.0f)
+#define S24_SCALE           (1.0f / 8388608.0f)
+#define S32_SCALE           (1.0 / 2147483648.0)
+
+#define ALIGN_SIZE(size, align) (((size) + (align - 1)) & (~(align - 1)))
+
+#ifndef M_PI
+#define M_PI                3.14159265358979323846
+#endif
+#ifndef M_SQRT1_2
+#define M_SQRT1_2           0.70710678118654752440
+#endif
+
+struct aconv_kernels {
+    void (*s16_to_f32)(const uint8_t *in, float *out, int n);
+    void (*s16x2_to_f32)(const uint8_t *in, float *l, float *r, int n);
+    void (*f32_to_s16)(const float *in, uint8_t *out, int n);
+    void (*f32x2_to_s16)(const float *l, const float *r, uint8_t *out, int n);
+    void (*f32x2_split)(const uint8_t *in, float *l, float *r, int n);
+    void (*f32x2_merge)(const float *l, const float *r, uint8_t *out, int n);
+    void (*mix)(float *acc, const float *in, float gain, int n);
+    float (*dot)(const float *a, const float *b, int n);
+};
+
+static int16_t alaw_tbl[256];
+static int16_t ulaw_tbl[256];
+
+static inline float clampf(float v)
+{
+    return (v < -1.0f) ? -1.0f : ((v > 1.0f) ? 1.0f : v);
+}
+
+static inline int16_t f32_to_s16_1(float v)
+{
+    v *= 32768.0f;
+    v = (v > 32767.0f) ? 32767.0f : v;
+    v = (v < -32768.0f) ? -32768.0f : v;
+    return (int16_t)lrintf(v);
+}
+
+/******************************************************************************
+ * G.711
+ ******************************************************************************/
+static int16_t alaw2linear(uint8_t a)
+{
+    int t, seg;
+
+    a ^= 0x55;
+    t = (a & 0x0f) << 4;
+    seg = (a & 0x70) >> 4;
+    switch (seg) {
+    case 0:
+        t += 8;
+        break;
+    case 1:
+        t += 0x108;
+        break;
+    default:
+        t += 0x108;
+        t <<= seg - 1;
+        break;
+    }
+    return (a & 0x80) ? t : -t;
+}
+
+static int16_t ulaw2linear(uint8_t u)
+{
+    int t;
+
+    u = ~u;
+    t = ((u & 0x0f) << 3) + 0x84;
+    t <<= (u & 0x70) >> 4;
+    return (u & 0x80) ? (0x84 - t) : (t - 0x84);
+}
+
+static int g711_seg(int v, const int16_t *end)
+{
+    int i;
+    for (i = 0; i < 8; i++) {
+        if (v <= end[i]) {
+            break;
+        }
+    }
+    return i;
+}
+
+static uint8_t linear2alaw(int16_t pcm)
+{
+    static const int16_t seg_end[8] = {0x1F, 0x3F, 0x7F, 0xFF, 0x1FF, 0x3FF, 0x7FF, 0xFFF};
+    int mask, seg, p = pcm >> 3;
+    uint8_t aval;
+
+    if (p >= 0) {
+        mask = 0xD5;
+    } else {
+        mask = 0x55;
+        p = -p - 1;
+    }
+    seg = g711_seg(p, seg_end);
+    if (seg >= 8) {
+        return 0x7F ^ mask;
+    }
+    aval = seg << 4;
+    aval |= (seg < 2) ? ((p >> 1) & 0xf) : ((p >> seg) & 0xf);
+    return aval ^ mask;
+}
+
+static uint8_t linear2ulaw(int16_t pcm)
+{
+    static const int16_t seg_end[8] = {0x3F, 0x7F, 0xFF, 0x1FF, 0x3FF, 0x7FF, 0xFFF, 0x1FFF};
+    int mask, seg, p = pcm >> 2;
+
+    if (p < 0) {
+        p = -p;
+        mask = 0x7F;
+    } else {
+        mask = 0xFF;
+    }
+    if (p > 8159) {
+        p = 8159;
+    }
+    p += 0x84 >> 2;
+    seg = g711_seg(p, seg_end);
+    if (seg >= 8) {
+        return 0x7F ^ mask;
+    }
+    return ((seg << 4) | ((p >> (seg + 1)) & 0xf)) ^ mask;
+}
+
+/******************************************************************************
+ * C kernels, also used for the tail of SIMD loops.
+ * S16/F32 kernels read little endian memory and are only used on LE hosts.
+ ******************************************************************************/
+static void s16_to_f32_c(const uint8_t *in, float *out, int n)
+{
+    int i;
+    int16_t v;
+    for (i = 0; i < n; i++) {
+        memcpy(&v, in + 2 * i, 2);
+        out[i] = (float)v * S16_SCALE;
+    }
+}
+
+static void s16x2_to_f32_c(const uint8_t *in, float *l, float *r, int n)
+{
+    int i;
+    int16_t v[2];
+    for (i = 0; i < n; i++) {
+        memcpy(v, in + 4 * i, 4);
+        l[i] = (float)v[0] * S16_SCALE;
+        r[i] = (float)v[1] * S16_SCALE;
+    }
+}
+
+static void f32_to_s16_c(const float *in, uint8_t *out, int n)
+{
+    int i;
+    int16_t v;
+    for (i = 0; i < n; i++) {
+        v = f32_to_s16_1(in[i]);
+        memcpy(out + 2 * i, &v, 2);
+    }
+}
+
+static void f32x2_to_s16_c(const float *l, const float *r, uint8_t *out, int n)
+{
+    int i;
+    int16_t v[2];
+    for (i = 0; i < n; i++) {
+        v[0] = f32_to_s16_1(l[i]);
+        v[1] = f32_to_s16_1(r[i]);
+        memcpy(out + 4 * i, v, 4);
+    }
+}
+
+static void f32x2_split_c(const uint8_t *in, float *l, float *r, int n)
+{
+    int i;
+    float v[2];
+    for (i = 0; i < n; i++) {
+        memcpy(v, in + 8 * i, 8);
+        l[i] = v[0];
+        r[i] = v[1];
+    }
+}
+
+static void f32x2_merge_c(const float *l, const float *r, uint8_t *out, int n)
+{
+    int i;
+    float v[2];
+    for (i = 0; i < n; i++) {
+        v[0] = l[i];
+        v[1] = r[i];
+        memcpy(out + 8 * i, v, 8);
+    }
+}
+
+static void mix_c(float *acc, const float *in, float gain, int n)
+{
+    int i;
+    for (i = 0; i < n; i++) {
+        acc[i] += in[i] * gain;
+    }
+}
+
+static float dot_c(const float *a, const float *b, int n)
+{
+    int i;
+    float s = 0.0f;
+    for (i = 0; i < n; i++) {
+        s += a[i] * b[i];
+    }
+    return s;
+}
+
+/******************************************************************************
+ * SSE2 / AVX
+ ******************************************************************************/
+#if defined (ACONV_SIMD_X86)
+__attribute__((target("sse2")))
+static void s16_to_f32_sse2(const uint8_t *in, float *out, int n)
+{
+    int i;
+    const __m128 k = _mm_set1_ps(S16_SCALE);
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + 2 * i));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(out + i,     _mm_mul_ps(_mm_cvtepi32_ps(lo), k));
+        _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), k));
+    }
+    s16_to_f32_c(in + 2 * i, out + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void s16x2_to_f32_sse2(const uint8_t *in, float *l, float *r, int n)
+{
+    int i;
+    const __m128 k = _mm_set1_ps(S16_SCALE);
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + 4 * i));
+        __m128i vl = _mm_srai_epi32(_mm_slli_epi32(v, 16), 16);
+        __m128i vr = _mm_srai_epi32(v, 16);
+        _mm_storeu_ps(l + i, _mm_mul_ps(_mm_cvtepi32_ps(vl), k));
+        _mm_storeu_ps(r + i, _mm_mul_ps(_mm_cvtepi32_ps(vr), k));
+    }
+    s16x2_to_f32_c(in + 4 * i, l + i, r + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static inline __m128i f32x4_to_s32_sse2(__m128 v)
+{
+    v = _mm_mul_ps(v, _mm_set1_ps(32768.0f));
+    v = _mm_min_ps(v, _mm_set1_ps(32767.0f));
+    v = _mm_max_ps(v, _mm_set1_ps(-32768.0f));
+    return _mm_cvtps_epi32(v);
+}
+
+__attribute__((target("sse2")))
+static void f32_to_s16_sse2(const float *in, uint8_t *out, int n)
+{
+    int i;
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m128i lo = f32x4_to_s32_sse2(_mm_loadu_ps(in + i));
+        __m128i hi = f32x4_to_s32_sse2(_mm_loadu_ps(in + i + 4));
+        _mm_storeu_si128((__m128i *)(out + 2 * i), _mm_packs_epi32(lo, hi));
+    }
+    f32_to_s16_c(in + i, out + 2 * i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void f32x2_to_s16_sse2(const float *l, const float *r, uint8_t *out, int n)
+{
+    int i;
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m128i vl = f32x4_to_s32_sse2(_mm_loadu_ps(l + i));
+        __m128i vr = f32x4_to_s32_sse2(_mm_loadu_ps(r + i));
+        __m128i lo = _mm_unpacklo_epi32(vl, vr);
+        __m128i hi = _mm_unpackhi_epi32(vl, vr);
+        _mm_storeu_si128((__m128i *)(out + 4 * i), _mm_packs_epi32(lo, hi));
+    }
+    f32x2_to_s16_c(l + i, r + i, out + 4 * i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void f32x2_split_sse2(const uint8_t *in, float *l, float *r, int n)
+{
+    int i;
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m128 a = _mm_loadu_ps((const float *)(in + 8 * i));
+        __m128 b = _mm_loadu_ps((const float *)(in + 8 * i + 16));
+        _mm_storeu_ps(l + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps(r + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+    f32x2_split_c(in + 8 * i, l + i, r + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void f32x2_merge_sse2(const float *l, const float *r, uint8_t *out, int n)
+{
+    int i;
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m128 a = _mm_loadu_ps(l + i);
+        __m128 b = _mm_loadu_ps(r + i);
+        _mm_storeu_ps((float *)(out + 8 * i),      _mm_unpacklo_ps(a, b));
+        _mm_storeu_ps((float *)(out + 8 * i + 16), _mm_unpackhi_ps(a, b));
+    }
+    f32x2_merge_c(l + i, r + i, out + 8 * i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void mix_sse2(float *acc, const float *in, float gain, int n)
+{
+    int i;
+    const __m128 g = _mm_set1_ps(gain);
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m128 v = _mm_mul_ps(_mm_loadu_ps(in + i), g);
+        _mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), v));
+    }
+    mix_c(acc + i, in + i, gain, n - i);
+}
+
+__attribute__((target("sse2")))
+static float dot_sse2(const float *a, const float *b, int n)
+{
+    int i;
+    float s[4];
+    __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+    for (i = 0; i + 8 <= n; i += 8) {
+        s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a + i),     _mm_loadu_ps(b + i)));
+        s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    _mm_storeu_ps(s, _mm_add_ps(s0, s1));
+    return s[0] + s[1] + s[2] + s[3] + dot_c(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx")))
+static void mix_avx(float *acc, const float *in, float gain, int n)
+{
+    int i;
+    const __m256 g = _mm256_set1_ps(gain);
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_mul_ps(_mm256_loadu_ps(in + i), g);
+        _mm256_storeu_ps(acc + i, _mm256_add_ps(_mm256_loadu_ps(acc + i), v));
+    }
+    mix_c(acc + i, in + i, gain, n - i);
+}
+
+__attribute__((target("avx")))
+static float dot_avx(const float *a, const float *b, int n)
+{
+    int i;
+    float s[4];
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+    __m128 r;
+    for (i = 0; i + 16 <= n; i += 16) {
+        s0 = _mm256_add_ps(s0, _mm256_mul_ps(_mm256_loadu_ps(a + i),     _mm256_loadu_ps(b + i)));
+        s1 = _mm256_add_ps(s1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8)));
+    }
+    s0 = _mm256_add_ps(s0, s1);
+    r = _mm_add_ps(_mm256_castps256_ps128(s0), _mm256_extractf128_ps(s0, 1));
+    _mm_storeu_ps(s, r);
+    return s[0] + s[1] + s[2] + s[3] + dot_c(a + i, b + i, n - i);
+}
+
+/******************************************************************************
+ * NEON
+ ******************************************************************************/
+#elif defined (ACONV_SIMD_NEON)
+static void s16_to_f32_neon(const uint8_t *in, float *out, int n)
+{
+    int i;
+    for (i = 0; i + 8 <= n; i += 8) {
+        int16x8_t v = vld1q_s16((const int16_t *)(in + 2 * i));
+        vst1q_f32(out + i,     vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), S16_SCALE));
+        vst1q_f32(out + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), S16_SCALE));
+    }
+    s16_to_f32_c(in + 2 * i, out + i, n - i);
+}
+
+static void s16x2_to_f32_neon(const uint8_t *in, float *l, float *r, int n)
+{
+    int i;
+    for (i = 0; i + 4 <= n; i += 4) {
+        int16x4x2_t v = vld2_s16((const int16_t *)(in + 4 * i));
+        vst1q_f32(l + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(v.val[0])), S16_SCALE));
+        vst1q_f32(r + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(v.val[1])), S16_SCALE));
+    }
+    s16x2_to_f32_c(in + 4 * i, l + i, r + i, n - i);
+}
+
+static inline int16x4_t f32x4_to_s16_neon(float32x4_t v)
+{
+    /* round to nearest like lrintf, vcvtq rounds toward zero */
+    int32x4_t i;
+    v = vmulq_n_f32(v, 32768.0f);
+    v = vminq_f32(v, vdupq_n_f32(32767.0f));
+    v = vmaxq_f32(v, vdupq_n_f32(-32768.0f));
+#if defined (__aarch64__)
+    i = vcvtnq_s32_f32(v);
+#else
+    i = vcvtq_s32_f32(vaddq_f32(v, vbslq_f32(vcltq_f32(v, vdupq_n_f32(0.0f)),
+                    vdupq_n_f32(-0.5f), vdupq_n_f32(0.5f))));
+#endif
+    return vqmovn_s32(i);
+}
+
+static void f32_to_s16_neon(const float *in, uint8_t *out, int n)
+{
+    int i;
+    for (i = 0; i + 8 <= n; i += 8) {
+        int16x4_t lo = f32x4_to_s16_neon(vld1q_f32(in + i));
+        int16x4_t hi = f32x4_to_s16_neon(vld1q_f32(in + i + 4));
+        vst1q_s16((int16_t *)(out + 2 * i), vcombine_s16(lo, hi));
+    }
+    f32_to_s16_c(in + i, out + 2 * i, n - i);
+}
+
+static void f32x2_to_s16_neon(const float *l, const float *r, uint8_t *out, int n)
+{
+    int i;
+    int16x4x2_t v;
+    for (i = 0; i + 4 <= n; i += 4) {
+        v.val[0] = f32x4_to_s16_neon(vld1q_f32(l + i));
+        v.val[1] = f32x4_to_s16_neon(vld1q_f32(r + i));
+        vst2_s16((int16_t *)(out + 4 * i), v);
+    }
+    f32x2_to_s16_c(l + i, r + i, out + 4 * i, n - i);
+}
+
+static void f32x2_split_neon(const uint8_t *in, float *l, float *r, int n)
+{
+    int i;
+    for (i = 0; i + 4 <= n; i += 4) {
+        float32x4x2_t v = vld2q_f32((const float *)(in + 8 * i));
+        vst1q_f32(l + i, v.val[0]);
+        vst1q_f32(r + i, v.val[1]);
+    }
+    f32x2_split_c(in + 8 * i, l + i, r + i, n - i);
+}
+
+static void f32x2_merge_neon(const float *l, const float *r, uint8_t *out, int n)
+{
+    int i;
+    float32x4x2_t v;
+    for (i = 0; i + 4 <= n; i += 4) {
+        v.val[0] = vld1q_f32(l + i);
+        v.val[1] = vld1q_f32(r + i);
+        vst2q_f32((float *)(out + 8 * i), v);
+    }
+    f32x2_merge_c(l + i, r + i, out + 8 * i, n - i);
+}
+
+static void mix_neon(float *acc, const float *in, float gain, int n)
+{
+    int i;
+    for (i = 0; i + 4 <= n; i += 4) {
+        float32x4_t v = vmulq_n_f32(vld1q_f32(in + i), gain);
+        vst1q_f32(acc + i, vaddq_f32(vld1q_f32(acc + i), v));
+    }
+    mix_c(acc + i, in + i, gain, n - i);
+}
+
+static float dot_neon(const float *a, const float *b, int n)
+{
+    int i;
+    float s[4];
+    float32x4_t s0 = vdupq_n_f32(0.0f), s1 = vdupq_n_f32(0.0f);
+    for (i = 0; i + 8 <= n; i += 8) {
+        s0 = vmlaq_f32(s0, vld1q_f32(a + i),     vld1q_f32(b + i));
+        s1 = vmlaq_f32(s1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    vst1q_f32(s, vaddq_f32(s0, s1));
+    return s[0] + s[1] + s[2] + s[3] + dot_c(a + i, b + i, n - i);
+}
+#endif
+
+static struct aconv_kernels aconv_k;
+static pthread_once_t aconv_k_once = PTHREAD_ONCE_INIT;
+
+static void aconv_kernels_init(void)
+{
+    int i;
+
+    for (i = 0; i < 256; i++) {
+        alaw_tbl[i] = alaw2linear(i);
+        ulaw_tbl[i] = ulaw2linear(i);
+    }
+    aconv_k.s16_to_f32   = s16_to_f32_c;
+    aconv_k.s16x2_to_f32 = s16x2_to_f32_c;
+    aconv_k.f32_to_s16   = f32_to_s16_c;
+    aconv_k.f32x2_to_s16 = f32x2_to_s16_c;
+    aconv_k.f32x2_split  = f32x2_split_c;
+    aconv_k.f32x2_merge  = f32x2_merge_c;
+    aconv_k.mix          = mix_c;
+    aconv_k.dot          = dot_c;
+#if defined (ACONV_SIMD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        aconv_k.s16_to_f32   = s16_to_f32_sse2;
+        aconv_k.s16x2_to_f32 = s16x2_to_f32_sse2;
+        aconv_k.f32_to_s16   = f32_to_s16_sse2;
+        aconv_k.f32x2_to_s16 = f32x2_to_s16_sse2;
+        aconv_k.f32x2_split  = f32x2_split_sse2;
+        aconv_k.f32x2_merge  = f32x2_merge_sse2;
+        aconv_k.mix          = mix_sse2;
+        aconv_k.dot          = dot_sse2;
+    }
+    if (__builtin_cpu_supports("avx")) {
+        aconv_k.mix          = mix_avx;
+        aconv_k.dot          = dot_avx;
+    }
+#elif defined (ACONV_SIMD_NEON)
+    aconv_k.s16_to_f32   = s16_to_f32_neon;
+    aconv_k.s16x2_to_f32 = s16x2_to_f32_neon;
+    aconv_k.f32_to_s16   = f32_to_s16_neon;
+    aconv_k.f32x2_to_s16 = f32x2_to_s16_neon;
+    aconv_k.f32x2_split  = f32x2_split_neon;
+    aconv_k.f32x2_merge  = f32x2_merge_neon;
+    aconv_k.mix          = mix_neon;
+    aconv_k.dot          = dot_neon;
+#endif
+}
+
+static const struct aconv_kernels *aconv_kernels(void)
+{
+    pthread_once(&aconv_k_once, aconv_kernels_init);
+    return &aconv_k;
+}
+
+/******************************************************************************
+ * decode / encode one block between a frame and planar float
+ ******************************************************************************/
+static inline uint32_t rd_le(const uint8_t *p, int n)
+{
+    uint32_t v = 0;
+    while (n--) {
+        v = (v << 8) | p[n];
+    }
+    return v;
+}
+
+static inline uint32_t rd_be(const uint8_t *p, int n)
+{
+    uint32_t v = 0;
+    int i;
+    for (i = 0; i < n; i++) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static inline void wr_le(uint8_t *p, uint32_t v, int n)
+{
+    int i;
+    for (i = 0; i < n; i++, v >>= 8) {
+        p[i] = v & 0xff;
+    }
+}
+
+static inline void wr_be(uint8_t *p, uint32_t v, int n)
+{
+    while (n--) {
+        p[n] = v & 0xff;
+        v >>= 8;
+    }
+}
+
+static inline float u32_to_f32(uint32_t v)
+{
+    float f;
+    memcpy(&f, &v, 4);
+    return f;
+}
+
+static inline uint32_t f32_to_u32(float f)
+{
+    uint32_t v;
+    memcpy(&v, &f, 4);
+    return v;
+}
+
+static inline int32_t f32_to_int(float v, double scale, double max)
+{
+    double d = (double)clampf(v) * scale;
+    return (int32_t)lrint(d > max ? max : d);
+}
+
+static void decode_chan(enum sample_format fmt, const uint8_t *p, int stride, float *out, int n)
+{
+    int i;
+
+    switch (fmt) {
+    case SAMPLE_FORMAT_PCM_U8:
+        for (i = 0; i < n; i++, p += stride) {
+            out[i] = (float)((int)*p - 128) * (1.0f / 128.0f);
+        }
+        break;
+    case SAMPLE_FORMAT_PCM_ALAW:
+        for (i = 0; i < n; i++, p += stride) {
+            out[i] = (float)alaw_tbl[*p] * S16_SCALE;
+        }
+        break;
+    case SAMPLE_FORMAT_PCM_ULAW:
+        for (i = 0; i < n; i++, p += stride) {
+            out[i] = (float)ulaw_tbl[*p] * S16_SCALE;
+        }
+        break;
+    case SAMPLE_FORMAT_PCM_S16LE:
+    case SAMPLE_FORMAT_PCM_S16LE_PLANAR:
+        for (i = 0; i < n; i++, p += stride) {
+            out[i] = (float)(int16_t)rd_le(p, 2) * S16_SCALE;
+        }
+        break;
+    case SAMPLE_FORMAT_PCM_S16BE:
+    case SAMPLE_FORMAT_PCM_S16BE_PLANAR:
+        for (i = 0; i < n; i++, p += stride) {
+            out[i] = (float)(int16_t)rd_be(p, 2) * S16_SCALE;
+        }
+        break;
+    case SAMPLE_FORMAT_PCM_S24LE:
+    case SAMPLE_FORMAT_PCM_S24LE_PLANAR:
+        for (i = 0; i < n; i++, p += stride) {
+            out[i] = (float)((int32_t)(rd_le(p, 3) << 8) >> 8) * S24_SCALE;
+        }
+        break;
+    case SAMPLE_FORMAT_PCM_S24BE:
+        for (i = 0; i < n; i++, p += stride) {
+            out[i] = (float)((int32_t)(rd_be(p, 3) << 8) >> 8) * S24_SCALE;
+        }
+        break;
+    case SAMPLE_FORMAT_PCM_S24_32LE:
+        for (i = 0; i < n; i++, p += stride) {
+            out[i] = (float)((int32_t)(rd_le(p, 4) << 8) >> 8) * S24_SCALE;
+        }
+        break;
+    case SAMPLE_FORMAT_PCM_S24_32BE:
+        for (i = 0; i < n; i++, p += stride) {
+            out[i] = (float)((int32_t)(rd_be(p, 4) << 8) >> 8) * S24_SCALE;
+        }
+        break;
+    case SAMPLE_FORMAT_PCM_S32LE:
+    case SAMPLE_FORMAT_PCM_S32LE_PLANAR:
+        for (i = 0; i < n; i++, p += stride) {
+            out[i] = (float)((int32_t)rd_le(p, 4) * S32_SCALE);
+        }
+        break;
+    case SAMPLE_FORMAT_PCM_S32BE:
+        for (i = 0; i < n; i++, p += stride) {
+            out[i] = (float)((int32_t)rd_be(p, 4) * S32_SCALE);
+        }
+        break;
+    case SAMPLE_FORMAT_PCM_F32LE:
+    case SAMPLE_FORMAT_PCM_F32LE_PLANAR:
+        for (i = 0; i < n; i++, p += stride) {
+            out[i] = u32_to_f32(rd_le(p, 4));
+        }
+        break;
+    case SAMPLE_FORMAT_PCM_F32BE:
+        for (i = 0; i < n; i++, p += stride) {
+            out[i] = u32_to_f32(rd_be(p, 4));
+        }
+        break;
+    default:
+        memset(out, 0, n * sizeof(float));
+        break;
+    }
+}
+
+static void encode_chan(enum sample_format fmt, const float *in, uint8_t *p, int stride, int n)
+{
+    int i;
+
+    switch (fmt) {
+    case SAMPLE_FORMAT_PCM_U8:
+        for (i = 0; i < n; i++, p += stride) {
+            *p = (uint8_t)(f32_to_int(in[i], 128.0, 127.0) + 128);
+        }
+        break;
+    case SAMPLE_FORMAT_PCM_ALAW:
+        for (i = 0; i < n; i++, p += stride) {
+            *p = linear2alaw(f32_to_s16_1(in[i]));
+        }
+        break;
+    case SAMPLE_FORMAT_PCM_ULAW:
+        for (i = 0; i < n; i++, p += stride) {
+            *p = linear2ulaw(f32_to_s16_1(in[i]));
+        }
+        break;
+    case SAMPLE_FORMAT_PCM_S16LE:
+    case SAMPLE_FORMAT_PCM_S16LE_PLANAR:
+        for (i = 0; i < n; i++, p += stride) {
+            wr_le(p, (uint16_t)f32_to_s16_1(in[i]), 2);
+        }
+        break;
+    case SAMPLE_FORMAT_PCM_S16BE:
+    case SAMPLE_FORMAT_PCM_S16BE_PLANAR:
+        for (i = 0; i < n; i++, p += stride) {
+            wr_be(p, (uint16_t)f32_to_s16_1(in[i]), 2);
+        }
+        break;
+    case SAMPLE_FORMAT_PCM_S24LE:
+    case SAMPLE_FORMAT_PCM_S24LE_PLANAR:
+    case SAMPLE_FORMAT_PCM_S24_32LE:
+        for (i = 0; i < n; i++, p += stride) {
+            wr_le(p, (uint32_t)f32_to_int(in[i], 8388608.0, 8388607.0),
+                  fmt == SAMPLE_FORMAT_PCM_S24_32LE ? 4 : 3);
+        }
+        break;
+    case SAMPLE_FORMAT_PCM_S24BE:
+    case SAMPLE_FORMAT_PCM_S24_32BE:
+        for (i = 0; i < n; i++, p += stride) {
+            wr_be(p, (uint32_t)f32_to_int(in[i], 8388608.0, 8388607.0),
+                  fmt == SAMPLE_FORMAT_PCM_S24_32BE ? 4 : 3);
+        }
+        break;
+    case SAMPLE_FORMAT_PCM_S32LE:
+    case SAMPLE_FORMAT_PCM_S32LE_PLANAR:
+        for (i = 0; i < n; i++, p += stride) {
+            wr_le(p, (uint32_t)f32_to_int(in[i], 2147483648.0, 2147483647.0), 4);
+        }
+        break;
+    case SAMPLE_FORMAT_PCM_S32BE:
+        for (i = 0; i < n; i++, p += stride) {
+            wr_be(p, (uint32_t)f32_to_int(in[i], 2147483648.0, 2147483647.0), 4);
+        }
+        break;
+    case SAMPLE_FORMAT_PCM_F32LE:
+    case SAMPLE_FORMAT_PCM_F32LE_PLANAR:
+        for (i = 0; i < n; i++, p += stride) {
+            wr_le(p, f32_to_u32(in[i]), 4);
+        }
+        break;
+    case SAMPLE_FORMAT_PCM_F32BE:
+        for (i = 0; i < n; i++, p += stride) {
+            wr_be(p, f32_to_u32(in[i]), 4);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static inline const uint8_t *chan_ptr(const struct audio_frame *f, int c, uint32_t off, int size, int *stride)
+{
+    if (sample_format_is_planar(f->format)) {
+        *stride = size;
+        return f->data[c] + (size_t)off * size;
+    }
+    *stride = size * f->channels;
+    return f->data[0] + ((size_t)off * f->channels + c) * size;
+}
+
+static void decode_block(const struct audio_frame *f, uint32_t off, int n, float *const *out)
+{
+    const struct aconv_kernels *k = aconv_kernels();
+    int c, stride, size = sample_format_size(f->format);
+    const uint8_t *p;
+
+#if defined (ACONV_HOST_LE)
+    if (f->channels == 2 && f->format == SAMPLE_FORMAT_PCM_S16LE) {
+        k->s16x2_to_f32(f->data[0] + (size_t)off * 4, out[0], out[1], n);
+        return;
+    }
+    if (f->channels == 2 && f->format == SAMPLE_FORMAT_PCM_F32LE) {
+        k->f32x2_split(f->data[0] + (size_t)off * 8, out[0], out[1], n);
+        return;
+    }
+#endif
+    for (c = 0; c < f->channels; c++) {
+        p = chan_ptr(f, c, off, size, &stride);
+#if defined (ACONV_HOST_LE)
+        if (stride == 2 && (f->format == SAMPLE_FORMAT_PCM_S16LE ||
+                            f->format == SAMPLE_FORMAT_PCM_S16LE_PLANAR)) {
+            k->s16_to_f32(p, out[c], n);
+            continue;
+        }
+        if (stride == 4 && (f->format == SAMPLE_FORMAT_PCM_F32LE ||
+                            f->format == SAMPLE_FORMAT_PCM_F32LE_PLANAR)) {
+            memcpy(out[c], p, n * sizeof(float));
+            continue;
+        }
+#endif
+        decode_chan(f->format, p, stride, out[c], n);
+    }
+}
+
+static void encode_block(const float *const *in, struct audio_frame *f, uint32_t off, int n)
+{
+    const struct aconv_kernels *k = aconv_kernels();
+    int c, stride, size = sample_format_size(f->format);
+    uint8_t *p;
+
+#if defined (ACONV_HOST_LE)
+    if (f->channels == 2 && f->format == SAMPLE_FORMAT_PCM_S16LE) {
+        k->f32x2_to_s16(in[0], in[1], f->data[0] + (size_t)off * 4, n);
+        return;
+    }
+    if (f->channels == 2 && f->format == SAMPLE_FORMAT_PCM_F32LE) {
+        k->f32x2_merge(in[0], in[1], f->data[0] + (size_t)off * 8, n);
+        return;
+    }
+#endif
+    for (c = 0; c < f->channels; c++) {
+        p = (uint8_t *)chan_ptr(f, c, off, size, &stride);
+#if defined (ACONV_HOST_LE)
+        if (stride == 2 && (f->format == SAMPLE_FORMAT_PCM_S16LE ||
+                            f->format == SAMPLE_FORMAT_PCM_S16LE_PLANAR)) {
+            k->f32_to_s16(in[c], p, n);
+            continue;
+        }
+        if (stride == 4 && (f->format == SAMPLE_FORMAT_PCM_F32LE ||
+                            f->format == SAMPLE_FORMAT_PCM_F32LE_PLANAR)) {
+            memcpy(p, in[c], n * sizeof(float));
+            continue;
+        }
+#endif
+        encode_chan(f->format, in[c], p, stride, n);
+    }
+}
+
+/*
+ * channel remap on planar float, out must not alias in.
+ * 5.1 (L R C LFE Ls Rs) -> stereo uses the ITU matrix scaled to not clip.
+ */
+static void remap_block(const float *const *in, int ich, float *const *out, int och, int n)
+{
+    const struct aconv_kernels *k = aconv_kernels();
+    int c;
+
+    if (och == 1) {
+        memset(out[0], 0, n * sizeof(float));
+        for (c = 0; c < ich; c++) {
+            k->mix(out[0], in[c], 1.0f / ich, n);
+        }
+    } else if (ich == 1) {
+        for (c = 0; c < och; c++) {
+            memcpy(out[c], in[0], n * sizeof(float));
+        }
+    } else if (ich == 6 && och == 2) {
+        const float g0 = 1.0f / (1.0f + 2.0f * (float)M_SQRT1_2);
+        const float g1 = (float)M_SQRT1_2 * g0;
+        for (c = 0; c < 2; c++) {
+            memset(out[c], 0, n * sizeof(float));
+            k->mix(out[c], in[c], g0, n);
+            k->mix(out[c], in[2], g1, n);
+            k->mix(out[c], in[4 + c], g1, n);
+        }
+    } else {
+        for (c = 0; c < och; c++) {
+            if (c < ich) {
+                memcpy(out[c], in[c], n * sizeof(float));
+            } else {
+                memset(out[c], 0, n * sizeof(float));
+            }
+        }
+    }
+}
+
+/*
+ * scratch of nbuf planar float blocks, AUDIO_MAX_CHANNELS planes each,
+ * taken from the media pool
+ */
+static float *scratch_alloc(float *planes[][AUDIO_MAX_CHANNELS], int nbuf, int block)
+{
+    int b, c;
+    float *mem = media_pool_alloc((size_t)nbuf * AUDIO_MAX_CHANNELS * block * sizeof(float));
+    if (!mem) {
+        return NULL;
+    }
+    for (b = 0; b < nbuf; b++) {
+        for (c = 0; c < AUDIO_MAX_CHANNELS; c++) {
+            planes[b][c] = mem + ((size_t)b * AUDIO_MAX_CHANNELS + c) * block;
+        }
+    }
+    return mem;
+}
+
+static bool frame_valid(const struct audio_frame *f)
+{
+    return f && sample_format_size(f->format) &&
+           f->channels > 0 && f->channels <= AUDIO_MAX_CHANNELS && f->data[0];
+}
+
+int audio_frame_convert(struct audio_frame *dst, const struct audio_frame *src)
+{
+    float *planes[2][AUDIO_MAX_CHANNELS];
+    float *mem;
+    float *const *out;
+    uint32_t off;
+    int n;
+
+    if (!frame_valid(dst) || !frame_valid(src) || dst == src) {
+        printf("%s invalid paramenters!\n", __func__);
+        return -1;
+    }
+    if (dst->sample_rate && src->sample_rate && dst->sample_rate != src->sample_rate) {
+        printf("%s: sample rate %u -> %u needs audio_resampler!\n", __func__,
+               src->sample_rate, dst->sample_rate);
+        return -1;
+    }
+    if (audio_frame_capacity(dst) < src->frames) {
+        printf("%s: dst too small %u < %u!\n", __func__, audio_frame_capacity(dst), src->frames);
+        return -1;
+    }
+    mem = scratch_alloc(planes, 2, ACONV_BLOCK);
+    if (!mem) {
+        printf("%s: malloc failed!\n", __func__);
+        return -1;
+    }
+    out = (src->channels == dst->channels) ? planes[0] : planes[1];
+    for (off = 0; off < src->frames; off += n) {
+        n = src->frames - off;
+        n = (n > ACONV_BLOCK) ? ACONV_BLOCK : n;
+        decode_block(src, off, n, planes[0]);
+        if (src->channels != dst->channels) {
+            remap_block((const float *const *)planes[0], src->channels, planes[1], dst->channels, n);
+        }
+        encode_block((const float *const *)out, dst, off, n);
+    }
+    media_pool_free(mem);
+    dst->frames      = src->frames;
+    dst->sample_rate = src->sample_rate;
+    dst->timestamp   = src->timestamp;
+    dst->frame_id    = src->frame_id;
+    return 0;
+}
+
+int audio_frame_reformat(struct audio_frame *frame, enum sample_format format, int channels)
+{
+    struct audio_frame tmp;
+    float *planes[1][AUDIO_MAX_CHANNELS];
+    enum sample_format from;
+    float *mem;
+    uint32_t off;
+    int n;
+
+    if (!frame_valid(frame) || !sample_format_size(format) ||
+        channels <= 0 || channels > AUDIO_MAX_CHANNELS) {
+        printf("%s invalid paramenters!\n", __func__);
+        return -1;
+    }
+    if (frame->format == format && frame->channels == channels) {
+        return 0;
+    }
+    if (frame->channels == channels &&
+        sample_format_size(frame->format) == sample_format_size(format) &&
+        (channels == 1 || sample_format_is_planar(frame->format) == sample_format_is_planar(format))) {
+        /* every block is read whole before it is written back */
+        from = frame->format;
+        mem = scratch_alloc(planes, 1, ACONV_BLOCK);
+        if (!mem) {
+            printf("%s: malloc failed!\n", __func__);
+            return -1;
+        }
+        for (off = 0; off < frame->frames; off += n) {
+            n = frame->frames - off;
+            n = (n > ACONV_BLOCK) ? ACONV_BLOCK : n;
+            frame->format = from;
+            decode_block(frame, off, n, planes[0]);
+            frame->format = format;
+            encode_block((const float *const *)planes[0], frame, off, n);
+        }
+        media_pool_free(mem);
+        frame->format = format;
+        return 0;
+    }
+    if (0 != audio_frame_init(&tmp, format, frame->sample_rate, channels,
+                              frame->frames, MEDIA_MEM_REF)) {
+        return -1;
+    }
+    if (0 != audio_frame_convert(&tmp, frame)) {
+        audio_frame_deinit(&tmp);
+        return -1;
+    }
+    audio_frame_deinit(frame);
+    *frame = tmp;
+    return 0;
+}
+
+/******************************************************************************
+ * polyphase resampler
+ *
+ * out_rate/in_rate = L/M. Output m sits at input time m*M/L, its window
+ * starts at hist[pos] and the filter phase is (m*M) % L. Each phase holds
+ * taps coefficients of a Blackman windowed sinc, normalized to unity gain.
+ ******************************************************************************/
+struct audio_resampler {
+    uint32_t  in_rate;
+    uint32_t  out_rate;
+    int       channels;
+    int       L;
+    int       M;
+    int       taps;
+    float    *filter;
+    float    *hist[AUDIO_MAX_CHANNELS];
+    int       hist_len;
+    int       hist_cap;
+    int       pos;
+    int       phase;
+    float    *obuf[AUDIO_MAX_CHANNELS]; /* audio_resampler_frame scratch */
+    int       obuf_len;
+};
+
+static uint32_t gcd_u32(uint32_t a, uint32_t b)
+{
+    uint32_t t;
+    while (b) {
+        t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static void resampler_design(struct audio_resampler *rs)
+{
+    int p, k, half = rs->taps / 2;
+    double fc = ACONV_CUTOFF * ((rs->L < rs->M) ? (double)rs->L / rs->M : 1.0);
+    double d, h, w, sum;
+    float *f;
+
+    for (p = 0; p < rs->L; p++) {
+        f = rs->filter + (size_t)p * rs->taps;
+        sum = 0.0;
+        for (k = 0; k < rs->taps; k++) {
+            d = k - (half - 1) - (double)p / rs->L;
+            h = (d == 0.0) ? fc : sin(M_PI * fc * d) / (M_PI * d);
+            w = 0.42 + 0.5 * cos(M_PI * d / half) + 0.08 * cos(2.0 * M_PI * d / half);
+            f[k] = (float)(h * ((fabs(d) < half) ? w : 0.0));
+            sum += f[k];
+        }
+        for (k = 0; k < rs->taps; k++) {
+            f[k] = (float)(f[k] / sum);
+        }
+    }
+}
+
+static int resampler_reserve(struct audio_resampler *rs, int frames)
+{
+    int c, cap = rs->hist_len + frames;
+    float *p;
+
+    if (cap <= rs->hist_cap) {
+        return 0;
+    }
+    cap = (cap < 2 * rs->hist_cap) ? 2 * rs->hist_cap : cap;
+    for (c = 0; c < rs->channels; c++) {
+        p = realloc(rs->hist[c], cap * sizeof(float));
+        if (!p) {
+            return -1;
+        }
+        rs->hist[c] = p;
+    }
+    rs->hist_cap = cap;
+    return 0;
+}
+
+struct audio_resampler *audio_resampler_create(uint32_t in_rate, uint32_t out_rate, int channels)
+{
+    struct audio_resampler *rs;
+    uint32_t g;
+    int c, taps;
+
+    if (!in_rate || !out_rate || channels <= 0 || channels > AUDIO_MAX_CHANNELS) {
+        printf("%s invalid paramenters!\n", __func__);
+        return NULL;
+    }
+    g = gcd_u32(in_rate, out_rate);
+    if (out_rate / g > ACONV_MAX_PHASES) {
+        printf("%s: ratio %u/%u unsupported!\n", __func__, out_rate, in_rate);
+        return NULL;
+    }
+    rs = calloc(1, sizeof(struct audio_resampler));
+    if (!rs) {
+        printf("malloc audio resampler failed!\n");
+        return NULL;
+    }
+    aconv_kernels();
+    rs->in_rate  = in_rate;
+    rs->out_rate = out_rate;
+    rs->channels = channels;
+    rs->L = out_rate / g;
+    rs->M = in_rate / g;
+    /* wider kernel when downsampling keeps the transition band in Hz */
+    taps = ACONV_BASE_TAPS;
+    if (rs->M > rs->L) {
+        taps = (int)(((int64_t)ACONV_BASE_TAPS * rs->M + rs->L - 1) / rs->L);
+    }
+    rs->taps = ALIGN_SIZE(taps, 8);
+    rs->filter = media_pool_alloc((size_t)rs->L * rs->taps * sizeof(float));
+    rs->obuf_len = (int)(((int64_t)ACONV_BLOCK * rs->L) / rs->M + 2);
+    rs->obuf[0] = media_pool_alloc((size_t)channels * rs->obuf_len * sizeof(float));
+    if (!rs->filter || !rs->obuf[0] || 0 != resampler_reserve(rs, rs->taps + ACONV_BLOCK)) {
+        printf("%s: malloc failed!\n", __func__);
+        audio_resampler_destroy(rs);
+        return NULL;
+    }
+    for (c = 1; c < channels; c++) {
+        rs->obuf[c] = rs->obuf[0] + (size_t)c * rs->obuf_len;
+    }
+    resampler_design(rs);
+    /* center of the first window lands on the first input sample */
+    rs->hist_len = rs->taps / 2 - 1;
+    for (c = 0; c < channels; c++) {
+        memset(rs->hist[c], 0, rs->hist_len * sizeof(float));
+    }
+    return rs;
+}
+
+void audio_resampler_destroy(struct audio_resampler *rs)
+{
+    int c;
+    if (!rs) {
+        return;
+    }
+    for (c = 0; c < rs->channels; c++) {
+        free(rs->hist[c]);
+    }
+    if (rs->filter) {
+        media_pool_free(rs->filter);
+    }
+    if (rs->obuf[0]) {
+        media_pool_free(rs->obuf[0]);
+    }
+    free(rs);
+}
+
+uint32_t audio_resampler_out_frames(struct audio_resampler *rs, uint32_t in_frames)
+{
+    int64_t x;
+    if (!rs) {
+        return 0;
+    }
+    /* outputs k with pos + (phase + k * M) / L + taps <= hist_len + in_frames */
+    x = ((int64_t)rs->hist_len + in_frames - rs->taps + 1 - rs->pos) * rs->L - rs->phase;
+    return (x > 0) ? (uint32_t)((x + rs->M - 1) / rs->M) : 0;
+}
+
+int audio_resampler_process(struct audio_resampler *rs, const float *const *in,
+                int in_frames, float *const *out, int out_cap)
+{
+    const struct aconv_kernels *k = aconv_kernels();
+    const float *f;
+    int c, n = 0;
+
+    if (!rs || in_frames < 0 || (in_frames && !in) || (out_cap && !out)) {
+        printf("%s invalid paramenters!\n", __func__);
+        return -1;
+    }
+    if (in_frames) {
+        if (0 != resampler_reserve(rs, in_frames)) {
+            printf("%s: malloc failed!\n", __func__);
+            return -1;
+        }
+        for (c = 0; c < rs->channels; c++) {
+            memcpy(rs->hist[c] + rs->hist_len, in[c], in_frames * sizeof(float));
+        }
+        rs->hist_len += in_frames;
+    }
+    while (n < out_cap && rs->pos + rs->taps <= rs->hist_len) {
+        f = rs->filter + (size_t)rs->phase * rs->taps;
+        for (c = 0; c < rs->channels; c++) {
+            out[c][n] = k->dot(f, rs->hist[c] + rs->pos, rs->taps);
+        }
+        n++;
+        rs->phase += rs->M;
+        rs->pos += rs->phase / rs->L;
+        rs->phase %= rs->L;
+    }
+    if (rs->pos) {
+        int keep = (rs->pos < rs->hist_len) ? rs->hist_len - rs->pos : 0;
+        for (c = 0; c < rs->channels; c++) {
+            memmove(rs->hist[c], rs->hist[c] + rs->hist_len - keep, keep * sizeof(float));
+        }
+        rs->pos -= rs->hist_len - keep;
+        rs->hist_len = keep;
+    }
+    return n;
+}
+
+int audio_resampler_frame(struct audio_resampler *rs, struct audio_frame *dst,
+                const struct audio_frame *src)
+{
+    float *planes[2][AUDIO_MAX_CHANNELS];
+    float *const *in;
+    float *mem;
+    uint32_t off, done = 0, cap;
+    int n, got;
+
+    if (!rs || !frame_valid(dst) || !frame_valid(src) || dst == src ||
+        dst->channels != rs->channels) {
+        printf("%s invalid paramenters!\n", __func__);
+        return -1;
+    }
+    if (src->sample_rate && src->sample_rate != rs->in_rate) {
+        printf("%s: input rate %u, resampler expects %u!\n", __func__,
+               src->sample_rate, rs->in_rate);
+        return -1;
+    }
+    cap = audio_frame_capacity(dst);
+    if (cap < audio_resampler_out_frames(rs, src->frames)) {
+        printf("%s: dst too small %u < %u!\n", __func__, cap,
+               audio_resampler_out_frames(rs, src->frames));
+        return -1;
+    }
+    mem = scratch_alloc(planes, 2, ACONV_BLOCK);
+    if (!mem) {
+        printf("%s: malloc failed!\n", __func__);
+        return -1;
+    }
+    in = (src->channels == rs->channels) ? planes[0] : planes[1];
+    for (off = 0; off < src->frames; off += n) {
+        n = src->frames - off;
+        n = (n > ACONV_BLOCK) ? ACONV_BLOCK : n;
+        decode_block(src, off, n, planes[0]);
+        if (src->channels != rs->channels) {
+            remap_block((const float *const *)planes[0], src->channels, planes[1], rs->channels, n);
+        }
+        got = audio_resampler_process(rs, (const float *const *)in, n, rs->obuf, rs->obuf_len);
+        while (got > 0) {
+            encode_block((const float *const *)rs->obuf, dst, done, got);
+            done += got;
+            if (got < rs->obuf_len) {
+                break;
+            }
+            got = audio_resampler_process(rs, NULL, 0, rs->obuf, rs->obuf_len);
+        }
+    }
+    media_pool_free(mem);
+    dst->frames      = done;
+    dst->sample_rate = rs->out_rate;
+    dst->timestamp   = src->timestamp;
+    dst->frame_id    = src->frame_id;
+    return 0;
+}
+
+/******************************************************************************
+ * mixer
+ ******************************************************************************/
+void audio_mix(float *dst, const float *const *src, const float *gain, int num, int samples)
+{
+    const struct aconv_kernels *k = aconv_kernels();
+    int i;
+
+    memset(dst, 0, samples * sizeof(float));
+    for (i = 0; i < num; i++) {
+        k->mix(dst, src[i], gain ? gain[i] : 1.0f, samples);
+    }
+}
+
+int audio_frame_mix(struct audio_frame *dst, const struct audio_frame *const *src,
+                const float *gain, int num)
+{
+    const struct aconv_kernels *k = aconv_kernels();
+    float *planes[3][AUDIO_MAX_CHANNELS];
+    float *const *in;
+    float *mem;
+    uint32_t off, frames = 0;
+    int i, c, n, m;
+
+    if (!frame_valid(dst) || !src || num <= 0) {
+        printf("%s invalid paramenters!\n", __func__);
+        return -1;
+    }
+    for (i = 0; i < num; i++) {
+        if (!frame_valid(src[i])) {
+            printf("%s invalid paramenters!\n", __func__);
+            return -1;
+        }
+        if (src[i]->sample_rate && dst->sample_rate && src[i]->sample_rate != dst->sample_rate) {
+            printf("%s: source %d rate %u != %u!\n", __func__, i,
+                   src[i]->sample_rate, dst->sample_rate);
+            return -1;
+        }
+        frames = (src[i]->frames > frames) ? src[i]->frames : frames;
+    }
+    if (audio_frame_capacity(dst) < frames) {
+        printf("%s: dst too small %u < %u!\n", __func__, audio_frame_capacity(dst), frames);
+        return -1;
+    }
+    mem = scratch_alloc(planes, 3, ACONV_BLOCK);
+    if (!mem) {
+        printf("%s: malloc failed!\n", __func__);
+        return -1;
+    }
+    for (off = 0; off < frames; off += n) {
+        n = frames - off;
+        n = (n > ACONV_BLOCK) ? ACONV_BLOCK : n;
+        for (c = 0; c < dst->channels; c++) {
+            memset(planes[2][c], 0, n * sizeof(float));
+        }
+        for (i = 0; i < num; i++) {
+            if (off >= src[i]->frames) {
+                continue;
+            }
+            m = src[i]->frames - off;
+            m = (m > n) ? n : m;
+            decode_block(src[i], off, m, planes[0]);
+            in = planes[0];
+            if (src[i]->channels != dst->channels) {
+                remap_block((const float *const *)planes[0], src[i]->channels,
+                            planes[1], dst->channels, m);
+                in = planes[1];
+            }
+            for (c = 0; c < dst->channels; c++) {
+                k->mix(planes[2][c], in[c], gain ? gain[i] : 1.0f, m);
+            }
+        }
+        encode_block((const float *const *)planes[2], dst, off, n);
+    }
+    media_pool_free(mem);
+    dst->frames = frames;
+    if (!dst->sample_rate) {
+        dst->sample_rate = src[0]->sample_rate;
+    }
+    dst->timestamp = src[0]->timestamp;
+    return 0;
+}
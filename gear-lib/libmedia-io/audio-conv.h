@@ -0,0 +1,97 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#ifndef AUDIO_CONV_H
+#define AUDIO_CONV_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Sample format conversion, resampling and mixing of audio_frame
+ *
+ * Every sample_format converts to every other one through blocks of planar
+ * float, channel count changes downmix (to mono or 5.1 -> stereo), duplicate
+ * mono or drop/zero the extra channels. Integer output saturates.
+ *
+ * S16 and F32 mono/stereo, the mixer and the resampler filter run on
+ * SSE2/AVX or NEON, selected at runtime.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct audio_resampler;
+
+/*
+ * convert src into dst->format and dst->channels, dst must be initialized
+ * with room for src->frames and the same sample_rate (or 0)
+ */
+GEAR_API int audio_frame_convert(struct audio_frame *dst, const struct audio_frame *src);
+
+/*
+ * convert frame in place. Without a change of sample size or layout the
+ * samples are rewritten where they are, otherwise they move to a pooled
+ * buffer and the frame becomes MEDIA_MEM_REF
+ */
+GEAR_API int audio_frame_reformat(struct audio_frame *frame, enum sample_format format, int channels);
+
+/*
+ * polyphase windowed-sinc resampler between any rates whose ratio reduces
+ * to at most 4096 phases (8k/16k/22.05k/32k/44.1k/48k/96k...).
+ * Output is time aligned with input, the last taps/2 input frames come
+ * out with the next call.
+ */
+GEAR_API struct audio_resampler *audio_resampler_create(uint32_t in_rate, uint32_t out_rate, int channels);
+GEAR_API void audio_resampler_destroy(struct audio_resampler *rs);
+
+/* frames produced by the next in_frames of input */
+GEAR_API uint32_t audio_resampler_out_frames(struct audio_resampler *rs, uint32_t in_frames);
+
+/*
+ * planar float in, planar float out, returns frames written. Input that
+ * does not fit in out_cap is kept and produced by the following calls.
+ */
+GEAR_API int audio_resampler_process(struct audio_resampler *rs, const float *const *in,
+                int in_frames, float *const *out, int out_cap);
+
+/*
+ * any format/channels in, dst->format out with the resampler's channels,
+ * dst needs audio_resampler_out_frames(src->frames) of room
+ */
+GEAR_API int audio_resampler_frame(struct audio_resampler *rs, struct audio_frame *dst,
+                const struct audio_frame *src);
+
+/* dst[i] = sum(gain[k] * src[k][i]), gain NULL means unity */
+GEAR_API void audio_mix(float *dst, const float *const *src, const float *gain, int num, int samples);
+
+/*
+ * mix num frames of dst->sample_rate into dst->format and dst->channels,
+ * dst may be one of src. Shorter sources are padded with silence.
+ */
+GEAR_API int audio_frame_mix(struct audio_frame *dst, const struct audio_frame *const *src,
+                const float *gain, int num);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -49,6 +49,7 @@ static struct sample_format_name sample_fmt_tbl[] = {
     {SAMPLE_FORMAT_PCM_S16BE_PLANAR, "PCM_S16BE_PLANAR"},
     {SAMPLE_FORMAT_PCM_S24LE_PLANAR, "PCM_S24LE_PLANAR"},
     {SAMPLE_FORMAT_PCM_S32LE_PLANAR, "PCM_S32LE_PLANAR"},
+    {SAMPLE_FORMAT_PCM_F32LE_PLANAR, "PCM_F32LE_PLANAR"},
     {SAMPLE_FORMAT_PCM_MAX,          "SAMPLE_FORMAT_PCM_MAX"},
 };
 
@@ -77,13 +78,155 @@ void audio_producer_dump(struct audio_producer *as)
 
 }
 
+#define ALIGNMENT 32
+#define ALIGN_SIZE(size, align) (((size) + (align - 1)) & (~(align - 1)))
+
+int sample_format_size(enum sample_format format)
+{
+    switch (format) {
+    case SAMPLE_FORMAT_PCM_U8:
+    case SAMPLE_FORMAT_PCM_ALAW:
+    case SAMPLE_FORMAT_PCM_ULAW:
+        return 1;
+    case SAMPLE_FORMAT_PCM_S16LE:
+    case SAMPLE_FORMAT_PCM_S16BE:
+    case SAMPLE_FORMAT_PCM_S16LE_PLANAR:
+    case SAMPLE_FORMAT_PCM_S16BE_PLANAR:
+        return 2;
+    case SAMPLE_FORMAT_PCM_S24LE:
+    case SAMPLE_FORMAT_PCM_S24BE:
+    case SAMPLE_FORMAT_PCM_S24LE_PLANAR:
+        return 3;
+    case SAMPLE_FORMAT_PCM_S32LE:
+    case SAMPLE_FORMAT_PCM_S32BE:
+    case SAMPLE_FORMAT_PCM_S24_32LE:
+    case SAMPLE_FORMAT_PCM_S24_32BE:
+    case SAMPLE_FORMAT_PCM_F32LE:
+    case SAMPLE_FORMAT_PCM_F32BE:
+    case SAMPLE_FORMAT_PCM_S32LE_PLANAR:
+    case SAMPLE_FORMAT_PCM_F32LE_PLANAR:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+bool sample_format_is_planar(enum sample_format format)
+{
+    switch (format) {
+    case SAMPLE_FORMAT_PCM_S16LE_PLANAR:
+    case SAMPLE_FORMAT_PCM_S16BE_PLANAR:
+    case SAMPLE_FORMAT_PCM_S24LE_PLANAR:
+    case SAMPLE_FORMAT_PCM_S32LE_PLANAR:
+    case SAMPLE_FORMAT_PCM_F32LE_PLANAR:
+        return true;
+    default:
+        return false;
+    }
+}
+
+int audio_frame_init(struct audio_frame *frame, enum sample_format format,
+                uint32_t sample_rate, int channels, uint32_t frames, media_mem_type_t type)
+{
+    int i, size = sample_format_size(format);
+    size_t plane;
+    uint8_t *base = NULL;
+
+    if (!frame || size == 0 || channels <= 0 || channels > AUDIO_MAX_CHANNELS) {
+        printf("%s invalid paramenters!\n", __func__);
+        return -1;
+    }
+    memset(frame, 0, sizeof(struct audio_frame));
+    frame->format = format;
+    frame->sample_rate = sample_rate;
+    frame->channels = channels;
+    frame->frames = frames;
+    frame->mem_type = type;
+    if (sample_format_is_planar(format)) {
+        plane = ALIGN_SIZE((size_t)frames * size, ALIGNMENT);
+        frame->total_size = plane * channels;
+    } else {
+        plane = 0;
+        frame->total_size = (size_t)frames * size * channels;
+    }
+    switch (type) {
+    case MEDIA_MEM_DEEP:
+        base = calloc(1, frame->total_size ? frame->total_size : 1);
+        break;
+    case MEDIA_MEM_REF:
+        frame->buf = media_buffer_alloc(frame->total_size);
+        base = frame->buf ? frame->buf->data : NULL;
+        break;
+    default:
+        return 0;
+    }
+    if (!base) {
+        printf("%s: malloc failed!\n", __func__);
+        return -1;
+    }
+    for (i = 0; i < (plane ? channels : 1); i++) {
+        frame->data[i] = base + i * plane;
+    }
+    return 0;
+}
+
+void audio_frame_deinit(struct audio_frame *frame)
+{
+    if (!frame) {
+        return;
+    }
+    if (frame->mem_type == MEDIA_MEM_DEEP) {
+        free(frame->data[0]);
+    } else if (frame->mem_type == MEDIA_MEM_REF) {
+        media_buffer_unref(frame->buf);
+        frame->buf = NULL;
+    }
+    memset(frame->data, 0, sizeof(frame->data));
+}
+
+struct audio_frame *audio_frame_create(enum sample_format format,
+                uint32_t sample_rate, int channels, uint32_t frames, media_mem_type_t type)
+{
+    struct audio_frame *frame = media_pool_alloc(sizeof(struct audio_frame));
+    if (!frame) {
+        printf("malloc audio frame failed!\n");
+        return NULL;
+    }
+    if (0 != audio_frame_init(frame, format, sample_rate, channels, frames, type)) {
+        media_pool_free(frame);
+        return NULL;
+    }
+    return frame;
+}
+
+void audio_frame_destroy(struct audio_frame *frame)
+{
+    if (frame) {
+        audio_frame_deinit(frame);
+        media_pool_free(frame);
+    }
+}
+
+uint32_t audio_frame_capacity(const struct audio_frame *frame)
+{
+    int size = sample_format_size(frame->format);
+    if (size == 0 || frame->channels <= 0) {
+        return 0;
+    }
+    if (sample_format_is_planar(frame->format)) {
+        return frame->total_size / frame->channels / size;
+    }
+    return frame->total_size / ((uint64_t)size * frame->channels);
+}
+
 struct audio_packet *audio_packet_create(enum media_mem_type type, void *data, size_t len)
 {
     struct audio_packet *ap;
-    ap = calloc(1, sizeof(struct audio_packet));
+    ap = media_pool_alloc(sizeof(struct audio_packet));
     if (!ap) {
         return NULL;
     }
+    memset(ap, 0, sizeof(struct audio_packet));
     ap->mem_type = type;
     switch (type) {
     case MEDIA_MEM_DEEP:
@@ -94,6 +237,20 @@ struct audio_packet *audio_packet_create(enum media_mem_type type, void *data, s
         ap->data = data;
         ap->size = len;
         break;
+    case MEDIA_MEM_REF:
+        if (len > 0) {
+            ap->buf = media_buffer_alloc(len);
+            if (!ap->buf) {
+                media_pool_free(ap);
+                return NULL;
+            }
+            ap->data = ap->buf->data;
+            if (data) {
+                memcpy(ap->data, data, len);
+            }
+        }
+        ap->size = len;
+        break;
     default:
         printf("%s invalid type!\n", __func__);
         break;
@@ -102,6 +259,23 @@ struct audio_packet *audio_packet_create(enum media_mem_type type, void *data, s
     return ap;
 }
 
+struct audio_packet *audio_packet_create_ref(struct media_buffer *buf, void *data, size_t len)
+{
+    struct audio_packet *ap;
+    if (!buf) {
+        printf("%s invalid paramenters!\n", __func__);
+        return NULL;
+    }
+    ap = audio_packet_create(MEDIA_MEM_REF, NULL, 0);
+    if (!ap) {
+        return NULL;
+    }
+    ap->buf = media_buffer_ref(buf);
+    ap->data = data ? data : buf->data;
+    ap->size = data ? len : buf->size;
+    return ap;
+}
+
 void audio_packet_destroy(struct audio_packet *ap)
 {
     if (ap) {
@@ -110,7 +284,10 @@ void audio_packet_destroy(struct audio_packet *ap)
             free(ap->data);
         }
 #endif
-        free(ap);
+        if (ap->mem_type == MEDIA_MEM_REF) {
+            media_buffer_unref(ap->buf);
+        }
+        media_pool_free(ap);
     }
 }
 
@@ -130,6 +307,28 @@ struct audio_packet *audio_packet_copy(struct audio_packet *dst, const struct au
         }
         memcpy(dst->data, src->data, src->size);
         break;
+    case MEDIA_MEM_REF:
+        if (src->buf) {
+            media_buffer_ref(src->buf);
+            media_buffer_unref(dst->buf);
+            dst->buf = src->buf;
+            dst->data = src->data;
+        } else {
+            /* first hop from unowned memory, the only copy on the way */
+            if (!dst->buf || dst->buf->size < src->size ||
+                !media_buffer_is_writable(dst->buf)) {
+                media_buffer_unref(dst->buf);
+                dst->buf = media_buffer_alloc(src->size);
+                if (!dst->buf) {
+                    dst->data = NULL;
+                    dst->size = 0;
+                    return NULL;
+                }
+            }
+            dst->data = dst->buf->data;
+            memcpy(dst->data, src->data, src->size);
+        }
+        break;
     }
     dst->size = src->size;
     dst->pts  = src->pts;
@@ -23,6 +23,7 @@
 #define AUDIO_DEF_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 /**
  * This file reference to ffmpeg and obs define
@@ -57,6 +58,7 @@ enum sample_format {
     SAMPLE_FORMAT_PCM_S16BE_PLANAR,
     SAMPLE_FORMAT_PCM_S24LE_PLANAR,
     SAMPLE_FORMAT_PCM_S32LE_PLANAR,
+    SAMPLE_FORMAT_PCM_F32LE_PLANAR,
 
     SAMPLE_FORMAT_PCM_MAX,       /**< Upper limit of valid sample types */
 };
@@ -77,18 +79,38 @@ struct audio_producer {
 void audio_producer_dump(struct audio_producer *as);
 
 struct audio_frame {
-    uint8_t           *data[AUDIO_MAX_CHANNELS];
+    uint8_t           *data[AUDIO_MAX_CHANNELS]; /* data[0] only if interleaved */
     uint32_t           frames;
     enum sample_format format;
     uint32_t           sample_rate;
+    int                channels;
     uint64_t           timestamp;//ns
     uint64_t           frame_id;
     uint64_t           total_size;
+    media_mem_type_t   mem_type;
+    struct media_buffer *buf;   /* MEDIA_MEM_REF only */
 };
 
 const char *sample_format_to_string(enum sample_format format);
 enum sample_format sample_string_to_format(const char *name);
 
+/* bytes of one sample of one channel, 0 if unknown */
+GEAR_API int sample_format_size(enum sample_format format);
+GEAR_API bool sample_format_is_planar(enum sample_format format);
+
+/*
+ * room for frames samples per channel, total_size is the capacity in bytes
+ * and frames is set to the capacity as well
+ */
+GEAR_API int audio_frame_init(struct audio_frame *frame, enum sample_format format,
+                uint32_t sample_rate, int channels, uint32_t frames, media_mem_type_t type);
+GEAR_API void audio_frame_deinit(struct audio_frame *frame);
+GEAR_API struct audio_frame *audio_frame_create(enum sample_format format,
+                uint32_t sample_rate, int channels, uint32_t frames, media_mem_type_t type);
+GEAR_API void audio_frame_destroy(struct audio_frame *frame);
+/* capacity in frames of the memory behind frame */
+GEAR_API uint32_t audio_frame_capacity(const struct audio_frame *frame);
+
 /******************************************************************************
  * compressed audio define
  ******************************************************************************/
@@ -123,6 +145,7 @@ struct audio_packet {
     uint8_t             *data;
     size_t               size;
     media_mem_type_t     mem_type;
+    struct media_buffer *buf;       /* MEDIA_MEM_REF only */
     uint64_t             pts;
     uint64_t             dts;
     int                  track_idx;
@@ -130,6 +153,7 @@ struct audio_packet {
 };
 
 GEAR_API struct audio_packet *audio_packet_create(enum media_mem_type type, void *data, size_t len);
+GEAR_API struct audio_packet *audio_packet_create_ref(struct media_buffer *buf, void *data, size_t len);
 GEAR_API void audio_packet_destroy(struct audio_packet *packet);
 GEAR_API struct audio_packet *audio_packet_copy(struct audio_packet *dst, const struct audio_packet *src, media_mem_type_t type);
 GEAR_API void audio_encoder_dump(struct audio_encoder *ve);
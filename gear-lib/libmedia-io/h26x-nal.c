@@ -0,0 +1,345 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#include "libmedia-io.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#define H26X_SIMD_X86
+#include <immintrin.h>
+#elif defined (__ARM_NEON) || defined (__ARM_NEON__)
+#define H26X_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+typedef const uint8_t *(*find_start_code_fn)(const uint8_t *p, const uint8_t *end);
+
+/*
+ * look at p[2] first: if it is > 1 no start code can begin at p, p+1 or p+2
+ */
+static const uint8_t *find_start_code_c(const uint8_t *p, const uint8_t *end)
+{
+    while (p + 2 < end) {
+        if (p[2] > 1) {
+            p += 3;
+        } else if (p[2] == 0) {
+            p++;
+        } else {
+            if (p[0] == 0 && p[1] == 0) {
+                return p;
+            }
+            p += 3;
+        }
+    }
+    return end;
+}
+
+#if defined (H26X_SIMD_X86)
+__attribute__((target("sse2")))
+static const uint8_t *find_start_code_sse2(const uint8_t *p, const uint8_t *end)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    __m128i a, b, c;
+    int mask;
+
+    for (; p + 18 <= end; p += 16) {
+        c = _mm_loadu_si128((const __m128i *)(p + 2));
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(c, one));
+        if (!mask) {
+            continue;
+        }
+        a = _mm_loadu_si128((const __m128i *)p);
+        b = _mm_loadu_si128((const __m128i *)(p + 1));
+        mask &= _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, zero),
+                                                _mm_cmpeq_epi8(b, zero)));
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return find_start_code_c(p, end);
+}
+
+__attribute__((target("avx2")))
+static const uint8_t *find_start_code_avx2(const uint8_t *p, const uint8_t *end)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi8(1);
+    __m256i a, b, c;
+    uint32_t mask;
+
+    for (; p + 34 <= end; p += 32) {
+        c = _mm256_loadu_si256((const __m256i *)(p + 2));
+        mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(c, one));
+        if (!mask) {
+            continue;
+        }
+        a = _mm256_loadu_si256((const __m256i *)p);
+        b = _mm256_loadu_si256((const __m256i *)(p + 1));
+        mask &= (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(
+                        _mm256_cmpeq_epi8(a, zero), _mm256_cmpeq_epi8(b, zero)));
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return find_start_code_sse2(p, end);
+}
+#elif defined (H26X_SIMD_NEON)
+static const uint8_t *find_start_code_neon(const uint8_t *p, const uint8_t *end)
+{
+    const uint8x16_t zero = vdupq_n_u8(0);
+    const uint8x16_t one = vdupq_n_u8(1);
+    uint8x16_t a, b, c, m;
+    uint64x2_t m64;
+
+    for (; p + 18 <= end; p += 16) {
+        a = vld1q_u8(p);
+        b = vld1q_u8(p + 1);
+        c = vld1q_u8(p + 2);
+        m = vandq_u8(vandq_u8(vceqq_u8(a, zero), vceqq_u8(b, zero)),
+                     vceqq_u8(c, one));
+        m64 = vreinterpretq_u64_u8(m);
+        if (vgetq_lane_u64(m64, 0) | vgetq_lane_u64(m64, 1)) {
+            return find_start_code_c(p, p + 18);
+        }
+    }
+    return find_start_code_c(p, end);
+}
+#endif
+
+static find_start_code_fn find_start_code_impl = find_start_code_c;
+static pthread_once_t find_start_code_once = PTHREAD_ONCE_INIT;
+
+static void find_start_code_select(void)
+{
+#if defined (H26X_SIMD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        find_start_code_impl = find_start_code_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        find_start_code_impl = find_start_code_sse2;
+    }
+#elif defined (H26X_SIMD_NEON)
+    find_start_code_impl = find_start_code_neon;
+#endif
+}
+
+const uint8_t *h26x_find_start_code(const uint8_t *p, const uint8_t *end)
+{
+    pthread_once(&find_start_code_once, find_start_code_select);
+    if (!p || p >= end) {
+        return end;
+    }
+    return find_start_code_impl(p, end);
+}
+
+int h26x_nal_type(enum video_codec_type codec, const uint8_t *nal)
+{
+    if (codec == VIDEO_CODEC_HEVC) {
+        return (nal[0] >> 1) & 0x3f;
+    }
+    return nal[0] & 0x1f;
+}
+
+enum h26x_nal_class h26x_nal_classify(enum video_codec_type codec, int type)
+{
+    if (codec == VIDEO_CODEC_HEVC) {
+        if (type >= H265_NAL_BLA_W_LP && type <= H265_NAL_CRA_NUT) {
+            return H26X_NAL_IDR;
+        }
+        if (type <= H265_NAL_RASL_R) {
+            return H26X_NAL_SLICE;
+        }
+        switch (type) {
+        case H265_NAL_VPS:        return H26X_NAL_VPS;
+        case H265_NAL_SPS:        return H26X_NAL_SPS;
+        case H265_NAL_PPS:        return H26X_NAL_PPS;
+        case H265_NAL_AUD:        return H26X_NAL_AUD;
+        case H265_NAL_SEI_PREFIX:
+        case H265_NAL_SEI_SUFFIX: return H26X_NAL_SEI;
+        default:                  return H26X_NAL_OTHER;
+        }
+    }
+    switch (type) {
+    case H264_NAL_IDR_SLICE: return H26X_NAL_IDR;
+    case H264_NAL_SLICE:
+    case H264_NAL_DPA:       return H26X_NAL_SLICE;
+    case H264_NAL_DPB:
+    case H264_NAL_DPC:       return H26X_NAL_SLICE_PART;
+    case H264_NAL_SPS:       return H26X_NAL_SPS;
+    case H264_NAL_PPS:       return H26X_NAL_PPS;
+    case H264_NAL_SEI:       return H26X_NAL_SEI;
+    case H264_NAL_AUD:       return H26X_NAL_AUD;
+    default:                 return H26X_NAL_OTHER;
+    }
+}
+
+const uint8_t *h26x_next_nal(enum video_codec_type codec,
+                const uint8_t *p, const uint8_t *end, struct h26x_nal *nal)
+{
+    const uint8_t *start, *next;
+    size_t size;
+
+    /* empty NAL units between back to back start codes are skipped */
+    do {
+        start = h26x_find_start_code(p, end);
+        if (start == end) {
+            return NULL;
+        }
+        start += 3;
+        next = h26x_find_start_code(start, end);
+        size = next - start;
+        while (size > 0 && start[size - 1] == 0) {
+            size--;
+        }
+        p = next;
+    } while (size == 0);
+    nal->data = start;
+    nal->size = size;
+    nal->type = h26x_nal_type(codec, start);
+    nal->cls = h26x_nal_classify(codec, nal->type);
+    return next;
+}
+
+bool h26x_has_start_code(const uint8_t *data, size_t size)
+{
+    if (size < 3 || data[0] != 0 || data[1] != 0) {
+        return false;
+    }
+    return data[2] == 1 || (size > 3 && data[2] == 0 && data[3] == 1);
+}
+
+bool h26x_is_keyframe(enum video_codec_type codec, const uint8_t *data, size_t size)
+{
+    const uint8_t *p, *end = data + size;
+    struct h26x_nal nal;
+
+    for (p = data; (p = h26x_next_nal(codec, p, end, &nal)) != NULL;) {
+        if (nal.cls == H26X_NAL_IDR) {
+            return true;
+        }
+        if (nal.cls == H26X_NAL_SLICE) {
+            return false;
+        }
+    }
+    return false;
+}
+
+static inline void wb32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+ssize_t h26x_annexb_to_avcc(const uint8_t *src, size_t len,
+                uint8_t *dst, size_t dst_len)
+{
+    const uint8_t *p, *end = src + len;
+    struct h26x_nal nal;
+    size_t n = 0;
+
+    for (p = src; (p = h26x_next_nal(VIDEO_CODEC_H264, p, end, &nal)) != NULL;) {
+        if (dst) {
+            if (n + 4 + nal.size > dst_len) {
+                return -1;
+            }
+            wb32(dst + n, (uint32_t)nal.size);
+            memcpy(dst + n + 4, nal.data, nal.size);
+        }
+        n += 4 + nal.size;
+    }
+    return n;
+}
+
+ssize_t h26x_avcc_to_annexb(const uint8_t *src, size_t len,
+                int nal_length_size, uint8_t *dst, size_t dst_len)
+{
+    size_t i, n = 0, nal_size;
+    int j;
+
+    if (nal_length_size < 1 || nal_length_size > 4) {
+        return -1;
+    }
+    for (i = 0; i + nal_length_size <= len; i += nal_size) {
+        nal_size = 0;
+        for (j = 0; j < nal_length_size; j++) {
+            nal_size = (nal_size << 8) | src[i++];
+        }
+        if (nal_size > len - i) {
+            return -1;
+        }
+        if (dst) {
+            if (n + 4 + nal_size > dst_len) {
+                return -1;
+            }
+            wb32(dst + n, 1);
+            memcpy(dst + n + 4, src + i, nal_size);
+        }
+        n += 4 + nal_size;
+    }
+    return n;
+}
+
+ssize_t h264_avcc_config(const uint8_t *src, size_t len,
+                uint8_t *dst, size_t dst_len)
+{
+    const uint8_t *p, *end = src + len;
+    const uint8_t *sps = NULL, *pps = NULL;
+    size_t sps_size = 0, pps_size = 0, n;
+    struct h26x_nal nal;
+
+    for (p = src; (p = h26x_next_nal(VIDEO_CODEC_H264, p, end, &nal)) != NULL;) {
+        if (nal.cls == H26X_NAL_SPS && !sps) {
+            sps = nal.data;
+            sps_size = nal.size;
+        } else if (nal.cls == H26X_NAL_PPS && !pps) {
+            pps = nal.data;
+            pps_size = nal.size;
+        }
+    }
+    if (!sps || !pps || sps_size < 4) {
+        return -1;
+    }
+    n = 6 + 2 + sps_size + 1 + 2 + pps_size;
+    if (!dst) {
+        return n;
+    }
+    if (dst_len < n) {
+        return -1;
+    }
+    dst[0] = 0x01;                      /* configurationVersion */
+    memcpy(dst + 1, sps + 1, 3);        /* profile, compat, level */
+    dst[4] = 0xff;                      /* 4 bytes NAL length */
+    dst[5] = 0xe1;                      /* one SPS */
+    dst[6] = sps_size >> 8;
+    dst[7] = sps_size & 0xff;
+    memcpy(dst + 8, sps, sps_size);
+    dst[8 + sps_size] = 0x01;           /* one PPS */
+    dst[9 + sps_size] = pps_size >> 8;
+    dst[10 + sps_size] = pps_size & 0xff;
+    memcpy(dst + 11 + sps_size, pps, pps_size);
+    return n;
+}
@@ -0,0 +1,100 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#ifndef H26X_NAL_H
+#define H26X_NAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+/* GEAR_API and enum video_codec_type */
+#include "libmedia-io.h"
+
+/**
+ * Annex-B / AVCC helpers shared by librtsp, librtmpc and libmp4
+ *
+ * Start code scanning uses SSE2/AVX2 or NEON when available, the kernel is
+ * selected at runtime on the first call.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum h26x_nal_class {
+    H26X_NAL_OTHER = 0,
+    H26X_NAL_VPS,
+    H26X_NAL_SPS,
+    H26X_NAL_PPS,
+    H26X_NAL_SEI,
+    H26X_NAL_AUD,
+    H26X_NAL_IDR,   /* IDR slice, or HEVC random access point (BLA/IDR/CRA) */
+    H26X_NAL_SLICE, /* other VCL slice, H264 data partition A */
+    H26X_NAL_SLICE_PART, /* H264 data partition B/C, starts with slice_id */
+};
+
+struct h26x_nal {
+    const uint8_t      *data;   /* NAL header, start code excluded */
+    size_t              size;   /* trailing zero bytes excluded */
+    int                 type;
+    enum h26x_nal_class cls;
+};
+
+/*
+ * return the first three byte start code 00 00 01 in [p, end), or end.
+ * For four byte start codes the pointer is at the second zero byte.
+ */
+GEAR_API const uint8_t *h26x_find_start_code(const uint8_t *p, const uint8_t *end);
+
+/*
+ * iterate NAL units of an Annex-B buffer:
+ *   for (p = buf; (p = h26x_next_nal(codec, p, end, &nal)) != NULL;)
+ */
+GEAR_API const uint8_t *h26x_next_nal(enum video_codec_type codec,
+                const uint8_t *p, const uint8_t *end, struct h26x_nal *nal);
+
+GEAR_API int h26x_nal_type(enum video_codec_type codec, const uint8_t *nal);
+GEAR_API enum h26x_nal_class h26x_nal_classify(enum video_codec_type codec, int type);
+GEAR_API bool h26x_has_start_code(const uint8_t *data, size_t size);
+GEAR_API bool h26x_is_keyframe(enum video_codec_type codec, const uint8_t *data, size_t size);
+
+/*
+ * Annex-B to 4 bytes length prefixed (AVCC/HVCC sample format) into dst.
+ * If dst is NULL the required size is returned. Returns -1 if dst_len is
+ * too small.
+ */
+GEAR_API ssize_t h26x_annexb_to_avcc(const uint8_t *src, size_t len,
+                uint8_t *dst, size_t dst_len);
+GEAR_API ssize_t h26x_avcc_to_annexb(const uint8_t *src, size_t len,
+                int nal_length_size, uint8_t *dst, size_t dst_len);
+
+/*
+ * build AVCDecoderConfigurationRecord (avcC) from Annex-B SPS/PPS.
+ * If dst is NULL the required size is returned.
+ */
+GEAR_API ssize_t h264_avcc_config(const uint8_t *src, size_t len,
+                uint8_t *dst, size_t dst_len);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
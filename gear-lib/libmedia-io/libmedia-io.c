@@ -26,10 +26,11 @@
 
 struct media_packet *media_packet_create(enum media_type type, enum media_mem_type mem_type, void *data, size_t len)
 {
-    struct media_packet *mp = calloc(1, sizeof(struct media_packet));
+    struct media_packet *mp = media_pool_alloc(sizeof(struct media_packet));
     if (!mp) {
         return NULL;
     }
+    memset(mp, 0, sizeof(struct media_packet));
     mp->type = type;
     switch (mp->type) {
     case MEDIA_TYPE_AUDIO:
@@ -45,6 +46,32 @@ struct media_packet *media_packet_create(enum media_type type, enum media_mem_ty
     return mp;
 }
 
+struct media_packet *media_packet_create_ref(enum media_type type, struct media_buffer *buf, void *data, size_t len)
+{
+    struct media_packet *mp = media_pool_alloc(sizeof(struct media_packet));
+    if (!mp) {
+        return NULL;
+    }
+    memset(mp, 0, sizeof(struct media_packet));
+    mp->type = type;
+    switch (mp->type) {
+    case MEDIA_TYPE_AUDIO:
+        mp->audio = audio_packet_create_ref(buf, data, len);
+        break;
+    case MEDIA_TYPE_VIDEO:
+        mp->video = video_packet_create_ref(buf, data, len);
+        break;
+    default:
+        printf("unsupport create %d media packet\n", mp->type);
+        break;
+    }
+    if (!mp->audio && !mp->video) {
+        media_pool_free(mp);
+        return NULL;
+    }
+    return mp;
+}
+
 void media_packet_destroy(struct media_packet *mp)
 {
     if (!mp) {
@@ -61,7 +88,7 @@ void media_packet_destroy(struct media_packet *mp)
         printf("unsupport destroy %d media packet\n", mp->type);
         break;
     }
-    free(mp);
+    media_pool_free(mp);
 }
 
 struct media_packet *media_packet_copy(const struct media_packet *src, enum media_mem_type mem_type)
@@ -45,15 +45,20 @@ enum media_type {
  * define media frame or packet memory copy type:
  * MEDIA_MEM_DEEP: data point to the memory alloc by uplayer
  * MEDIA_MEM_SHALLOW: data point to the addr which from hardware or prev stage
+ * MEDIA_MEM_REF: data point into a refcounted media_buffer, copy takes a ref
  */
 typedef enum media_mem_type {
     MEDIA_MEM_SHALLOW = 0,
     MEDIA_MEM_DEEP,
+    MEDIA_MEM_REF,
 } media_mem_type_t;
 
+#include "media-buffer.h"
 #include "audio-def.h"
 #include "video-def.h"
 #include "video-conv.h"
+#include "audio-conv.h"
+#include "h26x-nal.h"
 
 /*
  * +--------------+
@@ -100,6 +105,11 @@ struct media_packet {
 };
 
 GEAR_API struct media_packet *media_packet_create(enum media_type type, media_mem_type_t mem_type, void *data, size_t len);
+/*
+ * zero copy packet on top of buf, a reference is taken. data/len must lie
+ * inside buf, data NULL means the whole buffer.
+ */
+GEAR_API struct media_packet *media_packet_create_ref(enum media_type type, struct media_buffer *buf, void *data, size_t len);
 GEAR_API void media_packet_destroy(struct media_packet *mp);
 GEAR_API struct media_packet *media_packet_copy(const struct media_packet *src, media_mem_type_t type);
 GEAR_API size_t media_packet_get_size(struct media_packet *mp);
@@ -0,0 +1,275 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#include "libmedia-io.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define POOL_MIN_SHIFT          6   /* 64B */
+#define POOL_MAX_SHIFT          24  /* 16MB */
+#define POOL_CLASSES            (POOL_MAX_SHIFT - POOL_MIN_SHIFT + 1)
+#define POOL_CLASS_BYTES        (32 * 1024 * 1024)
+#define POOL_CLASS_MIN_BLOCKS   4
+#define POOL_CLASS_MAX_BLOCKS   256
+#define POOL_UNPOOLED           (-1)
+
+#define ALIGN_SIZE(size, align) (((size) + (align - 1)) & (~(align - 1)))
+
+#if defined(_MSC_VER)
+#define atomic_inc(p)   InterlockedIncrement((volatile LONG *)(p))
+#define atomic_dec(p)   InterlockedDecrement((volatile LONG *)(p))
+#define atomic_get(p)   InterlockedCompareExchange((volatile LONG *)(p), 0, 0)
+#else
+#define atomic_inc(p)   __atomic_add_fetch(p, 1, __ATOMIC_RELAXED)
+#define atomic_dec(p)   __atomic_sub_fetch(p, 1, __ATOMIC_ACQ_REL)
+#define atomic_get(p)   __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#endif
+
+/*
+ * every block is [raw malloc padding][pool_hdr][payload], the header sits
+ * right before the aligned payload so media_pool_free can find its class.
+ */
+struct pool_hdr {
+    void            *raw;
+    struct pool_hdr *next;
+    int              cls;
+};
+
+struct pool_class {
+    pthread_mutex_t  lock;
+    struct pool_hdr *head;
+    int              cnt;
+    int              max;
+    uint64_t         alloc_cnt;
+    uint64_t         hit_cnt;
+};
+
+struct media_pool {
+    struct pool_class cls[POOL_CLASSES];
+};
+
+static struct media_pool g_pool;
+static pthread_once_t g_pool_once = PTHREAD_ONCE_INIT;
+
+static void pool_init(void)
+{
+    int i, max;
+    for (i = 0; i < POOL_CLASSES; i++) {
+        max = POOL_CLASS_BYTES >> (POOL_MIN_SHIFT + i);
+        if (max < POOL_CLASS_MIN_BLOCKS) {
+            max = POOL_CLASS_MIN_BLOCKS;
+        } else if (max > POOL_CLASS_MAX_BLOCKS) {
+            max = POOL_CLASS_MAX_BLOCKS;
+        }
+        pthread_mutex_init(&g_pool.cls[i].lock, NULL);
+        g_pool.cls[i].head = NULL;
+        g_pool.cls[i].cnt = 0;
+        g_pool.cls[i].max = max;
+        g_pool.cls[i].alloc_cnt = 0;
+        g_pool.cls[i].hit_cnt = 0;
+    }
+}
+
+static int pool_class(size_t size)
+{
+    int shift = POOL_MIN_SHIFT;
+    while (((size_t)1 << shift) < size) {
+        if (++shift > POOL_MAX_SHIFT) {
+            return POOL_UNPOOLED;
+        }
+    }
+    return shift - POOL_MIN_SHIFT;
+}
+
+static struct pool_hdr *block_alloc(size_t size, int cls)
+{
+    uintptr_t payload;
+    struct pool_hdr *hdr;
+    void *raw = malloc(sizeof(struct pool_hdr) + MEDIA_BUFFER_ALIGN - 1 + size);
+    if (!raw) {
+        return NULL;
+    }
+    payload = ALIGN_SIZE((uintptr_t)raw + sizeof(struct pool_hdr), MEDIA_BUFFER_ALIGN);
+    hdr = (struct pool_hdr *)payload - 1;
+    hdr->raw = raw;
+    hdr->next = NULL;
+    hdr->cls = cls;
+    return hdr;
+}
+
+void *media_pool_alloc(size_t size)
+{
+    struct pool_class *pc;
+    struct pool_hdr *hdr = NULL;
+    int cls = pool_class(size);
+
+    pthread_once(&g_pool_once, pool_init);
+    if (cls != POOL_UNPOOLED) {
+        pc = &g_pool.cls[cls];
+        pthread_mutex_lock(&pc->lock);
+        hdr = pc->head;
+        if (hdr) {
+            pc->head = hdr->next;
+            pc->cnt--;
+            pc->hit_cnt++;
+        }
+        pc->alloc_cnt++;
+        pthread_mutex_unlock(&pc->lock);
+        size = (size_t)1 << (cls + POOL_MIN_SHIFT);
+    }
+    if (!hdr) {
+        hdr = block_alloc(size, cls);
+        if (!hdr) {
+            printf("%s: malloc %zu failed!\n", __func__, size);
+            return NULL;
+        }
+    }
+    hdr->next = NULL;
+    return hdr + 1;
+}
+
+void media_pool_free(void *ptr)
+{
+    struct pool_class *pc;
+    struct pool_hdr *hdr;
+
+    if (!ptr) {
+        return;
+    }
+    hdr = (struct pool_hdr *)ptr - 1;
+    if (hdr->cls != POOL_UNPOOLED) {
+        pc = &g_pool.cls[hdr->cls];
+        pthread_mutex_lock(&pc->lock);
+        if (pc->cnt < pc->max) {
+            hdr->next = pc->head;
+            pc->head = hdr;
+            pc->cnt++;
+            hdr = NULL;
+        }
+        pthread_mutex_unlock(&pc->lock);
+    }
+    if (hdr) {
+        free(hdr->raw);
+    }
+}
+
+void media_pool_trim(void)
+{
+    struct pool_hdr *hdr, *next;
+    int i;
+
+    pthread_once(&g_pool_once, pool_init);
+    for (i = 0; i < POOL_CLASSES; i++) {
+        pthread_mutex_lock(&g_pool.cls[i].lock);
+        hdr = g_pool.cls[i].head;
+        g_pool.cls[i].head = NULL;
+        g_pool.cls[i].cnt = 0;
+        pthread_mutex_unlock(&g_pool.cls[i].lock);
+        for (; hdr; hdr = next) {
+            next = hdr->next;
+            free(hdr->raw);
+        }
+    }
+}
+
+void media_pool_get_stat(struct media_pool_stat *st)
+{
+    int i;
+
+    if (!st) {
+        return;
+    }
+    pthread_once(&g_pool_once, pool_init);
+    memset(st, 0, sizeof(*st));
+    for (i = 0; i < POOL_CLASSES; i++) {
+        pthread_mutex_lock(&g_pool.cls[i].lock);
+        st->cached_bytes += (uint64_t)g_pool.cls[i].cnt << (i + POOL_MIN_SHIFT);
+        st->alloc_cnt += g_pool.cls[i].alloc_cnt;
+        st->hit_cnt += g_pool.cls[i].hit_cnt;
+        pthread_mutex_unlock(&g_pool.cls[i].lock);
+    }
+}
+
+#define BUFFER_HDR_SIZE ALIGN_SIZE(sizeof(struct media_buffer), MEDIA_BUFFER_ALIGN)
+
+struct media_buffer *media_buffer_alloc(size_t size)
+{
+    struct media_buffer *buf = media_pool_alloc(BUFFER_HDR_SIZE + size);
+    if (!buf) {
+        return NULL;
+    }
+    buf->data = (uint8_t *)buf + BUFFER_HDR_SIZE;
+    buf->size = size;
+    buf->refcnt = 1;
+    buf->free_cb = NULL;
+    buf->opaque = NULL;
+    return buf;
+}
+
+struct media_buffer *media_buffer_wrap(uint8_t *data, size_t size,
+                media_buffer_free_cb free_cb, void *opaque)
+{
+    struct media_buffer *buf;
+
+    if (!data) {
+        printf("%s invalid paramenters!\n", __func__);
+        return NULL;
+    }
+    buf = media_pool_alloc(sizeof(struct media_buffer));
+    if (!buf) {
+        return NULL;
+    }
+    buf->data = data;
+    buf->size = size;
+    buf->refcnt = 1;
+    buf->free_cb = free_cb;
+    buf->opaque = opaque;
+    return buf;
+}
+
+struct media_buffer *media_buffer_ref(struct media_buffer *buf)
+{
+    if (buf) {
+        atomic_inc(&buf->refcnt);
+    }
+    return buf;
+}
+
+void media_buffer_unref(struct media_buffer *buf)
+{
+    if (!buf) {
+        return;
+    }
+    if (atomic_dec(&buf->refcnt) != 0) {
+        return;
+    }
+    if (buf->free_cb) {
+        buf->free_cb(buf->opaque, buf->data);
+    }
+    media_pool_free(buf);
+}
+
+bool media_buffer_is_writable(const struct media_buffer *buf)
+{
+    return buf && atomic_get(&buf->refcnt) == 1;
+}
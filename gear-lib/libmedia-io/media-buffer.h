@@ -0,0 +1,91 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#ifndef MEDIA_BUFFER_H
+#define MEDIA_BUFFER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * Refcounted media memory and size-classed block pool
+ *
+ * A media_buffer is shared by every stage a frame or packet travels through
+ * (capture -> encode -> rtsp/rtmp/mp4), copying a MEDIA_MEM_REF packet only
+ * takes a reference. Memory owned by somebody else (v4l2 mmap, shm, encoder
+ * output) is wrapped with a free callback which runs on the last unref.
+ *
+ * Blocks come from power-of-two classes 64B..16MB with a bounded freelist
+ * per class, so steady state streaming does not hit malloc.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MEDIA_BUFFER_ALIGN      64
+
+typedef void (*media_buffer_free_cb)(void *opaque, uint8_t *data);
+
+struct media_buffer {
+    uint8_t              *data;
+    size_t                size;
+    volatile int          refcnt;
+    media_buffer_free_cb  free_cb;
+    void                 *opaque;
+};
+
+struct media_pool_stat {
+    uint64_t alloc_cnt;     /* pooled size allocations */
+    uint64_t hit_cnt;       /* served from freelist */
+    uint64_t cached_bytes;  /* bytes held in freelists */
+};
+
+/*
+ * MEDIA_BUFFER_ALIGN aligned block, must be released by media_pool_free.
+ * Content is not initialized.
+ */
+GEAR_API void *media_pool_alloc(size_t size);
+GEAR_API void media_pool_free(void *ptr);
+GEAR_API void media_pool_trim(void);
+GEAR_API void media_pool_get_stat(struct media_pool_stat *st);
+
+/*
+ * pooled buffer with refcnt 1, data is MEDIA_BUFFER_ALIGN aligned
+ */
+GEAR_API struct media_buffer *media_buffer_alloc(size_t size);
+
+/*
+ * wrap memory owned by the caller, free_cb(opaque, data) is called when
+ * the last reference is dropped. free_cb may be NULL for static memory.
+ */
+GEAR_API struct media_buffer *media_buffer_wrap(uint8_t *data, size_t size,
+                media_buffer_free_cb free_cb, void *opaque);
+
+GEAR_API struct media_buffer *media_buffer_ref(struct media_buffer *buf);
+GEAR_API void media_buffer_unref(struct media_buffer *buf);
+GEAR_API bool media_buffer_is_writable(const struct media_buffer *buf);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
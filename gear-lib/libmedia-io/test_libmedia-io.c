@@ -22,8 +22,340 @@
 #include "libmedia-io.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int foo_h26x_nal(void)
+{
+    int i, n, nals = 0;
+    size_t len = 8 * 1024 * 1024;
+    uint8_t *buf = calloc(1, len);
+    uint8_t *avcc, *annexb;
+    const uint8_t *p, *end = buf + len;
+    struct h26x_nal nal;
+    ssize_t avcc_len, annexb_len;
+    uint64_t t;
+
+    srand(1);
+    for (i = 0; i < (int)len; i++) {
+        buf[i] = (rand() % 255) + 1;
+    }
+    /* plant start codes, four bytes ones every 8th */
+    for (i = 0, n = 0; i + 64 < (int)len; i += 1000 + (rand() % 30000), n++) {
+        memcpy(buf + i, (n % 8) ? "\x00\x00\x01\x41" : "\x00\x00\x00\x01\x65", (n % 8) ? 4 : 5);
+    }
+    for (p = buf; (p = h26x_next_nal(VIDEO_CODEC_H264, p, end, &nal)) != NULL;) {
+        nals++;
+    }
+    printf("h26x_next_nal planted=%d found=%d %s\n", n, nals, n == nals ? "ok" : "FAILED");
+
+    avcc_len = h26x_annexb_to_avcc(buf, len, NULL, 0);
+    avcc = malloc(avcc_len);
+    annexb = malloc(avcc_len);
+    h26x_annexb_to_avcc(buf, len, avcc, avcc_len);
+    annexb_len = h26x_avcc_to_annexb(avcc, avcc_len, 4, annexb, avcc_len);
+    printf("annexb->avcc->annexb len=%zd/%zd %s\n", avcc_len, annexb_len,
+           (annexb_len == avcc_len && 0 == memcmp(annexb + 4, buf + 4, 100)) ? "ok" : "FAILED");
+
+    t = now_ns();
+    for (i = 0; i < 20; i++) {
+        for (p = buf; (p = h26x_next_nal(VIDEO_CODEC_H264, p, end, &nal)) != NULL;);
+    }
+    t = now_ns() - t;
+    printf("start code scan: %.1f MB/s\n", (20.0 * len / (1024 * 1024)) / (t / 1e9));
+
+    /* only start codes: no NAL and no stack growth */
+    memset(buf, 0, len);
+    for (i = 0; i + 3 <= (int)len; i += 3) {
+        buf[i + 2] = 1;
+    }
+    if (h26x_next_nal(VIDEO_CODEC_H264, buf, end, &nal) != NULL) {
+        printf("h26x_next_nal found a NAL in empty start codes\n");
+        nals = -1;
+    }
+    /* partitions B/C don't start a slice */
+    if (h26x_nal_classify(VIDEO_CODEC_H264, H264_NAL_DPA) != H26X_NAL_SLICE ||
+        h26x_nal_classify(VIDEO_CODEC_H264, H264_NAL_DPB) != H26X_NAL_SLICE_PART ||
+        h26x_nal_classify(VIDEO_CODEC_H264, H264_NAL_DPC) != H26X_NAL_SLICE_PART) {
+        printf("h26x_nal_classify data partitions FAILED\n");
+        nals = -1;
+    }
+
+    free(annexb);
+    free(avcc);
+    free(buf);
+    return (n == nals) ? 0 : -1;
+}
+
+static int wrap_freed = 0;
+
+static void wrap_free(void *opaque, uint8_t *data)
+{
+    wrap_freed++;
+    free(data);
+}
+
+static int foo_media_buffer(void)
+{
+    int i, hops = 4, loops = 20000;
+    size_t len = 64 * 1024;
+    uint8_t *src = calloc(1, len);
+    struct media_packet *mp, *cp[4];
+    struct media_buffer *buf;
+    struct media_pool_stat st;
+    uint64_t t_deep, t_ref;
+    int ret = 0;
+
+    /* foreign memory: freed once by the last holder */
+    buf = media_buffer_wrap(malloc(len), len, wrap_free, NULL);
+    mp = media_packet_create_ref(MEDIA_TYPE_VIDEO, buf, NULL, 0);
+    media_buffer_unref(buf);
+    cp[0] = media_packet_copy(mp, MEDIA_MEM_REF);
+    media_packet_destroy(mp);
+    if (wrap_freed != 0 || cp[0]->video->data != buf->data) {
+        ret = -1;
+    }
+    media_packet_destroy(cp[0]);
+    printf("media_buffer_wrap freed=%d %s\n", wrap_freed,
+           (ret == 0 && wrap_freed == 1) ? "ok" : "FAILED");
+
+    /* encoder -> queue -> muxers, deep copy at every hop vs refcount */
+    t_deep = now_ns();
+    for (i = 0; i < loops; i++) {
+        int j;
+        mp = media_packet_create(MEDIA_TYPE_VIDEO, MEDIA_MEM_DEEP, src, len);
+        for (j = 0; j < hops; j++) {
+            cp[j] = media_packet_copy(mp, MEDIA_MEM_DEEP);
+        }
+        media_packet_destroy(mp);
+        for (j = 0; j < hops; j++) {
+            media_packet_destroy(cp[j]);
+        }
+    }
+    t_deep = now_ns() - t_deep;
+
+    t_ref = now_ns();
+    for (i = 0; i < loops; i++) {
+        int j;
+        mp = media_packet_create(MEDIA_TYPE_VIDEO, MEDIA_MEM_REF, src, len);
+        for (j = 0; j < hops; j++) {
+            cp[j] = media_packet_copy(mp, MEDIA_MEM_REF);
+        }
+        media_packet_destroy(mp);
+        for (j = 0; j < hops; j++) {
+            media_packet_destroy(cp[j]);
+        }
+    }
+    t_ref = now_ns() - t_ref;
+    media_pool_get_stat(&st);
+    printf("%d hops x %zuKB: deep %.2fus, ref %.2fus per packet\n",
+           hops, len / 1024, t_deep / 1e3 / loops, t_ref / 1e3 / loops);
+    printf("media_pool alloc=%" PRIu64 " hit=%" PRIu64 " (%.1f%%) cached=%" PRIu64 "KB\n",
+           st.alloc_cnt, st.hit_cnt, st.alloc_cnt ? 100.0 * st.hit_cnt / st.alloc_cnt : 0,
+           st.cached_bytes / 1024);
+    media_pool_trim();
+    free(src);
+    return ret;
+}
+
+/*
+ * run one convert (mode < 0) or scale with the SIMD kernels and again with
+ * the C ones, the outputs must match byte for byte
+ */
+static int video_conv_same(struct video_frame *dst, const struct video_frame *src, int mode)
+{
+    struct video_frame *ref = video_frame_create(dst->format, dst->width, dst->height, MEDIA_MEM_DEEP);
+    int r1, r2, ret = -1;
+    size_t k;
+
+    if (!ref) {
+        return -1;
+    }
+    memset(dst->data[0], 0, dst->total_size);
+    memset(ref->data[0], 0, ref->total_size);
+    video_conv_set_simd(true);
+    r1 = (mode < 0) ? video_frame_convert(dst, src) : video_frame_scale(dst, src, mode);
+    video_conv_set_simd(false);
+    r2 = (mode < 0) ? video_frame_convert(ref, src) : video_frame_scale(ref, src, mode);
+    video_conv_set_simd(true);
+    if (r1 != 0 || r2 != 0) {
+        printf("%s -> %s %ux%u failed: simd %d, c %d\n", pixel_format_to_string(src->format),
+               pixel_format_to_string(dst->format), dst->width, dst->height, r1, r2);
+    } else if (memcmp(dst->data[0], ref->data[0], dst->total_size)) {
+        for (k = 0; dst->data[0][k] == ref->data[0][k]; k++) {
+        }
+        printf("%s -> %s %ux%u: simd and c differ at byte %zu (%u != %u)\n",
+               pixel_format_to_string(src->format), pixel_format_to_string(dst->format),
+               dst->width, dst->height, k, dst->data[0][k], ref->data[0][k]);
+    } else {
+        ret = 0;
+    }
+    video_frame_destroy(ref);
+    return ret;
+}
+
+static int foo_video_conv(void)
+{
+    struct {
+        enum pixel_format src;
+        enum pixel_format dst;
+    } pairs[] = {
+        {PIXEL_FORMAT_YUY2, PIXEL_FORMAT_I420},
+        {PIXEL_FORMAT_I420, PIXEL_FORMAT_BGRA},
+        {PIXEL_FORMAT_BGRA, PIXEL_FORMAT_NV12},
+        {PIXEL_FORMAT_NV12, PIXEL_FORMAT_I420},
+        {PIXEL_FORMAT_UYVY, PIXEL_FORMAT_I422},
+        {PIXEL_FORMAT_I420, PIXEL_FORMAT_YUY2},
+        {PIXEL_FORMAT_RGBA, PIXEL_FORMAT_UYVY},
+        {PIXEL_FORMAT_I444, PIXEL_FORMAT_NV12},
+        {PIXEL_FORMAT_NV12, PIXEL_FORMAT_RGBA},
+    };
+    /* 1080p is sliced and SIMD aligned, 642x362 leaves tails everywhere */
+    static const uint32_t sizes[][2] = {{1920, 1080}, {642, 362}};
+    static const uint32_t scaled[][2] = {{1280, 720}, {960, 540}, {322, 182}, {2562, 1442}};
+    struct video_frame *src, *dst;
+    int i, j, m, loops = 50, ret = 0;
+    size_t k, n;
+    uint64_t t;
+
+    for (i = 0; i < (int)(sizeof(pairs) / sizeof(pairs[0])); i++) {
+        for (n = 0; n < sizeof(sizes) / sizeof(sizes[0]); n++) {
+            src = video_frame_create(pairs[i].src, sizes[n][0], sizes[n][1], MEDIA_MEM_DEEP);
+            dst = video_frame_create(pairs[i].dst, sizes[n][0], sizes[n][1], MEDIA_MEM_DEEP);
+            for (k = 0; k < src->total_size; k++) {
+                src->data[0][k] = rand();
+            }
+            if (0 != video_conv_same(dst, src, -1)) {
+                ret = -1;
+            }
+            if (n == 0) {
+                t = now_ns();
+                for (j = 0; j < loops; j++) {
+                    video_frame_convert(dst, src);
+                }
+                t = now_ns() - t;
+                printf("1080p %s -> %s: %.2f ms/frame\n", pixel_format_to_string(pairs[i].src),
+                       pixel_format_to_string(pairs[i].dst), t / 1e6 / loops);
+            }
+            video_frame_destroy(src);
+            video_frame_destroy(dst);
+        }
+    }
+
+    src = video_frame_create(PIXEL_FORMAT_I420, 1920, 1080, MEDIA_MEM_DEEP);
+    for (k = 0; k < src->total_size; k++) {
+        src->data[0][k] = rand();
+    }
+    for (m = VIDEO_SCALE_BILINEAR; m <= VIDEO_SCALE_AREA; m++) {
+        for (n = 0; n < sizeof(scaled) / sizeof(scaled[0]); n++) {
+            dst = video_frame_create(PIXEL_FORMAT_I420, scaled[n][0], scaled[n][1], MEDIA_MEM_DEEP);
+            if (0 != video_conv_same(dst, src, m)) {
+                ret = -1;
+            }
+            video_frame_destroy(dst);
+        }
+    }
+    dst = video_frame_create(PIXEL_FORMAT_I420, 1280, 720, MEDIA_MEM_DEEP);
+    t = now_ns();
+    for (j = 0; j < loops; j++) {
+        video_frame_scale(dst, src, VIDEO_SCALE_BILINEAR);
+    }
+    t = now_ns() - t;
+    printf("I420 1080p -> 720p bilinear: %.2f ms/frame\n", t / 1e6 / loops);
+    video_frame_destroy(dst);
+    dst = video_frame_create(PIXEL_FORMAT_I420, 960, 540, MEDIA_MEM_DEEP);
+    t = now_ns();
+    for (j = 0; j < loops; j++) {
+        video_frame_scale(dst, src, VIDEO_SCALE_AREA);
+    }
+    t = now_ns() - t;
+    printf("I420 1080p -> 540p area: %.2f ms/frame\n", t / 1e6 / loops);
+    video_frame_destroy(dst);
+    video_frame_destroy(src);
+    printf("video conv simd vs c: %s\n", ret ? "FAIL" : "ok");
+    return ret;
+}
+
+static int foo_audio_conv(void)
+{
+    struct audio_frame *pcm, *flt, *out, *voice;
+    const struct audio_frame *srcs[2];
+    struct audio_resampler *rs;
+    float gain[2] = {1.0f, 0.5f};
+    int16_t *s16;
+    uint32_t i;
+    int j, loops = 200;
+    uint64_t t;
+
+    /* 20ms of 48k stereo, the usual encoder input */
+    pcm = audio_frame_create(SAMPLE_FORMAT_PCM_S16LE, 48000, 2, 960, MEDIA_MEM_REF);
+    s16 = (int16_t *)pcm->data[0];
+    for (i = 0; i < pcm->frames; i++) {
+        s16[2 * i] = s16[2 * i + 1] = (int16_t)(16384 * sin(2 * M_PI * 1000 * i / 48000.0));
+    }
+    flt = audio_frame_create(SAMPLE_FORMAT_PCM_F32LE_PLANAR, 48000, 2, 960, MEDIA_MEM_REF);
+    t = now_ns();
+    for (j = 0; j < loops; j++) {
+        audio_frame_convert(flt, pcm);
+        audio_frame_convert(pcm, flt);
+    }
+    t = now_ns() - t;
+    printf("S16LE <-> F32LE_PLANAR 960x2: %.2f us/frame, sample[100] %d\n",
+           t / 1e3 / loops / 2, s16[200]);
+
+    rs = audio_resampler_create(48000, 44100, 2);
+    /* steady state yields ceil(960 * 44100 / 48000) frames at most */
+    out = audio_frame_create(SAMPLE_FORMAT_PCM_S16LE, 44100, 2, 883, MEDIA_MEM_REF);
+    t = now_ns();
+    for (j = 0; j < loops; j++) {
+        audio_resampler_frame(rs, out, pcm);
+    }
+    t = now_ns() - t;
+    printf("resample 48k -> 44.1k stereo: %.2f us/20ms, %u frames out\n",
+           t / 1e3 / loops, out->frames);
+    audio_resampler_destroy(rs);
+    audio_frame_destroy(out);
+
+    voice = audio_frame_create(SAMPLE_FORMAT_PCM_S16LE, 48000, 1, 480, MEDIA_MEM_REF);
+    memset(voice->data[0], 0x10, voice->total_size);
+    out = audio_frame_create(SAMPLE_FORMAT_PCM_S16LE, 48000, 2, 960, MEDIA_MEM_REF);
+    srcs[0] = pcm;
+    srcs[1] = voice;
+    t = now_ns();
+    for (j = 0; j < loops; j++) {
+        audio_frame_mix(out, srcs, gain, 2);
+    }
+    t = now_ns() - t;
+    printf("mix stereo + mono into stereo: %.2f us/20ms, %u frames\n",
+           t / 1e3 / loops, out->frames);
+
+    audio_frame_reformat(out, SAMPLE_FORMAT_PCM_F32LE, 1);
+    printf("reformat to %s mono: %u frames, %" PRIu64 " bytes\n",
+           sample_format_to_string(out->format), out->frames, out->total_size);
+    audio_frame_destroy(out);
+    audio_frame_destroy(voice);
+    audio_frame_destroy(flt);
+    audio_frame_destroy(pcm);
+    return 0;
+}
 
 int main(int argc, char **argv)
 {
+    foo_h26x_nal();
+    foo_media_buffer();
+    if (foo_video_conv() < 0) {
+        return -1;
+    }
+    foo_audio_conv();
     return 0;
 }
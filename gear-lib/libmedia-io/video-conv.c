@@ -1,34 +1,1555 @@
-
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
 #include "libmedia-io.h"
-#include "video-conv.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#if defined (__linux__)
+#include <sys/sysinfo.h>
+#endif
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#define CONV_SIMD_X86
+#include <immintrin.h>
+#elif defined (__ARM_NEON) || defined (__ARM_NEON__)
+#define CONV_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+#define CONV_MAX_THREADS    8
+#define CONV_MT_PIXELS      (1280 * 720)
+#define CONV_SLICE_ROWS     32
+#define CONV_TMP_ROWS       11
+#define CONV_ROW_ALIGN      64
+#define ALIGN_SIZE(size, align) (((size) + (align - 1)) & (~(align - 1)))
+
+/*
+ * BT.601 limited range, 6 bit fixed point like most SIMD converters:
+ * luma is (Y * 0x0101 * YG) >> 16 so that 16..235 maps to 0..255 exactly
+ */
+#define YG      18997   /* 1.164 * 64 * 65536 / 257 */
+#define YGB     1192    /* 16 * 1.164 * 64 */
+#define VR      102     /* 1.596 * 64 */
+#define UG      25      /* 0.391 * 64 */
+#define VG      52      /* 0.813 * 64 */
+#define UB      129     /* 2.018 * 64 */
+
+#define RY      66
+#define GY      129
+#define BY      25
+#define RU      (-38)
+#define GU      (-74)
+#define BU      112
+#define RV      112
+#define GV      (-94)
+#define BV      (-18)
+
+enum conv_kind {
+    CONV_PLANAR,
+    CONV_NV12,
+    CONV_PACKED,    /* 4:2:2 packed */
+    CONV_RGB32,
+    CONV_GRAY,
+};
+
+#define CONV_Y_ODD      0x01    /* UYVY: luma at odd bytes */
+#define CONV_SWAP_UV    0x02    /* YVYU: V before U */
+
+struct conv_fmt {
+    enum pixel_format format;
+    enum conv_kind    kind;
+    uint8_t           cw;       /* chroma horizontal shift */
+    uint8_t           ch;       /* chroma vertical shift */
+    uint8_t           flags;
+    uint8_t           pos[4];   /* RGB32: byte offset of R, G, B, A */
+};
+
+/*
+ * RGB sources produce and RGB sinks consume chroma at half horizontal
+ * resolution, so they sit in the pipeline like 4:2:2
+ */
+static const struct conv_fmt conv_fmt_tbl[] = {
+    {PIXEL_FORMAT_I420, CONV_PLANAR, 1, 1, 0,            {0, 0, 0, 0}},
+    {PIXEL_FORMAT_I422, CONV_PLANAR, 1, 0, 0,            {0, 0, 0, 0}},
+    {PIXEL_FORMAT_I444, CONV_PLANAR, 0, 0, 0,            {0, 0, 0, 0}},
+    {PIXEL_FORMAT_NV12, CONV_NV12,   1, 1, 0,            {0, 0, 0, 0}},
+    {PIXEL_FORMAT_YUY2, CONV_PACKED, 1, 0, 0,            {0, 0, 0, 0}},
+    {PIXEL_FORMAT_YVYU, CONV_PACKED, 1, 0, CONV_SWAP_UV, {0, 0, 0, 0}},
+    {PIXEL_FORMAT_UYVY, CONV_PACKED, 1, 0, CONV_Y_ODD,   {0, 0, 0, 0}},
+    {PIXEL_FORMAT_BGRA, CONV_RGB32,  1, 0, 0,            {2, 1, 0, 3}},
+    {PIXEL_FORMAT_BGRX, CONV_RGB32,  1, 0, 0,            {2, 1, 0, 3}},
+    {PIXEL_FORMAT_RGBA, CONV_RGB32,  1, 0, 0,            {0, 1, 2, 3}},
+    {PIXEL_FORMAT_Y800, CONV_GRAY,   1, 1, 0,            {0, 0, 0, 0}},
+};
+
+struct conv_kernels {
+    void (*unpack422)(const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v, int w, int y_odd);
+    void (*pack422)(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int w, int y_odd);
+    void (*split_uv)(const uint8_t *uv, uint8_t *u, uint8_t *v, int n);
+    void (*merge_uv)(const uint8_t *u, const uint8_t *v, uint8_t *uv, int n);
+    void (*avg_row)(const uint8_t *a, const uint8_t *b, uint8_t *dst, int n);
+    void (*half_row)(const uint8_t *src, uint8_t *dst, int n);
+    void (*half_row_c4)(const uint8_t *src, uint8_t *dst, int n);
+    void (*double_row)(const uint8_t *src, uint8_t *dst, int n);
+    void (*lerp_row)(const uint8_t *a, const uint8_t *b, uint8_t *dst, int n, int f);
+    void (*yuv2rgb)(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int w, const uint8_t *pos);
+    void (*rgb2yuv)(const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v, int w, const uint8_t *pos);
+};
+
+static inline uint8_t clamp8(int v)
+{
+    return (v < 0) ? 0 : ((v > 255) ? 255 : (uint8_t)v);
+}
+
+/******************************************************************************
+ * C kernels, also used for the tail of SIMD rows
+ ******************************************************************************/
+static void unpack422_c(const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v, int w, int y_odd)
+{
+    int i, yo = y_odd ? 1 : 0, co = y_odd ? 0 : 1;
+    for (i = 0; i < w / 2; i++) {
+        y[2 * i]     = src[4 * i + yo];
+        y[2 * i + 1] = src[4 * i + yo + 2];
+        u[i]         = src[4 * i + co];
+        v[i]         = src[4 * i + co + 2];
+    }
+}
+
+static void pack422_c(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int w, int y_odd)
+{
+    int i, yo = y_odd ? 1 : 0, co = y_odd ? 0 : 1;
+    for (i = 0; i < w / 2; i++) {
+        dst[4 * i + yo]     = y[2 * i];
+        dst[4 * i + yo + 2] = y[2 * i + 1];
+        dst[4 * i + co]     = u[i];
+        dst[4 * i + co + 2] = v[i];
+    }
+}
+
+static void split_uv_c(const uint8_t *uv, uint8_t *u, uint8_t *v, int n)
+{
+    int i;
+    for (i = 0; i < n; i++) {
+        u[i] = uv[2 * i];
+        v[i] = uv[2 * i + 1];
+    }
+}
+
+static void merge_uv_c(const uint8_t *u, const uint8_t *v, uint8_t *uv, int n)
+{
+    int i;
+    for (i = 0; i < n; i++) {
+        uv[2 * i]     = u[i];
+        uv[2 * i + 1] = v[i];
+    }
+}
+
+static void avg_row_c(const uint8_t *a, const uint8_t *b, uint8_t *dst, int n)
+{
+    int i;
+    for (i = 0; i < n; i++) {
+        dst[i] = (a[i] + b[i] + 1) >> 1;
+    }
+}
+
+/* n output samples, each the rounded mean of two neighbours */
+static void half_row_c(const uint8_t *src, uint8_t *dst, int n)
+{
+    int i;
+    for (i = 0; i < n; i++) {
+        dst[i] = (src[2 * i] + src[2 * i + 1] + 1) >> 1;
+    }
+}
+
+static void half_row_c2(const uint8_t *src, uint8_t *dst, int n)
+{
+    int i;
+    for (i = 0; i < n; i++) {
+        dst[2 * i]     = (src[4 * i]     + src[4 * i + 2] + 1) >> 1;
+        dst[2 * i + 1] = (src[4 * i + 1] + src[4 * i + 3] + 1) >> 1;
+    }
+}
+
+static void half_row_c4_c(const uint8_t *src, uint8_t *dst, int n)
+{
+    int i, k;
+    for (i = 0; i < n; i++) {
+        for (k = 0; k < 4; k++) {
+            dst[4 * i + k] = (src[8 * i + k] + src[8 * i + 4 + k] + 1) >> 1;
+        }
+    }
+}
+
+/* n input samples, each written twice */
+static void double_row_c(const uint8_t *src, uint8_t *dst, int n)
+{
+    int i;
+    for (i = 0; i < n; i++) {
+        dst[2 * i] = dst[2 * i + 1] = src[i];
+    }
+}
+
+/* f in 1..255, weight of b */
+static void lerp_row_c(const uint8_t *a, const uint8_t *b, uint8_t *dst, int n, int f)
+{
+    int i;
+    for (i = 0; i < n; i++) {
+        dst[i] = (a[i] * (256 - f) + b[i] * f + 128) >> 8;
+    }
+}
+
+static inline void yuv2rgb_px(int y, int u, int v, uint8_t *dst, const uint8_t *pos)
+{
+    int yy = (int)(((uint32_t)y * 0x0101 * YG) >> 16) - YGB;
+    u -= 128;
+    v -= 128;
+    dst[pos[0]] = clamp8((yy + VR * v + 32) >> 6);
+    dst[pos[1]] = clamp8((yy - UG * u - VG * v + 32) >> 6);
+    dst[pos[2]] = clamp8((yy + UB * u + 32) >> 6);
+    dst[pos[3]] = 0xff;
+}
+
+static void yuv2rgb_c(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int w, const uint8_t *pos)
+{
+    int i;
+    for (i = 0; i < w / 2; i++) {
+        yuv2rgb_px(y[2 * i],     u[i], v[i], dst + 8 * i,     pos);
+        yuv2rgb_px(y[2 * i + 1], u[i], v[i], dst + 8 * i + 4, pos);
+    }
+}
+
+static void rgb2yuv_c(const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v, int w, const uint8_t *pos)
+{
+    int i, r, g, b;
+    const uint8_t *p;
+    for (i = 0; i < w; i++) {
+        p = src + 4 * i;
+        y[i] = ((RY * p[pos[0]] + GY * p[pos[1]] + BY * p[pos[2]] + 128) >> 8) + 16;
+    }
+    for (i = 0; i < w / 2; i++) {
+        p = src + 8 * i;
+        r = p[pos[0]] + p[4 + pos[0]];
+        g = p[pos[1]] + p[4 + pos[1]];
+        b = p[pos[2]] + p[4 + pos[2]];
+        u[i] = ((RU * r + GU * g + BU * b + 256) >> 9) + 128;
+        v[i] = ((RV * r + GV * g + BV * b + 256) >> 9) + 128;
+    }
+}
 
+#if defined (CONV_SIMD_X86)
+/******************************************************************************
+ * SSE2 kernels
+ ******************************************************************************/
+__attribute__((target("sse2")))
+static void unpack422_sse2(const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v, int w, int y_odd)
+{
+    const __m128i lo = _mm_set1_epi16(0x00ff);
+    __m128i a, b, c, d, ya, yb, ca, cb, cc;
+    int i = 0;
+    for (; i + 16 <= w; i += 16) {
+        a = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+        b = _mm_loadu_si128((const __m128i *)(src + 2 * i + 16));
+        if (y_odd) {
+            ya = _mm_srli_epi16(a, 8);
+            yb = _mm_srli_epi16(b, 8);
+            ca = _mm_and_si128(a, lo);
+            cb = _mm_and_si128(b, lo);
+        } else {
+            ya = _mm_and_si128(a, lo);
+            yb = _mm_and_si128(b, lo);
+            ca = _mm_srli_epi16(a, 8);
+            cb = _mm_srli_epi16(b, 8);
+        }
+        _mm_storeu_si128((__m128i *)(y + i), _mm_packus_epi16(ya, yb));
+        cc = _mm_packus_epi16(ca, cb);  /* u0 v0 u1 v1 ... */
+        c = _mm_and_si128(cc, lo);
+        d = _mm_srli_epi16(cc, 8);
+        _mm_storel_epi64((__m128i *)(u + i / 2), _mm_packus_epi16(c, c));
+        _mm_storel_epi64((__m128i *)(v + i / 2), _mm_packus_epi16(d, d));
+    }
+    unpack422_c(src + 2 * i, y + i, u + i / 2, v + i / 2, w - i, y_odd);
+}
 
-#define YUYV2RGB_2(pyuv, prgb) { \
-    float r = 1.402f * ((pyuv)[3]-128); \
-    float g = -0.34414f * ((pyuv)[1]-128) - 0.71414f * ((pyuv)[3]-128); \
-    float b = 1.772f * ((pyuv)[1]-128); \
-    (prgb)[0] = sat(pyuv[0] + r); \
-    (prgb)[1] = sat(pyuv[0] + g); \
-    (prgb)[2] = sat(pyuv[0] + b); \
-    (prgb)[3] = sat(pyuv[2] + r); \
-    (prgb)[4] = sat(pyuv[2] + g); \
-    (prgb)[5] = sat(pyuv[2] + b); \
-    }
-#define IYUYV2RGB_2(pyuv, prgb) { \
-    int r = (22987 * ((pyuv)[3] - 128)) >> 14; \
-    int g = (-5636 * ((pyuv)[1] - 128) - 11698 * ((pyuv)[3] - 128)) >> 14; \
-    int b = (29049 * ((pyuv)[1] - 128)) >> 14; \
-    (prgb)[0] = sat(*(pyuv) + r); \
-    (prgb)[1] = sat(*(pyuv) + g); \
-    (prgb)[2] = sat(*(pyuv) + b); \
-    (prgb)[3] = sat((pyuv)[2] + r); \
-    (prgb)[4] = sat((pyuv)[2] + g); \
-    (prgb)[5] = sat((pyuv)[2] + b); \
-    }
-#define IYUYV2RGB_16(pyuv, prgb) IYUYV2RGB_8(pyuv, prgb); IYUYV2RGB_8(pyuv + 16, prgb + 24);
-#define IYUYV2RGB_8(pyuv, prgb) IYUYV2RGB_4(pyuv, prgb); IYUYV2RGB_4(pyuv + 8, prgb + 12);
-#define IYUYV2RGB_4(pyuv, prgb) IYUYV2RGB_2(pyuv, prgb); IYUYV2RGB_2(pyuv + 4, prgb + 6);
+__attribute__((target("sse2")))
+static void pack422_sse2(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int w, int y_odd)
+{
+    __m128i yy, uv;
+    int i = 0;
+    for (; i + 16 <= w; i += 16) {
+        yy = _mm_loadu_si128((const __m128i *)(y + i));
+        uv = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(u + i / 2)),
+                               _mm_loadl_epi64((const __m128i *)(v + i / 2)));
+        if (y_odd) {
+            _mm_storeu_si128((__m128i *)(dst + 2 * i),      _mm_unpacklo_epi8(uv, yy));
+            _mm_storeu_si128((__m128i *)(dst + 2 * i + 16), _mm_unpackhi_epi8(uv, yy));
+        } else {
+            _mm_storeu_si128((__m128i *)(dst + 2 * i),      _mm_unpacklo_epi8(yy, uv));
+            _mm_storeu_si128((__m128i *)(dst + 2 * i + 16), _mm_unpackhi_epi8(yy, uv));
+        }
+    }
+    pack422_c(y + i, u + i / 2, v + i / 2, dst + 2 * i, w - i, y_odd);
+}
 
+__attribute__((target("sse2")))
+static void split_uv_sse2(const uint8_t *uv, uint8_t *u, uint8_t *v, int n)
+{
+    const __m128i lo = _mm_set1_epi16(0x00ff);
+    __m128i a, b;
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        a = _mm_loadu_si128((const __m128i *)(uv + 2 * i));
+        b = _mm_loadu_si128((const __m128i *)(uv + 2 * i + 16));
+        _mm_storeu_si128((__m128i *)(u + i),
+                        _mm_packus_epi16(_mm_and_si128(a, lo), _mm_and_si128(b, lo)));
+        _mm_storeu_si128((__m128i *)(v + i),
+                        _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+    }
+    split_uv_c(uv + 2 * i, u + i, v + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void merge_uv_sse2(const uint8_t *u, const uint8_t *v, uint8_t *uv, int n)
+{
+    __m128i a, b;
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        a = _mm_loadu_si128((const __m128i *)(u + i));
+        b = _mm_loadu_si128((const __m128i *)(v + i));
+        _mm_storeu_si128((__m128i *)(uv + 2 * i),      _mm_unpacklo_epi8(a, b));
+        _mm_storeu_si128((__m128i *)(uv + 2 * i + 16), _mm_unpackhi_epi8(a, b));
+    }
+    merge_uv_c(u + i, v + i, uv + 2 * i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void avg_row_sse2(const uint8_t *a, const uint8_t *b, uint8_t *dst, int n)
+{
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        _mm_storeu_si128((__m128i *)(dst + i),
+                        _mm_avg_epu8(_mm_loadu_si128((const __m128i *)(a + i)),
+                                     _mm_loadu_si128((const __m128i *)(b + i))));
+    }
+    avg_row_c(a + i, b + i, dst + i, n - i);
+}
 
+__attribute__((target("sse2")))
+static void half_row_sse2(const uint8_t *src, uint8_t *dst, int n)
+{
+    const __m128i lo = _mm_set1_epi16(0x00ff);
+    __m128i a, b, ea, eb;
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        a = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+        b = _mm_loadu_si128((const __m128i *)(src + 2 * i + 16));
+        ea = _mm_avg_epu16(_mm_and_si128(a, lo), _mm_srli_epi16(a, 8));
+        eb = _mm_avg_epu16(_mm_and_si128(b, lo), _mm_srli_epi16(b, 8));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(ea, eb));
+    }
+    half_row_c(src + 2 * i, dst + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void half_row_c4_sse2(const uint8_t *src, uint8_t *dst, int n)
+{
+    __m128i a, b, even, odd;
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        a = _mm_loadu_si128((const __m128i *)(src + 8 * i));
+        b = _mm_loadu_si128((const __m128i *)(src + 8 * i + 16));
+        even = _mm_unpacklo_epi64(_mm_shuffle_epi32(a, 0x88), _mm_shuffle_epi32(b, 0x88));
+        odd  = _mm_unpacklo_epi64(_mm_shuffle_epi32(a, 0xdd), _mm_shuffle_epi32(b, 0xdd));
+        _mm_storeu_si128((__m128i *)(dst + 4 * i), _mm_avg_epu8(even, odd));
+    }
+    half_row_c4_c(src + 8 * i, dst + 4 * i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void double_row_sse2(const uint8_t *src, uint8_t *dst, int n)
+{
+    __m128i a;
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        a = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + 2 * i),      _mm_unpacklo_epi8(a, a));
+        _mm_storeu_si128((__m128i *)(dst + 2 * i + 16), _mm_unpackhi_epi8(a, a));
+    }
+    double_row_c(src + i, dst + 2 * i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void lerp_row_sse2(const uint8_t *a, const uint8_t *b, uint8_t *dst, int n, int f)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i fa = _mm_set1_epi16(256 - f);
+    const __m128i fb = _mm_set1_epi16(f);
+    const __m128i rnd = _mm_set1_epi16(128);
+    __m128i x, y, lo, hi;
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        x = _mm_loadu_si128((const __m128i *)(a + i));
+        y = _mm_loadu_si128((const __m128i *)(b + i));
+        lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(x, zero), fa),
+                           _mm_mullo_epi16(_mm_unpacklo_epi8(y, zero), fb));
+        hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(x, zero), fa),
+                           _mm_mullo_epi16(_mm_unpackhi_epi8(y, zero), fb));
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, rnd), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, rnd), 8);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+    lerp_row_c(a + i, b + i, dst + i, n - i, f);
+}
+
+/*
+ * 8 pixels of Y (as Y * 0x0101), U, V in 16 bit lanes to clamped 8 bit
+ * R, G, B in the low and high half of r/g/b
+ */
+__attribute__((target("sse2")))
+static inline __m128i yuv2rgb_ch_sse2(__m128i yy, __m128i c0, int k0, __m128i c1, int k1, int sub)
+{
+    __m128i t = _mm_setzero_si128();
+    if (k0) {
+        t = _mm_mullo_epi16(c0, _mm_set1_epi16(k0));
+    }
+    if (k1) {
+        t = _mm_add_epi16(t, _mm_mullo_epi16(c1, _mm_set1_epi16(k1)));
+    }
+    t = sub ? _mm_subs_epi16(yy, t) : _mm_adds_epi16(yy, t);
+    return _mm_srai_epi16(_mm_adds_epi16(t, _mm_set1_epi16(32)), 6);
+}
+
+__attribute__((target("sse2")))
+static void yuv2rgb_sse2(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int w, const uint8_t *pos)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i c128 = _mm_set1_epi16(128);
+    const __m128i yg = _mm_set1_epi16(YG);
+    const __m128i ygb = _mm_set1_epi16(YGB);
+    __m128i ys, us, vs, yy[2], uu[2], vv[2], ch[4], t0, t1, t2, t3;
+    int i = 0, h;
+    for (; i + 16 <= w; i += 16) {
+        ys = _mm_loadu_si128((const __m128i *)(y + i));
+        us = _mm_loadl_epi64((const __m128i *)(u + i / 2));
+        vs = _mm_loadl_epi64((const __m128i *)(v + i / 2));
+        us = _mm_unpacklo_epi8(us, us);
+        vs = _mm_unpacklo_epi8(vs, vs);
+        yy[0] = _mm_unpacklo_epi8(ys, ys);
+        yy[1] = _mm_unpackhi_epi8(ys, ys);
+        uu[0] = _mm_sub_epi16(_mm_unpacklo_epi8(us, zero), c128);
+        uu[1] = _mm_sub_epi16(_mm_unpackhi_epi8(us, zero), c128);
+        vv[0] = _mm_sub_epi16(_mm_unpacklo_epi8(vs, zero), c128);
+        vv[1] = _mm_sub_epi16(_mm_unpackhi_epi8(vs, zero), c128);
+        for (h = 0; h < 2; h++) {
+            yy[h] = _mm_sub_epi16(_mm_mulhi_epu16(yy[h], yg), ygb);
+        }
+        ch[pos[0]] = _mm_packus_epi16(yuv2rgb_ch_sse2(yy[0], vv[0], VR, uu[0], 0, 0),
+                                      yuv2rgb_ch_sse2(yy[1], vv[1], VR, uu[1], 0, 0));
+        ch[pos[1]] = _mm_packus_epi16(yuv2rgb_ch_sse2(yy[0], uu[0], UG, vv[0], VG, 1),
+                                      yuv2rgb_ch_sse2(yy[1], uu[1], UG, vv[1], VG, 1));
+        ch[pos[2]] = _mm_packus_epi16(yuv2rgb_ch_sse2(yy[0], uu[0], UB, vv[0], 0, 0),
+                                      yuv2rgb_ch_sse2(yy[1], uu[1], UB, vv[1], 0, 0));
+        ch[pos[3]] = _mm_set1_epi8(-1);
+        t0 = _mm_unpacklo_epi8(ch[0], ch[1]);
+        t1 = _mm_unpackhi_epi8(ch[0], ch[1]);
+        t2 = _mm_unpacklo_epi8(ch[2], ch[3]);
+        t3 = _mm_unpackhi_epi8(ch[2], ch[3]);
+        _mm_storeu_si128((__m128i *)(dst + 4 * i),      _mm_unpacklo_epi16(t0, t2));
+        _mm_storeu_si128((__m128i *)(dst + 4 * i + 16), _mm_unpackhi_epi16(t0, t2));
+        _mm_storeu_si128((__m128i *)(dst + 4 * i + 32), _mm_unpacklo_epi16(t1, t3));
+        _mm_storeu_si128((__m128i *)(dst + 4 * i + 48), _mm_unpackhi_epi16(t1, t3));
+    }
+    yuv2rgb_c(y + i, u + i / 2, v + i / 2, dst + 4 * i, w - i, pos);
+}
+
+/* sum adjacent 32 bit lanes of a and b: [a0+a1, a2+a3, b0+b1, b2+b3] */
+__attribute__((target("sse2")))
+static inline __m128i hadd_epi32_sse2(__m128i a, __m128i b)
+{
+    __m128 fa = _mm_castsi128_ps(a), fb = _mm_castsi128_ps(b);
+    return _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(fa, fb, _MM_SHUFFLE(2, 0, 2, 0))),
+                         _mm_castps_si128(_mm_shuffle_ps(fa, fb, _MM_SHUFFLE(3, 1, 3, 1))));
+}
+
+__attribute__((target("sse2")))
+static void rgb2yuv_sse2(const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v, int w, const uint8_t *pos)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int16_t ky[4] = {0}, ku[4] = {0}, kv[4] = {0};
+    __m128i cy, cu, cv, p0, p1, a, b, c, d, s0, s1, t0, t1, uv;
+    uint8_t tmp[8];
+    int i = 0;
+
+    ky[pos[0]] = RY; ky[pos[1]] = GY; ky[pos[2]] = BY;
+    ku[pos[0]] = RU; ku[pos[1]] = GU; ku[pos[2]] = BU;
+    kv[pos[0]] = RV; kv[pos[1]] = GV; kv[pos[2]] = BV;
+    cy = _mm_setr_epi16(ky[0], ky[1], ky[2], ky[3], ky[0], ky[1], ky[2], ky[3]);
+    cu = _mm_setr_epi16(ku[0], ku[1], ku[2], ku[3], ku[0], ku[1], ku[2], ku[3]);
+    cv = _mm_setr_epi16(kv[0], kv[1], kv[2], kv[3], kv[0], kv[1], kv[2], kv[3]);
+    for (; i + 8 <= w; i += 8) {
+        p0 = _mm_loadu_si128((const __m128i *)(src + 4 * i));
+        p1 = _mm_loadu_si128((const __m128i *)(src + 4 * i + 16));
+        a = _mm_unpacklo_epi8(p0, zero);
+        b = _mm_unpackhi_epi8(p0, zero);
+        c = _mm_unpacklo_epi8(p1, zero);
+        d = _mm_unpackhi_epi8(p1, zero);
+
+        t0 = hadd_epi32_sse2(_mm_madd_epi16(a, cy), _mm_madd_epi16(b, cy));
+        t1 = hadd_epi32_sse2(_mm_madd_epi16(c, cy), _mm_madd_epi16(d, cy));
+        t0 = _mm_srai_epi32(_mm_add_epi32(t0, _mm_set1_epi32(128)), 8);
+        t1 = _mm_srai_epi32(_mm_add_epi32(t1, _mm_set1_epi32(128)), 8);
+        t0 = _mm_add_epi16(_mm_packs_epi32(t0, t1), _mm_set1_epi16(16));
+        _mm_storel_epi64((__m128i *)(y + i), _mm_packus_epi16(t0, t0));
+
+        /* pixel pair sums */
+        s0 = _mm_add_epi16(_mm_unpacklo_epi64(a, b), _mm_unpackhi_epi64(a, b));
+        s1 = _mm_add_epi16(_mm_unpacklo_epi64(c, d), _mm_unpackhi_epi64(c, d));
+        t0 = hadd_epi32_sse2(_mm_madd_epi16(s0, cu), _mm_madd_epi16(s1, cu));
+        t1 = hadd_epi32_sse2(_mm_madd_epi16(s0, cv), _mm_madd_epi16(s1, cv));
+        t0 = _mm_srai_epi32(_mm_add_epi32(t0, _mm_set1_epi32(256)), 9);
+        t1 = _mm_srai_epi32(_mm_add_epi32(t1, _mm_set1_epi32(256)), 9);
+        uv = _mm_add_epi16(_mm_packs_epi32(t0, t1), _mm_set1_epi16(128));
+        _mm_storel_epi64((__m128i *)tmp, _mm_packus_epi16(uv, uv));
+        memcpy(u + i / 2, tmp, 4);
+        memcpy(v + i / 2, tmp + 4, 4);
+    }
+    rgb2yuv_c(src + 4 * i, y + i, u + i / 2, v + i / 2, w - i, pos);
+}
+
+/******************************************************************************
+ * AVX2 kernels
+ ******************************************************************************/
+__attribute__((target("avx2")))
+static void avg_row_avx2(const uint8_t *a, const uint8_t *b, uint8_t *dst, int n)
+{
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        _mm256_storeu_si256((__m256i *)(dst + i),
+                        _mm256_avg_epu8(_mm256_loadu_si256((const __m256i *)(a + i)),
+                                        _mm256_loadu_si256((const __m256i *)(b + i))));
+    }
+    avg_row_c(a + i, b + i, dst + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void lerp_row_avx2(const uint8_t *a, const uint8_t *b, uint8_t *dst, int n, int f)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i fa = _mm256_set1_epi16(256 - f);
+    const __m256i fb = _mm256_set1_epi16(f);
+    const __m256i rnd = _mm256_set1_epi16(128);
+    __m256i x, y, lo, hi;
+    int i = 0;
+    /* unpack and pack are both per 128 bit lane, so byte order is kept */
+    for (; i + 32 <= n; i += 32) {
+        x = _mm256_loadu_si256((const __m256i *)(a + i));
+        y = _mm256_loadu_si256((const __m256i *)(b + i));
+        lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(x, zero), fa),
+                              _mm256_mullo_epi16(_mm256_unpacklo_epi8(y, zero), fb));
+        hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(x, zero), fa),
+                              _mm256_mullo_epi16(_mm256_unpackhi_epi8(y, zero), fb));
+        lo = _mm256_srli_epi16(_mm256_add_epi16(lo, rnd), 8);
+        hi = _mm256_srli_epi16(_mm256_add_epi16(hi, rnd), 8);
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_packus_epi16(lo, hi));
+    }
+    lerp_row_c(a + i, b + i, dst + i, n - i, f);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i yuv2rgb_ch_avx2(__m256i yy, __m256i c0, int k0, __m256i c1, int k1, int sub)
+{
+    __m256i t = _mm256_setzero_si256();
+    if (k0) {
+        t = _mm256_mullo_epi16(c0, _mm256_set1_epi16(k0));
+    }
+    if (k1) {
+        t = _mm256_add_epi16(t, _mm256_mullo_epi16(c1, _mm256_set1_epi16(k1)));
+    }
+    t = sub ? _mm256_subs_epi16(yy, t) : _mm256_adds_epi16(yy, t);
+    return _mm256_srai_epi16(_mm256_adds_epi16(t, _mm256_set1_epi16(32)), 6);
+}
+
+__attribute__((target("avx2")))
+static void yuv2rgb_avx2(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int w, const uint8_t *pos)
+{
+    const __m256i c128 = _mm256_set1_epi16(128);
+    const __m256i yg = _mm256_set1_epi16(YG);
+    const __m256i ygb = _mm256_set1_epi16(YGB);
+    __m128i ys0, ys1, us, vs;
+    __m256i yy[2], uu[2], vv[2], ch[4], t0, t1, t2, t3, o0, o1, o2, o3;
+    int i = 0, h;
+    for (; i + 32 <= w; i += 32) {
+        ys0 = _mm_loadu_si128((const __m128i *)(y + i));
+        ys1 = _mm_loadu_si128((const __m128i *)(y + i + 16));
+        us = _mm_loadu_si128((const __m128i *)(u + i / 2));
+        vs = _mm_loadu_si128((const __m128i *)(v + i / 2));
+        /* all 16 bit vectors below hold pixels in natural order */
+        yy[0] = _mm256_cvtepu8_epi16(ys0);
+        yy[1] = _mm256_cvtepu8_epi16(ys1);
+        uu[0] = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_unpacklo_epi8(us, us)), c128);
+        uu[1] = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_unpackhi_epi8(us, us)), c128);
+        vv[0] = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_unpacklo_epi8(vs, vs)), c128);
+        vv[1] = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_unpackhi_epi8(vs, vs)), c128);
+        for (h = 0; h < 2; h++) {
+            yy[h] = _mm256_or_si256(yy[h], _mm256_slli_epi16(yy[h], 8));
+            yy[h] = _mm256_sub_epi16(_mm256_mulhi_epu16(yy[h], yg), ygb);
+        }
+        ch[pos[0]] = _mm256_packus_epi16(yuv2rgb_ch_avx2(yy[0], vv[0], VR, uu[0], 0, 0),
+                                         yuv2rgb_ch_avx2(yy[1], vv[1], VR, uu[1], 0, 0));
+        ch[pos[1]] = _mm256_packus_epi16(yuv2rgb_ch_avx2(yy[0], uu[0], UG, vv[0], VG, 1),
+                                         yuv2rgb_ch_avx2(yy[1], uu[1], UG, vv[1], VG, 1));
+        ch[pos[2]] = _mm256_packus_epi16(yuv2rgb_ch_avx2(yy[0], uu[0], UB, vv[0], 0, 0),
+                                         yuv2rgb_ch_avx2(yy[1], uu[1], UB, vv[1], 0, 0));
+        /* packus interleaves lanes, restore pixel order 0..31 */
+        ch[pos[0]] = _mm256_permute4x64_epi64(ch[pos[0]], 0xd8);
+        ch[pos[1]] = _mm256_permute4x64_epi64(ch[pos[1]], 0xd8);
+        ch[pos[2]] = _mm256_permute4x64_epi64(ch[pos[2]], 0xd8);
+        ch[pos[3]] = _mm256_set1_epi8(-1);
+        t0 = _mm256_unpacklo_epi8(ch[0], ch[1]);    /* px 0-7  | 16-23 */
+        t1 = _mm256_unpackhi_epi8(ch[0], ch[1]);    /* px 8-15 | 24-31 */
+        t2 = _mm256_unpacklo_epi8(ch[2], ch[3]);
+        t3 = _mm256_unpackhi_epi8(ch[2], ch[3]);
+        o0 = _mm256_unpacklo_epi16(t0, t2);         /* px 0-3  | 16-19 */
+        o1 = _mm256_unpackhi_epi16(t0, t2);         /* px 4-7  | 20-23 */
+        o2 = _mm256_unpacklo_epi16(t1, t3);         /* px 8-11 | 24-27 */
+        o3 = _mm256_unpackhi_epi16(t1, t3);         /* px 12-15| 28-31 */
+        _mm256_storeu_si256((__m256i *)(dst + 4 * i),      _mm256_permute2x128_si256(o0, o1, 0x20));
+        _mm256_storeu_si256((__m256i *)(dst + 4 * i + 32), _mm256_permute2x128_si256(o2, o3, 0x20));
+        _mm256_storeu_si256((__m256i *)(dst + 4 * i + 64), _mm256_permute2x128_si256(o0, o1, 0x31));
+        _mm256_storeu_si256((__m256i *)(dst + 4 * i + 96), _mm256_permute2x128_si256(o2, o3, 0x31));
+    }
+    yuv2rgb_sse2(y + i, u + i / 2, v + i / 2, dst + 4 * i, w - i, pos);
+}
+#endif
+
+#if defined (CONV_SIMD_NEON)
+/******************************************************************************
+ * NEON kernels
+ ******************************************************************************/
+static void unpack422_neon(const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v, int w, int y_odd)
+{
+    uint8x8x4_t p;
+    uint8x8x2_t yy;
+    int i = 0;
+    for (; i + 16 <= w; i += 16) {
+        p = vld4_u8(src + 2 * i);
+        if (y_odd) {
+            yy.val[0] = p.val[1];
+            yy.val[1] = p.val[3];
+            vst1_u8(u + i / 2, p.val[0]);
+            vst1_u8(v + i / 2, p.val[2]);
+        } else {
+            yy.val[0] = p.val[0];
+            yy.val[1] = p.val[2];
+            vst1_u8(u + i / 2, p.val[1]);
+            vst1_u8(v + i / 2, p.val[3]);
+        }
+        vst2_u8(y + i, yy);
+    }
+    unpack422_c(src + 2 * i, y + i, u + i / 2, v + i / 2, w - i, y_odd);
+}
+
+static void pack422_neon(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int w, int y_odd)
+{
+    uint8x8x4_t p;
+    uint8x8x2_t yy;
+    int i = 0, yo = y_odd ? 1 : 0, co = y_odd ? 0 : 1;
+    for (; i + 16 <= w; i += 16) {
+        yy = vld2_u8(y + i);
+        p.val[yo]     = yy.val[0];
+        p.val[yo + 2] = yy.val[1];
+        p.val[co]     = vld1_u8(u + i / 2);
+        p.val[co + 2] = vld1_u8(v + i / 2);
+        vst4_u8(dst + 2 * i, p);
+    }
+    pack422_c(y + i, u + i / 2, v + i / 2, dst + 2 * i, w - i, y_odd);
+}
+
+static void split_uv_neon(const uint8_t *uv, uint8_t *u, uint8_t *v, int n)
+{
+    uint8x16x2_t p;
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        p = vld2q_u8(uv + 2 * i);
+        vst1q_u8(u + i, p.val[0]);
+        vst1q_u8(v + i, p.val[1]);
+    }
+    split_uv_c(uv + 2 * i, u + i, v + i, n - i);
+}
+
+static void merge_uv_neon(const uint8_t *u, const uint8_t *v, uint8_t *uv, int n)
+{
+    uint8x16x2_t p;
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        p.val[0] = vld1q_u8(u + i);
+        p.val[1] = vld1q_u8(v + i);
+        vst2q_u8(uv + 2 * i, p);
+    }
+    merge_uv_c(u + i, v + i, uv + 2 * i, n - i);
+}
+
+static void avg_row_neon(const uint8_t *a, const uint8_t *b, uint8_t *dst, int n)
+{
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        vst1q_u8(dst + i, vrhaddq_u8(vld1q_u8(a + i), vld1q_u8(b + i)));
+    }
+    avg_row_c(a + i, b + i, dst + i, n - i);
+}
+
+static void half_row_neon(const uint8_t *src, uint8_t *dst, int n)
+{
+    uint8x16x2_t p;
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        p = vld2q_u8(src + 2 * i);
+        vst1q_u8(dst + i, vrhaddq_u8(p.val[0], p.val[1]));
+    }
+    half_row_c(src + 2 * i, dst + i, n - i);
+}
+
+static void half_row_c4_neon(const uint8_t *src, uint8_t *dst, int n)
+{
+    uint32x4x2_t p;
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        p = vld2q_u32((const uint32_t *)(src + 8 * i));
+        vst1q_u8(dst + 4 * i, vrhaddq_u8(vreinterpretq_u8_u32(p.val[0]),
+                                         vreinterpretq_u8_u32(p.val[1])));
+    }
+    half_row_c4_c(src + 8 * i, dst + 4 * i, n - i);
+}
+
+static void double_row_neon(const uint8_t *src, uint8_t *dst, int n)
+{
+    uint8x16x2_t p;
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        p.val[0] = p.val[1] = vld1q_u8(src + i);
+        vst2q_u8(dst + 2 * i, p);
+    }
+    double_row_c(src + i, dst + 2 * i, n - i);
+}
+
+static void lerp_row_neon(const uint8_t *a, const uint8_t *b, uint8_t *dst, int n, int f)
+{
+    const uint8x8_t fa = vdup_n_u8((uint8_t)(256 - f));
+    const uint8x8_t fb = vdup_n_u8((uint8_t)f);
+    uint8x16_t x, y;
+    uint16x8_t lo, hi;
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        x = vld1q_u8(a + i);
+        y = vld1q_u8(b + i);
+        lo = vmlal_u8(vmull_u8(vget_low_u8(x), fa), vget_low_u8(y), fb);
+        hi = vmlal_u8(vmull_u8(vget_high_u8(x), fa), vget_high_u8(y), fb);
+        vst1q_u8(dst + i, vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)));
+    }
+    lerp_row_c(a + i, b + i, dst + i, n - i, f);
+}
+
+static inline uint8x8_t yuv2rgb_ch_neon(int16x8_t yy, int16x8_t c0, int16_t k0, int16x8_t c1, int16_t k1, int sub)
+{
+    int16x8_t t = vmulq_n_s16(c0, k0);
+    if (k1) {
+        t = vmlaq_n_s16(t, c1, k1);
+    }
+    t = sub ? vqsubq_s16(yy, t) : vqaddq_s16(yy, t);
+    return vqmovun_s16(vshrq_n_s16(vqaddq_s16(t, vdupq_n_s16(32)), 6));
+}
+
+static void yuv2rgb_neon(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int w, const uint8_t *pos)
+{
+    uint8x16_t ys;
+    uint8x8x2_t us, vs;
+    uint8x8_t yh;
+    uint16x8_t y16;
+    int16x8_t yy, uu, vv;
+    uint8x8_t r[2], g[2], b[2];
+    uint8x16x4_t o;
+    int i = 0, h;
+    for (; i + 16 <= w; i += 16) {
+        ys = vld1q_u8(y + i);
+        us = vzip_u8(vld1_u8(u + i / 2), vld1_u8(u + i / 2));
+        vs = vzip_u8(vld1_u8(v + i / 2), vld1_u8(v + i / 2));
+        for (h = 0; h < 2; h++) {
+            yh = h ? vget_high_u8(ys) : vget_low_u8(ys);
+            y16 = vmulq_n_u16(vmovl_u8(yh), 0x0101);
+            y16 = vcombine_u16(vshrn_n_u32(vmull_n_u16(vget_low_u16(y16), YG), 16),
+                               vshrn_n_u32(vmull_n_u16(vget_high_u16(y16), YG), 16));
+            yy = vsubq_s16(vreinterpretq_s16_u16(y16), vdupq_n_s16(YGB));
+            uu = vreinterpretq_s16_u16(vsubq_u16(vmovl_u8(us.val[h]), vdupq_n_u16(128)));
+            vv = vreinterpretq_s16_u16(vsubq_u16(vmovl_u8(vs.val[h]), vdupq_n_u16(128)));
+            r[h] = yuv2rgb_ch_neon(yy, vv, VR, uu, 0, 0);
+            g[h] = yuv2rgb_ch_neon(yy, uu, UG, vv, VG, 1);
+            b[h] = yuv2rgb_ch_neon(yy, uu, UB, vv, 0, 0);
+        }
+        o.val[pos[0]] = vcombine_u8(r[0], r[1]);
+        o.val[pos[1]] = vcombine_u8(g[0], g[1]);
+        o.val[pos[2]] = vcombine_u8(b[0], b[1]);
+        o.val[pos[3]] = vdupq_n_u8(0xff);
+        vst4q_u8(dst + 4 * i, o);
+    }
+    yuv2rgb_c(y + i, u + i / 2, v + i / 2, dst + 4 * i, w - i, pos);
+}
+
+static void rgb2yuv_neon(const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v, int w, const uint8_t *pos)
+{
+    uint8x8x4_t p;
+    uint16x8_t acc;
+    int16x4_t r2, g2, b2;
+    int32x4_t cu, cv;
+    uint8_t tmp[8];
+    int i = 0;
+    for (; i + 8 <= w; i += 8) {
+        p = vld4_u8(src + 4 * i);
+        acc = vmull_u8(p.val[pos[0]], vdup_n_u8(RY));
+        acc = vmlal_u8(acc, p.val[pos[1]], vdup_n_u8(GY));
+        acc = vmlal_u8(acc, p.val[pos[2]], vdup_n_u8(BY));
+        vst1_u8(y + i, vadd_u8(vrshrn_n_u16(acc, 8), vdup_n_u8(16)));
+
+        r2 = vreinterpret_s16_u16(vpaddl_u8(p.val[pos[0]]));
+        g2 = vreinterpret_s16_u16(vpaddl_u8(p.val[pos[1]]));
+        b2 = vreinterpret_s16_u16(vpaddl_u8(p.val[pos[2]]));
+        cu = vmlal_n_s16(vmlal_n_s16(vmull_n_s16(r2, RU), g2, GU), b2, BU);
+        cv = vmlal_n_s16(vmlal_n_s16(vmull_n_s16(r2, RV), g2, GV), b2, BV);
+        cu = vaddq_s32(vshrq_n_s32(vaddq_s32(cu, vdupq_n_s32(256)), 9), vdupq_n_s32(128));
+        cv = vaddq_s32(vshrq_n_s32(vaddq_s32(cv, vdupq_n_s32(256)), 9), vdupq_n_s32(128));
+        vst1_u8(tmp, vqmovun_s16(vcombine_s16(vmovn_s32(cu), vmovn_s32(cv))));
+        memcpy(u + i / 2, tmp, 4);
+        memcpy(v + i / 2, tmp + 4, 4);
+    }
+    rgb2yuv_c(src + 4 * i, y + i, u + i / 2, v + i / 2, w - i, pos);
+}
+#endif
+
+static struct conv_kernels conv_k_c;
+static struct conv_kernels conv_k;
+static const struct conv_kernels *conv_k_cur = &conv_k;
+static pthread_once_t conv_k_once = PTHREAD_ONCE_INIT;
+
+static void conv_kernels_init(void)
+{
+    conv_k_c.unpack422   = unpack422_c;
+    conv_k_c.pack422     = pack422_c;
+    conv_k_c.split_uv    = split_uv_c;
+    conv_k_c.merge_uv    = merge_uv_c;
+    conv_k_c.avg_row     = avg_row_c;
+    conv_k_c.half_row    = half_row_c;
+    conv_k_c.half_row_c4 = half_row_c4_c;
+    conv_k_c.double_row  = double_row_c;
+    conv_k_c.lerp_row    = lerp_row_c;
+    conv_k_c.yuv2rgb     = yuv2rgb_c;
+    conv_k_c.rgb2yuv     = rgb2yuv_c;
+    conv_k = conv_k_c;
+#if defined (CONV_SIMD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        conv_k.unpack422   = unpack422_sse2;
+        conv_k.pack422     = pack422_sse2;
+        conv_k.split_uv    = split_uv_sse2;
+        conv_k.merge_uv    = merge_uv_sse2;
+        conv_k.avg_row     = avg_row_sse2;
+        conv_k.half_row    = half_row_sse2;
+        conv_k.half_row_c4 = half_row_c4_sse2;
+        conv_k.double_row  = double_row_sse2;
+        conv_k.lerp_row    = lerp_row_sse2;
+        conv_k.yuv2rgb     = yuv2rgb_sse2;
+        conv_k.rgb2yuv     = rgb2yuv_sse2;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        conv_k.avg_row     = avg_row_avx2;
+        conv_k.lerp_row    = lerp_row_avx2;
+        conv_k.yuv2rgb     = yuv2rgb_avx2;
+    }
+#elif defined (CONV_SIMD_NEON)
+    conv_k.unpack422   = unpack422_neon;
+    conv_k.pack422     = pack422_neon;
+    conv_k.split_uv    = split_uv_neon;
+    conv_k.merge_uv    = merge_uv_neon;
+    conv_k.avg_row     = avg_row_neon;
+    conv_k.half_row    = half_row_neon;
+    conv_k.half_row_c4 = half_row_c4_neon;
+    conv_k.double_row  = double_row_neon;
+    conv_k.lerp_row    = lerp_row_neon;
+    conv_k.yuv2rgb     = yuv2rgb_neon;
+    conv_k.rgb2yuv     = rgb2yuv_neon;
+#endif
+}
+
+static const struct conv_kernels *conv_kernels_get(void)
+{
+    pthread_once(&conv_k_once, conv_kernels_init);
+    return __atomic_load_n(&conv_k_cur, __ATOMIC_ACQUIRE);
+}
+
+void video_conv_set_simd(bool enable)
+{
+    pthread_once(&conv_k_once, conv_kernels_init);
+    __atomic_store_n(&conv_k_cur, enable ? &conv_k : &conv_k_c, __ATOMIC_RELEASE);
+}
+
+/******************************************************************************
+ * slice workers
+ *
+ * One job at a time: workers and the caller pull slices from a shared
+ * counter. A second caller arriving while a job runs does its frame alone.
+ ******************************************************************************/
+typedef void (*conv_slice_fn)(void *ctx, int y0, int y1);
+
+struct conv_job {
+    conv_slice_fn fn;
+    void         *ctx;
+    int           rows;
+    int           step;
+    int           next;
+    int           done;
+};
+
+static struct {
+    pthread_mutex_t  run_lock;
+    pthread_mutex_t  lock;
+    pthread_cond_t   cond;
+    pthread_cond_t   done_cond;
+    pthread_t        tid[CONV_MAX_THREADS];
+    int              workers;
+    int              threads;
+    uint64_t         seq;
+    struct conv_job *job;
+} conv_pool = {
+    PTHREAD_MUTEX_INITIALIZER,
+    PTHREAD_MUTEX_INITIALIZER,
+    PTHREAD_COND_INITIALIZER,
+    PTHREAD_COND_INITIALIZER,
+};
+
+static int conv_ncpu(void)
+{
+#if defined (__linux__) || defined (_WIN32)
+    int n = get_nprocs();
+    return (n > 0) ? n : 1;
+#else
+    return 1;
+#endif
+}
+
+/* run slices of job until none is left, conv_pool.lock held */
+static void conv_job_drain(struct conv_job *job)
+{
+    int y0, y1;
+    while (job->next < job->rows) {
+        y0 = job->next;
+        y1 = (y0 + job->step < job->rows) ? y0 + job->step : job->rows;
+        job->next = y1;
+        pthread_mutex_unlock(&conv_pool.lock);
+        job->fn(job->ctx, y0, y1);
+        pthread_mutex_lock(&conv_pool.lock);
+        job->done += y1 - y0;
+    }
+    if (job->done == job->rows) {
+        pthread_cond_broadcast(&conv_pool.done_cond);
+    }
+}
+
+static void *conv_worker(void *arg)
+{
+    uint64_t seq = 0;
+    pthread_mutex_lock(&conv_pool.lock);
+    for (;;) {
+        while (!conv_pool.job || conv_pool.seq == seq) {
+            pthread_cond_wait(&conv_pool.cond, &conv_pool.lock);
+        }
+        seq = conv_pool.seq;
+        conv_job_drain(conv_pool.job);
+    }
+    pthread_mutex_unlock(&conv_pool.lock);
+    return NULL;
+}
+
+void video_conv_set_threads(int num)
+{
+    pthread_mutex_lock(&conv_pool.run_lock);
+    conv_pool.threads = (num < 0) ? 0 : num;
+    pthread_mutex_unlock(&conv_pool.run_lock);
+}
+
+/*
+ * rows are split on multiples of align, small frames and busy pools run
+ * inline in the caller
+ */
+static void conv_run(conv_slice_fn fn, void *ctx, int rows, int align, uint64_t pixels)
+{
+    struct conv_job job;
+    int threads, step;
+
+    if (pixels < CONV_MT_PIXELS || 0 != pthread_mutex_trylock(&conv_pool.run_lock)) {
+        fn(ctx, 0, rows);
+        return;
+    }
+    threads = conv_pool.threads ? conv_pool.threads : conv_ncpu();
+    threads = (threads > CONV_MAX_THREADS) ? CONV_MAX_THREADS : threads;
+    while (conv_pool.workers < threads - 1) {
+        if (0 != pthread_create(&conv_pool.tid[conv_pool.workers], NULL, conv_worker, NULL)) {
+            break;
+        }
+        pthread_detach(conv_pool.tid[conv_pool.workers]);
+        conv_pool.workers++;
+    }
+    if (threads <= 1 || conv_pool.workers == 0) {
+        pthread_mutex_unlock(&conv_pool.run_lock);
+        fn(ctx, 0, rows);
+        return;
+    }
+    /* a few slices per thread evens out uneven progress */
+    step = rows / (threads * 2);
+    step = (step < CONV_SLICE_ROWS) ? CONV_SLICE_ROWS : step;
+    step = ALIGN_SIZE(step, align);
+
+    job.fn = fn;
+    job.ctx = ctx;
+    job.rows = rows;
+    job.step = step;
+    job.next = 0;
+    job.done = 0;
+    pthread_mutex_lock(&conv_pool.lock);
+    conv_pool.job = &job;
+    conv_pool.seq++;
+    pthread_cond_broadcast(&conv_pool.cond);
+    conv_job_drain(&job);
+    while (job.done < job.rows) {
+        pthread_cond_wait(&conv_pool.done_cond, &conv_pool.lock);
+    }
+    conv_pool.job = NULL;
+    pthread_mutex_unlock(&conv_pool.lock);
+    pthread_mutex_unlock(&conv_pool.run_lock);
+}
+
+/******************************************************************************
+ * format conversion
+ ******************************************************************************/
+static const struct conv_fmt *conv_fmt_find(enum pixel_format format)
+{
+    int i;
+    for (i = 0; i < (int)(sizeof(conv_fmt_tbl) / sizeof(conv_fmt_tbl[0])); i++) {
+        if (conv_fmt_tbl[i].format == format) {
+            return &conv_fmt_tbl[i];
+        }
+    }
+    return NULL;
+}
+
+bool video_conv_supported(enum pixel_format src, enum pixel_format dst)
+{
+    return conv_fmt_find(src) && conv_fmt_find(dst);
+}
+
+struct conv_ctx {
+    const struct video_frame  *src;
+    struct video_frame        *dst;
+    const struct conv_fmt     *sf;
+    const struct conv_fmt     *df;
+    const struct conv_kernels *k;
+    int                        w;
+    size_t                     tmp_stride;
+};
+
+enum {
+    TMP_Y0, TMP_Y1, TMP_U0, TMP_U1, TMP_V0, TMP_V1,
+    TMP_HU0, TMP_HU1, TMP_HV0, TMP_HV1, TMP_GRAY,
+};
+
+static void rgb32_swizzle(const uint8_t *src, uint8_t *dst, int w,
+                const uint8_t *spos, const uint8_t *dpos)
+{
+    int i, k;
+    for (i = 0; i < w; i++) {
+        for (k = 0; k < 3; k++) {
+            dst[4 * i + dpos[k]] = src[4 * i + spos[k]];
+        }
+        dst[4 * i + dpos[3]] = 0xff;
+    }
+}
+
+/*
+ * rows [y0, y1) in pairs: source rows into planar Y/U/V at the source
+ * chroma siting, resample chroma horizontally then vertically, write out
+ */
+static void conv_slice(void *arg, int y0, int y1)
+{
+    struct conv_ctx *c = arg;
+    const struct video_frame *src = c->src;
+    struct video_frame *dst = c->dst;
+    const struct conv_fmt *sf = c->sf, *df = c->df;
+    const struct conv_kernels *k = c->k;
+    const uint8_t *Y[2], *U[2], *V[2], *t8;
+    uint8_t *tmp, *t[CONV_TMP_ROWS];
+    int w = c->w, scw = w >> sf->cw, dcw = w >> df->cw;
+    int y, i, nc, nd;
+
+    tmp = media_pool_alloc(CONV_TMP_ROWS * c->tmp_stride);
+    if (!tmp) {
+        printf("%s: malloc failed!\n", __func__);
+        return;
+    }
+    for (i = 0; i < CONV_TMP_ROWS; i++) {
+        t[i] = tmp + i * c->tmp_stride;
+    }
+    memset(t[TMP_GRAY], 128, w);
+
+    for (y = y0; y < y1; y += 2) {
+        /* RGB <-> RGB skips the YUV pipeline */
+        if (sf->kind == CONV_RGB32 && df->kind == CONV_RGB32) {
+            for (i = 0; i < 2; i++) {
+                rgb32_swizzle(src->data[0] + (y + i) * src->linesize[0],
+                              dst->data[0] + (y + i) * dst->linesize[0], w, sf->pos, df->pos);
+            }
+            continue;
+        }
+        nc = 2;
+        switch (sf->kind) {
+        case CONV_PLANAR:
+            nc = sf->ch ? 1 : 2;
+            for (i = 0; i < 2; i++) {
+                Y[i] = src->data[0] + (y + i) * src->linesize[0];
+            }
+            for (i = 0; i < nc; i++) {
+                U[i] = src->data[1] + ((y >> sf->ch) + i) * src->linesize[1];
+                V[i] = src->data[2] + ((y >> sf->ch) + i) * src->linesize[2];
+            }
+            break;
+        case CONV_NV12:
+            nc = 1;
+            for (i = 0; i < 2; i++) {
+                Y[i] = src->data[0] + (y + i) * src->linesize[0];
+            }
+            k->split_uv(src->data[1] + (y >> 1) * src->linesize[1], t[TMP_U0], t[TMP_V0], scw);
+            U[0] = t[TMP_U0];
+            V[0] = t[TMP_V0];
+            break;
+        case CONV_PACKED:
+            for (i = 0; i < 2; i++) {
+                k->unpack422(src->data[0] + (y + i) * src->linesize[0],
+                             t[TMP_Y0 + i], t[TMP_U0 + i], t[TMP_V0 + i], w, sf->flags & CONV_Y_ODD);
+                Y[i] = t[TMP_Y0 + i];
+                U[i] = (sf->flags & CONV_SWAP_UV) ? t[TMP_V0 + i] : t[TMP_U0 + i];
+                V[i] = (sf->flags & CONV_SWAP_UV) ? t[TMP_U0 + i] : t[TMP_V0 + i];
+            }
+            break;
+        case CONV_RGB32:
+            for (i = 0; i < 2; i++) {
+                k->rgb2yuv(src->data[0] + (y + i) * src->linesize[0],
+                           t[TMP_Y0 + i], t[TMP_U0 + i], t[TMP_V0 + i], w, sf->pos);
+                Y[i] = t[TMP_Y0 + i];
+                U[i] = t[TMP_U0 + i];
+                V[i] = t[TMP_V0 + i];
+            }
+            break;
+        case CONV_GRAY:
+            nc = 1;
+            for (i = 0; i < 2; i++) {
+                Y[i] = src->data[0] + (y + i) * src->linesize[0];
+            }
+            U[0] = V[0] = t[TMP_GRAY];
+            break;
+        }
+
+        if (df->kind == CONV_GRAY) {
+            for (i = 0; i < 2; i++) {
+                memcpy(dst->data[0] + (y + i) * dst->linesize[0], Y[i], w);
+            }
+            continue;
+        }
+
+        if (sf->cw != df->cw) {
+            for (i = 0; i < nc; i++) {
+                if (sf->cw > df->cw) {
+                    k->double_row(U[i], t[TMP_HU0 + i], scw);
+                    k->double_row(V[i], t[TMP_HV0 + i], scw);
+                } else {
+                    k->half_row(U[i], t[TMP_HU0 + i], dcw);
+                    k->half_row(V[i], t[TMP_HV0 + i], dcw);
+                }
+                U[i] = t[TMP_HU0 + i];
+                V[i] = t[TMP_HV0 + i];
+            }
+        }
+
+        /* 4:2:0 sinks take one chroma row per pair, the others two */
+        nd = df->ch ? 1 : 2;
+        if (nc == 2 && nd == 1) {
+            /* element-wise, so writing over U[1] is fine */
+            k->avg_row(U[0], U[1], t[TMP_HU1], dcw);
+            k->avg_row(V[0], V[1], t[TMP_HV1], dcw);
+            U[0] = t[TMP_HU1];
+            V[0] = t[TMP_HV1];
+        } else if (nc == 1 && nd == 2) {
+            U[1] = U[0];
+            V[1] = V[0];
+        }
+
+        switch (df->kind) {
+        case CONV_PLANAR:
+            for (i = 0; i < 2; i++) {
+                memcpy(dst->data[0] + (y + i) * dst->linesize[0], Y[i], w);
+            }
+            for (i = 0; i < nd; i++) {
+                memcpy(dst->data[1] + ((y >> df->ch) + i) * dst->linesize[1], U[i], dcw);
+                memcpy(dst->data[2] + ((y >> df->ch) + i) * dst->linesize[2], V[i], dcw);
+            }
+            break;
+        case CONV_NV12:
+            for (i = 0; i < 2; i++) {
+                memcpy(dst->data[0] + (y + i) * dst->linesize[0], Y[i], w);
+            }
+            k->merge_uv(U[0], V[0], dst->data[1] + (y >> 1) * dst->linesize[1], dcw);
+            break;
+        case CONV_PACKED:
+            for (i = 0; i < 2; i++) {
+                if (df->flags & CONV_SWAP_UV) {
+                    t8 = U[i];
+                    U[i] = V[i];
+                    V[i] = t8;
+                }
+                k->pack422(Y[i], U[i], V[i], dst->data[0] + (y + i) * dst->linesize[0],
+                           w, df->flags & CONV_Y_ODD);
+            }
+            break;
+        case CONV_RGB32:
+            for (i = 0; i < 2; i++) {
+                k->yuv2rgb(Y[i], U[i], V[i], dst->data[0] + (y + i) * dst->linesize[0], w, df->pos);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    media_pool_free(tmp);
+}
+
+int video_frame_convert(struct video_frame *dst, const struct video_frame *src)
+{
+    struct conv_ctx c;
+
+    if (!dst || !src || !dst->data[0] || !src->data[0]) {
+        printf("%s invalid paramenters!\n", __func__);
+        return -1;
+    }
+    if (dst->width != src->width || dst->height != src->height ||
+        (src->width & 1) || (src->height & 1)) {
+        printf("%s invalid size %" PRIu32 "x%" PRIu32 " -> %" PRIu32 "x%" PRIu32 "\n",
+               __func__, src->width, src->height, dst->width, dst->height);
+        return -1;
+    }
+    c.sf = conv_fmt_find(src->format);
+    c.df = conv_fmt_find(dst->format);
+    if (!c.sf || !c.df) {
+        printf("%s unsupport %s -> %s\n", __func__,
+               pixel_format_to_string(src->format), pixel_format_to_string(dst->format));
+        return -1;
+    }
+    if (src->format == dst->format) {
+        return video_frame_copy(dst, src) ? 0 : -1;
+    }
+    c.src = src;
+    c.dst = dst;
+    c.k = conv_kernels_get();
+    c.w = src->width;
+    c.tmp_stride = ALIGN_SIZE(src->width, CONV_ROW_ALIGN);
+    conv_run(conv_slice, &c, src->height, 2, (uint64_t)src->width * src->height);
+    dst->timestamp = src->timestamp;
+    dst->frame_id = src->frame_id;
+    return 0;
+}
+
+/******************************************************************************
+ * scaling
+ ******************************************************************************/
+struct scale_ctx {
+    const uint8_t             *src;
+    int                        sstride;
+    int                        sw;
+    int                        sh;
+    uint8_t                   *dst;
+    int                        dstride;
+    int                        dw;
+    int                        dh;
+    int                        c;       /* interleaved channels */
+    enum video_scale_mode      mode;
+    const struct conv_kernels *k;
+    int                       *x0;      /* bilinear: left sample, area: box start */
+    int                       *x1;      /* bilinear: right sample, area: box end */
+    uint8_t                   *xf;      /* bilinear: weight of right sample */
+};
+
+/* center aligned 16.16 source position of dst sample i */
+static inline int scale_pos(int i, int sn, int dn, int *frac)
+{
+    int64_t step = ((int64_t)sn << 16) / dn;
+    int64_t pos = step / 2 - 32768 + step * i;
+    if (pos < 0) {
+        pos = 0;
+    }
+    if (pos >= ((int64_t)(sn - 1) << 16)) {
+        *frac = 0;
+        return sn - 1;
+    }
+    *frac = (int)((pos >> 8) & 0xff);
+    return (int)(pos >> 16);
+}
+
+static inline void scale_hrow_n(const struct scale_ctx *s, const uint8_t *src, uint8_t *dst, const int c)
+{
+    const uint8_t *a, *b;
+    int x, k, f;
+    for (x = 0; x < s->dw; x++) {
+        a = src + s->x0[x] * c;
+        b = src + s->x1[x] * c;
+        f = s->xf[x];
+        for (k = 0; k < c; k++) {
+            dst[x * c + k] = (a[k] * (256 - f) + b[k] * f + 128) >> 8;
+        }
+    }
+}
+
+static void scale_hrow(const struct scale_ctx *s, const uint8_t *src, uint8_t *dst)
+{
+    if (s->sw == s->dw) {
+        memcpy(dst, src, s->dw * s->c);
+        return;
+    }
+    /* constant channel counts let the compiler unroll the inner loop */
+    switch (s->c) {
+    case 1:
+        scale_hrow_n(s, src, dst, 1);
+        break;
+    case 2:
+        scale_hrow_n(s, src, dst, 2);
+        break;
+    default:
+        scale_hrow_n(s, src, dst, 4);
+        break;
+    }
+}
+
+static void scale_bilinear(const struct scale_ctx *s, uint8_t *tmp, int y0, int y1)
+{
+    uint8_t *row[2];
+    int idx[2] = {-1, -1};
+    int n = s->dw * s->c;
+    int y, i, sy, f;
+    size_t stride = ALIGN_SIZE((size_t)n, CONV_ROW_ALIGN);
+    uint8_t *t;
+
+    row[0] = tmp;
+    row[1] = tmp + stride;
+    for (y = y0; y < y1; y++) {
+        sy = scale_pos(y, s->sh, s->dh, &f);
+        /* keep filtered rows around, consecutive dst rows mostly share them */
+        for (i = 0; i < 2; i++) {
+            int want = (i == 0) ? sy : ((sy + 1 < s->sh) ? sy + 1 : sy);
+            if (idx[i] == want) {
+                continue;
+            }
+            if (idx[1 - i] == want) {
+                t = row[i];
+                row[i] = row[1 - i];
+                row[1 - i] = t;
+                idx[1 - i] = idx[i];
+                idx[i] = want;
+                continue;
+            }
+            scale_hrow(s, s->src + want * s->sstride, row[i]);
+            idx[i] = want;
+        }
+        if (f == 0 || idx[0] == idx[1]) {
+            memcpy(s->dst + y * s->dstride, row[0], n);
+        } else {
+            s->k->lerp_row(row[0], row[1], s->dst + y * s->dstride, n, f);
+        }
+    }
+}
+
+static void scale_half(const struct scale_ctx *s, uint8_t *tmp, int y0, int y1)
+{
+    int y;
+    for (y = y0; y < y1; y++) {
+        s->k->avg_row(s->src + 2 * y * s->sstride, s->src + (2 * y + 1) * s->sstride,
+                      tmp, s->sw * s->c);
+        switch (s->c) {
+        case 1:
+            s->k->half_row(tmp, s->dst + y * s->dstride, s->dw);
+            break;
+        case 2:
+            half_row_c2(tmp, s->dst + y * s->dstride, s->dw);
+            break;
+        case 4:
+            s->k->half_row_c4(tmp, s->dst + y * s->dstride, s->dw);
+            break;
+        }
+    }
+}
+
+static void scale_box(const struct scale_ctx *s, uint8_t *tmp, int y0, int y1)
+{
+    uint32_t *acc = (uint32_t *)tmp;
+    uint32_t sum, cnt;
+    const uint8_t *src;
+    uint8_t *dst;
+    int y, sy, sy0, sy1, x, xx, k, n = s->sw * s->c;
+
+    for (y = y0; y < y1; y++) {
+        sy0 = (int)((int64_t)y * s->sh / s->dh);
+        sy1 = (int)((int64_t)(y + 1) * s->sh / s->dh);
+        sy1 = (sy1 > sy0) ? sy1 : sy0 + 1;
+        memset(acc, 0, n * sizeof(uint32_t));
+        for (sy = sy0; sy < sy1; sy++) {
+            src = s->src + sy * s->sstride;
+            for (x = 0; x < n; x++) {
+                acc[x] += src[x];
+            }
+        }
+        dst = s->dst + y * s->dstride;
+        for (x = 0; x < s->dw; x++) {
+            cnt = (uint32_t)(s->x1[x] - s->x0[x]) * (sy1 - sy0);
+            for (k = 0; k < s->c; k++) {
+                sum = 0;
+                for (xx = s->x0[x]; xx < s->x1[x]; xx++) {
+                    sum += acc[xx * s->c + k];
+                }
+                dst[x * s->c + k] = (sum + cnt / 2) / cnt;
+            }
+        }
+    }
+}
+
+static void scale_slice(void *arg, int y0, int y1)
+{
+    struct scale_ctx *s = arg;
+    size_t size = ALIGN_SIZE((size_t)s->sw * s->c * sizeof(uint32_t), CONV_ROW_ALIGN) +
+                  2 * ALIGN_SIZE((size_t)s->dw * s->c, CONV_ROW_ALIGN);
+    uint8_t *tmp = media_pool_alloc(size);
+
+    if (!tmp) {
+        printf("%s: malloc failed!\n", __func__);
+        return;
+    }
+    if (s->mode == VIDEO_SCALE_AREA && s->sw == 2 * s->dw && s->sh == 2 * s->dh) {
+        scale_half(s, tmp, y0, y1);
+    } else if (s->mode == VIDEO_SCALE_AREA && s->dw <= s->sw && s->dh <= s->sh) {
+        scale_box(s, tmp, y0, y1);
+    } else {
+        scale_bilinear(s, tmp, y0, y1);
+    }
+    media_pool_free(tmp);
+}
+
+static int scale_plane(struct scale_ctx *s)
+{
+    int x, f;
+
+    s->x0 = media_pool_alloc(s->dw * (2 * sizeof(int) + 1));
+    if (!s->x0) {
+        return -1;
+    }
+    s->x1 = s->x0 + s->dw;
+    s->xf = (uint8_t *)(s->x1 + s->dw);
+    for (x = 0; x < s->dw; x++) {
+        if (s->mode == VIDEO_SCALE_AREA && s->dw <= s->sw && s->dh <= s->sh) {
+            s->x0[x] = (int)((int64_t)x * s->sw / s->dw);
+            s->x1[x] = (int)((int64_t)(x + 1) * s->sw / s->dw);
+            s->x1[x] = (s->x1[x] > s->x0[x]) ? s->x1[x] : s->x0[x] + 1;
+            s->xf[x] = 0;
+        } else {
+            s->x0[x] = scale_pos(x, s->sw, s->dw, &f);
+            s->x1[x] = (s->x0[x] + 1 < s->sw) ? s->x0[x] + 1 : s->x0[x];
+            s->xf[x] = (uint8_t)f;
+        }
+    }
+    conv_run(scale_slice, s, s->dh, 1, (uint64_t)s->dw * s->dh * s->c);
+    media_pool_free(s->x0);
+    return 0;
+}
+
+int video_frame_scale(struct video_frame *dst, const struct video_frame *src,
+                enum video_scale_mode mode)
+{
+    struct scale_ctx s;
+    int i, planes, c[3], cw = 0, ch = 0;
+
+    if (!dst || !src || !dst->data[0] || !src->data[0] || src->format != dst->format ||
+        !src->width || !src->height || !dst->width || !dst->height) {
+        printf("%s invalid paramenters!\n", __func__);
+        return -1;
+    }
+    switch (src->format) {
+    case PIXEL_FORMAT_I420:
+        planes = 3; c[0] = c[1] = c[2] = 1; cw = ch = 1;
+        break;
+    case PIXEL_FORMAT_I422:
+        planes = 3; c[0] = c[1] = c[2] = 1; cw = 1;
+        break;
+    case PIXEL_FORMAT_I444:
+        planes = 3; c[0] = c[1] = c[2] = 1;
+        break;
+    case PIXEL_FORMAT_NV12:
+        planes = 2; c[0] = 1; c[1] = 2; cw = ch = 1;
+        break;
+    case PIXEL_FORMAT_Y800:
+        planes = 1; c[0] = 1;
+        break;
+    case PIXEL_FORMAT_BGRA:
+    case PIXEL_FORMAT_BGRX:
+    case PIXEL_FORMAT_RGBA:
+        planes = 1; c[0] = 4;
+        break;
+    default:
+        printf("%s unsupport %s\n", __func__, pixel_format_to_string(src->format));
+        return -1;
+    }
+    if (((src->width | dst->width) & cw) || ((src->height | dst->height) & ch)) {
+        printf("%s subsampled size must be even\n", __func__);
+        return -1;
+    }
+    s.mode = mode;
+    s.k = conv_kernels_get();
+    for (i = 0; i < planes; i++) {
+        s.src = src->data[i];
+        s.sstride = src->linesize[i];
+        s.dst = dst->data[i];
+        s.dstride = dst->linesize[i];
+        s.c = c[i];
+        s.sw = (i == 0) ? src->width : src->width >> cw;
+        s.sh = (i == 0) ? src->height : src->height >> ch;
+        s.dw = (i == 0) ? dst->width : dst->width >> cw;
+        s.dh = (i == 0) ? dst->height : dst->height >> ch;
+        if (0 != scale_plane(&s)) {
+            printf("%s: malloc failed!\n", __func__);
+            return -1;
+        }
+    }
+    dst->timestamp = src->timestamp;
+    dst->frame_id = src->frame_id;
+    return 0;
+}
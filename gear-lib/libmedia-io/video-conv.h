@@ -22,24 +22,58 @@
 #ifndef VIDEO_CONV_H
 #define VIDEO_CONV_H
 
-#if 0
 #include <stdint.h>
-#include <video-def.h>
+#include <stdbool.h>
 
-int video_yuyv2rgb(struct video_frame *in, struct video_frame *out);
-int uvc_uyvy2rgb(uvc_frame_t *in, uvc_frame_t *out);
-int uvc_any2rgb(uvc_frame_t *in, uvc_frame_t *out);
+/**
+ * Pixel format conversion and scaling of video_frame
+ *
+ * Formats: I420, NV12, I422, I444, YUY2, YVYU, UYVY, BGRA, BGRX, RGBA, Y800.
+ * Any pair of them converts through planar rows (packed <-> planar,
+ * 4:4:4 <-> 4:2:2 <-> 4:2:0), YUV <-> RGB uses BT.601 limited range.
+ * Width and height must be even.
+ *
+ * Row kernels are SSE2/AVX2 or NEON, selected at runtime. Frames from 720p
+ * up are cut into horizontal slices run on a small worker pool.
+ */
 
-int uvc_yuyv2bgr(uvc_frame_t *in, uvc_frame_t *out);
-int uvc_uyvy2bgr(uvc_frame_t *in, uvc_frame_t *out);
-int uvc_any2bgr(uvc_frame_t *in, uvc_frame_t *out);
+#ifdef __cplusplus
+extern "C" {
+#endif
 
-int uvc_yuyv2y(uvc_frame_t *in, uvc_frame_t *out);
-int uvc_yuyv2uv(uvc_frame_t *in, uvc_frame_t *out);
+enum video_scale_mode {
+    VIDEO_SCALE_BILINEAR = 0,
+    VIDEO_SCALE_AREA,       /* box filter for downscale, bilinear otherwise */
+};
 
-#ifdef LIBUVC_HAS_JPEG
-int uvc_mjpeg2rgb(uvc_frame_t *in, uvc_frame_t *out);
-#endif
-#endif
+GEAR_API bool video_conv_supported(enum pixel_format src, enum pixel_format dst);
 
+/*
+ * convert src into dst->format, dst must be initialized with the same
+ * width and height as src
+ */
+GEAR_API int video_frame_convert(struct video_frame *dst, const struct video_frame *src);
+
+/*
+ * scale src to dst->width x dst->height, formats must be equal.
+ * Supports planar YUV, NV12, Y800 and the 32bpp RGB formats.
+ */
+GEAR_API int video_frame_scale(struct video_frame *dst, const struct video_frame *src,
+                enum video_scale_mode mode);
+
+/*
+ * worker threads for sliced conversion, 0 means one per cpu (max 8),
+ * 1 disables slicing
+ */
+GEAR_API void video_conv_set_threads(int num);
+
+/*
+ * false runs the C row kernels only, to check or benchmark the SIMD ones
+ * against them. Applies to conversions started afterwards.
+ */
+GEAR_API void video_conv_set_simd(bool enable);
+
+#ifdef __cplusplus
+}
+#endif
 #endif
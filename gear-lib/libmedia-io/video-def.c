@@ -102,7 +102,7 @@ enum pixel_format pixel_string_to_format(const char *name)
     if (!name) {
         return PIXEL_FORMAT_NONE;
     }
-    for (i = 0; i < PIXEL_FORMAT_MAX; i++) {
+    for (i = 0; i < (int)(sizeof(pxlfmt_tbl) / sizeof(pxlfmt_tbl[0])); i++) {
         if (!strncasecmp(name, pxlfmt_tbl[i].name, sizeof(pxlfmt_tbl[i].name))) {
             return pxlfmt_tbl[i].format;
         }
@@ -112,8 +112,14 @@ enum pixel_format pixel_string_to_format(const char *name)
 
 const char *pixel_format_to_string(enum pixel_format fmt)
 {
-    fmt = (fmt > PIXEL_FORMAT_MAX) ? PIXEL_FORMAT_MAX : fmt;
-    return pxlfmt_tbl[fmt].name;
+    int i;
+    /* the table does not list every format, look it up by value */
+    for (i = 0; i < (int)(sizeof(pxlfmt_tbl) / sizeof(pxlfmt_tbl[0])); i++) {
+        if (pxlfmt_tbl[i].format == fmt) {
+            return pxlfmt_tbl[i].name;
+        }
+    }
+    return pxlfmt_tbl[0].name;
 }
 
 enum video_codec_type video_codec_string_to_type(const char *name)
@@ -136,6 +142,15 @@ const char *video_codec_type_to_string(enum video_codec_type type)
     return video_codec_tbl[type].name;
 }
 
+static uint8_t *frame_alloc(struct video_frame *frame, size_t size)
+{
+    if (frame->mem_type == MEDIA_MEM_REF) {
+        frame->buf = media_buffer_alloc(size);
+        return frame->buf ? frame->buf->data : NULL;
+    }
+    return (uint8_t *)aligned_alloc(ALIGNMENT, size);
+}
+
 int video_frame_init(struct video_frame *frame, enum pixel_format format,
                 uint32_t width, uint32_t height, media_mem_type_t mem_type)
 {
@@ -163,8 +178,8 @@ int video_frame_init(struct video_frame *frame, enum pixel_format format,
         size += (width / 2) * (height / 2);
         size = ALIGN_SIZE(size, ALIGNMENT);
         frame->total_size = size;
-        if (mem_type == MEDIA_MEM_DEEP) {
-           frame->data[0] = (uint8_t *)aligned_alloc(ALIGNMENT, size);
+        if (mem_type != MEDIA_MEM_SHALLOW) {
+           frame->data[0] = frame_alloc(frame, size);
            frame->data[1] = (uint8_t *)frame->data[0] + frame->plane_offsets[1];
            frame->data[2] = (uint8_t *)frame->data[0] + frame->plane_offsets[2];
         }
@@ -180,8 +195,8 @@ int video_frame_init(struct video_frame *frame, enum pixel_format format,
         size += (width / 2) * (height / 2) * 2;
         size = ALIGN_SIZE(size, ALIGNMENT);
         frame->total_size = size;
-        if (mem_type == MEDIA_MEM_DEEP) {
-            frame->data[0] = aligned_alloc(ALIGNMENT, size);
+        if (mem_type != MEDIA_MEM_SHALLOW) {
+            frame->data[0] = frame_alloc(frame, size);
             frame->data[1] = (uint8_t *)frame->data[0] + frame->plane_offsets[1];
         }
         frame->linesize[0] = width;
@@ -192,8 +207,8 @@ int video_frame_init(struct video_frame *frame, enum pixel_format format,
         size = width * height;
         size = ALIGN_SIZE(size, ALIGNMENT);
         frame->total_size = size;
-        if (mem_type == MEDIA_MEM_DEEP) {
-            frame->data[0] = aligned_alloc(ALIGNMENT, size);
+        if (mem_type != MEDIA_MEM_SHALLOW) {
+            frame->data[0] = frame_alloc(frame, size);
         }
         frame->linesize[0] = width;
         frame->planes = 1;
@@ -204,8 +219,8 @@ int video_frame_init(struct video_frame *frame, enum pixel_format format,
         size = width * height * 2;
         size = ALIGN_SIZE(size, ALIGNMENT);
         frame->total_size = size;
-        if (mem_type == MEDIA_MEM_DEEP) {
-            frame->data[0] = aligned_alloc(ALIGNMENT, size);
+        if (mem_type != MEDIA_MEM_SHALLOW) {
+            frame->data[0] = frame_alloc(frame, size);
         }
         frame->linesize[0] = width * 2;
         frame->planes = 1;
@@ -217,8 +232,8 @@ int video_frame_init(struct video_frame *frame, enum pixel_format format,
         size = width * height * 4;
         size = ALIGN_SIZE(size, ALIGNMENT);
         frame->total_size = size;
-        if (mem_type == MEDIA_MEM_DEEP) {
-            frame->data[0] = aligned_alloc(ALIGNMENT, size);
+        if (mem_type != MEDIA_MEM_SHALLOW) {
+            frame->data[0] = frame_alloc(frame, size);
         }
         frame->linesize[0] = width * 4;
         frame->planes = 1;
@@ -227,8 +242,8 @@ int video_frame_init(struct video_frame *frame, enum pixel_format format,
         size = width * height;
         size = ALIGN_SIZE(size, ALIGNMENT);
         frame->total_size = size;
-        if (mem_type == MEDIA_MEM_DEEP) {
-            frame->data[0] = aligned_alloc(ALIGNMENT, size * 3);
+        if (mem_type != MEDIA_MEM_SHALLOW) {
+            frame->data[0] = frame_alloc(frame, size * 3);
             frame->data[1] = (uint8_t *)frame->data[0] + size;
             frame->data[2] = (uint8_t *)frame->data[1] + size;
         }
@@ -242,8 +257,8 @@ int video_frame_init(struct video_frame *frame, enum pixel_format format,
         size = width * height * 3;
         size = ALIGN_SIZE(size, ALIGNMENT);
         frame->total_size = size;
-        if (mem_type == MEDIA_MEM_DEEP) {
-            frame->data[0] = aligned_alloc(ALIGNMENT, size);
+        if (mem_type != MEDIA_MEM_SHALLOW) {
+            frame->data[0] = frame_alloc(frame, size);
         }
         frame->linesize[0] = width * 3;
         frame->planes = 1;
@@ -258,8 +273,8 @@ int video_frame_init(struct video_frame *frame, enum pixel_format format,
         size += (width / 2) * height;
         size = ALIGN_SIZE(size, ALIGNMENT);
         frame->total_size = size;
-        if (mem_type == MEDIA_MEM_DEEP) {
-            frame->data[0] = aligned_alloc(ALIGNMENT, size);
+        if (mem_type != MEDIA_MEM_SHALLOW) {
+            frame->data[0] = frame_alloc(frame, size);
             frame->data[1] = (uint8_t *)frame->data[0] + frame->plane_offsets[1];
             frame->data[2] = (uint8_t *)frame->data[0] + frame->plane_offsets[2];
         }
@@ -281,8 +296,8 @@ int video_frame_init(struct video_frame *frame, enum pixel_format format,
         size += width * height;
         size = ALIGN_SIZE(size, ALIGNMENT);
         frame->total_size = size;
-        if (mem_type == MEDIA_MEM_DEEP) {
-            frame->data[0] = aligned_alloc(ALIGNMENT, size);
+        if (mem_type != MEDIA_MEM_SHALLOW) {
+            frame->data[0] = frame_alloc(frame, size);
             frame->data[1] = (uint8_t *)frame->data[0] + frame->plane_offsets[1];
             frame->data[2] = (uint8_t *)frame->data[0] + frame->plane_offsets[2];
             frame->data[3] = (uint8_t *)frame->data[0] + frame->plane_offsets[3];
@@ -306,8 +321,8 @@ int video_frame_init(struct video_frame *frame, enum pixel_format format,
         size += width * height;
         size = ALIGN_SIZE(size, ALIGNMENT);
         frame->total_size = size;
-        if (mem_type == MEDIA_MEM_DEEP) {
-            frame->data[0] = aligned_alloc(ALIGNMENT, size);
+        if (mem_type != MEDIA_MEM_SHALLOW) {
+            frame->data[0] = frame_alloc(frame, size);
             frame->data[1] = (uint8_t *)frame->data[0] + frame->plane_offsets[1];
             frame->data[2] = (uint8_t *)frame->data[0] + frame->plane_offsets[2];
             frame->data[3] = (uint8_t *)frame->data[0] + frame->plane_offsets[3];
@@ -331,8 +346,8 @@ int video_frame_init(struct video_frame *frame, enum pixel_format format,
         size += width * height;
         size = ALIGN_SIZE(size, ALIGNMENT);
         frame->total_size = size;
-        if (mem_type == MEDIA_MEM_DEEP) {
-            frame->data[0] = aligned_alloc(ALIGNMENT, size);
+        if (mem_type != MEDIA_MEM_SHALLOW) {
+            frame->data[0] = frame_alloc(frame, size);
             frame->data[1] = (uint8_t *)frame->data[0] + frame->plane_offsets[1];
             frame->data[2] = (uint8_t *)frame->data[0] + frame->plane_offsets[2];
             frame->data[3] = (uint8_t *)frame->data[0] + frame->plane_offsets[3];
@@ -348,8 +363,8 @@ int video_frame_init(struct video_frame *frame, enum pixel_format format,
         size = width * height;
         size = ALIGN_SIZE(size, ALIGNMENT);
         frame->total_size = size;
-        if (mem_type == MEDIA_MEM_DEEP) {
-            frame->data[0] = aligned_alloc(ALIGNMENT, size);
+        if (mem_type != MEDIA_MEM_SHALLOW) {
+            frame->data[0] = frame_alloc(frame, size);
         }
         frame->linesize[0] = width;
         frame->planes = 1;
@@ -366,6 +381,9 @@ void video_frame_deinit(struct video_frame *frame)
     if (frame) {
         if (frame->mem_type == MEDIA_MEM_DEEP) {
             aligned_free(frame->data[0]);
+        } else if (frame->mem_type == MEDIA_MEM_REF) {
+            media_buffer_unref(frame->buf);
+            frame->buf = NULL;
         }
     }
 }
@@ -380,14 +398,14 @@ struct video_frame *video_frame_create(enum pixel_format format,
         return NULL;
     }
 
-    frame = calloc(1, sizeof(struct video_frame));
+    frame = media_pool_alloc(sizeof(struct video_frame));
     if (!frame) {
         printf("malloc video frame failed!\n");
         return NULL;
     }
     if (0 != video_frame_init(frame, format, width, height, type)) {
         printf("video_frame_init failed!\n");
-        free(frame);
+        media_pool_free(frame);
         frame = NULL;
     }
 
@@ -398,10 +416,22 @@ void video_frame_destroy(struct video_frame *frame)
 {
     if (frame) {
         video_frame_deinit(frame);
-        free(frame);
+        media_pool_free(frame);
     }
 }
 
+struct video_frame *video_frame_ref(struct video_frame *dst, const struct video_frame *src)
+{
+    if (!dst || !src || !src->buf) {
+        printf("%s invalid paramenters!\n", __func__);
+        return NULL;
+    }
+    media_buffer_ref(src->buf);
+    video_frame_deinit(dst);
+    memcpy(dst, src, sizeof(struct video_frame));
+    return dst;
+}
+
 struct video_frame *video_frame_copy(struct video_frame *dst, const struct video_frame *src)
 {
     if (!dst || !src) {
@@ -474,10 +504,11 @@ void video_producer_dump(struct video_producer *vs)
 
 struct video_packet *video_packet_create(media_mem_type_t type, void *data, size_t len)
 {
-    struct video_packet *vp = calloc(1, sizeof(struct video_packet));
+    struct video_packet *vp = media_pool_alloc(sizeof(struct video_packet));
     if (!vp) {
         return NULL;
     }
+    memset(vp, 0, sizeof(struct video_packet));
     vp->mem_type = type;
     switch (type) {
     case MEDIA_MEM_DEEP:
@@ -488,6 +519,20 @@ struct video_packet *video_packet_create(media_mem_type_t type, void *data, size
         vp->data = data;
         vp->size = len;
         break;
+    case MEDIA_MEM_REF:
+        if (len > 0) {
+            vp->buf = media_buffer_alloc(len);
+            if (!vp->buf) {
+                media_pool_free(vp);
+                return NULL;
+            }
+            vp->data = vp->buf->data;
+            if (data) {
+                memcpy(vp->data, data, len);
+            }
+        }
+        vp->size = len;
+        break;
     default:
         printf("%s invalid type!\n", __func__);
         break;
@@ -496,6 +541,23 @@ struct video_packet *video_packet_create(media_mem_type_t type, void *data, size
     return vp;
 }
 
+struct video_packet *video_packet_create_ref(struct media_buffer *buf, void *data, size_t len)
+{
+    struct video_packet *vp;
+    if (!buf) {
+        printf("%s invalid paramenters!\n", __func__);
+        return NULL;
+    }
+    vp = video_packet_create(MEDIA_MEM_REF, NULL, 0);
+    if (!vp) {
+        return NULL;
+    }
+    vp->buf = media_buffer_ref(buf);
+    vp->data = data ? data : buf->data;
+    vp->size = data ? len : buf->size;
+    return vp;
+}
+
 void video_packet_destroy(struct video_packet *vp)
 {
     if (!vp)
@@ -509,11 +571,14 @@ void video_packet_destroy(struct video_packet *vp)
     case MEDIA_MEM_SHALLOW:
         vp->data = NULL;
         break;
+    case MEDIA_MEM_REF:
+        media_buffer_unref(vp->buf);
+        break;
     default:
         printf("%s invalid type!\n", __func__);
         break;
     }
-    free(vp);
+    media_pool_free(vp);
 }
 
 struct video_packet *video_packet_copy(struct video_packet *dst, const struct video_packet *src, media_mem_type_t type)
@@ -532,6 +597,28 @@ struct video_packet *video_packet_copy(struct video_packet *dst, const struct vi
         }
         memcpy(dst->data, src->data, src->size);
         break;
+    case MEDIA_MEM_REF:
+        if (src->buf) {
+            media_buffer_ref(src->buf);
+            media_buffer_unref(dst->buf);
+            dst->buf = src->buf;
+            dst->data = src->data;
+        } else {
+            /* first hop from unowned memory, the only copy on the way */
+            if (!dst->buf || dst->buf->size < src->size ||
+                !media_buffer_is_writable(dst->buf)) {
+                media_buffer_unref(dst->buf);
+                dst->buf = media_buffer_alloc(src->size);
+                if (!dst->buf) {
+                    dst->data = NULL;
+                    dst->size = 0;
+                    return NULL;
+                }
+            }
+            dst->data = dst->buf->data;
+            memcpy(dst->data, src->data, src->size);
+        }
+        break;
     }
     dst->size = src->size;
     dst->type = src->type;
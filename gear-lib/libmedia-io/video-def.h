@@ -114,6 +114,7 @@ struct video_frame {
     uint64_t          timestamp;//ns
     uint64_t          frame_id;
     media_mem_type_t  mem_type;
+    struct media_buffer *buf;   /* MEDIA_MEM_REF only, backs all planes */
 };
 
 const char *pixel_format_to_string(enum pixel_format fmt);
@@ -128,6 +129,12 @@ GEAR_API struct video_frame *video_frame_create(enum pixel_format format,
 GEAR_API void video_frame_destroy(struct video_frame *frame);
 GEAR_API struct video_frame *video_frame_copy(struct video_frame *dst,
                 const struct video_frame *src);
+/*
+ * share the planes of a MEDIA_MEM_REF frame, dst is deinit first
+ * and must be initialized or zeroed
+ */
+GEAR_API struct video_frame *video_frame_ref(struct video_frame *dst,
+                const struct video_frame *src);
 
 void video_producer_dump(struct video_producer *vp);
 
@@ -173,6 +180,27 @@ enum h264_nal_type {
     H264_NAL_AUXILIARY_SLICE,
 };
 
+enum h265_nal_type {
+    H265_NAL_TRAIL_N    = 0,
+    H265_NAL_TRAIL_R    = 1,
+    H265_NAL_RASL_R     = 9,
+    H265_NAL_BLA_W_LP   = 16,
+    H265_NAL_BLA_W_RADL = 17,
+    H265_NAL_BLA_N_LP   = 18,
+    H265_NAL_IDR_W_RADL = 19,
+    H265_NAL_IDR_N_LP   = 20,
+    H265_NAL_CRA_NUT    = 21,
+    H265_NAL_VPS        = 32,
+    H265_NAL_SPS        = 33,
+    H265_NAL_PPS        = 34,
+    H265_NAL_AUD        = 35,
+    H265_NAL_EOS        = 36,
+    H265_NAL_EOB        = 37,
+    H265_NAL_FD         = 38,
+    H265_NAL_SEI_PREFIX = 39,
+    H265_NAL_SEI_SUFFIX = 40,
+};
+
 /**
  * This structure describe encoder attribute
  */
@@ -198,6 +226,7 @@ struct video_packet {
     size_t                 size;
     enum video_packet_type type;
     media_mem_type_t       mem_type;
+    struct media_buffer   *buf;     /* MEDIA_MEM_REF only */
     uint64_t               pts;
     uint64_t               dts;
     bool                   key_frame;
@@ -205,6 +234,7 @@ struct video_packet {
 };
 
 GEAR_API struct video_packet *video_packet_create(media_mem_type_t type, void *data, size_t len);
+GEAR_API struct video_packet *video_packet_create_ref(struct media_buffer *buf, void *data, size_t len);
 GEAR_API void video_packet_destroy(struct video_packet *vp);
 GEAR_API struct video_packet *video_packet_copy(struct video_packet *dst, const struct video_packet *src, media_mem_type_t type);
 GEAR_API void video_encoder_dump(struct video_encoder *ve);
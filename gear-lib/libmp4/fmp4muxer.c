@@ -0,0 +1,1139 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#include "fmp4muxer.h"
+#include <libserializer.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#if !defined(IOV_MAX)
+#define IOV_MAX                     1024
+#endif
+
+#define FMP4_VIDEO_TRACK_ID         1
+#define FMP4_AUDIO_TRACK_ID         2
+#define FMP4_MAX_VIDEO_SAMPLES      600     /* largest moof reserved in file mode */
+#define FMP4_MAX_AUDIO_SAMPLES      1024
+#define FMP4_AUDIO_FRAGMENT_MS      1000    /* audio only streams */
+#define FMP4_GOP_MS                 2000    /* guess until the first GOP is seen */
+#define FMP4_DEFAULT_FPS            30
+#define FMP4_SAMPLES_INIT           64
+#define AAC_FRAME_LEN               1024
+
+#define TRUN_DATA_OFFSET            0x000001
+#define TRUN_SAMPLE_DURATION        0x000100
+#define TRUN_SAMPLE_SIZE            0x000200
+#define TRUN_SAMPLE_FLAGS           0x000400
+#define TRUN_SAMPLE_CTS             0x000800
+#define TFHD_DEFAULT_BASE_IS_MOOF   0x020000
+
+#define SAMPLE_FLAGS_SYNC           0x02000000
+#define SAMPLE_FLAGS_NON_SYNC       0x01010000
+
+struct fmp4_sample {
+    uint32_t size;
+    uint32_t duration;
+    uint32_t flags;
+    int32_t  cts;
+};
+
+struct fmp4_track {
+    bool                enable;
+    uint32_t            id;
+    uint32_t            timescale;      /* timebase.den */
+    uint32_t            tick;           /* timebase.num, packet ts * tick is in timescale */
+    uint64_t            start;          /* dts of the first sample */
+    uint64_t            last_dts;
+    uint64_t            base;           /* tfdt of current fragment */
+    uint32_t            last_duration;
+    struct fmp4_sample *samples;
+    int                 num;
+    int                 max;            /* allocated samples */
+    int                 cap;            /* per fragment, the moof hole in file mode */
+    int                 last_num;       /* samples in the previous fragment */
+    bool                full;           /* previous fragment was cut at cap */
+    size_t              bytes;          /* payload in current fragment */
+    struct serializer   buf;            /* payload unless streamed to file */
+    bool                buffered;
+};
+
+struct fmp4_muxer {
+    struct fmp4_config  conf;
+    int                 fd;
+    off_t               offset;         /* end of file */
+    off_t               frag_pos;       /* reserved moof area */
+    size_t              hole;
+    fmp4_segment_cb    *cb;
+    void               *cb_ctx;
+    struct video_encoder venc;
+    struct audio_encoder aenc;
+    struct fmp4_track   video;
+    struct fmp4_track   audio;
+    uint8_t            *avcc;
+    size_t              avcc_size;
+    uint8_t             asc[16];
+    size_t              asc_size;
+    bool                init_done;
+    bool                frag_open;
+    bool                frag_independent;
+    uint32_t            seq;
+    struct serializer   box;
+    struct iovec       *iov;
+    uint8_t            *prefix;
+    int                 max_nal;
+};
+
+static inline void wb32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static size_t box_begin(struct serializer *s, const char *type)
+{
+    size_t pos = s_getpos(s);
+    s_wb32(s, 0);
+    s_write(s, type, 4);
+    return pos;
+}
+
+static size_t fullbox_begin(struct serializer *s, const char *type, uint8_t version, uint32_t flags)
+{
+    size_t pos = box_begin(s, type);
+    s_w8(s, version);
+    s_wb24(s, flags);
+    return pos;
+}
+
+static void box_end(struct serializer *s, size_t pos)
+{
+    uint8_t *data;
+    size_t size;
+    serializer_array_get_data(s, &data, &size);
+    wb32(data + pos, (uint32_t)(size - pos));
+}
+
+static void s_zero(struct serializer *s, size_t n)
+{
+    while (n--) {
+        s_w8(s, 0);
+    }
+}
+
+static void write_matrix(struct serializer *s)
+{
+    s_wb32(s, 0x00010000); s_wb32(s, 0); s_wb32(s, 0);
+    s_wb32(s, 0); s_wb32(s, 0x00010000); s_wb32(s, 0);
+    s_wb32(s, 0); s_wb32(s, 0); s_wb32(s, 0x40000000);
+}
+
+/*
+ * init segment
+ */
+
+static void write_ftyp(struct serializer *s)
+{
+    size_t pos = box_begin(s, "ftyp");
+    s_write(s, "iso6", 4);
+    s_wb32(s, 0);
+    s_write(s, "iso6", 4);
+    s_write(s, "cmfc", 4);
+    s_write(s, "mp41", 4);
+    box_end(s, pos);
+}
+
+static void write_mvhd(struct serializer *s)
+{
+    size_t pos = fullbox_begin(s, "mvhd", 0, 0);
+    s_wb32(s, 0);               /* creation_time */
+    s_wb32(s, 0);               /* modification_time */
+    s_wb32(s, 1000);            /* timescale */
+    s_wb32(s, 0);               /* duration, fragmented */
+    s_wb32(s, 0x00010000);      /* rate */
+    s_wb16(s, 0x0100);          /* volume */
+    s_zero(s, 10);
+    write_matrix(s);
+    s_zero(s, 24);              /* pre_defined */
+    s_wb32(s, FMP4_AUDIO_TRACK_ID + 1);
+    box_end(s, pos);
+}
+
+static void write_tkhd(struct serializer *s, struct fmp4_muxer *m, struct fmp4_track *t)
+{
+    size_t pos = fullbox_begin(s, "tkhd", 0, 0x000003);
+    bool is_video = (t == &m->video);
+    s_wb32(s, 0);
+    s_wb32(s, 0);
+    s_wb32(s, t->id);
+    s_wb32(s, 0);
+    s_wb32(s, 0);               /* duration */
+    s_zero(s, 8);
+    s_wb16(s, 0);               /* layer */
+    s_wb16(s, 0);               /* alternate_group */
+    s_wb16(s, is_video ? 0 : 0x0100);
+    s_wb16(s, 0);
+    write_matrix(s);
+    s_wb32(s, is_video ? m->venc.width << 16 : 0);
+    s_wb32(s, is_video ? m->venc.height << 16 : 0);
+    box_end(s, pos);
+}
+
+static void write_avc1(struct serializer *s, struct fmp4_muxer *m)
+{
+    size_t pos = box_begin(s, "avc1"), avcc;
+    s_zero(s, 6);
+    s_wb16(s, 1);               /* data_reference_index */
+    s_zero(s, 16);
+    s_wb16(s, m->venc.width);
+    s_wb16(s, m->venc.height);
+    s_wb32(s, 0x00480000);      /* 72 dpi */
+    s_wb32(s, 0x00480000);
+    s_wb32(s, 0);
+    s_wb16(s, 1);               /* frame_count */
+    s_zero(s, 32);              /* compressorname */
+    s_wb16(s, 0x0018);          /* depth */
+    s_wb16(s, 0xffff);
+    avcc = box_begin(s, "avcC");
+    s_write(s, m->avcc, m->avcc_size);
+    box_end(s, avcc);
+    box_end(s, pos);
+}
+
+static void write_mp4a(struct serializer *s, struct fmp4_muxer *m)
+{
+    size_t pos = box_begin(s, "mp4a"), esds;
+    uint32_t dsi = m->asc_size;
+    uint32_t dcd = 13 + 2 + dsi;
+    uint32_t esd = 3 + 2 + dcd + 3;
+
+    s_zero(s, 6);
+    s_wb16(s, 1);
+    s_zero(s, 8);
+    s_wb16(s, m->aenc.channels);
+    s_wb16(s, 16);
+    s_wb32(s, 0);
+    /* 16.16, 0 if it doesn't fit: the track timescale has the rate */
+    s_wb32(s, m->aenc.sample_rate < 65536 ? (uint32_t)m->aenc.sample_rate << 16 : 0);
+
+    esds = fullbox_begin(s, "esds", 0, 0);
+    s_w8(s, 0x03);              /* ES_DescrTag */
+    s_w8(s, esd);
+    s_wb16(s, FMP4_AUDIO_TRACK_ID);
+    s_w8(s, 0);
+    s_w8(s, 0x04);              /* DecoderConfigDescrTag */
+    s_w8(s, dcd);
+    s_w8(s, 0x40);              /* Audio ISO/IEC 14496-3 */
+    s_w8(s, 0x15);              /* AudioStream */
+    s_wb24(s, 0);
+    s_wb32(s, (uint32_t)m->aenc.bitrate);
+    s_wb32(s, (uint32_t)m->aenc.bitrate);
+    s_w8(s, 0x05);              /* DecSpecificInfoTag */
+    s_w8(s, dsi);
+    s_write(s, m->asc, m->asc_size);
+    s_w8(s, 0x06);              /* SLConfigDescrTag */
+    s_w8(s, 1);
+    s_w8(s, 0x02);
+    box_end(s, esds);
+    box_end(s, pos);
+}
+
+static void write_empty_table(struct serializer *s, const char *type)
+{
+    size_t pos = fullbox_begin(s, type, 0, 0);
+    if (!memcmp(type, "stsz", 4)) {
+        s_wb32(s, 0);
+    }
+    s_wb32(s, 0);
+    box_end(s, pos);
+}
+
+static void write_trak(struct serializer *s, struct fmp4_muxer *m, struct fmp4_track *t)
+{
+    bool is_video = (t == &m->video);
+    size_t trak, mdia, box, minf, dinf, dref, stbl, stsd;
+
+    trak = box_begin(s, "trak");
+    write_tkhd(s, m, t);
+    mdia = box_begin(s, "mdia");
+
+    box = fullbox_begin(s, "mdhd", 0, 0);
+    s_wb32(s, 0);
+    s_wb32(s, 0);
+    s_wb32(s, t->timescale);
+    s_wb32(s, 0);
+    s_wb16(s, 0x55c4);          /* und */
+    s_wb16(s, 0);
+    box_end(s, box);
+
+    box = fullbox_begin(s, "hdlr", 0, 0);
+    s_wb32(s, 0);
+    s_write(s, is_video ? "vide" : "soun", 4);
+    s_zero(s, 12);
+    s_write(s, is_video ? "VideoHandler" : "SoundHandler", 13);
+    box_end(s, box);
+
+    minf = box_begin(s, "minf");
+    if (is_video) {
+        box = fullbox_begin(s, "vmhd", 0, 1);
+        s_zero(s, 8);
+    } else {
+        box = fullbox_begin(s, "smhd", 0, 0);
+        s_zero(s, 4);
+    }
+    box_end(s, box);
+
+    dinf = box_begin(s, "dinf");
+    dref = fullbox_begin(s, "dref", 0, 0);
+    s_wb32(s, 1);
+    box = fullbox_begin(s, "url ", 0, 1);
+    box_end(s, box);
+    box_end(s, dref);
+    box_end(s, dinf);
+
+    stbl = box_begin(s, "stbl");
+    stsd = fullbox_begin(s, "stsd", 0, 0);
+    s_wb32(s, 1);
+    if (is_video) {
+        write_avc1(s, m);
+    } else {
+        write_mp4a(s, m);
+    }
+    box_end(s, stsd);
+    write_empty_table(s, "stts");
+    write_empty_table(s, "stsc");
+    write_empty_table(s, "stsz");
+    write_empty_table(s, "stco");
+    box_end(s, stbl);
+
+    box_end(s, minf);
+    box_end(s, mdia);
+    box_end(s, trak);
+}
+
+static void write_trex(struct serializer *s, struct fmp4_track *t, uint32_t flags)
+{
+    size_t pos = fullbox_begin(s, "trex", 0, 0);
+    s_wb32(s, t->id);
+    s_wb32(s, 1);               /* default_sample_description_index */
+    s_wb32(s, 0);
+    s_wb32(s, 0);
+    s_wb32(s, flags);
+    box_end(s, pos);
+}
+
+static void write_init(struct serializer *s, struct fmp4_muxer *m)
+{
+    size_t moov, mvex;
+
+    write_ftyp(s);
+    moov = box_begin(s, "moov");
+    write_mvhd(s);
+    if (m->video.enable) {
+        write_trak(s, m, &m->video);
+    }
+    if (m->audio.enable) {
+        write_trak(s, m, &m->audio);
+    }
+    mvex = box_begin(s, "mvex");
+    if (m->video.enable) {
+        write_trex(s, &m->video, SAMPLE_FLAGS_NON_SYNC);
+    }
+    if (m->audio.enable) {
+        write_trex(s, &m->audio, SAMPLE_FLAGS_SYNC);
+    }
+    box_end(s, mvex);
+    box_end(s, moov);
+}
+
+/*
+ * fragments
+ */
+
+static size_t traf_size(int num, int per_sample)
+{
+    /* traf + tfhd + tfdt(v1) + trun header + entries */
+    return num ? 8 + 16 + 20 + 20 + (size_t)num * per_sample : 0;
+}
+
+static size_t moof_size(int nv, int na)
+{
+    return 8 + 16 + traf_size(nv, 16) + traf_size(na, 8);
+}
+
+static void write_traf(struct serializer *s, struct fmp4_muxer *m,
+                struct fmp4_track *t, uint32_t data_offset)
+{
+    bool is_video = (t == &m->video);
+    uint32_t flags = TRUN_DATA_OFFSET | TRUN_SAMPLE_DURATION | TRUN_SAMPLE_SIZE;
+    size_t traf, box;
+    int i;
+
+    if (is_video) {
+        flags |= TRUN_SAMPLE_FLAGS | TRUN_SAMPLE_CTS;
+    }
+    traf = box_begin(s, "traf");
+    box = fullbox_begin(s, "tfhd", 0, TFHD_DEFAULT_BASE_IS_MOOF);
+    s_wb32(s, t->id);
+    box_end(s, box);
+
+    box = fullbox_begin(s, "tfdt", 1, 0);
+    s_wb64(s, t->base);
+    box_end(s, box);
+
+    box = fullbox_begin(s, "trun", 1, flags);
+    s_wb32(s, t->num);
+    s_wb32(s, data_offset);
+    for (i = 0; i < t->num; i++) {
+        s_wb32(s, t->samples[i].duration);
+        s_wb32(s, t->samples[i].size);
+        if (is_video) {
+            s_wb32(s, t->samples[i].flags);
+            s_wb32(s, (uint32_t)t->samples[i].cts);
+        }
+    }
+    box_end(s, box);
+    box_end(s, traf);
+}
+
+static void write_moof(struct serializer *s, struct fmp4_muxer *m)
+{
+    uint32_t size = moof_size(m->video.num, m->audio.num);
+    size_t moof, box;
+
+    moof = box_begin(s, "moof");
+    box = fullbox_begin(s, "mfhd", 0, 0);
+    s_wb32(s, ++m->seq);
+    box_end(s, box);
+    /* mdat holds all video samples of the fragment, then all audio */
+    if (m->video.num) {
+        write_traf(s, m, &m->video, size + 8);
+    }
+    if (m->audio.num) {
+        write_traf(s, m, &m->audio, size + 8 + m->video.bytes);
+    }
+    box_end(s, moof);
+}
+
+static int write_all(int fd, const void *buf, size_t len, off_t off)
+{
+    const uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, off);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("pwrite failed: %s\n", strerror(errno));
+            return -1;
+        }
+        p += n;
+        off += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int writev_all(int fd, struct iovec *iov, int cnt, off_t off)
+{
+    while (cnt > 0) {
+        ssize_t n = pwritev(fd, iov, cnt > IOV_MAX ? IOV_MAX : cnt, off);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("pwritev failed: %s\n", strerror(errno));
+            return -1;
+        }
+        off += n;
+        while (cnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            cnt--;
+        }
+        if (n > 0) {
+            iov->iov_base = (uint8_t *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+static void write_box_header(uint8_t *buf, uint32_t size, const char *type)
+{
+    wb32(buf, size);
+    memcpy(buf + 4, type, 4);
+}
+
+/*
+ * File layout of a fragment while it is being written:
+ *
+ *   [free, hole bytes][mdat, size 0 = up to EOF][video samples ...]
+ *
+ * On close the audio samples are appended, then moof goes to the tail of
+ * the hole, the free box shrinks to the remainder and the mdat gets its
+ * real size. Each step leaves a valid file behind.
+ */
+static int frag_begin_file(struct fmp4_muxer *m)
+{
+    uint8_t hdr[8];
+
+    m->frag_pos = m->offset;
+    write_box_header(hdr, m->hole, "free");
+    if (write_all(m->fd, hdr, 8, m->frag_pos) < 0) {
+        return -1;
+    }
+    write_box_header(hdr, 0, "mdat");
+    if (write_all(m->fd, hdr, 8, m->frag_pos + m->hole) < 0) {
+        return -1;
+    }
+    m->offset = m->frag_pos + m->hole + 8;
+    return 0;
+}
+
+static int frag_end_file(struct fmp4_muxer *m, const uint8_t *moof, size_t moof_len)
+{
+    uint8_t hdr[8];
+    uint8_t *data;
+    size_t size, mdat;
+
+    if (m->audio.bytes) {
+        serializer_array_get_data(&m->audio.buf, &data, &size);
+        if (write_all(m->fd, data, size, m->offset) < 0) {
+            return -1;
+        }
+        m->offset += size;
+    }
+    if (write_all(m->fd, moof, moof_len, m->frag_pos + m->hole - moof_len) < 0) {
+        return -1;
+    }
+    if (m->hole > moof_len) {
+        write_box_header(hdr, m->hole - moof_len, "free");
+        if (write_all(m->fd, hdr, 8, m->frag_pos) < 0) {
+            return -1;
+        }
+    }
+    mdat = 8 + m->video.bytes + m->audio.bytes;
+    write_box_header(hdr, mdat, "mdat");
+    if (write_all(m->fd, hdr, 8, m->frag_pos + m->hole) < 0) {
+        return -1;
+    }
+    if (m->conf.crash_safe && fdatasync(m->fd) < 0) {
+        printf("fdatasync failed: %s\n", strerror(errno));
+    }
+    return 0;
+}
+
+static int frag_end_cb(struct fmp4_muxer *m, const uint8_t *moof, size_t moof_len)
+{
+    struct fmp4_track *t = m->video.num ? &m->video : &m->audio;
+    struct fmp4_segment seg;
+    struct iovec iov[4];
+    uint8_t hdr[8];
+    uint64_t duration = 0;
+    int i, n = 0;
+
+    for (i = 0; i < t->num; i++) {
+        duration += t->samples[i].duration;
+    }
+    write_box_header(hdr, 8 + m->video.bytes + m->audio.bytes, "mdat");
+    iov[n].iov_base = (void *)moof;
+    iov[n++].iov_len = moof_len;
+    iov[n].iov_base = hdr;
+    iov[n++].iov_len = 8;
+    if (m->video.bytes) {
+        serializer_array_get_data(&m->video.buf, (uint8_t **)&iov[n].iov_base, &iov[n].iov_len);
+        n++;
+    }
+    if (m->audio.bytes) {
+        serializer_array_get_data(&m->audio.buf, (uint8_t **)&iov[n].iov_base, &iov[n].iov_len);
+        n++;
+    }
+    memset(&seg, 0, sizeof(seg));
+    seg.type = FMP4_SEGMENT_MEDIA;
+    seg.independent = m->frag_independent;
+    seg.start_ms = t->base * 1000 / t->timescale;
+    seg.duration_ms = duration * 1000 / t->timescale;
+    seg.iov = iov;
+    seg.iovcnt = n;
+    seg.size = moof_len + 8 + m->video.bytes + m->audio.bytes;
+    return m->cb(m->cb_ctx, &seg);
+}
+
+static void track_reset(struct fmp4_track *t)
+{
+    t->last_num = t->num;
+    t->full = (t->num >= t->cap);
+    t->num = 0;
+    t->bytes = 0;
+    if (t->buffered) {
+        serializer_array_reset(&t->buf);
+    }
+}
+
+static void track_fix_last(struct fmp4_track *t)
+{
+    if (t->num && t->samples[t->num - 1].duration == 0) {
+        t->samples[t->num - 1].duration = t->last_duration;
+    }
+}
+
+static int frag_end(struct fmp4_muxer *m)
+{
+    uint8_t *moof;
+    size_t moof_len;
+    int ret;
+
+    if (!m->frag_open) {
+        return 0;
+    }
+    m->frag_open = false;
+    if (!m->video.num && !m->audio.num) {
+        if (m->fd >= 0) {
+            m->offset = m->frag_pos;
+        }
+        return 0;
+    }
+    track_fix_last(&m->video);
+    track_fix_last(&m->audio);
+    write_moof(&m->box, m);
+    serializer_array_get_data(&m->box, &moof, &moof_len);
+    ret = (m->fd >= 0) ? frag_end_file(m, moof, moof_len) : frag_end_cb(m, moof, moof_len);
+    serializer_array_reset(&m->box);
+    track_reset(&m->video);
+    track_reset(&m->audio);
+    return ret;
+}
+
+static int track_plan(struct fmp4_track *t, uint32_t ms, uint32_t per_sec, int max)
+{
+    int n = (int)((uint64_t)ms * per_sec / 1000) + 1;
+
+    n = MAX2(n, t->last_num);
+    n += n / 4 + 1;
+    if (t->full) {
+        n = MAX2(n, t->cap * 2);
+    }
+    return MIN2(n, max);
+}
+
+/*
+ * file mode reserves the moof before its samples are known: size it for
+ * one fragment_ms (or the last GOP) at the stream rates plus a quarter,
+ * instead of the worst case. a fragment outgrowing it is cut early and the
+ * next one gets twice the room
+ */
+static void frag_plan(struct fmp4_muxer *m)
+{
+    uint32_t ms = m->conf.fragment_ms ? m->conf.fragment_ms : FMP4_GOP_MS;
+    uint32_t fps = FMP4_DEFAULT_FPS, aps;
+
+    if (m->video.enable) {
+        if (m->venc.framerate.num > 0 && m->venc.framerate.den > 0) {
+            fps = (m->venc.framerate.num + m->venc.framerate.den - 1) / m->venc.framerate.den;
+        }
+        m->video.cap = track_plan(&m->video, ms, fps, FMP4_MAX_VIDEO_SAMPLES);
+    }
+    if (m->audio.enable) {
+        if (!m->video.enable && !m->conf.fragment_ms) {
+            ms = FMP4_AUDIO_FRAGMENT_MS;
+        }
+        aps = m->aenc.sample_rate ? m->aenc.sample_rate : m->audio.timescale;
+        aps = (aps + AAC_FRAME_LEN - 1) / AAC_FRAME_LEN;
+        m->audio.cap = track_plan(&m->audio, ms, aps, FMP4_MAX_AUDIO_SAMPLES);
+    }
+    m->hole = moof_size(m->video.enable ? m->video.cap : 0,
+                        m->audio.enable ? m->audio.cap : 0) + 8;
+}
+
+static int frag_begin(struct fmp4_muxer *m, bool independent)
+{
+    m->frag_open = true;
+    m->frag_independent = independent;
+    if (m->fd >= 0) {
+        frag_plan(m);
+        return frag_begin_file(m);
+    }
+    return 0;
+}
+
+static int write_init_segment(struct fmp4_muxer *m)
+{
+    struct fmp4_segment seg;
+    struct iovec iov;
+    uint8_t *data;
+    size_t size;
+    int ret;
+
+    write_init(&m->box, m);
+    serializer_array_get_data(&m->box, &data, &size);
+    if (m->fd >= 0) {
+        ret = write_all(m->fd, data, size, 0);
+        m->offset = size;
+    } else {
+        iov.iov_base = data;
+        iov.iov_len = size;
+        memset(&seg, 0, sizeof(seg));
+        seg.type = FMP4_SEGMENT_INIT;
+        seg.iov = &iov;
+        seg.iovcnt = 1;
+        seg.size = size;
+        ret = m->cb(m->cb_ctx, &seg);
+    }
+    serializer_array_reset(&m->box);
+    m->init_done = true;
+    return ret;
+}
+
+static int track_init(struct fmp4_track *t, uint32_t id, rational_t timebase,
+                uint32_t def_timescale, bool buffered)
+{
+    t->enable = true;
+    t->id = id;
+    if (timebase.den > 0 && timebase.num > 0) {
+        t->timescale = timebase.den;
+        t->tick = timebase.num;
+    } else {
+        t->timescale = def_timescale ? def_timescale : 1000;
+        t->tick = 1;
+    }
+    t->max = FMP4_SAMPLES_INIT;
+    t->cap = INT_MAX;           /* callback mode writes moof after the samples */
+    t->samples = calloc(t->max, sizeof(struct fmp4_sample));
+    if (!t->samples) {
+        return -1;
+    }
+    t->buffered = buffered;
+    if (buffered) {
+        serializer_array_init(&t->buf);
+    }
+    return 0;
+}
+
+static void track_deinit(struct fmp4_track *t)
+{
+    free(t->samples);
+    if (t->buffered) {
+        serializer_array_deinit(&t->buf);
+    }
+}
+
+/* the duration of a sample is known once the next one arrives */
+static void track_close_last(struct fmp4_track *t, uint64_t dts)
+{
+    if (t->num > 0 && dts > t->last_dts) {
+        t->last_duration = (uint32_t)(dts - t->last_dts);
+        t->samples[t->num - 1].duration = t->last_duration;
+    }
+}
+
+static int track_add_sample(struct fmp4_track *t, uint64_t dts, int32_t cts, uint32_t flags)
+{
+    struct fmp4_sample *s;
+
+    if (t->num == t->max) {
+        s = realloc(t->samples, sizeof(struct fmp4_sample) * t->max * 2);
+        if (!s) {
+            printf("%s: realloc samples failed!\n", __func__);
+            return -1;
+        }
+        t->samples = s;
+        t->max *= 2;
+    }
+    track_close_last(t, dts);
+    if (t->num == 0) {
+        t->base = dts - t->start;
+    }
+    s = &t->samples[t->num++];
+    s->size = 0;
+    s->duration = 0;
+    s->flags = flags;
+    s->cts = cts;
+    t->last_dts = dts;
+    return 0;
+}
+
+static int fmp4_write_video(struct fmp4_muxer *m, struct video_packet *vp)
+{
+    struct fmp4_track *t = &m->video;
+    const uint8_t *p, *end = vp->data + vp->size;
+    struct h26x_nal nal;
+    bool annexb = h26x_has_start_code(vp->data, vp->size);
+    bool key = annexb ? h26x_is_keyframe(VIDEO_CODEC_H264, vp->data, vp->size) :
+               (vp->key_frame || vp->type == H26X_FRAME_IDR || vp->type == H26X_FRAME_I);
+    uint64_t dts = vp->dts * t->tick;
+    int32_t cts = (int32_t)(((int64_t)vp->pts - (int64_t)vp->dts) * t->tick);
+    size_t size = 0;
+    int n = 0;
+
+    if (!m->init_done) {
+        const uint8_t *extra = vp->encoder.extra_size ? vp->encoder.extra_data : vp->data;
+        size_t extra_size = vp->encoder.extra_size ? vp->encoder.extra_size : vp->size;
+        ssize_t len;
+
+        if (!key) {
+            return 0;   /* fragments start at a keyframe */
+        }
+        if (h26x_has_start_code(extra, extra_size)) {
+            len = h264_avcc_config(extra, extra_size, NULL, 0);
+            m->avcc = (len > 0) ? malloc(len) : NULL;
+            if (!m->avcc || h264_avcc_config(extra, extra_size, m->avcc, len) < 0) {
+                printf("%s: no SPS/PPS for avcC!\n", __func__);
+                return -1;
+            }
+            m->avcc_size = len;
+        } else {
+            m->avcc = memdup(extra, extra_size);
+            m->avcc_size = extra_size;
+        }
+        if (!m->venc.width) {
+            m->venc.width = vp->encoder.width;
+            m->venc.height = vp->encoder.height;
+        }
+        t->start = t->last_dts = dts;
+        if (m->audio.enable) {
+            /* audio starts at the same wall time as the first keyframe */
+            m->audio.start = dts * m->audio.timescale / t->timescale;
+            m->audio.last_dts = m->audio.start;
+        }
+        if (write_init_segment(m) < 0) {
+            return -1;
+        }
+    }
+
+    if (dts < t->start) {
+        return 0;
+    }
+    if (!m->frag_open || (key && t->num > 0) || t->num >= t->cap ||
+        (m->conf.fragment_ms && t->num > 0 &&
+         (dts - t->start - t->base) * 1000 >= (uint64_t)m->conf.fragment_ms * t->timescale)) {
+        track_close_last(t, dts);
+        if (frag_end(m) < 0) {
+            return -1;
+        }
+        if (frag_begin(m, key) < 0) {
+            return -1;
+        }
+    }
+
+    if (t->num == 0 && key) {
+        /* the fragment may have been opened by audio */
+        m->frag_independent = true;
+    }
+    if (track_add_sample(t, dts, cts,
+                         key ? SAMPLE_FLAGS_SYNC : SAMPLE_FLAGS_NON_SYNC) < 0) {
+        return -1;
+    }
+
+    if (!annexb) {
+        if (t->buffered) {
+            s_write(&t->buf, vp->data, vp->size);
+        } else {
+            struct iovec iov = {vp->data, vp->size};
+            if (writev_all(m->fd, &iov, 1, m->offset) < 0) {
+                return -1;
+            }
+        }
+        size = vp->size;
+    } else {
+        for (p = vp->data; (p = h26x_next_nal(VIDEO_CODEC_H264, p, end, &nal)) != NULL; n++) {
+            if (t->buffered) {
+                s_wb32(&t->buf, nal.size);
+                s_write(&t->buf, nal.data, nal.size);
+            } else {
+                if (n == m->max_nal) {
+                    int i, max_nal = m->max_nal ? m->max_nal * 2 : 16;
+                    struct iovec *iov = realloc(m->iov, sizeof(struct iovec) * 2 * max_nal);
+                    uint8_t *prefix;
+                    if (!iov) {
+                        return -1;
+                    }
+                    m->iov = iov;
+                    prefix = realloc(m->prefix, 4 * max_nal);
+                    if (!prefix) {
+                        return -1;
+                    }
+                    m->prefix = prefix;
+                    m->max_nal = max_nal;
+                    for (i = 0; i < n; i++) {
+                        m->iov[2 * i].iov_base = m->prefix + 4 * i;
+                    }
+                }
+                wb32(m->prefix + 4 * n, nal.size);
+                m->iov[2 * n].iov_base = m->prefix + 4 * n;
+                m->iov[2 * n].iov_len = 4;
+                m->iov[2 * n + 1].iov_base = (void *)nal.data;
+                m->iov[2 * n + 1].iov_len = nal.size;
+            }
+            size += 4 + nal.size;
+        }
+        if (!t->buffered && n > 0 && writev_all(m->fd, m->iov, 2 * n, m->offset) < 0) {
+            return -1;
+        }
+    }
+    if (!t->buffered) {
+        m->offset += size;
+    }
+    t->samples[t->num - 1].size = size;
+    t->bytes += size;
+    return 0;
+}
+
+static void aac_config_from_adts(struct fmp4_muxer *m, const uint8_t *adts)
+{
+    int profile = (adts[2] >> 6) + 1;
+    int freq_idx = (adts[2] >> 2) & 0x0f;
+    int channels = ((adts[2] & 0x01) << 2) | (adts[3] >> 6);
+
+    m->asc[0] = (profile << 3) | (freq_idx >> 1);
+    m->asc[1] = ((freq_idx & 0x01) << 7) | (channels << 3);
+    m->asc_size = 2;
+}
+
+static void aac_config_from_encoder(struct fmp4_muxer *m)
+{
+    static const uint32_t rates[] = {
+        96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350
+    };
+    int freq_idx = 4;
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(rates); i++) {
+        if (rates[i] == m->aenc.sample_rate) {
+            freq_idx = i;
+            break;
+        }
+    }
+    m->asc[0] = (2 << 3) | (freq_idx >> 1);     /* AAC LC */
+    m->asc[1] = ((freq_idx & 0x01) << 7) | (m->aenc.channels << 3);
+    m->asc_size = 2;
+}
+
+static int fmp4_write_audio(struct fmp4_muxer *m, struct audio_packet *ap)
+{
+    struct fmp4_track *t = &m->audio;
+    const uint8_t *data = ap->data;
+    size_t size = ap->size;
+    uint64_t dts = ap->dts * t->tick;
+
+    if (size >= 7 && data[0] == 0xff && (data[1] & 0xf0) == 0xf0) {
+        size_t hdr = (data[1] & 0x01) ? 7 : 9;
+        if (!m->asc_size) {
+            aac_config_from_adts(m, data);
+        }
+        if (size <= hdr) {
+            return 0;
+        }
+        data += hdr;
+        size -= hdr;
+    }
+
+    if (!m->init_done) {
+        if (m->video.enable) {
+            return 0;   /* wait for the first video keyframe */
+        }
+        t->start = t->last_dts = dts;
+        if (write_init_segment(m) < 0) {
+            return -1;
+        }
+    }
+    if (dts < t->start) {
+        return 0;
+    }
+    if (!m->video.enable) {
+        uint32_t frag_ms = m->conf.fragment_ms ? m->conf.fragment_ms : FMP4_AUDIO_FRAGMENT_MS;
+        if (!m->frag_open || t->num >= t->cap ||
+            (t->num > 0 && (dts - t->start - t->base) * 1000 >= (uint64_t)frag_ms * t->timescale)) {
+            track_close_last(t, dts);
+            if (frag_end(m) < 0) {
+                return -1;
+            }
+            if (frag_begin(m, true) < 0) {
+                return -1;
+            }
+        }
+    } else if (!m->frag_open || t->num >= t->cap) {
+        /* flushed, or more audio than the moof has room for: cut here */
+        track_close_last(t, dts);
+        if (frag_end(m) < 0) {
+            return -1;
+        }
+        if (frag_begin(m, false) < 0) {
+            return -1;
+        }
+    }
+    if (track_add_sample(t, dts, 0, SAMPLE_FLAGS_SYNC) < 0) {
+        return -1;
+    }
+    s_write(&t->buf, data, size);
+    t->samples[t->num - 1].size = size;
+    t->bytes += size;
+    return 0;
+}
+
+static struct fmp4_muxer *fmp4_muxer_alloc(struct fmp4_config *conf)
+{
+    struct fmp4_muxer *m = calloc(1, sizeof(struct fmp4_muxer));
+    if (!m) {
+        printf("malloc fmp4_muxer failed!\n");
+        return NULL;
+    }
+    if (conf) {
+        memcpy(&m->conf, conf, sizeof(struct fmp4_config));
+    }
+    m->fd = -1;
+    serializer_array_init(&m->box);
+    return m;
+}
+
+struct fmp4_muxer *fmp4_muxer_open(const char *file, struct fmp4_config *conf)
+{
+    struct fmp4_muxer *m;
+    if (!file) {
+        return NULL;
+    }
+    m = fmp4_muxer_alloc(conf);
+    if (!m) {
+        return NULL;
+    }
+    m->fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (m->fd < 0) {
+        printf("open %s failed: %s\n", file, strerror(errno));
+        fmp4_muxer_close(m);
+        return NULL;
+    }
+    return m;
+}
+
+struct fmp4_muxer *fmp4_muxer_create(struct fmp4_config *conf, fmp4_segment_cb *cb, void *ctx)
+{
+    struct fmp4_muxer *m;
+    if (!cb) {
+        return NULL;
+    }
+    m = fmp4_muxer_alloc(conf);
+    if (!m) {
+        return NULL;
+    }
+    m->cb = cb;
+    m->cb_ctx = ctx;
+    return m;
+}
+
+int fmp4_muxer_add_media(struct fmp4_muxer *m, struct media_packet *pkt)
+{
+    if (!m || !pkt) {
+        return -1;
+    }
+    if (m->init_done) {
+        printf("fmp4_muxer already started!\n");
+        return -1;
+    }
+    switch (pkt->type) {
+    case MEDIA_TYPE_VIDEO:
+        if (m->video.enable) {
+            printf("fmp4_muxer already add video!\n");
+            return -1;
+        }
+        memcpy(&m->venc, &pkt->video->encoder, sizeof(struct video_encoder));
+        return track_init(&m->video, FMP4_VIDEO_TRACK_ID, m->venc.timebase, 1000, m->fd < 0);
+    case MEDIA_TYPE_AUDIO:
+        if (m->audio.enable) {
+            printf("fmp4_muxer already add audio!\n");
+            return -1;
+        }
+        memcpy(&m->aenc, &pkt->audio->encoder, sizeof(struct audio_encoder));
+        if (m->aenc.extra_size >= 2 && m->aenc.extra_size <= sizeof(m->asc)) {
+            memcpy(m->asc, m->aenc.extra_data, m->aenc.extra_size);
+            m->asc_size = m->aenc.extra_size;
+        } else if (m->aenc.format == AUDIO_CODEC_AAC && m->aenc.sample_rate) {
+            aac_config_from_encoder(m);
+        }
+        return track_init(&m->audio, FMP4_AUDIO_TRACK_ID, m->aenc.timebase,
+                          m->aenc.sample_rate, true);
+    default:
+        printf("unsupport type!\n");
+        break;
+    }
+    return -1;
+}
+
+int fmp4_muxer_write(struct fmp4_muxer *m, struct media_packet *pkt)
+{
+    if (!m || !pkt) {
+        return -1;
+    }
+    switch (pkt->type) {
+    case MEDIA_TYPE_VIDEO:
+        if (!m->video.enable) {
+            return -1;
+        }
+        return fmp4_write_video(m, pkt->video);
+    case MEDIA_TYPE_AUDIO:
+        if (!m->audio.enable) {
+            return -1;
+        }
+        return fmp4_write_audio(m, pkt->audio);
+    default:
+        break;
+    }
+    return -1;
+}
+
+int fmp4_muxer_flush(struct fmp4_muxer *m)
+{
+    if (!m) {
+        return -1;
+    }
+    return frag_end(m);
+}
+
+void fmp4_muxer_close(struct fmp4_muxer *m)
+{
+    if (!m) {
+        return;
+    }
+    frag_end(m);
+    if (m->fd >= 0) {
+        if (ftruncate(m->fd, m->offset) < 0) {
+            printf("ftruncate failed: %s\n", strerror(errno));
+        }
+        close(m->fd);
+    }
+    if (m->video.enable) {
+        track_deinit(&m->video);
+    }
+    if (m->audio.enable) {
+        track_deinit(&m->audio);
+    }
+    serializer_array_deinit(&m->box);
+    free(m->avcc);
+    free(m->iov);
+    free(m->prefix);
+    free(m);
+}
@@ -0,0 +1,81 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#ifndef FMP4MUXER_H
+#define FMP4MUXER_H
+
+#include <libposix.h>
+#include <libmedia-io.h>
+
+/*
+ * Native fragmented MP4 (ISO BMFF / CMAF) writer, no libavformat needed.
+ *
+ * Output is an init segment (ftyp + moov with mvex) followed by moof + mdat
+ * fragments, a new one at every video keyframe and optionally every
+ * fragment_ms in between (LL-HLS parts / DASH chunks).
+ *
+ * File mode streams video samples straight to disk: memory use does not
+ * grow with recording length or GOP size. Every fragment is completed in an
+ * order that keeps the file parseable at any point, so a crash loses at most
+ * the fragment being written.
+ *
+ * Callback mode hands each segment to the caller as an iovec list.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum fmp4_segment_type {
+    FMP4_SEGMENT_INIT = 0,
+    FMP4_SEGMENT_MEDIA,
+};
+
+struct fmp4_segment {
+    enum fmp4_segment_type type;
+    bool                   independent;   /* starts with a keyframe */
+    uint64_t               start_ms;      /* decode time of first sample */
+    uint32_t               duration_ms;
+    const struct iovec    *iov;
+    int                    iovcnt;
+    size_t                 size;
+};
+
+typedef int (fmp4_segment_cb)(void *ctx, const struct fmp4_segment *seg);
+
+struct fmp4_config {
+    uint32_t fragment_ms;   /* 0: one fragment per GOP */
+    bool     crash_safe;    /* file mode: fdatasync after every fragment */
+};
+
+struct fmp4_muxer;
+
+GEAR_API struct fmp4_muxer *fmp4_muxer_open(const char *file, struct fmp4_config *conf);
+GEAR_API struct fmp4_muxer *fmp4_muxer_create(struct fmp4_config *conf, fmp4_segment_cb *cb, void *ctx);
+GEAR_API int fmp4_muxer_add_media(struct fmp4_muxer *m, struct media_packet *pkt);
+GEAR_API int fmp4_muxer_write(struct fmp4_muxer *m, struct media_packet *pkt);
+GEAR_API int fmp4_muxer_flush(struct fmp4_muxer *m);
+GEAR_API void fmp4_muxer_close(struct fmp4_muxer *m);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
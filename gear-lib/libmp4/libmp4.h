@@ -26,6 +26,8 @@
 #include <libmedia-io.h>
 #include <stdlib.h>
 
+#include "fmp4muxer.h"
+
 #define LIBMP4_VERSION "0.1.0"
 
 #ifdef __cplusplus
@@ -33,21 +35,6 @@ extern "C" {
 #endif
 
 
-#define __STDC_CONSTANT_MACROS
-#include <libavformat/avformat.h>
-#include <libavcodec/avcodec.h>
-#include <libavutil/avutil.h>
-
-
-struct mp4_muxer_media {
-    enum AVCodecID codec_id;
-    AVStream *av_stream;
-    AVCodec *av_codec;
-    const AVBitStreamFilter *av_bsf;
-    uint64_t first_pts;
-    uint64_t last_pts;
-};
-
 struct mp4_config {
     uint32_t width;
     uint32_t height;
@@ -55,22 +42,48 @@ struct mp4_config {
     enum pixel_format format;
 };
 
-struct mp4_muxer {
-    struct mp4_muxer_media audio;
-    struct mp4_muxer_media video;
-    struct mp4_config conf;
-    AVFormatContext *av_format;
-    bool got_video;
-};
+/*
+ * mp4_muxer wraps libavformat and is only built with ENABLE_FFMPEG,
+ * fmp4_muxer (fmp4muxer.h) needs no FFmpeg
+ */
+struct mp4_muxer;
 
 GEAR_API struct mp4_muxer *mp4_muxer_open(const char *file, struct mp4_config *conf);
 GEAR_API int mp4_muxer_write(struct mp4_muxer *c, struct media_packet *frame);
 GEAR_API void mp4_muxer_close(struct mp4_muxer *c);
 
 
+/*
+ * sample index of one trak, stts/ctts/stsz/stsc/stco/co64/stss flattened
+ * into one entry per sample, times are in the track timescale
+ */
+struct mp4_track {
+    uint32_t id;
+    uint32_t handler;       /* 'vide', 'soun' ... fourcc */
+    uint32_t timescale;
+    uint64_t duration;
+    uint32_t sample_count;
+    uint64_t *offset;       /* file offset */
+    uint32_t *size;
+    uint64_t *dts;
+    int32_t  *cts;          /* pts - dts, NULL without ctts */
+    uint32_t *sync;         /* ascending sync samples, NULL if all are sync */
+    uint32_t sync_count;
+};
+
+struct mp4_sample {
+    uint64_t offset;
+    uint32_t size;
+    uint64_t dts;
+    uint64_t pts;
+    bool keyframe;
+};
+
 struct mp4_parser {
     void *opaque_stream;
     void *opaque_root;
+    int track_count;
+    struct mp4_track *tracks;   /* built on first mp4_get_track */
 };
 
 
@@ -80,6 +93,18 @@ GEAR_API int mp4_get_creation(struct mp4_parser *mp, uint64_t *time);
 GEAR_API int mp4_get_resolution(struct mp4_parser *mp, uint32_t *width, uint32_t *height);
 GEAR_API void mp4_parser_destroy(struct mp4_parser *mp);
 
+/*
+ * the index is read only once built, seek and sample lookups may then run
+ * from many threads, mp4_sample_data is zero copy from the file mapping
+ */
+GEAR_API int mp4_get_track_count(struct mp4_parser *mp);
+GEAR_API const struct mp4_track *mp4_get_track(struct mp4_parser *mp, int index);
+GEAR_API int mp4_track_get_sample(const struct mp4_track *t, uint32_t n, struct mp4_sample *s);
+/* last sample with dts <= time_us, or the sync sample before it */
+GEAR_API int mp4_track_seek(const struct mp4_track *t, uint64_t time_us, bool keyframe);
+GEAR_API const uint8_t *mp4_sample_data(struct mp4_parser *mp, const struct mp4_sample *s);
+GEAR_API int mp4_sample_read(struct mp4_parser *mp, const struct mp4_sample *s, void *buf, size_t len);
+
 
 #ifdef __cplusplus
 }
@@ -23,6 +23,28 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#define __STDC_CONSTANT_MACROS
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/avutil.h>
+
+struct mp4_muxer_media {
+    enum AVCodecID codec_id;
+    AVStream *av_stream;
+    AVCodec *av_codec;
+    const AVBitStreamFilter *av_bsf;
+    uint64_t first_pts;
+    uint64_t last_pts;
+};
+
+struct mp4_muxer {
+    struct mp4_muxer_media audio;
+    struct mp4_muxer_media video;
+    struct mp4_config conf;
+    AVFormatContext *av_format;
+    bool got_video;
+};
+
 static int muxer_add_stream(struct mp4_muxer *muxer, struct mp4_muxer_media *media, enum AVCodecID codec_id)
 {
     media->av_codec = avcodec_find_encoder(codec_id);
@@ -187,13 +209,13 @@ int mp4_muxer_write(struct mp4_muxer *c, struct media_packet *mp)
             printf("media_packet is not video\n");
             goto exit;
         }
-        if (!(mp->video->type == H26X_FRAME_I ||
-              mp->video->type == H26X_FRAME_B ||
-              mp->video->type == H26X_FRAME_P)) {
+        if (mp->video->type == H26X_FRAME_UNKNOWN ||
+            mp->video->type >= H26X_FRAME_TYPE_MAX) {
             printf("video packet in invalid type\n");
             goto exit;
         }
-        if (mp->video->type == H26X_FRAME_I) {
+        if (mp->video->type == H26X_FRAME_I || mp->video->type == H26X_FRAME_IDR ||
+            h26x_is_keyframe(mp->video->encoder.type, mp->video->data, mp->video->size)) {
             c->got_video = true;
             pkt.flags |= AV_PKT_FLAG_KEY;
         }
@@ -34,7 +34,17 @@ struct mp4_parser *mp4_parser_create(const char *file)
         return NULL;
     }
     struct mp4_parser *mp = (struct mp4_parser *)calloc(1, sizeof(struct mp4_parser));
+    if (!mp) {
+        destory_file_stream(stream);
+        return NULL;
+    }
     mp->opaque_root = (void *)MP4_BoxGetRoot(stream);
+    if (!mp->opaque_root) {
+        printf("MP4_BoxGetRoot failed!\n");
+        destory_file_stream(stream);
+        free(mp);
+        return NULL;
+    }
     mp->opaque_stream = (void *)stream;
     return mp;
 }
@@ -46,6 +56,17 @@ void mp4_parser_destroy(struct mp4_parser *mp)
     }
     stream_t *stream = (stream_t *)mp->opaque_stream;
     MP4_Box_t *root = (MP4_Box_t *)mp->opaque_root;
+    int i;
+    if (mp->tracks) {
+        for (i = 0; i < mp->track_count; i++) {
+            free(mp->tracks[i].offset);
+            free(mp->tracks[i].size);
+            free(mp->tracks[i].dts);
+            free(mp->tracks[i].cts);
+            free(mp->tracks[i].sync);
+        }
+        free(mp->tracks);
+    }
     MP4_BoxFree(stream, root);
     destory_file_stream(stream);
     free(mp);
@@ -84,3 +105,241 @@ int mp4_get_resolution(struct mp4_parser *mp, uint32_t *width, uint32_t *height)
     *height = (uint32_t)(p_box->data.p_tkhd->i_height/BLOCK16x16);
     return 0;
 }
+
+static int track_build(MP4_Box_t *trak, struct mp4_track *t)
+{
+    MP4_Box_t *tkhd = MP4_BoxGet(trak, "tkhd");
+    MP4_Box_t *mdhd = MP4_BoxGet(trak, "mdia/mdhd");
+    MP4_Box_t *hdlr = MP4_BoxGet(trak, "mdia/hdlr");
+    MP4_Box_t *stbl = MP4_BoxGet(trak, "mdia/minf/stbl");
+    MP4_Box_t *stts, *ctts, *stsz, *stsc, *co, *stss;
+    MP4_Box_data_co64_t *p_co;
+    MP4_Box_data_stsc_t *p_stsc;
+    uint32_t i, j, k, n, c, last;
+    uint64_t time, off;
+
+    if (!tkhd || !tkhd->data.p_tkhd || !mdhd || !mdhd->data.p_mdhd || !stbl) {
+        return -1;
+    }
+    t->id = tkhd->data.p_tkhd->i_track_ID;
+    t->timescale = mdhd->data.p_mdhd->i_timescale;
+    t->duration = mdhd->data.p_mdhd->i_duration;
+    if (hdlr && hdlr->data.p_hdlr) {
+        t->handler = hdlr->data.p_hdlr->i_handler_type;
+    }
+    stts = MP4_BoxGet(stbl, "stts");
+    ctts = MP4_BoxGet(stbl, "ctts");
+    stsz = MP4_BoxGet(stbl, "stsz");
+    stsc = MP4_BoxGet(stbl, "stsc");
+    stss = MP4_BoxGet(stbl, "stss");
+    co = MP4_BoxGet(stbl, "stco");
+    if (!co) {
+        co = MP4_BoxGet(stbl, "co64");
+    }
+    if (!stts || !stts->data.p_stts || !stsz || !stsz->data.p_stsz ||
+        !stsc || !stsc->data.p_stsc || !co || !co->data.p_co64) {
+        /* fragmented or broken trak, no sample in moov */
+        return 0;
+    }
+    n = stsz->data.p_stsz->i_sample_count;
+    if (n == 0) {
+        return 0;
+    }
+    t->offset = (uint64_t *)calloc(n, sizeof(uint64_t));
+    t->size = (uint32_t *)calloc(n, sizeof(uint32_t));
+    t->dts = (uint64_t *)calloc(n, sizeof(uint64_t));
+    if (!t->offset || !t->size || !t->dts) {
+        return -1;
+    }
+    for (i = 0; i < n; i++) {
+        t->size[i] = stsz->data.p_stsz->i_sample_size ?
+                     stsz->data.p_stsz->i_sample_size :
+                     stsz->data.p_stsz->i_entry_size[i];
+    }
+
+    time = 0;
+    for (i = 0, j = 0; j < stts->data.p_stts->i_entry_count && i < n; j++) {
+        for (k = 0; k < stts->data.p_stts->pi_sample_count[j] && i < n; k++) {
+            t->dts[i++] = time;
+            time += (uint32_t)stts->data.p_stts->pi_sample_delta[j];
+        }
+    }
+    for (; i < n; i++) {
+        t->dts[i] = time;
+    }
+
+    if (ctts && ctts->data.p_ctts) {
+        t->cts = (int32_t *)calloc(n, sizeof(int32_t));
+        if (!t->cts) {
+            return -1;
+        }
+        for (i = 0, j = 0; j < ctts->data.p_ctts->i_entry_count && i < n; j++) {
+            for (k = 0; k < ctts->data.p_ctts->pi_sample_count[j] && i < n; k++) {
+                t->cts[i++] = ctts->data.p_ctts->pi_sample_offset[j];
+            }
+        }
+    }
+
+    /* stsc runs of chunks with the same sample count, chunks are 1-based */
+    p_co = co->data.p_co64;
+    p_stsc = stsc->data.p_stsc;
+    for (i = 0, j = 0; j < p_stsc->i_entry_count && i < n; j++) {
+        last = (j + 1 < p_stsc->i_entry_count) ? p_stsc->i_first_chunk[j + 1]
+                                                : p_co->i_entry_count + 1;
+        for (c = p_stsc->i_first_chunk[j]; c < last && c <= p_co->i_entry_count && i < n; c++) {
+            if (c == 0) {
+                continue;
+            }
+            off = p_co->i_chunk_offset[c - 1];
+            for (k = 0; k < p_stsc->i_samples_per_chunk[j] && i < n; k++) {
+                t->offset[i] = off;
+                off += t->size[i];
+                i++;
+            }
+        }
+    }
+    t->sample_count = i;
+
+    if (stss && stss->data.p_stss) {
+        t->sync = (uint32_t *)calloc(stss->data.p_stss->i_entry_count + 1, sizeof(uint32_t));
+        if (!t->sync) {
+            return -1;
+        }
+        for (j = 0; j < stss->data.p_stss->i_entry_count; j++) {
+            k = stss->data.p_stss->i_sample_number[j];
+            if (k < t->sample_count &&
+                (t->sync_count == 0 || k > t->sync[t->sync_count - 1])) {
+                t->sync[t->sync_count++] = k;
+            }
+        }
+    }
+    return 0;
+}
+
+int mp4_get_track_count(struct mp4_parser *mp)
+{
+    if (!mp || !mp->opaque_root) {
+        return -1;
+    }
+    return MP4_BoxCount((MP4_Box_t *)mp->opaque_root, "moov/trak");
+}
+
+const struct mp4_track *mp4_get_track(struct mp4_parser *mp, int index)
+{
+    MP4_Box_t *root;
+    MP4_Box_t *trak;
+    int i, count;
+
+    if (!mp || !mp->opaque_root || index < 0) {
+        printf("%s invalid paramenters!\n", __func__);
+        return NULL;
+    }
+    if (!mp->tracks) {
+        root = (MP4_Box_t *)mp->opaque_root;
+        count = MP4_BoxCount(root, "moov/trak");
+        if (count <= 0) {
+            return NULL;
+        }
+        mp->tracks = (struct mp4_track *)calloc(count, sizeof(struct mp4_track));
+        if (!mp->tracks) {
+            return NULL;
+        }
+        mp->track_count = count;
+        for (i = 0; i < count; i++) {
+            trak = MP4_BoxGet(root, "moov/trak[%d]", i);
+            if (!trak || track_build(trak, &mp->tracks[i])) {
+                printf("build index of track %d failed!\n", i);
+            }
+        }
+    }
+    if (index >= mp->track_count) {
+        return NULL;
+    }
+    return &mp->tracks[index];
+}
+
+int mp4_track_get_sample(const struct mp4_track *t, uint32_t n, struct mp4_sample *s)
+{
+    if (!t || !s || n >= t->sample_count) {
+        return -1;
+    }
+    s->offset = t->offset[n];
+    s->size = t->size[n];
+    s->dts = t->dts[n];
+    s->pts = t->cts ? (uint64_t)((int64_t)t->dts[n] + t->cts[n]) : t->dts[n];
+    s->keyframe = true;
+    if (t->sync) {
+        uint32_t lo = 0, hi = t->sync_count;
+        while (lo < hi) {
+            uint32_t mid = (lo + hi) / 2;
+            if (t->sync[mid] < n) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        s->keyframe = (lo < t->sync_count && t->sync[lo] == n);
+    }
+    return 0;
+}
+
+int mp4_track_seek(const struct mp4_track *t, uint64_t time_us, bool keyframe)
+{
+    uint64_t ts;
+    uint32_t lo, hi, n;
+
+    if (!t || t->sample_count == 0) {
+        return -1;
+    }
+    ts = time_us / 1000000 * t->timescale + time_us % 1000000 * t->timescale / 1000000;
+
+    /* first sample with dts > ts, step back one */
+    lo = 0;
+    hi = t->sample_count;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (t->dts[mid] <= ts) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    n = lo ? lo - 1 : 0;
+    if (!keyframe || !t->sync || t->sync_count == 0) {
+        return n;
+    }
+    lo = 0;
+    hi = t->sync_count;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (t->sync[mid] <= n) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return t->sync[lo ? lo - 1 : 0];
+}
+
+const uint8_t *mp4_sample_data(struct mp4_parser *mp, const struct mp4_sample *s)
+{
+    stream_t *stream;
+    if (!mp || !s || !mp->opaque_stream) {
+        return NULL;
+    }
+    stream = (stream_t *)mp->opaque_stream;
+    if (!stream_IsMapped(stream) || s->offset >= stream->size ||
+        s->size > stream->size - s->offset) {
+        return NULL;
+    }
+    return stream->map + s->offset;
+}
+
+int mp4_sample_read(struct mp4_parser *mp, const struct mp4_sample *s, void *buf, size_t len)
+{
+    if (!mp || !s || !buf || len < s->size) {
+        printf("%s invalid paramenters!\n", __func__);
+        return -1;
+    }
+    return stream_ReadAt((stream_t *)mp->opaque_stream, s->offset, buf, s->size);
+}
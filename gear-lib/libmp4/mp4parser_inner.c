@@ -90,6 +90,7 @@ int MP4_ReadBoxCommon( stream_t *p_stream, MP4_Box_t *p_box )
     p_box->p_first  = NULL;
     p_box->p_last  = NULL;
     p_box->p_next   = NULL;
+    p_box->p_lazy   = NULL;
 
     MP4_GET4BYTES( p_box->i_shortsize );
     MP4_GETFOURCC( p_box->i_type );
@@ -3565,6 +3566,75 @@ static const struct
 };
 
 
+static unsigned int MP4_BoxFunctionIndex( const MP4_Box_t *p_box )
+{
+    unsigned int i_index;
+
+    for( i_index = 0; ; i_index++ )
+    {
+        if ( MP4_Box_Function[i_index].i_parent &&
+             p_box->p_father &&
+             p_box->p_father->i_type != MP4_Box_Function[i_index].i_parent )
+            continue;
+
+        if( ( MP4_Box_Function[i_index].i_type == p_box->i_type )||
+            ( MP4_Box_Function[i_index].i_type == 0 ) )
+        {
+            break;
+        }
+    }
+    return i_index;
+}
+
+/* sample tables, the bulk of a long recording's moov */
+static bool MP4_BoxIsLazy( const MP4_Box_t *p_box )
+{
+    if( !p_box->p_father || p_box->p_father->i_type != ATOM_stbl )
+        return false;
+
+    switch( p_box->i_type )
+    {
+    case ATOM_stts:
+    case ATOM_ctts:
+    case ATOM_stsz:
+    case ATOM_stsc:
+    case ATOM_stco:
+    case ATOM_co64:
+    case ATOM_stss:
+    case ATOM_sdtp:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/*****************************************************************************
+ * MP4_BoxLoad : parse the payload of a box skipped by MP4_ReadBox
+ *****************************************************************************/
+static void MP4_BoxLoad( MP4_Box_t *p_box )
+{
+    stream_t *p_stream = p_box->p_lazy;
+    const unsigned int i_index = MP4_BoxFunctionIndex( p_box );
+    int64_t i_tell;
+
+    if( !p_stream )
+        return;
+    p_box->p_lazy = NULL;
+
+    i_tell = stream_Tell( p_stream );
+    if( stream_Seek( p_stream, p_box->i_pos ) ||
+        !(MP4_Box_Function[i_index].MP4_ReadBox_function)( p_stream, p_box ) )
+    {
+        msg_Warn( p_stream, "cannot load box %4.4s", (char*)&p_box->i_type );
+        if( p_box->data.p_payload )
+        {
+            MP4_Box_Function[i_index].MP4_FreeBox_function( p_box );
+            FREENULL( p_box->data.p_payload );
+        }
+    }
+    stream_Seek( p_stream, i_tell );
+}
+
 /*****************************************************************************
  * MP4_ReadBox : parse the actual box and the children
  *  XXX : Do not go to the next box
@@ -3600,21 +3670,16 @@ static MP4_Box_t *MP4_ReadBox( stream_t *p_stream, MP4_Box_t *p_father )
     }
     p_box->p_father = p_father;
 
-    /* Now search function to call */
-    for( i_index = 0; ; i_index++ )
+    if( stream_IsMapped( p_stream ) && MP4_BoxIsLazy( p_box ) )
     {
-        if ( MP4_Box_Function[i_index].i_parent &&
-             p_box->p_father &&
-             p_box->p_father->i_type != MP4_Box_Function[i_index].i_parent )
-            continue;
-
-        if( ( MP4_Box_Function[i_index].i_type == p_box->i_type )||
-            ( MP4_Box_Function[i_index].i_type == 0 ) )
-        {
-            break;
-        }
+        /* left in the mapping until MP4_BoxGet reaches it */
+        p_box->p_lazy = p_stream;
+        return p_box;
     }
 
+    /* Now search function to call */
+    i_index = MP4_BoxFunctionIndex( p_box );
+
     if( !(MP4_Box_Function[i_index].MP4_ReadBox_function)( p_stream, p_box ) )
     {
         MP4_BoxFree( p_stream, p_box );
@@ -3648,19 +3713,7 @@ void MP4_BoxFree( stream_t *s, MP4_Box_t *p_box )
     /* Now search function to call */
     if( p_box->data.p_payload )
     {
-        for( i_index = 0; ; i_index++ )
-        {
-            if ( MP4_Box_Function[i_index].i_parent &&
-                 p_box->p_father &&
-                 p_box->p_father->i_type != MP4_Box_Function[i_index].i_parent )
-                continue;
-
-            if( ( MP4_Box_Function[i_index].i_type == p_box->i_type )||
-                ( MP4_Box_Function[i_index].i_type == 0 ) )
-            {
-                break;
-            }
-        }
+        i_index = MP4_BoxFunctionIndex( p_box );
         if( MP4_Box_Function[i_index].MP4_FreeBox_function == NULL )
         {
             /* Should not happen */
@@ -3787,6 +3840,7 @@ MP4_Box_t *MP4_BoxGetRoot( stream_t *s )
     p_root->p_first     = NULL;
     p_root->p_last      = NULL;
     p_root->p_next      = NULL;
+    p_root->p_lazy      = NULL;
 
     p_stream = s;
 
@@ -3978,6 +4032,7 @@ static void MP4_BoxGet_Internal( MP4_Box_t **pp_result,
         if( !psz_token )
         {
             free( psz_dup );
+            MP4_BoxLoad( p_box );
             *pp_result = p_box;
             return;
         }
@@ -1306,6 +1306,8 @@ typedef struct MP4_Box_s
 
     struct MP4_Box_s *p_next;   /* pointer on the next boxes at the same level */
 
+    stream_t *p_lazy;   /* set while the payload is not parsed yet */
+
 } MP4_Box_t;
 
 static inline size_t mp4_box_headersize( MP4_Box_t *p_box )
@@ -1351,15 +1353,24 @@ static inline size_t mp4_box_headersize( MP4_Box_t *p_box )
         p_str = NULL; \
     }
 
+/* a mapped stream is parsed in place, p_buff stays NULL */
 #define MP4_READBOX_ENTER( MP4_Box_data_TYPE_t ) \
     int64_t  i_read = p_box->i_size; \
-    uint8_t *p_peek, *p_buff; \
+    uint8_t *p_peek, *p_buff = NULL; \
     int i_actually_read; \
-    if( !( p_peek = p_buff = (uint8_t *)malloc( i_read ) ) ) \
+    if( stream_IsMapped( p_stream ) ) \
     { \
-        return( 0 ); \
+        i_actually_read = stream_Peek( p_stream, (const uint8_t **)&p_peek, i_read ); \
+        stream_Read( p_stream, NULL, i_actually_read ); \
+    } \
+    else \
+    { \
+        if( !( p_peek = p_buff = (uint8_t *)malloc( i_read ) ) ) \
+        { \
+            return( 0 ); \
+        } \
+        i_actually_read = stream_Read( p_stream, p_peek, i_read ); \
     } \
-    i_actually_read = stream_Read( p_stream, p_peek, i_read ); \
     if( i_actually_read < 0 || (int64_t)i_actually_read < i_read )\
     { \
         msg_Warn( p_stream, "MP4_READBOX_ENTER: I got %i bytes, "\
@@ -1473,6 +1484,9 @@ void MP4_BoxDumpStructure( stream_t *p_input, MP4_Box_t *p_box );
  *
  * ex: /moov/trak[12]
  *     ../mdia
+ *
+ * Sample tables of a mapped stream are parsed here on first access, so
+ * the stream must still be open and not shared with another thread
  *****************************************************************************/
 MP4_Box_t *MP4_BoxGet( MP4_Box_t *p_box, const char *psz_fmt, ... );
 
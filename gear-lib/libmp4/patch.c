@@ -24,6 +24,9 @@
 #include <malloc.h>
 #include <memory.h>
 #include <assert.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "patch.h"
 
 bool decodeQtLanguageCode( uint16_t i_language_code, char *psz_iso,
@@ -121,62 +124,118 @@ void msg_log(int log_lvl, const char *fmt, ...)
 
 int stream_Read(stream_t *s, void* buf, int size)
 {
-    return fread(buf, 1, size, s->fp);
+    uint64_t left;
+    if (size <= 0) {
+        return 0;
+    }
+    if (!s->map) {
+        return fread(buf, 1, size, s->fp);
+    }
+    left = s->pos < s->size ? s->size - s->pos : 0;
+    if ((uint64_t)size > left) {
+        size = (int)left;
+    }
+    if (buf) {
+        memcpy(buf, s->map + s->pos, size);
+    }
+    s->pos += size;
+    return size;
 }
 
 uint64_t stream_Seek(stream_t *s, int64_t offset)
 {
-    return fseek(s->fp, offset, SEEK_SET);
+    if (!s->map) {
+        return fseeko(s->fp, offset, SEEK_SET);
+    }
+    if (offset < 0) {
+        return -1;
+    }
+    s->pos = offset;
+    return 0;
 }
 
 int64_t stream_Tell(stream_t *s)
 {
-    return ftell(s->fp);
+    if (!s->map) {
+        return ftello(s->fp);
+    }
+    return s->pos;
 }
 
 int stream_Peek(stream_t *s, const uint8_t **buf, int size)
 {
-    uint32_t offset = stream_Tell(s);
-    *buf = (uint8_t *)calloc(1, size);
-    s->priv_buf_num++;
-    s->priv_buf = (void **)realloc(s->priv_buf, s->priv_buf_num * sizeof(uint8_t*));
-    s->priv_buf[s->priv_buf_num-1] = (void *)*buf;
-    int ret = stream_Read(s, (void *)*buf, size);
+    int64_t offset;
+    int ret;
+    if (s->map) {
+        uint64_t left = s->pos < s->size ? s->size - s->pos : 0;
+        *buf = s->map + s->pos;
+        return (uint64_t)size > left ? (int)left : size;
+    }
+    if (size > s->peek_size) {
+        uint8_t *p = (uint8_t *)realloc(s->peek_buf, size);
+        if (!p) {
+            return -1;
+        }
+        s->peek_buf = p;
+        s->peek_size = size;
+    }
+    offset = stream_Tell(s);
+    ret = stream_Read(s, s->peek_buf, size);
     stream_Seek(s, offset);
+    *buf = s->peek_buf;
     return ret;
 }
 
 int64_t stream_Size(stream_t *s)
 {
-    long size;
-    long tmp = ftell(s->fp);
-    fseek(s->fp, 0L, SEEK_END);
-    size = ftell(s->fp);
-    fseek(s->fp, tmp, SEEK_SET);
-    return (int64_t)size;
+    return (int64_t)s->size;
+}
+
+int stream_ReadAt(stream_t *s, uint64_t offset, void *buf, size_t size)
+{
+    if (offset >= s->size || size > s->size - offset) {
+        return -1;
+    }
+    if (s->map) {
+        memcpy(buf, s->map + offset, size);
+        return (int)size;
+    }
+    return (int)pread(fileno(s->fp), buf, size, offset);
 }
 
 stream_t* create_file_stream(const char *filename)
 {
+    struct stat st;
+    void *map;
+    memset(&st, 0, sizeof(st));
     stream_t* s = (stream_t*)calloc(1, sizeof(stream_t));
-    s->priv_buf_num = 0;
-    s->priv_buf = (void **)calloc(1, sizeof(uint32_t));
+    if (!s) {
+        return NULL;
+    }
     s->fp = fopen(filename, "rb");
     if (!s->fp) {
         printf("fopen %s failed!\n", filename);
         free(s);
         return NULL;
     }
+    if (fstat(fileno(s->fp), &st) == 0) {
+        s->size = st.st_size;
+    }
+    if (S_ISREG(st.st_mode) && s->size > 0) {
+        map = mmap(NULL, s->size, PROT_READ, MAP_SHARED, fileno(s->fp), 0);
+        if (map != MAP_FAILED) {
+            s->map = (const uint8_t *)map;
+        }
+    }
     return s;
 }
 
 void destory_file_stream(stream_t* s)
 {
-    int i;
-    fclose(s->fp);
-    for (i = 0; i < s->priv_buf_num; i++) {
-        free(s->priv_buf[i]);
+    if (s->map) {
+        munmap((void *)s->map, s->size);
     }
-    free(s->priv_buf);
+    fclose(s->fp);
+    free(s->peek_buf);
     free(s);
 }
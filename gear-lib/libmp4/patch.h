@@ -190,13 +190,21 @@ static inline uint64_t U64_AT (const void *p)
 #define MODE_CREATE           (8)
 
 
+/*
+ * the file is mmap'ed whenever possible, peek then returns a pointer into
+ * the mapping and read is a memcpy. Otherwise fall back to stdio, peek
+ * reuses one buffer, so a peeked pointer is valid until the next call
+ */
 typedef struct stream {
     FILE *fp;
-    void **priv_buf;//store peek malloc buffer
-    int priv_buf_num;
+    const uint8_t *map;
+    uint64_t size;
+    uint64_t pos;
+    uint8_t *peek_buf;
+    int peek_size;
 } stream_t;
 
-stream_t* create_file_stream();
+stream_t* create_file_stream(const char *filename);
 void destory_file_stream(stream_t* stream_s);
 
 int stream_Read(stream_t *stream_s, void* buf, int size);
@@ -204,6 +212,12 @@ int stream_Peek(stream_t *stream_s, const uint8_t **buf, int size);
 uint64_t stream_Seek(stream_t *stream_s, int64_t offset);
 int64_t stream_Tell(stream_t *stream_s);
 int64_t stream_Size(stream_t *stream_s);
+int stream_ReadAt(stream_t *stream_s, uint64_t offset, void *buf, size_t size);
+
+static inline bool stream_IsMapped(stream_t *s)
+{
+    return s->map != NULL;
+}
 
 bool decodeQtLanguageCode( uint16_t i_language_code, char *psz_iso,
                                   bool *b_mactables );
@@ -22,8 +22,451 @@
 #include "libmp4.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_FRAMES    3000
+#define BENCH_GOP       60
+#define BENCH_FRAME_LEN (32 * 1024)
+
+static const uint8_t sps_pps[] = {
+    0x00, 0x00, 0x00, 0x01, 0x67, 0x64, 0x00, 0x1f, 0xac, 0xd9, 0x40, 0x50,
+    0x05, 0xbb, 0x01, 0x10, 0x00, 0x00, 0x03, 0x00, 0x10, 0x00, 0x00, 0x03,
+    0x03, 0xc0, 0xf1, 0x83, 0x19, 0x60,
+    0x00, 0x00, 0x00, 0x01, 0x68, 0xeb, 0xe3, 0xcb, 0x22, 0xc0,
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* fake 1280x720 30fps stream: SPS/PPS + IDR every gop frames, P otherwise */
+static struct media_packet *bench_frame(struct media_packet *mp, int i, int gop)
+{
+    struct video_packet *vp = mp->video;
+    size_t off = 0;
+
+    if (i % gop == 0) {
+        memcpy(vp->data, sps_pps, sizeof(sps_pps));
+        off = sizeof(sps_pps);
+    }
+    memcpy(vp->data + off, (i % gop == 0) ? "\x00\x00\x00\x01\x65" : "\x00\x00\x00\x01\x41", 5);
+    vp->size = BENCH_FRAME_LEN;
+    vp->type = (i % gop == 0) ? H26X_FRAME_IDR : H26X_FRAME_P;
+    vp->key_frame = (i % gop == 0);
+    vp->pts = vp->dts = i;
+    return mp;
+}
+
+static struct media_packet *bench_packet(void)
+{
+    struct media_packet *mp;
+    uint8_t *buf = malloc(BENCH_FRAME_LEN);
+    int i;
+
+    for (i = 0; i < BENCH_FRAME_LEN; i++) {
+        buf[i] = (i * 7 + 1) | 0x80; /* no start code emulation */
+    }
+    mp = media_packet_create(MEDIA_TYPE_VIDEO, MEDIA_MEM_DEEP, buf, BENCH_FRAME_LEN);
+    free(buf);
+    mp->video->encoder.type = VIDEO_CODEC_H264;
+    mp->video->encoder.width = 1280;
+    mp->video->encoder.height = 720;
+    mp->video->encoder.timebase = (rational_t){1, 30};
+    mp->video->encoder.framerate = (rational_t){30, 1};
+    return mp;
+}
+
+static void bench_report(const char *name, uint64_t t)
+{
+    double sec = t / 1e9;
+    printf("%-8s %d frames in %.3fs: %.0f fps, %.1f MB/s\n", name, BENCH_FRAMES, sec,
+           BENCH_FRAMES / sec, (double)BENCH_FRAMES * BENCH_FRAME_LEN / (1024 * 1024) / sec);
+}
+
+/*
+ * parse fmp4 output back: box sizes add up, every trun points into the
+ * mdat right after its moof and covers it exactly, mfhd sequence numbers
+ * and per track tfdt are continuous
+ */
+struct fmp4_check {
+    int      fragments;
+    uint32_t seq;
+    int      samples[3];        /* by track id */
+    int      sync[3];
+    uint64_t next_dts[3];
+    uint32_t timescale[3];      /* mdhd */
+    uint32_t mp4a_rate;         /* mp4a samplerate, 16.16 */
+    size_t   free_bytes;
+};
+
+static uint32_t rb32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static uint64_t rb64(const uint8_t *p)
+{
+    return ((uint64_t)rb32(p) << 32) | rb32(p + 4);
+}
+
+#define CHECK(cond) do { if (!(cond)) { \
+        printf("%s:%d: check '%s' failed\n", __func__, __LINE__, #cond); return -1; } } while (0)
+
+static int check_traf(const uint8_t *traf, size_t len, size_t *payload, struct fmp4_check *c)
+{
+    const uint8_t *p = traf + 8, *end = traf + len;
+    uint32_t id = 0, flags = 0, n = 0, i;
+    uint64_t base = 0, duration = 0;
+    int32_t data_offset;
+    const uint8_t *e;
+
+    while (p + 8 <= end) {
+        uint32_t size = rb32(p);
+        CHECK(size >= 8 && p + size <= end);
+        if (!memcmp(p + 4, "tfhd", 4)) {
+            id = rb32(p + 12);
+            CHECK(id == 1 || id == 2);
+        } else if (!memcmp(p + 4, "tfdt", 4)) {
+            CHECK(p[8] == 1);
+            base = rb64(p + 12);
+        } else if (!memcmp(p + 4, "trun", 4)) {
+            flags = rb32(p + 8) & 0xffffff;
+            n = rb32(p + 12);
+            CHECK(flags & 0x000001);
+            data_offset = (int32_t)rb32(p + 16);
+            CHECK(data_offset >= 0 && (size_t)data_offset == *payload);
+            e = p + 20;
+            for (i = 0; i < n; i++) {
+                duration += rb32(e);
+                *payload += rb32(e + 4);
+                if (flags & 0x000400) {
+                    c->sync[id] += (rb32(e + 8) & 0x01010000) == 0;
+                }
+                e += 8 + ((flags & 0x000400) ? 4 : 0) + ((flags & 0x000800) ? 4 : 0);
+            }
+            CHECK(e == p + size);
+        }
+        p += size;
+    }
+    CHECK(id && n > 0);
+    CHECK(c->samples[id] == 0 || base == c->next_dts[id]);
+    c->next_dts[id] = base + duration;
+    c->samples[id] += n;
+    return 0;
+}
+
+/* first child box of type in [p, end), NULL if none */
+static const uint8_t *find_box(const uint8_t *p, const uint8_t *end, const char *type)
+{
+    while (p + 8 <= end && rb32(p) >= 8 && p + rb32(p) <= end) {
+        if (!memcmp(p + 4, type, 4)) {
+            return p;
+        }
+        p += rb32(p);
+    }
+    return NULL;
+}
+
+static int check_moov(const uint8_t *moov, size_t len, struct fmp4_check *c)
+{
+    const uint8_t *p, *end = moov + len, *box, *mdia, *mdhd;
+    uint32_t id;
+
+    for (p = moov + 8; (box = find_box(p, end, "trak")) != NULL; p = box + rb32(box)) {
+        const uint8_t *tend = box + rb32(box);
+        const uint8_t *tkhd = find_box(box + 8, tend, "tkhd");
+        CHECK(tkhd);
+        id = rb32(tkhd + (tkhd[8] == 1 ? 28 : 20));
+        CHECK(id == 1 || id == 2);
+        mdia = find_box(box + 8, tend, "mdia");
+        CHECK(mdia);
+        mdhd = find_box(mdia + 8, mdia + rb32(mdia), "mdhd");
+        CHECK(mdhd);
+        c->timescale[id] = rb32(mdhd + (mdhd[8] == 1 ? 28 : 20));
+    }
+    for (p = moov; p + 36 <= end; p++) {
+        if (!memcmp(p + 4, "mp4a", 4)) {
+            c->mp4a_rate = rb32(p + 32);
+            break;
+        }
+    }
+    return 0;
+}
+
+static int check_fmp4(const uint8_t *buf, size_t len, struct fmp4_check *c)
+{
+    const uint8_t *p = buf, *end = buf + len, *q;
+    size_t payload;
+
+    memset(c, 0, sizeof(*c));
+    CHECK(len >= 8 && !memcmp(buf + 4, "ftyp", 4));
+    while (p < end) {
+        uint32_t size = rb32(p);
+        CHECK(size >= 8 && p + size <= end);
+        if (!memcmp(p + 4, "free", 4)) {
+            c->free_bytes += size;
+        } else if (!memcmp(p + 4, "moov", 4)) {
+            if (check_moov(p, size, c) < 0) {
+                return -1;
+            }
+        } else if (!memcmp(p + 4, "moof", 4)) {
+            payload = size + 8;
+            for (q = p + 8; q < p + size; q += rb32(q)) {
+                CHECK(rb32(q) >= 8);
+                if (!memcmp(q + 4, "mfhd", 4)) {
+                    CHECK(rb32(q + 12) == ++c->seq);
+                } else if (!memcmp(q + 4, "traf", 4)) {
+                    if (check_traf(q, rb32(q), &payload, c) < 0) {
+                        return -1;
+                    }
+                }
+            }
+            CHECK(p + size + 8 <= end && !memcmp(p + size + 4, "mdat", 4));
+            CHECK(rb32(p + size) == payload - size);
+            c->fragments++;
+        }
+        p += size;
+    }
+    CHECK(p == end);
+    return 0;
+}
+
+static int check_fmp4_file(const char *file, struct fmp4_check *c)
+{
+    FILE *fp = fopen(file, "rb");
+    uint8_t *buf;
+    long len;
+    int ret = -1;
+
+    if (!fp) {
+        return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    buf = malloc(len);
+    if (buf && fread(buf, 1, len, fp) == (size_t)len) {
+        ret = check_fmp4(buf, len, c);
+    }
+    free(buf);
+    fclose(fp);
+    return ret;
+}
+
+static int foo_fmp4(const char *file)
+{
+    struct fmp4_config conf = {.fragment_ms = 0, .crash_safe = false};
+    struct media_packet *mp = bench_packet();
+    struct fmp4_muxer *m;
+    struct fmp4_check c;
+    uint64_t t;
+    int i;
+
+    t = now_ns();
+    m = fmp4_muxer_open(file, &conf);
+    if (!m) {
+        return -1;
+    }
+    fmp4_muxer_add_media(m, mp);
+    for (i = 0; i < BENCH_FRAMES; i++) {
+        fmp4_muxer_write(m, bench_frame(mp, i, BENCH_GOP));
+    }
+    fmp4_muxer_close(m);
+    bench_report("fmp4", now_ns() - t);
+    media_packet_destroy(mp);
+
+    CHECK(check_fmp4_file(file, &c) == 0);
+    CHECK(c.samples[1] == BENCH_FRAMES);
+    CHECK(c.sync[1] == BENCH_FRAMES / BENCH_GOP);
+    CHECK(c.fragments == BENCH_FRAMES / BENCH_GOP);
+    /* the moof hole is sized for the stream, not for the worst case */
+    CHECK(c.free_bytes / c.fragments < 1024);
+    printf("fmp4 check ok: %d fragments, %zu free bytes\n", c.fragments, c.free_bytes);
+    return 0;
+}
+
+#define AV_FRAMES       1800        /* 60s of video */
+#define AV_GOP          900         /* 30s GOP, more than 1024 AAC frames */
+#define AV_RATE         48000
+
+struct av_sink {
+    uint8_t *buf;
+    size_t   len;
+    int      media;
+    int      independent;
+};
+
+static int av_sink_cb(void *ctx, const struct fmp4_segment *seg)
+{
+    struct av_sink *sink = (struct av_sink *)ctx;
+    size_t size = 0;
+    int i;
+
+    for (i = 0; i < seg->iovcnt; i++) {
+        size += seg->iov[i].iov_len;
+    }
+    if (size != seg->size) {
+        return -1;
+    }
+    sink->buf = realloc(sink->buf, sink->len + size);
+    for (i = 0; i < seg->iovcnt; i++) {
+        memcpy(sink->buf + sink->len, seg->iov[i].iov_base, seg->iov[i].iov_len);
+        sink->len += seg->iov[i].iov_len;
+    }
+    if (seg->type == FMP4_SEGMENT_MEDIA) {
+        sink->media++;
+        sink->independent += seg->independent;
+    }
+    return 0;
+}
+
+/* video + AAC with a long GOP, no sample may be dropped in either mode */
+static int foo_fmp4_av(const char *file)
+{
+    struct fmp4_config conf = {.fragment_ms = 0, .crash_safe = false};
+    struct media_packet *vp = bench_packet();
+    struct media_packet *ap;
+    struct av_sink sink = {NULL, 0, 0, 0};
+    struct fmp4_check c;
+    struct fmp4_muxer *m;
+    uint8_t aac[256];
+    uint64_t adts = 0;
+    int i, mode, naudio = 0;
+
+    memset(aac, 0x5a, sizeof(aac));
+    ap = media_packet_create(MEDIA_TYPE_AUDIO, MEDIA_MEM_DEEP, aac, sizeof(aac));
+    ap->audio->encoder.format = AUDIO_CODEC_AAC;
+    ap->audio->encoder.sample_rate = AV_RATE;
+    ap->audio->encoder.channels = 2;
+    ap->audio->encoder.timebase = (rational_t){1, AV_RATE};
+
+    for (mode = 0; mode < 2; mode++) {
+        m = mode ? fmp4_muxer_create(&conf, av_sink_cb, &sink) : fmp4_muxer_open(file, &conf);
+        CHECK(m);
+        CHECK(fmp4_muxer_add_media(m, vp) == 0);
+        CHECK(fmp4_muxer_add_media(m, ap) == 0);
+        adts = 0;
+        naudio = 0;
+        for (i = 0; i < AV_FRAMES; i++) {
+            CHECK(fmp4_muxer_write(m, bench_frame(vp, i, AV_GOP)) == 0);
+            /* AAC frames up to the end of this video frame */
+            while (adts * 30 < (uint64_t)(i + 1) * AV_RATE) {
+                ap->audio->dts = ap->audio->pts = adts;
+                CHECK(fmp4_muxer_write(m, ap) == 0);
+                adts += 1024;
+                naudio++;
+            }
+        }
+        fmp4_muxer_close(m);
+        if (mode) {
+            CHECK(check_fmp4(sink.buf, sink.len, &c) == 0);
+            CHECK(sink.independent == AV_FRAMES / AV_GOP);
+            CHECK(sink.media == c.fragments);
+        } else {
+            CHECK(check_fmp4_file(file, &c) == 0);
+        }
+        CHECK(c.samples[1] == AV_FRAMES);
+        CHECK(c.sync[1] == AV_FRAMES / AV_GOP);
+        CHECK(c.samples[2] == naudio);
+        printf("fmp4 %s av check ok: %d video, %d audio in %d fragments, %zu free bytes\n",
+               mode ? "callback" : "file", c.samples[1], c.samples[2], c.fragments, c.free_bytes);
+    }
+    free(sink.buf);
+    media_packet_destroy(ap);
+    media_packet_destroy(vp);
+    return 0;
+}
+
+/*
+ * NTSC 1001/30000 video timebase and 96k audio: dts are scaled by the
+ * timebase num, the 16.16 mp4a rate can't hold 96000
+ */
+static int foo_fmp4_timebase(const char *file)
+{
+    struct fmp4_config conf = {.fragment_ms = 0, .crash_safe = false};
+    struct media_packet *vp = bench_packet();
+    struct media_packet *ap;
+    struct fmp4_check c;
+    struct fmp4_muxer *m;
+    uint8_t aac[64];
+    int i, frames = 2 * BENCH_GOP;
+
+    memset(aac, 0x5a, sizeof(aac));
+    ap = media_packet_create(MEDIA_TYPE_AUDIO, MEDIA_MEM_DEEP, aac, sizeof(aac));
+    ap->audio->encoder.format = AUDIO_CODEC_AAC;
+    ap->audio->encoder.sample_rate = 96000;
+    ap->audio->encoder.channels = 2;
+    ap->audio->encoder.timebase = (rational_t){1, 96000};
+    vp->video->encoder.timebase = (rational_t){1001, 30000};
+
+    m = fmp4_muxer_open(file, &conf);
+    CHECK(m);
+    CHECK(fmp4_muxer_add_media(m, vp) == 0);
+    CHECK(fmp4_muxer_add_media(m, ap) == 0);
+    for (i = 0; i < frames; i++) {
+        CHECK(fmp4_muxer_write(m, bench_frame(vp, i, BENCH_GOP)) == 0);
+        /* 96000 * 1001 / 30000 = 3203.2 samples per frame, about 3 AAC frames */
+        ap->audio->dts = ap->audio->pts = (uint64_t)i * 3 * 1024;
+        CHECK(fmp4_muxer_write(m, ap) == 0);
+    }
+    fmp4_muxer_close(m);
+    media_packet_destroy(ap);
+    media_packet_destroy(vp);
+
+    CHECK(check_fmp4_file(file, &c) == 0);
+    CHECK(c.timescale[1] == 30000);
+    CHECK(c.timescale[2] == 96000);
+    CHECK(c.mp4a_rate == 0);
+    CHECK(c.samples[1] == frames);
+    /* every sample lasts 1001 ticks of 1/30000 */
+    CHECK(c.next_dts[1] == (uint64_t)frames * 1001);
+    printf("fmp4 timebase check ok: %d frames, %llu/%u s\n",
+           c.samples[1], (unsigned long long)c.next_dts[1], c.timescale[1]);
+    return 0;
+}
+
+#if defined(ENABLE_FFMPEG)
+static int foo_mp4(const char *file)
+{
+    struct mp4_config conf = {.width = 1280, .height = 720, .fps = {30, 1}};
+    struct media_packet *mp = bench_packet();
+    struct mp4_muxer *m;
+    uint64_t t;
+    int i;
+
+    t = now_ns();
+    m = mp4_muxer_open(file, &conf);
+    if (!m) {
+        return -1;
+    }
+    for (i = 0; i < BENCH_FRAMES; i++) {
+        bench_frame(mp, i, BENCH_GOP)->video->pts *= 1000 / 30; /* mp4_muxer takes ms */
+        mp4_muxer_write(m, mp);
+    }
+    mp4_muxer_close(m);
+    bench_report("ffmpeg", now_ns() - t);
+    media_packet_destroy(mp);
+    return 0;
+}
+#endif
 
 int main(int argc, char **argv)
 {
+    if (foo_fmp4("test_fmp4.mp4") < 0) {
+        return -1;
+    }
+    if (foo_fmp4_av("test_fmp4_av.mp4") < 0) {
+        return -1;
+    }
+    if (foo_fmp4_timebase("test_fmp4_tb.mp4") < 0) {
+        return -1;
+    }
+#if defined(ENABLE_FFMPEG)
+    foo_mp4("test_mp4.mp4");
+#endif
     return 0;
 }
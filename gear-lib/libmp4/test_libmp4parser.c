@@ -21,9 +21,49 @@
  ******************************************************************************/
 #include "libmp4.h"
 #include <stdio.h>
+#include <time.h>
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
 
+static uint64_t now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void foo_sample_index(struct mp4_parser *mp)
+{
+    const struct mp4_track *t;
+    struct mp4_sample s;
+    uint64_t start, dur_us, sum = 0;
+    int i, j, n, loop = 1000000;
+
+    for (i = 0; i < mp4_get_track_count(mp); i++) {
+        start = now_us();
+        t = mp4_get_track(mp, i);
+        if (!t || !t->sample_count || !t->timescale) {
+            continue;
+        }
+        printf("track %u %.4s: %u samples, %u sync, timescale %u, index %" PRIu64 "us\n",
+               t->id, (char *)&t->handler, t->sample_count, t->sync_count,
+               t->timescale, now_us() - start);
+        mp4_track_get_sample(t, 0, &s);
+        printf("  sample[0] offset %" PRIu64 " size %u pts %" PRIu64 " key %d data %p\n",
+               s.offset, s.size, s.pts, s.keyframe, mp4_sample_data(mp, &s));
+
+        dur_us = t->duration * 1000000 / t->timescale;
+        start = now_us();
+        for (j = 0; j < loop; j++) {
+            n = mp4_track_seek(t, (uint64_t)j * 7919 % (dur_us + 1), true);
+            mp4_track_get_sample(t, n, &s);
+            sum += s.size;
+        }
+        printf("  seek+sample: %.1f ns/op (%" PRIu64 ")\n",
+               (now_us() - start) * 1000.0 / loop, sum);
+    }
+}
+
 int main(int argc, char* argv[])
 {
     if (argc < 2) {
@@ -37,6 +77,7 @@ int main(int argc, char* argv[])
     printf("duration = %" PRIu64 "\n", duration);
     mp4_get_resolution(mp, &w, &h);
     printf("resolution = %dx%d\n", (int)w, (int)h);
+    foo_sample_index(mp);
     mp4_parser_destroy(mp);
     return 0;
 }
@@ -0,0 +1,125 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#ifndef LIBMQTTC_ASYNC_H
+#define LIBMQTTC_ASYNC_H
+
+#include <libposix.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/uio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * non-blocking MQTT 3.1.1 client on libgevent, one event loop thread.
+ *
+ * publishes don't wait for their ack: up to max_inflight QoS1/2 messages
+ * are on the wire, each completed by its callback when acked and resent
+ * with DUP when no ack came within retry_ms. everything queued between two
+ * loop wakeups goes out in one sendmsg. incoming messages are dispatched
+ * through a topic filter trie.
+ */
+
+struct mqtt_async;
+
+struct mqtt_async_conf {
+    const char *client_id;
+    const char *username;
+    const char *password;
+    uint16_t keepalive;         /* seconds, 0 no ping */
+    int clean_session;
+    int max_inflight;           /* QoS1/2 publishes waiting for ack, <= 65535 */
+    int retry_ms;               /* resend an unacked publish after */
+    size_t max_queued;          /* bytes not written yet, publish fails or blocks above */
+    int block;                  /* publish waits until half of it is written */
+    int timeout_ms;             /* connect and close */
+};
+
+#define mqtt_async_conf_initializer \
+    { "gear-lib", NULL, NULL, 60, 1, 64, 5000, 4 * 1024 * 1024, 1, 3000 }
+
+/*
+ * rc 0 acked (or written for QoS0), -1 dropped by disconnect.
+ * for mqtt_async_publishv the payload may be released from here.
+ */
+typedef void (*mqtt_async_done_cb)(void *arg, uint16_t id, int rc);
+
+/* called from the loop thread, topic is not nul terminated */
+typedef void (*mqtt_async_msg_cb)(void *arg, const char *topic, size_t topic_len,
+                const void *payload, size_t len, int qos, int retained);
+
+/* granted qos, or 0x80 on failure */
+typedef void (*mqtt_async_sub_cb)(void *arg, const char *filter, int granted);
+
+GEAR_API struct mqtt_async *mqtt_async_create(const char *host, uint16_t port,
+                const struct mqtt_async_conf *conf);
+GEAR_API void mqtt_async_destroy(struct mqtt_async *c);
+
+/* connect and wait for CONNACK, return the connack code or -1 */
+GEAR_API int mqtt_async_connect(struct mqtt_async *c);
+/* wait until everything queued is written and acked, then DISCONNECT */
+GEAR_API int mqtt_async_disconnect(struct mqtt_async *c);
+
+/*
+ * the payload is copied. return 0 once queued, -1 when not connected or
+ * out of room (conf.block 0). the packet id is given to cb, it's assigned
+ * when the message enters the window.
+ */
+GEAR_API int mqtt_async_publish(struct mqtt_async *c, const char *topic,
+                const void *payload, size_t len, int qos, int retain,
+                mqtt_async_done_cb cb, void *arg);
+
+/*
+ * zero copy: the iovecs are written as they are, the memory they point to
+ * must stay valid until cb is called
+ */
+GEAR_API int mqtt_async_publishv(struct mqtt_async *c, const char *topic,
+                const struct iovec *iov, int iovcnt, int qos, int retain,
+                mqtt_async_done_cb cb, void *arg);
+
+GEAR_API int mqtt_async_subscribe(struct mqtt_async *c, const char *filter, int qos,
+                mqtt_async_msg_cb msg_cb, void *msg_arg,
+                mqtt_async_sub_cb sub_cb, void *sub_arg);
+GEAR_API int mqtt_async_unsubscribe(struct mqtt_async *c, const char *filter);
+
+/* wait until nothing is queued or in flight, 0 done, -1 timeout */
+GEAR_API int mqtt_async_flush(struct mqtt_async *c, int timeout_ms);
+
+struct mqtt_async_stat {
+    uint64_t published;
+    uint64_t acked;
+    uint64_t retransmits;
+    uint64_t received;
+    uint64_t writes;            /* sendmsg calls */
+    uint64_t bytes_out;
+    int inflight;
+    size_t queued;
+};
+
+GEAR_API void mqtt_async_get_stat(struct mqtt_async *c, struct mqtt_async_stat *st);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
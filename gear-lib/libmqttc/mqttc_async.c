@@ -0,0 +1,1284 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#define _GNU_SOURCE
+#include "libmqttc_async.h"
+#include "mqttc_trie.h"
+#include <libgevent.h>
+#include <libthread.h>
+#include <libsock.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define MQ_CONNECT      0x10
+#define MQ_CONNACK      0x20
+#define MQ_PUBLISH      0x30
+#define MQ_PUBACK       0x40
+#define MQ_PUBREC       0x50
+#define MQ_PUBREL       0x62
+#define MQ_PUBCOMP      0x70
+#define MQ_SUBSCRIBE    0x82
+#define MQ_SUBACK       0x90
+#define MQ_UNSUBSCRIBE  0xa2
+#define MQ_UNSUBACK     0xb0
+#define MQ_PINGREQ      0xc0
+#define MQ_PINGRESP     0xd0
+#define MQ_DISCONNECT   0xe0
+#define MQ_DUP          0x08
+
+#define MQ_IOV_MAX      64
+#define MQ_RECV_BUF     (16 * 1024)
+#define MQ_MAX_PACKET   (16 * 1024 * 1024)
+#define MQ_MATCH_MAX    32
+
+enum mq_state {
+    MQ_UNTRACKED = 0,
+    MQ_WAIT_ACK,                /* PUBACK, SUBACK or UNSUBACK */
+    MQ_WAIT_REC,
+    MQ_WAIT_COMP,
+};
+
+struct mq_pkt {
+    struct mq_pkt *next;        /* out queue or waiting list */
+    size_t len;
+    size_t off;                 /* bytes written */
+    struct iovec *iov;          /* iov[0] is the header */
+    int iovcnt;
+    uint16_t id;
+    uint16_t id_off;            /* packet id position in the header, 0 none */
+    uint8_t type;
+    uint8_t qos;
+    uint8_t state;
+    uint8_t queued;
+    uint8_t acked;              /* free once written */
+    uint64_t sent_ms;
+    mqtt_async_done_cb cb;
+    void *arg;
+    mqtt_async_sub_cb sub_cb;
+    void *sub_arg;
+    char *filter;
+    uint8_t head[];
+};
+
+/* callbacks collected under the lock, called without it */
+struct mq_done {
+    mqtt_async_done_cb cb;
+    mqtt_async_sub_cb sub_cb;
+    void *arg;
+    uint16_t id;
+    int rc;
+    char *filter;
+};
+
+struct mqtt_async {
+    char host[256];
+    uint16_t port;
+    struct mqtt_async_conf conf;
+    char *client_id;
+    char *username;
+    char *password;
+    int fd;
+    int wake_fd;
+    struct gevent_base *evbase;
+    struct gevent *ev_sock;
+    struct gevent *ev_wake;
+    struct gevent *ev_timer;
+    pthread_t loop_tid;
+    int loop_running;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int connack;                /* -1 until CONNACK */
+    int connected;
+    int broken;
+    int wake_pending;
+    /* out queue, written in order */
+    struct mq_pkt *out_head;
+    struct mq_pkt *out_tail;
+    size_t queued;              /* bytes in the out queue and the waiting list */
+    /* QoS1/2 publishes waiting for room in the window */
+    struct mq_pkt *wait_head;
+    struct mq_pkt *wait_tail;
+    /* packets waiting for their ack, open addressing by packet id */
+    struct mq_pkt **table;
+    int table_cap;
+    int inflight;               /* publishes in the table */
+    int tracked;                /* all packets in the table */
+    uint16_t next_id;
+    uint8_t qos2_rx[65536 / 8]; /* QoS2 ids received, not released yet */
+    struct mqtt_trie trie;
+    uint64_t last_sent;
+    uint64_t ping_sent;
+    int ping_out;
+    /* loop thread */
+    uint8_t *rbuf;
+    size_t rlen;
+    size_t rcap;
+    struct mq_done *dones;
+    int ndone;
+    int done_cap;
+    struct mqtt_async_stat stat;
+};
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int in_loop(struct mqtt_async *c)
+{
+    return c->loop_running && pthread_equal(pthread_self(), c->loop_tid);
+}
+
+static int remlen_encode(uint8_t *buf, size_t len)
+{
+    int n = 0;
+    do {
+        buf[n] = len % 128;
+        len /= 128;
+        if (len > 0) {
+            buf[n] |= 0x80;
+        }
+        n++;
+    } while (len > 0);
+    return n;
+}
+
+static uint8_t *put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v & 0xff;
+    return p + 2;
+}
+
+static uint8_t *put_str(uint8_t *p, const char *s, size_t len)
+{
+    p = put_u16(p, (uint16_t)len);
+    memcpy(p, s, len);
+    return p + len;
+}
+
+/* header of head_cap bytes, niov payload iovecs, copy bytes of payload space */
+static struct mq_pkt *pkt_alloc(size_t head_cap, int niov, size_t copy)
+{
+    struct mq_pkt *p;
+    size_t iov_off = (head_cap + 7) & ~(size_t)7;
+
+    p = calloc(1, sizeof(struct mq_pkt) + iov_off + (niov + 1) * sizeof(struct iovec) + copy);
+    if (!p) {
+        printf("malloc mq_pkt failed!\n");
+        return NULL;
+    }
+    p->iov = (struct iovec *)(p->head + iov_off);
+    p->iov[0].iov_base = p->head;
+    p->iovcnt = 1;
+    return p;
+}
+
+static struct mq_pkt *pkt_ctrl(uint8_t type, int id)
+{
+    struct mq_pkt *p = pkt_alloc(4, 0, 0);
+    if (!p) {
+        return NULL;
+    }
+    p->type = type;
+    p->head[0] = type;
+    if (id >= 0) {
+        p->head[1] = 2;
+        put_u16(p->head + 2, (uint16_t)id);
+        p->len = 4;
+    } else {
+        p->head[1] = 0;
+        p->len = 2;
+    }
+    p->iov[0].iov_len = p->len;
+    return p;
+}
+
+static void done_add(struct mqtt_async *c, struct mq_pkt *p, int rc, int granted)
+{
+    struct mq_done *d;
+
+    if (!p->cb && !p->sub_cb) {
+        return;
+    }
+    if (c->ndone == c->done_cap) {
+        d = realloc(c->dones, (c->done_cap ? c->done_cap * 2 : 64) * sizeof(struct mq_done));
+        if (!d) {
+            return;
+        }
+        c->dones = d;
+        c->done_cap = c->done_cap ? c->done_cap * 2 : 64;
+    }
+    d = &c->dones[c->ndone++];
+    memset(d, 0, sizeof(*d));
+    d->arg = p->cb ? p->arg : p->sub_arg;
+    d->id = p->id;
+    if (p->sub_cb) {
+        d->sub_cb = p->sub_cb;
+        d->filter = strdup(p->filter);
+        d->rc = rc < 0 ? 0x80 : granted;
+    } else {
+        d->cb = p->cb;
+        d->rc = rc;
+    }
+}
+
+/* loop thread, without the lock. dones are only added by the loop thread */
+static void done_run(struct mqtt_async *c)
+{
+    int i;
+
+    if (c->ndone == 0) {
+        return;
+    }
+    for (i = 0; i < c->ndone; i++) {
+        if (c->dones[i].sub_cb) {
+            c->dones[i].sub_cb(c->dones[i].arg, c->dones[i].filter, c->dones[i].rc);
+            free(c->dones[i].filter);
+        } else {
+            c->dones[i].cb(c->dones[i].arg, c->dones[i].id, c->dones[i].rc);
+        }
+    }
+    /* flush returns once the callbacks have run */
+    pthread_mutex_lock(&c->lock);
+    c->ndone = 0;
+    pthread_cond_broadcast(&c->cond);
+    pthread_mutex_unlock(&c->lock);
+}
+
+static void wake_loop(struct mqtt_async *c)
+{
+    uint64_t one = 1;
+    if (c->wake_pending || in_loop(c)) {
+        return;
+    }
+    c->wake_pending = 1;
+    if (write(c->wake_fd, &one, sizeof(one)) != sizeof(one) && errno != EAGAIN) {
+        printf("write wake fd failed: %s\n", strerror(errno));
+    }
+}
+
+static void out_push(struct mqtt_async *c, struct mq_pkt *p)
+{
+    p->next = NULL;
+    p->off = 0;
+    p->queued = 1;
+    if (c->out_tail) {
+        c->out_tail->next = p;
+    } else {
+        c->out_head = p;
+        wake_loop(c);
+    }
+    c->out_tail = p;
+    c->queued += p->len;
+}
+
+/******************************************************************************
+ * packet id table
+ ******************************************************************************/
+
+static struct mq_pkt **table_slot(struct mqtt_async *c, uint16_t id)
+{
+    uint32_t i, mask = c->table_cap - 1;
+    for (i = (id * 2654435761u) & mask;; i = (i + 1) & mask) {
+        if (!c->table[i] || c->table[i]->id == id) {
+            return &c->table[i];
+        }
+    }
+}
+
+static struct mq_pkt *table_find(struct mqtt_async *c, uint16_t id)
+{
+    return *table_slot(c, id);
+}
+
+static int table_add(struct mqtt_async *c, struct mq_pkt *p)
+{
+    struct mq_pkt **old = c->table, **slot;
+    int i, old_cap = c->table_cap;
+
+    if ((c->tracked + 1) * 2 > c->table_cap) {
+        c->table_cap = old_cap * 2;
+        c->table = calloc(c->table_cap, sizeof(struct mq_pkt *));
+        if (!c->table) {
+            c->table = old;
+            c->table_cap = old_cap;
+            return -1;
+        }
+        for (i = 0; i < old_cap; i++) {
+            if (old[i]) {
+                *table_slot(c, old[i]->id) = old[i];
+            }
+        }
+        free(old);
+    }
+    /* ids in use are skipped, the window is far below 65535 */
+    do {
+        c->next_id = c->next_id == 65535 ? 1 : c->next_id + 1;
+        slot = table_slot(c, c->next_id);
+    } while (*slot);
+    p->id = c->next_id;
+    *slot = p;
+    c->tracked++;
+    if (p->type == MQ_PUBLISH) {
+        c->inflight++;
+    }
+    if (p->id_off) {
+        put_u16(p->head + p->id_off, p->id);
+    }
+    return 0;
+}
+
+static void table_del(struct mqtt_async *c, struct mq_pkt *p)
+{
+    uint32_t i, j, k, mask = c->table_cap - 1;
+
+    i = (uint32_t)(table_slot(c, p->id) - c->table);
+    c->table[i] = NULL;
+    for (j = (i + 1) & mask; c->table[j]; j = (j + 1) & mask) {
+        k = (c->table[j]->id * 2654435761u) & mask;
+        if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j))) {
+            c->table[i] = c->table[j];
+            c->table[j] = NULL;
+            i = j;
+        }
+    }
+    c->tracked--;
+    if (p->type == MQ_PUBLISH) {
+        c->inflight--;
+    }
+}
+
+/* an acked packet still being rewritten is freed once written */
+static void pkt_complete(struct mqtt_async *c, struct mq_pkt *p, int rc, int granted)
+{
+    table_del(c, p);
+    if (rc == 0) {
+        c->stat.acked++;
+    }
+    done_add(c, p, rc, granted);
+    if (p->queued) {
+        p->acked = 1;
+    } else {
+        free(p);
+    }
+}
+
+/* move waiting publishes into the window */
+static void window_admit(struct mqtt_async *c)
+{
+    struct mq_pkt *p;
+
+    while (c->wait_head && c->inflight < c->conf.max_inflight) {
+        p = c->wait_head;
+        if (table_add(c, p) < 0) {
+            break;
+        }
+        c->wait_head = p->next;
+        if (!c->wait_head) {
+            c->wait_tail = NULL;
+        }
+        c->queued -= p->len;
+        p->state = p->qos == 1 ? MQ_WAIT_ACK : MQ_WAIT_REC;
+        out_push(c, p);
+    }
+}
+
+/******************************************************************************
+ * write
+ ******************************************************************************/
+
+static void conn_broken(struct mqtt_async *c);
+
+/* a packet is fully written */
+static void pkt_written(struct mqtt_async *c, struct mq_pkt *p, uint64_t now)
+{
+    p->queued = 0;
+    p->sent_ms = now;
+    if (p->acked) {
+        free(p);
+    } else if (p->state == MQ_UNTRACKED) {
+        if (p->type == MQ_PUBLISH) {
+            c->stat.acked++;
+            done_add(c, p, 0, 0);
+        }
+        free(p);
+    }
+}
+
+/* with the lock held, until the socket is full */
+static void out_flush(struct mqtt_async *c)
+{
+    struct iovec iov[MQ_IOV_MAX];
+    struct msghdr msg;
+    struct mq_pkt *p;
+    size_t skip, left;
+    uint64_t now;
+    ssize_t n;
+    int cnt, i;
+
+    while (c->out_head && !c->broken) {
+        cnt = 0;
+        for (p = c->out_head; p && cnt < MQ_IOV_MAX; p = p->next) {
+            skip = p->off;
+            for (i = 0; i < p->iovcnt && cnt < MQ_IOV_MAX; i++) {
+                if (skip >= p->iov[i].iov_len) {
+                    skip -= p->iov[i].iov_len;
+                    continue;
+                }
+                iov[cnt].iov_base = (uint8_t *)p->iov[i].iov_base + skip;
+                iov[cnt].iov_len = p->iov[i].iov_len - skip;
+                skip = 0;
+                cnt++;
+            }
+        }
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = cnt;
+        n = sendmsg(c->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN) {
+                printf("mqtt sendmsg failed: %s\n", strerror(errno));
+                conn_broken(c);
+            }
+            break;
+        }
+        c->stat.writes++;
+        c->stat.bytes_out += n;
+        c->queued -= n;
+        now = now_ms();
+        c->last_sent = now;
+        while (n > 0) {
+            p = c->out_head;
+            left = p->len - p->off;
+            if ((size_t)n < left) {
+                p->off += n;
+                break;
+            }
+            n -= left;
+            c->out_head = p->next;
+            if (!c->out_head) {
+                c->out_tail = NULL;
+            }
+            pkt_written(c, p, now);
+        }
+    }
+    pthread_cond_broadcast(&c->cond);
+}
+
+/******************************************************************************
+ * read
+ ******************************************************************************/
+
+static void send_ctrl(struct mqtt_async *c, uint8_t type, int id)
+{
+    struct mq_pkt *p = pkt_ctrl(type, id);
+    if (p) {
+        out_push(c, p);
+    }
+}
+
+static void on_publish(struct mqtt_async *c, uint8_t flags, const uint8_t *b, size_t len)
+{
+    struct mqtt_trie_sub subs[MQ_MATCH_MAX];
+    const char *topic;
+    size_t tlen, off;
+    int qos = (flags >> 1) & 3, retained = flags & 1, nsub, i, dup = 0;
+    uint16_t id = 0;
+
+    if (len < 2) {
+        return;
+    }
+    tlen = (b[0] << 8) | b[1];
+    off = 2 + tlen + (qos ? 2 : 0);
+    if (off > len) {
+        return;
+    }
+    topic = (const char *)b + 2;
+    if (qos) {
+        id = (b[2 + tlen] << 8) | b[3 + tlen];
+    }
+    c->stat.received++;
+    if (qos == 1) {
+        send_ctrl(c, MQ_PUBACK, id);
+    } else if (qos == 2) {
+        /* a resent QoS2 message is acked again but not delivered twice */
+        dup = c->qos2_rx[id >> 3] & (1 << (id & 7));
+        c->qos2_rx[id >> 3] |= 1 << (id & 7);
+        send_ctrl(c, MQ_PUBREC, id);
+    }
+    if (dup) {
+        return;
+    }
+    nsub = mqtt_trie_match(&c->trie, topic, tlen, subs, MQ_MATCH_MAX);
+    pthread_mutex_unlock(&c->lock);
+    for (i = 0; i < nsub; i++) {
+        subs[i].cb(subs[i].arg, topic, tlen, b + off, len - off, qos, retained);
+    }
+    pthread_mutex_lock(&c->lock);
+}
+
+static void on_packet(struct mqtt_async *c, uint8_t type, const uint8_t *b, size_t len)
+{
+    struct mq_pkt *p;
+    uint16_t id = len >= 2 ? (b[0] << 8) | b[1] : 0;
+
+    switch (type & 0xf0) {
+    case MQ_CONNACK:
+        c->connack = len >= 2 ? b[1] : 0xff;
+        c->connected = c->connack == 0;
+        pthread_cond_broadcast(&c->cond);
+        break;
+    case MQ_PUBLISH:
+        on_publish(c, type & 0x0f, b, len);
+        break;
+    case MQ_PUBACK:
+    case MQ_UNSUBACK:
+        p = table_find(c, id);
+        if (p && p->state == MQ_WAIT_ACK) {
+            pkt_complete(c, p, 0, 0);
+        }
+        break;
+    case MQ_PUBREC:
+        p = table_find(c, id);
+        if (p && (p->state == MQ_WAIT_REC || p->state == MQ_WAIT_COMP)) {
+            p->state = MQ_WAIT_COMP;
+            p->sent_ms = now_ms();
+            send_ctrl(c, MQ_PUBREL, id);
+        }
+        break;
+    case MQ_PUBREL & 0xf0:
+        c->qos2_rx[id >> 3] &= ~(1 << (id & 7));
+        send_ctrl(c, MQ_PUBCOMP, id);
+        break;
+    case MQ_PUBCOMP:
+        p = table_find(c, id);
+        if (p && p->state == MQ_WAIT_COMP) {
+            pkt_complete(c, p, 0, 0);
+        }
+        break;
+    case MQ_SUBACK:
+        p = table_find(c, id);
+        if (p && p->type == MQ_SUBSCRIBE) {
+            pkt_complete(c, p, 0, len >= 3 ? b[2] : 0x80);
+        }
+        break;
+    case MQ_PINGRESP:
+        c->ping_out = 0;
+        break;
+    default:
+        break;
+    }
+    window_admit(c);
+}
+
+/* with the lock held, parse all complete packets in rbuf */
+static void in_parse(struct mqtt_async *c)
+{
+    size_t pos = 0, rem, mul, hdr;
+    int i;
+
+    while (c->rlen - pos >= 2) {
+        rem = 0;
+        mul = 1;
+        for (i = 1; i <= 4; i++) {
+            if (pos + i >= c->rlen) {
+                goto more;
+            }
+            rem += (c->rbuf[pos + i] & 0x7f) * mul;
+            mul *= 128;
+            if (!(c->rbuf[pos + i] & 0x80)) {
+                break;
+            }
+        }
+        if (i > 4 || rem > MQ_MAX_PACKET) {
+            printf("mqtt bad packet length\n");
+            conn_broken(c);
+            return;
+        }
+        hdr = i + 1;
+        if (c->rlen - pos < hdr + rem) {
+            break;
+        }
+        on_packet(c, c->rbuf[pos], c->rbuf + pos + hdr, rem);
+        pos += hdr + rem;
+    }
+more:
+    if (pos > 0) {
+        memmove(c->rbuf, c->rbuf + pos, c->rlen - pos);
+        c->rlen -= pos;
+    }
+}
+
+static void on_sock_in(int fd, void *arg)
+{
+    struct mqtt_async *c = (struct mqtt_async *)arg;
+    uint8_t *buf;
+    ssize_t n;
+
+    pthread_mutex_lock(&c->lock);
+    while (!c->broken) {
+        if (c->rlen == c->rcap) {
+            buf = realloc(c->rbuf, c->rcap * 2);
+            if (!buf) {
+                conn_broken(c);
+                break;
+            }
+            c->rbuf = buf;
+            c->rcap *= 2;
+        }
+        n = recv(fd, c->rbuf + c->rlen, c->rcap - c->rlen, MSG_DONTWAIT);
+        if (n > 0) {
+            c->rlen += n;
+            in_parse(c);
+            continue;
+        }
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == 0 || errno != EAGAIN) {
+            conn_broken(c);
+        }
+        break;
+    }
+    /* acks and replies queued while parsing go out in one write */
+    out_flush(c);
+    pthread_mutex_unlock(&c->lock);
+    done_run(c);
+}
+
+static void on_sock_out(int fd, void *arg)
+{
+    struct mqtt_async *c = (struct mqtt_async *)arg;
+
+    pthread_mutex_lock(&c->lock);
+    out_flush(c);
+    pthread_mutex_unlock(&c->lock);
+    done_run(c);
+}
+
+static void on_wake(int fd, void *arg)
+{
+    struct mqtt_async *c = (struct mqtt_async *)arg;
+    uint64_t cnt;
+
+    if (read(fd, &cnt, sizeof(cnt)) != sizeof(cnt) && errno != EAGAIN) {
+        printf("read wake fd failed: %s\n", strerror(errno));
+    }
+    pthread_mutex_lock(&c->lock);
+    c->wake_pending = 0;
+    out_flush(c);
+    pthread_mutex_unlock(&c->lock);
+    done_run(c);
+}
+
+/* resend what wasn't acked in time, keepalive */
+static void on_timer(int fd, void *arg)
+{
+    struct mqtt_async *c = (struct mqtt_async *)arg;
+    struct mq_pkt *p;
+    uint64_t now = now_ms();
+    int i;
+
+    pthread_mutex_lock(&c->lock);
+    if (!c->connected || c->broken) {
+        pthread_mutex_unlock(&c->lock);
+        return;
+    }
+    for (i = 0; i < c->table_cap; i++) {
+        p = c->table[i];
+        if (!p || p->queued || now - p->sent_ms < (uint64_t)c->conf.retry_ms) {
+            continue;
+        }
+        c->stat.retransmits++;
+        if (p->state == MQ_WAIT_COMP) {
+            p->sent_ms = now;
+            send_ctrl(c, MQ_PUBREL, p->id);
+            continue;
+        }
+        if (p->type == MQ_PUBLISH) {
+            p->head[0] |= MQ_DUP;
+        }
+        out_push(c, p);
+    }
+    if (c->conf.keepalive) {
+        if (c->ping_out && now - c->ping_sent > c->conf.keepalive * 1000ULL) {
+            printf("mqtt keepalive timeout\n");
+            conn_broken(c);
+        } else if (!c->ping_out && now - c->last_sent >= c->conf.keepalive * 1000ULL) {
+            c->ping_out = 1;
+            c->ping_sent = now;
+            send_ctrl(c, MQ_PINGREQ, -1);
+        }
+    }
+    out_flush(c);
+    pthread_mutex_unlock(&c->lock);
+    done_run(c);
+}
+
+/* fail everything pending, waiters are woken */
+static void conn_broken(struct mqtt_async *c)
+{
+    struct mq_pkt *p, *next;
+    int i;
+
+    if (c->broken) {
+        return;
+    }
+    c->broken = 1;
+    c->connected = 0;
+    for (p = c->out_head; p; p = next) {
+        next = p->next;
+        p->queued = 0;
+        if (p->state == MQ_UNTRACKED && !p->acked) {
+            if (p->type == MQ_PUBLISH) {
+                done_add(c, p, -1, 0);
+            }
+            free(p);
+        } else if (p->acked) {
+            free(p);
+        }
+    }
+    c->out_head = c->out_tail = NULL;
+    for (p = c->wait_head; p; p = next) {
+        next = p->next;
+        done_add(c, p, -1, 0);
+        free(p);
+    }
+    c->wait_head = c->wait_tail = NULL;
+    c->queued = 0;
+    for (i = 0; i < c->table_cap; i++) {
+        p = c->table[i];
+        if (p) {
+            done_add(c, p, -1, 0);
+            free(p);
+            c->table[i] = NULL;
+        }
+    }
+    c->tracked = 0;
+    c->inflight = 0;
+    pthread_cond_broadcast(&c->cond);
+}
+
+/******************************************************************************
+ * api
+ ******************************************************************************/
+
+struct mqtt_async *mqtt_async_create(const char *host, uint16_t port,
+                const struct mqtt_async_conf *conf)
+{
+    struct mqtt_async_conf def = mqtt_async_conf_initializer;
+    struct mqtt_async *c;
+
+    if (!host) {
+        printf("invalid paraments!\n");
+        return NULL;
+    }
+    c = calloc(1, sizeof(struct mqtt_async));
+    if (!c) {
+        printf("malloc mqtt_async failed!\n");
+        return NULL;
+    }
+    c->conf = conf ? *conf : def;
+    if (c->conf.max_inflight <= 0 || c->conf.max_inflight > 65535) {
+        c->conf.max_inflight = def.max_inflight;
+    }
+    if (c->conf.retry_ms <= 0) {
+        c->conf.retry_ms = def.retry_ms;
+    }
+    if (c->conf.timeout_ms <= 0) {
+        c->conf.timeout_ms = def.timeout_ms;
+    }
+    if (c->conf.max_queued == 0) {
+        c->conf.max_queued = def.max_queued;
+    }
+    snprintf(c->host, sizeof(c->host), "%s", host);
+    c->port = port;
+    c->client_id = strdup(c->conf.client_id ? c->conf.client_id : "");
+    c->username = c->conf.username ? strdup(c->conf.username) : NULL;
+    c->password = c->conf.password ? strdup(c->conf.password) : NULL;
+    c->fd = -1;
+    c->wake_fd = -1;
+    c->connack = -1;
+    c->table_cap = 16;
+    while (c->table_cap < c->conf.max_inflight * 2) {
+        c->table_cap *= 2;
+    }
+    c->table = calloc(c->table_cap, sizeof(struct mq_pkt *));
+    c->rcap = MQ_RECV_BUF;
+    c->rbuf = malloc(c->rcap);
+    if (!c->client_id || !c->table || !c->rbuf) {
+        printf("malloc mqtt_async failed!\n");
+        free(c->client_id);
+        free(c->table);
+        free(c->rbuf);
+        free(c);
+        return NULL;
+    }
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->cond, NULL);
+    mqtt_trie_init(&c->trie);
+    return c;
+}
+
+/* wait on cond until done() or timeout, with the lock held */
+static int wait_until(struct mqtt_async *c, int (*done)(struct mqtt_async *), int timeout_ms)
+{
+    struct timespec ts;
+    int ret = 0;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += timeout_ms / 1000;
+    ts.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    while (!done(c) && ret != ETIMEDOUT) {
+        ret = pthread_cond_timedwait(&c->cond, &c->lock, &ts);
+    }
+    return done(c) ? 0 : -1;
+}
+
+static int connack_done(struct mqtt_async *c)
+{
+    return c->connack >= 0 || c->broken;
+}
+
+static struct mq_pkt *pkt_connect(struct mqtt_async *c)
+{
+    size_t id_len = strlen(c->client_id);
+    size_t user_len = c->username ? strlen(c->username) : 0;
+    size_t pass_len = c->password ? strlen(c->password) : 0;
+    size_t rem = 10 + 2 + id_len;
+    struct mq_pkt *p;
+    uint8_t *b, flags = 0;
+
+    if (c->username) {
+        rem += 2 + user_len;
+        flags |= 0x80;
+    }
+    if (c->password) {
+        rem += 2 + pass_len;
+        flags |= 0x40;
+    }
+    if (c->conf.clean_session) {
+        flags |= 0x02;
+    }
+    p = pkt_alloc(5 + rem, 0, 0);
+    if (!p) {
+        return NULL;
+    }
+    p->type = MQ_CONNECT;
+    b = p->head;
+    *b++ = MQ_CONNECT;
+    b += remlen_encode(b, rem);
+    b = put_str(b, "MQTT", 4);
+    *b++ = 4;
+    *b++ = flags;
+    b = put_u16(b, c->conf.keepalive);
+    b = put_str(b, c->client_id, id_len);
+    if (c->username) {
+        b = put_str(b, c->username, user_len);
+    }
+    if (c->password) {
+        b = put_str(b, c->password, pass_len);
+    }
+    p->len = b - p->head;
+    p->iov[0].iov_len = p->len;
+    return p;
+}
+
+int mqtt_async_connect(struct mqtt_async *c)
+{
+    struct sock_connection *conn;
+    struct mq_pkt *p;
+    int on = 1, ret;
+
+    if (!c || c->fd != -1) {
+        return -1;
+    }
+    conn = sock_tcp_connect(c->host, c->port);
+    if (!conn) {
+        printf("mqtt connect %s:%d failed!\n", c->host, c->port);
+        return -1;
+    }
+    c->fd = conn->fd;
+    free(conn);
+    sock_set_noblk(c->fd, 1);
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    c->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    c->evbase = gevent_base_create();
+    if (c->wake_fd == -1 || !c->evbase) {
+        return -1;
+    }
+    c->ev_sock = gevent_create(c->fd, on_sock_in, on_sock_out, NULL, c);
+    c->ev_wake = gevent_create(c->wake_fd, on_wake, NULL, NULL, c);
+    c->ev_timer = gevent_timer_create(c->conf.retry_ms / 4 < 100 ? 100 :
+                                      (c->conf.retry_ms / 4 > 1000 ? 1000 : c->conf.retry_ms / 4),
+                                      TIMER_PERSIST, on_timer, c);
+    if (!c->ev_sock || !c->ev_wake || !c->ev_timer ||
+        gevent_add(c->evbase, &c->ev_sock) == -1 ||
+        gevent_add(c->evbase, &c->ev_wake) == -1 ||
+        gevent_add(c->evbase, &c->ev_timer) == -1) {
+        printf("gevent_add failed!\n");
+        return -1;
+    }
+    gevent_base_loop_start(c->evbase);
+    if (!c->evbase->thread) {
+        return -1;
+    }
+    c->loop_tid = c->evbase->thread->tid;
+    c->loop_running = 1;
+
+    p = pkt_connect(c);
+    if (!p) {
+        return -1;
+    }
+    pthread_mutex_lock(&c->lock);
+    c->last_sent = now_ms();
+    out_push(c, p);
+    wait_until(c, connack_done, c->conf.timeout_ms);
+    ret = c->connack;
+    pthread_mutex_unlock(&c->lock);
+    if (ret != 0) {
+        printf("mqtt connack %d\n", ret);
+    }
+    return ret;
+}
+
+/* blocked publishers resume once half of max_queued is written */
+static int room_done(struct mqtt_async *c)
+{
+    return c->queued <= c->conf.max_queued / 2 || c->broken;
+}
+
+/* with the lock held, wait for room or fail */
+static int queue_room(struct mqtt_async *c, size_t len)
+{
+    if (!c->connected || c->broken) {
+        return -1;
+    }
+    if (c->queued == 0 || c->queued + len <= c->conf.max_queued) {
+        return 0;
+    }
+    if (!c->conf.block || in_loop(c)) {
+        return -1;
+    }
+    while (!room_done(c)) {
+        wait_until(c, room_done, 1000);
+    }
+    return c->broken ? -1 : 0;
+}
+
+static int publish(struct mqtt_async *c, const char *topic, const struct iovec *iov,
+                int iovcnt, const void *copy, size_t copy_len, int qos, int retain,
+                mqtt_async_done_cb cb, void *arg)
+{
+    struct mq_pkt *p;
+    size_t tlen, plen = copy_len, rem;
+    uint8_t *b;
+    int i;
+
+    if (!c || !topic || qos < 0 || qos > 2 || iovcnt < 0) {
+        printf("invalid paraments!\n");
+        return -1;
+    }
+    for (i = 0; i < iovcnt; i++) {
+        plen += iov[i].iov_len;
+    }
+    tlen = strlen(topic);
+    rem = 2 + tlen + (qos ? 2 : 0) + plen;
+    p = pkt_alloc(5 + 2 + tlen + 2, iovcnt ? iovcnt : 1, copy_len);
+    if (!p) {
+        return -1;
+    }
+    p->type = MQ_PUBLISH;
+    p->qos = qos;
+    p->cb = cb;
+    p->arg = arg;
+    b = p->head;
+    *b++ = MQ_PUBLISH | (qos << 1) | (retain ? 1 : 0);
+    b += remlen_encode(b, rem);
+    b = put_str(b, topic, tlen);
+    if (qos) {
+        p->id_off = b - p->head;
+        b += 2;
+    }
+    p->iov[0].iov_len = b - p->head;
+    if (copy) {
+        p->iov[1].iov_base = (uint8_t *)(p->iov + 2);
+        p->iov[1].iov_len = copy_len;
+        memcpy(p->iov[1].iov_base, copy, copy_len);
+        p->iovcnt = 2;
+    } else {
+        for (i = 0; i < iovcnt; i++) {
+            p->iov[1 + i] = iov[i];
+        }
+        p->iovcnt = 1 + iovcnt;
+    }
+    p->len = p->iov[0].iov_len + plen;
+
+    pthread_mutex_lock(&c->lock);
+    if (queue_room(c, p->len) < 0) {
+        pthread_mutex_unlock(&c->lock);
+        free(p);
+        return -1;
+    }
+    c->stat.published++;
+    if (qos == 0) {
+        out_push(c, p);
+    } else {
+        p->next = NULL;
+        if (c->wait_tail) {
+            c->wait_tail->next = p;
+        } else {
+            c->wait_head = p;
+        }
+        c->wait_tail = p;
+        c->queued += p->len;
+        window_admit(c);
+    }
+    pthread_mutex_unlock(&c->lock);
+    return 0;
+}
+
+int mqtt_async_publish(struct mqtt_async *c, const char *topic,
+                const void *payload, size_t len, int qos, int retain,
+                mqtt_async_done_cb cb, void *arg)
+{
+    return publish(c, topic, NULL, 0, payload ? payload : "", payload ? len : 0,
+                   qos, retain, cb, arg);
+}
+
+int mqtt_async_publishv(struct mqtt_async *c, const char *topic,
+                const struct iovec *iov, int iovcnt, int qos, int retain,
+                mqtt_async_done_cb cb, void *arg)
+{
+    if (iovcnt > 0 && !iov) {
+        return -1;
+    }
+    return publish(c, topic, iov, iovcnt, NULL, 0, qos, retain, cb, arg);
+}
+
+/* SUBSCRIBE / UNSUBSCRIBE of one filter */
+static struct mq_pkt *pkt_sub(uint8_t type, const char *filter, int qos)
+{
+    size_t flen = strlen(filter);
+    size_t rem = 2 + 2 + flen + (type == MQ_SUBSCRIBE ? 1 : 0);
+    struct mq_pkt *p;
+    uint8_t *b;
+
+    p = pkt_alloc(5 + rem + flen + 1, 0, 0);
+    if (!p) {
+        return NULL;
+    }
+    p->type = type;
+    p->state = MQ_WAIT_ACK;
+    b = p->head;
+    *b++ = type;
+    b += remlen_encode(b, rem);
+    p->id_off = b - p->head;
+    b += 2;
+    b = put_str(b, filter, flen);
+    if (type == MQ_SUBSCRIBE) {
+        *b++ = qos;
+    }
+    p->len = b - p->head;
+    p->iov[0].iov_len = p->len;
+    /* kept after the packet bytes for the SUBACK callback */
+    p->filter = (char *)b;
+    memcpy(p->filter, filter, flen + 1);
+    return p;
+}
+
+static int sub_send(struct mqtt_async *c, struct mq_pkt *p)
+{
+    if (!c->connected || c->broken || table_add(c, p) < 0) {
+        return -1;
+    }
+    out_push(c, p);
+    return 0;
+}
+
+int mqtt_async_subscribe(struct mqtt_async *c, const char *filter, int qos,
+                mqtt_async_msg_cb msg_cb, void *msg_arg,
+                mqtt_async_sub_cb sub_cb, void *sub_arg)
+{
+    struct mqtt_trie_sub sub;
+    struct mq_pkt *p;
+    int ret;
+
+    if (!c || !msg_cb || qos < 0 || qos > 2 || mqtt_trie_check(filter) < 0) {
+        printf("invalid paraments!\n");
+        return -1;
+    }
+    p = pkt_sub(MQ_SUBSCRIBE, filter, qos);
+    if (!p) {
+        return -1;
+    }
+    p->sub_cb = sub_cb;
+    p->sub_arg = sub_arg;
+    sub.cb = msg_cb;
+    sub.arg = msg_arg;
+    pthread_mutex_lock(&c->lock);
+    ret = mqtt_trie_add(&c->trie, filter, &sub);
+    if (ret == 0) {
+        ret = sub_send(c, p);
+        if (ret < 0) {
+            mqtt_trie_del(&c->trie, filter);
+        }
+    }
+    pthread_mutex_unlock(&c->lock);
+    if (ret < 0) {
+        free(p);
+    }
+    return ret;
+}
+
+int mqtt_async_unsubscribe(struct mqtt_async *c, const char *filter)
+{
+    struct mq_pkt *p;
+    int ret;
+
+    if (!c || mqtt_trie_check(filter) < 0) {
+        printf("invalid paraments!\n");
+        return -1;
+    }
+    p = pkt_sub(MQ_UNSUBSCRIBE, filter, 0);
+    if (!p) {
+        return -1;
+    }
+    pthread_mutex_lock(&c->lock);
+    mqtt_trie_del(&c->trie, filter);
+    ret = sub_send(c, p);
+    pthread_mutex_unlock(&c->lock);
+    if (ret < 0) {
+        free(p);
+    }
+    return ret;
+}
+
+static int drained_done(struct mqtt_async *c)
+{
+    return (!c->out_head && !c->wait_head && c->tracked == 0 && c->ndone == 0) || c->broken;
+}
+
+int mqtt_async_flush(struct mqtt_async *c, int timeout_ms)
+{
+    int ret;
+
+    if (!c || in_loop(c)) {
+        return -1;
+    }
+    pthread_mutex_lock(&c->lock);
+    ret = wait_until(c, drained_done, timeout_ms);
+    if (c->broken) {
+        ret = -1;
+    }
+    pthread_mutex_unlock(&c->lock);
+    return ret;
+}
+
+static int written_done(struct mqtt_async *c)
+{
+    return !c->out_head || c->broken;
+}
+
+int mqtt_async_disconnect(struct mqtt_async *c)
+{
+    int ret;
+
+    if (!c || !c->evbase) {
+        return -1;
+    }
+    ret = mqtt_async_flush(c, c->conf.timeout_ms);
+    pthread_mutex_lock(&c->lock);
+    if (c->connected && !c->broken) {
+        send_ctrl(c, MQ_DISCONNECT, -1);
+        wait_until(c, written_done, c->conf.timeout_ms);
+    }
+    c->connected = 0;
+    pthread_mutex_unlock(&c->lock);
+    return ret;
+}
+
+void mqtt_async_get_stat(struct mqtt_async *c, struct mqtt_async_stat *st)
+{
+    pthread_mutex_lock(&c->lock);
+    *st = c->stat;
+    st->inflight = c->inflight;
+    st->queued = c->queued;
+    pthread_mutex_unlock(&c->lock);
+}
+
+void mqtt_async_destroy(struct mqtt_async *c)
+{
+    if (!c) {
+        return;
+    }
+    if (c->loop_running) {
+        gevent_base_loop_stop(c->evbase);
+        c->loop_running = 0;
+    }
+    /* whatever is left is failed, the loop is gone so callbacks run here */
+    pthread_mutex_lock(&c->lock);
+    conn_broken(c);
+    pthread_mutex_unlock(&c->lock);
+    done_run(c);
+    if (c->evbase) {
+        if (c->ev_timer) {
+            gevent_del(c->evbase, &c->ev_timer);
+            gevent_timer_destroy(c->ev_timer);
+        }
+        gevent_base_destroy(c->evbase);
+    }
+    if (c->fd != -1) {
+        sock_close(c->fd);
+    }
+    if (c->wake_fd != -1) {
+        close(c->wake_fd);
+    }
+    mqtt_trie_deinit(&c->trie);
+    pthread_cond_destroy(&c->cond);
+    pthread_mutex_destroy(&c->lock);
+    free(c->dones);
+    free(c->rbuf);
+    free(c->table);
+    free(c->client_id);
+    free(c->username);
+    free(c->password);
+    free(c);
+}
@@ -0,0 +1,364 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#include "mqttc_trie.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+struct mqtt_trie_node {
+    struct mqtt_trie_node *parent;
+    char *level;
+    size_t level_len;
+    uint32_t hash;
+    /* exact children, open addressing, size a power of 2 */
+    struct mqtt_trie_node **childs;
+    int nchild;
+    int cap;
+    struct mqtt_trie_node *plus;
+    struct mqtt_trie_node *hash_wild;   /* '#' */
+    int has_sub;
+    struct mqtt_trie_sub sub;
+};
+
+static uint32_t level_hash(const char *s, size_t len)
+{
+    uint32_t h = 2166136261u;
+    size_t i;
+    for (i = 0; i < len; i++) {
+        h = (h ^ (uint8_t)s[i]) * 16777619u;
+    }
+    return h;
+}
+
+static struct mqtt_trie_node *node_create(struct mqtt_trie_node *parent,
+                const char *level, size_t len, uint32_t hash)
+{
+    struct mqtt_trie_node *n = calloc(1, sizeof(struct mqtt_trie_node) + len + 1);
+    if (!n) {
+        printf("malloc mqtt_trie_node failed!\n");
+        return NULL;
+    }
+    n->parent = parent;
+    n->level = (char *)(n + 1);
+    memcpy(n->level, level, len);
+    n->level[len] = '\0';
+    n->level_len = len;
+    n->hash = hash;
+    return n;
+}
+
+static struct mqtt_trie_node **child_slot(struct mqtt_trie_node *n,
+                const char *level, size_t len, uint32_t hash)
+{
+    struct mqtt_trie_node **slot;
+    uint32_t i;
+
+    for (i = hash & (n->cap - 1);; i = (i + 1) & (n->cap - 1)) {
+        slot = &n->childs[i];
+        if (!*slot || ((*slot)->hash == hash && (*slot)->level_len == len &&
+                       !memcmp((*slot)->level, level, len))) {
+            return slot;
+        }
+    }
+}
+
+static struct mqtt_trie_node *child_find(struct mqtt_trie_node *n,
+                const char *level, size_t len)
+{
+    if (n->nchild == 0) {
+        return NULL;
+    }
+    return *child_slot(n, level, len, level_hash(level, len));
+}
+
+static int child_grow(struct mqtt_trie_node *n)
+{
+    struct mqtt_trie_node **old = n->childs;
+    int i, old_cap = n->cap;
+
+    n->cap = old_cap ? old_cap * 2 : 4;
+    n->childs = calloc(n->cap, sizeof(struct mqtt_trie_node *));
+    if (!n->childs) {
+        n->childs = old;
+        n->cap = old_cap;
+        return -1;
+    }
+    for (i = 0; i < old_cap; i++) {
+        if (old[i]) {
+            *child_slot(n, old[i]->level, old[i]->level_len, old[i]->hash) = old[i];
+        }
+    }
+    free(old);
+    return 0;
+}
+
+static struct mqtt_trie_node *child_add(struct mqtt_trie_node *n,
+                const char *level, size_t len)
+{
+    struct mqtt_trie_node **slot, *c;
+    uint32_t hash = level_hash(level, len);
+
+    if (len == 1 && level[0] == '+') {
+        if (!n->plus) {
+            n->plus = node_create(n, level, len, hash);
+        }
+        return n->plus;
+    }
+    if (len == 1 && level[0] == '#') {
+        if (!n->hash_wild) {
+            n->hash_wild = node_create(n, level, len, hash);
+        }
+        return n->hash_wild;
+    }
+    if ((n->nchild + 1) * 4 > n->cap * 3 && child_grow(n) < 0) {
+        return NULL;
+    }
+    slot = child_slot(n, level, len, hash);
+    if (*slot) {
+        return *slot;
+    }
+    c = node_create(n, level, len, hash);
+    if (c) {
+        *slot = c;
+        n->nchild++;
+    }
+    return c;
+}
+
+/* backward shift delete keeps the probe chains intact */
+static void child_del(struct mqtt_trie_node *n, struct mqtt_trie_node *c)
+{
+    uint32_t i, j, k, mask = n->cap - 1;
+
+    if (n->plus == c) {
+        n->plus = NULL;
+        return;
+    }
+    if (n->hash_wild == c) {
+        n->hash_wild = NULL;
+        return;
+    }
+    i = (uint32_t)(child_slot(n, c->level, c->level_len, c->hash) - n->childs);
+    n->childs[i] = NULL;
+    n->nchild--;
+    for (j = (i + 1) & mask; n->childs[j]; j = (j + 1) & mask) {
+        k = n->childs[j]->hash & mask;
+        if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j))) {
+            n->childs[i] = n->childs[j];
+            n->childs[j] = NULL;
+            i = j;
+        }
+    }
+}
+
+static void node_free(struct mqtt_trie_node *n)
+{
+    int i;
+    if (!n) {
+        return;
+    }
+    for (i = 0; i < n->cap; i++) {
+        node_free(n->childs[i]);
+    }
+    node_free(n->plus);
+    node_free(n->hash_wild);
+    free(n->childs);
+    free(n);
+}
+
+void mqtt_trie_init(struct mqtt_trie *t)
+{
+    memset(t, 0, sizeof(*t));
+}
+
+void mqtt_trie_deinit(struct mqtt_trie *t)
+{
+    node_free(t->root);
+    memset(t, 0, sizeof(*t));
+}
+
+int mqtt_trie_check(const char *filter)
+{
+    const char *p = filter, *end;
+    size_t len;
+
+    if (!filter || !*filter) {
+        return -1;
+    }
+    for (;;) {
+        end = strchr(p, '/');
+        len = end ? (size_t)(end - p) : strlen(p);
+        if (memchr(p, '+', len) && len != 1) {
+            return -1;
+        }
+        if (memchr(p, '#', len) && (len != 1 || end)) {
+            return -1;
+        }
+        if (!end) {
+            return 0;
+        }
+        p = end + 1;
+    }
+}
+
+static struct mqtt_trie_node *trie_walk(struct mqtt_trie *t, const char *filter, int create)
+{
+    struct mqtt_trie_node *n;
+    const char *p = filter, *end;
+    size_t len;
+
+    if (!t->root) {
+        if (!create) {
+            return NULL;
+        }
+        t->root = node_create(NULL, "", 0, 0);
+        if (!t->root) {
+            return NULL;
+        }
+    }
+    n = t->root;
+    for (;;) {
+        end = strchr(p, '/');
+        len = end ? (size_t)(end - p) : strlen(p);
+        if (create) {
+            n = child_add(n, p, len);
+        } else if (len == 1 && *p == '+') {
+            n = n->plus;
+        } else if (len == 1 && *p == '#') {
+            n = n->hash_wild;
+        } else {
+            n = child_find(n, p, len);
+        }
+        if (!n || !end) {
+            return n;
+        }
+        p = end + 1;
+    }
+}
+
+int mqtt_trie_add(struct mqtt_trie *t, const char *filter, const struct mqtt_trie_sub *sub)
+{
+    struct mqtt_trie_node *n;
+
+    if (mqtt_trie_check(filter) < 0) {
+        printf("invalid topic filter %s\n", filter ? filter : "(null)");
+        return -1;
+    }
+    n = trie_walk(t, filter, 1);
+    if (!n) {
+        return -1;
+    }
+    if (!n->has_sub) {
+        t->count++;
+    }
+    n->has_sub = 1;
+    n->sub = *sub;
+    return 0;
+}
+
+int mqtt_trie_del(struct mqtt_trie *t, const char *filter)
+{
+    struct mqtt_trie_node *n, *parent;
+
+    if (mqtt_trie_check(filter) < 0) {
+        return -1;
+    }
+    n = trie_walk(t, filter, 0);
+    if (!n || !n->has_sub) {
+        return -1;
+    }
+    n->has_sub = 0;
+    t->count--;
+    /* prune the branch up to the first node still in use */
+    while (n->parent && !n->has_sub && !n->nchild && !n->plus && !n->hash_wild) {
+        parent = n->parent;
+        child_del(parent, n);
+        free(n->childs);
+        free(n);
+        n = parent;
+    }
+    return 0;
+}
+
+struct match_ctx {
+    const char *topic;
+    size_t topic_len;
+    struct mqtt_trie_sub *out;
+    int max;
+    int cnt;
+};
+
+static void match_add(struct match_ctx *m, struct mqtt_trie_node *n)
+{
+    if (n && n->has_sub && m->cnt < m->max) {
+        m->out[m->cnt++] = n->sub;
+    }
+}
+
+/* p is the start of a level, end of the topic when past it */
+static void match_level(struct match_ctx *m, struct mqtt_trie_node *n, const char *p, int first)
+{
+    const char *end = m->topic + m->topic_len, *sep;
+    struct mqtt_trie_node *c;
+    /* "$SYS/..." topics are not matched by a leading wildcard */
+    int wild = !(first && p < end && *p == '$');
+
+    if (wild) {
+        /* "a/#" matches "a" too */
+        match_add(m, n->hash_wild);
+    }
+    if (p > end) {
+        match_add(m, n);
+        return;
+    }
+    sep = memchr(p, '/', end - p);
+    if (!sep) {
+        sep = end;
+    }
+    if (n->nchild) {
+        c = child_find(n, p, sep - p);
+        if (c) {
+            match_level(m, c, sep + 1, 0);
+        }
+    }
+    if (wild && n->plus) {
+        match_level(m, n->plus, sep + 1, 0);
+    }
+}
+
+int mqtt_trie_match(struct mqtt_trie *t, const char *topic, size_t len,
+                struct mqtt_trie_sub *out, int max)
+{
+    struct match_ctx m;
+
+    if (!t->root || !topic) {
+        return 0;
+    }
+    m.topic = topic;
+    m.topic_len = len;
+    m.out = out;
+    m.max = max;
+    m.cnt = 0;
+    match_level(&m, t->root, topic, 1);
+    return m.cnt;
+}
@@ -0,0 +1,63 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#ifndef MQTTC_TRIE_H
+#define MQTTC_TRIE_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * topic filter trie, one node per level. matching a topic walks its levels
+ * once, following the exact, '+' and '#' children, instead of comparing it
+ * against every filter.
+ */
+struct mqtt_trie_node;
+
+struct mqtt_trie_sub {
+    void (*cb)(void *arg, const char *topic, size_t topic_len,
+               const void *payload, size_t len, int qos, int retained);
+    void *arg;
+};
+
+struct mqtt_trie {
+    struct mqtt_trie_node *root;
+    int count;
+};
+
+void mqtt_trie_init(struct mqtt_trie *t);
+void mqtt_trie_deinit(struct mqtt_trie *t);
+/* replace the subscriber of an existing filter */
+int mqtt_trie_add(struct mqtt_trie *t, const char *filter, const struct mqtt_trie_sub *sub);
+int mqtt_trie_del(struct mqtt_trie *t, const char *filter);
+/* store up to max subscribers matching topic, return the number matched */
+int mqtt_trie_match(struct mqtt_trie *t, const char *topic, size_t len,
+                struct mqtt_trie_sub *out, int max);
+/* 0 for a valid filter, wildcards only as whole levels, '#' last */
+int mqtt_trie_check(const char *filter);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -20,6 +20,8 @@
  * SOFTWARE.
  ******************************************************************************/
 #include "libmqttc.h"
+#include "libmqttc_async.h"
+#include "mqttc_trie.h"
 #include <libtime.h>
 
 #include <stdio.h>
@@ -28,6 +30,13 @@
 #include <stdarg.h>
 #include <time.h>
 #include <sys/timeb.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 
 
 #define LOGA_DEBUG 0
@@ -54,6 +63,7 @@ struct Options
     int test_no;
     int mqtt_version;
     int iterations;
+    int bench;
 } options = {
     "localhost",
     //"127.0.0.1",
@@ -65,6 +75,7 @@ struct Options
     0, //test_no
     4,
     1,
+    0, //bench
 };
 
 void getopts(int argc, char** argv)
@@ -112,6 +123,8 @@ void getopts(int argc, char** argv)
                 options.iterations = atoi(argv[count]);
             else
                 usage();
+        } else if (strcmp(argv[count], "--bench") == 0) {
+            options.bench = 1;
         } else if (strcmp(argv[count], "--verbose") == 0) {
             options.verbose = 1;
             printf("\nSetting verbose on\n");
@@ -906,17 +919,414 @@ exit:
 }
 #endif
 
+/******************************************************************************
+ * --bench: topic trie and the async client against a local broker stand-in
+ ******************************************************************************/
+
+static uint64_t bench_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void trie_cb(void *arg, const char *topic, size_t topic_len,
+                const void *payload, size_t len, int qos, int retained)
+{
+}
+
+static int trie_expect(struct mqtt_trie *t, const char *topic, int expect)
+{
+    struct mqtt_trie_sub subs[16];
+    int n = mqtt_trie_match(t, topic, strlen(topic), subs, 16);
+    if (n != expect) {
+        printf("trie match %s: %d, expect %d\n", topic, n, expect);
+        return 1;
+    }
+    return 0;
+}
+
+static int foo_trie(void)
+{
+    const char *filters[] = {"a/b/c", "a/+/c", "a/#", "#", "+/b/+", "$SYS/#", "a/b/c/+"};
+    struct mqtt_trie_sub sub = {trie_cb, NULL};
+    struct mqtt_trie_sub subs[4];
+    struct mqtt_trie t;
+    char buf[64];
+    uint64_t start;
+    int i, n, err = 0;
+
+    mqtt_trie_init(&t);
+    for (i = 0; i < (int)ARRAY_SIZE(filters); i++) {
+        mqtt_trie_add(&t, filters[i], &sub);
+    }
+    err += trie_expect(&t, "a/b/c", 5);
+    err += trie_expect(&t, "a/x/c", 3);
+    err += trie_expect(&t, "a", 2);
+    err += trie_expect(&t, "a/b/c/d", 3);
+    err += trie_expect(&t, "x/b/y", 2);
+    err += trie_expect(&t, "$SYS/load", 1);
+    mqtt_trie_del(&t, "#");
+    mqtt_trie_del(&t, "a/#");
+    err += trie_expect(&t, "a", 0);
+    err += trie_expect(&t, "a/b/c", 3);
+    err += mqtt_trie_check("a/b#") == 0;
+    err += mqtt_trie_check("a/#/b") == 0;
+    err += mqtt_trie_check("a/+b") == 0;
+    err += mqtt_trie_check("a/+/#") != 0;
+    mqtt_trie_deinit(&t);
+
+    /* one subscriber per device, every topic hits one of them */
+    mqtt_trie_init(&t);
+    for (i = 0; i < 10000; i++) {
+        snprintf(buf, sizeof(buf), "dev/%d/temp", i);
+        mqtt_trie_add(&t, buf, &sub);
+    }
+    mqtt_trie_add(&t, "dev/+/alarm", &sub);
+    start = bench_ms();
+    for (i = 0, n = 0; i < 1000000; i++) {
+        snprintf(buf, sizeof(buf), "dev/%d/temp", i % 10000);
+        n += mqtt_trie_match(&t, buf, strlen(buf), subs, 4);
+    }
+    printf("trie: 10001 filters, 1000000 matches in %" PRIu64 " ms, %d hits\n",
+           bench_ms() - start, n);
+    err += n != 1000000;
+    mqtt_trie_deinit(&t);
+    printf("foo_trie %s\n", err ? "failed" : "ok");
+    return err;
+}
+
+/*
+ * broker stand-in: one connection, acks every packet ack_delay_ms after it
+ * arrived, as a broker behind that much round trip would. publishes to
+ * "loop/..." are sent back to the client as QoS1.
+ */
+struct bench_broker {
+    int lfd;
+    int fd;
+    int ack_delay_ms;
+    uint16_t port;
+    pthread_t tid;
+    uint64_t msgs;
+};
+
+struct bench_ack {
+    uint64_t due;
+    int len;
+    uint8_t buf[8];
+};
+
+static int broker_send(int fd, const void *buf, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)buf;
+    ssize_t n;
+    while (len > 0) {
+        n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static void *broker_thread(void *arg)
+{
+    struct bench_broker *b = (struct bench_broker *)arg;
+    static uint8_t rbuf[256 * 1024];
+    static struct bench_ack acks[65536];
+    uint8_t out[512], *pkt;
+    size_t rlen = 0, pos, rem, mul, hdr, tlen, i;
+    unsigned ack_head = 0, ack_tail = 0;
+    uint16_t echo_id = 0;
+    struct pollfd pfd;
+    int timeout, qos;
+    uint64_t now;
+    ssize_t n;
+
+    b->fd = accept(b->lfd, NULL, NULL);
+    if (b->fd < 0) {
+        return NULL;
+    }
+    pfd.fd = b->fd;
+    pfd.events = POLLIN;
+    for (;;) {
+        now = bench_ms();
+        while (ack_head != ack_tail && acks[ack_head].due <= now) {
+            broker_send(b->fd, acks[ack_head].buf, acks[ack_head].len);
+            ack_head = (ack_head + 1) & 65535;
+        }
+        timeout = ack_head != ack_tail ? (int)(acks[ack_head].due - now) : 1000;
+        if (poll(&pfd, 1, timeout) <= 0) {
+            continue;
+        }
+        n = recv(b->fd, rbuf + rlen, sizeof(rbuf) - rlen, 0);
+        if (n <= 0) {
+            break;
+        }
+        rlen += n;
+        now = bench_ms();
+        for (pos = 0; rlen - pos >= 2; pos += hdr + rem) {
+            rem = 0;
+            mul = 1;
+            for (i = 1; i <= 4 && pos + i < rlen; i++) {
+                rem += (rbuf[pos + i] & 0x7f) * mul;
+                mul *= 128;
+                if (!(rbuf[pos + i] & 0x80)) {
+                    break;
+                }
+            }
+            hdr = i + 1;
+            if (i > 4 || pos + i >= rlen || rlen - pos < hdr + rem) {
+                break;
+            }
+            pkt = rbuf + pos + hdr;
+            acks[ack_tail].due = now + b->ack_delay_ms;
+            acks[ack_tail].len = 0;
+            switch (rbuf[pos] & 0xf0) {
+            case 0x10:  /* CONNECT, acked at once */
+                broker_send(b->fd, "\x20\x02\x00\x00", 4);
+                break;
+            case 0x30:  /* PUBLISH */
+                b->msgs++;
+                qos = (rbuf[pos] >> 1) & 3;
+                tlen = (pkt[0] << 8) | pkt[1];
+                if (qos) {
+                    acks[ack_tail].buf[0] = qos == 1 ? 0x40 : 0x50;
+                    acks[ack_tail].buf[1] = 2;
+                    memcpy(acks[ack_tail].buf + 2, pkt + 2 + tlen, 2);
+                    acks[ack_tail].len = 4;
+                }
+                if (tlen > 5 && !memcmp(pkt + 2, "loop/", 5) && rem < sizeof(out) - 8) {
+                    echo_id = echo_id == 65535 ? 1 : echo_id + 1;
+                    out[0] = 0x32;
+                    out[1] = rem + (qos ? 0 : 2);
+                    memcpy(out + 2, pkt, 2 + tlen);
+                    out[4 + tlen] = echo_id >> 8;
+                    out[5 + tlen] = echo_id & 0xff;
+                    i = 2 + tlen + (qos ? 2 : 0);
+                    memcpy(out + 6 + tlen, pkt + i, rem - i);
+                    broker_send(b->fd, out, 2 + out[1]);
+                }
+                break;
+            case 0x60:  /* PUBREL */
+                acks[ack_tail].buf[0] = 0x70;
+                acks[ack_tail].buf[1] = 2;
+                memcpy(acks[ack_tail].buf + 2, pkt, 2);
+                acks[ack_tail].len = 4;
+                break;
+            case 0x80:  /* SUBSCRIBE, grant what was asked */
+                acks[ack_tail].buf[0] = 0x90;
+                acks[ack_tail].buf[1] = 3;
+                memcpy(acks[ack_tail].buf + 2, pkt, 2);
+                acks[ack_tail].buf[4] = pkt[rem - 1];
+                acks[ack_tail].len = 5;
+                break;
+            case 0xa0:  /* UNSUBSCRIBE */
+                acks[ack_tail].buf[0] = 0xb0;
+                acks[ack_tail].buf[1] = 2;
+                memcpy(acks[ack_tail].buf + 2, pkt, 2);
+                acks[ack_tail].len = 4;
+                break;
+            case 0xc0:  /* PINGREQ */
+                broker_send(b->fd, "\xd0\x00", 2);
+                break;
+            default:
+                break;
+            }
+            if (acks[ack_tail].len) {
+                ack_tail = (ack_tail + 1) & 65535;
+            }
+        }
+        memmove(rbuf, rbuf + pos, rlen - pos);
+        rlen -= pos;
+    }
+    close(b->fd);
+    return NULL;
+}
+
+static int broker_start(struct bench_broker *b, int ack_delay_ms)
+{
+    struct sockaddr_in addr;
+    socklen_t alen = sizeof(addr);
+    int on = 1;
+
+    memset(b, 0, sizeof(*b));
+    b->ack_delay_ms = ack_delay_ms;
+    b->lfd = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(b->lfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(b->lfd, (struct sockaddr *)&addr, sizeof(addr)) || listen(b->lfd, 4) ||
+        getsockname(b->lfd, (struct sockaddr *)&addr, &alen)) {
+        perror("broker listen");
+        close(b->lfd);
+        return -1;
+    }
+    b->port = ntohs(addr.sin_port);
+    return pthread_create(&b->tid, NULL, broker_thread, b);
+}
+
+static void broker_stop(struct bench_broker *b)
+{
+    pthread_join(b->tid, NULL);
+    close(b->lfd);
+}
+
+static volatile int bench_acked;
+static volatile int bench_failed;
+static volatile int bench_received;
+static volatile int bench_granted = -1;
+
+static void bench_done(void *arg, uint16_t id, int rc)
+{
+    if (rc == 0) {
+        __sync_fetch_and_add(&bench_acked, 1);
+    } else {
+        __sync_fetch_and_add(&bench_failed, 1);
+    }
+}
+
+static void bench_msg(void *arg, const char *topic, size_t topic_len,
+                const void *payload, size_t len, int qos, int retained)
+{
+    __sync_fetch_and_add(&bench_received, 1);
+}
+
+static void bench_sub(void *arg, const char *filter, int granted)
+{
+    bench_granted = granted;
+}
+
+/* publish count messages, return msg/s or -1 */
+static int bench_run(int window, int qos, int zero_copy, int count, int ack_delay_ms)
+{
+    struct mqtt_async_conf conf = mqtt_async_conf_initializer;
+    struct mqtt_async_stat st;
+    struct bench_broker b;
+    struct mqtt_async *c;
+    struct iovec iov[2];
+    char payload[64];
+    uint64_t start, ms;
+    int i, ret = -1;
+
+    if (broker_start(&b, ack_delay_ms)) {
+        return -1;
+    }
+    conf.max_inflight = window;
+    c = mqtt_async_create("127.0.0.1", b.port, &conf);
+    if (!c || mqtt_async_connect(c) != 0) {
+        printf("mqtt_async_connect failed\n");
+        goto out;
+    }
+    bench_acked = bench_failed = 0;
+    memset(payload, 'x', sizeof(payload));
+    iov[0].iov_base = payload;
+    iov[0].iov_len = 16;
+    iov[1].iov_base = payload + 16;
+    iov[1].iov_len = sizeof(payload) - 16;
+    start = bench_ms();
+    for (i = 0; i < count; i++) {
+        if (zero_copy) {
+            mqtt_async_publishv(c, "bench/topic", iov, 2, qos, 0, bench_done, NULL);
+        } else {
+            mqtt_async_publish(c, "bench/topic", payload, sizeof(payload), qos, 0,
+                               bench_done, NULL);
+        }
+    }
+    if (mqtt_async_flush(c, 60000) == 0 && bench_acked == count) {
+        ms = bench_ms() - start;
+        ret = (int)(count * 1000ULL / (ms ? ms : 1));
+        mqtt_async_get_stat(c, &st);
+        printf("qos%d window %-3d %s%6d msgs in %5" PRIu64 " ms, %8d msg/s, "
+               "%" PRIu64 " writes\n", qos, window, zero_copy ? "iov  " : "copy ",
+               count, ms, ret, st.writes);
+    } else {
+        printf("qos%d window %d: %d acked, %d failed of %d\n",
+               qos, window, bench_acked, bench_failed, count);
+    }
+    mqtt_async_disconnect(c);
+out:
+    mqtt_async_destroy(c);
+    broker_stop(&b);
+    return ret;
+}
+
+/* subscribe, publish to ourselves through the broker, unsubscribe */
+static int bench_loopback(void)
+{
+    struct mqtt_async_conf conf = mqtt_async_conf_initializer;
+    struct bench_broker b;
+    struct mqtt_async *c;
+    uint64_t start;
+    int i, err = 1;
+
+    if (broker_start(&b, 0)) {
+        return 1;
+    }
+    c = mqtt_async_create("127.0.0.1", b.port, &conf);
+    if (!c || mqtt_async_connect(c) != 0) {
+        goto out;
+    }
+    bench_received = 0;
+    mqtt_async_subscribe(c, "loop/+/data", 1, bench_msg, NULL, bench_sub, NULL);
+    for (i = 0; i < 1000; i++) {
+        mqtt_async_publish(c, i % 2 ? "loop/a/data" : "loop/a/other", "hello", 5, 1, 0,
+                           NULL, NULL);
+    }
+    mqtt_async_flush(c, 5000);
+    for (start = bench_ms(); bench_received < 500 && bench_ms() - start < 5000;) {
+        usleep(1000);
+    }
+    mqtt_async_unsubscribe(c, "loop/+/data");
+    mqtt_async_flush(c, 5000);
+    err = bench_received != 500 || bench_granted != 1;
+    printf("loopback: received %d of 500, granted %d\n", bench_received, bench_granted);
+    mqtt_async_disconnect(c);
+out:
+    mqtt_async_destroy(c);
+    broker_stop(&b);
+    printf("bench_loopback %s\n", err ? "failed" : "ok");
+    return err;
+}
+
+static int foo_async_bench(void)
+{
+    int w1, w64, err = 0;
+
+    err += bench_loopback();
+    /* 1ms round trip: stop-and-wait as mqtt_publish does vs a window */
+    w1 = bench_run(1, 1, 0, 500, 1);
+    w64 = bench_run(64, 1, 0, 20000, 1);
+    err += w1 <= 0 || w64 <= 0;
+    if (w1 > 0) {
+        printf("window 64 vs 1 at 1ms rtt: %.1fx\n", (double)w64 / w1);
+    }
+    err += bench_run(64, 2, 0, 20000, 1) <= 0;
+    err += bench_run(1024, 1, 1, 200000, 0) <= 0;
+    err += bench_run(1, 0, 1, 200000, 0) <= 0;
+    printf("foo_async_bench %s\n", err ? "failed" : "ok");
+    return err;
+}
+
 int main(int argc, char** argv)
 {
     int rc = 0;
     int (*tests[])() = {NULL, test1/*, test2, test3*/};
     int i;
 
+    getopts(argc, argv);
+    if (options.bench) {
+        rc = foo_trie();
+        rc += foo_async_bench();
+        return rc;
+    }
+
     xml = fopen("TEST-test1.xml", "w");
     fprintf(xml, "<testsuite name=\"test1\" tests=\"%d\">\n", (int)(ARRAY_SIZE(tests) - 1));
 
-    getopts(argc, argv);
-
     for (i = 0; i < options.iterations; ++i) {
         if (options.test_no == 0) { /* run all the tests */
             for (options.test_no = 1; options.test_no < ARRAY_SIZE(tests); ++options.test_no)
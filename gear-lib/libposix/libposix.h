@@ -243,6 +243,71 @@ GEAR_API bool is_little_endian(void);
 
 GEAR_API int get_proc_name(char *name, size_t len);
 
+/******************************************************************************
+ * memory
+ *
+ * allocations are counted per subsystem tag, so mem_get_stat shows which
+ * library is churning the heap. mem_cache hands out fixed-size objects from
+ * slabs through per-thread free lists, mem_arena bump-allocates scratch
+ * memory released at once by mem_arena_reset. slabs, arenas and mem_malloc
+ * go through the allocator set by mem_set_allocator (libc by default).
+ ******************************************************************************/
+struct mem_allocator {
+    void *(*malloc)(size_t size);
+    void *(*calloc)(size_t nmemb, size_t size);
+    void *(*realloc)(void *ptr, size_t size);
+    void (*free)(void *ptr);
+};
+
+/* e.g. jemalloc or mimalloc, before the first allocation */
+GEAR_API void mem_set_allocator(const struct mem_allocator *alloc);
+
+#define MEM_TAG_MAX         64
+
+struct mem_tag_stat {
+    char name[32];
+    uint64_t allocs;
+    uint64_t frees;
+    int64_t bytes;              /* held now, slabs and arena blocks included */
+};
+
+/* tag of a subsystem, the same name gives the same tag. 0 is "default" */
+GEAR_API int mem_tag_register(const char *name);
+/* return the number of tags filled, other threads may lag by a few hundred ops */
+GEAR_API int mem_get_stat(struct mem_tag_stat *st, int max);
+
+GEAR_API void *mem_malloc(int tag, size_t size);
+GEAR_API void *mem_calloc(int tag, size_t nmemb, size_t size);
+GEAR_API void *mem_realloc(int tag, void *ptr, size_t size);
+GEAR_API void mem_free(void *ptr);
+GEAR_API char *mem_strdup(int tag, const char *s);
+
+struct mem_cache;
+
+/*
+ * caches are shared by name and refcounted, objects must all be freed before
+ * the last mem_cache_destroy. built with ASan each object is a plain
+ * allocation so use-after-free is still caught.
+ */
+GEAR_API struct mem_cache *mem_cache_create(const char *name, size_t size);
+GEAR_API void mem_cache_destroy(struct mem_cache *c);
+/* *c, created on first use and kept for the life of the process */
+GEAR_API struct mem_cache *mem_cache_get(struct mem_cache **c, const char *name, size_t size);
+GEAR_API void *mem_cache_alloc(struct mem_cache *c);
+GEAR_API void *mem_cache_zalloc(struct mem_cache *c);
+GEAR_API void mem_cache_free(struct mem_cache *c, void *ptr);
+
+struct mem_arena;
+
+GEAR_API struct mem_arena *mem_arena_create(int tag, size_t block_size);
+GEAR_API void mem_arena_destroy(struct mem_arena *a);
+/* 16-byte aligned, valid until reset or destroy */
+GEAR_API void *mem_arena_alloc(struct mem_arena *a, size_t size);
+GEAR_API void *mem_arena_zalloc(struct mem_arena *a, size_t size);
+GEAR_API char *mem_arena_strdup(struct mem_arena *a, const char *s);
+/* drop every allocation, blocks are kept for reuse */
+GEAR_API void mem_arena_reset(struct mem_arena *a);
+
 /*
  *       mbs
  *      /  \
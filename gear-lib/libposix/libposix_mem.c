@@ -0,0 +1,742 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#include "libposix.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+/* with ASan every cache object is its own allocation */
+#if defined(__SANITIZE_ADDRESS__)
+#define MEM_CACHE_PASSTHROUGH   1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define MEM_CACHE_PASSTHROUGH   1
+#endif
+#endif
+#ifndef MEM_CACHE_PASSTHROUGH
+#define MEM_CACHE_PASSTHROUGH   0
+#endif
+
+#if defined(_MSC_VER)
+#define mem_atomic_add(p, v)    InterlockedExchangeAdd64((volatile LONG64 *)(p), (v))
+#define mem_atomic_load(p)      InterlockedOr64((volatile LONG64 *)(p), 0)
+#define mem_ptr_load(p)         InterlockedCompareExchangePointer((PVOID volatile *)(p), NULL, NULL)
+#define mem_ptr_cas(p, o, n)    (InterlockedCompareExchangePointer((PVOID volatile *)(p), (n), (o)) == (o))
+#else
+#define mem_atomic_add(p, v)    __atomic_fetch_add(p, v, __ATOMIC_RELAXED)
+#define mem_atomic_load(p)      __atomic_load_n(p, __ATOMIC_RELAXED)
+#define mem_ptr_load(p)         __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define mem_ptr_cas(p, o, n)    __atomic_compare_exchange_n(p, &(o), n, 0, \
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#endif
+
+#define MEM_CACHE_MAX       64
+#define MEM_SLAB_SIZE       (64 * 1024)
+#define MEM_BATCH           32          /* objects moved between a thread and the depot */
+#define MEM_STAT_FLUSH      256         /* thread-local counts folded into the tag */
+#define MEM_ALIGN           16
+#define MEM_MAGIC           0x6d656d21
+
+/* one cache line per tag, counters of busy tags don't share it */
+struct mem_tag {
+    int64_t allocs;
+    int64_t frees;
+    int64_t bytes;
+    int64_t pad[5];
+};
+
+/* in front of every mem_malloc block */
+struct mem_hdr {
+    uint32_t tag;
+    uint32_t magic;
+    uint64_t size;
+};
+
+struct mem_cache {
+    char name[32];
+    size_t size;
+    int id;
+    int tag;
+    uint32_t gen;
+    int ref;
+    pthread_mutex_t lock;
+    void *depot;                /* free objects shared by all threads */
+    int depot_cnt;
+    void *slabs;
+};
+
+/* per thread free list of one cache */
+struct mem_tcache {
+    void *head;
+    int cnt;
+    uint32_t gen;
+    int allocs;
+    int frees;
+};
+
+struct mem_tls {
+    struct mem_tcache c[MEM_CACHE_MAX];
+};
+
+static struct mem_allocator mem_alloc = {malloc, calloc, realloc, free};
+static pthread_mutex_t mem_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct mem_tag mem_tags[MEM_TAG_MAX];
+static char mem_tag_names[MEM_TAG_MAX][32] = {"default"};
+static int mem_tag_cnt = 1;
+static struct mem_cache *mem_caches[MEM_CACHE_MAX];
+static uint32_t mem_cache_gen[MEM_CACHE_MAX];
+static pthread_key_t mem_key;
+static pthread_once_t mem_key_once = PTHREAD_ONCE_INIT;
+
+void mem_set_allocator(const struct mem_allocator *alloc)
+{
+    if (!alloc || !alloc->malloc || !alloc->calloc || !alloc->realloc || !alloc->free) {
+        printf("invalid paraments!\n");
+        return;
+    }
+    mem_alloc = *alloc;
+}
+
+int mem_tag_register(const char *name)
+{
+    int i;
+
+    if (!name) {
+        return 0;
+    }
+    pthread_mutex_lock(&mem_lock);
+    for (i = 0; i < mem_tag_cnt; i++) {
+        if (!strncmp(mem_tag_names[i], name, sizeof(mem_tag_names[i]) - 1)) {
+            break;
+        }
+    }
+    if (i == mem_tag_cnt) {
+        if (mem_tag_cnt == MEM_TAG_MAX) {
+            i = 0;
+        } else {
+            snprintf(mem_tag_names[i], sizeof(mem_tag_names[i]), "%s", name);
+            mem_tag_cnt++;
+        }
+    }
+    pthread_mutex_unlock(&mem_lock);
+    return i;
+}
+
+static void mem_key_create(void);
+static void tcache_flush_stat(struct mem_cache *c, struct mem_tcache *tc);
+
+int mem_get_stat(struct mem_tag_stat *st, int max)
+{
+    int i, cnt;
+    struct mem_tls *tls;
+    struct mem_cache *c;
+
+    if (!st || max <= 0) {
+        return 0;
+    }
+    pthread_once(&mem_key_once, mem_key_create);
+    tls = (struct mem_tls *)pthread_getspecific(mem_key);
+    pthread_mutex_lock(&mem_lock);
+    /* the caller's own counts, other threads lag by < MEM_STAT_FLUSH ops */
+    for (i = 0; tls && i < MEM_CACHE_MAX; i++) {
+        c = mem_caches[i];
+        if (c && c->gen == tls->c[i].gen) {
+            tcache_flush_stat(c, &tls->c[i]);
+        }
+    }
+    cnt = MIN2(mem_tag_cnt, max);
+    for (i = 0; i < cnt; i++) {
+        memcpy(st[i].name, mem_tag_names[i], sizeof(st[i].name));
+        st[i].allocs = mem_atomic_load(&mem_tags[i].allocs);
+        st[i].frees = mem_atomic_load(&mem_tags[i].frees);
+        st[i].bytes = mem_atomic_load(&mem_tags[i].bytes);
+    }
+    pthread_mutex_unlock(&mem_lock);
+    return cnt;
+}
+
+static struct mem_tag *tag_get(int tag)
+{
+    return &mem_tags[(tag > 0 && tag < MEM_TAG_MAX) ? tag : 0];
+}
+
+/******************************************************************************
+ * tagged malloc
+ ******************************************************************************/
+
+static void *hdr_init(struct mem_hdr *h, int tag, size_t size)
+{
+    struct mem_tag *t = tag_get(tag);
+
+    h->tag = (uint32_t)(t - mem_tags);
+    h->magic = MEM_MAGIC;
+    h->size = size;
+    mem_atomic_add(&t->allocs, 1);
+    mem_atomic_add(&t->bytes, (int64_t)size);
+    return h + 1;
+}
+
+void *mem_malloc(int tag, size_t size)
+{
+    struct mem_hdr *h = mem_alloc.malloc(sizeof(struct mem_hdr) + size);
+    return h ? hdr_init(h, tag, size) : NULL;
+}
+
+void *mem_calloc(int tag, size_t nmemb, size_t size)
+{
+    struct mem_hdr *h;
+
+    if (size && nmemb > (SIZE_MAX - sizeof(struct mem_hdr)) / size) {
+        return NULL;
+    }
+    h = mem_alloc.calloc(1, sizeof(struct mem_hdr) + nmemb * size);
+    return h ? hdr_init(h, tag, nmemb * size) : NULL;
+}
+
+void *mem_realloc(int tag, void *ptr, size_t size)
+{
+    struct mem_hdr *h, *nh;
+    struct mem_tag *t;
+
+    if (!ptr) {
+        return mem_malloc(tag, size);
+    }
+    h = (struct mem_hdr *)ptr - 1;
+    if (h->magic != MEM_MAGIC) {
+        printf("mem_realloc: %p is not from mem_malloc!\n", ptr);
+        return NULL;
+    }
+    t = &mem_tags[h->tag];
+    nh = mem_alloc.realloc(h, sizeof(struct mem_hdr) + size);
+    if (!nh) {
+        return NULL;
+    }
+    mem_atomic_add(&t->bytes, (int64_t)size - (int64_t)nh->size);
+    nh->size = size;
+    return nh + 1;
+}
+
+void mem_free(void *ptr)
+{
+    struct mem_hdr *h;
+    struct mem_tag *t;
+
+    if (!ptr) {
+        return;
+    }
+    h = (struct mem_hdr *)ptr - 1;
+    if (h->magic != MEM_MAGIC) {
+        printf("mem_free: %p is not from mem_malloc!\n", ptr);
+        return;
+    }
+    t = &mem_tags[h->tag];
+    mem_atomic_add(&t->frees, 1);
+    mem_atomic_add(&t->bytes, -(int64_t)h->size);
+    h->magic = 0;
+    mem_alloc.free(h);
+}
+
+char *mem_strdup(int tag, const char *s)
+{
+    size_t len;
+    char *p;
+
+    if (!s) {
+        return NULL;
+    }
+    len = strlen(s) + 1;
+    p = mem_malloc(tag, len);
+    if (p) {
+        memcpy(p, s, len);
+    }
+    return p;
+}
+
+/******************************************************************************
+ * slab cache
+ ******************************************************************************/
+
+#define OBJ_NEXT(p)     (*(void **)(p))
+
+static void tcache_flush_stat(struct mem_cache *c, struct mem_tcache *tc)
+{
+    struct mem_tag *t = &mem_tags[c->tag];
+
+    if (tc->allocs) {
+        mem_atomic_add(&t->allocs, tc->allocs);
+    }
+    if (tc->frees) {
+        mem_atomic_add(&t->frees, tc->frees);
+    }
+    tc->allocs = 0;
+    tc->frees = 0;
+}
+
+/* give a thread's objects back to their caches when it exits */
+static void mem_tls_destroy(void *arg)
+{
+    struct mem_tls *tls = (struct mem_tls *)arg;
+    struct mem_tcache *tc;
+    struct mem_cache *c;
+    void *tail;
+    int i;
+
+    pthread_mutex_lock(&mem_lock);
+    for (i = 0; i < MEM_CACHE_MAX; i++) {
+        tc = &tls->c[i];
+        c = mem_caches[i];
+        if (!c || c->gen != tc->gen) {
+            continue;
+        }
+        tcache_flush_stat(c, tc);
+        if (!tc->head) {
+            continue;
+        }
+        for (tail = tc->head; OBJ_NEXT(tail); tail = OBJ_NEXT(tail))
+            ;
+        pthread_mutex_lock(&c->lock);
+        OBJ_NEXT(tail) = c->depot;
+        c->depot = tc->head;
+        c->depot_cnt += tc->cnt;
+        pthread_mutex_unlock(&c->lock);
+    }
+    pthread_mutex_unlock(&mem_lock);
+    free(tls);
+}
+
+static void mem_key_create(void)
+{
+    pthread_key_create(&mem_key, mem_tls_destroy);
+}
+
+static struct mem_tcache *tcache_get(struct mem_cache *c)
+{
+    struct mem_tls *tls;
+    struct mem_tcache *tc;
+
+    pthread_once(&mem_key_once, mem_key_create);
+    tls = (struct mem_tls *)pthread_getspecific(mem_key);
+    if (UNLIKELY(!tls)) {
+        /* libc, not the hook: it's freed from the key destructor */
+        tls = calloc(1, sizeof(struct mem_tls));
+        if (!tls) {
+            return NULL;
+        }
+        pthread_setspecific(mem_key, tls);
+    }
+    tc = &tls->c[c->id];
+    if (UNLIKELY(tc->gen != c->gen)) {
+        /* the cache in this slot was destroyed, its objects went with it */
+        memset(tc, 0, sizeof(*tc));
+        tc->gen = c->gen;
+    }
+    return tc;
+}
+
+/* with c->lock held */
+static int slab_grow(struct mem_cache *c)
+{
+    char *slab, *p;
+    size_t off = ALIGN2(sizeof(void *), MEM_ALIGN);
+
+    slab = mem_alloc.malloc(MEM_SLAB_SIZE);
+    if (!slab) {
+        return -1;
+    }
+    OBJ_NEXT(slab) = c->slabs;
+    c->slabs = slab;
+    for (p = slab + off; p + c->size <= slab + MEM_SLAB_SIZE; p += c->size) {
+        OBJ_NEXT(p) = c->depot;
+        c->depot = p;
+        c->depot_cnt++;
+    }
+    mem_atomic_add(&mem_tags[c->tag].bytes, MEM_SLAB_SIZE);
+    return 0;
+}
+
+static int tcache_refill(struct mem_cache *c, struct mem_tcache *tc)
+{
+    void *head, *tail;
+    int n;
+
+    pthread_mutex_lock(&c->lock);
+    if (!c->depot && slab_grow(c) < 0) {
+        pthread_mutex_unlock(&c->lock);
+        return -1;
+    }
+    head = tail = c->depot;
+    for (n = 1; n < MEM_BATCH && OBJ_NEXT(tail); n++) {
+        tail = OBJ_NEXT(tail);
+    }
+    c->depot = OBJ_NEXT(tail);
+    c->depot_cnt -= n;
+    pthread_mutex_unlock(&c->lock);
+    OBJ_NEXT(tail) = tc->head;
+    tc->head = head;
+    tc->cnt += n;
+    tcache_flush_stat(c, tc);
+    return 0;
+}
+
+static void tcache_drain(struct mem_cache *c, struct mem_tcache *tc)
+{
+    void *head = tc->head, *tail = tc->head;
+    int n;
+
+    for (n = 1; n < MEM_BATCH; n++) {
+        tail = OBJ_NEXT(tail);
+    }
+    tc->head = OBJ_NEXT(tail);
+    tc->cnt -= n;
+    pthread_mutex_lock(&c->lock);
+    OBJ_NEXT(tail) = c->depot;
+    c->depot = head;
+    c->depot_cnt += n;
+    pthread_mutex_unlock(&c->lock);
+    tcache_flush_stat(c, tc);
+}
+
+struct mem_cache *mem_cache_create(const char *name, size_t size)
+{
+    struct mem_cache *c = NULL;
+    int i, id = -1;
+
+    if (!name || size == 0 || size > MEM_SLAB_SIZE / 8) {
+        printf("invalid paraments!\n");
+        return NULL;
+    }
+    size = ALIGN2(MAX2(size, sizeof(void *)), MEM_ALIGN);
+    pthread_mutex_lock(&mem_lock);
+    for (i = 0; i < MEM_CACHE_MAX; i++) {
+        if (mem_caches[i] && !strcmp(mem_caches[i]->name, name)) {
+            c = mem_caches[i];
+            break;
+        }
+        if (!mem_caches[i] && id == -1) {
+            id = i;
+        }
+    }
+    if (c) {
+        if (c->size == size) {
+            c->ref++;
+        } else {
+            printf("mem_cache %s exists with size %zu\n", name, c->size);
+            c = NULL;
+        }
+        pthread_mutex_unlock(&mem_lock);
+        return c;
+    }
+    pthread_mutex_unlock(&mem_lock);
+
+    i = mem_tag_register(name);
+    pthread_mutex_lock(&mem_lock);
+    if (id == -1 || mem_caches[id]) {
+        /* raced with another create, look again */
+        for (id = 0; id < MEM_CACHE_MAX && mem_caches[id]; id++)
+            ;
+    }
+    if (id < MEM_CACHE_MAX) {
+        c = calloc(1, sizeof(struct mem_cache));
+    }
+    if (c) {
+        snprintf(c->name, sizeof(c->name), "%s", name);
+        c->size = size;
+        c->id = id;
+        c->tag = i;
+        c->ref = 1;
+        c->gen = ++mem_cache_gen[id];
+        pthread_mutex_init(&c->lock, NULL);
+        mem_caches[id] = c;
+    } else {
+        printf("mem_cache_create %s failed!\n", name);
+    }
+    pthread_mutex_unlock(&mem_lock);
+    return c;
+}
+
+void mem_cache_destroy(struct mem_cache *c)
+{
+    void *slab, *next;
+    int64_t bytes = 0;
+
+    if (!c) {
+        return;
+    }
+    pthread_mutex_lock(&mem_lock);
+    if (--c->ref > 0) {
+        pthread_mutex_unlock(&mem_lock);
+        return;
+    }
+    mem_caches[c->id] = NULL;
+    pthread_mutex_unlock(&mem_lock);
+    for (slab = c->slabs; slab; slab = next) {
+        next = OBJ_NEXT(slab);
+        mem_alloc.free(slab);
+        bytes += MEM_SLAB_SIZE;
+    }
+    mem_atomic_add(&mem_tags[c->tag].bytes, -bytes);
+    pthread_mutex_destroy(&c->lock);
+    free(c);
+}
+
+struct mem_cache *mem_cache_get(struct mem_cache **pc, const char *name, size_t size)
+{
+    struct mem_cache *c = mem_ptr_load(pc), *old = NULL;
+
+    if (LIKELY(c != NULL)) {
+        return c;
+    }
+    c = mem_cache_create(name, size);
+    if (c && !mem_ptr_cas(pc, old, c)) {
+        /* another thread got there first, same cache by name */
+        mem_cache_destroy(c);
+        c = mem_ptr_load(pc);
+    }
+    return c;
+}
+
+void *mem_cache_alloc(struct mem_cache *c)
+{
+    struct mem_tcache *tc;
+    void *p;
+
+    if (UNLIKELY(!c)) {
+        return NULL;
+    }
+    if (MEM_CACHE_PASSTHROUGH) {
+        p = mem_alloc.malloc(c->size);
+        if (p) {
+            mem_atomic_add(&mem_tags[c->tag].allocs, 1);
+            mem_atomic_add(&mem_tags[c->tag].bytes, (int64_t)c->size);
+        }
+        return p;
+    }
+    tc = tcache_get(c);
+    if (UNLIKELY(!tc || (!tc->head && tcache_refill(c, tc) < 0))) {
+        return NULL;
+    }
+    p = tc->head;
+    tc->head = OBJ_NEXT(p);
+    tc->cnt--;
+    if (UNLIKELY(++tc->allocs >= MEM_STAT_FLUSH)) {
+        tcache_flush_stat(c, tc);
+    }
+    return p;
+}
+
+void mem_cache_free(struct mem_cache *c, void *ptr)
+{
+    struct mem_tcache *tc;
+
+    if (UNLIKELY(!c || !ptr)) {
+        return;
+    }
+    if (MEM_CACHE_PASSTHROUGH) {
+        mem_atomic_add(&mem_tags[c->tag].frees, 1);
+        mem_atomic_add(&mem_tags[c->tag].bytes, -(int64_t)c->size);
+        mem_alloc.free(ptr);
+        return;
+    }
+    tc = tcache_get(c);
+    if (UNLIKELY(!tc)) {
+        /* no thread cache, straight to the depot */
+        pthread_mutex_lock(&c->lock);
+        OBJ_NEXT(ptr) = c->depot;
+        c->depot = ptr;
+        c->depot_cnt++;
+        pthread_mutex_unlock(&c->lock);
+        mem_atomic_add(&mem_tags[c->tag].frees, 1);
+        return;
+    }
+    OBJ_NEXT(ptr) = tc->head;
+    tc->head = ptr;
+    tc->cnt++;
+    tc->frees++;
+    if (UNLIKELY(tc->cnt > 2 * MEM_BATCH)) {
+        tcache_drain(c, tc);
+    } else if (UNLIKELY(tc->frees >= MEM_STAT_FLUSH)) {
+        tcache_flush_stat(c, tc);
+    }
+}
+
+void *mem_cache_zalloc(struct mem_cache *c)
+{
+    void *p = mem_cache_alloc(c);
+    if (p) {
+        memset(p, 0, c->size);
+    }
+    return p;
+}
+
+/******************************************************************************
+ * arena
+ ******************************************************************************/
+
+struct mem_block {
+    struct mem_block *next;
+    size_t size;
+    size_t used;
+};
+
+#define BLOCK_HDR       ALIGN2(sizeof(struct mem_block), MEM_ALIGN)
+#define BLOCK_DATA(b)   ((char *)(b) + BLOCK_HDR)
+
+struct mem_arena {
+    int tag;
+    size_t block_size;
+    struct mem_block *cur;      /* bump from here, then the rest in use */
+    struct mem_block *spare;    /* kept over reset */
+    struct mem_block *large;    /* one allocation each, freed on reset */
+};
+
+static struct mem_block *block_new(struct mem_arena *a, size_t size)
+{
+    struct mem_block *b = mem_alloc.malloc(BLOCK_HDR + size);
+    if (!b) {
+        return NULL;
+    }
+    b->size = size;
+    b->used = 0;
+    mem_atomic_add(&mem_tags[a->tag].allocs, 1);
+    mem_atomic_add(&mem_tags[a->tag].bytes, (int64_t)(BLOCK_HDR + size));
+    return b;
+}
+
+static void block_free_list(struct mem_arena *a, struct mem_block *b)
+{
+    struct mem_block *next;
+    for (; b; b = next) {
+        next = b->next;
+        mem_atomic_add(&mem_tags[a->tag].frees, 1);
+        mem_atomic_add(&mem_tags[a->tag].bytes, -(int64_t)(BLOCK_HDR + b->size));
+        mem_alloc.free(b);
+    }
+}
+
+struct mem_arena *mem_arena_create(int tag, size_t block_size)
+{
+    struct mem_arena *a = calloc(1, sizeof(struct mem_arena));
+    if (!a) {
+        printf("malloc mem_arena failed!\n");
+        return NULL;
+    }
+    a->tag = (int)(tag_get(tag) - mem_tags);
+    a->block_size = ALIGN2(block_size ? block_size : 4096, MEM_ALIGN);
+    return a;
+}
+
+void mem_arena_destroy(struct mem_arena *a)
+{
+    if (!a) {
+        return;
+    }
+    block_free_list(a, a->cur);
+    block_free_list(a, a->spare);
+    block_free_list(a, a->large);
+    free(a);
+}
+
+void *mem_arena_alloc(struct mem_arena *a, size_t size)
+{
+    struct mem_block *b;
+    void *p;
+
+    if (UNLIKELY(!a)) {
+        return NULL;
+    }
+    size = ALIGN2(size ? size : 1, MEM_ALIGN);
+    b = a->cur;
+    if (LIKELY(b && b->size - b->used >= size)) {
+        p = BLOCK_DATA(b) + b->used;
+        b->used += size;
+        return p;
+    }
+    if (size > a->block_size / 4) {
+        /* big ones get their own block, the current one keeps bumping */
+        b = block_new(a, size);
+        if (!b) {
+            return NULL;
+        }
+        b->next = a->large;
+        a->large = b;
+        b->used = size;
+        return BLOCK_DATA(b);
+    }
+    if (a->spare) {
+        b = a->spare;
+        a->spare = b->next;
+    } else {
+        b = block_new(a, a->block_size);
+        if (!b) {
+            return NULL;
+        }
+    }
+    b->used = size;
+    b->next = a->cur;
+    a->cur = b;
+    return BLOCK_DATA(b);
+}
+
+void *mem_arena_zalloc(struct mem_arena *a, size_t size)
+{
+    void *p = mem_arena_alloc(a, size);
+    if (p) {
+        memset(p, 0, size);
+    }
+    return p;
+}
+
+char *mem_arena_strdup(struct mem_arena *a, const char *s)
+{
+    size_t len;
+    char *p;
+
+    if (!s) {
+        return NULL;
+    }
+    len = strlen(s) + 1;
+    p = mem_arena_alloc(a, len);
+    if (p) {
+        memcpy(p, s, len);
+    }
+    return p;
+}
+
+void mem_arena_reset(struct mem_arena *a)
+{
+    struct mem_block *b, *next;
+
+    if (!a) {
+        return;
+    }
+    for (b = a->cur; b; b = next) {
+        next = b->next;
+        b->used = 0;
+        b->next = a->spare;
+        a->spare = b;
+    }
+    a->cur = NULL;
+    block_free_list(a, a->large);
+    a->large = NULL;
+}
@@ -22,12 +22,14 @@
 #include "libposix.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <pthread.h>
 #include <errno.h>
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
 #include <sys/stat.h>
+#include <time.h>
 
 typedef int (*add2_fn)(char* a, char* b);
 typedef int (*add3_fn)(char* a, char* b, char *c);
@@ -84,9 +86,191 @@ void foo()
     printf("read pipe buf = %s\n", buf);
 }
 
+#define MEM_LOOPS   (1000000)
+#define MEM_BATCH   (64)
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#define MEM_OBJ_SIZE    (48)
+#define MEM_THREADS     (4)
+
+struct mem_thread_arg {
+    struct mem_cache *c;
+    int id;
+    int overlap;
+};
+
+/* each thread fills its objects with its id, an object handed out twice gets overwritten */
+static void *mem_thread(void *arg)
+{
+    struct mem_thread_arg *ta = (struct mem_thread_arg *)arg;
+    unsigned char *obj[MEM_BATCH];
+    int i, j, k;
+    for (i = 0; i < MEM_LOOPS / MEM_BATCH; i++) {
+        for (j = 0; j < MEM_BATCH; j++) {
+            obj[j] = (unsigned char *)mem_cache_alloc(ta->c);
+            if (obj[j]) {
+                memset(obj[j], ta->id, MEM_OBJ_SIZE);
+            }
+        }
+        for (j = 0; j < MEM_BATCH; j++) {
+            if (!obj[j]) {
+                ta->overlap++;
+                continue;
+            }
+            for (k = 0; k < MEM_OBJ_SIZE; k++) {
+                if (obj[j][k] != ta->id) {
+                    ta->overlap++;
+                    break;
+                }
+            }
+            mem_cache_free(ta->c, obj[j]);
+        }
+    }
+    return NULL;
+}
+
+static struct mem_tag_stat *mem_find_stat(struct mem_tag_stat *st, int n, const char *name)
+{
+    int i;
+    for (i = 0; i < n; i++) {
+        if (!strcmp(st[i].name, name)) {
+            return &st[i];
+        }
+    }
+    return NULL;
+}
+
+int foo_mem()
+{
+    int i, j, k, n, ret = 0;
+    uint64_t t;
+    void *obj[MEM_BATCH];
+    pthread_t tid[MEM_THREADS];
+    struct mem_thread_arg ta[MEM_THREADS];
+    struct mem_tag_stat st[MEM_TAG_MAX];
+    struct mem_tag_stat *s;
+    struct mem_cache *c = mem_cache_create("test_obj", MEM_OBJ_SIZE);
+    int tag = mem_tag_register("test");
+    struct mem_arena *a = mem_arena_create(tag, 4096);
+    char *p;
+
+    for (i = 0; i < MEM_THREADS; i++) {
+        ta[i].c = c;
+        ta[i].id = i + 1;
+        ta[i].overlap = 0;
+        pthread_create(&tid[i], NULL, mem_thread, &ta[i]);
+    }
+    for (i = 0; i < MEM_THREADS; i++) {
+        pthread_join(tid[i], NULL);
+        if (ta[i].overlap) {
+            printf("mem_cache: thread %d saw %d objects in use elsewhere\n", i, ta[i].overlap);
+            ret = -1;
+        }
+    }
+    /* exited threads have folded their counts into the tag */
+    n = mem_get_stat(st, MEM_TAG_MAX);
+    s = mem_find_stat(st, n, "test_obj");
+    if (!s || s->allocs != s->frees ||
+        s->allocs < (uint64_t)MEM_THREADS * (MEM_LOOPS / MEM_BATCH) * MEM_BATCH) {
+        printf("mem_cache: test_obj allocs=%" PRIu64 " frees=%" PRIu64 " after the threads\n",
+               s ? s->allocs : 0, s ? s->frees : 0);
+        ret = -1;
+    }
+
+    /* objects the threads filled come back zeroed */
+    for (j = 0; j < MEM_BATCH; j++) {
+        obj[j] = mem_cache_zalloc(c);
+        for (k = 0; obj[j] && k < MEM_OBJ_SIZE; k++) {
+            if (((unsigned char *)obj[j])[k]) {
+                printf("mem_cache_zalloc: object not zeroed\n");
+                ret = -1;
+                break;
+            }
+        }
+    }
+    for (j = 0; j < MEM_BATCH; j++) {
+        mem_cache_free(c, obj[j]);
+    }
+
+    t = now_ns();
+    for (i = 0; i < MEM_LOOPS / MEM_BATCH; i++) {
+        for (j = 0; j < MEM_BATCH; j++) {
+            obj[j] = mem_cache_zalloc(c);
+        }
+        for (j = 0; j < MEM_BATCH; j++) {
+            mem_cache_free(c, obj[j]);
+        }
+    }
+    t = now_ns() - t;
+    printf("mem_cache_zalloc/free %.1f ns/op\n", (double)t / MEM_LOOPS);
+
+    t = now_ns();
+    for (i = 0; i < MEM_LOOPS / MEM_BATCH; i++) {
+        for (j = 0; j < MEM_BATCH; j++) {
+            obj[j] = calloc(1, MEM_OBJ_SIZE);
+        }
+        for (j = 0; j < MEM_BATCH; j++) {
+            free(obj[j]);
+        }
+    }
+    t = now_ns() - t;
+    printf("calloc/free %.1f ns/op\n", (double)t / MEM_LOOPS);
+
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < 1000; j++) {
+            p = mem_arena_strdup(a, "arena string");
+            if (!p || strcmp(p, "arena string")) {
+                printf("mem_arena_strdup failed!\n");
+                ret = -1;
+            }
+        }
+        mem_arena_alloc(a, 8192);
+        mem_arena_reset(a);
+    }
+    p = mem_strdup(tag, "tagged string");
+    printf("mem_strdup %s\n", p);
+    n = mem_get_stat(st, MEM_TAG_MAX);
+    s = mem_find_stat(st, n, "test");
+    if (!s || s->bytes <= 0) {
+        printf("mem_strdup: test tag holds no bytes\n");
+        ret = -1;
+    }
+    mem_free(p);
+    mem_arena_destroy(a);
+
+    n = mem_get_stat(st, MEM_TAG_MAX);
+    for (i = 0; i < n; i++) {
+        printf("tag %-16s allocs=%" PRIu64 " frees=%" PRIu64 " bytes=%" PRId64 "\n",
+               st[i].name, st[i].allocs, st[i].frees, st[i].bytes);
+    }
+    /* the string and every arena block are given back */
+    s = mem_find_stat(st, n, "test");
+    if (!s || s->bytes != 0 || s->allocs != s->frees) {
+        printf("mem: test tag leaks after mem_free and mem_arena_destroy\n");
+        ret = -1;
+    }
+    s = mem_find_stat(st, n, "test_obj");
+    if (!s || s->allocs != s->frees) {
+        printf("mem_cache: test_obj allocs != frees\n");
+        ret = -1;
+    }
+    mem_cache_destroy(c);
+    printf("%s: %s\n", __func__, ret ? "failed" : "pass");
+    return ret;
+}
+
 int main(int argc, char **argv)
 {
     foo();
+    if (foo_mem()) {
+        return -1;
+    }
 
     REFLECT_CALL(add2_fn, "add2", "4", "2");
     REFLECT_CALL(add3_fn, "add3", "1", "4", "2");
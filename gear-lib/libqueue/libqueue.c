@@ -33,13 +33,16 @@
 
 #define QUEUE_MAX_DEPTH 200
 
+static struct mem_cache *queue_item_cache;
+
 struct queue_item *queue_item_alloc(struct queue *q, void *data, size_t len, void *arg)
 {
     struct queue_item *item;
     if (!q || !data || len == 0) {
         return NULL;
     }
-    item = CALLOC(1, struct queue_item);
+    item = mem_cache_zalloc(mem_cache_get(&queue_item_cache, "queue_item",
+                                          sizeof(struct queue_item)));
     if (!item) {
         printf("malloc failed!\n");
         return NULL;
@@ -67,7 +70,7 @@ void queue_item_free(struct queue *q, struct queue_item *item)
     } else {
         free(item->data.iov_base);
     }
-    free(item);
+    mem_cache_free(queue_item_cache, item);
 }
 
 struct iovec *queue_item_get_data(struct queue *q, struct queue_item *it)
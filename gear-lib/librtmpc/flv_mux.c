@@ -179,8 +179,26 @@ static int32_t get_ms_time_a(struct audio_packet *packet, int64_t val)
     return (int32_t)(val * MILLISECOND_DEN / packet->encoder.timebase.den);
 }
 
+size_t flv_video_tag_header(uint8_t *buf, bool key_frame, bool is_hdr, int32_t cts)
+{
+    buf[0] = (key_frame ? FLV_FRAME_KEY : FLV_FRAME_INTER) | FLV_CODECID_H264;
+    buf[1] = is_hdr ? 0 : 1;
+    buf[2] = (cts >> 16) & 0xff;
+    buf[3] = (cts >> 8) & 0xff;
+    buf[4] = cts & 0xff;
+    return FLV_VIDEO_TAG_HEADER_SIZE;
+}
+
+size_t flv_audio_tag_header(uint8_t *buf, bool is_hdr)
+{
+    buf[0] = FLV_CODECID_AAC|FLV_SAMPLERATE_44100HZ|FLV_SAMPLESSIZE_16BIT|FLV_STEREO;
+    buf[1] = is_hdr ? 0 : 1;
+    return FLV_AUDIO_TAG_HEADER_SIZE;
+}
+
 static int write_video(struct serializer *s, struct video_packet *vp, int32_t dts_offset, bool is_hdr)
 {
+    uint8_t hdr[FLV_VIDEO_TAG_HEADER_SIZE];
     uint8_t *data;
     size_t size;
     int64_t offset = vp->pts - vp->dts;
@@ -192,9 +210,7 @@ static int write_video(struct serializer *s, struct video_packet *vp, int32_t dt
     s_wb24(s, time_ms);
     s_w8(s, (time_ms >> 24) & 0x7f);
     s_wb24(s, 0);
-    s_w8(s, (vp->key_frame?FLV_FRAME_KEY:FLV_FRAME_INTER) | FLV_CODECID_H264);
-    s_w8(s, is_hdr ? 0 : 1);
-    s_wb24(s, get_ms_time_v(vp, offset));
+    s_write(s, hdr, flv_video_tag_header(hdr, vp->key_frame, is_hdr, get_ms_time_v(vp, offset)));
 
     s_write(s, vp->data, vp->size);
     s_wb32(s, s_getpos(s) - 1);
@@ -206,6 +222,7 @@ static int write_video(struct serializer *s, struct video_packet *vp, int32_t dt
 
 static int write_audio(struct serializer *s, struct audio_packet *ap, int32_t dts_offset, bool is_hdr)
 {
+    uint8_t hdr[FLV_AUDIO_TAG_HEADER_SIZE];
     int32_t time_ms = get_ms_time_a(ap, ap->dts) - dts_offset;
 
     s_w8(s, FLV_TAG_TYPE_AUDIO);
@@ -213,8 +230,7 @@ static int write_audio(struct serializer *s, struct audio_packet *ap, int32_t dt
     s_wb24(s, time_ms);
     s_w8(s, (time_ms >> 24) & 0x7F);
     s_wb24(s, 0);
-    s_w8(s, FLV_CODECID_AAC|FLV_SAMPLERATE_44100HZ|FLV_SAMPLESSIZE_16BIT|FLV_STEREO);
-    s_w8(s, is_hdr ? 0 : 1);
+    s_write(s, hdr, flv_audio_tag_header(hdr, is_hdr));
     s_write(s, ap->data, ap->size);
     s_wb32(s, s_getpos(s) - 1);
 
@@ -234,7 +250,7 @@ static void s_amf_double(struct serializer *s, double d)
     s_wb64(s, dbl2int(d));
 }
 
-static int build_meta_data(struct flv_muxer *flv, uint8_t **output, size_t *size)
+int flv_mux_meta_data(struct flv_muxer *flv, uint8_t **output, size_t *size)
 {
     struct serializer *s, ss;
     uint8_t *data;
@@ -326,7 +342,7 @@ static int write_meta(struct serializer *s, struct flv_muxer *flv)
     uint8_t *meta = NULL;
     size_t meta_size;
     uint32_t start_pos;
-    build_meta_data(flv, &meta, &meta_size);
+    flv_mux_meta_data(flv, &meta, &meta_size);
 
     start_pos = s_getpos(s);
 
@@ -342,176 +358,46 @@ static int write_meta(struct serializer *s, struct flv_muxer *flv)
     return 0;
 }
 
-static bool has_start_code(const uint8_t *data)
-{
-    if (data[0] != 0 || data[1] != 0)
-        return false;
-
-    return data[2] == 1 || (data[2] == 0 && data[3] == 1);
-}
-
-static const uint8_t *ff_avc_find_startcode_internal(const uint8_t *p,
-                    const uint8_t *end)
-{
-    const uint8_t *a = p + 4 - ((intptr_t)p & 3);
-
-    for (end -= 3; p < a && p < end; p++) {
-        if (p[0] == 0 && p[1] == 0 && p[2] == 1)
-            return p;
-    }
-
-    for (end -= 3; p < end; p += 4) {
-        uint32_t x = *(const uint32_t *)p;
-        if ((x - 0x01010101) & (~x) & 0x80808080) {
-            if (p[1] == 0) {
-                if (p[0] == 0 && p[2] == 1)
-                    return p;
-                if (p[2] == 0 && p[3] == 1)
-                    return p + 1;
-            }
-
-            if (p[3] == 0) {
-                if (p[2] == 0 && p[4] == 1)
-                    return p + 2;
-                if (p[4] == 0 && p[5] == 1)
-                    return p + 3;
-            }
-        }
-    }
-
-    for (end += 3; p < end; p++) {
-        if (p[0] == 0 && p[1] == 0 && p[2] == 1)
-            return p;
-    }
-
-    return end + 3;
-}
-
-static const uint8_t *avc_find_startcode(const uint8_t *p, const uint8_t *end)
-{
-    const uint8_t *out = ff_avc_find_startcode_internal(p, end);
-    if (p < out && out < end && !out[-1])
-        out--;
-    return out;
-}
-
-static void get_sps_pps(const uint8_t *data, size_t size, const uint8_t **sps,
-                        size_t *sps_size, const uint8_t **pps, size_t *pps_size)
-{
-    const uint8_t *nal_start, *nal_end;
-    const uint8_t *end = data + size;
-    int type;
-
-    nal_start = avc_find_startcode(data, end);
-    while (true) {
-        while (nal_start < end && !*(nal_start++))
-            ;
-        if (nal_start == end)
-            break;
-        nal_end = avc_find_startcode(nal_start, end);
-        type = nal_start[0] & 0x1F;
-        switch (type) {
-        case H264_NAL_SPS:
-            *sps = nal_start;
-            *sps_size = nal_end - nal_start;
-            break;
-        case H264_NAL_PPS:
-            *pps = nal_start;
-            *pps_size = nal_end - nal_start;
-            break;
-        }
-
-        nal_start = nal_end;
-    }
-}
-
 static size_t parse_avc_header(const struct video_packet *src, struct video_packet *dst)
 {
-    uint8_t *header;
-    struct serializer s;
-    const uint8_t *sps = NULL, *pps = NULL;
-    size_t sps_size = 0, pps_size = 0;
-
+    ssize_t size;
     const uint8_t *extra_data = src->encoder.extra_data;
     size_t extra_size = src->encoder.extra_size;
-    serializer_array_init(&s);
 
     if (extra_size <= 6) {
         printf("%s:%d extra_size=%zu\n", __func__, __LINE__, extra_size);
         return 0;
     }
 
-    if (!has_start_code(extra_data)) {
+    if (!h26x_has_start_code(extra_data, extra_size)) {
         dst->data = memdup(extra_data, extra_size);
         return extra_size;
     }
 
-    get_sps_pps(extra_data, extra_size, &sps, &sps_size, &pps, &pps_size);
-    if (!sps || !pps || sps_size < 4) {
+    size = h264_avcc_config(extra_data, extra_size, NULL, 0);
+    if (size < 0) {
         return 0;
     }
-
-    s_w8(&s, 0x01);
-    s_write(&s, sps + 1, 3);
-    s_w8(&s, 0xff);
-    s_w8(&s, 0xe1);
-
-    s_wb16(&s, (uint16_t)sps_size);
-    s_write(&s, sps, sps_size);
-    s_w8(&s, 0x01);
-    s_wb16(&s, (uint16_t)pps_size);
-    s_write(&s, pps, pps_size);
-
-    serializer_array_get_data(&s, &header, &extra_size);
-    dst->data = memdup(header, extra_size);
-    dst->size = extra_size;
-    serializer_array_deinit(&s);
-    memcpy(&dst->encoder, &src->encoder, sizeof(struct video_encoder));
-    return extra_size;
-}
-
-
-
-static void serialize_avc_data(struct serializer *s, const uint8_t *data,
-                size_t size, bool *is_keyframe)
-{
-    const uint8_t *nal_start, *nal_end;
-    const uint8_t *end = data + size;
-    int type;
-
-    nal_start = avc_find_startcode(data, end);
-    while (true) {
-        while (nal_start < end && !*(nal_start++))
-            ;
-        if (nal_start == end)
-            break;
-        type = nal_start[0] & 0x1F;
-        if (type == H264_NAL_IDR_SLICE || type == H264_NAL_SLICE) {
-            if (is_keyframe)
-                *is_keyframe = (type == H264_NAL_IDR_SLICE);
-        }
-        nal_end = avc_find_startcode(nal_start, end);
-        s_wb32(s, (uint32_t)(nal_end - nal_start));
-        s_write(s, nal_start, nal_end - nal_start);
-        nal_start = nal_end;
+    dst->data = malloc(size);
+    if (!dst->data) {
+        return 0;
     }
-
+    h264_avcc_config(extra_data, extra_size, dst->data, size);
+    dst->size = size;
+    memcpy(&dst->encoder, &src->encoder, sizeof(struct video_encoder));
+    return size;
 }
 
 static void parse_avc_packet(const struct video_packet *src, struct video_packet *dst)
 {
-    uint8_t *data;
-    size_t size;
-    struct serializer s;
-
-    serializer_array_init(&s);
+    ssize_t size = h26x_annexb_to_avcc(src->data, src->size, NULL, 0);
 
-    serialize_avc_data(&s, src->data, src->size, &dst->key_frame);
-    serializer_array_get_data(&s, &data, &size);
-
-    dst->data = memdup(data, size);
-    dst->size = size;
-    serializer_array_deinit(&s);
+    dst->key_frame = h26x_is_keyframe(VIDEO_CODEC_H264, src->data, src->size);
+    dst->data = (size > 0) ? malloc(size) : NULL;
+    if (dst->data) {
+        h26x_annexb_to_avcc(src->data, src->size, dst->data, size);
+        dst->size = size;
+    }
     memcpy(&dst->encoder, &src->encoder, sizeof(struct video_encoder));
 }
 
@@ -47,6 +47,17 @@ void flv_mux_destroy(struct flv_muxer *flv);
 
 int flv_write_packet(struct flv_muxer *flv, struct media_packet *pkt);
 
+/*
+ * tag body pieces for writers that frame FLV payloads themselves (the RTMP
+ * chunk path): onMetaData script data (caller frees *output), and the
+ * VideoTagHeader / AudioTagHeader that precede the AVC / AAC payload.
+ */
+#define FLV_VIDEO_TAG_HEADER_SIZE   5
+#define FLV_AUDIO_TAG_HEADER_SIZE   2
+int flv_mux_meta_data(struct flv_muxer *flv, uint8_t **output, size_t *size);
+size_t flv_video_tag_header(uint8_t *buf, bool key_frame, bool is_hdr, int32_t cts);
+size_t flv_audio_tag_header(uint8_t *buf, bool is_hdr);
+
 #ifdef __cplusplus
 }
 #endif
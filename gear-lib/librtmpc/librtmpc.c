@@ -20,6 +20,7 @@
  * SOFTWARE.
  ******************************************************************************/
 #include "librtmpc.h"
+#include "rtmpc_sched.h"
 #include "rtmp.h"
 #include "log.h"
 #include <stdio.h>
@@ -27,35 +28,280 @@
 #include <unistd.h>
 #include <string.h>
 
-void rtmpc_destroy(struct rtmpc *rtmpc)
+/*
+ * Direct media_packet -> RTMP chunk stream path: the FLV tag body is never
+ * assembled in memory. Each NAL unit of the Annex-B input is referenced in
+ * place by an iovec, preceded by its 4 byte AVCC length prefix, and
+ * RTMP_SendPacketv() interleaves the chunk headers and writev()s it.
+ */
+#define RTMPC_CHANNEL_DATA      0x04
+#define RTMPC_CHANNEL_AUDIO     0x05
+#define RTMPC_CHANNEL_VIDEO     0x06
+
+enum rtmpc_cs {
+    RTMPC_CS_DATA = 0,
+    RTMPC_CS_AUDIO,
+    RTMPC_CS_VIDEO,
+    RTMPC_CS_MAX,
+};
+
+struct rtmpc_chunk {
+    struct iovec *iov;              /* tag header, then prefix/NAL pairs */
+    uint8_t      *prefix;           /* AVCC length prefixes, 4 bytes each */
+    int           max_nal;
+    bool          got_start;
+    uint32_t      start_ms;
+    uint32_t      last_ts[RTMPC_CS_MAX];
+    bool          started[RTMPC_CS_MAX];
+};
+
+static struct rtmpc_chunk *rtmpc_chunk_create(void)
 {
-    if (!rtmpc) {
+    struct rtmpc_chunk *c = calloc(1, sizeof(struct rtmpc_chunk));
+    if (!c) {
+        printf("malloc rtmpc_chunk failed!\n");
+        return NULL;
+    }
+    return c;
+}
+
+static void rtmpc_chunk_destroy(struct rtmpc_chunk *c)
+{
+    if (!c) {
         return;
     }
-    RTMP_Close(rtmpc->base);
-    RTMP_Free(rtmpc->base);
-    rtmpc->base = NULL;
-    queue_destroy(rtmpc->q);
-    flv_mux_destroy(rtmpc->flv);
-    free(rtmpc);
+    free(c->iov);
+    free(c->prefix);
+    free(c);
 }
 
-static void *item_alloc_hook(void *data, size_t len, void *arg)
+static int rtmpc_chunk_grow(struct rtmpc_chunk *c, int filled)
 {
-    struct media_packet *new_pkt;
-    struct media_packet *pkt = (struct media_packet *)arg;
-    if (!pkt) {
-        printf("calloc packet failed!\n");
-        return NULL;
+    int i, max_nal = c->max_nal ? c->max_nal * 2 : 16;
+    struct iovec *iov = realloc(c->iov, sizeof(struct iovec) * (1 + 2 * max_nal));
+    uint8_t *prefix;
+
+    if (!iov) {
+        return -1;
+    }
+    c->iov = iov;
+    prefix = realloc(c->prefix, 4 * max_nal);
+    if (!prefix) {
+        return -1;
+    }
+    c->prefix = prefix;
+    c->max_nal = max_nal;
+    for (i = 0; i < filled; i++) {
+        c->iov[1 + 2 * i].iov_base = c->prefix + 4 * i;
+    }
+    return 0;
+}
+
+static inline uint32_t rtmpc_ms(uint64_t val, rational_t timebase)
+{
+    return timebase.den ? (uint32_t)(val * 1000 / timebase.den) : (uint32_t)val;
+}
+
+static int rtmpc_send_message(struct rtmpc *rtmpc, enum rtmpc_cs cs, uint8_t type,
+                uint32_t ts, const struct iovec *iov, int iovcnt)
+{
+    static const int channel[RTMPC_CS_MAX] = {
+        RTMPC_CHANNEL_DATA, RTMPC_CHANNEL_AUDIO, RTMPC_CHANNEL_VIDEO
+    };
+    struct rtmpc_chunk *c = rtmpc->chunk;
+    RTMP *r = rtmpc->base;
+    RTMPPacket packet;
+    uint32_t size = 0;
+    int i;
+
+    for (i = 0; i < iovcnt; i++) {
+        size += iov[i].iov_len;
+    }
+    memset(&packet, 0, sizeof(packet));
+    packet.m_nChannel = channel[cs];
+    /* a timestamp going backwards can not be sent as a delta */
+    packet.m_headerType = (c->started[cs] && ts >= c->last_ts[cs]) ?
+                          RTMP_PACKET_SIZE_MEDIUM : RTMP_PACKET_SIZE_LARGE;
+    packet.m_packetType = type;
+    packet.m_nTimeStamp = ts;
+    packet.m_nInfoField2 = r->Link.streams[0].id;
+    packet.m_nBodySize = size;
+    if (!RTMP_SendPacketv(r, &packet, iov, iovcnt)) {
+        printf("RTMP_SendPacketv type=%d size=%u failed!\n", type, size);
+        return -1;
+    }
+    c->started[cs] = true;
+    c->last_ts[cs] = ts;
+    return 0;
+}
+
+static int rtmpc_send_headers(struct rtmpc *rtmpc, const struct video_packet *vp)
+{
+    static const uint8_t set_data_frame[] = {
+        0x02, 0x00, 0x0d, '@', 's', 'e', 't', 'D', 'a', 't', 'a', 'F', 'r', 'a', 'm', 'e'
+    };
+    struct flv_muxer *flv = rtmpc->flv;
+    uint8_t hdr[FLV_VIDEO_TAG_HEADER_SIZE];
+    uint8_t *meta = NULL, *avcc = NULL;
+    const uint8_t *extra;
+    size_t meta_size = 0, extra_size;
+    struct iovec iov[2];
+    ssize_t size;
+    int ret;
+
+    flv_mux_meta_data(flv, &meta, &meta_size);
+    iov[0].iov_base = (void *)set_data_frame;
+    iov[0].iov_len = sizeof(set_data_frame);
+    iov[1].iov_base = meta;
+    iov[1].iov_len = meta_size;
+    ret = rtmpc_send_message(rtmpc, RTMPC_CS_DATA, RTMP_PACKET_TYPE_INFO, 0, iov, 2);
+    free(meta);
+    if (ret < 0) {
+        return -1;
+    }
+
+    if (vp) {
+        /* fall back to the in-band SPS/PPS of the first keyframe */
+        extra = vp->encoder.extra_size ? vp->encoder.extra_data : vp->data;
+        extra_size = vp->encoder.extra_size ? vp->encoder.extra_size : vp->size;
+        if (h26x_has_start_code(extra, extra_size)) {
+            size = h264_avcc_config(extra, extra_size, NULL, 0);
+            avcc = (size > 0) ? malloc(size) : NULL;
+            if (!avcc || h264_avcc_config(extra, extra_size, avcc, size) < 0) {
+                printf("%s: no SPS/PPS for AVC sequence header!\n", __func__);
+                free(avcc);
+                return -1;
+            }
+            extra = avcc;
+            extra_size = size;
+        }
+        iov[0].iov_base = hdr;
+        iov[0].iov_len = flv_video_tag_header(hdr, true, true, 0);
+        iov[1].iov_base = (void *)extra;
+        iov[1].iov_len = extra_size;
+        ret = rtmpc_send_message(rtmpc, RTMPC_CS_VIDEO, RTMP_PACKET_TYPE_VIDEO, 0, iov, 2);
+        free(avcc);
+        if (ret < 0) {
+            return -1;
+        }
+    }
+
+    if (flv->audio && flv->audio->extra_size) {
+        iov[0].iov_base = hdr;
+        iov[0].iov_len = flv_audio_tag_header(hdr, true);
+        iov[1].iov_base = flv->audio->extra_data;
+        iov[1].iov_len = flv->audio->extra_size;
+        if (rtmpc_send_message(rtmpc, RTMPC_CS_AUDIO, RTMP_PACKET_TYPE_AUDIO, 0, iov, 2) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int rtmpc_write_video(struct rtmpc *rtmpc, const struct video_packet *vp)
+{
+    struct rtmpc_chunk *c = rtmpc->chunk;
+    const uint8_t *p, *end = vp->data + vp->size;
+    uint8_t hdr[FLV_VIDEO_TAG_HEADER_SIZE];
+    struct h26x_nal nal;
+    bool key = h26x_is_keyframe(VIDEO_CODEC_H264, vp->data, vp->size);
+    uint32_t ms = rtmpc_ms(vp->dts, vp->encoder.timebase);
+    int32_t cts = rtmpc_ms(vp->pts - vp->dts, vp->encoder.timebase);
+    int n = 0;
+
+    if (!c->got_start) {
+        if (!key) {
+            return 0; /* nothing decodable before the first keyframe */
+        }
+        c->start_ms = ms;
+        c->got_start = true;
+    }
+    if (!rtmpc->sent_headers) {
+        if (rtmpc_send_headers(rtmpc, vp) < 0) {
+            return -1;
+        }
+        rtmpc->sent_headers = true;
+    }
+
+    for (p = vp->data; (p = h26x_next_nal(VIDEO_CODEC_H264, p, end, &nal)) != NULL; n++) {
+        if (n == c->max_nal && rtmpc_chunk_grow(c, n) < 0) {
+            printf("%s: realloc iovec failed!\n", __func__);
+            return -1;
+        }
+        c->prefix[4 * n + 0] = (nal.size >> 24) & 0xff;
+        c->prefix[4 * n + 1] = (nal.size >> 16) & 0xff;
+        c->prefix[4 * n + 2] = (nal.size >> 8) & 0xff;
+        c->prefix[4 * n + 3] = nal.size & 0xff;
+        c->iov[1 + 2 * n].iov_base = c->prefix + 4 * n;
+        c->iov[1 + 2 * n].iov_len = 4;
+        c->iov[2 + 2 * n].iov_base = (void *)nal.data;
+        c->iov[2 + 2 * n].iov_len = nal.size;
+    }
+    if (n == 0) {
+        return 0;
+    }
+    c->iov[0].iov_base = hdr;
+    c->iov[0].iov_len = flv_video_tag_header(hdr, key, false, cts);
+    return rtmpc_send_message(rtmpc, RTMPC_CS_VIDEO, RTMP_PACKET_TYPE_VIDEO,
+                    ms - c->start_ms, c->iov, 1 + 2 * n);
+}
+
+static int rtmpc_write_audio(struct rtmpc *rtmpc, const struct audio_packet *ap)
+{
+    struct rtmpc_chunk *c = rtmpc->chunk;
+    uint8_t hdr[FLV_AUDIO_TAG_HEADER_SIZE];
+    uint32_t ms = rtmpc_ms(ap->dts, ap->encoder.timebase);
+    struct iovec iov[2];
+
+    if (!c->got_start) {
+        if (rtmpc->flv->video) {
+            return 0; /* audio starts together with the first keyframe */
+        }
+        c->start_ms = ms;
+        c->got_start = true;
     }
-    new_pkt = media_packet_copy(pkt, MEDIA_MEM_SHALLOW);
-    return new_pkt;
+    if (ms < c->start_ms) {
+        return 0;
+    }
+    if (!rtmpc->sent_headers) {
+        if (rtmpc_send_headers(rtmpc, NULL) < 0) {
+            return -1;
+        }
+        rtmpc->sent_headers = true;
+    }
+    iov[0].iov_base = hdr;
+    iov[0].iov_len = flv_audio_tag_header(hdr, false);
+    iov[1].iov_base = ap->data;
+    iov[1].iov_len = ap->size;
+    return rtmpc_send_message(rtmpc, RTMPC_CS_AUDIO, RTMP_PACKET_TYPE_AUDIO,
+                    ms - c->start_ms, iov, 2);
 }
 
-static void item_free_hook(void *data)
+static int rtmpc_write_packet(struct rtmpc *rtmpc, struct media_packet *pkt)
 {
-    struct media_packet *pkt = (struct media_packet *)data;
-    media_packet_destroy(pkt);
+    switch (pkt->type) {
+    case MEDIA_TYPE_VIDEO:
+        return rtmpc_write_video(rtmpc, pkt->video);
+    case MEDIA_TYPE_AUDIO:
+        return rtmpc_write_audio(rtmpc, pkt->audio);
+    default:
+        break;
+    }
+    return 0;
+}
+
+void rtmpc_destroy(struct rtmpc *rtmpc)
+{
+    if (!rtmpc) {
+        return;
+    }
+    RTMP_Close(rtmpc->base);
+    RTMP_Free(rtmpc->base);
+    rtmpc->base = NULL;
+    rtmpc_sched_destroy(rtmpc->sched);
+    flv_mux_destroy(rtmpc->flv);
+    rtmpc_chunk_destroy(rtmpc->chunk);
+    free(rtmpc);
 }
 
 static int flv_mux_output(void *ctx, uint8_t *data, size_t size, int strm_idx)
@@ -99,14 +345,20 @@ struct rtmpc *rtmpc_create(const char *url)
         goto failed;
     }
 
+    if (!RTMP_SetChunkSize(base, RTMPC_DEFAULT_CHUNK_SIZE)) {
+        printf("RTMP_SetChunkSize failed!\n");
+    }
+
     rtmpc->flv = flv_mux_create(flv_mux_output, base);
+    rtmpc->chunk = rtmpc_chunk_create();
+    if (!rtmpc->chunk) {
+        goto failed;
+    }
 
-    rtmpc->q = queue_create();
-    if (!rtmpc->q) {
-        printf("queue_create failed!\n");
+    rtmpc->sched = rtmpc_sched_create();
+    if (!rtmpc->sched) {
         goto failed;
     }
-    queue_set_hook(rtmpc->q, item_alloc_hook, item_free_hook);
     rtmpc->base = base;
     rtmpc->is_run = false;
     rtmpc->is_start = false;
@@ -114,9 +366,9 @@ struct rtmpc *rtmpc_create(const char *url)
 
 failed:
     if (rtmpc) {
-        if (rtmpc->q) {
-            queue_destroy(rtmpc->q);
-        }
+        rtmpc_sched_destroy(rtmpc->sched);
+        flv_mux_destroy(rtmpc->flv);
+        rtmpc_chunk_destroy(rtmpc->chunk);
         free(rtmpc);
     }
     return NULL;
@@ -171,14 +423,20 @@ struct rtmpc *rtmpc_create2(struct rtmp_url *url)
         goto failed;
     }
 
+    if (!RTMP_SetChunkSize(base, RTMPC_DEFAULT_CHUNK_SIZE)) {
+        printf("RTMP_SetChunkSize failed!\n");
+    }
+
     rtmpc->flv = flv_mux_create(flv_mux_output, base);
+    rtmpc->chunk = rtmpc_chunk_create();
+    if (!rtmpc->chunk) {
+        goto failed;
+    }
 
-    rtmpc->q = queue_create();
-    if (!rtmpc->q) {
-        printf("queue_create failed!\n");
+    rtmpc->sched = rtmpc_sched_create();
+    if (!rtmpc->sched) {
         goto failed;
     }
-    queue_set_hook(rtmpc->q, item_alloc_hook, item_free_hook);
     rtmpc->base = base;
     rtmpc->is_run = false;
     rtmpc->is_start = false;
@@ -186,9 +444,9 @@ struct rtmpc *rtmpc_create2(struct rtmp_url *url)
 
 failed:
     if (rtmpc) {
-        if (rtmpc->q) {
-            queue_destroy(rtmpc->q);
-        }
+        rtmpc_sched_destroy(rtmpc->sched);
+        flv_mux_destroy(rtmpc->flv);
+        rtmpc_chunk_destroy(rtmpc->chunk);
         free(rtmpc);
     }
     return NULL;
@@ -199,29 +457,54 @@ int rtmpc_stream_add(struct rtmpc *rtmpc, struct media_packet *pkt)
     return flv_mux_add_media(rtmpc->flv, pkt);
 }
 
+int rtmpc_set_chunk_size(struct rtmpc *rtmpc, int size)
+{
+    if (!rtmpc || !rtmpc->base) {
+        return -1;
+    }
+    if (rtmpc->is_start) {
+        printf("%s must be called before rtmpc_stream_start!\n", __func__);
+        return -1;
+    }
+    if (!RTMP_SetChunkSize(rtmpc->base, size)) {
+        printf("RTMP_SetChunkSize %d failed!\n", size);
+        return -1;
+    }
+    return 0;
+}
+
+int rtmpc_set_latency(struct rtmpc *rtmpc, uint32_t max_ms)
+{
+    if (!rtmpc || max_ms == 0) {
+        return -1;
+    }
+    pthread_mutex_lock(&rtmpc->sched->lock);
+    rtmpc->sched->max_latency = max_ms;
+    pthread_mutex_unlock(&rtmpc->sched->lock);
+    return 0;
+}
+
+int rtmpc_get_stat(struct rtmpc *rtmpc, struct rtmpc_stat *stat)
+{
+    if (!rtmpc || !stat) {
+        return -1;
+    }
+    rtmpc_sched_get_stat(rtmpc->sched, stat);
+    return 0;
+}
+
 int rtmpc_send_packet(struct rtmpc *rtmpc, struct media_packet *pkt)
 {
-    struct queue_item *item = NULL;
     if (!rtmpc || !pkt) {
         printf("%s invalid parament!\n", __func__);
         return -1;
     }
-    switch (pkt->type) {
-    case MEDIA_TYPE_AUDIO:
-        item = queue_item_alloc(rtmpc->q, pkt->audio->data, pkt->audio->size, pkt);
-        break;
-    case MEDIA_TYPE_VIDEO:
-        item = queue_item_alloc(rtmpc->q, pkt->video->data, pkt->video->size, pkt);
-        break;
-    default:
-        break;
-    }
-    if (!item) {
-        printf("item_alloc packet type %d failed!\n", pkt->type);
+    if (__atomic_load_n(&rtmpc->is_broken, __ATOMIC_ACQUIRE)) {
+        printf("rtmpc connection lost, packet type %d not sent!\n", pkt->type);
         return -1;
     }
-    if (0 != queue_push(rtmpc->q, item)) {
-        printf("queue_push failed!\n");
+    if (0 != rtmpc_sched_push(rtmpc->sched, pkt)) {
+        printf("rtmpc_sched_push packet type %d failed!\n", pkt->type);
         return -1;
     }
     return 0;
@@ -229,30 +512,36 @@ int rtmpc_send_packet(struct rtmpc *rtmpc, struct media_packet *pkt)
 
 static void *rtmpc_stream_thread(struct thread *t, void *arg)
 {
-    struct media_packet *pkt;
+    struct rtmpc_entry *e;
     struct rtmpc *rtmpc = (struct rtmpc *)arg;
-    queue_flush(rtmpc->q);
+    int ret;
     rtmpc->is_run = true;
     while (rtmpc->is_run) {
-        struct queue_item *it = queue_pop(rtmpc->q);
-        if (!it) {
-            usleep(200000);
-            continue;
+        e = rtmpc_sched_pop(rtmpc->sched);
+        if (!e) {
+            break;
+        }
+        ret = rtmpc_write_packet(rtmpc, e->pkt);
+        rtmpc_sched_done(rtmpc->sched, e, RTMP_Socket(rtmpc->base), ret);
+        if (ret < 0 && !RTMP_IsConnected(rtmpc->base)) {
+            /* librtmp closes the socket on a failed write, nothing more can go out */
+            printf("rtmpc connection lost, stream stopped!\n");
+            __atomic_store_n(&rtmpc->is_broken, true, __ATOMIC_RELEASE);
+            rtmpc_sched_stop(rtmpc->sched);
+            break;
         }
-        pkt = (struct media_packet *)it->opaque.iov_base;
-        flv_write_packet(rtmpc->flv, pkt);
-        queue_item_free(rtmpc->q, it);
     }
     return NULL;
 }
 
 void rtmpc_stream_stop(struct rtmpc *rtmpc)
 {
-    rtmpc->is_run = false;
     if (rtmpc) {
-        queue_flush(rtmpc->q);
+        rtmpc->is_run = false;
+        rtmpc_sched_stop(rtmpc->sched);
         thread_join(rtmpc->thread);
         thread_destroy(rtmpc->thread);
+        rtmpc_sched_flush(rtmpc->sched);
         rtmpc->thread = NULL;
         rtmpc->is_start = false;
     }
@@ -23,7 +23,6 @@
 #define LIBRTMPC_H
 
 #include <libposix.h>
-#include <libqueue.h>
 #include <libthread.h>
 #include <libmedia-io.h>
 #include <stdio.h>
@@ -34,6 +33,12 @@
 
 #define LIBRTMPC_VERSION "0.1.0"
 
+/* outgoing chunk size announced after connect, RTMP default is 128 */
+#define RTMPC_DEFAULT_CHUNK_SIZE    4096
+
+/* latency budget of the send scheduler before video frames are shed */
+#define RTMPC_DEFAULT_MAX_LATENCY   1000
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -46,14 +51,30 @@ struct rtmp_url {
 
 };
 
+struct rtmpc_stat {
+    uint64_t sent_bytes;
+    uint64_t sent_audio;        /* frames */
+    uint64_t sent_video;
+    uint64_t drop_audio;
+    uint64_t drop_video;
+    uint32_t bitrate;           /* kbps, measured over the last second */
+    uint32_t rtt_ms;            /* TCP smoothed RTT, 0 if unknown */
+    uint32_t sndbuf_bytes;      /* unsent and unacked in the socket */
+    uint32_t queue_depth;       /* packets waiting to be sent */
+    uint32_t backlog_ms;        /* queue + socket drain time at bitrate */
+    uint32_t latency_ms;        /* push to send, averaged */
+};
+
 struct rtmpc {
     void *base;
     struct flv_muxer *flv;
-    struct queue *q;
+    struct rtmpc_sched *sched;
     struct thread *thread;
     bool is_run;
     bool is_start;
+    bool is_broken;     /* connection lost while streaming, set by the stream thread */
     bool sent_headers;
+    struct rtmpc_chunk *chunk;
 };
 
 GEAR_API struct rtmpc *rtmpc_create(const char *push_url);
@@ -61,6 +82,9 @@ GEAR_API struct rtmpc *rtmpc_create2(struct rtmp_url *url);
 GEAR_API int rtmpc_stream_add(struct rtmpc *rtmpc, struct media_packet *pkt);
 GEAR_API int rtmpc_stream_start(struct rtmpc *rtmpc);
 GEAR_API void rtmpc_stream_stop(struct rtmpc *rtmpc);
+GEAR_API int rtmpc_set_chunk_size(struct rtmpc *rtmpc, int size);
+GEAR_API int rtmpc_set_latency(struct rtmpc *rtmpc, uint32_t max_ms);
+GEAR_API int rtmpc_get_stat(struct rtmpc *rtmpc, struct rtmpc_stat *stat);
 GEAR_API int rtmpc_send_packet(struct rtmpc *rtmpc, struct media_packet *pkt);
 GEAR_API void rtmpc_destroy(struct rtmpc *rtmpc);
 
@@ -38,6 +38,10 @@
 #define MSG_NOSIGNAL 0
 #endif
 
+#if !defined(IOV_MAX)
+#define IOV_MAX 1024
+#endif
+
 #ifdef CRYPTO
 
 #ifdef __APPLE__
@@ -4427,6 +4431,218 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
     return TRUE;
 }
 
+/* Same wire format as RTMP_SendPacket(), but the message body is scattered
+ * over iov[] and is never copied: the chunk headers are generated on the
+ * side and interleaved with slices of the body, then the whole message goes
+ * out with a single writev() (batched by IOV_MAX).  Transports that need a
+ * contiguous buffer (RTMPT, TLS, custom send) get the chunks coalesced. */
+int
+RTMP_SendPacketv(RTMP *r, RTMPPacket *packet, const struct iovec *body, int bodycnt)
+{
+    const RTMPPacket *prevPacket;
+    uint32_t last = 0, t;
+    int nSize, hSize, cSize = 0, i, off, n, niov, maxiov, nChunkSize, ok = TRUE;
+    char hbuf[RTMP_MAX_HEADER_SIZE], cont[3], *hptr, *hend = hbuf + sizeof(hbuf), c;
+    struct iovec *iov, siov[64];
+
+    if (packet->m_headerType > 3)
+        return FALSE;
+
+    if (packet->m_nChannel >= r->m_channelsAllocatedOut)
+    {
+        int nch = packet->m_nChannel + 10;
+        RTMPPacket **packets = realloc(r->m_vecChannelsOut, sizeof(RTMPPacket*) * nch);
+        if (!packets)
+            return FALSE;
+        r->m_vecChannelsOut = packets;
+        memset(r->m_vecChannelsOut + r->m_channelsAllocatedOut, 0, sizeof(RTMPPacket*) * (nch - r->m_channelsAllocatedOut));
+        r->m_channelsAllocatedOut = nch;
+    }
+
+    prevPacket = r->m_vecChannelsOut[packet->m_nChannel];
+    if (prevPacket && packet->m_headerType != RTMP_PACKET_SIZE_LARGE)
+    {
+        if (prevPacket->m_nBodySize == packet->m_nBodySize
+                && prevPacket->m_packetType == packet->m_packetType
+                && packet->m_headerType == RTMP_PACKET_SIZE_MEDIUM)
+            packet->m_headerType = RTMP_PACKET_SIZE_SMALL;
+
+        if (prevPacket->m_nTimeStamp == packet->m_nTimeStamp
+                && packet->m_headerType == RTMP_PACKET_SIZE_SMALL)
+            packet->m_headerType = RTMP_PACKET_SIZE_MINIMUM;
+        last = prevPacket->m_nTimeStamp;
+    }
+
+    nSize = packetSize[packet->m_headerType];
+    t = packet->m_nTimeStamp - last;
+    if (packet->m_nChannel > 319)
+        cSize = 2;
+    else if (packet->m_nChannel > 63)
+        cSize = 1;
+
+    hptr = hbuf;
+    c = packet->m_headerType << 6;
+    if (cSize == 0)
+        c |= packet->m_nChannel;
+    else if (cSize == 2)
+        c |= 1;
+    *hptr++ = c;
+    cont[0] = (0xc0 | c);
+    if (cSize)
+    {
+        int tmp = packet->m_nChannel - 64;
+        *hptr++ = cont[1] = tmp & 0xff;
+        if (cSize == 2)
+            *hptr++ = cont[2] = tmp >> 8;
+    }
+    if (nSize > 1)
+        hptr = AMF_EncodeInt24(hptr, hend, t > 0xffffff ? 0xffffff : t);
+    if (nSize > 4)
+    {
+        hptr = AMF_EncodeInt24(hptr, hend, packet->m_nBodySize);
+        *hptr++ = packet->m_packetType;
+    }
+    if (nSize > 8)
+        hptr += EncodeInt32LE(hptr, packet->m_nInfoField2);
+    if (nSize > 1 && t >= 0xffffff)
+        hptr = AMF_EncodeInt32(hptr, hend, t);
+    hSize = hptr - hbuf;
+
+    /* every chunk boundary may split one body slice in two */
+    nChunkSize = r->m_outChunkSize;
+    maxiov = 1 + bodycnt + 2 * (packet->m_nBodySize / nChunkSize + 1);
+    iov = (maxiov <= (int)(sizeof(siov) / sizeof(siov[0]))) ? siov : malloc(sizeof(struct iovec) * maxiov);
+    if (!iov)
+        return FALSE;
+
+    niov = 0;
+    iov[niov].iov_base = hbuf;
+    iov[niov++].iov_len = hSize;
+    for (i = 0, n = 0; i < bodycnt; i++)
+    {
+        char *p = body[i].iov_base;
+        int left = body[i].iov_len;
+        while (left > 0)
+        {
+            int room = nChunkSize - n;
+            if (room == 0)
+            {
+                iov[niov].iov_base = cont;
+                iov[niov++].iov_len = 1 + cSize;
+                n = 0;
+                room = nChunkSize;
+            }
+            if (room > left)
+                room = left;
+            iov[niov].iov_base = p;
+            iov[niov++].iov_len = room;
+            p += room;
+            left -= room;
+            n += room;
+        }
+    }
+
+#if defined(_WIN32)
+    if (1)
+#elif defined(CRYPTO)
+    if ((r->Link.protocol & RTMP_FEATURE_HTTP) || (r->m_bCustomSend && r->m_customSendFunc)
+            || r->m_sb.sb_ssl || r->Link.rc4keyOut)
+#else
+    if ((r->Link.protocol & RTMP_FEATURE_HTTP) || (r->m_bCustomSend && r->m_customSendFunc))
+#endif
+    {
+        int tlen = 0;
+        char *tbuf, *toff;
+        for (i = 0; i < niov; i++)
+            tlen += iov[i].iov_len;
+        tbuf = toff = malloc(tlen);
+        if (!tbuf)
+        {
+            ok = FALSE;
+            goto out;
+        }
+        for (i = 0; i < niov; i++)
+        {
+            memcpy(toff, iov[i].iov_base, iov[i].iov_len);
+            toff += iov[i].iov_len;
+        }
+        ok = WriteN(r, tbuf, tlen);
+        free(tbuf);
+        goto out;
+    }
+
+#if !defined(_WIN32)
+    for (off = 0; off < niov; )
+    {
+        int cnt = niov - off;
+        ssize_t wrote;
+        if (cnt > IOV_MAX)
+            cnt = IOV_MAX;
+        wrote = writev(r->m_sb.sb_socket, &iov[off], cnt);
+        if (wrote < 0)
+        {
+            int sockerr = GetSockError();
+            if (sockerr == EINTR && !RTMP_ctrlC)
+                continue;
+            RTMP_Log(RTMP_LOGERROR, "%s, RTMP send error %d", __FUNCTION__, sockerr);
+            r->last_error_code = sockerr;
+            RTMP_Close(r);
+            ok = FALSE;
+            break;
+        }
+        /* drop fully written slices, trim the partially written one */
+        while (off < niov && wrote >= (ssize_t)iov[off].iov_len)
+            wrote -= iov[off++].iov_len;
+        if (wrote > 0)
+        {
+            iov[off].iov_base = (char *)iov[off].iov_base + wrote;
+            iov[off].iov_len -= wrote;
+        }
+    }
+#endif
+
+out:
+    if (iov != siov)
+        free(iov);
+    if (!ok)
+        return FALSE;
+
+    if (!r->m_vecChannelsOut[packet->m_nChannel])
+        r->m_vecChannelsOut[packet->m_nChannel] = malloc(sizeof(RTMPPacket));
+    memcpy(r->m_vecChannelsOut[packet->m_nChannel], packet, sizeof(RTMPPacket));
+    r->m_vecChannelsOut[packet->m_nChannel]->m_body = NULL;
+    return TRUE;
+}
+
+/* Announce a new outgoing chunk size to the peer, then switch to it.
+ * Larger chunks mean fewer chunk headers and syscall slices per frame. */
+int
+RTMP_SetChunkSize(RTMP *r, int size)
+{
+    RTMPPacket packet;
+    char pbuf[RTMP_MAX_HEADER_SIZE + 4];
+
+    if (size < RTMP_DEFAULT_CHUNKSIZE || size > 0x7fffffff)
+        return FALSE;
+    if (size == r->m_outChunkSize)
+        return TRUE;
+
+    packet.m_nChannel = 0x02;
+    packet.m_headerType = RTMP_PACKET_SIZE_LARGE;
+    packet.m_packetType = RTMP_PACKET_TYPE_CHUNK_SIZE;
+    packet.m_nTimeStamp = 0;
+    packet.m_nInfoField2 = 0;
+    packet.m_hasAbsTimestamp = 0;
+    packet.m_body = pbuf + RTMP_MAX_HEADER_SIZE;
+    packet.m_nBodySize = 4;
+    AMF_EncodeInt32(packet.m_body, pbuf + sizeof(pbuf), size);
+
+    if (!RTMP_SendPacket(r, &packet, FALSE))
+        return FALSE;
+    r->m_outChunkSize = size;
+    return TRUE;
+}
+
 int
 RTMP_Serve(RTMP *r)
 {
@@ -365,6 +365,9 @@ extern "C"
 
     int RTMP_ReadPacket(RTMP *r, RTMPPacket *packet);
     int RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue);
+    struct iovec;
+    int RTMP_SendPacketv(RTMP *r, RTMPPacket *packet, const struct iovec *body, int bodycnt);
+    int RTMP_SetChunkSize(RTMP *r, int size);
     int RTMP_SendChunk(RTMP *r, RTMPChunk *chunk);
     int RTMP_IsConnected(RTMP *r);
     SOCKET RTMP_Socket(RTMP *r);
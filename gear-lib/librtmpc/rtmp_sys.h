@@ -40,6 +40,7 @@
 #include <ws2tcpip.h>
 #include <Mstcpip.h>
 #include <time.h>
+#include <libposix.h>   /* struct iovec */
 
 #ifdef _MSC_VER	/* MSVC */
 #define snprintf _snprintf
@@ -61,6 +62,7 @@
 #else /* !_WIN32 */
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/times.h>
 #include <netdb.h>
 #include <unistd.h>
@@ -0,0 +1,324 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#include "librtmpc.h"
+#include "rtmpc_sched.h"
+#include "rtmp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined (__linux__)
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
+#define RTMPC_SCHED_MAX_DEPTH       512
+#define RTMPC_SCHED_WINDOW_MS       1000
+#define RTMPC_SCHED_PROBE_MS        100
+
+static enum rtmpc_prio rtmpc_video_prio(const struct video_packet *vp)
+{
+    const uint8_t *p, *end = vp->data + vp->size;
+    struct h26x_nal nal;
+
+    for (p = vp->data; (p = h26x_next_nal(VIDEO_CODEC_H264, p, end, &nal)) != NULL;) {
+        if (nal.cls == H26X_NAL_IDR) {
+            return RTMPC_PRIO_KEY;
+        }
+        if (nal.cls == H26X_NAL_SLICE) {
+            /* nal_ref_idc == 0: nothing references this picture */
+            return (nal.data[0] & 0x60) ? RTMPC_PRIO_REF : RTMPC_PRIO_NONREF;
+        }
+    }
+    return RTMPC_PRIO_REF;
+}
+
+static void entry_free(struct rtmpc_entry *e)
+{
+    media_packet_destroy(e->pkt);
+    free(e);
+}
+
+static void entry_drop(struct rtmpc_sched *s, struct rtmpc_entry *e)
+{
+    list_del(&e->entry);
+    s->depth--;
+    s->bytes -= e->size;
+    s->drop[e->prio != RTMPC_PRIO_AUDIO]++;
+    entry_free(e);
+}
+
+/* time to drain everything not yet acked by the peer, in ms */
+static uint32_t backlog_ms(struct rtmpc_sched *s)
+{
+    if (s->bitrate == 0) {
+        return 0;
+    }
+    return (uint32_t)((s->bytes + s->sndbuf) * 8 / s->bitrate);
+}
+
+static void drop_prio(struct rtmpc_sched *s, enum rtmpc_prio prio)
+{
+    struct list_head *pos, *n;
+    list_for_each_safe(pos, n, &s->head) {
+        struct rtmpc_entry *e = list_entry(pos, struct rtmpc_entry, entry);
+        if (e->prio == prio) {
+            entry_drop(s, e);
+        }
+    }
+}
+
+/* drop every keyframe but the newest, whole GOPs are gone by now */
+static void drop_gops(struct rtmpc_sched *s)
+{
+    struct list_head *pos, *n;
+    struct rtmpc_entry *last = NULL;
+
+    list_for_each(pos, &s->head) {
+        struct rtmpc_entry *e = list_entry(pos, struct rtmpc_entry, entry);
+        if (e->prio == RTMPC_PRIO_KEY) {
+            last = e;
+        }
+    }
+    list_for_each_safe(pos, n, &s->head) {
+        struct rtmpc_entry *e = list_entry(pos, struct rtmpc_entry, entry);
+        if (e == last) {
+            break;
+        }
+        if (e->prio != RTMPC_PRIO_AUDIO) {
+            entry_drop(s, e);
+        }
+    }
+}
+
+static void sched_shed(struct rtmpc_sched *s)
+{
+    if (backlog_ms(s) > s->max_latency / 2) {
+        drop_prio(s, RTMPC_PRIO_NONREF);
+    }
+    if (backlog_ms(s) > s->max_latency) {
+        drop_prio(s, RTMPC_PRIO_REF);
+        s->wait_key = true;
+    }
+    if (backlog_ms(s) > s->max_latency * 2) {
+        drop_gops(s);
+    }
+    while (s->depth >= s->max_depth) {
+        drop_prio(s, RTMPC_PRIO_NONREF);
+        drop_prio(s, RTMPC_PRIO_REF);
+        if (s->depth < s->max_depth) {
+            s->wait_key = true;
+            break;
+        }
+        entry_drop(s, list_first_entry(&s->head, struct rtmpc_entry, entry));
+    }
+}
+
+struct rtmpc_sched *rtmpc_sched_create(void)
+{
+    struct rtmpc_sched *s = calloc(1, sizeof(struct rtmpc_sched));
+    if (!s) {
+        printf("malloc rtmpc_sched failed!\n");
+        return NULL;
+    }
+    INIT_LIST_HEAD(&s->head);
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    s->max_depth = RTMPC_SCHED_MAX_DEPTH;
+    s->max_latency = RTMPC_DEFAULT_MAX_LATENCY;
+    return s;
+}
+
+void rtmpc_sched_flush(struct rtmpc_sched *s)
+{
+    struct list_head *pos, *n;
+    pthread_mutex_lock(&s->lock);
+    list_for_each_safe(pos, n, &s->head) {
+        struct rtmpc_entry *e = list_entry(pos, struct rtmpc_entry, entry);
+        list_del(&e->entry);
+        entry_free(e);
+    }
+    s->depth = 0;
+    s->bytes = 0;
+    s->stop = false;
+    s->wait_key = false;
+    pthread_mutex_unlock(&s->lock);
+}
+
+void rtmpc_sched_destroy(struct rtmpc_sched *s)
+{
+    if (!s) {
+        return;
+    }
+    rtmpc_sched_flush(s);
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->cond);
+    free(s);
+}
+
+int rtmpc_sched_push(struct rtmpc_sched *s, struct media_packet *pkt)
+{
+    struct rtmpc_entry *e;
+    enum rtmpc_prio prio;
+
+    if (pkt->type == MEDIA_TYPE_VIDEO) {
+        prio = rtmpc_video_prio(pkt->video);
+    } else if (pkt->type == MEDIA_TYPE_AUDIO) {
+        prio = RTMPC_PRIO_AUDIO;
+    } else {
+        return -1;
+    }
+
+    pthread_mutex_lock(&s->lock);
+    if (prio == RTMPC_PRIO_KEY) {
+        s->wait_key = false;
+    } else if (prio != RTMPC_PRIO_AUDIO && s->wait_key) {
+        s->drop[1]++;
+        pthread_mutex_unlock(&s->lock);
+        return 0;
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    e = calloc(1, sizeof(struct rtmpc_entry));
+    if (!e) {
+        return -1;
+    }
+    e->pkt = media_packet_copy(pkt, MEDIA_MEM_REF);
+    if (!e->pkt) {
+        free(e);
+        return -1;
+    }
+    e->prio = prio;
+    e->size = media_packet_get_size(pkt);
+    e->push_ms = RTMP_GetTime();
+
+    pthread_mutex_lock(&s->lock);
+    list_add_tail(&e->entry, &s->head);
+    s->depth++;
+    s->bytes += e->size;
+    sched_shed(s);
+    pthread_cond_signal(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+    return 0;
+}
+
+struct rtmpc_entry *rtmpc_sched_pop(struct rtmpc_sched *s)
+{
+    struct rtmpc_entry *e = NULL;
+
+    pthread_mutex_lock(&s->lock);
+    while (list_empty(&s->head) && !s->stop) {
+        pthread_cond_wait(&s->cond, &s->lock);
+    }
+    if (!s->stop) {
+        e = list_first_entry(&s->head, struct rtmpc_entry, entry);
+        list_del(&e->entry);
+        s->depth--;
+        s->bytes -= e->size;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return e;
+}
+
+static void sched_probe(struct rtmpc_sched *s, int fd)
+{
+#if defined (__linux__)
+    struct tcp_info ti;
+    socklen_t len = sizeof(ti);
+    int outq = 0;
+
+    if (ioctl(fd, SIOCOUTQ, &outq) == 0) {
+        s->sndbuf = outq;
+    }
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &ti, &len) == 0) {
+        s->rtt = ti.tcpi_rtt / 1000;
+    }
+#endif
+}
+
+/*
+ * account a popped entry, ret is the write result: a failed write is a drop
+ * and must not show up in the throughput or latency estimate
+ */
+void rtmpc_sched_done(struct rtmpc_sched *s, struct rtmpc_entry *e, int fd, int ret)
+{
+    uint32_t now = RTMP_GetTime();
+    uint32_t elapsed;
+
+    pthread_mutex_lock(&s->lock);
+    if (ret < 0) {
+        s->drop[e->prio != RTMPC_PRIO_AUDIO]++;
+        pthread_mutex_unlock(&s->lock);
+        entry_free(e);
+        return;
+    }
+    s->sent[e->prio != RTMPC_PRIO_AUDIO]++;
+    s->sent_bytes += e->size;
+    s->win_bytes += e->size;
+    s->latency = (s->latency * 7 + (now - e->push_ms)) / 8;
+    if (s->win_start == 0) {
+        s->win_start = now;
+    }
+    elapsed = now - s->win_start;
+    if (elapsed >= 2 * RTMPC_SCHED_WINDOW_MS) {
+        /* the source went idle, this window says nothing about the link */
+        s->win_bytes = e->size;
+        s->win_start = now;
+    } else if (elapsed >= RTMPC_SCHED_WINDOW_MS) {
+        /* bytes * 8 / ms == kbit/s */
+        s->bitrate = (uint32_t)(s->win_bytes * 8 / elapsed);
+        s->win_bytes = 0;
+        s->win_start = now;
+    }
+    if (fd >= 0 && now - s->probe_ms >= RTMPC_SCHED_PROBE_MS) {
+        sched_probe(s, fd);
+        s->probe_ms = now;
+    }
+    pthread_mutex_unlock(&s->lock);
+    entry_free(e);
+}
+
+void rtmpc_sched_stop(struct rtmpc_sched *s)
+{
+    pthread_mutex_lock(&s->lock);
+    s->stop = true;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+}
+
+void rtmpc_sched_get_stat(struct rtmpc_sched *s, struct rtmpc_stat *st)
+{
+    pthread_mutex_lock(&s->lock);
+    st->sent_bytes   = s->sent_bytes;
+    st->sent_audio   = s->sent[0];
+    st->sent_video   = s->sent[1];
+    st->drop_audio   = s->drop[0];
+    st->drop_video   = s->drop[1];
+    st->bitrate      = s->bitrate;
+    st->rtt_ms       = s->rtt;
+    st->sndbuf_bytes = s->sndbuf;
+    st->queue_depth  = s->depth;
+    st->backlog_ms   = backlog_ms(s);
+    st->latency_ms   = s->latency;
+    pthread_mutex_unlock(&s->lock);
+}
@@ -0,0 +1,99 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#ifndef RTMPC_SCHED_H
+#define RTMPC_SCHED_H
+
+#include <libposix.h>
+#include <libmedia-io.h>
+#include <pthread.h>
+
+/*
+ * publisher side send scheduler
+ *
+ * Packets wait here between rtmpc_send_packet() and the stream thread. The
+ * backlog is the queued bytes plus what is still sitting in the socket send
+ * buffer, expressed as time to drain at the measured uplink throughput.
+ * When it grows past the latency budget, video is shed by priority:
+ *
+ *   > budget/2   drop non-reference (B) frames
+ *   > budget     drop reference (P) frames, skip video until next keyframe
+ *   > budget*2   drop whole GOPs, keeping only the newest keyframe
+ *
+ * Audio is never shed while any video can still be dropped.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum rtmpc_prio {
+    RTMPC_PRIO_AUDIO = 0,
+    RTMPC_PRIO_KEY,
+    RTMPC_PRIO_REF,
+    RTMPC_PRIO_NONREF,
+};
+
+struct rtmpc_entry {
+    struct list_head     entry;
+    struct media_packet *pkt;
+    enum rtmpc_prio      prio;
+    size_t               size;
+    uint32_t             push_ms;
+};
+
+struct rtmpc_stat;
+
+struct rtmpc_sched {
+    struct list_head  head;
+    pthread_mutex_t   lock;
+    pthread_cond_t    cond;
+    int               depth;
+    int               max_depth;
+    size_t            bytes;        /* queued payload bytes */
+    bool              stop;
+    bool              wait_key;     /* a reference frame was dropped */
+    uint32_t          max_latency;  /* ms */
+    uint32_t          sndbuf;       /* socket backlog, bytes */
+    uint32_t          rtt;          /* ms */
+    uint32_t          bitrate;      /* kbps, 0 until first window */
+    uint32_t          latency;      /* ms, EWMA of push to sent */
+    uint32_t          win_start;
+    uint32_t          probe_ms;
+    uint64_t          win_bytes;
+    uint64_t          sent_bytes;
+    uint64_t          sent[2];      /* audio, video */
+    uint64_t          drop[2];
+};
+
+struct rtmpc_sched *rtmpc_sched_create(void);
+void rtmpc_sched_destroy(struct rtmpc_sched *s);
+int rtmpc_sched_push(struct rtmpc_sched *s, struct media_packet *pkt);
+struct rtmpc_entry *rtmpc_sched_pop(struct rtmpc_sched *s);
+void rtmpc_sched_done(struct rtmpc_sched *s, struct rtmpc_entry *e, int fd, int ret);
+void rtmpc_sched_stop(struct rtmpc_sched *s);
+void rtmpc_sched_flush(struct rtmpc_sched *s);
+void rtmpc_sched_get_stat(struct rtmpc_sched *s, struct rtmpc_stat *st);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -20,11 +20,169 @@
  * SOFTWARE.
  ******************************************************************************/
 #include "librtmpc.h"
+#include "rtmpc_sched.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CHECK(cond) do { if (!(cond)) { \
+        printf("%s:%d: check '%s' failed\n", __func__, __LINE__, #cond); \
+        return -1; } } while (0)
+
+#define FRAME_SIZE      1000
+
+/* H264 frame of FRAME_SIZE bytes, nal is the NAL header byte */
+static struct media_packet *h264_frame(uint8_t nal)
+{
+    uint8_t buf[FRAME_SIZE];
+    struct media_packet *pkt;
+
+    memset(buf, 0x5a, sizeof(buf));
+    buf[0] = buf[1] = buf[2] = 0;
+    buf[3] = 1;
+    buf[4] = nal;
+    pkt = media_packet_create(MEDIA_TYPE_VIDEO, MEDIA_MEM_DEEP, buf, sizeof(buf));
+    if (pkt) {
+        pkt->video->encoder.format = VIDEO_CODEC_H264;
+    }
+    return pkt;
+}
+
+static void count_prio(struct rtmpc_sched *s, int cnt[4])
+{
+    struct list_head *pos;
+    memset(cnt, 0, 4 * sizeof(int));
+    list_for_each(pos, &s->head) {
+        cnt[list_entry(pos, struct rtmpc_entry, entry)->prio]++;
+    }
+}
+
+/*
+ * no server needed: the bitrate is forced so the backlog crosses the
+ * latency budget, B frames must go before P frames and audio must stay
+ */
+static int foo_sched_shed(void)
+{
+    struct rtmpc_sched *s = rtmpc_sched_create();
+    struct media_packet *key = h264_frame(0x65);    /* IDR */
+    struct media_packet *ref = h264_frame(0x41);    /* nal_ref_idc 2 */
+    struct media_packet *nonref = h264_frame(0x01); /* nal_ref_idc 0 */
+    struct media_packet *audio;
+    struct rtmpc_stat st;
+    uint8_t aac[100];
+    int cnt[4], i, naudio = 0, ref_gone = 0;
+
+    memset(aac, 0x5a, sizeof(aac));
+    audio = media_packet_create(MEDIA_TYPE_AUDIO, MEDIA_MEM_DEEP, aac, sizeof(aac));
+    CHECK(s && key && ref && nonref && audio);
+
+    /* no bitrate measured yet: nothing is shed */
+    CHECK(rtmpc_sched_push(s, key) == 0);
+    CHECK(rtmpc_sched_push(s, ref) == 0);
+    CHECK(rtmpc_sched_push(s, nonref) == 0);
+    CHECK(rtmpc_sched_push(s, audio) == 0);
+    naudio++;
+    count_prio(s, cnt);
+    CHECK(cnt[RTMPC_PRIO_KEY] == 1 && cnt[RTMPC_PRIO_REF] == 1);
+    CHECK(cnt[RTMPC_PRIO_NONREF] == 1 && cnt[RTMPC_PRIO_AUDIO] == 1);
+
+    /* 1000 kbps is 125 bytes per ms, a 100ms budget is 12500 bytes */
+    s->bitrate = 1000;
+    s->max_latency = 100;
+    for (i = 0; i < 40; i++) {
+        CHECK(rtmpc_sched_push(s, (i & 1) ? nonref : ref) == 0);
+        CHECK(rtmpc_sched_push(s, audio) == 0);
+        naudio++;
+        count_prio(s, cnt);
+        if (cnt[RTMPC_PRIO_REF] == 0) {
+            ref_gone = 1;
+        }
+        /* P frames only go once every B frame is gone */
+        CHECK(cnt[RTMPC_PRIO_REF] > 0 || cnt[RTMPC_PRIO_NONREF] == 0);
+        CHECK(cnt[RTMPC_PRIO_KEY] == 1);
+        CHECK(cnt[RTMPC_PRIO_AUDIO] == naudio);
+    }
+    CHECK(ref_gone);
+    CHECK(s->wait_key);
+
+    /* video waits for the next keyframe, audio keeps flowing */
+    CHECK(rtmpc_sched_push(s, ref) == 0);
+    CHECK(rtmpc_sched_push(s, audio) == 0);
+    naudio++;
+    count_prio(s, cnt);
+    CHECK(cnt[RTMPC_PRIO_REF] == 0 && cnt[RTMPC_PRIO_AUDIO] == naudio);
+    CHECK(rtmpc_sched_push(s, key) == 0);
+    CHECK(!s->wait_key);
+
+    rtmpc_sched_get_stat(s, &st);
+    CHECK(st.drop_audio == 0);
+    /* every P and B frame pushed: two at first, 40 in the loop, one after */
+    CHECK(st.drop_video == 2 + 40 + 1);
+    CHECK(st.queue_depth == (uint32_t)(naudio + 2));
+    printf("rtmpc sched shed ok: %d queued, %llu video dropped, backlog %ums\n",
+           st.queue_depth, (unsigned long long)st.drop_video, st.backlog_ms);
+
+    media_packet_destroy(key);
+    media_packet_destroy(ref);
+    media_packet_destroy(nonref);
+    media_packet_destroy(audio);
+    rtmpc_sched_destroy(s);
+    return 0;
+}
+
+/* only entries written successfully count in sent, bitrate and latency */
+static int foo_sched_stat(void)
+{
+    struct rtmpc_sched *s = rtmpc_sched_create();
+    struct media_packet *key = h264_frame(0x65);
+    struct rtmpc_entry *e;
+    struct rtmpc_stat st;
+    int i;
+
+    CHECK(s && key);
+    for (i = 0; i < 3; i++) {
+        CHECK(rtmpc_sched_push(s, key) == 0);
+    }
+    e = rtmpc_sched_pop(s);
+    CHECK(e);
+    rtmpc_sched_done(s, e, -1, 0);
+    e = rtmpc_sched_pop(s);
+    CHECK(e);
+    rtmpc_sched_done(s, e, -1, -1);
+    rtmpc_sched_get_stat(s, &st);
+    CHECK(st.sent_video == 1 && st.drop_video == 1);
+    CHECK(st.sent_bytes == FRAME_SIZE);
+    CHECK(st.bitrate == 0);
+
+    /* close the 1s window: two good frames over at least 1000ms */
+    usleep(1100 * 1000);
+    e = rtmpc_sched_pop(s);
+    CHECK(e);
+    rtmpc_sched_done(s, e, -1, 0);
+    rtmpc_sched_get_stat(s, &st);
+    CHECK(st.sent_video == 2 && st.drop_video == 1);
+    CHECK(st.sent_bytes == 2 * FRAME_SIZE);
+    CHECK(st.queue_depth == 0);
+    CHECK(st.bitrate > 0 && st.bitrate <= 2 * FRAME_SIZE * 8 / 1000);
+    /* the last frame waited at least 1100ms in the queue */
+    CHECK(st.latency_ms >= 1100 / 8);
+    printf("rtmpc sched stat ok: %llu bytes, %ukbps, latency %ums\n",
+           (unsigned long long)st.sent_bytes, st.bitrate, st.latency_ms);
+
+    media_packet_destroy(key);
+    rtmpc_sched_destroy(s);
+    return 0;
+}
 
 int main(int argc, char **argv)
 {
+    if (foo_sched_shed() < 0) {
+        return -1;
+    }
+    if (foo_sched_stat() < 0) {
+        return -1;
+    }
 #if 0
     const char *url = "rtmp://localhost";
     struct rtmp *rtmp = rtmp_create(url);
@@ -41,6 +41,8 @@
 
 #define RTSP_REQUEST_LEN_MAX	(1024)
 
+static struct mem_cache *rtsp_request_cache;
+
 static void rtsp_connect_create(struct rtsp_server *rtsp, int fd, uint32_t ip, uint16_t port);
 static void rtsp_connect_destroy(struct rtsp_server *rtsp, int fd);
 
@@ -80,7 +82,8 @@ static void on_error(int fd, void *arg)
 static void rtsp_connect_create(struct rtsp_server *rtsp, int fd, uint32_t ip, uint16_t port)
 {
     char key[9];
-    struct rtsp_request *req = calloc(1, sizeof(struct rtsp_request));
+    struct rtsp_request *req = mem_cache_zalloc(mem_cache_get(&rtsp_request_cache,
+                                    "rtsp_request", sizeof(struct rtsp_request)));
     if (!req) {
         loge("calloc failed!\n");
         return;
@@ -113,7 +116,7 @@ static void rtsp_connect_destroy(struct rtsp_server *rtsp, int fd)
     gevent_destroy(req->event);
     iovec_destroy(req->raw);
     sock_close(fd);
-    free(req);
+    mem_cache_free(rtsp_request_cache, req);
 }
 
 static void on_connect(int fd, void *arg)
@@ -43,6 +43,7 @@ typedef struct media_source {
     int (*_open)(struct media_source *ms, const char *uri);
     int (*_read)(struct media_source *ms, void **data, size_t *len);
     int (*_write)(struct media_source *ms, void *data, size_t len);
+    int (*_seek)(struct media_source *ms, uint64_t msec);
     void (*_close)(struct media_source *ms);
     int (*get_frame)();
     void *opaque;
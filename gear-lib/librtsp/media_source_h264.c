@@ -20,98 +20,318 @@
  * SOFTWARE.
  ******************************************************************************/
 #include <liblog.h>
-#include <libfile.h>
-#include <libqueue.h>
+#include <libtime.h>
 #include <libmedia-io.h>
+#include <libfile.h>
 #include "sdp.h"
 #include "media_source.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
+#include <limits.h>
+
+/*
+ * H.264 Annex-B file source.
+ *
+ * The file is mmaped instead of being dumped into RAM, and NALUs are scanned
+ * lazily with the shared SIMD scanner: every _read() groups the NALUs of one access unit and returns them
+ * as a shallow media_packet pointing into the mapping. Output is paced by
+ * wall clock, using the frame rate from SPS VUI timing info when available.
+ */
+
+#define H264_DEFAULT_FPS_NUM    25
+#define H264_DEFAULT_FPS_DEN    1
+#define H264_KEYFRAME_IDX_STEP  64
+#define H264_PREFETCH_SIZE      (2 * 1024 * 1024)
+
+struct h264_keyframe {
+    size_t   offset;
+    uint64_t frame;
+};
 
 struct h264_source_ctx {
     const char name[32];
-    struct queue *q;
-    int sps_cnt;
-    int duration;
+    struct file_map *map;
+    const uint8_t *base;
+    size_t size;
+    size_t pos;                     /* offset of next access unit */
+    rational_t fps;
+    uint64_t frame_cnt;             /* frames sent, keeps growing on loop */
+    uint64_t frame_in_file;         /* frame index of pos in current pass */
+    uint64_t clock_base;            /* monotonic ns of frame_cnt == 0 */
+    bool loop;
+    struct media_packet *pkt;
+    struct h264_keyframe *kf;       /* lazily built keyframe index */
+    int kf_num;
+    int kf_max;
+    size_t scanned;                 /* keyframe index covers [0, scanned) */
+    uint64_t scanned_frames;
+};
+
+/* return the NALU payload (after start code) beginning at or after p */
+static inline const uint8_t *h264_next_nalu(const uint8_t *p, const uint8_t *end)
+{
+    p = h26x_find_start_code(p, end);
+    if (p == end) {
+        return end;
+    }
+    return p + 3;
+}
+
+struct bit_reader {
+    const uint8_t *p;
+    const uint8_t *end;
+    int bit;
+    int zeros;
 };
 
-static void *item_alloc_hook(void *data, size_t len, void *arg)
+static inline int br_u1(struct bit_reader *br)
 {
-    struct media_packet *new_pkt;
-    struct media_packet *pkt = (struct media_packet *)arg;
-    if (!pkt) {
-        loge("calloc packet failed!\n");
-        return NULL;
+    int v;
+    if (br->p >= br->end) {
+        return 0;
+    }
+    v = (*br->p >> (7 - br->bit)) & 1;
+    if (++br->bit == 8) {
+        br->bit = 0;
+        br->zeros = (*br->p == 0) ? br->zeros + 1 : 0;
+        br->p++;
+        /* skip emulation prevention byte 00 00 03 */
+        if (br->zeros >= 2 && br->p < br->end && *br->p == 0x03) {
+            br->p++;
+            br->zeros = 0;
+        }
     }
-    new_pkt = media_packet_copy(pkt, MEDIA_MEM_SHALLOW);
-    logd("media_packet size=%d\n", media_packet_get_size(new_pkt));
-    return new_pkt;
+    return v;
 }
 
-static void item_free_hook(void *data)
+static uint32_t br_u(struct bit_reader *br, int n)
 {
-    struct media_packet *pkt = (struct media_packet *)data;
-    media_packet_destroy(pkt);
+    uint32_t v = 0;
+    while (n--) {
+        v = (v << 1) | br_u1(br);
+    }
+    return v;
 }
 
-static inline const uint8_t* h264_find_start_code(const uint8_t* ptr, const uint8_t* end)
+static uint32_t br_ue(struct bit_reader *br)
 {
-    const uint8_t *p;
-    for (p = ptr; p + 3 < end; p++) {
-        if (0x00 == p[0] && 0x00 == p[1] && (0x01 == p[2] || (0x00==p[2] && 0x01==p[3]))) {
-            return p;
+    int lz = 0;
+    while (!br_u1(br) && lz < 32 && br->p < br->end) {
+        lz++;
+    }
+    return ((1u << lz) - 1) + br_u(br, lz);
+}
+
+static int32_t br_se(struct bit_reader *br)
+{
+    uint32_t v = br_ue(br);
+    return (v & 1) ? (int32_t)((v + 1) / 2) : -(int32_t)(v / 2);
+}
+
+static void br_skip_scaling_list(struct bit_reader *br, int size)
+{
+    int i, last = 8, next = 8;
+    for (i = 0; i < size; i++) {
+        if (next != 0) {
+            next = (last + br_se(br) + 256) % 256;
         }
+        last = (next == 0) ? last : next;
     }
-    return end;
 }
 
-static int h264_parser_frame(struct h264_source_ctx *c, const char *name)
+static uint64_t gcd64(uint64_t a, uint64_t b)
 {
-    int ret = 0;
-    size_t count = 0;
-    size_t bytes;
-    const uint8_t *start, *end, *nalu, *nalu2;
-    struct media_packet *pkt;
-    struct queue_item *it;
-    struct iovec *data = file_dump(name);
-    if (!data) {
-        loge("file_dump %s failed!\n", name);
+    uint64_t t;
+    while (b) {
+        t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/*
+ * parse frame rate from SPS VUI timing info, sps points to NALU header
+ */
+static int h264_sps_parse_fps(const uint8_t *sps, const uint8_t *end, rational_t *fps)
+{
+    uint32_t i, n, profile, poc_type, num_units, time_scale;
+    uint64_t num, den, g;
+    struct bit_reader br = {sps + 1, end, 0, 0};
+
+    profile = br_u(&br, 8);
+    br_u(&br, 16);                      /* constraint flags, level_idc */
+    br_ue(&br);                         /* seq_parameter_set_id */
+    if (profile == 100 || profile == 110 || profile == 122 || profile == 244 ||
+        profile == 44  || profile == 83  || profile == 86  || profile == 118 ||
+        profile == 128 || profile == 138 || profile == 139 || profile == 134) {
+        uint32_t chroma = br_ue(&br);
+        if (chroma == 3) {
+            br_u1(&br);                 /* separate_colour_plane_flag */
+        }
+        br_ue(&br);                     /* bit_depth_luma_minus8 */
+        br_ue(&br);                     /* bit_depth_chroma_minus8 */
+        br_u1(&br);                     /* qpprime_y_zero_transform_bypass */
+        if (br_u1(&br)) {               /* seq_scaling_matrix_present_flag */
+            for (i = 0; i < ((chroma != 3) ? 8 : 12); i++) {
+                if (br_u1(&br)) {
+                    br_skip_scaling_list(&br, i < 6 ? 16 : 64);
+                }
+            }
+        }
+    }
+    br_ue(&br);                         /* log2_max_frame_num_minus4 */
+    poc_type = br_ue(&br);
+    if (poc_type == 0) {
+        br_ue(&br);
+    } else if (poc_type == 1) {
+        br_u1(&br);
+        br_se(&br);
+        br_se(&br);
+        n = br_ue(&br);
+        for (i = 0; i < n && br.p < br.end; i++) {
+            br_se(&br);
+        }
+    }
+    br_ue(&br);                         /* max_num_ref_frames */
+    br_u1(&br);                         /* gaps_in_frame_num_allowed */
+    br_ue(&br);                         /* pic_width_in_mbs_minus1 */
+    br_ue(&br);                         /* pic_height_in_map_units_minus1 */
+    if (!br_u1(&br)) {                  /* frame_mbs_only_flag */
+        br_u1(&br);
+    }
+    br_u1(&br);                         /* direct_8x8_inference_flag */
+    if (br_u1(&br)) {                   /* frame_cropping_flag */
+        br_ue(&br);
+        br_ue(&br);
+        br_ue(&br);
+        br_ue(&br);
+    }
+    if (!br_u1(&br)) {                  /* vui_parameters_present_flag */
+        return -1;
+    }
+    if (br_u1(&br)) {                   /* aspect_ratio_info_present_flag */
+        if (br_u(&br, 8) == 255) {
+            br_u(&br, 32);
+        }
+    }
+    if (br_u1(&br)) {                   /* overscan_info_present_flag */
+        br_u1(&br);
+    }
+    if (br_u1(&br)) {                   /* video_signal_type_present_flag */
+        br_u(&br, 4);
+        if (br_u1(&br)) {
+            br_u(&br, 24);
+        }
+    }
+    if (br_u1(&br)) {                   /* chroma_loc_info_present_flag */
+        br_ue(&br);
+        br_ue(&br);
+    }
+    if (!br_u1(&br)) {                  /* timing_info_present_flag */
+        return -1;
+    }
+    num_units = br_u(&br, 32);
+    time_scale = br_u(&br, 32);
+    if (br.p >= br.end || num_units == 0 || time_scale == 0) {
+        return -1;
+    }
+    /* one frame is two field ticks, reduce so that den fits in an int */
+    den = (uint64_t)num_units * 2;
+    num = time_scale;
+    g = gcd64(num, den);
+    num /= g;
+    den /= g;
+    while (num > INT_MAX || den > INT_MAX) {
+        num >>= 1;
+        den >>= 1;
+    }
+    if (num == 0 || den == 0) {
         return -1;
     }
-    start = data->iov_base;
-    end = start + data->iov_len;
-    nalu = h264_find_start_code(start, end);
+    fps->num = (int)num;
+    fps->den = (int)den;
+    return 0;
+}
 
+/*
+ * find the end of the access unit which starts at nalu, set *key if it
+ * contains an IDR slice. Returns offset of the next access unit start code.
+ */
+static const uint8_t *h264_access_unit(const uint8_t *au, const uint8_t *end, bool *key)
+{
+    const uint8_t *nalu, *next;
+    bool has_vcl = false;
+    enum h26x_nal_class cls;
+    int type;
+
+    *key = false;
+    nalu = h264_next_nalu(au, end);
     while (nalu < end) {
-        nalu2 = h264_find_start_code(nalu + 4, end);
-        bytes = nalu2 - nalu;
-        pkt = media_packet_create(MEDIA_TYPE_VIDEO, MEDIA_MEM_SHALLOW, (uint8_t *)nalu, bytes);
-        pkt->video->pts = 90000 * count++;
-        pkt->video->dts = 90000 * count++;
-        pkt->video->encoder.timebase.num = 30;
-        pkt->video->encoder.timebase.den = 1;
-
-        it = queue_item_alloc(c->q, pkt->video->data, pkt->video->size, pkt);
-        if (!it) {
-            loge("item_alloc packet type %d failed!\n", pkt->type);
-            ret = -1;
-            goto exit;
+        next = h26x_find_start_code(nalu, end);
+        type = h26x_nal_type(VIDEO_CODEC_H264, nalu);
+        cls = h26x_nal_classify(VIDEO_CODEC_H264, type);
+        if (cls == H26X_NAL_IDR || cls == H26X_NAL_SLICE) {
+            /* first_mb_in_slice == 0 is coded as a single '1' bit */
+            if (has_vcl && nalu + 1 < end && (nalu[1] & 0x80)) {
+                return nalu - 3;
+            }
+            has_vcl = true;
+            if (cls == H26X_NAL_IDR) {
+                *key = true;
+            }
+        } else if (cls == H26X_NAL_SLICE_PART) {
+            /* partitions B/C start with slice_id, they follow their partition A */
+        } else if (has_vcl && (cls != H26X_NAL_OTHER || (type >= 14 && type <= 18))) {
+            return nalu - 3;
         }
-        if (0 != queue_push(c->q, it)) {
-            loge("queue_push failed!\n");
-            ret = -1;
-            goto exit;
+        nalu = (next == end) ? end : next + 3;
+    }
+    return end;
+}
+
+static void h264_keyframe_add(struct h264_source_ctx *c, size_t offset, uint64_t frame)
+{
+    struct h264_keyframe *kf;
+    if (c->kf_num > 0 && c->kf[c->kf_num - 1].offset >= offset) {
+        return;
+    }
+    if (c->kf_num == c->kf_max) {
+        kf = realloc(c->kf, (c->kf_max + H264_KEYFRAME_IDX_STEP) * sizeof(*kf));
+        if (!kf) {
+            return;
         }
-        nalu = nalu2;
+        c->kf = kf;
+        c->kf_max += H264_KEYFRAME_IDX_STEP;
     }
-    c->duration = 40 * count;
+    c->kf[c->kf_num].offset = offset;
+    c->kf[c->kf_num].frame = frame;
+    c->kf_num++;
+}
+
+static void h264_probe(struct h264_source_ctx *c)
+{
+    const uint8_t *end = c->base + c->size;
+    const uint8_t *nalu = h264_next_nalu(c->base, end);
 
-exit:
-    free(data->iov_base);
-    return ret;
+    c->fps.num = H264_DEFAULT_FPS_NUM;
+    c->fps.den = H264_DEFAULT_FPS_DEN;
+    /* SPS is expected in the first few NALUs */
+    while (nalu < end && nalu < c->base + 4096) {
+        if ((nalu[0] & 0x1f) == H264_NAL_SPS) {
+            if (0 == h264_sps_parse_fps(nalu, h26x_find_start_code(nalu, end), &c->fps)) {
+                break;
+            }
+        }
+        nalu = h264_next_nalu(nalu, end);
+    }
+    logi("h264 source %s: %" PRIu64 " bytes, %d/%d fps\n",
+         c->name, (uint64_t)c->size, c->fps.num, c->fps.den);
 }
 
 static int h264_file_open(struct media_source *ms, const char *name)
@@ -121,33 +341,152 @@ static int h264_file_open(struct media_source *ms, const char *name)
         loge("calloc h264_source_ctx failed!\n");
         return -1;
     }
+    snprintf((char *)c->name, sizeof(c->name), "%s", name);
+    c->map = file_map(name, 0, 0, FILE_MAP_SEQUENTIAL);
+    if (!c->map) {
+        loge("map %s failed or empty file!\n", name);
+        goto failed;
+    }
+    c->base = (const uint8_t *)c->map->base;
+    c->size = c->map->len;
+    /* only the head is needed to start, the rest comes with readahead */
+    file_map_advise(c->map, 0, H264_PREFETCH_SIZE, FILE_MAP_WILLNEED);
 
-    c->q = queue_create();
-    if (!c->q) {
-        loge("queue_create failed!\n");
-        return -1;
+    c->pkt = media_packet_create(MEDIA_TYPE_VIDEO, MEDIA_MEM_SHALLOW, NULL, 0);
+    if (!c->pkt) {
+        loge("media_packet_create failed!\n");
+        goto failed;
     }
-    queue_set_hook(c->q, item_alloc_hook, item_free_hook);
+    h264_probe(c);
+    c->pos = h26x_find_start_code(c->base, c->base + c->size) - c->base;
+    c->loop = true;
+    c->pkt->video->encoder.type = VIDEO_CODEC_H264;
+    c->pkt->video->encoder.framerate = c->fps;
+    c->pkt->video->encoder.timebase.num = c->fps.den;
+    c->pkt->video->encoder.timebase.den = c->fps.num;
     ms->opaque = c;
-    h264_parser_frame(c, name);
     return 0;
+
+failed:
+    file_unmap(c->map);
+    free(c);
+    return -1;
 }
 
 static void h264_file_close(struct media_source *ms)
 {
     struct h264_source_ctx *c = (struct h264_source_ctx *)ms->opaque;
-    queue_destroy(c->q);
+    if (!c) {
+        return;
+    }
+    media_packet_destroy(c->pkt);
+    file_unmap(c->map);
+    free(c->kf);
     free(c);
+    ms->opaque = NULL;
+}
+
+static inline uint64_t h264_frame_to_nsec(struct h264_source_ctx *c, uint64_t frame)
+{
+    return frame * 1000000000ULL * c->fps.den / c->fps.num;
+}
+
+static void h264_wait_frame(struct h264_source_ctx *c)
+{
+    uint64_t now = time_bootup_nsec();
+    uint64_t due;
+
+    if (c->frame_cnt == 0 || c->clock_base == 0) {
+        c->clock_base = now - h264_frame_to_nsec(c, c->frame_cnt);
+        return;
+    }
+    due = c->clock_base + h264_frame_to_nsec(c, c->frame_cnt);
+    if (due > now) {
+        usleep((due - now) / 1000);
+    }
 }
 
 static int h264_file_read_frame(struct media_source *ms, void **data, size_t *len)
 {
     struct h264_source_ctx *c = (struct h264_source_ctx *)ms->opaque;
-    struct queue_item *it = queue_pop(c->q);
-    *data = (struct media_packet *)it->opaque.iov_base;
-    *len = it->opaque.iov_len;
-    logd("queue_pop ptr=%p, data=%p, len=%d\n", it->opaque.iov_base, *data, it->opaque.iov_len);
-    //item_free(c->q, it);
+    struct video_packet *vpkt = c->pkt->video;
+    const uint8_t *end = c->base + c->size;
+    const uint8_t *au, *next;
+    bool key;
+
+    if (c->pos >= c->size) {
+        if (!c->loop) {
+            return -1;
+        }
+        c->pos = h26x_find_start_code(c->base, end) - c->base;
+        c->frame_in_file = 0;
+        if (c->pos >= c->size) {
+            return -1;
+        }
+    }
+    au = c->base + c->pos;
+    next = h264_access_unit(au, end, &key);
+    if (key) {
+        h264_keyframe_add(c, c->pos, c->frame_in_file);
+    }
+    if (c->pos >= c->scanned) {
+        c->scanned = next - c->base;
+        c->scanned_frames = c->frame_in_file + 1;
+    }
+
+    h264_wait_frame(c);
+
+    vpkt->data = (uint8_t *)au;
+    vpkt->size = next - au;
+    vpkt->key_frame = key;
+    vpkt->type = key ? H26X_FRAME_IDR : H26X_FRAME_P;
+    vpkt->pts = c->frame_cnt * c->fps.den;
+    vpkt->dts = vpkt->pts;
+
+    c->pos = next - c->base;
+    c->frame_cnt++;
+    c->frame_in_file++;
+
+    *data = c->pkt;
+    *len = vpkt->size;
+    return 0;
+}
+
+/*
+ * seek to the last keyframe at or before msec, extending the keyframe index
+ * by scanning (without pacing) when the target is beyond what we have seen.
+ */
+static int h264_file_seek(struct media_source *ms, uint64_t msec)
+{
+    struct h264_source_ctx *c = (struct h264_source_ctx *)ms->opaque;
+    const uint8_t *end = c->base + c->size;
+    const uint8_t *au, *next;
+    uint64_t target = msec * c->fps.num / (1000ULL * c->fps.den);
+    bool key;
+    int i;
+
+    if (c->scanned == 0) {
+        c->scanned = h26x_find_start_code(c->base, end) - c->base;
+    }
+    while (c->scanned < c->size && c->scanned_frames <= target) {
+        au = c->base + c->scanned;
+        next = h264_access_unit(au, end, &key);
+        if (key) {
+            h264_keyframe_add(c, c->scanned, c->scanned_frames);
+        }
+        c->scanned = next - c->base;
+        c->scanned_frames++;
+    }
+    if (c->kf_num == 0) {
+        loge("no keyframe found in %s\n", c->name);
+        return -1;
+    }
+    for (i = c->kf_num - 1; i > 0 && c->kf[i].frame > target; i--);
+    c->pos = c->kf[i].offset;
+    c->frame_in_file = c->kf[i].frame;
+    /* restart pacing from the seek point */
+    c->clock_base = 0;
+    logi("seek %" PRIu64 "ms to frame %" PRIu64 "\n", msec, c->frame_in_file);
     return 0;
 }
 
@@ -206,5 +545,6 @@ struct media_source media_source_h264 = {
     ._open         = h264_file_open,
     ._read         = h264_file_read_frame,
     ._write        = h264_file_write,
+    ._seek         = h264_file_seek,
     ._close        = h264_file_close,
 };
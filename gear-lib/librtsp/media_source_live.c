@@ -244,11 +244,16 @@ pic->img.i_plane, frame->planes);
 static int fill_packet(struct x264_ctx *c, struct video_packet *pkt,
                        x264_nal_t *nals, int nal_cnt, x264_picture_t *pic_out)
 {
-    int i;
+    int i, bytes = 0;
     if (!nal_cnt)
         return -1;
 
-    da_free(c->packet_data);
+    /* keep the buffer across frames, grow it at most once per frame */
+    da_resize(c->packet_data, 0);
+    for (i = 0; i < nal_cnt; i++) {
+        bytes += nals[i].i_payload;
+    }
+    da_reserve(c->packet_data, bytes);
 
     if (!c->append_extra) {
         pkt->encoder.extra_data = c->encoder.extra_data;
@@ -325,6 +330,7 @@ static void x264_close(struct x264_ctx *c)
         cc->extradata.iov_len = 0;
     }
     free(c->sei.iov_base);
+    da_free(c->packet_data);
     free(c);
 }
 static int is_auth()
@@ -418,22 +424,22 @@ static int live_read(struct media_source *ms, void **data, size_t *len)
     struct iovec in, out;
     struct live_source_ctx *c = (struct live_source_ctx *)ms->opaque;
     int size;
-    ms_pre = time_now_msec();
+    ms_pre = time_fast_nsec()/1000000;
     size = avcap_query_frame(c->uvc, &c->frm);
     if (size < 0) {
         loge("avcap_query_frame failed!\n");
     }
-    ms_post = time_now_msec();
+    ms_post = time_fast_nsec()/1000000;
     logd("avcap_query_frame cost %" PRIu64 "ms\n", ms_post - ms_pre);
     in.iov_base = &c->frm.video;
     in.iov_len = size;
     out.iov_base = c->pkt;
-    ms_pre = time_now_msec();
+    ms_pre = time_fast_nsec()/1000000;
     ret = x264_encode(c->x264, &in, &out);
     if (ret < 0) {
         loge("x264_encode failed\n");
     }
-    ms_post = time_now_msec();
+    ms_post = time_fast_nsec()/1000000;
     *data = out.iov_base;
     *len = out.iov_len;
     logd("x264_encode len=%d, cost %" PRIu64 "ms\n", *len, ms_post - ms_pre);
@@ -217,6 +217,8 @@ static int on_play(struct rtsp_request *req, char *url)
     struct transport_session *ts;
     struct media_source *ms;
 
+    /* req lives as long as the connection, drop the Range of an earlier PLAY */
+    memset(&req->range, 0, sizeof(req->range));
     if (-1 == parse_range(&req->range, (char *)req->raw->iov_base, req->raw->iov_len)) {
         loge("parse_range failed!\n");
         return -1;
@@ -239,6 +241,9 @@ static int on_play(struct rtsp_request *req, char *url)
     n += snprintf(buf+n, sizeof(buf)-n, "RTP-Info: url=%s;seq=%s;rtptime=%u\r\n\r\n", req->url_origin, req->cseq, get_timestamp());//XXX
 
     handle_rtsp_response(req, 200, buf);
+    /* npt=0- is a seek to the start too, npt=now- and no Range are not */
+    ts->seek = (req->range.type != 0 && req->range.from_value == RTSP_RANGE_TIME_NORMAL);
+    ts->seek_msec = req->range.from;
     transport_session_start(ts, ms);
     return 0;
 }
@@ -222,9 +222,12 @@ int rtp_packet_deserialize(struct rtp_packet *pkt, const void* data, int bytes)
     return 0;
 }
 
+static struct mem_cache *rtp_packet_cache;
+
 struct rtp_packet *rtp_packet_create(uint8_t pt, int size, uint16_t seq, uint32_t ssrc)
 {
-    struct rtp_packet *pkt = calloc(1, sizeof(struct rtp_packet));
+    struct rtp_packet *pkt = mem_cache_zalloc(mem_cache_get(&rtp_packet_cache, "rtp_packet",
+                                                            sizeof(struct rtp_packet)));
     if (!pkt) return NULL;
 
     pkt->header.v = RTP_VERSION;
@@ -238,7 +241,7 @@ struct rtp_packet *rtp_packet_create(uint8_t pt, int size, uint16_t seq, uint32_
 void rtp_packet_destroy(struct rtp_packet *pkt)
 {
     if (pkt)
-        free(pkt);
+        mem_cache_free(rtp_packet_cache, pkt);
 }
 
 int rtp_packet_get_info(struct rtp_packet *pkt, uint16_t* seq, uint32_t* timestamp)
@@ -261,6 +264,12 @@ int rtp_packet_pack(struct rtp_socket *sock, struct rtp_packet *pkt, const void*
     }
     pkt->header.timestamp = timestamp;
     pkt->header.m = 0;
+    if (pkt->size <= RTP_FIXED_HEADER) {
+        return -1;
+    }
+    /* one buffer for every fragment, each is at most pkt->size */
+    rtp = (uint8_t*)malloc(pkt->size);
+    if (!rtp) return ENOMEM;
 
     for (ptr = (const uint8_t *)data; bytes > 0; ++pkt->header.seq) {
         pkt->payload = ptr;
@@ -269,9 +278,6 @@ int rtp_packet_pack(struct rtp_socket *sock, struct rtp_packet *pkt, const void*
         bytes -= pkt->payloadlen;
 
         n = RTP_FIXED_HEADER + pkt->payloadlen;
-        rtp = (uint8_t*)calloc(1, n);
-        if (!rtp) return ENOMEM;
-
         n = rtp_packet_serialize(pkt, rtp, n);
         if (n != RTP_FIXED_HEADER + pkt->payloadlen) {
             free(rtp);
@@ -280,11 +286,11 @@ int rtp_packet_pack(struct rtp_socket *sock, struct rtp_packet *pkt, const void*
 
         loge("send len=%d\n", n);
         ret = rtp_sendto(sock, NULL, 0, rtp, n);//XXX
-        free(rtp);
         if (ret < 0) {
             loge("rtp_sendto ret=%d\n", ret);
         }
     }
+    free(rtp);
 
     return 0;
 }
@@ -82,19 +82,6 @@ typedef struct h264_fu_header H264_FU_HEADER;
 #define FU_END      0x40
 #define N_FU_HEADER 2
 
-static const uint8_t* h264_nalu_find(const uint8_t* p, const uint8_t* end)
-{
-    int j = 0;
-    for (p += 2; p + 1 < end; p++, j++) {
-        //if (0x000001 == (*(p-2)<<16 | *(p-1)<<8 | *p)) {
-        if (0x01 == *p && 0x00 == *(p - 1) && 0x00 == *(p - 2)) {
-            logd("got nalu, j=%d\n", j);
-            return p + 1;
-        }
-    }
-    return end;
-}
-
 static int rtp_h264_pack_nalu(struct rtp_socket *sock, struct rtp_packet *pkt, const uint8_t* nalu, int bytes)
 {
     int n, ret;
@@ -176,25 +163,17 @@ static int rtp_h264_pack_fu_a(struct rtp_socket *sock, struct rtp_packet *pkt, c
 int rtp_payload_h264_encode(struct rtp_socket *sock, struct rtp_packet *pkt, const void* h264, int bytes, uint32_t timestamp)
 {
     int r = 0;
-    const uint8_t *p1, *p2, *pend;
+    const uint8_t *p, *pend;
+    struct h26x_nal nal;
     pkt->header.timestamp = timestamp;
 
     pend = (const uint8_t*)h264 + bytes;
 
-    for (p1 = h264_nalu_find((const uint8_t*)h264, pend); p1 < pend && 0 == r; p1 = p2) {
-        size_t nalu_size;
-
-        p2 = h264_nalu_find(p1 + 1, pend);
-        nalu_size = p2 - p1;
-
-        // filter suffix '00' bytes
-        if (p2 != pend) --nalu_size;
-        while(0 == p1[nalu_size-1]) --nalu_size;
-
-        if (nalu_size + RTP_FIXED_HEADER <= MTU) {
-            r = rtp_h264_pack_nalu(sock, pkt, p1, nalu_size);
+    for (p = h264; 0 == r && (p = h26x_next_nal(VIDEO_CODEC_H264, p, pend, &nal)) != NULL;) {
+        if (nal.size + RTP_FIXED_HEADER <= MTU) {
+            r = rtp_h264_pack_nalu(sock, pkt, nal.data, nal.size);
         } else {
-            r = rtp_h264_pack_fu_a(sock, pkt, p1, nalu_size);
+            r = rtp_h264_pack_fu_a(sock, pkt, nal.data, nal.size);
         }
     }
     return r;
@@ -706,10 +706,18 @@ static const char* rtsp_header_range_npt_time(const char* str, uint64_t *seconds
                 //*seconds = hours;
         }
 
+        // fraction in ms: ".5" is 500, digits past the third are dropped
+        *fraction = 0;
         if(*p == '.')
-                p = string_token_int(p+1, fraction);
-        else
-                *fraction = 0;
+        {
+            for(v1 = 0, ++p; *p >= '0' && *p <= '9'; ++p, ++v1)
+            {
+                if(v1 < 3)
+                    *fraction = *fraction * 10 + (*p - '0');
+            }
+            for(; v1 < 3; ++v1)
+                *fraction *= 10;
+        }
     }
 
     return p;
@@ -851,7 +859,7 @@ int parse_range(struct range_header *range, char* buf, int len)
 {
     int r = 0;
     int found = 0;
-    char *field;
+    char *field, *eol;
     while (1) {
         if (*buf == '\0') {
             break;
@@ -868,9 +876,14 @@ int parse_range(struct range_header *range, char* buf, int len)
     if (!found) {
         return 0;
     }
-    field = buf;
+    /* skip "Range:" up to the first range specifier */
+    field = buf + 5;
+    while (*field == ' ' || *field == ':') {
+        ++field;
+    }
+    eol = strchr(field, '\r');
     range->time = 0L;
-    while (field && 0 == r) {
+    while (field && (!eol || field < eol) && 0 == r) {
         if (0 == strncasecmp("clock=", field, 6)) {
             range->type = RTSP_RANGE_CLOCK;
             r = rtsp_header_range_clock(field+6, range);
@@ -34,6 +34,8 @@
 #include <errno.h>
 #include <sys/time.h>
 #include <unistd.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
 
 
 void *transport_session_pool_create()
@@ -118,6 +120,11 @@ static void *send_thread(struct thread *t, void *ptr)
         loge("open failed!\n");
         return NULL;
     }
+    if (ts->seek && ms->_seek) {
+        if (-1 == ms->_seek(ms, ts->seek_msec)) {
+            loge("seek to %" PRIu64 "ms failed!\n", ts->seek_msec);
+        }
+    }
     ms->is_active = true;
     ssrc = (unsigned int)rtp_ssrc();
     pts = time_now_msec();
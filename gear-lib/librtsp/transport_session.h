@@ -27,6 +27,7 @@
 #include "rtp.h"
 #include <libthread.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <stddef.h>
 
 #ifdef __cplusplus
@@ -53,6 +54,8 @@ typedef struct transport_session {
     uint8_t packet[1450];
 
     int track; // mp4 track
+    bool seek; // play had a range start, seek_msec may be 0
+    uint64_t seek_msec; // play range start, used if media source can seek
     struct thread *thread;
     struct thread *ev_thread;
     struct media_source *media_source;
@@ -62,6 +62,10 @@ char *strtolower(char *dst, char *src, size_t n);
 
 int strhex2bin(char ch);
 
+/**
+ * base64/base16 codecs, SSSE3/AVX2 or NEON when the cpu has them.
+ * base64_decode() accepts both the standard and the url alphabet.
+ */
 GEAR_API size_t base64_encode(char* target, const void *source, size_t bytes);
 GEAR_API size_t base64_encode_url(char* target, const void *source, size_t bytes);
 GEAR_API size_t base64_decode(void* target, const char *source, size_t bytes);
@@ -69,6 +73,53 @@ GEAR_API size_t base64_decode(void* target, const char *source, size_t bytes);
 GEAR_API size_t base16_encode(char* target, const void *source, size_t bytes);
 GEAR_API size_t base16_decode(void* target, const char *source, size_t bytes);
 
+/**
+ * @exact output size: encode size includes padding, decode size honours the
+ *  trailing '=' of source (unpadded input is fine too)
+ */
+GEAR_API size_t base64_encode_size(size_t bytes);
+GEAR_API size_t base64_decode_size(const char *source, size_t bytes);
+GEAR_API size_t base16_encode_size(size_t bytes);
+GEAR_API size_t base16_decode_size(size_t bytes);
+
+/**
+ * @base64 stream, for input that arrives in arbitrary chunks.
+ *  encode: target needs base64_encode_size(bytes) per call and 4 for final.
+ *  decode: target needs bytes / 4 * 3 + 3 per call and 2 for final; white
+ *  space is skipped, padding is optional, anything else returns -1.
+ */
+struct base64_stream {
+    uint8_t buf[4];
+    int len;
+    int url;
+    int done;
+};
+
+GEAR_API void base64_stream_init(struct base64_stream *s, int url);
+GEAR_API size_t base64_stream_encode(struct base64_stream *s, char *target, const void *source, size_t bytes);
+GEAR_API size_t base64_stream_encode_final(struct base64_stream *s, char *target);
+GEAR_API size_t base64_stream_decode(struct base64_stream *s, void *target, const char *source, size_t bytes);
+GEAR_API size_t base64_stream_decode_final(struct base64_stream *s, void *target);
+
+/**
+ * @base16 stream decode keeps an odd trailing digit for the next chunk,
+ *  base16_encode() is already chunkable as is
+ */
+struct base16_stream {
+    uint8_t hi;
+    int len;
+};
+
+GEAR_API void base16_stream_init(struct base16_stream *s);
+GEAR_API size_t base16_stream_decode(struct base16_stream *s, void *target, const char *source, size_t bytes);
+
+/**
+ * @strhash64 fast non-cryptographic hash (wyhash), for hash tables and
+ *  dictionaries, not for anything facing an attacker without a random seed
+ */
+GEAR_API uint64_t strhash64(const void *key, size_t len, uint64_t seed);
+GEAR_API uint32_t strhash32(const void *key, size_t len);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,850 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#include "libstrex.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#define STREX_SIMD_X86
+#include <immintrin.h>
+#elif defined (__GNUC__) && defined (__aarch64__) && defined (__ARM_NEON)
+#define STREX_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+/*
+ * base64/base16 codecs
+ *
+ * Every backend works on whole blocks and returns how much of the input it
+ * consumed; the scalar code finishes the tail, padding and anything the
+ * vector code refuses (the decoders bail out of a block holding a byte
+ * outside the alphabet, including '=', so the scalar path keeps the exact
+ * legacy semantics for dirty input).
+ */
+
+struct strcodec_ops {
+    size_t (*b64_encode)(char *dst, const uint8_t *src, size_t len, int url);
+    size_t (*b64_decode)(uint8_t *dst, const uint8_t *src, size_t len);
+    size_t (*b16_encode)(char *dst, const uint8_t *src, size_t len);
+    size_t (*b16_decode)(uint8_t *dst, const uint8_t *src, size_t len);
+};
+
+static const char s_base64_enc[64] = {
+    'A','B','C','D','E','F','G','H','I','J','K','L','M',
+    'N','O','P','Q','R','S','T','U','V','W','X','Y','Z',
+    'a','b','c','d','e','f','g','h','i','j','k','l','m',
+    'n','o','p','q','r','s','t','u','v','w','x','y','z',
+    '0','1','2','3','4','5','6','7','8','9','+','/'
+};
+
+static const char s_base64_url[64] = {
+    'A','B','C','D','E','F','G','H','I','J','K','L','M',
+    'N','O','P','Q','R','S','T','U','V','W','X','Y','Z',
+    'a','b','c','d','e','f','g','h','i','j','k','l','m',
+    'n','o','p','q','r','s','t','u','v','w','x','y','z',
+    '0','1','2','3','4','5','6','7','8','9','-','_'
+};
+
+/* lenient table of base64_decode(): anything unknown decodes as 0 */
+static const uint8_t s_base64_dec[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,62, 0,62, 0,63,  /* +/-/ */
+    52,53,54,55,56,57,58,59,60,61, 0, 0, 0, 0, 0, 0, /* 0 - 9 */
+    0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14,  /* A - Z */
+    15,16,17,18,19,20,21,22,23,24,25, 0, 0, 0, 0,63, /* _ */
+    00,26,27,28,29,30,31,32,33,34,35,36,37,38,39,40, /* a - z */
+    41,42,43,44,45,46,47,48,49,50,51, 0, 0, 0, 0, 0,
+};
+
+/* strict table of the stream decoder, both alphabets, XX is invalid */
+#define XX 0xFF
+static const uint8_t s_base64_val[256] = {
+    XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,
+    XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,
+    XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,62,XX,62,XX,63, /* +/-/ */
+    52,53,54,55,56,57,58,59,60,61,XX,XX,XX,XX,XX,XX, /* 0 - 9 */
+    XX, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14, /* A - Z */
+    15,16,17,18,19,20,21,22,23,24,25,XX,XX,XX,XX,63, /* _ */
+    XX,26,27,28,29,30,31,32,33,34,35,36,37,38,39,40, /* a - z */
+    41,42,43,44,45,46,47,48,49,50,51,XX,XX,XX,XX,XX,
+    XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,
+    XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,
+    XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,
+    XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,
+    XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,
+    XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,
+    XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,
+    XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,
+};
+#undef XX
+
+static const char s_base16_enc[16] = {
+    '0','1','2','3','4','5','6','7','8','9','A','B','C','D','E','F'
+};
+
+static const uint8_t s_base16_dec[128] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 0, 0, 0, 0, 0, /* 0 - 9 */
+    0,10,11,12,13,14,15, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* A - F */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0,10,11,12,13,14,15, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* a - f */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+static size_t b64_encode_c(char *dst, const uint8_t *src, size_t len, int url)
+{
+    const char *table = url ? s_base64_url : s_base64_enc;
+    size_t i;
+
+    for (i = 0; i + 3 <= len; i += 3) {
+        dst[0] = table[(src[i] >> 2) & 0x3F];
+        dst[1] = table[((src[i] & 0x03) << 4) | ((src[i + 1] >> 4) & 0x0F)];
+        dst[2] = table[((src[i + 1] & 0x0F) << 2) | ((src[i + 2] >> 6) & 0x03)];
+        dst[3] = table[src[i + 2] & 0x3F];
+        dst += 4;
+    }
+    return i;
+}
+
+/* the 1 or 2 byte tail group, padded to 4 chars */
+static size_t b64_encode_tail(char *dst, const uint8_t *src, size_t len, int url)
+{
+    const char *table = url ? s_base64_url : s_base64_enc;
+
+    dst[0] = table[(src[0] >> 2) & 0x3F];
+    if (len > 1) {
+        dst[1] = table[((src[0] & 0x03) << 4) | ((src[1] >> 4) & 0x0F)];
+        dst[2] = table[(src[1] & 0x0F) << 2];
+    } else {
+        dst[1] = table[(src[0] & 0x03) << 4];
+        dst[2] = '=';
+    }
+    dst[3] = '=';
+    return 4;
+}
+
+static size_t b64_decode_c(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    return 0;
+}
+
+static size_t b16_encode_c(char *dst, const uint8_t *src, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        dst[i * 2] = s_base16_enc[(src[i] >> 4) & 0x0F];
+        dst[i * 2 + 1] = s_base16_enc[src[i] & 0x0F];
+    }
+    return len;
+}
+
+static size_t b16_decode_c(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    return 0;
+}
+
+static const struct strcodec_ops s_ops_c = {
+    b64_encode_c,
+    b64_decode_c,
+    b16_encode_c,
+    b16_decode_c,
+};
+
+#if defined (STREX_SIMD_X86)
+/*
+ * base64 encode: shuffle each 3 source bytes into a 32-bit lane, split out
+ * the four 6-bit indices with two multiplies, then map index ranges to ASCII
+ * with one pshufb of per-range offsets
+ */
+#define B64_OFFSETS(c62, c63) \
+    71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, (c62) - 62, (c63) - 63, 65, 0, 0
+
+__attribute__((target("ssse3")))
+static inline __m128i b64_enc_lane_ssse3(__m128i in, __m128i offsets)
+{
+    __m128i t0, t1, t2, t3, idx, res;
+
+    in = _mm_shuffle_epi8(in, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4,
+                                            7, 6, 8, 7, 10, 9, 11, 10));
+    t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    idx = _mm_or_si128(t1, t3);
+
+    res = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+    res = _mm_or_si128(res, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), idx),
+                                          _mm_set1_epi8(13)));
+    return _mm_add_epi8(idx, _mm_shuffle_epi8(offsets, res));
+}
+
+__attribute__((target("ssse3")))
+static size_t b64_encode_ssse3(char *dst, const uint8_t *src, size_t len, int url)
+{
+    const __m128i offsets = url ? _mm_setr_epi8(B64_OFFSETS('-', '_'))
+                                : _mm_setr_epi8(B64_OFFSETS('+', '/'));
+    size_t i;
+
+    /* 12 bytes per round, the 16 byte load must stay inside src */
+    for (i = 0; i + 16 <= len; i += 12) {
+        __m128i in = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)dst, b64_enc_lane_ssse3(in, offsets));
+        dst += 16;
+    }
+    return i + b64_encode_c(dst, src + i, len - i, url);
+}
+
+__attribute__((target("avx2")))
+static size_t b64_encode_avx2(char *dst, const uint8_t *src, size_t len, int url)
+{
+    const __m256i offsets = url ? _mm256_setr_epi8(B64_OFFSETS('-', '_'), B64_OFFSETS('-', '_'))
+                                : _mm256_setr_epi8(B64_OFFSETS('+', '/'), B64_OFFSETS('+', '/'));
+    const __m256i shuf = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                          1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    __m256i in, t0, t1, t2, t3, idx, res;
+    size_t i;
+
+    /* 24 bytes per round, two 12 byte lanes loaded 16 bytes wide */
+    for (i = 0; i + 28 <= len; i += 24) {
+        in = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(src + i))),
+                _mm_loadu_si128((const __m128i *)(src + i + 12)), 1);
+        in = _mm256_shuffle_epi8(in, shuf);
+        t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+        t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+        t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+        t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+        idx = _mm256_or_si256(t1, t3);
+
+        res = _mm256_subs_epu8(idx, _mm256_set1_epi8(51));
+        res = _mm256_or_si256(res, _mm256_and_si256(
+                        _mm256_cmpgt_epi8(_mm256_set1_epi8(26), idx), _mm256_set1_epi8(13)));
+        res = _mm256_add_epi8(idx, _mm256_shuffle_epi8(offsets, res));
+        _mm256_storeu_si256((__m256i *)dst, res);
+        dst += 32;
+    }
+    return i + b64_encode_ssse3(dst, src + i, len - i, url);
+}
+
+/*
+ * base64 decode: map both alphabets by character range, reject the whole
+ * block on anything else, then pack 4x6 bits with maddubs/madd and compact
+ * the 3 useful bytes of every 32-bit lane.
+ * A block writes 4 bytes past its output, so at least 8 more input chars
+ * (which decode to at least 4 bytes) must follow it.
+ */
+#define B64_RANGE(c, lo, hi) \
+    _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8((lo) - 1)), \
+                  _mm_cmpgt_epi8(_mm_set1_epi8((hi) + 1), c))
+#define B64_RANGE256(c, lo, hi) \
+    _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8((lo) - 1)), \
+                     _mm256_cmpgt_epi8(_mm256_set1_epi8((hi) + 1), c))
+
+__attribute__((target("ssse3")))
+static size_t b64_decode_ssse3(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    __m128i c, upper, lower, digit, c62, c63, v, valid;
+    size_t i;
+
+    for (i = 0; i + 16 + 8 <= len; i += 16) {
+        c = _mm_loadu_si128((const __m128i *)(src + i));
+        upper = B64_RANGE(c, 'A', 'Z');
+        lower = B64_RANGE(c, 'a', 'z');
+        digit = B64_RANGE(c, '0', '9');
+        c62 = _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('+')),
+                           _mm_cmpeq_epi8(c, _mm_set1_epi8('-')));
+        c63 = _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('/')),
+                           _mm_cmpeq_epi8(c, _mm_set1_epi8('_')));
+        valid = _mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(digit, _mm_or_si128(c62, c63)));
+        if (_mm_movemask_epi8(valid) != 0xFFFF) {
+            break;
+        }
+        v = _mm_and_si128(upper, _mm_sub_epi8(c, _mm_set1_epi8('A')));
+        v = _mm_or_si128(v, _mm_and_si128(lower, _mm_sub_epi8(c, _mm_set1_epi8('a' - 26))));
+        v = _mm_or_si128(v, _mm_and_si128(digit, _mm_add_epi8(c, _mm_set1_epi8(52 - '0'))));
+        v = _mm_or_si128(v, _mm_and_si128(c62, _mm_set1_epi8(62)));
+        v = _mm_or_si128(v, _mm_and_si128(c63, _mm_set1_epi8(63)));
+
+        v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+        v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+        _mm_storeu_si128((__m128i *)dst, _mm_shuffle_epi8(v, pack));
+        dst += 12;
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t b64_decode_avx2(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                          2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    __m256i c, upper, lower, digit, c62, c63, v, valid;
+    size_t i;
+
+    for (i = 0; i + 32 + 8 <= len; i += 32) {
+        c = _mm256_loadu_si256((const __m256i *)(src + i));
+        upper = B64_RANGE256(c, 'A', 'Z');
+        lower = B64_RANGE256(c, 'a', 'z');
+        digit = B64_RANGE256(c, '0', '9');
+        c62 = _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('+')),
+                              _mm256_cmpeq_epi8(c, _mm256_set1_epi8('-')));
+        c63 = _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('/')),
+                              _mm256_cmpeq_epi8(c, _mm256_set1_epi8('_')));
+        valid = _mm256_or_si256(_mm256_or_si256(upper, lower),
+                                _mm256_or_si256(digit, _mm256_or_si256(c62, c63)));
+        if ((uint32_t)_mm256_movemask_epi8(valid) != 0xFFFFFFFF) {
+            break;
+        }
+        v = _mm256_and_si256(upper, _mm256_sub_epi8(c, _mm256_set1_epi8('A')));
+        v = _mm256_or_si256(v, _mm256_and_si256(lower, _mm256_sub_epi8(c, _mm256_set1_epi8('a' - 26))));
+        v = _mm256_or_si256(v, _mm256_and_si256(digit, _mm256_add_epi8(c, _mm256_set1_epi8(52 - '0'))));
+        v = _mm256_or_si256(v, _mm256_and_si256(c62, _mm256_set1_epi8(62)));
+        v = _mm256_or_si256(v, _mm256_and_si256(c63, _mm256_set1_epi8(63)));
+
+        v = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+        v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));
+        v = _mm256_shuffle_epi8(v, pack);
+        _mm_storeu_si128((__m128i *)dst, _mm256_castsi256_si128(v));
+        _mm_storeu_si128((__m128i *)(dst + 12), _mm256_extracti128_si256(v, 1));
+        dst += 24;
+    }
+    return i + b64_decode_ssse3(dst, src + i, len - i);
+}
+
+/* base16: nibbles through a pshufb table, interleaved back in order */
+__attribute__((target("ssse3")))
+static size_t b16_encode_ssse3(char *dst, const uint8_t *src, size_t len)
+{
+    const __m128i lut = _mm_loadu_si128((const __m128i *)s_base16_enc);
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    __m128i in, hi, lo;
+    size_t i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        in = _mm_loadu_si128((const __m128i *)(src + i));
+        hi = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(in, 4), mask));
+        lo = _mm_shuffle_epi8(lut, _mm_and_si128(in, mask));
+        _mm_storeu_si128((__m128i *)(dst + i * 2), _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i *)(dst + i * 2 + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+    return i + b16_encode_c(dst + i * 2, src + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t b16_encode_avx2(char *dst, const uint8_t *src, size_t len)
+{
+    const __m256i lut = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)s_base16_enc));
+    const __m256i mask = _mm256_set1_epi8(0x0F);
+    __m256i in, hi, lo, a, b;
+    size_t i;
+
+    for (i = 0; i + 32 <= len; i += 32) {
+        in = _mm256_loadu_si256((const __m256i *)(src + i));
+        hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(in, 4), mask));
+        lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(in, mask));
+        a = _mm256_unpacklo_epi8(hi, lo);
+        b = _mm256_unpackhi_epi8(hi, lo);
+        _mm256_storeu_si256((__m256i *)(dst + i * 2), _mm256_permute2x128_si256(a, b, 0x20));
+        _mm256_storeu_si256((__m256i *)(dst + i * 2 + 32), _mm256_permute2x128_si256(a, b, 0x31));
+    }
+    return i + b16_encode_ssse3(dst + i * 2, src + i, len - i);
+}
+
+__attribute__((target("ssse3")))
+static size_t b16_decode_ssse3(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    __m128i c, digit, upper, lower, v;
+    size_t i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        c = _mm_loadu_si128((const __m128i *)(src + i));
+        digit = B64_RANGE(c, '0', '9');
+        upper = B64_RANGE(c, 'A', 'F');
+        lower = B64_RANGE(c, 'a', 'f');
+        if (_mm_movemask_epi8(_mm_or_si128(digit, _mm_or_si128(upper, lower))) != 0xFFFF) {
+            break;
+        }
+        v = _mm_and_si128(digit, _mm_sub_epi8(c, _mm_set1_epi8('0')));
+        v = _mm_or_si128(v, _mm_and_si128(upper, _mm_sub_epi8(c, _mm_set1_epi8('A' - 10))));
+        v = _mm_or_si128(v, _mm_and_si128(lower, _mm_sub_epi8(c, _mm_set1_epi8('a' - 10))));
+        v = _mm_maddubs_epi16(v, _mm_set1_epi16(0x0110));
+        _mm_storel_epi64((__m128i *)(dst + i / 2), _mm_packus_epi16(v, v));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t b16_decode_avx2(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    __m256i c, digit, upper, lower, v;
+    size_t i;
+
+    for (i = 0; i + 32 <= len; i += 32) {
+        c = _mm256_loadu_si256((const __m256i *)(src + i));
+        digit = B64_RANGE256(c, '0', '9');
+        upper = B64_RANGE256(c, 'A', 'F');
+        lower = B64_RANGE256(c, 'a', 'f');
+        if ((uint32_t)_mm256_movemask_epi8(_mm256_or_si256(digit, _mm256_or_si256(upper, lower))) != 0xFFFFFFFF) {
+            break;
+        }
+        v = _mm256_and_si256(digit, _mm256_sub_epi8(c, _mm256_set1_epi8('0')));
+        v = _mm256_or_si256(v, _mm256_and_si256(upper, _mm256_sub_epi8(c, _mm256_set1_epi8('A' - 10))));
+        v = _mm256_or_si256(v, _mm256_and_si256(lower, _mm256_sub_epi8(c, _mm256_set1_epi8('a' - 10))));
+        v = _mm256_maddubs_epi16(v, _mm256_set1_epi16(0x0110));
+        v = _mm256_permute4x64_epi64(_mm256_packus_epi16(v, v), 0x08);
+        _mm_storeu_si128((__m128i *)(dst + i / 2), _mm256_castsi256_si128(v));
+    }
+    return i + b16_decode_ssse3(dst + i / 2, src + i, len - i);
+}
+
+static const struct strcodec_ops s_ops_ssse3 = {
+    b64_encode_ssse3,
+    b64_decode_ssse3,
+    b16_encode_ssse3,
+    b16_decode_ssse3,
+};
+
+static const struct strcodec_ops s_ops_avx2 = {
+    b64_encode_avx2,
+    b64_decode_avx2,
+    b16_encode_avx2,
+    b16_decode_avx2,
+};
+#elif defined (STREX_SIMD_NEON)
+static size_t b64_encode_neon(char *dst, const uint8_t *src, size_t len, int url)
+{
+    const char *table = url ? s_base64_url : s_base64_enc;
+    uint8x16x4_t lut, out;
+    uint8x16x3_t in;
+    size_t i;
+
+    lut.val[0] = vld1q_u8((const uint8_t *)table);
+    lut.val[1] = vld1q_u8((const uint8_t *)table + 16);
+    lut.val[2] = vld1q_u8((const uint8_t *)table + 32);
+    lut.val[3] = vld1q_u8((const uint8_t *)table + 48);
+
+    for (i = 0; i + 48 <= len; i += 48) {
+        in = vld3q_u8(src + i);
+        out.val[0] = vshrq_n_u8(in.val[0], 2);
+        out.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[0], 4), vshrq_n_u8(in.val[1], 4)), vdupq_n_u8(0x3F));
+        out.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[1], 2), vshrq_n_u8(in.val[2], 6)), vdupq_n_u8(0x3F));
+        out.val[3] = vandq_u8(in.val[2], vdupq_n_u8(0x3F));
+        out.val[0] = vqtbl4q_u8(lut, out.val[0]);
+        out.val[1] = vqtbl4q_u8(lut, out.val[1]);
+        out.val[2] = vqtbl4q_u8(lut, out.val[2]);
+        out.val[3] = vqtbl4q_u8(lut, out.val[3]);
+        vst4q_u8((uint8_t *)dst, out);
+        dst += 64;
+    }
+    return i + b64_encode_c(dst, src + i, len - i, url);
+}
+
+static inline uint8x16_t b64_value_neon(uint8x16_t c, uint8x16_t *valid)
+{
+    uint8x16_t upper = vandq_u8(vcgeq_u8(c, vdupq_n_u8('A')), vcleq_u8(c, vdupq_n_u8('Z')));
+    uint8x16_t lower = vandq_u8(vcgeq_u8(c, vdupq_n_u8('a')), vcleq_u8(c, vdupq_n_u8('z')));
+    uint8x16_t digit = vandq_u8(vcgeq_u8(c, vdupq_n_u8('0')), vcleq_u8(c, vdupq_n_u8('9')));
+    uint8x16_t c62 = vorrq_u8(vceqq_u8(c, vdupq_n_u8('+')), vceqq_u8(c, vdupq_n_u8('-')));
+    uint8x16_t c63 = vorrq_u8(vceqq_u8(c, vdupq_n_u8('/')), vceqq_u8(c, vdupq_n_u8('_')));
+    uint8x16_t v;
+
+    *valid = vandq_u8(*valid, vorrq_u8(vorrq_u8(upper, lower), vorrq_u8(digit, vorrq_u8(c62, c63))));
+    v = vandq_u8(upper, vsubq_u8(c, vdupq_n_u8('A')));
+    v = vorrq_u8(v, vandq_u8(lower, vsubq_u8(c, vdupq_n_u8('a' - 26))));
+    v = vorrq_u8(v, vandq_u8(digit, vaddq_u8(c, vdupq_n_u8(52 - '0'))));
+    v = vorrq_u8(v, vandq_u8(c62, vdupq_n_u8(62)));
+    return vorrq_u8(v, vandq_u8(c63, vdupq_n_u8(63)));
+}
+
+static size_t b64_decode_neon(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    uint8x16x4_t in;
+    uint8x16x3_t out;
+    uint8x16_t a, b, c, d, valid;
+    size_t i;
+
+    for (i = 0; i + 64 <= len; i += 64) {
+        in = vld4q_u8(src + i);
+        valid = vdupq_n_u8(0xFF);
+        a = b64_value_neon(in.val[0], &valid);
+        b = b64_value_neon(in.val[1], &valid);
+        c = b64_value_neon(in.val[2], &valid);
+        d = b64_value_neon(in.val[3], &valid);
+        if (vminvq_u8(valid) != 0xFF) {
+            break;
+        }
+        out.val[0] = vorrq_u8(vshlq_n_u8(a, 2), vshrq_n_u8(b, 4));
+        out.val[1] = vorrq_u8(vshlq_n_u8(b, 4), vshrq_n_u8(c, 2));
+        out.val[2] = vorrq_u8(vshlq_n_u8(c, 6), d);
+        vst3q_u8(dst, out);
+        dst += 48;
+    }
+    return i;
+}
+
+static size_t b16_encode_neon(char *dst, const uint8_t *src, size_t len)
+{
+    const uint8x16_t lut = vld1q_u8((const uint8_t *)s_base16_enc);
+    uint8x16x2_t out;
+    uint8x16_t in;
+    size_t i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        in = vld1q_u8(src + i);
+        out.val[0] = vqtbl1q_u8(lut, vshrq_n_u8(in, 4));
+        out.val[1] = vqtbl1q_u8(lut, vandq_u8(in, vdupq_n_u8(0x0F)));
+        vst2q_u8((uint8_t *)dst + i * 2, out);
+    }
+    return i + b16_encode_c(dst + i * 2, src + i, len - i);
+}
+
+static inline uint8x16_t b16_value_neon(uint8x16_t c, uint8x16_t *valid)
+{
+    uint8x16_t digit = vandq_u8(vcgeq_u8(c, vdupq_n_u8('0')), vcleq_u8(c, vdupq_n_u8('9')));
+    uint8x16_t upper = vandq_u8(vcgeq_u8(c, vdupq_n_u8('A')), vcleq_u8(c, vdupq_n_u8('F')));
+    uint8x16_t lower = vandq_u8(vcgeq_u8(c, vdupq_n_u8('a')), vcleq_u8(c, vdupq_n_u8('f')));
+    uint8x16_t v;
+
+    *valid = vandq_u8(*valid, vorrq_u8(digit, vorrq_u8(upper, lower)));
+    v = vandq_u8(digit, vsubq_u8(c, vdupq_n_u8('0')));
+    v = vorrq_u8(v, vandq_u8(upper, vsubq_u8(c, vdupq_n_u8('A' - 10))));
+    return vorrq_u8(v, vandq_u8(lower, vsubq_u8(c, vdupq_n_u8('a' - 10))));
+}
+
+static size_t b16_decode_neon(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    uint8x16x2_t in;
+    uint8x16_t hi, lo, valid;
+    size_t i;
+
+    for (i = 0; i + 32 <= len; i += 32) {
+        in = vld2q_u8(src + i);
+        valid = vdupq_n_u8(0xFF);
+        hi = b16_value_neon(in.val[0], &valid);
+        lo = b16_value_neon(in.val[1], &valid);
+        if (vminvq_u8(valid) != 0xFF) {
+            break;
+        }
+        vst1q_u8(dst + i / 2, vorrq_u8(vshlq_n_u8(hi, 4), lo));
+    }
+    return i;
+}
+
+static const struct strcodec_ops s_ops_neon = {
+    b64_encode_neon,
+    b64_decode_neon,
+    b16_encode_neon,
+    b16_decode_neon,
+};
+#endif
+
+static const struct strcodec_ops *s_ops = NULL;
+
+static const struct strcodec_ops *strcodec_select(void)
+{
+#if defined (STREX_SIMD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return &s_ops_avx2;
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        return &s_ops_ssse3;
+    }
+#elif defined (STREX_SIMD_NEON)
+    return &s_ops_neon;
+#endif
+    return &s_ops_c;
+}
+
+static inline const struct strcodec_ops *strcodec_ops(void)
+{
+    /* selection is idempotent, racing first callers store the same value */
+    if (UNLIKELY(!s_ops)) {
+        s_ops = strcodec_select();
+    }
+    return s_ops;
+}
+
+size_t base64_encode_size(size_t bytes)
+{
+    return (bytes + 2) / 3 * 4;
+}
+
+size_t base64_decode_size(const char *source, size_t bytes)
+{
+    int pad = 0;
+
+    while (bytes > 0 && pad < 2 && source[bytes - 1] == '=') {
+        bytes--;
+        pad++;
+    }
+    return bytes / 4 * 3 + (bytes % 4 > 1 ? bytes % 4 - 1 : 0);
+}
+
+size_t base16_encode_size(size_t bytes)
+{
+    return bytes * 2;
+}
+
+size_t base16_decode_size(size_t bytes)
+{
+    return bytes / 2;
+}
+
+static size_t base64_encode_table(char *target, const void *source, size_t bytes, int url)
+{
+    const uint8_t *ptr = (const uint8_t *)source;
+    size_t i;
+
+    i = strcodec_ops()->b64_encode(target, ptr, bytes, url);
+    if (i < bytes) {
+        b64_encode_tail(target + i / 3 * 4, ptr + i, bytes - i, url);
+    }
+    return base64_encode_size(bytes);
+}
+
+size_t base64_encode(char* target, const void *source, size_t bytes)
+{
+    return base64_encode_table(target, source, bytes, 0);
+}
+
+size_t base64_encode_url(char* target, const void *source, size_t bytes)
+{
+    return base64_encode_table(target, source, bytes, 1);
+}
+
+size_t base64_decode(void* target, const char *src, size_t bytes)
+{
+    size_t i, j;
+    uint8_t* p = (uint8_t*)target;
+    const uint8_t* source = (const uint8_t*)src;
+    const uint8_t* end;
+
+    if (0 != bytes % 4) {
+        return -1;
+    }
+
+    end = source + bytes;
+    if (bytes > 4) {
+        /* the last quad may carry padding, leave it to the tail below */
+        j = strcodec_ops()->b64_decode(p, source, bytes - 4);
+        source += j;
+        i = j / 4 * 3;
+    } else {
+        i = 0;
+    }
+    while (source + 4 < end) {
+        p[i++] = (s_base64_dec[source[0]] << 2) | (s_base64_dec[source[1]] >> 4);
+        p[i++] = (s_base64_dec[source[1]] << 4) | (s_base64_dec[source[2]] >> 2);
+        p[i++] = (s_base64_dec[source[2]] << 6) | s_base64_dec[source[3]];
+        source += 4;
+    }
+
+    if (source + 4 == end) {
+        p[i++] = (s_base64_dec[source[0]] << 2) | (s_base64_dec[source[1]] >> 4);
+        if ('=' != source[2])
+            p[i++] = (s_base64_dec[source[1]] << 4) | (s_base64_dec[source[2]] >> 2);
+        if ('=' != source[3])
+            p[i++] = (s_base64_dec[source[2]] << 6) | s_base64_dec[source[3]];
+    }
+    return i;
+}
+
+size_t base16_encode(char* target, const void *source, size_t bytes)
+{
+    strcodec_ops()->b16_encode(target, (const uint8_t *)source, bytes);
+    return bytes * 2;
+}
+
+size_t base16_decode(void* target, const char *source, size_t bytes)
+{
+    size_t i;
+    uint8_t* p;
+    p = (uint8_t*)target;
+    if (0 != bytes % 2) {
+        return -1;
+    }
+    i = strcodec_ops()->b16_decode(p, (const uint8_t *)source, bytes) / 2;
+    for (; i < bytes / 2; i++) {
+        p[i] = s_base16_dec[source[i * 2] & 0x7F] << 4;
+        p[i] |= s_base16_dec[source[i * 2 + 1] & 0x7F];
+    }
+    return i;
+}
+
+void base64_stream_init(struct base64_stream *s, int url)
+{
+    memset(s, 0, sizeof(*s));
+    s->url = url;
+}
+
+size_t base64_stream_encode(struct base64_stream *s, char *target, const void *source, size_t bytes)
+{
+    const uint8_t *src = (const uint8_t *)source;
+    char *dst = target;
+    size_t n;
+
+    while (s->len > 0 && s->len < 3 && bytes > 0) {
+        s->buf[s->len++] = *src++;
+        bytes--;
+    }
+    if (s->len == 3) {
+        dst += b64_encode_c(dst, s->buf, 3, s->url) / 3 * 4;
+        s->len = 0;
+    }
+    n = strcodec_ops()->b64_encode(dst, src, bytes, s->url);
+    dst += n / 3 * 4;
+    for (; n < bytes; n++) {
+        s->buf[s->len++] = src[n];
+    }
+    return dst - target;
+}
+
+size_t base64_stream_encode_final(struct base64_stream *s, char *target)
+{
+    size_t n = 0;
+
+    if (s->len > 0) {
+        n = b64_encode_tail(target, s->buf, s->len, s->url);
+    }
+    s->len = 0;
+    return n;
+}
+
+static inline int is_b64_space(uint8_t c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+size_t base64_stream_decode(struct base64_stream *s, void *target, const char *source, size_t bytes)
+{
+    const uint8_t *src = (const uint8_t *)source;
+    const uint8_t *end = src + bytes;
+    uint8_t *dst = (uint8_t *)target;
+    uint8_t a, b, c, d;
+    size_t n;
+
+    while (src < end) {
+        if (s->len == 0 && !s->done) {
+            /* aligned: vector blocks, then clean scalar quads */
+            n = strcodec_ops()->b64_decode(dst, src, end - src);
+            src += n;
+            dst += n / 4 * 3;
+            while (src + 4 <= end) {
+                a = s_base64_val[src[0]];
+                b = s_base64_val[src[1]];
+                c = s_base64_val[src[2]];
+                d = s_base64_val[src[3]];
+                if ((a | b | c | d) & 0x80) {
+                    break;
+                }
+                dst[0] = (a << 2) | (b >> 4);
+                dst[1] = (b << 4) | (c >> 2);
+                dst[2] = (c << 6) | d;
+                dst += 3;
+                src += 4;
+            }
+            if (src == end) {
+                break;
+            }
+        }
+        /* one char at a time across whitespace, padding and chunk edges */
+        c = *src++;
+        if (is_b64_space(c)) {
+            continue;
+        }
+        if (s->done) {
+            if (c != '=') {
+                return -1;
+            }
+            continue;
+        }
+        if (c == '=') {
+            if (s->len < 2) {
+                return -1;
+            }
+            dst += base64_stream_decode_final(s, dst);
+            s->done = 1;
+            continue;
+        }
+        if (s_base64_val[c] == 0xFF) {
+            return -1;
+        }
+        s->buf[s->len++] = s_base64_val[c];
+        if (s->len == 4) {
+            dst[0] = (s->buf[0] << 2) | (s->buf[1] >> 4);
+            dst[1] = (s->buf[1] << 4) | (s->buf[2] >> 2);
+            dst[2] = (s->buf[2] << 6) | s->buf[3];
+            dst += 3;
+            s->len = 0;
+        }
+    }
+    return dst - (uint8_t *)target;
+}
+
+size_t base64_stream_decode_final(struct base64_stream *s, void *target)
+{
+    uint8_t *dst = (uint8_t *)target;
+    size_t n = 0;
+
+    if (s->len == 1) {
+        return -1;
+    }
+    if (s->len > 1) {
+        dst[n++] = (s->buf[0] << 2) | (s->buf[1] >> 4);
+    }
+    if (s->len > 2) {
+        dst[n++] = (s->buf[1] << 4) | (s->buf[2] >> 2);
+    }
+    s->len = 0;
+    s->done = 0;
+    return n;
+}
+
+void base16_stream_init(struct base16_stream *s)
+{
+    memset(s, 0, sizeof(*s));
+}
+
+size_t base16_stream_decode(struct base16_stream *s, void *target, const char *source, size_t bytes)
+{
+    uint8_t *dst = (uint8_t *)target;
+    size_t n = 0;
+
+    if (s->len && bytes > 0) {
+        dst[n++] = (s->hi << 4) | s_base16_dec[*source++ & 0x7F];
+        bytes--;
+        s->len = 0;
+    }
+    n += base16_decode(dst + n, source, bytes & ~(size_t)1);
+    if (bytes & 1) {
+        s->hi = s_base16_dec[source[bytes - 1] & 0x7F];
+        s->len = 1;
+    }
+    return n;
+}
@@ -23,8 +23,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <sys/time.h>
 #include "libstrex.h"
 
+static uint64_t now_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
 void base64_test()
 {
     char target[100] = {0};
@@ -43,6 +51,117 @@ void base64_test()
     printf("return byte: %d , target2: %s \n", ret_bytes, target2);
 }
 
+void codec_test()
+{
+    const char *vec[][2] = {
+        {"", ""}, {"f", "Zg=="}, {"fo", "Zm8="}, {"foo", "Zm9v"},
+        {"foob", "Zm9vYg=="}, {"fooba", "Zm9vYmE="}, {"foobar", "Zm9vYmFy"},
+    };
+    struct base64_stream bs;
+    struct base16_stream hs;
+    size_t size = 4 * 1024 * 1024;
+    uint8_t *src = malloc(size);
+    char *enc = malloc(base16_encode_size(size));
+    uint8_t *dec = malloc(size + 8);
+    size_t i, n, m, len;
+    uint64_t t;
+    int bad = 0;
+
+    for (i = 0; i < sizeof(vec) / sizeof(vec[0]); i++) {
+        n = base64_encode(enc, vec[i][0], strlen(vec[i][0]));
+        if (n != strlen(vec[i][1]) || memcmp(enc, vec[i][1], n)) {
+            bad++;
+        }
+        if (base64_decode_size(vec[i][1], strlen(vec[i][1])) != strlen(vec[i][0])) {
+            bad++;
+        }
+    }
+    for (i = 0; i < size; i++) {
+        src[i] = rand();
+    }
+
+    /* every length around the vector block sizes, one shot and chunked */
+    for (len = 0; len < 300; len++) {
+        n = base64_encode_url(enc, src, len);
+        m = base64_decode(dec, enc, n);
+        if (n != base64_encode_size(len) || m != len || memcmp(dec, src, len)) {
+            bad++;
+        }
+        base64_stream_init(&bs, 1);
+        for (i = 0, m = 0; i < n; i += 7) {
+            m += base64_stream_decode(&bs, dec + m, enc + i, n - i < 7 ? n - i : 7);
+        }
+        m += base64_stream_decode_final(&bs, dec + m);
+        if (m != len || memcmp(dec, src, len)) {
+            bad++;
+        }
+        n = base16_encode(enc, src, len);
+        base16_stream_init(&hs);
+        for (i = 0, m = 0; i < n; i += 5) {
+            m += base16_stream_decode(&hs, dec + m, enc + i, n - i < 5 ? n - i : 5);
+        }
+        if (m != len || memcmp(dec, src, len)) {
+            bad++;
+        }
+    }
+    printf("codec vectors and round trips: %s\n", bad ? "FAIL" : "ok");
+
+    t = now_us();
+    for (i = 0; i < 16; i++) {
+        n = base64_encode(enc, src, size);
+    }
+    printf("base64_encode %.0f MB/s\n", 16.0 * size / (now_us() - t));
+    t = now_us();
+    for (i = 0; i < 16; i++) {
+        m = base64_decode(dec, enc, n);
+    }
+    printf("base64_decode %.0f MB/s\n", 16.0 * n / (now_us() - t));
+    base64_stream_init(&bs, 0);
+    t = now_us();
+    for (i = 0, m = 0; i < n; i += 1500) {
+        m += base64_stream_decode(&bs, dec + m, enc + i, n - i < 1500 ? n - i : 1500);
+    }
+    m += base64_stream_decode_final(&bs, dec + m);
+    printf("base64_stream_decode %.0f MB/s (%s)\n", 1.0 * n / (now_us() - t),
+           m == size && !memcmp(dec, src, size) ? "ok" : "FAIL");
+    t = now_us();
+    for (i = 0; i < 16; i++) {
+        n = base16_encode(enc, src, size);
+    }
+    printf("base16_encode %.0f MB/s\n", 16.0 * size / (now_us() - t));
+    t = now_us();
+    for (i = 0; i < 16; i++) {
+        m = base16_decode(dec, enc, n);
+    }
+    printf("base16_decode %.0f MB/s\n", 16.0 * n / (now_us() - t));
+
+    free(src);
+    free(enc);
+    free(dec);
+}
+
+void hash_test()
+{
+    int i, j, n = 100000;
+    char (*key)[16] = malloc(n * sizeof(*key));
+    uint64_t t, h = 0;
+
+    printf("strhash64(\"hello world\") = %016llx\n",
+           (unsigned long long)strhash64("hello world", 11, 0));
+    for (i = 0; i < n; i++) {
+        snprintf(key[i], sizeof(key[i]), "key-%d", i);
+    }
+    t = now_us();
+    for (j = 0; j < 20; j++) {
+        for (i = 0; i < n; i++) {
+            h += strhash32(key[i], strlen(key[i]));
+        }
+    }
+    printf("strhash32 short keys: %.1f ns/key (%08x)\n",
+           1000.0 * (now_us() - t) / (n * 20), (uint32_t)h);
+    free(key);
+}
+
 void strex_test()
 {
     char *mix = "Hello World";
@@ -58,6 +177,8 @@ void strex_test()
 int main(int argc, char **argv)
 {
     base64_test();
+    codec_test();
+    hash_test();
     strex_test();
     return 0;
 }
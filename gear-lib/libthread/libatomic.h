@@ -68,6 +68,50 @@ int atomic_int_dec(volatile int *ptr);
  */
 void *atomic_ptr_cas(void * volatile *ptr, void *oldval, void *newval);
 
+/*
+ * C11 style atomics with an explicit memory order, on any integer or
+ * pointer lvalue. They map straight to compiler builtins, no library calls.
+ *
+ *   atomic_load_ex(&v, ATOMIC_ACQUIRE);
+ *   atomic_cas_ex(&v, &expect, val, ATOMIC_ACQ_REL, ATOMIC_RELAXED);
+ *
+ * atomic_cas_ex returns true on success, otherwise *expect is updated
+ * with the current value.
+ */
+#if defined (__GNUC__) || defined (__clang__)
+#define ATOMIC_RELAXED      __ATOMIC_RELAXED
+#define ATOMIC_CONSUME      __ATOMIC_CONSUME
+#define ATOMIC_ACQUIRE      __ATOMIC_ACQUIRE
+#define ATOMIC_RELEASE      __ATOMIC_RELEASE
+#define ATOMIC_ACQ_REL      __ATOMIC_ACQ_REL
+#define ATOMIC_SEQ_CST      __ATOMIC_SEQ_CST
+
+#define atomic_load_ex(ptr, mo)             __atomic_load_n(ptr, mo)
+#define atomic_store_ex(ptr, val, mo)       __atomic_store_n(ptr, val, mo)
+#define atomic_xchg_ex(ptr, val, mo)        __atomic_exchange_n(ptr, val, mo)
+#define atomic_cas_ex(ptr, expect, val, succ, fail) \
+        __atomic_compare_exchange_n(ptr, expect, val, 0, succ, fail)
+#define atomic_cas_weak_ex(ptr, expect, val, succ, fail) \
+        __atomic_compare_exchange_n(ptr, expect, val, 1, succ, fail)
+#define atomic_fetch_add_ex(ptr, val, mo)   __atomic_fetch_add(ptr, val, mo)
+#define atomic_fetch_sub_ex(ptr, val, mo)   __atomic_fetch_sub(ptr, val, mo)
+#define atomic_fetch_and_ex(ptr, val, mo)   __atomic_fetch_and(ptr, val, mo)
+#define atomic_fetch_or_ex(ptr, val, mo)    __atomic_fetch_or(ptr, val, mo)
+#define atomic_fence_ex(mo)                 __atomic_thread_fence(mo)
+#define atomic_compiler_barrier()           __atomic_signal_fence(__ATOMIC_SEQ_CST)
+
+/*
+ * busy-wait hint, lets the sibling hyperthread run and saves power
+ */
+#if defined (__i386__) || defined (__x86_64__)
+#define cpu_relax()         __builtin_ia32_pause()
+#elif defined (__aarch64__) || (defined (__arm__) && __ARM_ARCH >= 7)
+#define cpu_relax()         __asm__ __volatile__("yield" ::: "memory")
+#else
+#define cpu_relax()         atomic_compiler_barrier()
+#endif
+#endif
+
 
 #ifdef __cplusplus
 }
@@ -20,6 +20,7 @@
  * SOFTWARE.
  ******************************************************************************/
 #include "libthread.h"
+#include "libatomic.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -29,38 +30,53 @@
 #include <pthread.h>
 #endif
 #include <errno.h>
+#include <limits.h>
+#if defined (OS_LINUX)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
 
 /******************************************************************************
  * spin lock APIs
  *****************************************************************************/
-#if ( __i386__ || __i386 || __amd64__ || __amd64 )
-#define cpu_pause() __asm__ ("pause")
-#else
-#define cpu_pause()
-#endif
+#define SPIN_LIMIT  2048
 
-#if defined (__linux__) || defined (__CYGWIN__)
-#define atomic_cmp_set(lock, old, set) \
-    __sync_bool_compare_and_swap(lock, old, set)
+/* spinning only pays when the holder can run on another cpu */
+static int lock_ncpu(void)
+{
+#if defined (OS_LINUX) || defined (OS_APPLE)
+    static int ncpu = 0;
+    int n = atomic_load_ex(&ncpu, ATOMIC_RELAXED);
+    if (UNLIKELY(n == 0)) {
+        n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        if (n < 1) {
+            n = 1;
+        }
+        atomic_store_ex(&ncpu, n, ATOMIC_RELAXED);
+    }
+    return n;
+#else
+    return 1;
 #endif
+}
 
 int spin_lock(spin_lock_t *lock)
 {
 #if defined (__linux__) || defined (__CYGWIN__)
-    int spin = 2048;
-    int value = 1;
     int i, n;
-    long g_ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int smp = lock_ncpu() > 1;
     for ( ;; ) {
-        if (*lock == 0 && atomic_cmp_set(lock, 0, value)) {
+        if (atomic_load_ex(lock, ATOMIC_RELAXED) == 0 &&
+            atomic_xchg_ex(lock, 1, ATOMIC_ACQUIRE) == 0) {
             return 0;
         }
-        if (g_ncpu > 1) {
-            for (n = 1; n < spin; n <<= 1) {
+        if (smp) {
+            for (n = 1; n < SPIN_LIMIT; n <<= 1) {
                 for (i = 0; i < n; i++) {
-                    cpu_pause();
+                    cpu_relax();
                 }
-                if (*lock == 0 && atomic_cmp_set(lock, 0, value)) {
+                if (atomic_load_ex(lock, ATOMIC_RELAXED) == 0 &&
+                    atomic_xchg_ex(lock, 1, ATOMIC_ACQUIRE) == 0) {
                     return 0;
                 }
             }
@@ -73,14 +89,19 @@ int spin_lock(spin_lock_t *lock)
 
 int spin_unlock(spin_lock_t *lock)
 {
+#if defined (__GNUC__) || defined (__clang__)
+    atomic_store_ex(lock, 0, ATOMIC_RELEASE);
+#else
     *(lock) = 0;
+#endif
     return 0;
 }
 
 int spin_trylock(spin_lock_t *lock)
 {
 #if defined (__linux__) || defined (__CYGWIN__)
-    return (*(lock) == 0 && atomic_cmp_set(lock, 0, 1));
+    return (atomic_load_ex(lock, ATOMIC_RELAXED) == 0 &&
+            atomic_xchg_ex(lock, 1, ATOMIC_ACQUIRE) == 0);
 #else
     return 0;
 #endif
@@ -260,7 +281,7 @@ int mutex_cond_wait(mutex_lock_t *mutexp, mutex_cond_t *condp, int64_t ms)
         uint64_t ns = ts.tv_sec * 1000 * 1000 * 1000 + ts.tv_nsec;
         ns += ms * 1000 * 1000;
         ts.tv_sec = ns / (1000 * 1000 * 1000);
-        ts.tv_nsec = ns % 1000 * 1000 * 1000;
+        ts.tv_nsec = ns % (1000 * 1000 * 1000);
 wait:
         ret = pthread_cond_timedwait(cond, mutex, &ts);
         if (ret != 0) {
@@ -538,7 +559,7 @@ int sem_lock_wait(sem_lock_t *ptr, int64_t ms)
         uint64_t ns = ts.tv_sec * 1000 * 1000 * 1000 + ts.tv_nsec;
         ns += ms * 1000 * 1000;
         ts.tv_sec = ns / (1000 * 1000 * 1000);
-        ts.tv_nsec = ns % 1000 * 1000 * 1000;
+        ts.tv_nsec = ns % (1000 * 1000 * 1000);
         ret = sem_timedwait(lock, &ts);
         if (ret != 0) {
             switch (errno) {
@@ -598,3 +619,236 @@ int sem_lock_signal(sem_lock_t *ptr)
 #endif
     return ret;
 }
+
+#if defined (__GNUC__) || defined (__clang__)
+/******************************************************************************
+ * futex APIs
+ *****************************************************************************/
+#if defined (OS_LINUX)
+static int futex_wait(uint32_t *addr, uint32_t val, const struct timespec *ts)
+{
+    if (-1 == syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, ts, NULL, 0)) {
+        return errno;
+    }
+    return 0;
+}
+
+static void futex_wake(uint32_t *addr, int n)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+#else
+static int futex_wait(uint32_t *addr, uint32_t val, const struct timespec *ts)
+{
+    sched_yield();
+    return 0;
+}
+
+static void futex_wake(uint32_t *addr, int n)
+{
+}
+#endif
+
+/* bounded spin for the hand-made locks: yield once the holder looks preempted */
+static inline void spin_wait(int *spins)
+{
+    if (++*spins < SPIN_LIMIT && lock_ncpu() > 1) {
+        cpu_relax();
+    } else {
+        *spins = 0;
+        sched_yield();
+    }
+}
+
+/******************************************************************************
+ * futex mutex APIs
+ *****************************************************************************/
+#define FMUTEX_SPIN 100
+
+void fmutex_init(fmutex_t *m)
+{
+    m->state = 0;
+}
+
+int fmutex_trylock(fmutex_t *m)
+{
+    uint32_t c = 0;
+    return atomic_cas_ex(&m->state, &c, 1, ATOMIC_ACQUIRE, ATOMIC_RELAXED) ? 0 : -1;
+}
+
+void fmutex_lock(fmutex_t *m)
+{
+    uint32_t c = 0;
+    int i;
+
+    if (LIKELY(atomic_cas_ex(&m->state, &c, 1, ATOMIC_ACQUIRE, ATOMIC_RELAXED))) {
+        return;
+    }
+    if (lock_ncpu() > 1) {
+        for (i = 0; i < FMUTEX_SPIN && c != 2; i++) {
+            cpu_relax();
+            c = 0;
+            if (atomic_cas_ex(&m->state, &c, 1, ATOMIC_ACQUIRE, ATOMIC_RELAXED)) {
+                return;
+            }
+        }
+    }
+    /* from here on the lock is marked contended so unlock wakes us */
+    if (c != 2) {
+        c = atomic_xchg_ex(&m->state, 2, ATOMIC_ACQUIRE);
+    }
+    while (c != 0) {
+        futex_wait(&m->state, 2, NULL);
+        c = atomic_xchg_ex(&m->state, 2, ATOMIC_ACQUIRE);
+    }
+}
+
+void fmutex_unlock(fmutex_t *m)
+{
+    if (atomic_fetch_sub_ex(&m->state, 1, ATOMIC_RELEASE) != 1) {
+        atomic_store_ex(&m->state, 0, ATOMIC_RELEASE);
+        futex_wake(&m->state, 1);
+    }
+}
+
+/******************************************************************************
+ * futex condition APIs
+ *****************************************************************************/
+void fcond_init(fcond_t *c)
+{
+    c->seq = 0;
+}
+
+int fcond_wait(fcond_t *c, fmutex_t *m, int64_t ms)
+{
+    struct timespec ts;
+    uint32_t seq = atomic_load_ex(&c->seq, ATOMIC_RELAXED);
+    int ret;
+
+    if (ms > 0) {
+        ts.tv_sec = ms / 1000;
+        ts.tv_nsec = (ms % 1000) * 1000 * 1000;
+    }
+    fmutex_unlock(m);
+    ret = futex_wait(&c->seq, seq, ms > 0 ? &ts : NULL);
+    /* relock as contended: other waiters may sleep on the mutex too */
+    while (atomic_xchg_ex(&m->state, 2, ATOMIC_ACQUIRE) != 0) {
+        futex_wait(&m->state, 2, NULL);
+    }
+    return ret == ETIMEDOUT ? ETIMEDOUT : 0;
+}
+
+void fcond_signal(fcond_t *c)
+{
+    atomic_fetch_add_ex(&c->seq, 1, ATOMIC_RELEASE);
+    futex_wake(&c->seq, 1);
+}
+
+void fcond_broadcast(fcond_t *c)
+{
+    atomic_fetch_add_ex(&c->seq, 1, ATOMIC_RELEASE);
+    futex_wake(&c->seq, INT_MAX);
+}
+
+/******************************************************************************
+ * ticket lock APIs
+ *****************************************************************************/
+void ticket_lock(ticket_lock_t *l)
+{
+    uint32_t t = atomic_fetch_add_ex(&l->next, 1, ATOMIC_RELAXED);
+    int spins = 0;
+
+    while (atomic_load_ex(&l->owner, ATOMIC_ACQUIRE) != t) {
+        spin_wait(&spins);
+    }
+}
+
+int ticket_trylock(ticket_lock_t *l)
+{
+    uint32_t o = atomic_load_ex(&l->owner, ATOMIC_RELAXED);
+    uint32_t n = o;
+    return atomic_cas_ex(&l->next, &n, o + 1, ATOMIC_ACQUIRE, ATOMIC_RELAXED) ? 0 : -1;
+}
+
+void ticket_unlock(ticket_lock_t *l)
+{
+    atomic_store_ex(&l->owner, l->owner + 1, ATOMIC_RELEASE);
+}
+
+/******************************************************************************
+ * MCS lock APIs
+ *****************************************************************************/
+void mcs_lock(mcs_lock_t *l, struct mcs_node *node)
+{
+    struct mcs_node *prev;
+    int spins = 0;
+
+    node->next = NULL;
+    node->locked = 1;
+    prev = atomic_xchg_ex(&l->tail, node, ATOMIC_ACQ_REL);
+    if (!prev) {
+        return;
+    }
+    atomic_store_ex(&prev->next, node, ATOMIC_RELEASE);
+    while (atomic_load_ex(&node->locked, ATOMIC_ACQUIRE)) {
+        spin_wait(&spins);
+    }
+}
+
+void mcs_unlock(mcs_lock_t *l, struct mcs_node *node)
+{
+    struct mcs_node *next = atomic_load_ex(&node->next, ATOMIC_ACQUIRE);
+    struct mcs_node *expect = node;
+    int spins = 0;
+
+    if (!next) {
+        if (atomic_cas_ex(&l->tail, &expect, NULL, ATOMIC_RELEASE, ATOMIC_RELAXED)) {
+            return;
+        }
+        /* a successor swapped the tail but has not linked itself yet */
+        while (!(next = atomic_load_ex(&node->next, ATOMIC_ACQUIRE))) {
+            spin_wait(&spins);
+        }
+    }
+    atomic_store_ex(&next->locked, 0, ATOMIC_RELEASE);
+}
+
+/******************************************************************************
+ * seqlock APIs
+ *****************************************************************************/
+void seqlock_init(seqlock_t *s)
+{
+    s->seq = 0;
+    s->lock = 0;
+}
+
+uint32_t seqlock_read_begin(const seqlock_t *s)
+{
+    uint32_t seq;
+    int spins = 0;
+
+    while ((seq = atomic_load_ex(&s->seq, ATOMIC_ACQUIRE)) & 1) {
+        spin_wait(&spins);
+    }
+    return seq;
+}
+
+int seqlock_read_retry(const seqlock_t *s, uint32_t seq)
+{
+    atomic_fence_ex(ATOMIC_ACQUIRE);
+    return atomic_load_ex(&s->seq, ATOMIC_RELAXED) != seq;
+}
+
+void seqlock_write_lock(seqlock_t *s)
+{
+    spin_lock(&s->lock);
+    atomic_store_ex(&s->seq, s->seq + 1, ATOMIC_RELAXED);
+    atomic_fence_ex(ATOMIC_RELEASE);
+}
+
+void seqlock_write_unlock(seqlock_t *s)
+{
+    atomic_store_ex(&s->seq, s->seq + 1, ATOMIC_RELEASE);
+    spin_unlock(&s->lock);
+}
+#endif
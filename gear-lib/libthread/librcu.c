@@ -0,0 +1,249 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#include "libthread.h"
+#include "librcu.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+/*
+ * the global epoch starts at 1 and only grows. a reader's epoch is 0 while
+ * it is outside any read section (or offline), otherwise the global epoch
+ * it last observed. rcu_synchronize() bumps the global epoch and waits for
+ * every reader to be 0 or to have seen the new value.
+ *
+ * reader: store epoch, full fence, load pointers
+ * writer: store pointers, full fence, bump and load epochs
+ * so at least one side sees the other's store.
+ */
+
+#define RCU_DEFER_BATCH 64
+#define RCU_SPIN        1024
+
+struct rcu_reader {
+    uint64_t epoch;
+    int nest;
+    struct rcu *rcu;
+    struct rcu_reader *next;
+} __attribute__((aligned(64)));
+
+struct rcu_cb {
+    void (*func)(void *);
+    void *arg;
+};
+
+struct rcu {
+    uint64_t epoch;
+    fmutex_t gp_lock;           /* one grace period at a time */
+    fmutex_t reader_lock;
+    struct rcu_reader *readers;
+    fmutex_t defer_lock;
+    struct rcu_cb *cbs;
+    int cb_num;
+};
+
+struct rcu *rcu_create(void)
+{
+    struct rcu *rcu = calloc(1, sizeof(struct rcu));
+    if (!rcu) {
+        printf("malloc rcu failed!\n");
+        return NULL;
+    }
+    rcu->cbs = calloc(RCU_DEFER_BATCH, sizeof(struct rcu_cb));
+    if (!rcu->cbs) {
+        printf("malloc rcu_cb failed!\n");
+        free(rcu);
+        return NULL;
+    }
+    rcu->epoch = 1;
+    fmutex_init(&rcu->gp_lock);
+    fmutex_init(&rcu->reader_lock);
+    fmutex_init(&rcu->defer_lock);
+    return rcu;
+}
+
+void rcu_destroy(struct rcu *rcu)
+{
+    struct rcu_reader *r, *next;
+    if (!rcu) {
+        return;
+    }
+    rcu_barrier(rcu);
+    for (r = rcu->readers; r; r = next) {
+        next = r->next;
+        free(r);
+    }
+    free(rcu->cbs);
+    free(rcu);
+}
+
+struct rcu_reader *rcu_register(struct rcu *rcu)
+{
+    struct rcu_reader *r;
+    if (posix_memalign((void **)&r, 64, sizeof(struct rcu_reader))) {
+        printf("malloc rcu_reader failed!\n");
+        return NULL;
+    }
+    memset(r, 0, sizeof(struct rcu_reader));
+    r->rcu = rcu;
+    fmutex_lock(&rcu->reader_lock);
+    r->next = rcu->readers;
+    rcu->readers = r;
+    fmutex_unlock(&rcu->reader_lock);
+    return r;
+}
+
+void rcu_unregister(struct rcu *rcu, struct rcu_reader *r)
+{
+    struct rcu_reader **pp;
+    if (!r) {
+        return;
+    }
+    fmutex_lock(&rcu->reader_lock);
+    for (pp = &rcu->readers; *pp; pp = &(*pp)->next) {
+        if (*pp == r) {
+            *pp = r->next;
+            break;
+        }
+    }
+    fmutex_unlock(&rcu->reader_lock);
+    free(r);
+}
+
+static inline void rcu_reader_mark(struct rcu_reader *r)
+{
+    atomic_store_ex(&r->epoch, atomic_load_ex(&r->rcu->epoch, ATOMIC_RELAXED),
+                    ATOMIC_RELAXED);
+    atomic_fence_ex(ATOMIC_SEQ_CST);
+}
+
+void rcu_read_lock(struct rcu_reader *r)
+{
+    if (r->nest++ == 0) {
+        rcu_reader_mark(r);
+    }
+}
+
+void rcu_read_unlock(struct rcu_reader *r)
+{
+    if (--r->nest == 0) {
+        atomic_store_ex(&r->epoch, 0, ATOMIC_RELEASE);
+    }
+}
+
+void rcu_online(struct rcu_reader *r)
+{
+    r->nest = 1;
+    rcu_reader_mark(r);
+}
+
+void rcu_quiescent(struct rcu_reader *r)
+{
+    /* release: every access before this point is done with old versions */
+    atomic_fence_ex(ATOMIC_RELEASE);
+    rcu_reader_mark(r);
+}
+
+void rcu_offline(struct rcu_reader *r)
+{
+    r->nest = 0;
+    atomic_store_ex(&r->epoch, 0, ATOMIC_RELEASE);
+}
+
+void rcu_synchronize(struct rcu *rcu)
+{
+    struct rcu_reader *r;
+    uint64_t target, e;
+    int spins;
+
+    fmutex_lock(&rcu->gp_lock);
+    atomic_fence_ex(ATOMIC_SEQ_CST);
+    target = atomic_fetch_add_ex(&rcu->epoch, 1, ATOMIC_SEQ_CST) + 1;
+    fmutex_lock(&rcu->reader_lock);
+    for (r = rcu->readers; r; r = r->next) {
+        spins = 0;
+        for (;;) {
+            e = atomic_load_ex(&r->epoch, ATOMIC_ACQUIRE);
+            if (e == 0 || e >= target) {
+                break;
+            }
+            if (++spins < RCU_SPIN) {
+                cpu_relax();
+            } else {
+                spins = 0;
+                sched_yield();
+            }
+        }
+    }
+    fmutex_unlock(&rcu->reader_lock);
+    fmutex_unlock(&rcu->gp_lock);
+}
+
+static void rcu_run(struct rcu_cb *cbs, int num)
+{
+    int i;
+    for (i = 0; i < num; i++) {
+        cbs[i].func(cbs[i].arg);
+    }
+}
+
+int rcu_defer(struct rcu *rcu, void (*func)(void *), void *arg)
+{
+    struct rcu_cb batch[RCU_DEFER_BATCH];
+    int num = 0;
+
+    if (!rcu || !func) {
+        return -1;
+    }
+    fmutex_lock(&rcu->defer_lock);
+    if (rcu->cb_num == RCU_DEFER_BATCH) {
+        num = rcu->cb_num;
+        memcpy(batch, rcu->cbs, num * sizeof(struct rcu_cb));
+        rcu->cb_num = 0;
+    }
+    rcu->cbs[rcu->cb_num].func = func;
+    rcu->cbs[rcu->cb_num].arg = arg;
+    rcu->cb_num++;
+    fmutex_unlock(&rcu->defer_lock);
+
+    if (num) {
+        rcu_synchronize(rcu);
+        rcu_run(batch, num);
+    }
+    return 0;
+}
+
+void rcu_barrier(struct rcu *rcu)
+{
+    struct rcu_cb batch[RCU_DEFER_BATCH];
+    int num;
+
+    fmutex_lock(&rcu->defer_lock);
+    num = rcu->cb_num;
+    memcpy(batch, rcu->cbs, num * sizeof(struct rcu_cb));
+    rcu->cb_num = 0;
+    fmutex_unlock(&rcu->defer_lock);
+
+    rcu_synchronize(rcu);
+    rcu_run(batch, num);
+}
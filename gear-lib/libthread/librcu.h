@@ -0,0 +1,81 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#ifndef LIBRCU_H
+#define LIBRCU_H
+
+#include <libposix.h>
+#include <stdint.h>
+#include "libatomic.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * epoch based RCU for read-mostly tables
+ *
+ * readers register once per thread, then either bracket each access with
+ * rcu_read_lock/unlock (one fence per outermost lock), or stay online and
+ * report rcu_quiescent() between accesses (QSBR, free read side).
+ * writers publish with rcu_assign_pointer, then rcu_synchronize() or
+ * rcu_defer() before freeing the old version.
+ *
+ *   rcu_read_lock(r);
+ *   cfg = rcu_dereference(g_cfg);
+ *   ...
+ *   rcu_read_unlock(r);
+ *
+ *   old = g_cfg;
+ *   rcu_assign_pointer(g_cfg, new_cfg);
+ *   rcu_defer(rcu, free, old);
+ *
+ * a thread must not call rcu_synchronize() inside its own read section.
+ */
+struct rcu;
+struct rcu_reader;
+
+GEAR_API struct rcu *rcu_create(void);
+GEAR_API void rcu_destroy(struct rcu *rcu);
+
+GEAR_API struct rcu_reader *rcu_register(struct rcu *rcu);
+GEAR_API void rcu_unregister(struct rcu *rcu, struct rcu_reader *r);
+
+GEAR_API void rcu_read_lock(struct rcu_reader *r);
+GEAR_API void rcu_read_unlock(struct rcu_reader *r);
+
+GEAR_API void rcu_online(struct rcu_reader *r);
+GEAR_API void rcu_quiescent(struct rcu_reader *r);
+GEAR_API void rcu_offline(struct rcu_reader *r);
+
+GEAR_API void rcu_synchronize(struct rcu *rcu);
+GEAR_API int rcu_defer(struct rcu *rcu, void (*func)(void *), void *arg);
+GEAR_API void rcu_barrier(struct rcu *rcu);
+
+#if defined (__GNUC__) || defined (__clang__)
+#define rcu_dereference(p)          atomic_load_ex(&(p), ATOMIC_CONSUME)
+#define rcu_assign_pointer(p, v)    atomic_store_ex(&(p), v, ATOMIC_RELEASE)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif
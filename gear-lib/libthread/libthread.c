@@ -31,7 +31,57 @@
 #include <string.h>
 #include <errno.h>
 #include <stdarg.h>
+#include <inttypes.h>
+#include <limits.h>
+#if defined (OS_LINUX)
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+
+#if defined (OS_LINUX)
+static void thread_attr_to_cpuset(const struct thread_attr *attr, cpu_set_t *set)
+{
+    int i;
+    CPU_ZERO(set);
+    for (i = 0; i < THREAD_CPU_MAX && i < CPU_SETSIZE; i++) {
+        if (attr->cpus[i / (8 * sizeof(unsigned long))] &
+            (1UL << (i % (8 * sizeof(unsigned long))))) {
+            CPU_SET(i, set);
+        }
+    }
+}
+#endif
 
+/* runs in the new thread: things the creator can not or may not do */
+static void thread_apply_attr(struct thread *t)
+{
+#if defined (OS_LINUX)
+    struct sched_param sp;
+    t->ktid = (int)syscall(__NR_gettid);
+    if (t->tattr.policy >= 0) {
+        memset(&sp, 0, sizeof(sp));
+        sp.sched_priority = t->tattr.priority;
+        if (0 != pthread_setschedparam(pthread_self(), t->tattr.policy, &sp)) {
+            printf("pthread_setschedparam policy %d priority %d failed, "
+                   "keep default scheduling\n", t->tattr.policy, t->tattr.priority);
+        }
+    }
+    if (t->tattr.numa_node >= 0) {
+        /* preferred, not bound: allocations fall back to other nodes */
+        unsigned long nodemask[THREAD_CPU_WORDS];
+        memset(nodemask, 0, sizeof(nodemask));
+        nodemask[t->tattr.numa_node / (8 * sizeof(unsigned long))] |=
+            1UL << (t->tattr.numa_node % (8 * sizeof(unsigned long)));
+        if (-1 == syscall(SYS_set_mempolicy, 1 /* MPOL_PREFERRED */,
+                          nodemask, THREAD_CPU_MAX)) {
+            printf("set_mempolicy node %d failed %d:%s\n",
+                   t->tattr.numa_node, errno, strerror(errno));
+        }
+    }
+#endif
+}
 
 static void *__thread_func(void *arg)
 {
@@ -40,15 +90,205 @@ static void *__thread_func(void *arg)
         printf("thread function is null\n");
         return NULL;
     }
+    thread_apply_attr(t);
     t->run = true;
     t->func(t, t->arg);
     t->run = false;
     return NULL;
 }
 
+void thread_attr_init(struct thread_attr *attr)
+{
+    memset(attr, 0, sizeof(struct thread_attr));
+    attr->policy = -1;
+    attr->numa_node = -1;
+}
+
+int thread_attr_set_cpu(struct thread_attr *attr, int cpu)
+{
+    if (!attr || cpu < 0 || cpu >= THREAD_CPU_MAX) {
+        return -1;
+    }
+    if (!(attr->cpus[cpu / (8 * sizeof(unsigned long))] &
+          (1UL << (cpu % (8 * sizeof(unsigned long)))))) {
+        attr->cpus[cpu / (8 * sizeof(unsigned long))] |=
+            1UL << (cpu % (8 * sizeof(unsigned long)));
+        attr->ncpu++;
+    }
+    return 0;
+}
+
+int thread_attr_set_sched(struct thread_attr *attr, int policy, int priority)
+{
+#if defined (OS_LINUX)
+    int min, max;
+    if (!attr) {
+        return -1;
+    }
+    min = sched_get_priority_min(policy);
+    max = sched_get_priority_max(policy);
+    if (min == -1 || priority < min || priority > max) {
+        printf("sched policy %d priority %d out of [%d, %d]\n",
+               policy, priority, min, max);
+        return -1;
+    }
+    attr->policy = policy;
+    attr->priority = priority;
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+int thread_attr_set_stack(struct thread_attr *attr, size_t size)
+{
+    if (!attr || (size && size < PTHREAD_STACK_MIN)) {
+        return -1;
+    }
+    attr->stack_size = size;
+    return 0;
+}
+
+static const char *cpulist_num(const char *p, unsigned int *val)
+{
+    char *end;
+    unsigned long v;
+    if (*p < '0' || *p > '9') {
+        return NULL;
+    }
+    v = strtoul(p, &end, 10);
+    if (v >= THREAD_CPU_MAX) {
+        return NULL;
+    }
+    *val = (unsigned int)v;
+    return end;
+}
+
+int thread_attr_set_cpulist(struct thread_attr *attr, const char *list)
+{
+    struct thread_attr tmp;
+    const char *p = list;
+    unsigned int start, end, used, group, cpu;
+
+    if (!attr || !list) {
+        return -1;
+    }
+    thread_attr_init(&tmp);
+    while (*p && *p != '\n') {
+        if (!(p = cpulist_num(p, &start))) {
+            goto err;
+        }
+        end = start;
+        used = group = 1;
+        if (*p == '-') {
+            if (!(p = cpulist_num(p + 1, &end)) || end < start) {
+                goto err;
+            }
+            if (*p == ':') {
+                if (!(p = cpulist_num(p + 1, &used)) || *p != '/' ||
+                    !(p = cpulist_num(p + 1, &group)) ||
+                    !used || !group || used > group) {
+                    goto err;
+                }
+            }
+        }
+        for (cpu = start; cpu <= end; cpu++) {
+            if ((cpu - start) % group < used) {
+                thread_attr_set_cpu(&tmp, cpu);
+            }
+        }
+        if (*p == ',') {
+            p++;
+        } else if (*p && *p != '\n') {
+            goto err;
+        }
+    }
+    memcpy(attr->cpus, tmp.cpus, sizeof(attr->cpus));
+    attr->ncpu = tmp.ncpu;
+    return 0;
+err:
+    printf("invalid cpu list \"%s\"\n", list);
+    return -1;
+}
+
+int thread_attr_set_numa(struct thread_attr *attr, int node)
+{
+#if defined (OS_LINUX)
+    char path[64];
+    char list[256];
+    FILE *fp;
+
+    if (!attr || node < 0 || node >= THREAD_CPU_MAX) {
+        return -1;
+    }
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    fp = fopen(path, "r");
+    if (!fp) {
+        printf("open %s failed %d:%s\n", path, errno, strerror(errno));
+        return -1;
+    }
+    if (!fgets(list, sizeof(list), fp)) {
+        printf("read %s failed\n", path);
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    /* an explicit cpu list wins, otherwise run anywhere on the node */
+    if (!attr->ncpu && thread_attr_set_cpulist(attr, list)) {
+        return -1;
+    }
+    attr->numa_node = node;
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+int thread_set_affinity(struct thread *t, const struct thread_attr *attr)
+{
+#if defined (OS_LINUX)
+    cpu_set_t set;
+    int ret;
+    if (!t || !attr || !attr->ncpu) {
+        return -1;
+    }
+    thread_attr_to_cpuset(attr, &set);
+    ret = pthread_setaffinity_np(t->tid, sizeof(set), &set);
+    if (ret != 0) {
+        printf("pthread_setaffinity_np failed: %s\n", strerror(ret));
+        return -1;
+    }
+    memcpy(t->tattr.cpus, attr->cpus, sizeof(t->tattr.cpus));
+    t->tattr.ncpu = attr->ncpu;
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+int thread_set_cpulist(struct thread *t, const char *list)
+{
+    struct thread_attr attr;
+
+    thread_attr_init(&attr);
+    if (thread_attr_set_cpulist(&attr, list)) {
+        return -1;
+    }
+    return thread_set_affinity(t, &attr);
+}
+
 struct thread *thread_create(void *(*func)(struct thread *, void *), void *arg)
+{
+    return thread_create_attr(func, arg, NULL);
+}
+
+struct thread *thread_create_attr(void *(*func)(struct thread *, void *), void *arg,
+                const struct thread_attr *tattr)
 {
     enum lock_type type = THREAD_LOCK_COND;
+#if defined (OS_LINUX)
+    cpu_set_t set;
+#endif
     struct thread *t = CALLOC(1, struct thread);
     if (!t) {
         printf("malloc thread failed(%d): %s\n", errno, strerror(errno));
@@ -60,11 +300,32 @@ struct thread *thread_create(void *(*func)(struct thread *, void *), void *arg)
         type = THREAD_LOCK_COND;//default
     }
     t->type = type;
+    if (tattr) {
+        memcpy(&t->tattr, tattr, sizeof(struct thread_attr));
+    } else {
+        thread_attr_init(&t->tattr);
+    }
 
     if (0 != pthread_attr_init(&t->attr)) {
         printf("pthread_attr_init() failed\n");
         goto err;
     }
+    if (t->tattr.stack_size) {
+        if (0 != pthread_attr_setstacksize(&t->attr, t->tattr.stack_size)) {
+            printf("pthread_attr_setstacksize %zu failed\n", t->tattr.stack_size);
+            goto err;
+        }
+    }
+#if defined (OS_LINUX)
+    /* pinned before the first instruction runs, not after */
+    if (t->tattr.ncpu) {
+        thread_attr_to_cpuset(&t->tattr, &set);
+        if (0 != pthread_attr_setaffinity_np(&t->attr, sizeof(set), &set)) {
+            printf("pthread_attr_setaffinity_np failed\n");
+            goto err;
+        }
+    }
+#endif
 
     switch (type) {
     case THREAD_LOCK_SPIN:
@@ -82,6 +343,10 @@ struct thread *thread_create(void *(*func)(struct thread *, void *), void *arg)
         }
         break;
     case THREAD_LOCK_COND:
+        if (0 != mutex_lock_init(&t->lock.mutex)) {
+            printf("mutex_lock_init failed\n");
+            goto err;
+        }
         if (0 != mutex_cond_init(&t->cond)) {
             printf("mutex_cond_init failed\n");
             goto err;
@@ -108,6 +373,68 @@ err:
     return NULL;
 }
 
+int thread_get_stats(struct thread *t, struct thread_stats *st)
+{
+#if defined (OS_LINUX)
+    char path[64];
+    char line[128];
+    clockid_t cid;
+    struct timespec ts;
+    FILE *fp;
+    long cpu = -1;
+    int i;
+
+    if (!t || !st) {
+        return -1;
+    }
+    memset(st, 0, sizeof(struct thread_stats));
+    st->last_cpu = -1;
+    if (0 == pthread_getcpuclockid(t->tid, &cid) &&
+        0 == clock_gettime(cid, &ts)) {
+        st->cpu_ns = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    }
+    if (!t->ktid) {
+        return 0;
+    }
+    snprintf(path, sizeof(path), "/proc/self/task/%d/status", t->ktid);
+    fp = fopen(path, "r");
+    if (!fp) {
+        printf("open %s failed %d:%s\n", path, errno, strerror(errno));
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp)) {
+        if (!strncmp(line, "voluntary_ctxt_switches:", 24)) {
+            st->voluntary_ctxt = strtoull(line + 24, NULL, 10);
+        } else if (!strncmp(line, "nonvoluntary_ctxt_switches:", 27)) {
+            st->involuntary_ctxt = strtoull(line + 27, NULL, 10);
+        }
+    }
+    fclose(fp);
+
+    /* field 39 of stat is the cpu it last ran on, skip past "(comm)" */
+    snprintf(path, sizeof(path), "/proc/self/task/%d/stat", t->ktid);
+    fp = fopen(path, "r");
+    if (fp) {
+        char buf[512];
+        char *p = NULL;
+        if (fgets(buf, sizeof(buf), fp)) {
+            p = strrchr(buf, ')');
+        }
+        for (i = 2; p && i < 39; i++) {
+            p = strchr(p + 1, ' ');
+        }
+        if (p) {
+            cpu = strtol(p + 1, NULL, 10);
+        }
+        fclose(fp);
+    }
+    st->last_cpu = (int)cpu;
+    return 0;
+#else
+    return -1;
+#endif
+}
+
 int thread_join(struct thread *t)
 {
     if (!t) {
@@ -207,6 +534,27 @@ void thread_get_info(struct thread *t)
     if (0 == pthread_getname_np(t->tid, t->name, sizeof(t->name))) {
         printf("thread name = %s\n", t->name);
     }
+#if defined (OS_LINUX)
+    {
+        struct thread_stats st;
+        cpu_set_t set;
+        int n;
+        if (0 == pthread_getaffinity_np(t->tid, sizeof(set), &set)) {
+            printf("affinity =");
+            for (n = 0; n < CPU_SETSIZE; n++) {
+                if (CPU_ISSET(n, &set)) {
+                    printf(" %d", n);
+                }
+            }
+            printf("\n");
+        }
+        if (0 == thread_get_stats(t, &st)) {
+            printf("cpu time = %" PRIu64 " ns, ctxt switches = %" PRIu64
+                   " voluntary %" PRIu64 " involuntary, last cpu = %d\n",
+                   st.cpu_ns, st.voluntary_ctxt, st.involuntary_ctxt, st.last_cpu);
+        }
+    }
+#endif
 #endif
 }
 
@@ -216,6 +564,7 @@ int thread_lock(struct thread *t)
         return -1;
     }
     switch (t->type) {
+    case THREAD_LOCK_COND:
     case THREAD_LOCK_MUTEX:
         return mutex_lock(&t->lock.mutex);
         break;
@@ -234,6 +583,7 @@ int thread_unlock(struct thread *t)
         return -1;
     }
     switch (t->type) {
+    case THREAD_LOCK_COND:
     case THREAD_LOCK_MUTEX:
         return mutex_unlock(&t->lock.mutex);
         break;
@@ -110,11 +110,125 @@ int sem_lock_trywait(sem_lock_t *lock);
 int sem_lock_signal(sem_lock_t *lock);
 void sem_lock_deinit(sem_lock_t *lock);
 
+#if defined (__GNUC__) || defined (__clang__)
+/*
+ * futex mutex: one atomic op uncontended, short adaptive spin, then sleeps
+ * in the kernel (Linux) or yields. 0 = unlocked, 1 = locked, 2 = waiters
+ */
+typedef struct fmutex {
+    uint32_t state;
+} fmutex_t;
+#define FMUTEX_INITIALIZER  {0}
+GEAR_API void fmutex_init(fmutex_t *m);
+GEAR_API void fmutex_lock(fmutex_t *m);
+GEAR_API int fmutex_trylock(fmutex_t *m);
+GEAR_API void fmutex_unlock(fmutex_t *m);
+
+/*
+ * futex condition variable paired with fmutex_t,
+ * fcond_wait returns 0 or ETIMEDOUT, ms <= 0 waits forever
+ */
+typedef struct fcond {
+    uint32_t seq;
+} fcond_t;
+#define FCOND_INITIALIZER   {0}
+GEAR_API void fcond_init(fcond_t *c);
+GEAR_API int fcond_wait(fcond_t *c, fmutex_t *m, int64_t ms);
+GEAR_API void fcond_signal(fcond_t *c);
+GEAR_API void fcond_broadcast(fcond_t *c);
+
+/*
+ * ticket spin lock, FIFO fair
+ */
+typedef struct ticket_lock {
+    uint32_t next;
+    uint32_t owner;
+} ticket_lock_t;
+#define TICKET_LOCK_INITIALIZER {0, 0}
+GEAR_API void ticket_lock(ticket_lock_t *l);
+GEAR_API int ticket_trylock(ticket_lock_t *l);
+GEAR_API void ticket_unlock(ticket_lock_t *l);
+
+/*
+ * MCS queue spin lock, FIFO and every waiter spins on its own cache line;
+ * the caller passes the same node to lock and unlock, usually on its stack
+ */
+struct mcs_node {
+    struct mcs_node *next;
+    int locked;
+} __attribute__((aligned(64)));
+typedef struct mcs_lock {
+    struct mcs_node *tail;
+} mcs_lock_t;
+#define MCS_LOCK_INITIALIZER {NULL}
+GEAR_API void mcs_lock(mcs_lock_t *l, struct mcs_node *node);
+GEAR_API void mcs_unlock(mcs_lock_t *l, struct mcs_node *node);
+
+/*
+ * seqlock for read-mostly data such as stats: writers serialise, readers
+ * never write shared memory and retry if a writer overlapped
+ *
+ *   do {
+ *       seq = seqlock_read_begin(&sl);
+ *       copy = stats;
+ *   } while (seqlock_read_retry(&sl, seq));
+ */
+typedef struct seqlock {
+    uint32_t seq;
+    spin_lock_t lock;
+} seqlock_t;
+#define SEQLOCK_INITIALIZER {0, 0}
+GEAR_API void seqlock_init(seqlock_t *s);
+GEAR_API uint32_t seqlock_read_begin(const seqlock_t *s);
+GEAR_API int seqlock_read_retry(const seqlock_t *s, uint32_t seq);
+GEAR_API void seqlock_write_lock(seqlock_t *s);
+GEAR_API void seqlock_write_unlock(seqlock_t *s);
+#endif
+
 #define THREAD_NAME_LEN 16
 
+/*
+ * thread attributes, everything is optional: thread_attr_init() gives the
+ * same thread thread_create() would. Linux only beyond the stack size.
+ */
+struct thread;
+
+#define THREAD_CPU_MAX      1024
+#define THREAD_CPU_WORDS    (THREAD_CPU_MAX / (8 * sizeof(unsigned long)))
+
+struct thread_attr {
+    size_t stack_size;                  /* 0: system default */
+    int policy;                         /* -1: inherit, else SCHED_FIFO... */
+    int priority;
+    int numa_node;                      /* -1: none */
+    int ncpu;                           /* cpus set in the mask, 0: any */
+    unsigned long cpus[THREAD_CPU_WORDS];
+};
+
+struct thread_stats {
+    uint64_t cpu_ns;                    /* user + system time */
+    uint64_t voluntary_ctxt;            /* blocked and gave up the cpu */
+    uint64_t involuntary_ctxt;          /* preempted */
+    int last_cpu;
+};
+
+GEAR_API void thread_attr_init(struct thread_attr *attr);
+GEAR_API int thread_attr_set_cpu(struct thread_attr *attr, int cpu);
+GEAR_API int thread_attr_set_sched(struct thread_attr *attr, int policy, int priority);
+GEAR_API int thread_attr_set_stack(struct thread_attr *attr, size_t size);
+
+/*
+ * cpu lists as in /sys and cgroups: "2-3,6" or "0-15:2/4" (range:used/group)
+ */
+GEAR_API int thread_attr_set_cpulist(struct thread_attr *attr, const char *list);
+GEAR_API int thread_attr_set_numa(struct thread_attr *attr, int node);
+GEAR_API int thread_set_cpulist(struct thread *t, const char *list);
+
 typedef struct thread {
     pthread_t tid;
     pthread_attr_t attr;
+    struct thread_attr tattr;
+    int ktid;                           /* kernel thread id, for stats */
     char name[THREAD_NAME_LEN];
     enum lock_type type;
     union {
@@ -129,6 +243,10 @@ typedef struct thread {
 } thread_t;
 
 GEAR_API struct thread *thread_create(void *(*func)(struct thread *, void *), void *arg);
+GEAR_API struct thread *thread_create_attr(void *(*func)(struct thread *, void *), void *arg,
+                const struct thread_attr *attr);
+GEAR_API int thread_set_affinity(struct thread *t, const struct thread_attr *attr);
+GEAR_API int thread_get_stats(struct thread *t, struct thread_stats *st);
 GEAR_API int thread_join(struct thread *t);
 GEAR_API void thread_destroy(struct thread *t);
 GEAR_API void thread_get_info(struct thread *t);
@@ -20,6 +20,7 @@
  * SOFTWARE.
  ******************************************************************************/
 #include "libthread.h"
+#include "librcu.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -28,9 +29,14 @@
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
 #include <sys/time.h>
+#include <sched.h>
 
 static spin_lock_t spin;
 static mutex_lock_t mutex;
+static fmutex_t fmutex = FMUTEX_INITIALIZER;
+static ticket_lock_t ticket = TICKET_LOCK_INITIALIZER;
+static mcs_lock_t mcs = MCS_LOCK_INITIALIZER;
+static seqlock_t seqlock = SEQLOCK_INITIALIZER;
 
 static int64_t value = 0;
 struct thread_arg {
@@ -41,10 +47,11 @@ struct thread_arg {
 
 void usage(int argc, char **argv)
 {
-    if (argc != 3) {
-        printf("Usage: %s <type> <count>\n", argv[0]);
-        printf("type: spin | mutex\n");
-        printf("count: 2 ~ 10\n");
+    if (argc != 3 && argc != 4) {
+        printf("Usage: %s <type> <count> [threads]\n", argv[0]);
+        printf("type: spin | mutex | fmutex | ticket | mcs | seqlock | rcu | all\n");
+        printf("count: loops per thread\n");
+        printf("threads: contention bench threads, default 4\n");
         exit(0);
     }
 
@@ -106,9 +113,240 @@ static void *print_spin_lock(void *arg)
     return NULL;
 }
 
+/******************************************************************************
+ * contention bench: every thread takes the lock count times
+ *****************************************************************************/
+#define BENCH_MAX_THREADS 64
+
+enum bench_type {
+    BENCH_SPIN,
+    BENCH_MUTEX,
+    BENCH_FMUTEX,
+    BENCH_TICKET,
+    BENCH_MCS,
+};
+
+static const char *bench_name[] = {"spin", "mutex", "fmutex", "ticket", "mcs"};
+
+struct bench_arg {
+    enum bench_type type;
+    uint64_t count;
+};
+
+static uint64_t now_us()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+static void *bench_lock_thread(void *arg)
+{
+    struct bench_arg *b = (struct bench_arg *)arg;
+    struct mcs_node node;
+    uint64_t i;
+
+    for (i = 0; i < b->count; i++) {
+        switch (b->type) {
+        case BENCH_SPIN:
+            spin_lock(&spin);
+            ++ value;
+            spin_unlock(&spin);
+            break;
+        case BENCH_MUTEX:
+            mutex_lock(&mutex);
+            ++ value;
+            mutex_unlock(&mutex);
+            break;
+        case BENCH_FMUTEX:
+            fmutex_lock(&fmutex);
+            ++ value;
+            fmutex_unlock(&fmutex);
+            break;
+        case BENCH_TICKET:
+            ticket_lock(&ticket);
+            ++ value;
+            ticket_unlock(&ticket);
+            break;
+        case BENCH_MCS:
+            mcs_lock(&mcs, &node);
+            ++ value;
+            mcs_unlock(&mcs, &node);
+            break;
+        }
+    }
+    return NULL;
+}
+
+static int bench_lock(enum bench_type type, uint64_t count, int nthread)
+{
+    pthread_t tid[BENCH_MAX_THREADS];
+    struct bench_arg arg = {type, count};
+    uint64_t start, used;
+    int i;
+
+    value = 0;
+    start = now_us();
+    for (i = 0; i < nthread; i++) {
+        pthread_create(&tid[i], NULL, bench_lock_thread, &arg);
+    }
+    for (i = 0; i < nthread; i++) {
+        pthread_join(tid[i], NULL);
+    }
+    used = now_us() - start;
+    printf("%-8s threads=%d value=%" PRId64 " %s, %.1f ns/op\n",
+           bench_name[type], nthread, value,
+           (uint64_t)value == count * nthread ? "ok" : "BROKEN",
+           used * 1000.0 / (count * nthread));
+    return (uint64_t)value == count * nthread ? 0 : -1;
+}
+
+/* readers check a == ~b, one writer updates both */
+struct pair {
+    uint64_t a;
+    uint64_t b;
+};
+
+static struct pair seq_pair = {0, ~0ULL};
+static struct pair *rcu_pair;
+static struct rcu *rcu;
+static int bench_stop;
+
+struct reader_result {
+    uint64_t reads;
+    uint64_t retries;
+    uint64_t broken;
+};
+
+static void *seqlock_reader(void *arg)
+{
+    struct reader_result *res = (struct reader_result *)arg;
+    struct pair p;
+    uint32_t seq;
+    int first;
+
+    while (!atomic_load_ex(&bench_stop, ATOMIC_RELAXED)) {
+        first = 1;
+        do {
+            if (!first) {
+                res->retries++;
+            }
+            first = 0;
+            seq = seqlock_read_begin(&seqlock);
+            p.a = atomic_load_ex(&seq_pair.a, ATOMIC_RELAXED);
+            p.b = atomic_load_ex(&seq_pair.b, ATOMIC_RELAXED);
+        } while (seqlock_read_retry(&seqlock, seq));
+        if (p.a != ~p.b) {
+            res->broken++;
+        }
+        res->reads++;
+    }
+    return NULL;
+}
+
+static void *rcu_reader(void *arg)
+{
+    struct reader_result *res = (struct reader_result *)arg;
+    struct rcu_reader *r = rcu_register(rcu);
+    struct pair *p;
+
+    while (!atomic_load_ex(&bench_stop, ATOMIC_RELAXED)) {
+        rcu_read_lock(r);
+        p = rcu_dereference(rcu_pair);
+        if (p->a != ~p->b) {
+            res->broken++;
+        }
+        rcu_read_unlock(r);
+        res->reads++;
+    }
+    rcu_unregister(rcu, r);
+    return NULL;
+}
+
+static int bench_read_mostly(int is_rcu, uint64_t count, int nthread)
+{
+    pthread_t tid[BENCH_MAX_THREADS];
+    struct reader_result res[BENCH_MAX_THREADS];
+    struct pair *p, *old;
+    uint64_t i, start, used, reads = 0, retries = 0, broken = 0;
+    int n;
+
+    if (nthread < 2) {
+        nthread = 2;
+    }
+    memset(res, 0, sizeof(res));
+    bench_stop = 0;
+    if (is_rcu) {
+        rcu = rcu_create();
+        rcu_pair = calloc(1, sizeof(struct pair));
+        rcu_pair->b = ~0ULL;
+    }
+    start = now_us();
+    for (n = 0; n < nthread - 1; n++) {
+        pthread_create(&tid[n], NULL, is_rcu ? rcu_reader : seqlock_reader, &res[n]);
+    }
+    /* the writer: count / 100 updates */
+    for (i = 1; i <= count / 100; i++) {
+        if (is_rcu) {
+            p = malloc(sizeof(struct pair));
+            p->a = i;
+            p->b = ~i;
+            old = rcu_pair;
+            rcu_assign_pointer(rcu_pair, p);
+            rcu_defer(rcu, free, old);
+        } else {
+            seqlock_write_lock(&seqlock);
+            atomic_store_ex(&seq_pair.a, i, ATOMIC_RELAXED);
+            atomic_store_ex(&seq_pair.b, ~i, ATOMIC_RELAXED);
+            seqlock_write_unlock(&seqlock);
+        }
+        sched_yield();
+    }
+    atomic_store_ex(&bench_stop, 1, ATOMIC_RELAXED);
+    for (n = 0; n < nthread - 1; n++) {
+        pthread_join(tid[n], NULL);
+        reads += res[n].reads;
+        retries += res[n].retries;
+        broken += res[n].broken;
+    }
+    used = now_us() - start;
+    printf("%-8s readers=%d writes=%" PRIu64 " reads=%" PRIu64 " retries=%" PRIu64
+           " torn=%" PRIu64 ", %.1f ns/read\n",
+           is_rcu ? "rcu" : "seqlock", nthread - 1, count / 100, reads, retries,
+           broken, reads ? used * 1000.0 * (nthread - 1) / reads : 0.0);
+    if (is_rcu) {
+        rcu_destroy(rcu);
+        free(rcu_pair);
+    }
+    return broken ? -1 : 0;
+}
+
 int main(int argc, char **argv)
 {
     usage(argc, argv);
+    int nthread = argc == 4 ? atoi(argv[3]) : 4;
+    int all = !strcmp(argv[1], "all");
+    if (nthread < 1 || nthread > BENCH_MAX_THREADS) {
+        nthread = 4;
+    }
+    if (all || argc == 4 || (strcmp(argv[1], "spin") && strcmp(argv[1], "mutex"))) {
+        uint64_t loops = strtoul((const char*)argv[2], (char**)NULL, 10);
+        int t, ret = 0;
+        mutex_lock_init(&mutex);
+        for (t = BENCH_SPIN; t <= BENCH_MCS; t++) {
+            if (all || !strcmp(argv[1], bench_name[t])) {
+                ret |= bench_lock((enum bench_type)t, loops, nthread);
+            }
+        }
+        if (all || !strcmp(argv[1], "seqlock")) {
+            ret |= bench_read_mostly(0, loops, nthread);
+        }
+        if (all || !strcmp(argv[1], "rcu")) {
+            ret |= bench_read_mostly(1, loops, nthread);
+        }
+        mutex_lock_deinit(&mutex);
+        return ret;
+    }
     pthread_t tid1, tid2;
     struct timeval start;
     struct timeval end;
@@ -24,6 +24,10 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <unistd.h>
+#include <inttypes.h>
+#if defined (OS_LINUX)
+#include <sched.h>
+#endif
 
 void thread_print_info(struct thread *t)
 {
@@ -69,8 +73,125 @@ void foo2()
     thread_destroy(t1);
 }
 
+static void *busy(struct thread *t, void *arg)
+{
+    volatile int *stop = (volatile int *)arg;
+    volatile unsigned long n;
+    while (!*stop) {
+        for (n = 0; n < 100000; n++) {
+        }
+        usleep(1000);
+    }
+    return NULL;
+}
+
+static int cpu_isset(const struct thread_attr *attr, int cpu)
+{
+    return !!(attr->cpus[cpu / (8 * sizeof(unsigned long))] &
+              (1UL << (cpu % (8 * sizeof(unsigned long)))));
+}
+
+static int foo_cpulist()
+{
+    /* "0-15:2/4" takes 2 of every 4 cpus: 0,1,4,5,8,9,12,13 */
+    static const int expect[] = {0, 1, 4, 5, 8, 9, 12, 13, 32};
+    static const char *bad[] = {"x", "3-1", "4096", "0-7:3/2", "0-7:0/4", "0-7:2", "1,,2x"};
+    struct thread_attr attr;
+    int cpu, i, n;
+
+    thread_attr_init(&attr);
+    if (thread_attr_set_cpulist(&attr, "0-15:2/4,32")) {
+        printf("%s: parse \"0-15:2/4,32\" failed\n", __func__);
+        return -1;
+    }
+    n = sizeof(expect) / sizeof(expect[0]);
+    if (attr.ncpu != n) {
+        printf("%s: ncpu=%d, expect %d\n", __func__, attr.ncpu, n);
+        return -1;
+    }
+    for (cpu = 0, i = 0; cpu < THREAD_CPU_MAX; cpu++) {
+        if (cpu_isset(&attr, cpu) != (i < n && expect[i] == cpu)) {
+            printf("%s: cpu %d mask mismatch\n", __func__, cpu);
+            return -1;
+        }
+        if (i < n && expect[i] == cpu) {
+            i++;
+        }
+    }
+    thread_attr_init(&attr);
+    if (thread_attr_set_cpulist(&attr, "2,0-1\n") || attr.ncpu != 3 ||
+        !cpu_isset(&attr, 0) || !cpu_isset(&attr, 1) || !cpu_isset(&attr, 2)) {
+        printf("%s: parse \"2,0-1\" failed\n", __func__);
+        return -1;
+    }
+    for (i = 0; i < (int)(sizeof(bad) / sizeof(bad[0])); i++) {
+        /* a rejected list must leave the previous mask untouched */
+        if (!thread_attr_set_cpulist(&attr, bad[i])) {
+            printf("%s: \"%s\" should be rejected\n", __func__, bad[i]);
+            return -1;
+        }
+        if (attr.ncpu != 3) {
+            printf("%s: \"%s\" changed the mask\n", __func__, bad[i]);
+            return -1;
+        }
+    }
+    printf("%s: pass\n", __func__);
+    return 0;
+}
+
+int foo_attr()
+{
+    struct thread_attr attr;
+    struct thread_stats st;
+    struct thread *t;
+    volatile int stop = 0;
+
+    if (foo_cpulist()) {
+        return -1;
+    }
+    thread_attr_init(&attr);
+    thread_attr_set_stack(&attr, 256 * 1024);
+#if defined (OS_LINUX)
+    if (thread_attr_set_cpulist(&attr, "0")) {
+        printf("thread_attr_set_cpulist failed\n");
+    }
+    thread_attr_set_numa(&attr, 0);
+    /* needs CAP_SYS_NICE, otherwise only a warning and normal scheduling */
+    thread_attr_set_sched(&attr, SCHED_FIFO, 10);
+#endif
+    t = thread_create_attr(busy, (void *)&stop, &attr);
+    if (!t) {
+        printf("thread_create_attr failed\n");
+        return -1;
+    }
+    thread_set_name(t, "pinned thread");
+    usleep(200 * 1000);
+    if (0 == thread_get_stats(t, &st)) {
+        printf("%s: cpu_ns=%" PRIu64 " vctx=%" PRIu64 " nvctx=%" PRIu64 " last_cpu=%d\n",
+               __func__, st.cpu_ns, st.voluntary_ctxt, st.involuntary_ctxt, st.last_cpu);
+#if defined (OS_LINUX)
+        if (st.last_cpu != 0) {
+            printf("%s: pinned thread ran on cpu %d\n", __func__, st.last_cpu);
+            stop = 1;
+            thread_join(t);
+            thread_destroy(t);
+            return -1;
+        }
+#endif
+    }
+    thread_get_info(t);
+    stop = 1;
+    thread_join(t);
+    thread_destroy(t);
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
+    /* foo() and foo2() leave threads parked in thread_wait(), check attr first */
+    if (foo_attr()) {
+        return -1;
+    }
     foo();
     foo2();
     while (1) {
@@ -13,6 +13,6 @@ LIBRARIES_DIR	:= $(LOCAL_PATH)/../
 LOCAL_C_INCLUDES := $(LOCAL_PATH)
 
 # Add your application source files here...
-LOCAL_SRC_FILES := libtime.c
+LOCAL_SRC_FILES := libtime.c time-clock.c
 
 include $(BUILD_SHARED_LIBRARY)
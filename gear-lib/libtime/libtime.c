@@ -107,7 +107,7 @@ uint64_t time_now_usec(struct timeval *val)
         printf("gettimeofday failed %d:%s\n", errno, strerror(errno));
         return -1;
     }
-    return (uint64_t)(((uint64_t)tv.tv_sec)*1000*1000 + (uint64_t)tv.tv_usec);
+    return (uint64_t)(((uint64_t)val->tv_sec)*1000*1000 + (uint64_t)val->tv_usec);
 }
 
 static uint64_t _time_clock_gettime(clockid_t clk_id)
@@ -167,10 +167,9 @@ char *time_now_msec_str(char *str, int len)
 int time_sleep_ms(uint64_t ms)
 {
     struct timeval tv;
-    tv.tv_sec = 0;
-    tv.tv_usec = ms*1000;
+    tv.tv_sec = ms/1000;
+    tv.tv_usec = (ms%1000)*1000;
     return select(0, NULL, NULL, NULL, &tv);
-    return 0;
 }
 
 int time_info_by_utc(uint32_t utc, struct time_info *ti)
@@ -80,6 +80,33 @@ int time_info_by_utc(uint32_t utc, struct time_info *ti);
 int time_info_by_msec(uint64_t msec, struct time_info *ti);
 uint64_t time_elapsed_ms(struct timeval *tv);
 
+/*
+ * cheap clocks for hot paths
+ *
+ * time_clock_start() runs a ticker thread that caches monotonic and wall
+ * time every tick_ms; the coarse readers then cost one load. Without the
+ * ticker they use CLOCK_*_COARSE (jiffy resolution, no syscall).
+ */
+int time_clock_start(uint32_t tick_ms);
+void time_clock_stop();
+uint64_t time_coarse_nsec();
+uint64_t time_coarse_msec();
+uint64_t time_coarse_wall_msec();
+
+/*
+ * monotonic nano second from a calibrated invariant TSC on x86_64,
+ * CLOCK_MONOTONIC elsewhere or until calibration (~20ms) is done
+ */
+uint64_t time_fast_nsec();
+int time_fast_is_tsc();
+
+/*
+ * "YYYY-MM-DD HH:MM:SS[.mmm]" of the current local time, cached per thread
+ * and only reformatted when the second changes; valid until the calling
+ * thread's next call
+ */
+const char *time_cached_str(int with_msec);
+
 #ifdef __cplusplus
 }
 #endif
@@ -47,10 +47,62 @@ void foo()
     printf("time_str_by_msec:     %s\n", time_str_format_by_msec(ti.utc_msec, ts, sizeof(ts)));
 }
 
+#define BENCH_LOOP  (1000 * 1000)
+
+#define BENCH(name, expr)                                                   \
+    do {                                                                    \
+        uint64_t _t0, _sum = 0;                                             \
+        int _i;                                                             \
+        _t0 = time_now_nsec();                                              \
+        for (_i = 0; _i < BENCH_LOOP; _i++) {                               \
+            _sum += (uint64_t)(uintptr_t)(expr);                            \
+        }                                                                   \
+        printf("%-24s %6.1f ns/call (%" PRIu64 ")\n", name,                 \
+               (double)(time_now_nsec() - _t0) / BENCH_LOOP, _sum & 1);    \
+    } while (0)
+
+void foo_clock()
+{
+    char time[32];
+    uint64_t prev, now;
+    int i, back = 0;
+
+    printf("time_cached_str:      %s\n", time_cached_str(1));
+    printf("time_cached_str:      %s\n", time_cached_str(0));
+    printf("time_coarse_msec:     %" PRIu64 "\n", time_coarse_msec());
+    printf("time_coarse_wall_msec:%" PRIu64 "\n", time_coarse_wall_msec());
+
+    prev = time_fast_nsec();
+    time_sleep_ms(50);
+    for (i = 0; i < BENCH_LOOP; i++) {
+        now = time_fast_nsec();
+        if (now < prev) {
+            back++;
+        }
+        prev = now;
+    }
+    printf("time_fast_nsec:       tsc=%d backwards=%d\n", time_fast_is_tsc(), back);
+
+    BENCH("time_now_msec", time_now_msec());
+    BENCH("time_now_msec_str", time_now_msec_str(time, sizeof(time)));
+    BENCH("time_coarse_msec", time_coarse_msec());
+    BENCH("time_fast_nsec", time_fast_nsec());
+    BENCH("time_cached_str", time_cached_str(1));
+
+    time_clock_start(1);
+    time_sleep_ms(20);
+    printf("ticker started\n");
+    BENCH("time_coarse_msec", time_coarse_msec());
+    BENCH("time_cached_str", time_cached_str(1));
+    printf("time_cached_str:      %s\n", time_cached_str(1));
+    time_clock_stop();
+}
+
 int main(int argc, char **argv)
 {
     foo();
     time_sleep_ms(1000);
     foo();
+    foo_clock();
     return 0;
 }
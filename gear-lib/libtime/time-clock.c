@@ -0,0 +1,346 @@
+/******************************************************************************
+ * Copyright (C) 2014-2020 Zhifeng Gong <gozfree@163.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+#include "libtime.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#if defined (__GNUC__) && defined (__x86_64__)
+#define TIME_CLOCK_TSC
+#include <x86intrin.h>
+#include <cpuid.h>
+#endif
+
+/*
+ * clock service
+ *
+ * coarse clocks: one ticker thread stores monotonic and wall time every
+ * tick, readers load a 64-bit word. Without the ticker they fall back to
+ * CLOCK_*_COARSE, which the vDSO answers from the last jiffy without a
+ * syscall.
+ *
+ * fast clock: on an invariant TSC, nanoseconds are ns0 + (tsc - tsc0) * mult,
+ * calibrated against CLOCK_MONOTONIC over the first 20ms of use and
+ * re-anchored every second by the ticker. Readers never lock, the anchor is
+ * published under a sequence counter. Anywhere else it is CLOCK_MONOTONIC.
+ *
+ * cached strings: each thread keeps the last formatted wall clock string and
+ * only calls localtime_r() when the second changes; a new millisecond just
+ * rewrites three digits.
+ */
+
+#if defined (__GNUC__)
+#define TLS                 __thread
+#define LOAD(p)             __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define STORE(p, v)         __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define LOAD_RELAXED(p)     __atomic_load_n(p, __ATOMIC_RELAXED)
+#define STORE_RELAXED(p, v) __atomic_store_n(p, v, __ATOMIC_RELAXED)
+#define FENCE()             __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#else
+#define TLS                 __declspec(thread)
+#define LOAD(p)             (MemoryBarrier(), *(p))
+#define STORE(p, v)         do { MemoryBarrier(); *(p) = (v); } while (0)
+#define LOAD_RELAXED(p)     (*(p))
+#define STORE_RELAXED(p, v) (*(p) = (v))
+#define FENCE()             MemoryBarrier()
+#endif
+
+#define TSC_CALIB_NS        (20 * 1000 * 1000ULL)
+
+enum tsc_state {
+    TSC_UNKNOWN = 0,
+    TSC_NONE,
+    TSC_CALIB,
+    TSC_READY,
+};
+
+struct tsc_clock {
+    uint32_t seq;
+    uint64_t tsc0;
+    uint64_t ns0;
+    uint64_t mult;          /* ns per tick << 32 */
+    int state;
+    uint64_t ref_tsc;       /* last real (tsc, ns) sample */
+    uint64_t ref_ns;
+    pthread_mutex_t lock;
+};
+
+struct time_clock {
+    pthread_t tid;
+    int running;
+    uint32_t tick_ms;
+    uint64_t mono_ns;
+    uint64_t wall_ms;
+};
+
+struct time_str_cache {
+    int64_t sec;
+    int msec;
+    char str[32];
+};
+
+static struct tsc_clock s_tsc = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+static struct time_clock s_clock;
+static TLS struct time_str_cache s_str_cache = { -1, -1, {0} };
+
+static inline uint64_t clock_ns(clockid_t id)
+{
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#if defined (CLOCK_MONOTONIC_COARSE)
+#define CLOCK_MONO_COARSE   CLOCK_MONOTONIC_COARSE
+#define CLOCK_WALL_COARSE   CLOCK_REALTIME_COARSE
+#else
+#define CLOCK_MONO_COARSE   CLOCK_MONOTONIC
+#define CLOCK_WALL_COARSE   CLOCK_REALTIME
+#endif
+
+#if defined (TIME_CLOCK_TSC)
+static int tsc_invariant(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) {
+        return 0;
+    }
+    return !!(edx & (1 << 8));
+}
+
+static inline uint64_t tsc_to_ns(uint64_t tsc, uint64_t tsc0, uint64_t ns0, uint64_t mult)
+{
+    return ns0 + (uint64_t)(((unsigned __int128)(tsc - tsc0) * mult) >> 32);
+}
+
+/* called with s_tsc.lock held, by the ticker or by a reader before READY */
+static void tsc_update(void)
+{
+    uint64_t tsc, ns, pred, mult;
+
+    tsc = __rdtsc();
+    ns = clock_ns(CLOCK_MONOTONIC);
+    switch (s_tsc.state) {
+    case TSC_UNKNOWN:
+        STORE(&s_tsc.state, tsc_invariant() ? TSC_CALIB : TSC_NONE);
+        s_tsc.ref_tsc = tsc;
+        s_tsc.ref_ns = ns;
+        break;
+    case TSC_CALIB:
+    case TSC_READY:
+        if (ns - s_tsc.ref_ns < TSC_CALIB_NS || tsc <= s_tsc.ref_tsc) {
+            break;
+        }
+        mult = ((ns - s_tsc.ref_ns) << 32) / (tsc - s_tsc.ref_tsc);
+        /* never step backwards: anchor at the later of clock and prediction */
+        if (s_tsc.state == TSC_READY) {
+            pred = tsc_to_ns(tsc, s_tsc.tsc0, s_tsc.ns0, s_tsc.mult);
+            if (pred > ns) {
+                ns = pred;
+            }
+        }
+        STORE(&s_tsc.seq, s_tsc.seq + 1);
+        FENCE();
+        STORE_RELAXED(&s_tsc.tsc0, tsc);
+        STORE_RELAXED(&s_tsc.ns0, ns);
+        STORE_RELAXED(&s_tsc.mult, mult);
+        STORE(&s_tsc.seq, s_tsc.seq + 1);
+        s_tsc.ref_tsc = tsc;
+        s_tsc.ref_ns = clock_ns(CLOCK_MONOTONIC);
+        STORE(&s_tsc.state, TSC_READY);
+        break;
+    default:
+        break;
+    }
+}
+
+uint64_t time_fast_nsec()
+{
+    uint64_t tsc0, ns0, mult, tsc;
+    uint32_t seq;
+
+    if (LIKELY(LOAD(&s_tsc.state) == TSC_READY)) {
+        do {
+            seq = LOAD(&s_tsc.seq);
+            tsc0 = LOAD_RELAXED(&s_tsc.tsc0);
+            ns0 = LOAD_RELAXED(&s_tsc.ns0);
+            mult = LOAD_RELAXED(&s_tsc.mult);
+            FENCE();
+        } while ((seq & 1) || seq != LOAD(&s_tsc.seq));
+        tsc = __rdtsc();
+        /* another core's tsc may trail the anchor by a few ticks */
+        return tsc > tsc0 ? tsc_to_ns(tsc, tsc0, ns0, mult) : ns0;
+    }
+    if (LOAD_RELAXED(&s_tsc.state) != TSC_NONE && !pthread_mutex_trylock(&s_tsc.lock)) {
+        tsc_update();
+        pthread_mutex_unlock(&s_tsc.lock);
+    }
+    return clock_ns(CLOCK_MONOTONIC);
+}
+
+int time_fast_is_tsc()
+{
+    return LOAD(&s_tsc.state) == TSC_READY;
+}
+#else
+uint64_t time_fast_nsec()
+{
+    return clock_ns(CLOCK_MONOTONIC);
+}
+
+int time_fast_is_tsc()
+{
+    return 0;
+}
+#endif
+
+static void *time_clock_ticker(void *arg)
+{
+    uint64_t last_sec = 0;
+
+    while (LOAD(&s_clock.running)) {
+        STORE(&s_clock.mono_ns, clock_ns(CLOCK_MONOTONIC));
+        STORE(&s_clock.wall_ms, clock_ns(CLOCK_REALTIME) / 1000000);
+#if defined (TIME_CLOCK_TSC)
+        if (s_clock.mono_ns / 1000000000 != last_sec) {
+            last_sec = s_clock.mono_ns / 1000000000;
+            pthread_mutex_lock(&s_tsc.lock);
+            tsc_update();
+            pthread_mutex_unlock(&s_tsc.lock);
+        }
+#else
+        (void)last_sec;
+#endif
+        time_sleep_ms(s_clock.tick_ms);
+    }
+    return NULL;
+}
+
+int time_clock_start(uint32_t tick_ms)
+{
+    if (s_clock.running) {
+        return 0;
+    }
+    s_clock.tick_ms = tick_ms ? tick_ms : 1;
+    s_clock.mono_ns = clock_ns(CLOCK_MONOTONIC);
+    s_clock.wall_ms = clock_ns(CLOCK_REALTIME) / 1000000;
+    STORE(&s_clock.running, 1);
+    if (pthread_create(&s_clock.tid, NULL, time_clock_ticker, NULL)) {
+        printf("pthread_create failed %d:%s\n", errno, strerror(errno));
+        STORE(&s_clock.running, 0);
+        return -1;
+    }
+    return 0;
+}
+
+void time_clock_stop()
+{
+    if (!s_clock.running) {
+        return;
+    }
+    STORE(&s_clock.running, 0);
+    pthread_join(s_clock.tid, NULL);
+}
+
+uint64_t time_coarse_nsec()
+{
+    if (LOAD(&s_clock.running)) {
+        return LOAD(&s_clock.mono_ns);
+    }
+    return clock_ns(CLOCK_MONO_COARSE);
+}
+
+uint64_t time_coarse_msec()
+{
+    return time_coarse_nsec() / 1000000;
+}
+
+uint64_t time_coarse_wall_msec()
+{
+    if (LOAD(&s_clock.running)) {
+        return LOAD(&s_clock.wall_ms);
+    }
+    return clock_ns(CLOCK_WALL_COARSE) / 1000000;
+}
+
+static inline void put2(char *p, int v)
+{
+    p[0] = '0' + v / 10;
+    p[1] = '0' + v % 10;
+}
+
+const char *time_cached_str(int with_msec)
+{
+    struct time_str_cache *c = &s_str_cache;
+    uint64_t ms;
+    int64_t sec;
+    int msec;
+    struct tm tm;
+    time_t t;
+
+    if (LOAD(&s_clock.running)) {
+        ms = LOAD(&s_clock.wall_ms);
+    } else {
+        ms = clock_ns(CLOCK_REALTIME) / 1000000;
+    }
+    sec = ms / 1000;
+    msec = ms % 1000;
+    if (UNLIKELY(sec != c->sec)) {
+        t = (time_t)sec;
+        if (!localtime_r(&t, &tm)) {
+            return NULL;
+        }
+        /* "YYYY-MM-DD HH:MM:SS.mmm" */
+        put2(c->str, (tm.tm_year + 1900) / 100);
+        put2(c->str + 2, (tm.tm_year + 1900) % 100);
+        c->str[4] = '-';
+        put2(c->str + 5, tm.tm_mon + 1);
+        c->str[7] = '-';
+        put2(c->str + 8, tm.tm_mday);
+        c->str[10] = ' ';
+        put2(c->str + 11, tm.tm_hour);
+        c->str[13] = ':';
+        put2(c->str + 14, tm.tm_min);
+        c->str[16] = ':';
+        put2(c->str + 17, tm.tm_sec);
+        c->str[19] = '.';
+        c->sec = sec;
+        c->msec = -1;
+    }
+    if (!with_msec) {
+        c->str[19] = '\0';
+        c->msec = -1;
+        return c->str;
+    }
+    if (msec != c->msec) {
+        c->str[19] = '.';
+        c->str[20] = '0' + msec / 100;
+        put2(c->str + 21, msec % 100);
+        c->str[23] = '\0';
+        c->msec = msec;
+    }
+    return c->str;
+}
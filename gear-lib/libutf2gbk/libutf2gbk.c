@@ -1,4 +1,12 @@
 #include "libutf2gbk.h"
+#include <pthread.h>
+#include <stdint.h>
+
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#elif defined (__ARM_NEON) || defined (__ARM_NEON__)
+#include <arm_neon.h>
+#endif
 
 
 typedef struct
@@ -4375,6 +4383,53 @@ static UNICODE_GB unicode_gb_table[] = {//unicode到gb2312表
 static int enc_get_utf8_size(const unsigned char pInput);
 static unsigned short SearchCodeTable(unsigned short unicode);
 
+/*
+ * direct lookup, built once from unicode_gb_table:
+ * unicode -> gbk is two level, 256 page pointers into a pool of the pages
+ * the table actually uses (an unused page points at the all-zero page 0);
+ * gbk -> unicode is indexed by [lead - GBK_LEAD_MIN][trail].
+ */
+#define U2G_MAX_PAGES	128
+#define GBK_LEAD_MIN	0x81
+#define GBK_LEAD_MAX	0xFE
+#define GBK_IS_LEAD(c)	((c) >= GBK_LEAD_MIN && (c) <= GBK_LEAD_MAX)
+#define GBK_IS_TRAIL(c)	((c) >= 0x40 && (c) <= 0xFE && (c) != 0x7F)
+
+static unsigned short s_u2g_pool[U2G_MAX_PAGES][256];
+static unsigned short *s_u2g[256];
+static unsigned short s_g2u[GBK_LEAD_MAX - GBK_LEAD_MIN + 1][256];
+static pthread_once_t s_table_once = PTHREAD_ONCE_INIT;
+
+static void table_build(void)
+{
+	int i, page, pages = 1;
+	unsigned short u, g;
+
+	for (i = 0; i < 256; i++)
+		s_u2g[i] = s_u2g_pool[0];
+	for (i = 0; i < TABLE_LEN; i++)
+	{
+		u = unicode_gb_table[i].unicode;
+		g = unicode_gb_table[i].gb2312;
+		page = u >> 8;
+		if (s_u2g[page] == s_u2g_pool[0])
+		{
+			if (pages == U2G_MAX_PAGES)
+				continue;
+			s_u2g[page] = s_u2g_pool[pages++];
+		}
+		s_u2g[page][u & 0xFF] = g;
+		if (GBK_IS_LEAD(g >> 8) && GBK_IS_TRAIL(g & 0xFF) &&
+		    !s_g2u[(g >> 8) - GBK_LEAD_MIN][g & 0xFF])
+			s_g2u[(g >> 8) - GBK_LEAD_MIN][g & 0xFF] = u;
+	}
+}
+
+static inline void table_init(void)
+{
+	pthread_once(&s_table_once, table_build);
+}
+
 int  UTF_8ToGB2312(char*pOut, char *pInput, int pLen)
 {
 	int res, i = 0, j = 0;
@@ -4486,20 +4541,10 @@ void UnicodeToGB2312(char*pOut, char *pInput)
 	memcpy(pOut, &gb2312_tmp, 2);
 }
 
-static unsigned short SearchCodeTable(unsigned short unicode) // 二分法查表
+static unsigned short SearchCodeTable(unsigned short unicode)
 {
-	int mid, start = 0, end = TABLE_LEN - 1;
-	while (start <= end)
-	{
-		mid = (start + end) / 2;
-		if (unicode_gb_table[mid].unicode == unicode)
-			return unicode_gb_table[mid].gb2312;
-		else if (unicode_gb_table[mid].unicode < unicode)
-			start = mid + 1;
-		else
-			end = mid - 1;
-	}
-	return 0;
+	table_init();
+	return s_u2g[unicode >> 8][unicode & 0xFF];
 }
 
 static int enc_get_utf8_size(const unsigned char pInput)
@@ -4511,4 +4556,190 @@ static int enc_get_utf8_size(const unsigned char pInput)
 		temp = (temp >> 1);
 	}
 	return num;
-}
\ No newline at end of file
+}
+
+/*
+ * copy the leading pure-ASCII run of src to dst, 32 or 16 bytes per step
+ * while both sides have room, return its length
+ */
+static size_t ascii_copy(uint8_t *dst, const uint8_t *src, size_t n)
+{
+	size_t i = 0;
+	uint64_t w;
+
+#if defined (__SSE2__)
+	for (; i + 32 <= n; i += 32)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + i + 16));
+		if (_mm_movemask_epi8(_mm_or_si128(a, b)))
+			break;
+		_mm_storeu_si128((__m128i *)(dst + i), a);
+		_mm_storeu_si128((__m128i *)(dst + i + 16), b);
+	}
+	for (; i + 16 <= n; i += 16)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+		if (_mm_movemask_epi8(a))
+			break;
+		_mm_storeu_si128((__m128i *)(dst + i), a);
+	}
+#elif defined (__aarch64__) && defined (__ARM_NEON)
+	for (; i + 32 <= n; i += 32)
+	{
+		uint8x16_t a = vld1q_u8(src + i);
+		uint8x16_t b = vld1q_u8(src + i + 16);
+		if (vmaxvq_u8(vorrq_u8(a, b)) & 0x80)
+			break;
+		vst1q_u8(dst + i, a);
+		vst1q_u8(dst + i + 16, b);
+	}
+#endif
+	for (; i + 8 <= n; i += 8)
+	{
+		memcpy(&w, src + i, 8);
+		if (w & 0x8080808080808080ULL)
+			break;
+		memcpy(dst + i, &w, 8);
+	}
+	for (; i < n && src[i] < 0x80; i++)
+		dst[i] = src[i];
+	return i;
+}
+
+/* strict UTF-8 decode of one non-ASCII sequence, return its length or 0 */
+static int utf8_decode(const uint8_t *p, size_t n, uint32_t *cp)
+{
+	uint8_t c = p[0];
+
+	if (c >= 0xC2 && c <= 0xDF)
+	{
+		if (n < 2 || (p[1] & 0xC0) != 0x80)
+			return 0;
+		*cp = ((c & 0x1F) << 6) | (p[1] & 0x3F);
+		return 2;
+	}
+	if (c >= 0xE0 && c <= 0xEF)
+	{
+		if (n < 3 || (p[1] & 0xC0) != 0x80 || (p[2] & 0xC0) != 0x80)
+			return 0;
+		*cp = ((c & 0x0F) << 12) | ((p[1] & 0x3F) << 6) | (p[2] & 0x3F);
+		if (*cp < 0x800 || (*cp >= 0xD800 && *cp <= 0xDFFF))
+			return 0;
+		return 3;
+	}
+	if (c >= 0xF0 && c <= 0xF4)
+	{
+		if (n < 4 || (p[1] & 0xC0) != 0x80 || (p[2] & 0xC0) != 0x80
+			|| (p[3] & 0xC0) != 0x80)
+			return 0;
+		*cp = ((c & 0x07) << 18) | ((p[1] & 0x3F) << 12)
+			| ((p[2] & 0x3F) << 6) | (p[3] & 0x3F);
+		if (*cp < 0x10000 || *cp > 0x10FFFF)
+			return 0;
+		return 4;
+	}
+	return 0;
+}
+
+int UTF_8ToGBK(char *pOut, int outLen, const char *pInput, int inLen)
+{
+	const uint8_t *in = (const uint8_t *)pInput;
+	uint8_t *out = (uint8_t *)pOut;
+	size_t i = 0, o = 0, n;
+	unsigned short g;
+	uint32_t cp;
+	int len;
+
+	if (!pOut || !pInput || outLen < 0 || inLen < 0)
+		return -1;
+	table_init();
+	while (i < (size_t)inLen)
+	{
+		n = (size_t)inLen - i;
+		if (n > (size_t)outLen - o)
+			n = (size_t)outLen - o;
+		n = ascii_copy(out + o, in + i, n);
+		i += n;
+		o += n;
+		if (i == (size_t)inLen)
+			break;
+		if (in[i] < 0x80)
+			return -1;	/* ASCII left but no room */
+		len = utf8_decode(in + i, (size_t)inLen - i, &cp);
+		if (!len)
+			return -1;
+		g = cp < 0x10000 ? s_u2g[cp >> 8][cp & 0xFF] : 0;
+		if (g)
+		{
+			if (o + 2 > (size_t)outLen)
+				return -1;
+			out[o++] = g >> 8;
+			out[o++] = g & 0xFF;
+		}
+		else
+		{
+			if (o + 1 > (size_t)outLen)
+				return -1;
+			out[o++] = '?';
+		}
+		i += len;
+	}
+	return (int)o;
+}
+
+int GBKToUTF_8(char *pOut, int outLen, const char *pInput, int inLen)
+{
+	const uint8_t *in = (const uint8_t *)pInput;
+	uint8_t *out = (uint8_t *)pOut;
+	size_t i = 0, o = 0, n;
+	uint32_t cp;
+
+	if (!pOut || !pInput || outLen < 0 || inLen < 0)
+		return -1;
+	table_init();
+	while (i < (size_t)inLen)
+	{
+		n = (size_t)inLen - i;
+		if (n > (size_t)outLen - o)
+			n = (size_t)outLen - o;
+		n = ascii_copy(out + o, in + i, n);
+		i += n;
+		o += n;
+		if (i == (size_t)inLen)
+			break;
+		if (in[i] < 0x80)
+			return -1;	/* ASCII left but no room */
+		/*
+		 * a bad or unmapped pair costs only its lead byte when the
+		 * second byte is ASCII, that byte is decoded on its own
+		 */
+		n = 1;
+		cp = 0xFFFD;
+		if (GBK_IS_LEAD(in[i]) && i + 1 < (size_t)inLen && GBK_IS_TRAIL(in[i + 1]))
+		{
+			cp = s_g2u[in[i] - GBK_LEAD_MIN][in[i + 1]];
+			if (cp || in[i + 1] >= 0x80)
+				n = 2;
+			if (!cp)
+				cp = 0xFFFD;
+		}
+		if (cp < 0x800)
+		{
+			if (o + 2 > (size_t)outLen)
+				return -1;
+			out[o++] = 0xC0 | (cp >> 6);
+			out[o++] = 0x80 | (cp & 0x3F);
+		}
+		else
+		{
+			if (o + 3 > (size_t)outLen)
+				return -1;
+			out[o++] = 0xE0 | (cp >> 12);
+			out[o++] = 0x80 | ((cp >> 6) & 0x3F);
+			out[o++] = 0x80 | (cp & 0x3F);
+		}
+		i += n;
+	}
+	return (int)o;
+}
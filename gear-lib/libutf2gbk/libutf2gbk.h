@@ -12,6 +12,18 @@ int  UTF_8ToGB2312(char*pOut, char *pInput, int pLen);
 int UTF_8ToUnicode(char* pOutput, char *pInput);
 void UnicodeToGB2312(char*pOut, char *pInput);
 
+/*
+ * bounded transcoders, nothing is written past pOut + outLen and no NUL is
+ * appended. return the number of bytes written, or -1 on malformed UTF-8
+ * or when pOut is too small (inLen bytes always suffice for UTF_8ToGBK,
+ * inLen * 3 for GBKToUTF_8).
+ * characters without a mapping become '?' in GBK and U+FFFD in UTF-8. A
+ * GBK byte that doesn't start a valid pair becomes one U+FFFD and decoding
+ * goes on with the next byte.
+ */
+int UTF_8ToGBK(char *pOut, int outLen, const char *pInput, int inLen);
+int GBKToUTF_8(char *pOut, int outLen, const char *pInput, int inLen);
+
 #ifdef __cplusplus
 }
 #endif
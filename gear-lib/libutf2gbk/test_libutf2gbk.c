@@ -1,14 +1,112 @@
 #include <stdio.h> 
 #include <string.h>
+#include <stdlib.h>
+#include <sys/time.h>
 #include "libutf2gbk.h"
 
+static double now_ms(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+static void foo_bounded(void)
+{
+	const char *utf8 = "OSD 2020-06-01 12:00:00 前门摄像头 CAM-01 温度 23℃";
+	char gbk[128], back[128];
+	int n, m;
+
+	n = UTF_8ToGBK(gbk, sizeof(gbk), utf8, strlen(utf8));
+	m = GBKToUTF_8(back, sizeof(back), gbk, n);
+	printf("utf8 %zu bytes -> gbk %d bytes -> utf8 %d bytes, round trip %s\n",
+		strlen(utf8), n, m, (m == (int)strlen(utf8) && !memcmp(back, utf8, m)) ? "ok" : "FAIL");
+	printf("short output: %d\n", UTF_8ToGBK(gbk, 10, utf8, strlen(utf8)));
+	printf("truncated utf8: %d\n", UTF_8ToGBK(gbk, sizeof(gbk), "\xe5\x89", 2));
+}
+
+/* each bad GBK lead byte is one U+FFFD, an ASCII trail byte survives */
+static int foo_invalid_gbk(void)
+{
+	static const struct {
+		const char *gbk;
+		const char *utf8;
+	} cases[] = {
+		{"\xC4\xE3", "\xE4\xBD\xA0"},			/* 你 */
+		{"\xC4\x31", "\xEF\xBF\xBD" "1"},		/* bad trail, re-scanned */
+		{"\xC4\x7F" "A", "\xEF\xBF\xBD" "\x7F" "A"},
+		{"\x80" "A", "\xEF\xBF\xBD" "A"},		/* 0x80 is not a lead */
+		{"\xFF\xC4\xE3", "\xEF\xBF\xBD\xE4\xBD\xA0"},
+		{"A\xC4", "A\xEF\xBF\xBD"},			/* lead at the end */
+	};
+	char out[32];
+	size_t k;
+	int m, fail = 0;
+
+	for (k = 0; k < sizeof(cases) / sizeof(cases[0]); k++) {
+		m = GBKToUTF_8(out, sizeof(out), cases[k].gbk, strlen(cases[k].gbk));
+		if (m != (int)strlen(cases[k].utf8) || memcmp(out, cases[k].utf8, m)) {
+			printf("invalid gbk case %zu: got %d bytes, FAIL\n", k, m);
+			fail = 1;
+		}
+	}
+	printf("invalid gbk: %s\n", fail ? "FAIL" : "ok");
+	return fail ? -1 : 0;
+}
+
+static void foo_bench(void)
+{
+	const char *line[] = {
+		"CH1 2020-06-01 12:00:00 FPS:25 BR:4096kbps ",
+		"前门摄像头 温度 23℃ 湿度 45% ",
+	};
+	int i, k, loop = 2000, size = 64 * 1024;
+	char *utf8 = malloc(size), *gbk = malloc(size), *back = malloc(size * 2);
+	double t;
+	int len, n = 0, m = 0;
+
+	for (k = 0; k < 2; k++)
+	{
+		len = 0;
+		while (len + (int)strlen(line[k]) < size)
+		{
+			memcpy(utf8 + len, line[k], strlen(line[k]));
+			len += strlen(line[k]);
+		}
+		t = now_ms();
+		for (i = 0; i < loop; i++)
+			n = UTF_8ToGBK(gbk, size, utf8, len);
+		t = now_ms() - t;
+		printf("%s UTF_8ToGBK: %.0f MB/s\n", k ? "chinese" : "ascii", loop * len / t / 1000);
+		t = now_ms();
+		for (i = 0; i < loop; i++)
+			m = GBKToUTF_8(back, size * 2, gbk, n);
+		t = now_ms() - t;
+		printf("%s GBKToUTF_8: %.0f MB/s (%s)\n", k ? "chinese" : "ascii", loop * n / t / 1000,
+			(m == len && !memcmp(back, utf8, len)) ? "ok" : "FAIL");
+		t = now_ms();
+		for (i = 0; i < loop / 10; i++)
+			UTF_8ToGB2312(gbk, utf8, len);
+		t = now_ms() - t;
+		printf("%s UTF_8ToGB2312: %.0f MB/s\n", k ? "chinese" : "ascii", loop / 10 * len / t / 1000);
+	}
+	free(utf8);
+	free(gbk);
+	free(back);
+}
+
 int main()
 {
 	char buf[] = "nininihhahahhh你好呀你好呀哈哈哈";
 	char buf2[(strlen(buf) + 1) * 6];
 	
+	memset(buf2, 0, sizeof(buf2));
 	UTF_8ToGB2312(buf2,buf,strlen(buf));
 	printf("buf : %s \nbuf 2 : %s \n",buf,buf2);
 	printf("utf8-len : %lu,gb2312-len : %lu\n",strlen(buf),strlen(buf2));
+	foo_bounded();
+	if (foo_invalid_gbk() < 0)
+		return -1;
+	foo_bench();
 	return 0;
-}
\ No newline at end of file
+}
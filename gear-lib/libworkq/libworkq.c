@@ -34,6 +34,7 @@ struct task {
     struct workq *wq;
 };
 
+static struct mem_cache *task_cache;
 
 static bool is_workq_underload(struct workq_pool *pool, struct workq *wq)
 {
@@ -42,12 +43,13 @@ static bool is_workq_underload(struct workq_pool *pool, struct workq *wq)
 
 bool is_workq_overload(struct workq_pool *pool, struct workq *wq)
 {
-    return (wq->load == 1 || wq->load > pool->threshold);
+    return (wq->load > pool->threshold);
 }
 
 static struct task *task_create(struct workq *wq, task_func_t func, void *data)
 {
-    struct task *t = calloc(1, sizeof(struct task));
+    struct task *t = mem_cache_alloc(mem_cache_get(&task_cache, "workq_task",
+                                                   sizeof(struct task)));
     if (!t) {
         return NULL;
     }
@@ -56,6 +58,7 @@ static struct task *task_create(struct workq *wq, task_func_t func, void *data)
     t->data = data;
     thread_lock(wq->thread);
     list_add_tail(&t->entry, &wq->wq_list);
+    wq->load++;
     thread_signal(wq->thread);
     thread_unlock(wq->thread);
     return t;
@@ -65,9 +68,9 @@ static void task_destroy(struct task *t)
 {
     struct workq *wq = t->wq;
     thread_lock(wq->thread);
-    list_del_init(&t->entry);
+    wq->load--;
     thread_unlock(wq->thread);
-    free(t);
+    mem_cache_free(task_cache, t);
 }
 
 static void *_task_thread(struct thread *thread, void *arg)
@@ -80,12 +83,16 @@ static void *_task_thread(struct thread *thread, void *arg)
             thread_wait(thread, 0);
         }
         t = list_first_entry_or_null(&wq->wq_list, struct task, entry);
+        if (t) {
+            /* running task is off the list, workq_destroy can't free it */
+            list_del_init(&t->entry);
+        }
         thread_unlock(thread);
-        if (t && t->func) {
-            wq->load = 1;
-            t->func(t->data);
+        if (t) {
+            if (t->func) {
+                t->func(t->data);
+            }
             task_destroy(t);
-            wq->load = 0;
         }
     }
     return NULL;
@@ -116,7 +123,9 @@ static void workq_destroy(struct workq *wq)
     thread_lock(wq->thread);
     while (!list_empty(&wq->wq_list)) {
         t = list_first_entry_or_null(&wq->wq_list, struct task, entry);
-        task_destroy(t);
+        list_del_init(&t->entry);
+        wq->load--;
+        mem_cache_free(task_cache, t);
     }
     wq->run = 0;
     thread_signal(wq->thread);
@@ -165,7 +174,7 @@ failed:
     if (pool) {
         do {
             wq = pool->wq_array.array[pool->wq_array.num-1];
-            da_erase_item(pool->wq_array, &wq);
+            da_pop_back(pool->wq_array);
             free(wq);
         } while (pool->wq_array.num > 0);
     }
@@ -178,20 +187,19 @@ failed:
 static struct workq *find_underrun_workq(struct workq_pool *pool)
 {
     int i;
-    struct workq *wq;
+    struct workq *wq, *min = NULL;
+    /*
+     * load counts queued and running tasks, so a burst of pushes spreads
+     * over the pool instead of piling on the first idle workq
+     */
     for (i = 0; i < pool->wq_array.num; i++) {
         wq = pool->wq_array.array[i];
         if (is_workq_underload(pool, wq))
-            break;
-    }
-    if (i == pool->wq_array.num) {
-        /*
-         * TODO: need do load blance
-         */
-        i = pool->wq_array.num - 1;
-        printf("all workq are overload, need expand, just force to last workq!\n");
+            return wq;
+        if (!min || wq->load < min->load)
+            min = wq;
     }
-    return pool->wq_array.array[i];
+    return min;
 }
 
 int workq_pool_task_push(struct workq_pool *pool, task_func_t func, void *data)
@@ -225,7 +233,7 @@ void workq_pool_destroy(struct workq_pool *pool)
     while (pool->wq_array.num > 0) {
         wq = pool->wq_array.array[pool->wq_array.num-1];
         workq_destroy(wq);
-        da_erase_item(pool->wq_array, &wq);
+        da_pop_back(pool->wq_array);
         free(wq);
     }
     da_free(pool->wq_array);
@@ -1 +0,0 @@
-../gear-lib/libbase64/libbase64.h
\ No newline at end of file
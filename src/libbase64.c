@@ -1 +0,0 @@
-../gear-lib/libbase64/libbase64.c
\ No newline at end of file